@@ -12,13 +12,18 @@
 extern "C" {
 #endif
 
-/* FIXME instead of these fixed-length buffers, there should be an
-   index_results structure that holds the individual results and a pool
-   of memory used for these string fields. */
+/* maximum sizes of the string fields of results (index_search_results
+   returns them in a pool of memory supplied by the caller instead of in
+   fixed-length buffers) */
 #define INDEX_SUMMARYLEN 1024        /* Maximum size of document summary */
 #define INDEX_TITLELEN 150           /* Maximum size of document title */
 #define INDEX_AUXILIARYLEN 150      /* Maximum size of auxiliary fields */
 
+/* maximum number of fields that the text of documents can be divided into
+ * (see the field attribute of psettings).  Field 0 holds all text that 
+ * isn't in another field.  Must be a power of two. */
+#define INDEX_FIELDS 8
+
 enum index_summary_type {
     INDEX_SUMMARISE_NONE = 0, /* no summary */
     INDEX_SUMMARISE_PLAIN = 1, /* summarise without highlighting */
@@ -45,6 +50,18 @@ enum index_stem {
     INDEX_STEM_LIGHT = 3            /* use light stemming algorithm */
 };
 
+/* compression schemes for the postings of document ordered lists (and the 
+ * document numbers of impact ordered lists) */
+enum index_codec {
+    INDEX_CODEC_VBYTE = 0,          /* vbyte coding (see vec.h) */
+    INDEX_CODEC_BLOCK = 1           /* Stream VByte blocks (see blockcodec.h),
+                                     * which decode faster.  Implies that 
+                                     * word positions are stored separately 
+                                     * from the postings.  Impact ordered 
+                                     * lists are bit-packed (see 
+                                     * impactcodec.h) */
+};
+
 /* options to be passed to index_new */
 enum index_new_opts {
     INDEX_NEW_NOOPT = 0,            /* pass this to indicate no options */
@@ -67,8 +84,15 @@ enum index_new_opts {
                                      * stoplist) */
     INDEX_NEW_TABLESIZE = (1 << 9), /* dictate how large the postings 
                                      * hashtable is */
-    INDEX_NEW_PARSEBUF = (1 << 10)  /* dictate how large the postings 
+    INDEX_NEW_PARSEBUF = (1 << 10), /* dictate how large the postings 
                                      * hashtable is */
+    INDEX_NEW_CODEC = (1 << 12),    /* compress document ordered lists using
+                                     * the given codec (default is 
+                                     * INDEX_CODEC_VBYTE) */
+    INDEX_NEW_DOCSTORE = (1 << 13)  /* keep a compressed copy of the 
+                                     * documents added, and retrieve them 
+                                     * from it rather than from the files 
+                                     * indexed */
 };
 
 /* XXX: comment me */
@@ -81,6 +105,7 @@ struct index_new_opt {
     unsigned int tablesize;
     unsigned int parsebuf;
     const char *qstop_file;
+    enum index_codec codec;
 };
 
 /* create a new, empty index.  config can now be NULL if default compile-time 
@@ -109,8 +134,21 @@ enum index_load_opts {
     INDEX_LOAD_QSTOP = (1 << 11),    /* stop at query time, using the file 
                                       * given as qstop_list (or NULL for 
                                       * default stoplist) */
-    INDEX_LOAD_DOCMAP_CACHE = (1 << 12)  /* specify which values to cache 
+    INDEX_LOAD_DOCMAP_CACHE = (1 << 12), /* specify which values to cache 
                                       * in-memory when the docmap loads */
+    INDEX_LOAD_MMAP = (1 << 13),     /* memory-map the inverted lists, 
+                                      * vocabulary and docmap (read-only) 
+                                      * rather than reading them, for indexes
+                                      * that are only being searched.  Reads
+                                      * are used where the OS can't map 
+                                      * files */
+    INDEX_LOAD_LIST_CACHE = (1 << 14), /* keep recently used inverted lists
+                                      * in memory, using at most list_cache
+                                      * bytes */
+    INDEX_LOAD_RESULT_CACHE = (1 << 15) /* keep the results of recent 
+                                      * searches, using at most result_cache
+                                      * bytes, so that repeated searches 
+                                      * don't have to be evaluated again */
 };
 
 /* XXX: comment me */
@@ -121,6 +159,8 @@ struct index_load_opt {
     unsigned int parsebuf;
     const char *qstop_file;
     int docmap_cache;
+    unsigned int list_cache;
+    unsigned int result_cache;
 };
 
 #define INDEX_MEMORY_UNLIMITED 0    /* Don't limit memory usage */
@@ -160,6 +200,32 @@ struct index_stats {
                                       positions vectors are in index */
     unsigned int impact_vectors; /* indicates if impact ordered vectors are in
                                     index */
+    unsigned int skip_vectors;   /* indicates if long doc-order vectors have
+                                    skip tables */
+    unsigned int separate_positions; /* indicates if doc-order vectors store
+                                    word positions separately */
+    enum index_codec list_codec; /* compression used by doc-order vectors */
+    unsigned int docstore;       /* indicates if documents are retrieved
+                                    from a document store */
+    unsigned int score_bounds;   /* indicates if the vocab holds upper bounds
+                                    on the scores of postings */
+    unsigned int fields;         /* number of fields documents are divided 
+                                    into (1 if they aren't) */
+
+    /* caches (sizes are 0 if the cache isn't in use).  The list and result
+     * caches are emptied whenever the index is committed (blocks of the 
+     * document store never change). */
+    unsigned int list_cache;        /* bytes of inverted lists cached */
+    unsigned long int list_cache_lookups; /* times a list was looked for */
+    unsigned long int list_cache_hits; /* times a list was found */
+    unsigned int result_cache;      /* bytes of search results cached */
+    unsigned long int result_cache_lookups; /* times results were looked 
+                                     * for */
+    unsigned long int result_cache_hits; /* times results were found */
+    unsigned int store_cache;       /* bytes of document store blocks 
+                                     * cached */
+    unsigned long int store_cache_lookups; /* times a block was looked for */
+    unsigned long int store_cache_hits; /* times a block was found */
 };
 
 /* struct to record statistics about the index that take a while to 
@@ -181,6 +247,11 @@ struct index_expensive_stats {
                                      * stored in the vocabulary */
     double vocab_structure;         /* size of structural information stored 
                                      * in the vocabulary */
+    double vectors_postings;        /* total size of document numbers and 
+                                     * frequencies in lists with separate 
+                                     * word positions */
+    double vectors_positions;       /* total size of word positions in lists
+                                     * with separate word positions */
     /* XXX: size of query processing vectors? */
     /* XXX: docmap aux string size? */
 };
@@ -247,7 +318,55 @@ enum index_search_opts {
      * default ACCUMULATOR_LIMIT adjusted to a minimum of 1%.  Note that
      * if you explicitly set the accumulator limit, then _no_ adjustment
      * is made for either collection size or number of results requested. */
-    INDEX_SEARCH_ACCUMULATOR_LIMIT = (1 << 9)
+    INDEX_SEARCH_ACCUMULATOR_LIMIT = (1 << 9),
+
+    /* evaluate document-at-a-time, using per-term upper bounds on scores
+     * to skip documents that can't make it into the requested results
+     * (the MaxScore strategy).  Results are identical to exhaustive
+     * evaluation, and the accumulator limit doesn't apply.  Only Okapi and
+     * Dirichlet ranking are pruned, other metrics ignore this flag.  Note
+     * that the number of results is estimated when pruning occurs. */
+    INDEX_SEARCH_PRUNE = (1 << 11),
+
+    /* summarise results on this many threads at once (supply as unsigned 
+     * int).  Summaries are the same as those produced one at a time, which 
+     * is what happens if this isn't given, or zettair was built without 
+     * thread support. */
+    INDEX_SEARCH_SUMMARY_THREADS = (1 << 12),
+
+    /* evaluate impact-ordered queries (INDEX_SEARCH_ANH_IMPACT_RANK) as 
+     * anytime queries: blocks of postings are processed strictly in 
+     * decreasing order of impact, without the term and block fines that 
+     * otherwise end evaluation early, until budget_postings postings have 
+     * been processed or budget_usec microseconds have passed (supply both 
+     * as unsigned long int, 0 meaning unlimited).  Evaluation stops at the 
+     * first block boundary after the budget runs out.  If it stops before
+     * every posting has been processed (or the accumulator limit drops
+     * postings), INDEX_SEARCH_EST_RESULTS is set in the value written into 
+     * est, and the results aren't kept in the result cache.  Other metrics 
+     * ignore this flag. */
+    INDEX_SEARCH_ANYTIME = (1 << 13),
+
+    /* use BM25F ranking, as described in Robertson, Zaragoza and Taylor, 
+     * 'Simple BM25 extension to multiple weighted fields', CIKM 2004.  
+     * Occurrences in each field are boosted and length normalised 
+     * separately before being combined into one term frequency, so you'll 
+     * need to provide k1, k3 and boost and b for each field (see 
+     * INDEX_FIELDS).  Searching an index with fields fails if its word 
+     * positions aren't stored with the postings (they aren't when the index
+     * uses separate positions or INDEX_CODEC_BLOCK).  With one field it 
+     * ranks as Okapi does. */
+    INDEX_SEARCH_BM25F_RANK = (1 << 14)
+};
+
+/* bits of the value written into est by index_search and its variants */
+enum index_search_est {
+    INDEX_SEARCH_EST_TOTAL = (1 << 0),   /* total number of results is 
+                                          * estimated */
+    INDEX_SEARCH_EST_RESULTS = (1 << 1)  /* results aren't those of complete
+                                          * evaluation, because an anytime 
+                                          * query ran out of budget (or 
+                                          * accumulators) */
 };
 
 /* FIXME: comment me */
@@ -271,11 +390,21 @@ struct index_search_opt {
             float alpha;
             float k3;
         } hawkapi;
+
+        struct {
+            float k1;
+            float k3;
+            float boost[INDEX_FIELDS];
+            float b[INDEX_FIELDS];
+        } bm25f;
     } u;
 
     unsigned int word_limit;
     unsigned int accumulator_limit;
     enum index_summary_type summary_type;
+    unsigned int summary_threads;
+    unsigned long int budget_postings;
+    unsigned long int budget_usec;
 };
 
 /* search the index.  idx is a loaded or created index, query is a
@@ -286,12 +415,72 @@ struct index_search_opt {
  * Returns true on success and 0 on failure.  On successful return, the number
  * of results returned is written into *results, and the total number of
  * matching documents is written into *total_results.  value written into est
- * indicates whether *total_results is estimated (non-zero) or exact (zero). */
+ * indicates whether *total_results is estimated (non-zero) or exact (zero), 
+ * and is made up of the bits of enum index_search_est above. */
 int index_search(struct index *idx, const char *query, 
   unsigned long int startdoc, unsigned long int len, 
   struct index_result *result, unsigned int *results, 
   double *total_results, int *est, int opts, struct index_search_opt *opt);
 
+/* fields of each result that index_search_results and index_search_stream
+ * can fill in.  The document number and score are always returned. */
+enum index_result_fields {
+    INDEX_RESULT_SCORE = 0,              /* document number and score only */
+    INDEX_RESULT_AUX = (1 << 0),         /* auxilliary information, such as 
+                                          * the TREC number or URL */
+    INDEX_RESULT_TITLE = (1 << 1),       /* document title */
+    INDEX_RESULT_SUMMARY = (1 << 2)      /* query-biased summary, of the type 
+                                          * given by INDEX_SEARCH_SUMMARY_TYPE 
+                                          * (plain if it isn't given).  Titles 
+                                          * are found while summarising, so 
+                                          * either costs about as much as 
+                                          * both */
+};
+
+/* struct that is returned for each document found by index_search_results
+ * and index_search_stream.  The fields point to NUL-terminated strings of the
+ * given lengths, or are NULL if they weren't requested (or didn't fit). */
+struct index_hit {
+    unsigned long int docno;        /* the distinct number given to this doc */
+    float score;                    /* strength of the match to query */
+    const char *aux;                /* auxilliary information, see above */
+    unsigned int aux_len;           /* length of aux */
+    const char *title;              /* the title of the document */
+    unsigned int title_len;         /* length of title */
+    const char *summary;            /* a summary of the document */
+    unsigned int summary_len;       /* length of summary */
+};
+
+/* number of bytes of arena that index_search_results needs to return all 
+ * fields of len results */
+#define INDEX_RESULT_ARENA(len, fields)                                       \
+  ((len) * ((((fields) & INDEX_RESULT_AUX) ? INDEX_AUXILIARYLEN + 1 : 0)      \
+    + (((fields) & INDEX_RESULT_TITLE) ? INDEX_TITLELEN + 1 : 0)              \
+    + (((fields) & INDEX_RESULT_SUMMARY) ? INDEX_SUMMARYLEN + 1 : 0)))
+
+/* search the index as index_search does, but only look up the fields of each
+ * result given in fields (a bitfield of enum index_result_fields above).
+ * Results are written into the array result of length len, and their fields
+ * into arena, a buffer of arenalen bytes.  Fields that don't fit in the arena
+ * are returned as NULL, which can't happen if it's INDEX_RESULT_ARENA bytes
+ * long.  Other arguments and the return value are as for index_search. */
+int index_search_results(struct index *idx, const char *query, 
+  unsigned long int startdoc, unsigned long int len, unsigned int fields,
+  struct index_hit *result, char *arena, unsigned long int arenalen, 
+  unsigned int *results, double *total_results, int *est, int opts, 
+  struct index_search_opt *opt);
+
+/* search the index as index_search_results does, but pass each result in 
+ * turn to fn (along with opaque) instead of storing it.  The result and its
+ * fields are only valid for the duration of the call.  If fn returns 0, no 
+ * more results are passed to it.  The number of results passed is written 
+ * into *results. */
+int index_search_stream(struct index *idx, const char *query, 
+  unsigned long int startdoc, unsigned long int len, unsigned int fields,
+  int (*fn)(void *opaque, const struct index_hit *result), void *opaque,
+  unsigned int *results, double *total_results, int *est, int opts, 
+  struct index_search_opt *opt);
+
 /* retrieve a portion of a document from the index cache.  idx is the index,
  * docno is the document number to retrieve, offset is the offset in the
  * document from which to start retrieval.  dst is a buffer of size dstsize that
@@ -328,11 +517,44 @@ enum index_commit_opts {
     INDEX_COMMIT_NOOPT = 0,              /* pass this to indicate no flags */
     INDEX_COMMIT_DUMPBUF = (1 << 1),     /* buffer update writing (supply size 
                                           * of buffer as unsigned int) */
-    INDEX_COMMIT_ANH_IMPACTS = (1 << 10) /* create Anh impact-ordered vectors */
+    INDEX_COMMIT_ANH_IMPACTS = (1 << 10),/* create Anh impact-ordered vectors */
+    INDEX_COMMIT_SKIPS = (1 << 11),      /* add skip tables to long 
+                                          * doc-ordered vectors (they are 
+                                          * maintained by all later commits).
+                                          * Building an index with this, 
+                                          * separate positions or 
+                                          * INDEX_CODEC_BLOCK costs another 
+                                          * read and write of the vector 
+                                          * file after the merge; updates 
+                                          * lay out vectors as they merge 
+                                          * them, at no extra I/O */
+    INDEX_COMMIT_SEPARATE_POSITIONS = (1 << 12), /* store word positions of 
+                                          * doc-ordered vectors after their 
+                                          * postings, so that ranked queries 
+                                          * don't read them (maintained by 
+                                          * all later commits) */
+    INDEX_COMMIT_SEGMENTS = (1 << 13),   /* write updates out as segments 
+                                          * that are merged in the 
+                                          * background, rather than merging 
+                                          * them into the index (used by all 
+                                          * later commits) */
+    INDEX_COMMIT_BOUNDS = (1 << 14),     /* store upper bounds on the scores
+                                          * of postings in the vocab (supply
+                                          * okapi and dirichlet parameters 
+                                          * as bound_k1, bound_b and 
+                                          * bound_mu; they are maintained by
+                                          * all later commits) */
+    INDEX_COMMIT_THREADS = (1 << 15)     /* create impact-ordered vectors 
+                                          * on this many threads at once 
+                                          * (supply as unsigned int) */
 };
 
 struct index_commit_opt {
     unsigned int dumpbuf;
+    double bound_k1;
+    double bound_b;
+    double bound_mu;
+    unsigned int threads;
 };
 
 /* options that can be passed to index_add */
@@ -358,7 +580,12 @@ struct index_add_opt {
  * *docs with the number of documents extracted from the file.  opts specify
  * options to use when updating the index.  You can supply options for the
  * adding operation using opt(s), and options for commits that occur during the
- * process using commitopt(s) */
+ * process using commitopt(s).  Documents added to an index that has already
+ * been built can be found by index_search (except for impact ordered queries) 
+ * as soon as this returns.  The number of documents and the total number of 
+ * terms in the collection count them as soon as each is added, but the 
+ * average document weight and length aren't updated until they're committed.
+ * Searches must not be run while documents are being added. */
 int index_add(struct index *idx, const char *file, const char *mimetype,
   unsigned long int *docno, unsigned int *docs, 
   unsigned int opts, struct index_add_opt *opt, 
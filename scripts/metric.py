@@ -160,7 +160,7 @@ def usage(progname, decode = None, post = None):
 
 class Decl:
     def __init__(self, lineno, name, type, init, level, macro, 
-      comment, fninit, pre, contrib, ex):
+      comment, fninit, pre, contrib, bound, ex):
 
         self.pre = pre
         self.lineno = lineno
@@ -176,6 +176,9 @@ class Decl:
         # contrib is what happens if we have to calculate the
         # contribution without a specific document 
         self.contrib = contrib
+        # bound is what happens if we have to calculate the largest 
+        # contribution over all documents
+        self.bound = bound
         self.ex = ex
 
     def __repr__(self):
@@ -186,7 +189,7 @@ class Decl:
           % (self.type, self.name, self.init, self.fninit, self.level, self.lineno, self.macro, self.comment, self.pre)
 
 def ins_decl(namespaces, used, line, level, macro = '', 
-  lineno = -1, fninit = '', pre = '', contrib = '', ex = ''):
+  lineno = -1, fninit = '', pre = '', contrib = '', ex = '', bound = ''):
     # check for and remove trailing comment
     comment = ''
     pos = line.find('#')
@@ -250,7 +253,8 @@ def ins_decl(namespaces, used, line, level, macro = '',
         # accept declaration
         for n in namespaces:
             n[toks[0]] = Decl(lineno, toks[0], type.strip(), 
-              init.strip(), level, macro, comment, fninit, pre, contrib, ex)
+              init.strip(), level, macro, comment, fninit, pre, contrib, 
+              bound, ex)
 
         # identify quantities used in contrib (XXX: we only insert
         # them in the first namespace/used combo - this is dodgy) 
@@ -382,7 +386,7 @@ def propagate(statements):
         prevlevel = s[1]
 
     rev = map(lambda x: x, statements)
-    rev.reverse
+    rev.reverse()
 
     prevlevel = 0
     for s in rev:
@@ -481,6 +485,12 @@ def contrib_replace(x):
     else:
         return x.macro
 
+def bound_replace(x):
+    if (len(x.bound)):
+        return x.bound
+    else:
+        return x.macro
+
 def get_replace_map(decls, fn = (lambda x: x.macro)):
     map = {}
     for i in filter(lambda x: len(fn(decls[x])) > 0, decls):
@@ -539,6 +549,8 @@ if __name__ == "__main__":
       ex='number of times term occurs in collection')
     ins_decl([decode_decl], [decode_used], 'const unsigned int f_dt;', 3,
       ex='number of times term occurs in current document')
+    ins_decl([decode_decl], [decode_used], 'const unsigned int f_dtf;', 3,
+      ex='number of times term occurs in each field of current document (array)')
     #ins_decl([decode_decl], [decode_used], 'const unsigned int offset;', 4)
     #ins_decl([decode_decl], [decode_used], 'const unsigned int attr;', 5)
 
@@ -595,19 +607,40 @@ if __name__ == "__main__":
     ins_decl([decode_decl, post_decl], [decode_used, post_used], 
       'const unsigned int D_bytes;', 2, 'docmap_get_bytes_cached(idx->map, acc->acc.docno)', -1, '', 
       'if (docmap_cache(idx->map, docmap_get_cache(idx->map) | DOCMAP_CACHE_BYTES) != DOCMAP_OK) return SEARCH_EINVAL;', '((float) avg_D_bytes)',
+      bound='0',
       ex='number of bytes in the current document')
     ins_decl([decode_decl, post_decl], [decode_used, post_used], 
       'const unsigned int D_terms;', 2, 'DOCMAP_GET_WORDS(idx->map, acc->acc.docno)', -1, '',
       'if (docmap_cache(idx->map, docmap_get_cache(idx->map) | DOCMAP_CACHE_WORDS) != DOCMAP_OK) return SEARCH_EINVAL;', '((float) avg_D_terms)',
+      bound='0',
       ex='number of terms in the current document')
     ins_decl([decode_decl, post_decl], [decode_used, post_used], 
       'const unsigned int D_dterms;', 2, 'DOCMAP_GET_DISTINCT_WORDS(idx->map, acc->acc.docno)', -1, '',
       'if (docmap_cache(idx->map, docmap_get_cache(idx->map) | DOCMAP_CACHE_DISTINCT_WORDS) != DOCMAP_OK) return SEARCH_EINVAL;', '((float) avg_D_dterms)',
+      bound='0',
       ex='number of distinct terms in the current document')
     ins_decl([decode_decl, post_decl], [decode_used, post_used], 
       'const float D_weight;', 2, 'DOCMAP_GET_WEIGHT(idx->map, acc->acc.docno)', -1, '',
       'if (docmap_cache(idx->map, docmap_get_cache(idx->map) | DOCMAP_CACHE_WEIGHT) != DOCMAP_OK) return SEARCH_EINVAL;', '((float) avg_D_weight)',
+      bound='0',
       ex='cosine weight of the current document')
+    ins_decl([decode_decl, post_decl], [decode_used, post_used], 
+      'const unsigned int fields = idx->fields;', 1,
+      ex='number of fields documents are divided into')
+    ins_decl([decode_decl, post_decl], [decode_used, post_used], 
+      'double avg_D_fterms[INDEX_FIELDS];', 1, '', -1,
+      '''\
+         if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+             return SEARCH_EINVAL;
+         }''',
+      ex='average terms in each field per document in the collection (array)')
+    # note that the bound for field lengths isn't a bound at all, so metrics
+    # using them can't be pruned
+    ins_decl([decode_decl, post_decl], [decode_used, post_used], 
+      'const unsigned int D_fterms;', 2, 'DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno)', -1, '',
+      'if (docmap_cache(idx->map, docmap_get_cache(idx->map) | DOCMAP_CACHE_FIELD_WORDS) != DOCMAP_OK) return SEARCH_EINVAL;', 'avg_D_fterms',
+      bound='avg_D_fterms',
+      ex='number of terms in each field of the current document (array)')
     ins_decl([decode_decl, post_decl], [decode_used, post_used], 
       'const unsigned int f_qt;', 1, 'query->term[qterm].f_qt',
       ex='number of times the current term occurred in the query')
@@ -650,6 +683,9 @@ if __name__ == "__main__":
                 vname = vname[0].strip()
                 if (vname[-1] == ';'):
                     vname = vname[0:-1]
+                # array parameters are named without their dimension
+                if (vname.find('[') > 0):
+                    vname = vname[0:vname.find('[')]
 
                 ins_decl([params, post_decl, decode_decl], 
                   [decode_used, post_used], line[len('parameter'):], 
@@ -795,6 +831,11 @@ if __name__ == "__main__":
                           and nt[0] == 'METRIC_DEPENDS_POST'):
                             print '/* METRIC_DEPENDS_POST */', len(post),
                             toks = nnt[1:]
+                        elif (toks[0] == '/*' and len(nnt) and nnt[0] == '*/' 
+                          and nt[0] == 'METRIC_FIELDS'):
+                            print '/* METRIC_FIELDS */', 
+                            print int(decode_used.has_key('f_dtf')),
+                            toks = nnt[1:]
                         elif (toks[0] == '/*' and len(nnt) and nnt[0] == '*/' 
                           and nt[0] == 'METRIC_PRE'):
                             print '/* METRIC_PRE */'
@@ -854,6 +895,23 @@ if __name__ == "__main__":
                               get_replace_map(decode_decl, contrib_replace))
                             #print '#line %u "%s"' % (currline, args[1])
                             toks = nnt[1:]
+                        elif (toks[0] == '/*' and len(nnt) and nnt[0] == '*/' 
+                          and nt[0] == 'METRIC_BOUND'):
+                            print '/* METRIC_BOUND */'
+                            # output level two and three stuff, using
+                            # the values of document quantities that 
+                            # maximise the contribution 
+                            print_level(decode, 2, dent, name, 
+                              get_replace_map(decode_decl, bound_replace))
+                            print_level(decode, 3, dent, name,
+                              get_replace_map(decode_decl, bound_replace))
+                            toks = nnt[1:]
+                        elif (toks[0] == '/*' and len(nnt) and nnt[0] == '*/' 
+                          and nt[0] == 'METRIC_POST_BOUND'):
+                            print '/* METRIC_POST_BOUND */'
+                            print_level(post, 2, dent, name, 
+                              get_replace_map(post_decl, bound_replace))
+                            toks = nnt[1:]
                         else:
                             sys.stdout.write(toks[0])
                             toks = toks[1:]
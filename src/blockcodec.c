@@ -0,0 +1,247 @@
+/* blockcodec.c implements the Stream VByte block coding described in
+ * blockcodec.h.
+ *
+ * Decoding proceeds a control byte (four numbers) at a time.  Where the
+ * processor supports SSSE3, the data bytes of each four numbers are moved
+ * into place with a single shuffle, using a precomputed mask for each
+ * possible control byte.  Otherwise, each number is loaded as four bytes and
+ * masked down to its length, which avoids branching on the lengths.  Both
+ * kernels read up to 16 bytes past the current number, so the last few
+ * numbers of each block are decoded a byte at a time.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "blockcodec.h"
+
+#include "vec.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (__GNUC__ >= 5) \
+  && (defined(__x86_64__) || defined(__i386__))
+#define BLOCKCODEC_SSSE3
+#include <tmmintrin.h>
+#endif
+
+/* length in bytes of number num (0 - 3) of a control byte */
+#define LEN(c, num) ((((c) >> (2 * (num))) & 3) + 1)
+
+/* offset of the data of number num of a control byte from the start of the
+ * data for the control byte */
+#define OFF(c, num)                                                           \
+    (((num) > 0 ? LEN(c, 0) : 0) + ((num) > 1 ? LEN(c, 1) : 0)                \
+      + ((num) > 2 ? LEN(c, 2) : 0))
+
+/* macros to expand a table with an entry for each control byte */
+#define ROW4(E, c) E(c), E((c) + 1), E((c) + 2), E((c) + 3)
+#define ROW16(E, c) ROW4(E, c), ROW4(E, (c) + 4), ROW4(E, (c) + 8),           \
+  ROW4(E, (c) + 12)
+#define ROW64(E, c) ROW16(E, c), ROW16(E, (c) + 16), ROW16(E, (c) + 32),      \
+  ROW16(E, (c) + 48)
+#define TABLE(E) ROW64(E, 0), ROW64(E, 64), ROW64(E, 128), ROW64(E, 192)
+
+/* total number of data bytes described by each control byte */
+#define CTRL_LEN(c) (OFF(c, 3) + LEN(c, 3))
+static const unsigned char ctrl_len[256] = {TABLE(CTRL_LEN)};
+
+/* mask to remove bytes beyond the length of a number loaded as four bytes,
+ * indexed by length less one */
+static const uint32_t len_mask[4] = {0xff, 0xffff, 0xffffff, 0xffffffff};
+
+#ifdef BLOCKCODEC_SSSE3
+
+/* shuffle masks to move the data for each control byte into four 32-bit
+ * numbers (0xff zeroes the byte) */
+#define SHUF_BYTE(c, num, byte)                                               \
+    ((byte) < LEN(c, num) ? OFF(c, num) + (byte) : 0xff)
+#define SHUF_NUM(c, num)                                                      \
+    SHUF_BYTE(c, num, 0), SHUF_BYTE(c, num, 1), SHUF_BYTE(c, num, 2),         \
+      SHUF_BYTE(c, num, 3)
+#define SHUF(c) {SHUF_NUM(c, 0), SHUF_NUM(c, 1), SHUF_NUM(c, 2), SHUF_NUM(c, 3)}
+static const unsigned char shuf[256][16] = {TABLE(SHUF)};
+
+/* decode groups of four numbers from data into out using the shuffle masks,
+ * for as long as it's safe to load 16 bytes from data.  Returns the number
+ * of control bytes used. */
+__attribute__((target("ssse3")))
+static unsigned int decode_ssse3(const unsigned char *ctrl,
+  unsigned int groups, const unsigned char **data,
+  const unsigned char *end, uint32_t *out) {
+    const unsigned char *pos = *data;
+    unsigned int i;
+
+    for (i = 0; (i < groups) && (end - pos >= 16); i++) {
+        __m128i in = _mm_loadu_si128((const __m128i *) pos),
+                mask = _mm_loadu_si128((const __m128i *) shuf[ctrl[i]]);
+
+        _mm_storeu_si128((__m128i *) &out[4 * i],
+          _mm_shuffle_epi8(in, mask));
+        pos += ctrl_len[ctrl[i]];
+    }
+
+    *data = pos;
+    return i;
+}
+
+#endif
+
+/* decode groups of four numbers from data into out, for as long as it's safe
+ * to load all 16 bytes that a group may occupy.  Returns the number of
+ * control bytes used. */
+static unsigned int decode_masked(const unsigned char *ctrl,
+  unsigned int groups, const unsigned char **data,
+  const unsigned char *end, uint32_t *out) {
+    const unsigned char *pos = *data;
+    unsigned int i,
+                 j,
+                 c;
+
+    for (i = 0; (i < groups) && (end - pos >= 16); i++) {
+        c = ctrl[i];
+        for (j = 0; j < 4; j++) {
+            out[4 * i + j] = (pos[0] | ((uint32_t) pos[1] << 8)
+                | ((uint32_t) pos[2] << 16) | ((uint32_t) pos[3] << 24))
+              & len_mask[LEN(c, j) - 1];
+            pos += LEN(c, j);
+        }
+    }
+
+    *data = pos;
+    return i;
+}
+
+/* decode n numbers from data into out, a byte at a time.  Returns false if
+ * the numbers don't exactly fill the data up to end. */
+static int decode_bytes(const unsigned char *ctrl, unsigned int n,
+  const unsigned char *data, const unsigned char *end, uint32_t *out) {
+    unsigned int i,
+                 len,
+                 b;
+
+    for (i = 0; i < n; i++) {
+        len = LEN(ctrl[i / 4], i % 4);
+        if (end - data < (int) len) {
+            return 0;
+        }
+        out[i] = 0;
+        for (b = 0; b < len; b++) {
+            out[i] |= (uint32_t) data[b] << (8 * b);
+        }
+        data += len;
+    }
+
+    return data == end;
+}
+
+/* internal function to read the header of a block from v into n and datalen,
+ * returning the number of bytes it occupies, or 0 if v doesn't hold the whole
+ * block */
+static unsigned int header_read(struct vec *v, unsigned long int *n,
+  unsigned long int *datalen) {
+    unsigned int bytes,
+                 len = 0;
+
+    if ((bytes = vec_vbyte_read(v, n))) {
+        len = vec_vbyte_read(v, datalen);
+        v->pos -= bytes + len;
+        bytes += len;
+        if (len
+          && (*n <= BLOCKCODEC_INTS)
+          && (*datalen <= 4 * BLOCKCODEC_INTS)
+          && (VEC_LEN(v) >= bytes + (*n + 3) / 4 + *datalen)) {
+            return bytes;
+        }
+    }
+    return 0;
+}
+
+unsigned int blockcodec_write(struct vec *v, const uint32_t *ints,
+  unsigned int n) {
+    unsigned int i,
+                 len,
+                 datalen = 0,
+                 bytes;
+    unsigned char *ctrl,
+                  *data;
+    uint32_t num;
+
+    assert(n <= BLOCKCODEC_INTS);
+    for (i = 0; i < n; i++) {
+        datalen += 1 + (ints[i] > 0xff) + (ints[i] > 0xffff)
+          + (ints[i] > 0xffffff);
+    }
+
+    bytes = vec_vbyte_len(n) + vec_vbyte_len(datalen) + (n + 3) / 4 + datalen;
+    if (VEC_LEN(v) < bytes) {
+        return 0;
+    }
+
+    vec_vbyte_write(v, n);
+    vec_vbyte_write(v, datalen);
+    ctrl = (unsigned char *) v->pos;
+    data = ctrl + (n + 3) / 4;
+    memset(ctrl, 0, (n + 3) / 4);
+    for (i = 0; i < n; i++) {
+        num = ints[i];
+        len = 1 + (num > 0xff) + (num > 0xffff) + (num > 0xffffff);
+        ctrl[i / 4] |= (len - 1) << (2 * (i % 4));
+        do {
+            *data++ = num & 0xff;
+            num >>= 8;
+        } while (--len);
+    }
+    v->pos = (char *) data;
+    return bytes;
+}
+
+unsigned int blockcodec_read(struct vec *v, uint32_t *ints) {
+    unsigned long int n,
+                      datalen;
+    unsigned int bytes,
+                 groups,
+                 done = 0;
+    const unsigned char *ctrl,
+                        *data,
+                        *end;
+
+    if (!(bytes = header_read(v, &n, &datalen)) || !n) {
+        return 0;
+    }
+
+    ctrl = (const unsigned char *) v->pos + bytes;
+    data = ctrl + (n + 3) / 4;
+    end = data + datalen;
+    groups = n / 4;
+
+#ifdef BLOCKCODEC_SSSE3
+    if (__builtin_cpu_supports("ssse3")) {
+        done = decode_ssse3(ctrl, groups, &data, end, ints);
+    }
+#endif
+    done += decode_masked(ctrl + done, groups - done, &data, end,
+      ints + 4 * done);
+
+    /* decode the remainder, checking that they end where the block does */
+    if (!decode_bytes(ctrl + done, n - 4 * done, data, end, ints + 4 * done)) {
+        return 0;
+    }
+
+    v->pos = (char *) end;
+    return n;
+}
+
+unsigned int blockcodec_scan(struct vec *v) {
+    unsigned long int n,
+                      datalen;
+    unsigned int bytes;
+
+    if ((bytes = header_read(v, &n, &datalen))) {
+        v->pos += bytes + (n + 3) / 4 + datalen;
+        return n;
+    }
+    return 0;
+}
+
@@ -0,0 +1,1150 @@
+/* bm25f.c implements the bm25f metric for the zettair query
+ * subsystem.  This file was automatically generated from
+ * src/bm25f.metric and src/metric.c
+ * by scripts/metric.py on Sun, 18 Oct 2026 11:04:56 GMT.  
+ *
+ * DO NOT MODIFY THIS FILE, as changes will be lost upon 
+ * subsequent regeneration (and this code is repetitive enough 
+ * that you probably don't want to anyway).  
+ * Go modify src/bm25f.metric or src/metric.c instead.  
+ * 
+ * Comments from bm25f.metric:
+ *
+ * bm25f.metric is a functional description in our funny zettair metric
+ * language (see metric.py) of how the BM25F metric should operate.
+ * 
+ * BM25F is described in 'Simple BM25 extension to multiple weighted fields'
+ * by Robertson, Zaragoza and Taylor (CIKM 2004).  Rather than adding up
+ * okapi scores for each field, it normalises the occurrences of the term in
+ * each field by the length of that field (with its own b), weights them by a
+ * per-field boost, and then saturates their sum once, as okapi does f_dt.
+ * With a single field (or all boosts 1 and all b the same, in an index
+ * without fields) it gives the same scores as okapi_k3.
+ *
+ */
+
+
+#include "firstinclude.h"
+
+#include "metric.h"
+
+#include "_index.h"
+#include "_docmap.h"
+#include "index_querybuild.h"
+
+#include "blockcodec.h"
+#include "def.h"
+#include "objalloc.h"
+#include "docmap.h"
+#include "search.h"
+#include "vec.h"
+
+#include <assert.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <stdlib.h>
+
+/* whether the metric needs to know how many occurrences are in each field */
+#define FIELDS /* METRIC_FIELDS */ 1
+
+static enum search_ret pre(struct index *idx, struct query *query, 
+  int opts, struct index_search_opt *opt) {
+    /* METRIC_PRE */
+    if (docmap_cache(idx->map, docmap_get_cache(idx->map) | DOCMAP_CACHE_FIELD_WORDS) != DOCMAP_OK) return SEARCH_EINVAL;
+
+    return SEARCH_OK;
+}
+
+static enum search_ret post(struct index *idx, struct query *query, 
+  struct search_acc_cons *acc, int opts, struct index_search_opt *opt) {
+    /* METRIC_POST */
+
+
+    while (acc) {
+        assert(acc->acc.docno < docmap_entries(idx->map));
+        /* METRIC_POST_PER_DOC */
+
+        acc = acc->next;
+    }
+
+    return SEARCH_OK;
+}
+
+/* macro to atomically read the next docno and f_dt from a vector 
+ * (note: i also tried a more complicated version that tested for a long vec 
+ * and used unchecked reads, but measurements showed no improvement) */
+#define NEXT_VBYTE_DOC(v, docno, f_dt)                                        \
+    (vec_vbyte_read(v, &docno_d)                                              \
+      && (((vec_vbyte_read(v, &f_dt) && ((docno += docno_d + 1), 1))          \
+        /* second read failed, reposition vec back to start of docno_d */     \
+        || (((v)->pos -= vec_vbyte_len(docno_d)), 0))))
+
+/* macro to read the next docno and f_dt from a block coded vector, decoding
+ * the next whole block from v into blk when the current one runs out */
+#define NEXT_BLOCK_DOC(v, blk, docno, f_dt)                                   \
+    ((((blk).pos < (blk).n)                                                   \
+        || (((blk).pos = 0), ((blk).n = blockcodec_read(v, (blk).ints))))     \
+      && ((docno += (blk).ints[(blk).pos] + 1),                               \
+        (f_dt = (blk).ints[(blk).pos + 1]), ((blk).pos += 2), 1))
+
+/* macro to read the next docno and f_dt from a source, however it's coded */
+#define NEXT_DOC(src, v, blk, docno, f_dt)                                    \
+    ((src)->blocks                                                            \
+      ? NEXT_BLOCK_DOC(v, blk, docno, f_dt)                                   \
+      : NEXT_VBYTE_DOC(v, docno, f_dt))
+
+/* macro to scan over f_dt offsets from a vector/source (if the source has
+ * them) */
+#define SCAN_OFFSETS(src, v, f_dt)                                            \
+    do {                                                                      \
+        unsigned int toscan = (src)->offsets ? f_dt : 0,                      \
+                     scanned;                                                 \
+        enum search_ret sret;                                                 \
+                                                                              \
+        while (toscan) {                                                      \
+            if ((scanned = vec_vbyte_scan(v, toscan, &scanned)) == toscan) {  \
+                toscan = 0;                                                   \
+                break;                                                        \
+            } else if (scanned < toscan) {                                    \
+                toscan -= scanned;                                            \
+                /* need to read more */                                       \
+                if ((sret = src->readlist(src, VEC_LEN(v),                    \
+                    (void **) &(v)->pos, &bytes)) == SEARCH_OK) {             \
+                                                                              \
+                    (v)->end = (v)->pos + bytes;                              \
+                } else if (sret == SEARCH_FINISH) {                           \
+                    /* shouldn't end while scanning offsets */                \
+                    return SEARCH_EINVAL;                                     \
+                } else {                                                      \
+                    return sret;                                              \
+                }                                                             \
+            } else {                                                          \
+                assert("can't get here" && 0);                                \
+                return SEARCH_EINVAL;                                         \
+            }                                                                 \
+        }                                                                     \
+    } while (0)
+
+/* macro to count all f_dt occurrences in the first field, for when there 
+ * aren't offsets to say otherwise */
+#define FIRST_FIELD(f_dtf, f_dt)                                              \
+    do {                                                                      \
+        unsigned int field;                                                   \
+                                                                              \
+        f_dtf[0] = f_dt;                                                      \
+        for (field = 1; field < INDEX_FIELDS; field++) {                      \
+            f_dtf[field] = 0;                                                 \
+        }                                                                     \
+    } while (0)
+
+/* macro to read f_dt offsets from a vector/source (if the source has them), 
+ * counting the number in each field (which tags the bottom bits of each 
+ * offset) into f_dtf */
+#define FIELD_OFFSETS(src, v, f_dt, f_dtf)                                    \
+    do {                                                                      \
+        unsigned long int toread = (src)->offsets ? f_dt : 0,                 \
+                          pos = -1,                                           \
+                          gap;                                                \
+        enum search_ret sret;                                                 \
+                                                                              \
+        FIRST_FIELD(f_dtf, toread ? 0 : f_dt);                                \
+        while (toread) {                                                      \
+            if (vec_vbyte_read(v, &gap)) {                                    \
+                pos += gap + 1;   /* + 1 to negate encoding */                \
+                f_dtf[pos & ((1U << idx->field_bits) - 1)]++;                 \
+                toread--;                                                     \
+            } else if ((sret = src->readlist(src, VEC_LEN(v),                 \
+                (void **) &(v)->pos, &bytes)) == SEARCH_OK) {                 \
+                                                                              \
+                (v)->end = (v)->pos + bytes;                                  \
+            } else if (sret == SEARCH_FINISH) {                               \
+                /* shouldn't end while reading offsets */                     \
+                return SEARCH_EINVAL;                                         \
+            } else {                                                          \
+                return sret;                                                  \
+            }                                                                 \
+        }                                                                     \
+    } while (0)
+
+/* macro to get past f_dt offsets from a vector/source, counting them into 
+ * f_dtf only if the metric needs them */
+#if FIELDS
+#define OFFSETS(src, v, f_dt, f_dtf) FIELD_OFFSETS(src, v, f_dt, f_dtf)
+#else
+#define OFFSETS(src, v, f_dt, f_dtf) SCAN_OFFSETS(src, v, f_dt)
+#endif /* FIELDS */
+ 
+static enum search_ret or_decode(struct index *idx, struct query *query, 
+  unsigned int qterm, unsigned long int docno, 
+  struct search_metric_results *results, struct search_list_src *src, 
+  int opts, struct index_search_opt *opt) {
+    struct search_acc_cons *acc = results->acc,
+                           **prevptr = &results->acc;
+    unsigned int accs_added = 0;   /* number of accumulators added */
+    unsigned long int f_dt,        /* number of offsets for this document */
+                      docno_d;     /* d-gap */
+    unsigned int bytes;
+    struct vec v = {NULL, NULL};
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    struct blockcodec_block blk;   /* decoded block, if block coded */
+    enum search_ret ret;
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    blk.n = blk.pos = 0;
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+    while (1) {
+        while (NEXT_DOC(src, &v, blk, docno, f_dt)) {
+            OFFSETS(src, &v, f_dt, f_dtf);
+
+            /* merge into accumulator list */
+            while (acc && (docno > acc->acc.docno)) {
+                prevptr = &acc->next;
+                acc = acc->next;
+            }
+
+            if (acc && (docno == acc->acc.docno)) {
+                /* METRIC_PER_DOC */
+                tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+                for (f = 1; f < fields; f++) {
+                    tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+                }
+                (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+            } else {
+                struct search_acc_cons *newacc;
+                assert(!acc || docno < acc->acc.docno); 
+
+                /* allocate a new accumulator (we have reserved allocators
+                 * earlier, so this should never fail) */
+                newacc = objalloc_malloc(results->alloc, sizeof(*newacc));
+                assert(newacc);
+                newacc->next = acc;
+                acc = newacc;
+                acc->acc.docno = docno;
+                acc->acc.weight = 0.0;
+                /* METRIC_PER_DOC */
+                tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+                for (f = 1; f < fields; f++) {
+                    tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+                }
+                (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+                *prevptr = newacc;
+                accs_added++;
+            }
+            assert(acc);
+
+            /* go to next accumulator */
+            prevptr = &acc->next;
+            acc = acc->next;
+        }
+
+        /* need to read more data, preserving bytes that we already have */
+        if ((ret = src->readlist(src, VEC_LEN(&v),
+            (void **) &v.pos, &bytes)) == SEARCH_OK) {
+
+            v.end = v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            /* finished, update number of accumulators */
+            results->accs += accs_added;
+            results->total_results += accs_added;
+
+            if (!VEC_LEN(&v)) {
+                return SEARCH_OK;
+            } else {
+                return SEARCH_EINVAL;
+            }
+        } else {
+            return ret;
+        }
+    }
+}
+
+/* internal function to estimate the number of results that an unrestricted
+ * evaluation would have found, after a list has been decoded in AND mode.
+ * hit entries in the list matched an accumulator and missed entries didn't,
+ * out of decoded entries */
+static void and_estimate(struct search_metric_results *results, 
+  unsigned int hit, unsigned int missed, unsigned int decoded) {
+    float cooc_rate;               /* co-occurrance rate for list entries and 
+                                    * accumulators */
+
+    /* list entries now divide up into two portions:
+     *   - matching an entry in the acc list (hit)
+     *   - missed
+     *
+     * cooccurrance rate is the percentage of list items hit */
+    assert(missed + hit == decoded);
+    cooc_rate = hit / (float) decoded;
+
+    /* now have sampled co-occurrance rate, use this to estimate 
+     * population co-occurrance rate (assuming unbiased sampling) 
+     * and then number of results from unrestricted evaluation */
+    assert(results->total_results >= results->accs);
+    cooc_rate *= (float) results->total_results / (float) results->accs; 
+    assert(cooc_rate >= 0.0);
+    if (cooc_rate > 1.0) {
+        cooc_rate = 1.0;
+    }
+
+    /* add number of things we think would have been added from the
+     * things that were missed */
+    results->total_results += (1 - cooc_rate) * missed;
+
+    if (missed) {
+        results->estimated |= 1;
+    }
+}
+
+static enum search_ret and_decode(struct index *idx, struct query *query, 
+  unsigned int qterm, unsigned long int docno, 
+  struct search_metric_results *results, struct search_list_src *src,
+  int opts, struct index_search_opt *opt) {
+    struct search_acc_cons *acc = results->acc,
+                           **prevptr = &results->acc;
+    int exclude = (query->term[qterm].type == CONJUNCT_TYPE_EXCLUDE);
+    unsigned long int f_dt,        /* number of offsets for this document */
+                      docno_d;     /* d-gap */
+    struct vec v = {NULL, NULL};
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    struct blockcodec_block blk;   /* decoded block, if block coded */
+    unsigned int bytes,
+                 missed = 0,       /* number of list entries that didn't match 
+                                    * an accumulator */
+                 hit = 0,          /* number of entries in both accs and list*/
+                 decoded = 0;      /* number of list entries seen */
+    enum search_ret ret;
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    blk.n = blk.pos = 0;
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+    while (1) {
+        while (NEXT_DOC(src, &v, blk, docno, f_dt)) {
+            OFFSETS(src, &v, f_dt, f_dtf);
+            decoded++;
+
+            /* merge into accumulator list */
+            while (acc && (docno > acc->acc.docno)) {
+                prevptr = &acc->next;
+                acc = acc->next;
+            }
+
+            if (acc && (docno == acc->acc.docno)) {
+                if (exclude) {
+                    /* documents containing an excluded term aren't results,
+                     * so remove the accumulator */
+                    *prevptr = acc->next;
+                    objalloc_free(results->alloc, acc);
+                    results->accs--;
+                    acc = *prevptr;
+                } else {
+                    /* METRIC_PER_DOC */
+                    tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+                    for (f = 1; f < fields; f++) {
+                        tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+                    }
+                    (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+
+                    /* go to next accumulator */
+                    prevptr = &acc->next;
+                    acc = acc->next;
+                }
+                hit++;
+            } else {
+                missed++;
+            }
+
+            /* skip over blocks of postings that can't match the next
+             * accumulator, counting them as missed */
+            if (src->skip_to && (!acc || (acc->acc.docno > docno + 1))) {
+                unsigned long int base = docno,
+                                  postings;
+
+                if ((ret = src->skip_to(src, acc ? acc->acc.docno : ULONG_MAX,
+                    &base, &postings)) != SEARCH_OK) {
+                    return ret;
+                } else if (base != docno) {
+                    docno = base;
+                    missed += postings - decoded;
+                    decoded = postings;
+                    v.pos = v.end = NULL;
+                    blk.n = blk.pos = 0;
+                }
+            }
+        }
+
+        /* need to read more data, preserving bytes that we already have */
+        if ((ret = src->readlist(src, VEC_LEN(&v),
+            (void **) &v.pos, &bytes)) == SEARCH_OK) {
+
+            v.end = v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            /* finished, estimate number of results (removing the ones
+             * that were excluded) */
+            if (exclude) {
+                results->total_results -= hit;
+            } else {
+                and_estimate(results, hit, missed, decoded);
+            }
+
+            if (!VEC_LEN(&v)) {
+                return SEARCH_OK;
+            } else {
+                return SEARCH_EINVAL;
+            }
+        } else {
+            return ret;
+        }
+    }
+}
+
+/* macros to test and set whether document i in a page of dense accumulators
+ * has an accumulator */
+#define DENSE_USED(page, i) ((page)->used[(i) >> 3] & (1 << ((i) & 7)))
+#define DENSE_USE(page, i) ((page)->used[(i) >> 3] |= (1 << ((i) & 7)))
+
+static enum search_ret dense_or_decode(struct index *idx, struct query *query, 
+  unsigned int qterm, unsigned long int docno, 
+  struct search_metric_results *results, struct search_list_src *src, 
+  int opts, struct index_search_opt *opt) {
+    struct search_acc_cons dense,  /* accumulator being updated */
+                           *acc = &dense;
+    struct search_acc_page *page;
+    unsigned int accs_added = 0,   /* number of accumulators added */
+                 i;
+    unsigned long int f_dt,        /* number of offsets for this document */
+                      docno_d;     /* d-gap */
+    unsigned int bytes;
+    struct vec v = {NULL, NULL};
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    struct blockcodec_block blk;   /* decoded block, if block coded */
+    enum search_ret ret;
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    blk.n = blk.pos = 0;
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+    while (1) {
+        while (NEXT_DOC(src, &v, blk, docno, f_dt)) {
+            OFFSETS(src, &v, f_dt, f_dtf);
+            assert(docno < docmap_entries(idx->map));
+
+            /* find the page for this document, allocating it if necessary */
+            if (!(page = results->dense[docno / SEARCH_DENSE_PAGE])
+              && !(page = results->dense[docno / SEARCH_DENSE_PAGE] 
+                = calloc(1, sizeof(*page)))) {
+                return SEARCH_ENOMEM;
+            }
+
+            i = docno % SEARCH_DENSE_PAGE;
+            if (!DENSE_USED(page, i)) {
+                DENSE_USE(page, i);
+                accs_added++;
+            }
+            acc->acc.docno = docno;
+            acc->acc.weight = page->weight[i];
+            /* METRIC_PER_DOC */
+            tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+            for (f = 1; f < fields; f++) {
+                tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+            }
+            (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+            page->weight[i] = acc->acc.weight;
+        }
+
+        /* need to read more data, preserving bytes that we already have */
+        if ((ret = src->readlist(src, VEC_LEN(&v),
+            (void **) &v.pos, &bytes)) == SEARCH_OK) {
+
+            v.end = v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            /* finished, update number of accumulators */
+            results->accs += accs_added;
+            results->total_results += accs_added;
+
+            if (!VEC_LEN(&v)) {
+                return SEARCH_OK;
+            } else {
+                return SEARCH_EINVAL;
+            }
+        } else {
+            return ret;
+        }
+    }
+}
+
+static enum search_ret dense_and_decode(struct index *idx, 
+  struct query *query, unsigned int qterm, unsigned long int docno, 
+  struct search_metric_results *results, struct search_list_src *src,
+  int opts, struct index_search_opt *opt) {
+    struct search_acc_cons dense,  /* accumulator being updated */
+                           *acc = &dense;
+    struct search_acc_page *page;
+    int exclude = (query->term[qterm].type == CONJUNCT_TYPE_EXCLUDE);
+    unsigned long int f_dt,        /* number of offsets for this document */
+                      docno_d;     /* d-gap */
+    struct vec v = {NULL, NULL};
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    struct blockcodec_block blk;   /* decoded block, if block coded */
+    unsigned int bytes,
+                 i,
+                 missed = 0,       /* number of list entries that didn't match 
+                                    * an accumulator */
+                 hit = 0,          /* number of entries in both accs and list*/
+                 decoded = 0;      /* number of list entries seen */
+    enum search_ret ret;
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    blk.n = blk.pos = 0;
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+    while (1) {
+        while (NEXT_DOC(src, &v, blk, docno, f_dt)) {
+            OFFSETS(src, &v, f_dt, f_dtf);
+            decoded++;
+            assert(docno < docmap_entries(idx->map));
+
+            i = docno % SEARCH_DENSE_PAGE;
+            if ((page = results->dense[docno / SEARCH_DENSE_PAGE])
+              && DENSE_USED(page, i)) {
+                if (exclude) {
+                    /* documents containing an excluded term aren't results,
+                     * so remove the accumulator */
+                    page->used[i >> 3] &= ~(1 << (i & 7));
+                    results->accs--;
+                } else {
+                    acc->acc.docno = docno;
+                    acc->acc.weight = page->weight[i];
+                    /* METRIC_PER_DOC */
+                    tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+                    for (f = 1; f < fields; f++) {
+                        tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+                    }
+                    (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+                    page->weight[i] = acc->acc.weight;
+                }
+                hit++;
+            } else {
+                missed++;
+            }
+        }
+
+        /* need to read more data, preserving bytes that we already have */
+        if ((ret = src->readlist(src, VEC_LEN(&v),
+            (void **) &v.pos, &bytes)) == SEARCH_OK) {
+
+            v.end = v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            /* finished, estimate number of results (removing the ones
+             * that were excluded) */
+            if (exclude) {
+                results->total_results -= hit;
+            } else {
+                and_estimate(results, hit, missed, decoded);
+            }
+
+            if (!VEC_LEN(&v)) {
+                return SEARCH_OK;
+            } else {
+                return SEARCH_EINVAL;
+            }
+        } else {
+            return ret;
+        }
+    }
+}
+
+/* tolerance value for thresholding estimates.  Should be >= 1.0.  Make higher
+ * for stabler, but higher memory usage, processing. */
+#define TOLERANCE 1.2
+
+/* low-ish approximation of infinity, to make counting up to it acceptable */
+#define INF 2000
+
+static enum search_ret thresh_decode(struct index *idx, struct query *query,
+  unsigned int qterm, unsigned long int docno, 
+  struct search_metric_results *results, 
+  struct search_list_src *src, unsigned int postings, 
+  int opts, struct index_search_opt *opt) {
+    struct search_acc_cons *acc = results->acc,
+                           **prevptr = &results->acc,
+                           dummy;
+    unsigned long int f_dt,           /* number of offsets for this document */
+                      docno_d;        /* d-gap */
+
+    /* initial number of accumulators */
+    unsigned int initial_accs = results->accs,
+
+                 decoded = 0,         /* number of postings decoded */
+                 thresh,              /* current discrete threshold */
+                 rethresh,            /* distance to recalculation of the 
+                                       * threshold */
+                 rethresh_dist,
+                 bytes,
+                 step,
+                 missed = 0,        /* number of list entries that didn't match 
+                                     * an accumulator */
+                 hit = 0;           /* number of entries in both accs and list*/
+ 
+    struct vec v = {NULL, NULL};
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    struct blockcodec_block blk;   /* decoded block, if block coded */
+    enum search_ret ret;
+    int infinite = 0;                 /* whether threshold is infinite */
+    float cooc_rate;
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    blk.n = blk.pos = 0;
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+    rethresh_dist = rethresh = (postings + results->acc_limit - 1) 
+      / results->acc_limit;
+
+    if (results->v_t == FLT_MIN) {
+        unsigned long int docno_copy = docno;
+
+        /* this should be the first thresholded list, need to estimate 
+         * threshold */
+        assert(rethresh && rethresh < postings);
+        thresh = 0;
+
+        assert(rethresh < postings);
+        while (rethresh) {
+            while (rethresh && NEXT_DOC(src, &v, blk, docno, f_dt)) {
+                rethresh--;
+                SCAN_OFFSETS(src, &v, f_dt);
+                if (f_dt > thresh) {
+                    thresh = f_dt;
+                }
+            }
+
+            /* need to read more data, preserving bytes that we already have */
+            if (rethresh && (ret = src->readlist(src, VEC_LEN(&v),
+                (void **) &v.pos, &bytes)) == SEARCH_OK) {
+
+                v.end = v.pos + bytes;
+            } else if (rethresh) {
+                assert(ret != SEARCH_FINISH);
+                return ret;
+            }
+        }
+        thresh--;
+
+        acc = &dummy;
+        acc->acc.docno = UINT_MAX;   /* shouldn't be used */
+        acc->acc.weight = 0.0;
+        f_dt = thresh;
+#if FIELDS
+        FIRST_FIELD(f_dtf, f_dt);
+#endif /* FIELDS */
+        /* METRIC_CONTRIB */
+        tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (avg_D_fterms)[0]) / (float) avg_D_fterms[0]));
+        for (f = 1; f < fields; f++) {
+            tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (avg_D_fterms)[f]) / (float) avg_D_fterms[f])) : 0;
+        }
+        (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+        results->v_t = acc->acc.weight;
+
+        /* reset source/vector to start */
+        v.pos = v.end = NULL;
+        blk.n = blk.pos = 0;
+        if ((ret = src->reset(src)) != SEARCH_OK) {
+            return ret;
+        }
+
+        acc = *prevptr;
+        docno = docno_copy;
+        rethresh = rethresh_dist;
+    } else {
+        /* translate the existing v_t threshold to an f_dt */
+        acc = &dummy;
+        acc->acc.docno = UINT_MAX;   /* shouldn't be used */
+        f_dt = 0;
+        do {
+            acc->acc.weight = 0.0;
+            f_dt++;
+#if FIELDS
+            FIRST_FIELD(f_dtf, f_dt);
+#endif /* FIELDS */
+            /* METRIC_CONTRIB */
+            tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (avg_D_fterms)[0]) / (float) avg_D_fterms[0]));
+            for (f = 1; f < fields; f++) {
+                tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (avg_D_fterms)[f]) / (float) avg_D_fterms[f])) : 0;
+            }
+            (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+        } while (acc->acc.weight < results->v_t && f_dt < INF);
+        thresh = f_dt; 
+        acc = *prevptr;
+
+        if (thresh == INF) {
+            /* this is not a sensible term */
+            infinite = 1;
+            rethresh = postings + 1;
+        }
+    }
+
+    /* set step to 1/2 of the threshold */
+    step = (thresh + 1) / 2;
+    step += !step; /* but don't let it become 0 */
+
+    while (1) {
+        while (NEXT_DOC(src, &v, blk, docno, f_dt)) {
+            OFFSETS(src, &v, f_dt, f_dtf);
+            decoded++;
+
+            /* merge into accumulator list */
+            while (acc && (docno > acc->acc.docno)) {
+                /* perform threshold test */
+                if (acc->acc.weight < results->v_t) {
+                    /* remove this accumulator */
+                    *prevptr = acc->next;
+                    objalloc_free(results->alloc, acc);
+                    acc = (*prevptr);
+                    results->accs--;
+                } else {
+                    /* retain this accumulator */
+                    prevptr = &acc->next;
+                    acc = acc->next;
+                }
+            }
+
+            if (acc && (docno == acc->acc.docno)) {
+                /* METRIC_PER_DOC */
+                tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+                for (f = 1; f < fields; f++) {
+                    tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+                }
+                (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+
+                if (acc->acc.weight < results->v_t) {
+                    /* remove this accumulator */
+                    *prevptr = acc->next;
+                    objalloc_free(results->alloc, acc);
+                    acc = *prevptr;
+                    results->accs--;
+                } else {
+                    /* go to next accumulator */
+                    prevptr = &acc->next;
+                    acc = acc->next;
+                }
+                hit++;
+            } else {
+                if (f_dt > thresh) {
+                    struct search_acc_cons *newacc;
+                    assert(!acc || docno < acc->acc.docno); 
+
+                    if ((newacc = objalloc_malloc(results->alloc, 
+                      sizeof(*newacc)))) {
+                        newacc->acc.docno = docno;
+                        newacc->acc.weight = 0.0;
+                        newacc->next = acc;
+                        acc = newacc;
+                        /* note that we have to be careful around here to 
+                         * assign newacc to acc before using PER_DOC, 
+                         * otherwise we end up with nonsense in some 
+                         * accumulators */
+                        /* METRIC_PER_DOC */
+                        tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+                        for (f = 1; f < fields; f++) {
+                            tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+                        }
+                        (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+                        *prevptr = newacc;
+                        results->accs++;
+                    } else {
+                        return SEARCH_ENOMEM;
+                    }
+
+                    /* go to next accumulator */
+                    prevptr = &acc->next;
+                    acc = acc->next;
+                } else {
+                    missed++;
+                }
+            }
+
+            if (!--rethresh) {
+                int estimate;
+                unsigned int prev_thresh = thresh;
+
+                estimate = (int) (results->accs 
+                  + ((postings - decoded) 
+                    * ((float) results->accs - initial_accs)) / decoded);
+
+                if (estimate > TOLERANCE * results->acc_limit) {
+                    thresh += step;
+                } else if ((estimate < results->acc_limit / TOLERANCE) 
+                  && thresh) {
+                    if (thresh >= step) {
+                        thresh -= step;
+                    } else {
+                        thresh = 0;
+                    }
+                }
+
+                step = (step + 1) / 2;
+                assert(step);
+
+                /* note that we don't want to recalculate the threshold if it
+                 * doesn't change because this involves re-discretising it */
+                if (prev_thresh != thresh) {
+                    /* recalculate contribution that corresponds to the new 
+                     * threshold */
+                    f_dt = thresh;
+                    if (f_dt) {
+                        acc = &dummy;
+                        acc->acc.docno = UINT_MAX;   /* shouldn't be used */
+                        acc->acc.weight = 0.0;
+#if FIELDS
+                        FIRST_FIELD(f_dtf, f_dt);
+#endif /* FIELDS */
+                        /* METRIC_CONTRIB */
+                        tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (avg_D_fterms)[0]) / (float) avg_D_fterms[0]));
+                        for (f = 1; f < fields; f++) {
+                            tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (avg_D_fterms)[f]) / (float) avg_D_fterms[f])) : 0;
+                        }
+                        (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+                        results->v_t = acc->acc.weight;
+                        acc = *prevptr;
+                    } else {
+                        results->v_t = FLT_MIN;
+                    }
+                }
+
+                rethresh_dist *= 2;
+                rethresh = rethresh_dist;
+            }
+        }
+
+        /* need to read more data, preserving bytes that we already have */
+        if ((ret = src->readlist(src, VEC_LEN(&v),
+            (void **) &v.pos, &bytes)) == SEARCH_OK) {
+
+            v.end = v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            /* finished, estimate total results count */
+            assert(postings == decoded);
+
+            results->total_results += (int) (results->accs - initial_accs);
+
+            /* list entries now divide up into three portions:
+             *   - matching an entry in the acc list (hit)
+             *   - missed
+             *   - added
+             *
+             * cooccurrance rate is the percentage of list items hit */
+            cooc_rate = hit / (float) decoded;
+
+            /* now have sampled co-occurrance rate, use this to estimate 
+             * population co-occurrance rate (assuming unbiased sampling) 
+             * and then number of results from unrestricted evaluation */
+            assert(results->total_results >= results->accs);
+            cooc_rate 
+              *= (float) results->total_results / (float) results->accs; 
+            assert(cooc_rate >= 0.0);
+            if (cooc_rate > 1.0) {
+                cooc_rate = 1.0;
+            }
+
+            /* add number of things we think would have been added from the
+             * things that were missed */
+            results->total_results += (1 - cooc_rate) * missed;
+
+            /* note that the total results are not an estimate if either there
+             * were no accumulators in the list when we started (in which case
+             * missed records exactly the number, uh, missing from the
+             * accumulators) or there were none missed, in which case the
+             * accumulators have fully accounted for everything in this list.
+             * In either case, the (1 - cooc_rate) * missed maths above handles
+             * it exactly (modulo floating point errors of course). */
+            if (initial_accs && missed) {
+                results->estimated |= 1;
+            }
+
+            if (!VEC_LEN(&v)) {
+                if (!infinite) {
+                    /* continue threshold evaluation */
+                    return SEARCH_OK;
+                } else {
+                    /* switch to AND processing */
+                    return SEARCH_FINISH;
+                }
+            } else {
+                return SEARCH_EINVAL;
+            }
+        } else {
+            return ret;
+        }
+    }
+}
+
+static enum search_ret score(struct index *idx, struct query *query,
+  unsigned int qterm, struct search_acc_cons *acc, unsigned long int f_dt,
+  int opts, struct index_search_opt *opt) {
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+#if FIELDS
+    FIRST_FIELD(f_dtf, f_dt);
+#endif /* FIELDS */
+
+    /* METRIC_PER_DOC */
+    tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[0]) / (float) avg_D_fterms[0]));
+    for (f = 1; f < fields; f++) {
+        tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (DOCMAP_GET_FIELD_WORDS(idx->map, acc->acc.docno))[f]) / (float) avg_D_fterms[f])) : 0;
+    }
+    (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+
+    return SEARCH_OK;
+}
+
+static enum search_ret bound(struct index *idx, struct query *query,
+  unsigned int qterm, unsigned long int f_dt, float *weight,
+  int opts, struct index_search_opt *opt) {
+    struct search_acc_cons dummy,
+                           *acc = &dummy;
+#if FIELDS
+    unsigned int f_dtf[INDEX_FIELDS];  /* number of offsets in each field */
+#endif /* FIELDS */
+    /* METRIC_DECL */
+
+    const unsigned int fields = idx->fields;
+
+    double avg_D_fterms [INDEX_FIELDS];
+
+    const unsigned int N = docmap_entries(idx->map);
+    float w_t;
+    float tf;
+    unsigned int f;
+
+    float r_qt = (((opt->u.bm25f.k3) + 1) * (query->term[qterm].f_qt)) / ((opt->u.bm25f.k3) + (query->term[qterm].f_qt));
+    if (docmap_avg_field_words(idx->map, avg_D_fterms) != DOCMAP_OK) {
+        return SEARCH_EINVAL;
+    }
+
+
+    /* METRIC_PER_CALL */
+    w_t = (float) logf((N - (query->term[qterm].f_t) + 0.5F) / ((query->term[qterm].f_t) + 0.5F));
+    /* fix for okapi bug, w_t shouldn't be 0 or negative. */
+    if (w_t <= 0.0F) {
+        /* use a very small increment instead */
+        w_t = FLT_EPSILON;
+    }
+    
+    
+
+
+#if FIELDS
+    FIRST_FIELD(f_dtf, f_dt);
+#endif /* FIELDS */
+    acc->acc.docno = UINT_MAX;   /* shouldn't be used */
+    acc->acc.weight = 0.0;
+    /* METRIC_BOUND */
+    tf = ((opt->u.bm25f.boost)[0] * f_dtf[0]) / ((1 - (opt->u.bm25f.b)[0]) + (((opt->u.bm25f.b)[0] * (avg_D_fterms)[0]) / (float) avg_D_fterms[0]));
+    for (f = 1; f < fields; f++) {
+        tf += f_dtf[f] ? ((opt->u.bm25f.boost)[f] * f_dtf[f]) / ((1 - (opt->u.bm25f.b)[f]) + (((opt->u.bm25f.b)[f] * (avg_D_fterms)[f]) / (float) avg_D_fterms[f])) : 0;
+    }
+    (acc->acc.weight) += ((((opt->u.bm25f.k1) + 1) * tf) / ((opt->u.bm25f.k1) + tf)) * w_t * r_qt;
+
+
+    *weight = acc->acc.weight;
+    return SEARCH_OK;
+}
+
+static enum search_ret post_bound(struct index *idx, struct query *query,
+  float *weight, int opts, struct index_search_opt *opt) {
+    struct search_acc_cons dummy,
+                           *acc = &dummy;
+    /* METRIC_POST */
+
+
+    acc->acc.docno = UINT_MAX;   /* shouldn't be used */
+    acc->acc.weight = 0.0;
+    /* METRIC_POST_BOUND */
+
+
+    *weight = acc->acc.weight;
+    return SEARCH_OK;
+}
+
+/* Declare a function named the same as the metric that returns a structure 
+ * containing function pointers */
+const struct search_metric * /* METRIC_NAME */ bm25f () {
+    static const struct search_metric sm 
+      = {pre, /* METRIC_DEPENDS_POST */ 0 ? post : NULL, 
+         or_decode, and_decode, thresh_decode, dense_or_decode, 
+         dense_and_decode, score, bound, 
+         /* METRIC_DEPENDS_POST */ 0 ? post_bound : NULL};
+    return &sm;
+}
+
@@ -0,0 +1,482 @@
+/* bound_build.c implements a pass over an index that adds upper bounds on the
+ * scores of postings to its vocabulary.  See bound_build.h for what the
+ * bounds are.
+ *
+ * Each document ordered list is read and converted into plain postings (in
+ * the same way as for impact ordering), and the bounds worked out while
+ * passing over them.  Only the vocabulary is rewritten, as the bounds are
+ * small enough to keep in each vocab entry, right after the vector they
+ * bound.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "bound_build.h"
+
+#include "_index.h"
+
+#include "btbulk.h"
+#include "def.h"
+#include "docmap.h"
+#include "error.h"
+#include "fdset.h"
+#include "iobtree.h"
+#include "skip_build.h"
+#include "vec.h"
+#include "vocab.h"
+
+#include <assert.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* collection statistics and parameters that scores are bounded for */
+struct bound_params {
+    double k1;                       /* okapi parameters */
+    double b;
+    double mu;                       /* dirichlet parameter */
+    double N;                        /* number of documents */
+    double avg_words;                /* average document length */
+    double terms;                    /* number of terms in the collection */
+};
+
+/* buffers that are reused from list to list */
+struct bound_bufs {
+    char *vec;                       /* vector as stored */
+    unsigned int veclen;
+    char *plain;                     /* vector as plain postings */
+    unsigned int plainlen;
+    char *table;                     /* per-block bounds */
+    unsigned int tablelen;
+    char *entry;                     /* new vocab entry */
+    unsigned int entrylen;
+};
+
+/* internal function to ensure that a buffer has at least len bytes */
+static int bound_reserve(char **buf, unsigned int *buflen, unsigned int len) {
+    if (len > *buflen) {
+        void *ptr = realloc(*buf, len);
+
+        if (ptr) {
+            *buf = ptr;
+            *buflen = len;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* internal function to determine whether a vector is document ordered */
+static int bound_doc_ordered(struct vocab_vector *vv) {
+    switch (vv->type) {
+    case VOCAB_VTYPE_DOC:
+    case VOCAB_VTYPE_DOCWP:
+    case VOCAB_VTYPE_DOCWP_SKIP:
+    case VOCAB_VTYPE_DOCWP_SEP:
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+unsigned long int bound_interval(unsigned long int docs) {
+    unsigned long int interval = SKIP_DEFAULT_INTERVAL;
+
+    if (docs <= SKIP_DEFAULT_INTERVAL) {
+        return 0;
+    }
+    while ((docs + interval - 1) / interval > BOUND_MAX_BLOCKS) {
+        interval *= 2;
+    }
+    return interval;
+}
+
+/* internal function to get the postings of the document ordered vector vv
+ * as plain postings (VOCAB_VTYPE_DOC or VOCAB_VTYPE_DOCWP), pointing pv at
+ * them */
+static enum bound_ret bound_postings(struct index *idx,
+  struct vocab_vector *vv, struct bound_bufs *bufs, struct vec *pv) {
+    struct vocab_vector plainvv = *vv;
+    char *vec;
+    int fd;
+    ssize_t bytes;
+
+    if (vv->location == VOCAB_LOCATION_VOCAB) {
+        vec = vv->loc.vocab.vec;
+    } else {
+        if (!bound_reserve(&bufs->vec, &bufs->veclen, vv->size)) {
+            return BOUND_MEM_ERROR;
+        }
+        if ((fd = fdset_pin(idx->fd, idx->index_type, vv->loc.file.fileno,
+            vv->loc.file.offset, SEEK_SET)) < 0) {
+            return BOUND_IO_ERROR;
+        }
+        bytes = index_atomic_read(fd, bufs->vec, vv->size);
+        fdset_unpin(idx->fd, idx->index_type, vv->loc.file.fileno, fd);
+        if (bytes != (ssize_t) vv->size) {
+            return BOUND_IO_ERROR;
+        }
+        vec = bufs->vec;
+    }
+
+    if ((vv->type == VOCAB_VTYPE_DOC) || (vv->type == VOCAB_VTYPE_DOCWP)) {
+        pv->pos = vec;
+        pv->end = vec + vv->size;
+        return BOUND_OK;
+    }
+
+    /* strip skip table, decode blocks and merge positions back in */
+    if (!bound_reserve(&bufs->plain, &bufs->plainlen,
+        skip_docwp_bound(&plainvv))) {
+        return BOUND_MEM_ERROR;
+    } else if (skip_docwp(&plainvv, vec, bufs->plain) != SKIP_OK) {
+        return BOUND_FMT_ERROR;
+    }
+    pv->pos = bufs->plain;
+    pv->end = bufs->plain + plainvv.size;
+    return BOUND_OK;
+}
+
+/* internal function to work out the bounds on the document ordered vector
+ * vv, describing them in bv (whose per-block table is left in bufs->table) */
+static enum bound_ret bound_list(struct index *idx,
+  struct bound_params *params, struct vocab_vector *vv,
+  struct bound_bufs *bufs, struct vocab_vector *bv) {
+    struct vec v,
+               tv;
+    unsigned long int docs = vocab_docs(vv),
+                      interval = bound_interval(docs),
+                      docno = 0,
+                      docno_d,
+                      f_dt,
+                      blockmax = 0,
+                      d;
+    unsigned int words,
+                 normwords,
+                 bytes;
+    double w_t,
+           r_dt,
+           r_max = 0.0;
+    enum bound_ret ret;
+
+    if ((ret = bound_postings(idx, vv, bufs, &v)) != BOUND_OK) {
+        return ret;
+    }
+
+    /* any f_dt fits into the number of bytes that occurs does */
+    tv.pos = tv.end = bufs->table;
+    if (interval) {
+        if (!bound_reserve(&bufs->table, &bufs->tablelen,
+            ((docs + interval - 1) / interval)
+              * vec_vbyte_len(vocab_occurs(vv)))) {
+            return BOUND_MEM_ERROR;
+        }
+        tv.pos = bufs->table;
+        tv.end = bufs->table + bufs->tablelen;
+    }
+
+    bv->attr = VOCAB_ATTRIBUTES_NONE;
+    bv->attribute = 0;
+    bv->type = VOCAB_VTYPE_BOUNDS;
+    bv->header.bounds.docs = docs;
+    bv->header.bounds.occurs = vocab_occurs(vv);
+    bv->header.bounds.last = vocab_last(vv);
+    bv->header.bounds.max_fdt = 0;
+    bv->header.bounds.interval = interval;
+    bv->location = VOCAB_LOCATION_VOCAB;
+    bv->loc.vocab.vec = bufs->table;
+
+    for (d = 0; d < docs; d++) {
+        if (!vec_vbyte_read(&v, &docno_d) || !vec_vbyte_read(&v, &f_dt)
+          || ((vv->type != VOCAB_VTYPE_DOC)
+            && (vec_vbyte_scan(&v, f_dt, &bytes) != f_dt))) {
+            return BOUND_FMT_ERROR;
+        }
+        docno = d ? docno + docno_d + 1 : docno_d;
+
+        if (docno >= docmap_entries(idx->map)
+          || docmap_get_words(idx->map, docno, &words) != DOCMAP_OK) {
+            return BOUND_FMT_ERROR;
+        }
+
+        /* okapi scores fall as documents get longer, so use the shorter of
+         * the exact and approximate lengths */
+        normwords = docmap_norm_words(words);
+        if (normwords < words) {
+            words = normwords;
+        }
+        r_dt = ((params->k1 + 1) * f_dt)
+          / (params->k1 * ((1 - params->b)
+              + ((params->b * words) / params->avg_words)) + f_dt);
+        if (r_dt > r_max) {
+            r_max = r_dt;
+        }
+
+        if (f_dt > bv->header.bounds.max_fdt) {
+            bv->header.bounds.max_fdt = f_dt;
+        }
+        if (f_dt > blockmax) {
+            blockmax = f_dt;
+        }
+        if (interval && (((d + 1) % interval == 0) || (d + 1 == docs))) {
+            if (!vec_vbyte_write(&tv, blockmax)) {
+                return BOUND_OTHER_ERROR;
+            }
+            blockmax = 0;
+        }
+    }
+    bv->size = tv.pos - bufs->table;
+
+    /* as for the okapi metric, which doesn't allow term weights below
+     * FLT_EPSILON */
+    w_t = log((params->N - docs + 0.5) / (docs + 0.5));
+    if (w_t <= 0.0) {
+        w_t = FLT_EPSILON;
+    }
+    bv->header.bounds.okapi = (float) (w_t * r_max);
+    bv->header.bounds.dirichlet = 0.0F;
+    if (vocab_occurs(vv)) {
+        bv->header.bounds.dirichlet = (float) log(1
+          + bv->header.bounds.max_fdt * params->terms
+            / (params->mu * vocab_occurs(vv)));
+    }
+    return BOUND_OK;
+}
+
+/* internal function to append vector vv to the len bytes of the vocab entry
+ * being built in bufs */
+static enum bound_ret bound_append(struct bound_bufs *bufs, unsigned int *len,
+  struct vocab_vector *vv) {
+    struct vec ev;
+
+    if (!bound_reserve(&bufs->entry, &bufs->entrylen, *len + vocab_len(vv))) {
+        return BOUND_MEM_ERROR;
+    }
+    ev.pos = bufs->entry + *len;
+    ev.end = bufs->entry + bufs->entrylen;
+    if (vocab_encode(vv, &ev) != VOCAB_OK) {
+        return BOUND_OTHER_ERROR;
+    } else if (vv->location == VOCAB_LOCATION_VOCAB && vv->size) {
+        /* encode leaves space for in-vocab vector at the end */
+        memcpy(ev.pos - vv->size, vv->loc.vocab.vec, vv->size);
+    }
+    *len = ev.pos - bufs->entry;
+    return BOUND_OK;
+}
+
+/* internal function to write out a btree bucket produced by btbulk */
+static enum bound_ret bound_bucket(struct index *idx, struct btbulk *bulk) {
+    int fd;
+    ssize_t bytes;
+
+    if ((fd = fdset_pin(idx->fd, idx->vtmp_type, bulk->fileno, bulk->offset,
+        SEEK_SET)) < 0
+      && (fd = fdset_create_seek(idx->fd, idx->vtmp_type, bulk->fileno,
+        bulk->offset)) < 0) {
+        ERROR1("opening vocab file number %u", bulk->fileno);
+        return BOUND_IO_ERROR;
+    }
+    bytes = index_atomic_write(fd, bulk->output.write.next_out,
+      bulk->output.write.avail_out);
+    fdset_unpin(idx->fd, idx->vtmp_type, bulk->fileno, fd);
+
+    if (bytes != (ssize_t) bulk->output.write.avail_out) {
+        ERROR1("writing to vocab file number %u", bulk->fileno);
+        return BOUND_IO_ERROR;
+    }
+    bulk->offset += bulk->output.write.avail_out;
+    return BOUND_OK;
+}
+
+/* internal function to replace the vocab files with the count temporary vocab
+ * files, by renaming them into place */
+static enum bound_ret bound_replace(struct index *idx, unsigned int count) {
+    char final_fname[FILENAME_MAX + 1],
+         tmp_fname[FILENAME_MAX + 1];
+    unsigned int i,
+                 len;
+    int writeable;
+
+    for (i = 0; fdset_unlink(idx->fd, idx->vocab_type, i) == FDSET_OK; i++) ;
+    for (i = 0; i < count; i++) {
+        if ((fdset_close_file(idx->fd, idx->vtmp_type, i) < 0)
+          || (fdset_name(idx->fd, idx->vocab_type, i, final_fname,
+              FILENAME_MAX, &len, &writeable) != FDSET_OK)
+          || (fdset_name(idx->fd, idx->vtmp_type, i, tmp_fname, FILENAME_MAX,
+              &len, &writeable) != FDSET_OK)
+          || (rename(tmp_fname, final_fname) < 0)) {
+            ERROR2("renaming file number %u to %s", i, final_fname);
+            return BOUND_IO_ERROR;
+        }
+    }
+    return BOUND_OK;
+}
+
+enum bound_ret bound_build_index(struct index *idx, double k1, double b,
+  double mu) {
+    struct btbulk bulk;
+    struct bound_bufs bufs = {NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct bound_params params;
+    unsigned int state[3] = {0, 0, 0},
+                 termlen,
+                 datalen,
+                 root_fileno,
+                 i;
+    unsigned long int root_offset,
+                      terms = 0;
+    const char *term;
+    void *data;
+    enum docmap_cache cache,
+                      exact;
+    enum bound_ret ret = BOUND_OK;
+    enum btbulk_ret btret;
+
+    params.k1 = k1;
+    params.b = b;
+    params.mu = mu;
+    params.N = docmap_entries(idx->map);
+    params.terms = ((double) UINT_MAX) * idx->stats.terms_high
+      + idx->stats.terms_low;
+    if ((docmap_avg_words(idx->map, &params.avg_words) != DOCMAP_OK)
+      || (params.avg_words <= 0.0)) {
+        params.avg_words = 1.0;
+    }
+
+    /* bounds are computed from exact document lengths, so make sure that
+     * they're cached (and not as norms) while we work */
+    cache = docmap_get_cache(idx->map);
+    exact = (cache & ~DOCMAP_CACHE_NORMS) | DOCMAP_CACHE_WORDS;
+    if ((exact != cache) && (docmap_cache(idx->map, exact) != DOCMAP_OK)) {
+        return BOUND_MEM_ERROR;
+    }
+
+    if (!btbulk_new(idx->storage.pagesize, idx->storage.max_filesize,
+        idx->storage.btleaf_strategy, idx->storage.btnode_strategy, 1.0, 0,
+        &bulk)) {
+        docmap_cache(idx->map, cache);
+        return BOUND_MEM_ERROR;
+    }
+    bulk.fileno = 0;
+    bulk.offset = 0;
+
+    while ((ret == BOUND_OK)
+      && (term = iobtree_next_term(idx->vocab, state, &termlen, &data,
+          &datalen))) {
+        struct vocab_vector vv,
+                            bv;
+        struct vec v;
+        unsigned int len = 0;
+        enum vocab_ret vret = VOCAB_OK;
+
+        /* copy each vector in the entry, dropping old bounds and adding new
+         * ones after each document ordered vector */
+        v.pos = data;
+        v.end = v.pos + datalen;
+        while ((ret == BOUND_OK)
+          && ((vret = vocab_decode(&vv, &v)) == VOCAB_OK)) {
+            if (vv.type == VOCAB_VTYPE_BOUNDS) {
+                /* out-of-date, replaced below */
+            } else if (((ret = bound_append(&bufs, &len, &vv)) == BOUND_OK)
+              && bound_doc_ordered(&vv)
+              && ((ret = bound_list(idx, &params, &vv, &bufs, &bv))
+                == BOUND_OK)) {
+                ret = bound_append(&bufs, &len, &bv);
+            }
+        }
+
+        if ((ret == BOUND_OK) && (vret != VOCAB_END)) {
+            ERROR1("decoding vocab entry for term '%s'", term);
+            ret = BOUND_FMT_ERROR;
+        } else if (ret == BOUND_FMT_ERROR) {
+            ERROR1("reading postings for term '%s'", term);
+        }
+
+        /* insert new entry into new vocab */
+        bulk.term = term;
+        bulk.termlen = termlen;
+        bulk.datasize = len;
+        while (ret == BOUND_OK) {
+            btret = btbulk_insert(&bulk);
+            if (btret == BTBULK_OK) {
+                memcpy(bulk.output.ok.data, bufs.entry, len);
+                terms++;
+                break;
+            } else if (btret == BTBULK_WRITE) {
+                ret = bound_bucket(idx, &bulk);
+            } else if (btret == BTBULK_FLUSH) {
+                bulk.fileno++;
+                bulk.offset = 0;
+            } else {
+                ret = BOUND_OTHER_ERROR;
+            }
+        }
+    }
+
+    /* finish new vocab */
+    while (ret == BOUND_OK) {
+        btret = btbulk_finalise(&bulk, &root_fileno, &root_offset);
+        if ((btret == BTBULK_OK) || (btret == BTBULK_FINISH)) {
+            break;
+        } else if (btret == BTBULK_WRITE) {
+            ret = bound_bucket(idx, &bulk);
+        } else if (btret == BTBULK_FLUSH) {
+            bulk.fileno++;
+            bulk.offset = 0;
+        } else {
+            ret = BOUND_OTHER_ERROR;
+        }
+    }
+
+    btbulk_delete(&bulk);
+    free(bufs.vec);
+    free(bufs.plain);
+    free(bufs.table);
+    free(bufs.entry);
+    if ((exact != cache) && (docmap_cache(idx->map, cache) != DOCMAP_OK)
+      && (ret == BOUND_OK)) {
+        ret = BOUND_MEM_ERROR;
+    }
+
+    if (ret != BOUND_OK) {
+        /* remove partially written files, leaving index as it was */
+        for (i = 0; fdset_unlink(idx->fd, idx->vtmp_type, i) == FDSET_OK;
+          i++) ;
+        return ret;
+    }
+
+    /* replace old vocab with the new one.  If this fails the index is
+     * probably stuffed, as with impact ordering. */
+    iobtree_delete(idx->vocab);
+    idx->vocab = NULL;
+    if ((ret = bound_replace(idx, bulk.fileno + 1)) != BOUND_OK) {
+        return ret;
+    }
+    idx->vocabs = bulk.fileno + 1;
+
+    if (!(idx->vocab = iobtree_load_quick(idx->storage.pagesize,
+        idx->storage.btleaf_strategy, idx->storage.btnode_strategy, NULL,
+        idx->fd, idx->vocab_type, root_fileno, root_offset, terms))) {
+        ERROR("loading new vocab");
+        return BOUND_OTHER_ERROR;
+    }
+
+    /* record the parameters, so that updates can recompute the bounds */
+    idx->bounds.build = 1;
+    idx->bounds.k1 = k1;
+    idx->bounds.b = b;
+    idx->bounds.mu = mu;
+    if (!index_commit_superblock(idx)) {
+        ERROR("committing superblock");
+        return BOUND_IO_ERROR;
+    }
+
+    return BOUND_OK;
+}
+
@@ -34,8 +34,9 @@ void btbucket_new(void *btbucket, unsigned int bucketsize,
     b->u.s.prefixsize = BIT_SET(*prefix_size, 7, leaf);
 
     /* tailsize is the amount of space in the btree bucket not allocated to the
-     * bucket itself.  If its a leaf then it has a sibling pointer ... */
-    b->u.s.tailsize = leaf * (sizeof(sib_fileno) + sizeof(sib_offset))
+     * bucket itself.  If its a leaf then it has a sibling pointer (stored
+     * the same way as btbucket_set_sibling writes it) ... */
+    b->u.s.tailsize = leaf * (sizeof(unsigned int) + sizeof(unsigned long int))
       /* ... and all buckets have a prefix which takes space ... */
       + *prefix_size 
       /* ... and all buckets have two bytes overhead at the start ... */
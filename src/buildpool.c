@@ -0,0 +1,849 @@
+/* buildpool.c implements the concurrent index construction declared in
+ * buildpool.h.
+ *
+ * Submitted files are kept in a list in submission order.  A worker takes a
+ * batch of the oldest files that haven't been started (enough of them to
+ * fill its postings, judging by their size), and parses them into a run:
+ * postings with documents numbered from 0, along with what the docmap needs
+ * to know about each document.  Whenever the postings are full, and at the
+ * end of the batch, the worker hands the run to the merging thread and
+ * carries on with another.  The merging thread takes runs in the order of the
+ * files they came from, adds their documents to the docmap, and dumps their
+ * postings (renumbered from the first document number they were given) into
+ * the merging pyramid, which merges them as it sees fit.
+ *
+ * Workers wait before starting a new run while as many runs as there are
+ * workers are waiting to be merged, so that they can't get far ahead of the
+ * merging thread.  The worker parsing the batch that the merging thread is
+ * up to only waits while the merging thread has one of its runs to merge,
+ * since otherwise the runs waiting are held up behind its own.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "buildpool.h"
+
+#include "_index.h"
+
+#include "def.h"
+#include "docmap.h"
+#include "error.h"
+#include "fdset.h"
+#include "makeindex.h"
+#include "mime.h"
+#include "postings.h"
+#include "psettings.h"
+#include "pyramid.h"
+#include "str.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
+/* a submitted file */
+struct job {
+    struct buildpool_result res;     /* result (and file) */
+    char *mimetype;                  /* type of file (or NULL) */
+    unsigned int repos;              /* repository number of file, or
+                                      * UINT_MAX if not yet numbered */
+    unsigned long int seq;           /* position in submission order */
+    unsigned long int bytes;         /* size of file */
+    struct timeval then;             /* when we started adding the file */
+    int done;                        /* whether the file has been added */
+    struct job *next;                /* next file in submission order */
+};
+
+/* a parsed document waiting to be added to the docmap */
+struct doc {
+    struct job *job;                 /* file the document is from */
+    off_t offset;                    /* offset of document in file */
+    unsigned int bytes;              /* size of document */
+    enum docmap_flag flags;          /* docmap flags for the document */
+    enum mime_types type;            /* type of the document */
+    unsigned int words;              /* number of words in the document */
+    unsigned int distinct;           /* number of distinct words */
+    unsigned int fields[INDEX_FIELDS]; /* number of words in each field */
+    float weight;                    /* weight of the document */
+    unsigned int aux;                /* offset of docno in run aux buffer */
+    unsigned int auxlen;             /* length of docno */
+};
+
+/* consecutive documents parsed by a worker */
+struct run {
+    struct postings *post;           /* postings, numbered from 0 */
+    struct doc *doc;                 /* documents in postings */
+    unsigned int docs;               /* number of documents */
+    unsigned int docsize;            /* capacity of doc array */
+    char *aux;                       /* docnos of documents */
+    unsigned int auxlen;             /* length of aux buffer */
+    unsigned int auxsize;            /* capacity of aux buffer */
+    unsigned long int batch;         /* seq of first file of the batch run
+                                      * is from */
+    unsigned int seq;                /* position of run in its batch */
+    struct job *from;                /* file being parsed when run started */
+    struct job *last;                /* last file that ended in run (files
+                                      * from from onward ended in it), or
+                                      * NULL if none did */
+    int end;                         /* whether run ends its batch */
+    struct run *next;                /* next run in list */
+};
+
+struct buildpool {
+    struct index *idx;               /* index being built */
+    unsigned int threads;            /* number of worker threads */
+    unsigned int opts;               /* options for index_add */
+    struct index_add_opt *opt;       /* options for index_add */
+    unsigned int commitopts;         /* commit options for index_add */
+    struct index_commit_opt *commitopt; /* commit options for index_add */
+    struct job *head;                /* oldest uncollected file */
+    struct job *tail;                /* most recently submitted file */
+    struct job *next;                /* oldest file not yet started */
+    unsigned long int seq;           /* number of files submitted */
+    unsigned int pending;            /* number of uncollected files */
+#ifdef MT_ZET
+    unsigned int accbuf;             /* postings memory before a run ends */
+    unsigned int accdoc;             /* documents before a run can end */
+    void *dumpbuf;                   /* buffer for dumping and merging */
+    unsigned int dumpbufsz;          /* size of dumpbuf */
+    unsigned long int unfinished;    /* number of files not yet added */
+    unsigned long int batch;         /* seq of first file of the batch
+                                      * that the merging thread is up to */
+    unsigned int batchseq;           /* seq of next run to take from it */
+    struct run *ready;               /* runs waiting to be merged */
+    unsigned int queued;             /* number of runs in ready list */
+    struct run *free;                /* runs waiting to be reused */
+    unsigned int busy;               /* number of threads working on files */
+    int err;                         /* whether adding a file failed */
+    int finish;                      /* whether threads should exit */
+    pthread_t *thread;               /* worker threads */
+    pthread_t merger;                /* merging thread */
+    pthread_mutex_t mutex;           /* protects everything above */
+    pthread_cond_t work;             /* signalled when a file is submitted,
+                                      * or the pool is finishing */
+    pthread_cond_t merge;            /* signalled when a run is ready, or
+                                      * the pool is finishing */
+    pthread_cond_t reuse;            /* signalled when a run is merged */
+    pthread_cond_t done;             /* signalled when a file is done, or
+                                      * threads stop work on a failure */
+#endif /* MT_ZET */
+};
+
+static void job_delete(struct job *job) {
+    free(job->res.file);
+    free(job->mimetype);
+    free(job);
+}
+
+/* internal function to return the number of seconds since then */
+static double elapsed(struct timeval *then) {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (double) ((now.tv_sec - then->tv_sec)
+      + (now.tv_usec - (double) then->tv_usec) / 1000000.0);
+}
+
+#ifdef MT_ZET
+
+static struct run *run_new(struct index *idx) {
+    struct run *run;
+
+    if ((run = malloc(sizeof(*run)))
+      && (run->post = postings_new(idx->params.tblsize, index_stemmer(idx),
+          idx->stem, idx->istop, idx->fields))) {
+        run->doc = NULL;
+        run->docs = run->docsize = 0;
+        run->aux = NULL;
+        run->auxlen = run->auxsize = 0;
+        return run;
+    } else {
+        free(run);
+        return NULL;
+    }
+}
+
+static void run_delete(struct run *run) {
+    postings_delete(run->post);
+    free(run->doc);
+    free(run->aux);
+    free(run);
+}
+
+/* internal function to find the run that the merging thread is up to in the
+ * list of runs ready to be merged, also pointing *prev at the link to it
+ * (if prev isn't NULL).  Must be called with the mutex held.  Returns NULL
+ * if it isn't ready. */
+static struct run *run_next(struct buildpool *pool, struct run ***prev) {
+    struct run **link,
+               *run;
+
+    for (link = &pool->ready; (run = *link)
+      && ((run->batch != pool->batch) || (run->seq != pool->batchseq));
+      link = &run->next) ;
+
+    if (prev) {
+        *prev = link;
+    }
+    return run;
+}
+
+/* internal function to obtain an empty run to parse batch batch into,
+ * starting with file from, waiting for the merging thread to catch up if
+ * necessary.  Must be called with the mutex held.  Returns NULL on
+ * failure. */
+static struct run *run_get(struct buildpool *pool, unsigned long int batch,
+  struct job *from) {
+    struct run *run;
+
+    while ((pool->queued >= pool->threads) && !pool->err
+      && ((batch != pool->batch) || run_next(pool, NULL))) {
+        pthread_cond_wait(&pool->reuse, &pool->mutex);
+    }
+
+    if (pool->err) {
+        return NULL;
+    } else if ((run = pool->free)) {
+        pool->free = run->next;
+    } else if (!(run = run_new(pool->idx))) {
+        return NULL;
+    }
+
+    run->batch = batch;
+    run->seq = 0;
+    run->from = from;
+    run->last = NULL;
+    run->end = 0;
+    run->next = NULL;
+    return run;
+}
+
+/* internal function to give a parsed run to the merging thread.  Must be
+ * called with the mutex held. */
+static void run_put(struct buildpool *pool, struct run *run) {
+    run->next = pool->ready;
+    pool->ready = run;
+    pool->queued++;
+    pthread_cond_signal(&pool->merge);
+}
+
+/* internal function to note that adding files has failed.  Must be called
+ * with the mutex held. */
+static void fail(struct buildpool *pool) {
+    pool->err = 1;
+    pthread_cond_broadcast(&pool->merge);
+    pthread_cond_broadcast(&pool->reuse);
+    pthread_cond_broadcast(&pool->done);
+}
+
+/* state of a worker thread while it parses a file */
+struct worker {
+    struct buildpool *pool;          /* pool worker belongs to */
+    struct run *run;                 /* run being parsed into */
+    struct job *job;                 /* file being parsed */
+};
+
+/* index_parse callback to record a parsed document in the current run,
+ * moving on to a new run if it's full */
+static int worker_enddoc(void *opaque, struct makeindex *mi, off_t offset,
+  unsigned int bytes, enum docmap_flag flags) {
+    struct worker *w = opaque;
+    struct buildpool *pool = w->pool;
+    struct run *run = w->run,
+               *next;
+    const char *aux = makeindex_docno(mi);
+    unsigned int auxlen = str_len(aux);
+    struct doc *doc;
+    void *ptr;
+
+    assert(mi->post == run->post);
+    assert(mi->docs == run->docs + 1);
+
+    if (run->docs == run->docsize) {
+        if (!(ptr = realloc(run->doc,
+            sizeof(*run->doc) * (run->docsize * 2 + 1)))) {
+            return 0;
+        }
+        run->doc = ptr;
+        run->docsize = run->docsize * 2 + 1;
+    }
+    if (run->auxlen + auxlen > run->auxsize) {
+        if (!(ptr = realloc(run->aux, run->auxsize * 2 + auxlen))) {
+            return 0;
+        }
+        run->aux = ptr;
+        run->auxsize = run->auxsize * 2 + auxlen;
+    }
+
+    doc = &run->doc[run->docs++];
+    doc->job = w->job;
+    doc->offset = offset;
+    doc->bytes = bytes;
+    doc->flags = flags;
+    doc->type = makeindex_type(mi);
+    doc->words = mi->stats.terms;
+    doc->distinct = mi->stats.distinct;
+    memcpy(doc->fields, mi->stats.fields, sizeof(doc->fields));
+    doc->weight = mi->stats.weight;
+    doc->aux = run->auxlen;
+    doc->auxlen = auxlen;
+    memcpy(run->aux + run->auxlen, aux, auxlen);
+    run->auxlen += auxlen;
+
+    /* check if we need to move on to a new run */
+    if ((postings_memsize(run->post) >= pool->accbuf)
+      && (postings_documents(run->post) >= pool->accdoc)) {
+        unsigned long int batch = run->batch;
+        unsigned int seq = run->seq + 1;
+
+        /* note that run can be merged and reused as soon as we put it */
+        pthread_mutex_lock(&pool->mutex);
+        run_put(pool, run);
+        w->run = next = run_get(pool, batch, w->job);
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (!next) {
+            return 0;
+        }
+        next->seq = seq;
+        mi->post = next->post;
+        mi->docs = 0;
+    }
+    return 1;
+}
+
+/* internal function to parse the file a worker is up to into its run */
+static int worker_parse(struct worker *w) {
+    struct job *job = w->job;
+    int fd,
+        ret;
+
+    gettimeofday(&job->then, NULL);
+    if ((fd = open(job->res.file, O_RDONLY | O_BINARY)) < 0) {
+        ERROR1("opening '%s'", job->res.file);
+        return 0;
+    }
+    ret = index_parse(w->pool->idx, fd, job->res.file, job->mimetype,
+      w->run->post, w->run->docs, worker_enddoc, NULL, w,
+      &job->res.detected_type);
+    close(fd);
+
+    if (ret) {
+        w->run->last = job;
+    }
+    return ret;
+}
+
+/* main loop of worker threads */
+static void *worker(void *vpool) {
+    struct buildpool *pool = vpool;
+    struct worker w;
+    struct job *first,
+               *last;
+    unsigned long int bytes;
+    int ok;
+
+    w.pool = pool;
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->finish) {
+        if (pool->next && !pool->err) {
+            /* take the oldest files that haven't been started, as many as
+             * we expect to fill our postings */
+            first = last = pool->next;
+            bytes = first->bytes;
+            while (last->next && (bytes < pool->accbuf)) {
+                last = last->next;
+                bytes += last->bytes;
+            }
+            pool->next = last->next;
+            pool->busy++;
+            w.run = run_get(pool, first->seq, first);
+            pthread_mutex_unlock(&pool->mutex);
+
+            ok = (w.run != NULL);
+            for (w.job = first; ok; w.job = w.job->next) {
+                ok = worker_parse(&w);
+                if (w.job == last) {
+                    break;
+                }
+            }
+
+            pthread_mutex_lock(&pool->mutex);
+            if (ok) {
+                w.run->end = 1;
+                run_put(pool, w.run);
+            } else {
+                if (w.run) {
+                    run_delete(w.run);
+                }
+                fail(pool);
+            }
+            pool->busy--;
+            pthread_cond_broadcast(&pool->done);
+        } else {
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/* internal function to give a file the next repository number, as index_add
+ * would, unless it has one already, and to copy it into the document store if
+ * the index has one.  Returns true on success. */
+static int merge_repos(struct index *idx, struct job *job) {
+    int fd;
+
+    if (job->repos == UINT_MAX) {
+        if (fdset_set_fd_name(idx->fd, idx->repos_type, idx->repos,
+            job->res.file, str_len(job->res.file), 0) != FDSET_OK) {
+            return 0;
+        }
+        job->repos = idx->repos++;
+
+        /* as for index_add, failing to store the file isn't fatal */
+        if (idx->store) {
+            if ((fd = open(job->res.file, O_RDONLY | O_BINARY)) >= 0) {
+                index_store(idx, job->repos, fd);
+                close(fd);
+            } else {
+                ERROR1("opening '%s'", job->res.file);
+            }
+        }
+    }
+    return 1;
+}
+
+/* internal function to add the documents in a run to the docmap and dump its
+ * postings into the merging pyramid */
+static int merge_run(struct buildpool *pool, struct run *run) {
+    struct index *idx = pool->idx;
+    unsigned long int base = docmap_entries(idx->map),
+                      docno;
+    unsigned int i;
+    struct doc *doc;
+    struct job *job;
+    enum docmap_ret dm_ret;
+    int outfd;
+
+    /* number repositories in file order, including those of files without
+     * any documents */
+    job = run->from;
+    for (i = 0; i < run->docs; i++) {
+        doc = &run->doc[i];
+        while (merge_repos(idx, job) && (job != doc->job)) {
+            job = job->next;
+        }
+        if (job != doc->job) {
+            return 0;
+        }
+        dm_ret = docmap_add(idx->map, doc->job->repos, doc->offset,
+          doc->bytes, doc->flags, doc->words, doc->distinct, doc->fields, 
+          doc->weight,
+          run->aux + doc->aux, doc->auxlen, doc->type, &docno);
+        if (dm_ret != DOCMAP_OK) {
+            ERROR1("error on docmap_add: %s", docmap_strerror(dm_ret));
+            return 0;
+        }
+        assert(docno == base + i);
+        if (!doc->job->res.docs++) {
+            doc->job->res.docno = docno;
+        }
+    }
+
+    for (job = run->from; run->last; job = job->next) {
+        if (!job->res.docs) {
+            job->res.docno = docmap_entries(idx->map);
+        }
+        if (!merge_repos(idx, job)) {
+            return 0;
+        }
+        if (job == run->last) {
+            break;
+        }
+    }
+
+    if (postings_size(run->post)) {
+        if (((outfd = pyramid_pin_next(idx->merger)) >= 0)
+          && postings_dump_rebase(run->post, pool->dumpbuf, pool->dumpbufsz,
+              outfd, base)
+          && (pyramid_unpin_next(idx->merger, outfd) == PYRAMID_OK)
+          && (pyramid_add_file(idx->merger, 1, pool->dumpbuf,
+              pool->dumpbufsz) == PYRAMID_OK)) {
+            /* dumping succeeded */
+        } else {
+            return 0;
+        }
+    } else {
+        postings_clear(run->post);
+    }
+
+    run->docs = 0;
+    run->auxlen = 0;
+    return 1;
+}
+
+/* main loop of the merging thread */
+static void *merger(void *vpool) {
+    struct buildpool *pool = vpool;
+    struct run *run,
+               **prev;
+    struct job *job;
+    int ok;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->finish && !pool->err) {
+        if ((run = run_next(pool, &prev))) {
+            *prev = run->next;
+            pool->queued--;
+            if (run->end) {
+                pool->batch = run->last->seq + 1;
+                pool->batchseq = 0;
+            } else {
+                pool->batchseq++;
+            }
+            pool->busy++;
+            pthread_mutex_unlock(&pool->mutex);
+
+            ok = merge_run(pool, run);
+
+            pthread_mutex_lock(&pool->mutex);
+            pool->busy--;
+            if (ok) {
+                for (job = run->from; run->last; job = job->next) {
+                    job->res.ok = 1;
+                    job->res.seconds = elapsed(&job->then);
+                    job->done = 1;
+                    pool->unfinished--;
+                    if (job == run->last) {
+                        break;
+                    }
+                }
+                run->next = pool->free;
+                pool->free = run;
+                pthread_cond_broadcast(&pool->reuse);
+                pthread_cond_broadcast(&pool->done);
+            } else {
+                run_delete(run);
+                fail(pool);
+            }
+        } else {
+            pthread_cond_wait(&pool->merge, &pool->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/* internal function to start the threads of a pool that adds files
+ * concurrently.  Returns true on success. */
+static int start(struct buildpool *pool) {
+    struct index *idx = pool->idx;
+    struct psettings_type *ptype;
+    enum mime_types type;
+    unsigned int i;
+    int outfd;
+
+    pool->accbuf = idx->params.memory;
+    pool->accdoc = 0;
+    pool->dumpbufsz = DUMP_BUFFER;
+    if (pool->opts & INDEX_ADD_ACCBUF) {
+        pool->accbuf = pool->opt->accbuf;
+    }
+    if (pool->opts & INDEX_ADD_ACCDOC) {
+        pool->accdoc = pool->opt->accdoc;
+    }
+    if (pool->commitopts & INDEX_COMMIT_DUMPBUF) {
+        pool->dumpbufsz = pool->commitopt->dumpbuf;
+    }
+    pool->unfinished = 0;
+    pool->batch = 0;
+    pool->batchseq = 0;
+    pool->ready = pool->free = NULL;
+    pool->queued = 0;
+    pool->busy = 0;
+    pool->err = 0;
+    pool->finish = 0;
+
+    /* makeindex gives types without parser settings the default settings
+     * the first time it sees them, which would change them under the other
+     * workers, so do that now for all of them */
+    for (type = 0; mime_string(type); type++) {
+        if ((psettings_type_tags(idx->settings, type, &ptype) != PSETTINGS_OK)
+          && (psettings_type_default(idx->settings, type,
+              psettings_default(idx->settings)) != PSETTINGS_OK)) {
+            return 0;
+        }
+    }
+
+    if (!(pool->dumpbuf = malloc(pool->dumpbufsz))) {
+        return 0;
+    }
+
+    /* runs are numbered from the end of the docmap, so anything index_add has
+     * accumulated has to go into the pyramid first */
+    assert(!postings_needs_update(idx->post));
+    if (postings_size(idx->post)
+      && !(((outfd = pyramid_pin_next(idx->merger)) >= 0)
+        && postings_dump(idx->post, pool->dumpbuf, pool->dumpbufsz, outfd)
+        && (pyramid_unpin_next(idx->merger, outfd) == PYRAMID_OK)
+        && (pyramid_add_file(idx->merger, 1, pool->dumpbuf, pool->dumpbufsz)
+          == PYRAMID_OK))) {
+        free(pool->dumpbuf);
+        return 0;
+    }
+
+    if (!(pool->thread = malloc(sizeof(*pool->thread) * pool->threads))) {
+        free(pool->dumpbuf);
+        return 0;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->merge, NULL);
+    pthread_cond_init(&pool->reuse, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    if (!pthread_create(&pool->merger, NULL, merger, pool)) {
+        for (i = 0; i < pool->threads; i++) {
+            if (pthread_create(&pool->thread[i], NULL, worker, pool)) {
+                /* couldn't create all of them, make do with what we have */
+                break;
+            }
+        }
+
+        if (i) {
+            pthread_mutex_lock(&pool->mutex);
+            pool->threads = i;
+            pthread_mutex_unlock(&pool->mutex);
+            return 1;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->finish = 1;
+        pthread_cond_broadcast(&pool->merge);
+        pthread_mutex_unlock(&pool->mutex);
+        pthread_join(pool->merger, NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->reuse);
+    pthread_cond_destroy(&pool->merge);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->thread);
+    free(pool->dumpbuf);
+    return 0;
+}
+
+#endif /* MT_ZET */
+
+struct buildpool *buildpool_new(struct index *idx, unsigned int threads,
+  unsigned int opts, struct index_add_opt *opt,
+  unsigned int commitopts, struct index_commit_opt *commitopt) {
+    struct buildpool *pool;
+
+#ifndef MT_ZET
+    threads = 1;
+#endif /* MT_ZET */
+
+    if (!(pool = malloc(sizeof(*pool)))) {
+        return NULL;
+    }
+    pool->idx = idx;
+    pool->opts = opts;
+    pool->opt = opt;
+    pool->commitopts = commitopts;
+    pool->commitopt = commitopt;
+    pool->head = pool->tail = pool->next = NULL;
+    pool->seq = 0;
+    pool->pending = 0;
+
+    /* files added to a constructed index update it as they're added, so can
+     * only be added one at a time */
+    pool->threads = ((threads > 1) && !(idx->flags & INDEX_BUILT))
+      ? threads : 1;
+
+#ifdef MT_ZET
+    if ((pool->threads > 1) && !start(pool)) {
+        free(pool);
+        return NULL;
+    }
+#endif /* MT_ZET */
+
+    return pool;
+}
+
+void buildpool_delete(struct buildpool *pool) {
+    struct job *job;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        struct run *run;
+        unsigned int i;
+
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->err ? pool->busy : pool->unfinished) {
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        }
+        pool->finish = 1;
+        pthread_cond_broadcast(&pool->work);
+        pthread_cond_broadcast(&pool->merge);
+        pthread_mutex_unlock(&pool->mutex);
+        for (i = 0; i < pool->threads; i++) {
+            pthread_join(pool->thread[i], NULL);
+        }
+        pthread_join(pool->merger, NULL);
+
+        while ((run = pool->ready)) {
+            pool->ready = run->next;
+            run_delete(run);
+        }
+        while ((run = pool->free)) {
+            pool->free = run->next;
+            run_delete(run);
+        }
+
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->reuse);
+        pthread_cond_destroy(&pool->merge);
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->thread);
+        free(pool->dumpbuf);
+    }
+#endif /* MT_ZET */
+
+    while ((job = pool->head)) {
+        pool->head = job->next;
+        job_delete(job);
+    }
+    free(pool);
+}
+
+enum buildpool_ret buildpool_submit(struct buildpool *pool, const char *file,
+  const char *mimetype, void *userdata) {
+    struct job *job;
+    struct stat st;
+
+    if (!(job = malloc(sizeof(*job)))) {
+        return BUILDPOOL_ENOMEM;
+    }
+    job->res.file = str_dup(file);
+    job->mimetype = NULL;
+    if (!job->res.file || (mimetype && !(job->mimetype = str_dup(mimetype)))) {
+        job_delete(job);
+        return BUILDPOOL_ENOMEM;
+    }
+    job->res.userdata = userdata;
+    job->res.ok = 0;
+    job->res.docno = 0;
+    job->res.docs = 0;
+    job->res.detected_type = NULL;
+    job->res.seconds = 0.0;
+    job->bytes = stat(file, &st) ? 0 : st.st_size;
+    job->repos = UINT_MAX;
+    job->done = 0;
+    job->next = NULL;
+
+    if (pool->threads <= 1) {
+        /* add it now */
+        gettimeofday(&job->then, NULL);
+        job->res.ok = index_add(pool->idx, file, mimetype, &job->res.docno,
+            &job->res.docs, pool->opts, pool->opt, pool->commitopts,
+            pool->commitopt);
+        job->res.detected_type = pool->opt->detected_type;
+        job->res.seconds = elapsed(&job->then);
+        job->done = 1;
+    }
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->unfinished++;
+    }
+#endif /* MT_ZET */
+
+    job->seq = pool->seq++;
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    if (!pool->next && !job->done) {
+        pool->next = job;
+    }
+    pool->pending++;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+#endif /* MT_ZET */
+
+    return BUILDPOOL_OK;
+}
+
+enum buildpool_ret buildpool_next(struct buildpool *pool,
+  struct buildpool_result **res) {
+    struct job *job;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+
+        /* wait for the file to be added, or for everything to stop after a
+         * failure */
+        while (pool->head && !pool->head->done
+          && (!pool->err || pool->busy)) {
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        }
+    }
+#endif /* MT_ZET */
+
+    if ((job = pool->head)) {
+        assert(job->done || !job->res.ok);
+        if (!(pool->head = job->next)) {
+            pool->tail = NULL;
+        }
+        pool->pending--;
+    }
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_mutex_unlock(&pool->mutex);
+    }
+#endif /* MT_ZET */
+
+    if (job) {
+        /* the result is the first member of the job, so hand it over and free
+         * the rest of it when it's deleted */
+        *res = &job->res;
+        return BUILDPOOL_OK;
+    } else {
+        return BUILDPOOL_EMPTY;
+    }
+}
+
+unsigned int buildpool_pending(const struct buildpool *pool) {
+    return pool->pending;
+}
+
+unsigned int buildpool_threads(const struct buildpool *pool) {
+    return pool->threads;
+}
+
+void buildpool_result_delete(struct buildpool_result *res) {
+    job_delete((struct job *) res);
+}
+
@@ -0,0 +1,272 @@
+/* cache.c implements the byte-bounded cache declared in cache.h.
+ *
+ * Values are allocated with a small header in front of them, which records
+ * their key, length and position in a doubly linked list kept in order of
+ * use (most recently used first).  A hashtable maps keys to headers.  Values
+ * that are discarded while pinned are removed from the list and the
+ * hashtable immediately, but not freed until the last pin is released.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "cache.h"
+
+#include "chash.h"
+#include "str.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MT_ZET
+#include <pthread.h>
+
+#define CACHE_LOCK(cache) pthread_mutex_lock(&(cache)->mutex)
+#define CACHE_UNLOCK(cache) pthread_mutex_unlock(&(cache)->mutex)
+#else
+#define CACHE_LOCK(cache)
+#define CACHE_UNLOCK(cache)
+#endif /* MT_ZET */
+
+/* header preceding each value */
+struct entry {
+    char *key;                       /* key value is stored under (or NULL if
+                                      * it hasn't been stored) */
+    unsigned int keylen;             /* length of key */
+    unsigned int len;                /* length of the value */
+    unsigned int pins;               /* number of times value is pinned */
+    int cached;                      /* whether value is still in cache */
+    struct entry *prev;              /* more recently used value */
+    struct entry *next;              /* less recently used value */
+};
+
+/* union used to keep values aligned as well as malloc would */
+union entry_align {
+    struct entry entry;
+    double d;
+    long int l;
+    void *p;
+};
+
+#define VALUE(entry) ((void *) ((union entry_align *) (entry) + 1))
+#define ENTRY(value) ((struct entry *) ((union entry_align *) (value) - 1))
+
+/* number of bytes an entry is charged for */
+#define COST(entry) \
+  (sizeof(union entry_align) + (entry)->len + (entry)->keylen)
+
+struct cache {
+    struct chash *lookup;            /* hashtable of entries by key */
+    struct entry *head;              /* most recently used entry */
+    struct entry *tail;              /* least recently used entry */
+    unsigned long int size;          /* maximum number of bytes held */
+    unsigned long int used;          /* number of bytes held */
+    unsigned long int lookups;       /* number of calls to cache_find */
+    unsigned long int hits;          /* number of values found */
+#ifdef MT_ZET
+    pthread_mutex_t mutex;           /* protects everything above */
+#endif /* MT_ZET */
+};
+
+struct cache *cache_new(unsigned long int size) {
+    struct cache *cache;
+
+    if ((cache = malloc(sizeof(*cache)))
+      && (cache->lookup = chash_str_new(4, 1.0, str_nhash))) {
+        cache->head = cache->tail = NULL;
+        cache->size = size;
+        cache->used = 0;
+        cache->lookups = cache->hits = 0;
+#ifdef MT_ZET
+        pthread_mutex_init(&cache->mutex, NULL);
+#endif /* MT_ZET */
+        return cache;
+    } else {
+        if (cache) {
+            free(cache);
+        }
+        return NULL;
+    }
+}
+
+void *cache_alloc(unsigned int len) {
+    struct entry *entry;
+
+    if ((entry = malloc(sizeof(union entry_align) + len))) {
+        entry->key = NULL;
+        entry->keylen = 0;
+        entry->len = len;
+        entry->pins = 0;
+        entry->cached = 0;
+        entry->prev = entry->next = NULL;
+        return VALUE(entry);
+    } else {
+        return NULL;
+    }
+}
+
+void cache_free(void *value) {
+    struct entry *entry = ENTRY(value);
+
+    assert(!entry->cached && !entry->pins);
+    if (entry->key) {
+        free(entry->key);
+    }
+    free(entry);
+}
+
+/* internal function to unlink an entry from the list of entries */
+static void unlink_entry(struct cache *cache, struct entry *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+/* internal function to link an entry in as the most recently used */
+static void link_entry(struct cache *cache, struct entry *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+/* internal function to remove an entry from the cache, freeing it unless it's
+ * pinned */
+static void discard(struct cache *cache, struct entry *entry) {
+    void *found;
+    enum chash_ret ret;
+
+    assert(entry->cached);
+    ret = chash_nstr_ptr_remove(cache->lookup, entry->key, entry->keylen,
+        &found);
+    assert(ret == CHASH_OK && found == entry);
+    unlink_entry(cache, entry);
+    cache->used -= COST(entry);
+    entry->cached = 0;
+    if (!entry->pins) {
+        cache_free(VALUE(entry));
+    }
+}
+
+const void *cache_find(struct cache *cache, const char *key,
+  unsigned int keylen, unsigned int *len) {
+    struct entry *entry;
+    void **found;
+
+    CACHE_LOCK(cache);
+    cache->lookups++;
+    if (chash_nstr_ptr_find(cache->lookup, key, keylen, &found) == CHASH_OK) {
+        entry = *found;
+        cache->hits++;
+        entry->pins++;
+        if (cache->head != entry) {
+            unlink_entry(cache, entry);
+            link_entry(cache, entry);
+        }
+        CACHE_UNLOCK(cache);
+        *len = entry->len;
+        return VALUE(entry);
+    }
+    CACHE_UNLOCK(cache);
+    return NULL;
+}
+
+void cache_release(struct cache *cache, const void *value) {
+    struct entry *entry = ENTRY(value);
+
+    CACHE_LOCK(cache);
+    assert(entry->pins);
+    if (!--entry->pins && !entry->cached) {
+        cache_free(VALUE(entry));
+    }
+    CACHE_UNLOCK(cache);
+}
+
+enum cache_ret cache_insert(struct cache *cache, const char *key,
+  unsigned int keylen, void *value, int pin) {
+    struct entry *entry = ENTRY(value);
+    void **found;
+
+    assert(!entry->cached && !entry->pins);
+    if (sizeof(union entry_align) + entry->len + keylen > cache->size) {
+        return CACHE_ETOOBIG;
+    }
+
+    if (!entry->key || (entry->keylen < keylen)) {
+        if (entry->key) {
+            free(entry->key);
+        }
+        if (!(entry->key = malloc(keylen))) {
+            return CACHE_ENOMEM;
+        }
+    }
+    memcpy(entry->key, key, keylen);
+    entry->keylen = keylen;
+
+    CACHE_LOCK(cache);
+    /* replace anything stored under the key, then make room */
+    if (chash_nstr_ptr_find(cache->lookup, key, keylen, &found) == CHASH_OK) {
+        discard(cache, *found);
+    }
+    while (cache->used + COST(entry) > cache->size) {
+        assert(cache->tail);
+        discard(cache, cache->tail);
+    }
+
+    if (chash_nstr_ptr_insert(cache->lookup, entry->key, keylen, entry)
+      != CHASH_OK) {
+        CACHE_UNLOCK(cache);
+        return CACHE_ENOMEM;
+    }
+    link_entry(cache, entry);
+    cache->used += COST(entry);
+    entry->cached = 1;
+    if (pin) {
+        entry->pins++;
+    }
+    CACHE_UNLOCK(cache);
+    return CACHE_OK;
+}
+
+void cache_clear(struct cache *cache) {
+    CACHE_LOCK(cache);
+    while (cache->head) {
+        discard(cache, cache->head);
+    }
+    CACHE_UNLOCK(cache);
+}
+
+void cache_delete(struct cache *cache) {
+    cache_clear(cache);
+    chash_delete(cache->lookup);
+#ifdef MT_ZET
+    pthread_mutex_destroy(&cache->mutex);
+#endif /* MT_ZET */
+    free(cache);
+}
+
+unsigned long int cache_size(const struct cache *cache) {
+    return cache->size;
+}
+
+void cache_stats(struct cache *cache, unsigned long int *lookups,
+  unsigned long int *hits) {
+    CACHE_LOCK(cache);
+    *lookups = cache->lookups;
+    *hits = cache->hits;
+    CACHE_UNLOCK(cache);
+}
+
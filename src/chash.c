@@ -695,6 +695,52 @@ enum chash_ret chash_ptr_luint_find(struct chash *hash, const void *key,
     return CHASH_ENOENT;
 }
 
+/* macro to find an element without moving it to the front of its chain, so
+ * that the hashtable isn't changed */
+#define CHASH_PEEK(hash, ky, keytype, keyisptr, dt, datatype)                 \
+    do {                                                                      \
+        const struct chash_link *link = hash->table[modhash];                 \
+                                                                              \
+        while (link) {                                                        \
+            if ((keyisptr && ((hashval == link->hash)                         \
+                && (!hash->cmpfn((void*) ky, link->key.k_ptr))))              \
+              /* compare direct if key isn't a pointer type */                \
+              || (!keyisptr && (link->key.k_##keytype == ky))) {              \
+                *dt = link->data.d_##datatype;                                \
+                return CHASH_OK;                                              \
+            }                                                                 \
+            link = link->next;                                                \
+        }                                                                     \
+    } while (0)
+
+enum chash_ret chash_ptr_ptr_peek(const struct chash *hash, const void *key, 
+  void **data) {
+    unsigned int hashval = hash->hashfn.h_ptr(key),
+                 modhash = BIT_MOD2(hashval, hash->bits);
+
+    assert(hash->key_type == CHASH_TYPE_PTR);
+    assert((hash->data_type == CHASH_TYPE_PTR) 
+      || (hash->data_type == CHASH_TYPE_UNKNOWN));
+
+    CHASH_PEEK(hash, key, ptr, 1, data, ptr);
+    /* failed to find it */
+    return CHASH_ENOENT;
+}
+
+enum chash_ret chash_ptr_luint_peek(const struct chash *hash, const void *key, 
+  unsigned long int *data) {
+    unsigned int hashval = hash->hashfn.h_ptr(key),
+                 modhash = BIT_MOD2(hashval, hash->bits);
+
+    assert(hash->key_type == CHASH_TYPE_PTR);
+    assert((hash->data_type == CHASH_TYPE_LUINT) 
+      || (hash->data_type == CHASH_TYPE_UNKNOWN));
+
+    CHASH_PEEK(hash, key, ptr, 1, data, luint);
+    /* failed to find it */
+    return CHASH_ENOENT;
+}
+
 enum chash_ret chash_luint_ptr_find(struct chash *hash, unsigned long int key, 
   void ***data) {
     unsigned int hashval = key,  /* integral types are their own hash values */
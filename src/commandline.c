@@ -16,6 +16,9 @@
 #include "timings.h"
 #include "index_querybuild.h"
 #include "summarise.h"
+#include "searchpool.h"
+#include "buildpool.h"
+#include "bound_build.h"
 #include "error.h"
 #include "signals.h"
 #include "svnversion.h"
@@ -48,11 +51,24 @@ void print_usage(const char *progname, FILE *output, int verbose) {
     fprintf(output, "    --summary=[value]: create textual summary of this "
       "type\n"
       "                       (where value is capitalise, plain, or tag)\n");
+    fprintf(output, "    --summary-threads=[uint]: summarise the results of "
+      "a query this many at once\n");
     fprintf(output, "    --query-list=[file]: read queries from this file\n");
     fprintf(output, "    --query-stop=[file]: stop queries according to the "
       "contents of this file\n");
     fprintf(output, 
       "                         (or use default if no file give)\n");
+    fprintf(output, "    --threads=[uint]: evaluate this many queries (or "
+      "parse this many files,\n"
+      "                      and impact-order this many lists) at once\n");
+    fprintf(output, "    --mmap: memory-map the index rather than reading "
+      "it\n");
+    fprintf(output, "    --norms: hold document lengths and weights in "
+      "memory approximately,\n             as 8-bit norms\n");
+    fprintf(output, "    --list-cache=[bytes]: keep recently used inverted "
+      "lists in memory\n");
+    fprintf(output, "    --result-cache=[bytes]: keep results of recent "
+      "queries in memory\n");
     fprintf(output, "    --big-and-fast: use more memory\n");
     fprintf(output, "    -s,--stats: get index statistics\n");
     fprintf(output, "    -v,--version: print version number\n");
@@ -66,6 +82,11 @@ void print_usage(const char *progname, FILE *output, int verbose) {
     fprintf(output, "    --k1=[float]: set Okapi BM25 k1 value\n");
     fprintf(output, "    --k3=[float]: set Okapi BM25 k3 value\n");
     fprintf(output, "    --b=[float]: set Okapi BM25 b value\n");
+    fprintf(output, "    --bm25f=[boost[:b],...]: use BM25F metric, with "
+      "boost and b for\n"
+      "                             each field in turn (field 0 first, "
+      "others\n"
+      "                             default to a boost of 1 and the b value)\n");
     fprintf(output, "    --pivoted-cosine=[float]: use pivoted cosine "
       "metric, with given pivot\n");
     fprintf(output, "    --cosine: use cosine metric\n");
@@ -73,6 +94,14 @@ void print_usage(const char *progname, FILE *output, int verbose) {
       "with alpha given\n");
     fprintf(output, "    --dirichlet=[uint]: use Dirichlet-smoothed LM "
       "metric, with mu given\n");
+    fprintf(output, "    --prune: skip documents that can't make the results\n"
+      "             (okapi and dirichlet only, results are unchanged)\n");
+    fprintf(output, "    --budget-postings=[uint]: stop impact-ordered "
+      "evaluation after this many\n"
+      "                              postings (anh-impact only)\n");
+    fprintf(output, "    --budget-time=[uint]: stop impact-ordered "
+      "evaluation after this many\n"
+      "                          microseconds (anh-impact only)\n");
 
     fprintf(output, "\n");
     fprintf(output, "usage to index: '%s -i file1 ... fileN'\n", 
@@ -88,6 +117,25 @@ void print_usage(const char *progname, FILE *output, int verbose) {
       "                    (default is light)\n");
     fprintf(output, "    --add: add indexed files to an existing index\n");
     fprintf(output, "    --anh-impact: generate impact-ordered lists\n");
+    fprintf(output, "    --skips: add skip tables to long lists\n");
+    fprintf(output, "    --separate-positions: store word positions apart "
+      "from postings\n");
+    fprintf(output, "    --bounds: store upper bounds on the scores of each "
+      "list in the\n"
+      "                    vocabulary, for pruning ranked queries\n");
+    fprintf(output, "    --segments: write added files out as segments "
+      "rather than\n"
+      "                    merging them into the index\n");
+    fprintf(output, "    --codec=[value]: compression of document ordered "
+      "lists\n"
+      "                    (value is one of vbyte, block)\n"
+      "                    (default is vbyte, block also bit-packs "
+      "impact\n"
+      "                    ordered lists)\n");
+    fprintf(output, "    --docstore: keep a compressed copy of the documents "
+      "in the\n"
+      "                    index, so the files indexed aren't needed to "
+      "retrieve them\n");
 
     return;
 }
@@ -107,6 +155,7 @@ struct args {
     unsigned int memory;
     unsigned int results;
     unsigned int first_result;
+    unsigned int threads;
     char * stop_file;
     char * qstop_file;
 
@@ -235,9 +284,43 @@ enum {
     OPT_STEM, OPT_BUILD_STOP, OPT_QUERY_STOP, OPT_ACCUMULATOR_LIMIT, 
     OPT_IGNORE_VERSION,
     OPT_DIRICHLET, OPT_ANH_IMPACT, 
-    OPT_TABLESIZE, OPT_PARSEBUF, OPT_BIG_AND_FAST, OPT_QUERYLIST
+    OPT_TABLESIZE, OPT_PARSEBUF, OPT_BIG_AND_FAST, OPT_QUERYLIST, OPT_PRUNE,
+    OPT_SKIPS, OPT_SEPARATE_POSITIONS, OPT_CODEC, OPT_THREADS, OPT_MMAP,
+    OPT_LIST_CACHE, OPT_RESULT_CACHE, OPT_SEGMENTS, OPT_SUMMARY_THREADS,
+    OPT_DOCSTORE, OPT_NORMS, OPT_BOUNDS, OPT_BUDGET_POSTINGS, OPT_BUDGET_TIME,
+    OPT_BM25F
 };
 
+/* internal function to parse a comma-separated list of BM25F field 
+ * parameters (field 0 first), each a boost optionally followed by a colon 
+ * and a b value, into boost and b.  Fields that aren't listed are left
+ * alone.  Returns true on success. */
+static int parse_bm25f(const char *arg, float *boost, float *b) {
+    unsigned int field = 0;
+    char *end;
+
+    do {
+        if (field >= INDEX_FIELDS) {
+            return 0;
+        }
+        boost[field] = (float) strtod(arg, &end);
+        if (end == arg) {
+            return 0;
+        }
+        if (*end == ':') {
+            arg = end + 1;
+            b[field] = (float) strtod(arg, &end);
+            if (end == arg) {
+                return 0;
+            }
+        }
+        field++;
+        arg = end + 1;
+    } while (*end == ',');
+
+    return !*end;
+}
+
 static struct args *parse_args(unsigned int argc, char **argv, 
   struct args *args, FILE *output, const char *path) {
     int quiet = 0,               /* an internal error occurred */
@@ -258,10 +341,20 @@ static struct args *parse_args(unsigned int argc, char **argv,
     enum getlongopt_ret ret;     /* return value from option parser */
     FILE *fp;                    /* file pointer to open file list with */
     double dnum;
+    float boost[INDEX_FIELDS],   /* BM25F boost for each field */
+          b[INDEX_FIELDS];       /* BM25F b for each field (-1 if unset) */
+    unsigned int field;          /* current field */
 
     struct getlongopt_opt opts[] = {
         {"index", 'i', GETLONGOPT_ARG_NONE, OPT_INDEX},
         {"add", 'a', GETLONGOPT_ARG_NONE, OPT_ADD},
+        {"skips", '\0', GETLONGOPT_ARG_NONE, OPT_SKIPS},
+        {"separate-positions", '\0', GETLONGOPT_ARG_NONE, 
+          OPT_SEPARATE_POSITIONS},
+        {"bounds", '\0', GETLONGOPT_ARG_NONE, OPT_BOUNDS},
+        {"codec", '\0', GETLONGOPT_ARG_REQUIRED, OPT_CODEC},
+        {"segments", '\0', GETLONGOPT_ARG_NONE, OPT_SEGMENTS},
+        {"docstore", '\0', GETLONGOPT_ARG_NONE, OPT_DOCSTORE},
         {"build-stats", '\0', GETLONGOPT_ARG_NONE, OPT_ADD_STATS},
         {"filename", 'f', GETLONGOPT_ARG_REQUIRED, OPT_FILENAME},
         {"config", 'c', GETLONGOPT_ARG_REQUIRED, OPT_CONFIG},
@@ -274,12 +367,19 @@ static struct args *parse_args(unsigned int argc, char **argv,
         {NULL, 'H', GETLONGOPT_ARG_NONE, OPT_HELP},
         {"stats", 's', GETLONGOPT_ARG_NONE, OPT_STATS},
         {"summary", '\0', GETLONGOPT_ARG_REQUIRED, OPT_SUMMARY},    
+        {"summary-threads", '\0', GETLONGOPT_ARG_REQUIRED, 
+          OPT_SUMMARY_THREADS},
         {"big-and-fast", '\0', GETLONGOPT_ARG_NONE, OPT_BIG_AND_FAST},
         {"memory", 'm', GETLONGOPT_ARG_REQUIRED, OPT_MEMORY},
         {"tablesize", '\0', GETLONGOPT_ARG_REQUIRED, OPT_TABLESIZE},
         {"parse-buffer", '\0', GETLONGOPT_ARG_REQUIRED, OPT_PARSEBUF},
         {"file-list", 'L', GETLONGOPT_ARG_REQUIRED, OPT_FILELIST},    
         {"query-list", '\0', GETLONGOPT_ARG_REQUIRED, OPT_QUERYLIST},    
+        {"threads", '\0', GETLONGOPT_ARG_REQUIRED, OPT_THREADS},
+        {"mmap", '\0', GETLONGOPT_ARG_NONE, OPT_MMAP},
+        {"norms", '\0', GETLONGOPT_ARG_NONE, OPT_NORMS},
+        {"list-cache", '\0', GETLONGOPT_ARG_REQUIRED, OPT_LIST_CACHE},
+        {"result-cache", '\0', GETLONGOPT_ARG_REQUIRED, OPT_RESULT_CACHE},
         {"word-limit", '\0', GETLONGOPT_ARG_REQUIRED, OPT_WORD_LIMIT},    
         {"stem", '\0', GETLONGOPT_ARG_REQUIRED, OPT_STEM},    
         {"build-stop", '\0', GETLONGOPT_ARG_REQUIRED, OPT_BUILD_STOP},
@@ -293,11 +393,16 @@ static struct args *parse_args(unsigned int argc, char **argv,
         {"k1", '1', GETLONGOPT_ARG_REQUIRED, OPT_K1},
         {"k3", '3', GETLONGOPT_ARG_REQUIRED, OPT_K3},
         {"b", 'b', GETLONGOPT_ARG_REQUIRED, OPT_B},
+        {"bm25f", '\0', GETLONGOPT_ARG_REQUIRED, OPT_BM25F},
         {"pivoted-cosine", '\0', GETLONGOPT_ARG_REQUIRED, OPT_PIVOTED_COSINE},
         {"cosine", '\0', GETLONGOPT_ARG_NONE, OPT_COSINE},
         {"hawkapi", '\0', GETLONGOPT_ARG_REQUIRED, OPT_HAWKAPI},
         {"anh-impact", '\0', GETLONGOPT_ARG_NONE, OPT_ANH_IMPACT},
         {"dirichlet", '\0', GETLONGOPT_ARG_REQUIRED, OPT_DIRICHLET},
+        {"prune", '\0', GETLONGOPT_ARG_NONE, OPT_PRUNE},
+        {"budget-postings", '\0', GETLONGOPT_ARG_REQUIRED, 
+          OPT_BUDGET_POSTINGS},
+        {"budget-time", '\0', GETLONGOPT_ARG_REQUIRED, OPT_BUDGET_TIME},
 
         {"accumulation-memory", '\0', GETLONGOPT_ARG_REQUIRED, 
           OPT_ACCUMULATION_MEMORY},
@@ -315,6 +420,7 @@ static struct args *parse_args(unsigned int argc, char **argv,
     args->index_add_stats = 0;
     args->stat = 0;              /* search by default */
     args->first_result = 0;
+    args->threads = 1;
 
     /* null out the others */
     args->results = 0;
@@ -337,8 +443,14 @@ static struct args *parse_args(unsigned int argc, char **argv,
     args->sopt.u.okapi_k3.k1 = 1.2F;
     args->sopt.u.okapi_k3.k3 = 1e10; /* inf */
     args->sopt.u.okapi_k3.b = 0.75;
+    for (field = 0; field < INDEX_FIELDS; field++) {
+        boost[field] = 1.0F;
+        b[field] = -1.0F;
+    }
 
     args->sopt.summary_type = INDEX_SUMMARISE_NONE;
+    args->sopt.budget_postings = 0;
+    args->sopt.budget_usec = 0;
 
     args->nopt.stop_file = NULL;
 
@@ -379,6 +491,65 @@ static struct args *parse_args(unsigned int argc, char **argv,
             }
             break;
 
+        case OPT_THREADS:
+            errno = 0;
+            num = strtol(arg, &tmp, 10);
+            if (!errno && !*tmp && (num > 0)) {
+                args->threads = num;
+                args->copts |= INDEX_COMMIT_THREADS;
+                args->copt.threads = num;
+#ifndef MT_ZET
+                if (num > 1) {
+                    fprintf(output, "%s was built without support for "
+                      "threads\n", PACKAGE);
+                    err = 1;
+                }
+#endif /* MT_ZET */
+            } else {
+                fprintf(output, "error converting threads value '%s'\n", 
+                  arg);
+                verbose = 0;
+                err = 1;
+            }
+            break;
+
+        case OPT_MMAP:
+            args->lopts |= INDEX_LOAD_MMAP;
+            break;
+
+        case OPT_NORMS:
+            /* arrange for lengths to be loaded into memory as norms */
+            args->lopts |= INDEX_LOAD_DOCMAP_CACHE;
+            args->lopt.docmap_cache |= DOCMAP_CACHE_WORDS | DOCMAP_CACHE_NORMS;
+            break;
+
+        case OPT_LIST_CACHE:
+        case OPT_RESULT_CACHE:
+            if (!must_index && !must_stat) {
+                must_search = 1;
+                errno = 0;
+                num = strtol(arg, &tmp, 10);
+                if (!errno && (num >= 0) && (num <= UINT_MAX) && !*tmp) {
+                    if (id == OPT_LIST_CACHE) {
+                        args->lopts |= INDEX_LOAD_LIST_CACHE;
+                        args->lopt.list_cache = num;
+                    } else {
+                        args->lopts |= INDEX_LOAD_RESULT_CACHE;
+                        args->lopt.result_cache = num;
+                    }
+                } else {
+                    fprintf(output, "error converting cache size '%s'\n", 
+                      arg);
+                    err = 1;
+                    verbose = 0;
+                }
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "cache options must be used with search options\n");
+            }
+            break;
+
         case OPT_ADD:
             /* updating is on */
             if (!must_search && !must_stat) {
@@ -391,6 +562,83 @@ static struct args *parse_args(unsigned int argc, char **argv,
             }
             break;
 
+        case OPT_SKIPS:
+            if (!must_search && !must_stat) {
+                must_index = 1;
+                args->copts |= INDEX_COMMIT_SKIPS;
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "skips option cannot be used with search options\n");
+            }
+            break;
+
+        case OPT_SEPARATE_POSITIONS:
+            if (!must_search && !must_stat) {
+                must_index = 1;
+                args->copts |= INDEX_COMMIT_SEPARATE_POSITIONS;
+            } else {
+                err = 1;
+                fprintf(output, "separate-positions option cannot be used "
+                  "with search options\n");
+            }
+            break;
+
+        case OPT_BOUNDS:
+            if (!must_search && !must_stat) {
+                must_index = 1;
+                args->copts |= INDEX_COMMIT_BOUNDS;
+                args->copt.bound_k1 = BOUND_DEFAULT_K1;
+                args->copt.bound_b = BOUND_DEFAULT_B;
+                args->copt.bound_mu = BOUND_DEFAULT_MU;
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "bounds option cannot be used with search options\n");
+            }
+            break;
+
+        case OPT_SEGMENTS:
+            if (!must_search && !must_stat) {
+                must_index = 1;
+                args->copts |= INDEX_COMMIT_SEGMENTS;
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "segments option cannot be used with search options\n");
+            }
+            break;
+
+        case OPT_DOCSTORE:
+            if (!must_search && !must_stat) {
+                must_index = 1;
+                args->nopts |= INDEX_NEW_DOCSTORE;
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "docstore option cannot be used with search options\n");
+            }
+            break;
+
+        case OPT_CODEC:
+            if (!must_search && !must_stat) {
+                must_index = 1;
+                args->nopts |= INDEX_NEW_CODEC;
+                if (!str_casecmp(arg, "vbyte")) {
+                    args->nopt.codec = INDEX_CODEC_VBYTE;
+                } else if (!str_casecmp(arg, "block")) {
+                    args->nopt.codec = INDEX_CODEC_BLOCK;
+                } else {
+                    fprintf(output, "unrecognised list codec '%s'\n", arg);
+                    err = 1;
+                }
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "codec option cannot be used with search options\n");
+            }
+            break;
+
         case OPT_ADD_STATS:
             args->index_add_stats = 1;
             break;
@@ -792,6 +1040,31 @@ static struct args *parse_args(unsigned int argc, char **argv,
             }
             break;
 
+        case OPT_SUMMARY_THREADS:
+            errno = 0;
+            num = strtol(arg, &tmp, 10);
+            if (!must_index && !errno && !*tmp && (num > 0)) {
+                must_search = 1;
+                args->sopt.summary_threads = num;
+                args->sopts |= INDEX_SEARCH_SUMMARY_THREADS;
+#ifndef MT_ZET
+                if (num > 1) {
+                    fprintf(output, "%s was built without support for "
+                      "threads\n", PACKAGE);
+                    err = 1;
+                }
+#endif /* MT_ZET */
+            } else if (!must_index) {
+                fprintf(output, "error converting summary threads value "
+                  "'%s'\n", arg);
+                verbose = 0;
+                err = 1;
+            } else {
+                fprintf(output, "no summary available during indexing\n");
+                err = 1;
+            }
+            break;
+
         case OPT_VERSION: 
             printf("version %s\n", PACKAGE_VERSION);
             err = 1;
@@ -899,11 +1172,70 @@ static struct args *parse_args(unsigned int argc, char **argv,
             }
             break;
 
+        case OPT_BM25F: 
+            if (!must_index && !must_stat) {
+                must_search = 1;
+                if (metric) {
+                    err = 1;
+                    fprintf(output, "metric set multiple times\n");
+                } else if (parse_bm25f(arg, boost, b)) {
+                    metric = 1;
+                    args->sopts |= INDEX_SEARCH_BM25F_RANK;
+                } else {
+                    fprintf(output, 
+                      "error converting BM25F field values '%s'\n", arg);
+                    verbose = 0;
+                    err = 1;
+                }
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "bm25f option must be used with search options\n");
+            }
+            break;
+
         case OPT_ANH_IMPACT:
             args->sopts |= INDEX_SEARCH_ANH_IMPACT_RANK;
             args->copts |= INDEX_COMMIT_ANH_IMPACTS;
             break;
 
+        case OPT_PRUNE:
+            if (!must_index && !must_stat) {
+                must_search = 1;
+                args->sopts |= INDEX_SEARCH_PRUNE;
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "prune option must be used with search options\n");
+            }
+            break;
+
+        case OPT_BUDGET_POSTINGS:
+        case OPT_BUDGET_TIME:
+            if (!must_index && !must_stat) {
+                must_search = 1;
+                errno = 0;
+                num = strtol(arg, &tmp, 10);
+                if (!errno && !*tmp && (num >= 0)) {
+                    args->sopts |= INDEX_SEARCH_ANYTIME;
+                    if (id == OPT_BUDGET_POSTINGS) {
+                        args->sopt.budget_postings = num;
+                    } else {
+                        args->sopt.budget_usec = num;
+                    }
+                } else {
+                    fprintf(output, "error converting budget value '%s'\n", 
+                      arg);
+                    verbose = 0;
+                    err = 1;
+                }
+            } else {
+                err = 1;
+                fprintf(output, 
+                  "budget options must be used with search options\n");
+            }
+            break;
+
         case OPT_DIRICHLET:
             if (!must_index && !must_stat) {
                 must_search = 1;
@@ -1089,6 +1421,22 @@ static struct args *parse_args(unsigned int argc, char **argv,
         return NULL;
     }
 
+    /* BM25F shares k1, k3 and (unless given per field) b with okapi, which
+     * occupies the same space, so move them across now */
+    if (args->sopts & INDEX_SEARCH_BM25F_RANK) {
+        float k1 = args->sopt.u.okapi_k3.k1,
+              k3 = args->sopt.u.okapi_k3.k3,
+              okapi_b = args->sopt.u.okapi_k3.b;
+
+        args->sopt.u.bm25f.k1 = k1;
+        args->sopt.u.bm25f.k3 = k3;
+        for (field = 0; field < INDEX_FIELDS; field++) {
+            args->sopt.u.bm25f.boost[field] = boost[field];
+            args->sopt.u.bm25f.b[field] 
+              = (b[field] < 0.0F) ? okapi_b : b[field];
+        }
+    }
+
     if (!err && !args->prefix) {
         if (!(args->prefix = str_dup("index"))) {
             fprintf(output, "couldn't copy prefix 'index'\n");
@@ -1226,11 +1574,66 @@ static int is_cache_request(const char *querystr, unsigned int maxwordlen,
     return 1;
 }
 
+/* print out the results of a query */
+static void print_results(struct index_result *result, unsigned int results,
+  unsigned int start, double total_results, int est, double seconds, 
+  struct index_search_opt *opt) {
+    unsigned int i;
+
+    for (i = 0; i < results; i++) {
+        fprintf(stdout, "%u. %s (score %f, docid %lu)\n",
+              start + i + 1, result[i].auxilliary, result[i].score,
+              result[i].docno);
+        
+        if (opt->summary_type != INDEX_SUMMARISE_NONE) {
+            /* print out document summary and title */ 
+            if (result[i].title[0] != '\0') {
+                fprintf(stdout, "title: %s\n", 
+                  result[i].title);
+            }
+            if (result[i].summary[0] != '\0') {
+                fprintf(stdout, "%s\n", result[i].summary);
+            }
+        }              
+    }
+  
+    if (seconds == 0.0) {
+        fprintf(stdout, "\n%u results of %s%.0f shown%s\n", 
+          i, est ? "about " : "", total_results, 
+          (est & INDEX_SEARCH_EST_RESULTS) ? " (budget exhausted)" : "");
+    } else {
+        fprintf(stdout, "\n%u results of %s%.0f shown%s "
+          "(took %f seconds)\n",
+          i, est ? "about " : "", total_results, 
+          (est & INDEX_SEARCH_EST_RESULTS) ? " (budget exhausted)" : "",
+          seconds);
+    }
+}
+
+/* print out a document from the cache */
+static int retrieve(struct index *idx, unsigned long int docno) {
+    int readlen;
+    unsigned int total = 0;
+    char buf[BUFSIZ];
+
+    while ((readlen = index_retrieve(idx, docno, total, buf, BUFSIZ)) > 0) {
+        fwrite(buf, 1, readlen, stdout);
+        total += readlen;
+    } 
+
+    if (readlen < 0) {
+        /* error occurred */
+        fprintf(stderr, "failed to retrieve document %lu\n", docno);
+        return 0;
+    }
+
+    return 1;
+}
+
 int search(struct index *idx, const char *query, struct index_result *result, 
   unsigned int requested, unsigned int start, unsigned int maxwordlen,
   int opts, struct index_search_opt *opt) {
-    unsigned int results,                /* number of results */
-                 i;
+    unsigned int results;                /* number of results */
     double total_results;
     struct timeval then,
                    now;
@@ -1251,52 +1654,120 @@ int search(struct index *idx, const char *query, struct index_result *result,
             seconds = (double) ((now.tv_sec - then.tv_sec) 
               + (now.tv_usec - (double) then.tv_usec) / 1000000.0);
 
-            for (i = 0; i < results; i++) {
-                fprintf(stdout, "%u. %s (score %f, docid %lu)\n",
-                      start + i + 1, result[i].auxilliary, result[i].score,
-                      result[i].docno);
-                
-                if (opt->summary_type != INDEX_SUMMARISE_NONE) {
-                    /* print out document summary and title */ 
-                    if (result[i].title[0] != '\0') {
-                        fprintf(stdout, "title: %s\n", 
-                          result[i].title);
-                    }
-                    if (result[i].summary[0] != '\0') {
-                        fprintf(stdout, "%s\n", result[i].summary);
-                    }
-                }              
-            }
-          
-            if (seconds == 0.0) {
-                fprintf(stdout, "\n%u results of %s%.0f shown\n", 
-                  i, est ? "about " : "", total_results);
-            } else {
-                fprintf(stdout, "\n%u results of %s%.0f shown "
-                  "(took %f seconds)\n",
-                  i, est ? "about " : "", total_results, seconds);
-            }
+            print_results(result, results, start, total_results, est, 
+              seconds, opt);
         }
     } else {
-        int readlen;
-        unsigned int total = 0;
-        char buf[BUFSIZ];
-
-        while ((readlen = index_retrieve(idx, docno, total, buf, BUFSIZ)) > 0) {
-            fwrite(buf, 1, readlen, stdout);
-            total += readlen;
-        } 
-
-        if (readlen < 0) {
-            /* error occurred */
-            fprintf(stderr, "failed to retrieve document %lu\n", docno);
+        return retrieve(idx, docno);
+    }
+
+    return 1;
+}
+
+/* print out the results of queries evaluated by pool until no more than 
+ * pending are outstanding */
+static void search_pool_drain(struct searchpool *pool, unsigned int pending,
+  unsigned int start, struct index_search_opt *opt) {
+    struct searchpool_result *res;
+
+    while ((searchpool_pending(pool) > pending) 
+      && (searchpool_next(pool, &res) == SEARCHPOOL_OK)) {
+        if (res->ok) {
+            print_results(res->result, res->results, start, 
+              res->total_results, res->est, res->seconds, opt);
+        }
+        searchpool_result_delete(res);
+    }
+}
+
+/* version of search that submits queries to pool, printing results in the 
+ * order that the queries were submitted */
+static int search_pool(struct searchpool *pool, struct index *idx, 
+  const char *query, unsigned int requested, unsigned int start, 
+  unsigned int maxwordlen, int opts, struct index_search_opt *opt) {
+    unsigned long int docno;
+
+    if (!is_cache_request(query, maxwordlen, &docno)) {
+        if (searchpool_submit(pool, query, start, requested, opts, opt, NULL)
+          != SEARCHPOOL_OK) {
+            fprintf(stderr, "failed to submit query '%s'\n", query);
             return 0;
         }
 
+        /* keep a few queries per thread outstanding, so that threads don't
+         * wait for us to print results */
+        search_pool_drain(pool, 4 * searchpool_threads(pool), start, opt);
         return 1;
+    } else {
+        /* print everything before it */
+        search_pool_drain(pool, 0, start, opt);
+        return retrieve(idx, docno);
     }
+}
 
-    return 1;
+/* print out the outcome of successfully adding a file to the index */
+static void print_added(FILE *output, struct args *args, unsigned int docs,
+  const char *detected_type, double seconds) {
+    fprintf(output, "found %u doc%s, %s%s%s%f seconds\n", docs, 
+      docs == 1 ? "": "s", 
+      !args->type ? "type " : "",
+      !args->type ? (detected_type ? detected_type : "unknown") : "",
+      !args->type ? ", " : "", seconds);
+}
+
+/* print out the outcome of adding files with pool until no more than pending
+ * are outstanding.  Returns 0 if adding one of them failed. */
+static int build_pool_drain(struct buildpool *pool, unsigned int pending,
+  struct args *args, FILE *output) {
+    struct buildpool_result *res;
+    int ok = 1;
+
+    while (ok && (buildpool_pending(pool) > pending) 
+      && (buildpool_next(pool, &res) == BUILDPOOL_OK)) {
+        if ((ok = res->ok)) {
+            fprintf(output, "parsing %s... ", res->file);
+            print_added(output, args, res->docs, res->detected_type, 
+              res->seconds);
+        } else {
+            /* may not be this file that failed, the error says which */
+            fprintf(stderr, "error while adding files: %s\n", 
+              error_last_msg());
+        }
+        buildpool_result_delete(res);
+    }
+    return ok;
+}
+
+/* version of build's parsing loop that parses files on a pool of threads, 
+ * printing their outcomes in the order they were given */
+static int build_pool(struct index *idx, struct args *args, FILE *output) {
+    struct buildpool *pool;
+    unsigned int i;
+    int ok = 1;
+
+    if (!(pool = buildpool_new(idx, args->threads, args->aopts, &args->aopt, 
+        args->copts, &args->copt))) {
+        fprintf(stderr, "failed to start %u build threads\n", args->threads);
+        return 0;
+    }
+
+    for (i = 0; ok && args->list[i]; i++) {
+        if (buildpool_submit(pool, args->list[i], args->type, NULL) 
+          != BUILDPOOL_OK) {
+            fprintf(stderr, "failed to submit file %s\n", args->list[i]);
+            ok = 0;
+        } else {
+            /* keep a few files per thread outstanding, so that threads 
+             * always have something to parse */
+            ok = build_pool_drain(pool, 4 * buildpool_threads(pool), args, 
+              output);
+        }
+    }
+    ok = ok && build_pool_drain(pool, 0, args, output);
+
+    /* wait for everything to be added to the index */
+    buildpool_delete(pool);
+    return ok;
 }
 
 int build(struct args *args, FILE *output) {
@@ -1367,36 +1838,37 @@ int build(struct args *args, FILE *output) {
     fprintf(output, "\n");
 
     /* add repositories from args */
-    for (i = 0; args->list[i]; i++) {
-        fprintf(output, "parsing %s... ", args->list[i]);
-        fflush(output);
+    if (args->threads > 1) {
+        if (!build_pool(idx, args, output)) {
+            index_rm(idx);
+            index_delete(idx);
+            return 0;
+        }
+    } else {
+        for (i = 0; args->list[i]; i++) {
+            fprintf(output, "parsing %s... ", args->list[i]);
+            fflush(output);
 
-        gettimeofday(&then, NULL);
+            gettimeofday(&then, NULL);
 
-        if (index_add(idx, args->list[i], args->type, &docno, &docs, 
-            args->aopts, &args->aopt, args->copts, &args->copt)) {
+            if (index_add(idx, args->list[i], args->type, &docno, &docs, 
+                args->aopts, &args->aopt, args->copts, &args->copt)) {
 
-            gettimeofday(&now, NULL);
+                gettimeofday(&now, NULL);
 
-            seconds = (double) ((now.tv_sec - then.tv_sec) 
-              + (now.tv_usec - (double) then.tv_usec) / 1000000.0);
+                seconds = (double) ((now.tv_sec - then.tv_sec) 
+                  + (now.tv_usec - (double) then.tv_usec) / 1000000.0);
 
-            /* succeded */
-            fprintf(output, "found %u doc%s, %s%s%s%f seconds\n", docs, 
-              docs == 1 ? "": "s", 
-              !args->type ? "type " : "",
-              !args->type 
-                ? (args->aopt.detected_type
-                  ? args->aopt.detected_type
-                  : "unknown")
-                : "",
-              !args->type ? ", " : "", seconds);
-        } else {
-            fprintf(stderr, "error while adding file %s: %s\n", 
-              args->list[i], error_last_msg());
-            index_rm(idx);
-            index_delete(idx);
-            return 0;
+                /* succeded */
+                print_added(output, args, docs, args->aopt.detected_type, 
+                  seconds);
+            } else {
+                fprintf(stderr, "error while adding file %s: %s\n", 
+                  args->list[i], error_last_msg());
+                index_rm(idx);
+                index_delete(idx);
+                return 0;
+            }
         }
     }
 
@@ -1465,7 +1937,16 @@ int build(struct args *args, FILE *output) {
             printf("allocated_files: %f\n", estats.allocated_files); 
             printf("vocab_info: %f\n", estats.vocab_info); 
             printf("vocab_structure: %f\n", estats.vocab_structure); 
+            printf("vectors_postings: %f\n", estats.vectors_postings); 
+            printf("vectors_positions: %f\n", estats.vectors_positions); 
             printf("sorted: %d\n", stats.sorted); 
+            printf("skip_vectors: %u\n", stats.skip_vectors); 
+            printf("separate_positions: %u\n", stats.separate_positions); 
+            printf("list_codec: %s\n", 
+              stats.list_codec == INDEX_CODEC_BLOCK ? "block" : "vbyte"); 
+            printf("docstore: %u\n", stats.docstore); 
+            printf("score_bounds: %u\n", stats.score_bounds); 
+            printf("fields: %u\n", stats.fields); 
         }
 
         return 1;
@@ -1476,13 +1957,24 @@ int build(struct args *args, FILE *output) {
     }
 }
 
+/* print the hit rate of a cache to fp, if it was used */
+static void print_cache_stats(FILE *fp, const char *name, unsigned int size,
+  unsigned long int lookups, unsigned long int hits) {
+    if (size) {
+        fprintf(fp, "%s cache: %lu hits from %lu lookups (%.1f%%)\n", name, 
+          hits, lookups, lookups ? 100.0 * hits / lookups : 0.0);
+    }
+}
+
 int main(int argc, char **argv) {
     struct args argspace,
                *args;
     FILE *output;
     struct index *idx;
     struct index_result *results;
+    struct searchpool *pool = NULL;
     unsigned int i;
+    int ok = 1;
     struct index_stats stats;
     char path[FILENAME_MAX + 1];
     struct timeval now, 
@@ -1515,36 +2007,70 @@ int main(int argc, char **argv) {
                     return EXIT_FAILURE;
                 }
 
+                if ((args->threads > 1) 
+                  && !(pool = searchpool_new(idx, args->threads))) {
+                    fprintf(stderr, "failed to start %u search threads\n", 
+                      args->threads);
+                    index_delete(idx);
+                    free(results);
+                    free_args(args);
+                    return EXIT_FAILURE;
+                }
+
                 /* non-interactive mode */
-                for (i = 0; args->list && args->list[i]; i++) {
-                    if (!(search(idx, args->list[i], results, args->results,
-                      args->first_result, stats.maxtermlen, args->sopts,
-                      &args->sopt))) {
-                        index_delete(idx);
-                        free_args(args);
-                        return EXIT_FAILURE;
+                for (i = 0; ok && args->list && args->list[i]; i++) {
+                    if (pool) {
+                        ok = search_pool(pool, idx, args->list[i], 
+                          args->results, args->first_result, 
+                          stats.maxtermlen, args->sopts, &args->sopt);
+                    } else {
+                        ok = search(idx, args->list[i], results, 
+                          args->results, args->first_result, 
+                          stats.maxtermlen, args->sopts, &args->sopt);
                     }
                 }
 
-                if (args->qlist != stdin || !args->list || !args->list[0]) {
+                if (ok 
+                  && (args->qlist != stdin || !args->list || !args->list[0])) {
                     /* stream-sourced mode */
                     char querybuf[QUERYBUF + 1];
 
-                    while (((args->qlist != stdin) 
+                    while (ok 
+                      && ((args->qlist != stdin) 
                         || (printf("> ") && (fflush(stdout) == 0)))
                       && fgets(querybuf, QUERYBUF, args->qlist)) {
                         querybuf[QUERYBUF] = '\0';
 
-                        if (!(search(idx, querybuf, results, args->results, 
-                          args->first_result, stats.maxtermlen, args->sopts, 
-                          &args->sopt))) {
-                            index_delete(idx);
-                            free_args(args);
-                            return EXIT_FAILURE;
+                        if (pool) {
+                            ok = search_pool(pool, idx, querybuf, 
+                              args->results, args->first_result, 
+                              stats.maxtermlen, args->sopts, &args->sopt);
+
+                            /* answer interactive queries straight away */
+                            if (args->qlist == stdin) {
+                                search_pool_drain(pool, 0, args->first_result,
+                                  &args->sopt);
+                            }
+                        } else {
+                            ok = search(idx, querybuf, results, 
+                              args->results, args->first_result, 
+                              stats.maxtermlen, args->sopts, &args->sopt);
                         }
                     }
                 }
 
+                if (pool) {
+                    search_pool_drain(pool, 0, args->first_result, 
+                      &args->sopt);
+                    searchpool_delete(pool);
+                }
+                if (!ok) {
+                    index_delete(idx);
+                    free(results);
+                    free_args(args);
+                    return EXIT_FAILURE;
+                }
+
                 gettimeofday(&now, NULL);
 
                 printf("%lu microseconds querying "
@@ -1552,6 +2078,17 @@ int main(int argc, char **argv) {
                   (unsigned long int) (now.tv_usec - then.tv_usec 
                     + (now.tv_sec - then.tv_sec) * 1000000));
 
+                if (index_stats(idx, &stats)) {
+                    print_cache_stats(stdout, "list", stats.list_cache,
+                      stats.list_cache_lookups, stats.list_cache_hits);
+                    print_cache_stats(stdout, "result", stats.result_cache,
+                      stats.result_cache_lookups, stats.result_cache_hits);
+                    /* the store cache is always there, rather than asked 
+                     * for, so keep it out of the normal output */
+                    print_cache_stats(stderr, "store", stats.store_cache,
+                      stats.store_cache_lookups, stats.store_cache_hits);
+                }
+
                 index_delete(idx);
                 free(results);
             } else {
@@ -0,0 +1,126 @@
+/* denseacc.c implements the array accumulators declared in denseacc.h.
+ *
+ * Epochs start at 1, and pages that have never been used are tagged with
+ * epoch 0, so they're zeroed when first touched.  When the epoch counter
+ * wraps around, all pages are retagged with 0.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "denseacc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* internal function to return the number of pages needed for docs
+ * documents */
+static unsigned int denseacc_pages(unsigned long int docs) {
+    return (docs + DENSEACC_PAGE - 1) >> DENSEACC_PAGE_BITS;
+}
+
+/* internal function to make sure that acc covers docs documents */
+static int denseacc_grow(struct denseacc *acc, unsigned long int docs) {
+    unsigned int pages = denseacc_pages(docs),
+                 *epoch,
+                 *touched,
+                 *arr,
+                 i;
+
+    if (pages <= acc->pages) {
+        if (docs > acc->docs) {
+            acc->docs = docs;
+        }
+        return 1;
+    }
+
+    /* grow by at least half, so that a growing collection doesn't cause
+     * a reallocation every query */
+    if (pages < acc->pages + acc->pages / 2) {
+        pages = acc->pages + acc->pages / 2;
+    }
+
+    if (!(arr = realloc(acc->acc, sizeof(*arr) * pages * DENSEACC_PAGE))) {
+        return 0;
+    }
+    acc->acc = arr;
+    if (!(epoch = realloc(acc->epoch, sizeof(*epoch) * pages))) {
+        return 0;
+    }
+    acc->epoch = epoch;
+    if (!(touched = realloc(acc->touched, sizeof(*touched) * pages))) {
+        return 0;
+    }
+    acc->touched = touched;
+
+    for (i = acc->pages; i < pages; i++) {
+        acc->epoch[i] = 0;
+    }
+    acc->pages = pages;
+    acc->docs = docs;
+    return 1;
+}
+
+struct denseacc *denseacc_new(unsigned long int docs) {
+    struct denseacc *acc = malloc(sizeof(*acc));
+
+    if (acc) {
+        acc->acc = NULL;
+        acc->epoch = NULL;
+        acc->touched = NULL;
+        acc->touches = 0;
+        acc->pages = 0;
+        acc->docs = 0;
+        acc->size = 0;
+        acc->current = 1;
+        if (!denseacc_grow(acc, docs)) {
+            denseacc_delete(acc);
+            acc = NULL;
+        }
+    }
+    return acc;
+}
+
+void denseacc_delete(struct denseacc *acc) {
+    free(acc->acc);
+    free(acc->epoch);
+    free(acc->touched);
+    free(acc);
+}
+
+int denseacc_reset(struct denseacc *acc, unsigned long int docs) {
+    unsigned int i;
+
+    if (!denseacc_grow(acc, docs)) {
+        return 0;
+    }
+
+    if (!++acc->current) {
+        /* epochs wrapped around, retag every page as unused */
+        for (i = 0; i < acc->pages; i++) {
+            acc->epoch[i] = 0;
+        }
+        acc->current = 1;
+    }
+    acc->touches = 0;
+    acc->size = 0;
+    return 1;
+}
+
+void denseacc_touch(struct denseacc *acc, unsigned int page) {
+    assert(page < acc->pages);
+    assert(acc->epoch[page] != acc->current);
+    memset(&acc->acc[page << DENSEACC_PAGE_BITS], 0,
+      sizeof(*acc->acc) * DENSEACC_PAGE);
+    acc->epoch[page] = acc->current;
+    acc->touched[acc->touches++] = page;
+}
+
+unsigned long int denseacc_memsize(unsigned long int docs) {
+    unsigned long int pages = denseacc_pages(docs);
+
+    return sizeof(struct denseacc)
+      + pages * (sizeof(unsigned int) * (DENSEACC_PAGE + 2));
+}
+
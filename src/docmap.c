@@ -106,6 +106,41 @@
  * are recorded in a sorted in-memory array if they are not of type
  * MIME_TYPE_APPLICATION_X_TREC (yes, this is a bit hacky).
  *
+ * Words and weights can also be cached as 8-bit norms (DOCMAP_CACHE_NORMS),
+ * where scoring only needs them approximately and would rather they fitted in
+ * the processor cache.  Norms are a little floating-point format: values 
+ * below 16 are held exactly, and above that the top 5 bits are kept, 
+ * giving 16 steps per doubling up to about half a million (longer documents
+ * get the largest norm).  Each norm decodes to the middle of the values it
+ * covers, through a table.  Weights are quantised in eighths.  Norms are 
+ * written to cache pages as byte 0x10 (words) and 0x11 (weights), in the 
+ * same format as trecno front-coded entries.
+ *
+ * Decoding cache pages still takes a while for a large collection, and every
+ * process has to do it, so if the docmap is given a column cache file the
+ * cached quantities are written there instead, in a form that can be used 
+ * directly from a memory-mapping of the file (or a single read of it).  
+ * The file is written in native byte order, and consists of: 
+ *   - a header of COLUMNS_HDR_LEN uint32_t's (see enum columns_hdr),
+ *     including a magic number (which also checks the byte order), the
+ *     number of entries and map pages (which must match the docmap), the
+ *     quantities present, the width of the length columns and the lengths of
+ *     the variable-length columns
+ *   - for each quantity present, in the order words, distinct words, weight,
+ *     TREC docnos and location, the in-memory arrays described above, 
+ *     each starting on a multiple of COLUMNS_ALIGN bytes.  Lengths are 
+ *     bit-packed into the smallest width that holds the largest (see 
+ *     struct docmap_packed), up to COLUMNS_MAX_BITS, beyond which they're 
+ *     kept as whole uint32_t's.  Weights are stored as floats, TREC docnos as
+ *     their offset array and front-coded buffer, and locations as their 
+ *     offset array, encoded buffer and type exception array.  If norms are 
+ *     present, words and weights are stored as their arrays of norms 
+ *     instead, and are only used if norms are wanted.
+ * Quantities in the column cache file are left out of the cache pages.  
+ * If the file is missing or doesn't match, they're recovered by reading the
+ * entire docmap, as for any other quantity that wasn't cached.  Changes to
+ * the docmap copy them out of the file first.
+ *
  * There are still some flaws in the current implementation (XXX).  Firstly, 
  * the empty docmap has no valid representation.  
  * Also, the number of entries on a page can change during reading, which won't
@@ -134,10 +169,23 @@
 #include "zvalgrind.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "reposset.h"
 
+#ifdef MT_ZET
+#include <pthread.h>
+
+/* the read cursor is shared, so reads that can't be answered from the cache
+ * (and changes to the cache) are serialised */
+#define LOCK(dm) pthread_mutex_lock(&(dm)->mutex)
+#define UNLOCK(dm) pthread_mutex_unlock(&(dm)->mutex)
+#else
+#define LOCK(dm)
+#define UNLOCK(dm)
+#endif /* MT_ZET */
+
 /* frequency of front-coding of trecno's.  For example, a value of 4 sets a
  * policy of 3-in-4 front coding, where only every fourth entry is not
  * front-encoded */
@@ -157,6 +205,35 @@
 
 #define DOCMAP_WEIGHT_PRECISION 7
 
+/* magic number starting the column cache file, as read on a machine with the
+ * same byte order as the one that wrote it, and the version of its format */
+#define COLUMNS_MAGIC 0x7a646d63
+#define COLUMNS_VERSION 1
+
+/* columns in the column cache file start on multiples of this many bytes */
+#define COLUMNS_ALIGN 8
+
+/* widest packed length column (wider columns are stored as uint32_t's) */
+#define COLUMNS_MAX_BITS 24
+
+/* number of values packed at a time when writing the column cache file */
+#define COLUMNS_CHUNK 8192
+
+/* fields of the column cache file header */
+enum columns_hdr {
+    COLUMNS_HDR_MAGIC = 0,
+    COLUMNS_HDR_VERSION = 1,
+    COLUMNS_HDR_ENTRIES = 2,          /* number of entries in docmap */
+    COLUMNS_HDR_MAP_LEN = 3,          /* number of data pages in docmap */
+    COLUMNS_HDR_CACHE = 4,            /* quantities present */
+    COLUMNS_HDR_WORDS_BITS = 5,       /* width of words column */
+    COLUMNS_HDR_DWORDS_BITS = 6,      /* width of distinct words column */
+    COLUMNS_HDR_TRECNO_LEN = 7,       /* length of front-coded trecnos */
+    COLUMNS_HDR_LOC_LEN = 8,          /* length of encoded locations */
+    COLUMNS_HDR_TYPEEX_LEN = 9,       /* number of type exceptions */
+    COLUMNS_HDR_LEN = 10
+};
+
 enum cache_id {
     CACHE_ID_END = 0,
     CACHE_ID_AGG = 0x01,
@@ -170,7 +247,12 @@ enum cache_id {
     CACHE_ID_REPOS_CHECK = 0x0b,
     CACHE_ID_LOC = 0x0c,
     CACHE_ID_LOC_CODE = 0x0d,
-    CACHE_ID_TYPEEX = 0x0e
+    CACHE_ID_TYPEEX = 0x0e,
+    CACHE_ID_REPOS_RESUME = 0x0f,
+    CACHE_ID_WORDS_NORM = 0x10,
+    CACHE_ID_WEIGHT_NORM = 0x11,
+    CACHE_ID_FIELD_WORDS = 0x12,
+    CACHE_ID_FIELD_AGG = 0x13
 };
 
 /* internal function to make a cursor point to nothing */
@@ -199,12 +281,58 @@ static void invalidate_buffer(struct docmap *dm, struct docmap_buffer *buf) {
     buf->dirty = 0;
 }
 
+/* internal function to quantise val into a norm */
+static unsigned char norm_encode(unsigned int val) {
+    unsigned int shift = 0,
+                 norm;
+
+    if (val < DOCMAP_NORM_EXACT) {
+        return val;
+    }
+    while ((val >> shift) >= 2 * DOCMAP_NORM_EXACT) {
+        shift++;
+    }
+    norm = DOCMAP_NORM_EXACT * (shift + 1) 
+      + (val >> shift) - DOCMAP_NORM_EXACT;
+    return (norm > UCHAR_MAX) ? UCHAR_MAX : norm;
+}
+
+/* internal function to return the value in the middle of those quantised into
+ * norm */
+static unsigned int norm_decode(unsigned char norm) {
+    unsigned int shift;
+
+    if (norm < DOCMAP_NORM_EXACT) {
+        return norm;
+    }
+    shift = norm / DOCMAP_NORM_EXACT - 1;
+    return ((DOCMAP_NORM_EXACT + norm % DOCMAP_NORM_EXACT) << shift)
+      + ((1U << shift) - 1) / 2;
+}
+
+/* internal function to quantise a weight into a norm */
+static unsigned char norm_encode_weight(float weight) {
+    float scaled = weight * DOCMAP_NORM_WEIGHT_SCALE + 0.5F;
+
+    if (scaled <= 0) {
+        return 0;
+    } else if (scaled >= (float) UINT_MAX) {
+        return UCHAR_MAX;
+    } else {
+        return norm_encode((unsigned int) scaled);
+    }
+}
+
 /* internal function to initialise a docmap structure, used for both docmap_new
  * and docmap_load */
 static struct docmap *docmap_init(struct fdset *fdset, 
-  int fd_type, unsigned int pagesize, unsigned int pages, 
-  unsigned long int max_filesize, enum docmap_cache cache) {
+  int fd_type, int col_type, unsigned int pagesize, unsigned int pages, 
+  unsigned long int max_filesize, unsigned int fields, 
+  enum docmap_cache cache) {
     struct docmap *dm = malloc(sizeof(*dm));
+    unsigned int i;
+
+    assert(fields && fields <= INDEX_FIELDS);
 
     if (pages < 2) {
         pages = 2;
@@ -220,8 +348,10 @@ static struct docmap *docmap_init(struct fdset *fdset,
         dm->file_pages = max_filesize / pagesize;
         dm->fdset = fdset;
         dm->fd_type = fd_type;
+        dm->col_type = col_type;
         dm->pagesize = pagesize;
         dm->entries = 0;
+        dm->fields = fields;
 
         /* assign all pages to reading, append buffering will steal them later
          * if necessary */
@@ -230,6 +360,7 @@ static struct docmap *docmap_init(struct fdset *fdset,
         invalidate_buffer(dm, &dm->readbuf);
         invalidate_buffer(dm, &dm->appendbuf);
         dm->read.entry.trecno = dm->write.entry.trecno = NULL;
+        dm->read.fields = dm->write.fields = fields;
         dm->read.entry.trecno_len = dm->read.entry.trecno_size = 0;
         dm->write.entry.trecno_len = dm->write.entry.trecno_size = 0;
         dm->readbuf.buf = dm->buf;
@@ -247,6 +378,7 @@ static struct docmap *docmap_init(struct fdset *fdset,
         dm->cache.words = NULL;
         dm->cache.dwords = NULL;
         dm->cache.weight = NULL;
+        dm->cache.fwords = NULL;
         dm->cache.loc_off = NULL;
         dm->cache.loc.buf = NULL;
         dm->cache.loc.len = dm->cache.loc.size = 0;
@@ -255,12 +387,31 @@ static struct docmap *docmap_init(struct fdset *fdset,
         dm->cache.trecno.len = dm->cache.trecno.size = 0;
         dm->cache.typeex = NULL;
         dm->cache.typeex_len = dm->cache.typeex_size = 0;
+        dm->cache.pwords.buf = dm->cache.pdwords.buf = NULL;
+        dm->cache.pwords.bits = dm->cache.pdwords.bits = 0;
+        dm->cache.pwords.mask = dm->cache.pdwords.mask = 0;
+        dm->cache.columns = NULL;
+        dm->cache.columns_mapped = 0;
+        dm->cache.columns_cache = DOCMAP_CACHE_NOTHING;
+        dm->cache.nwords = dm->cache.nweight = NULL;
+        for (i = 0; i <= UCHAR_MAX; i++) {
+            dm->cache.words_norm[i] = norm_decode(i);
+            dm->cache.weight_norm[i] 
+              = norm_decode(i) / DOCMAP_NORM_WEIGHT_SCALE;
+        }
 
         dm->agg.avg_bytes = dm->agg.sum_bytes 
           = dm->agg.avg_weight = dm->agg.sum_weight 
           = dm->agg.avg_words = dm->agg.sum_words 
           = dm->agg.avg_dwords = dm->agg.sum_dwords
           = dm->agg.sum_trecno = 0;
+        for (i = 0; i < INDEX_FIELDS; i++) {
+            dm->agg.sum_fwords[i] = 0;
+        }
+
+#ifdef MT_ZET
+        pthread_mutex_init(&dm->mutex, NULL);
+#endif /* MT_ZET */
     } else {
         if (dm) {
             if (dm->buf) {
@@ -275,16 +426,18 @@ static struct docmap *docmap_init(struct fdset *fdset,
     return dm;
 }
 
-/* internal function to encode an entry relative to a previous entry into 
- * some space. */
+/* internal function to encode an entry (with fields fields) relative to a 
+ * previous entry into some space.  The number of words in each field but 
+ * the first follow the weight (field 0 has the rest of them). */
 static enum docmap_ret encode(struct vec *v, struct docmap_entry *prev, 
-  struct docmap_entry *curr) {
+  struct docmap_entry *curr, unsigned int fields) {
     uintmax_t tmp[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
     unsigned int arrlen = sizeof(tmp) / sizeof(*tmp),
                  prefix,
                  len,
                  bytes,
-                 i = 0;
+                 i = 0,
+                 f;
     char *pos = v->pos;
 
     /* figure out the length of the front-coding prefix between trecnos */
@@ -327,6 +480,13 @@ static enum docmap_ret encode(struct vec *v, struct docmap_entry *prev,
         (unsigned int) tmp[arrlen - 1]) == tmp[arrlen - 1]
       && vec_flt_write(v, curr->weight, DOCMAP_WEIGHT_PRECISION)) {
 
+        for (f = 1; f < fields; f++) {
+            if (!vec_vbyte_write(v, curr->fwords[f])) {
+                v->pos = pos;
+                return DOCMAP_BUFSIZE_ERROR;
+            }
+        }
+
         /* Relations that we use to compress entries.  These assertions go 
          * after encoding so that we don't assert things if encoding fails) */
         assert(curr->words >= curr->dwords);
@@ -348,6 +508,7 @@ static enum docmap_ret decode(struct docmap_cursor *cur) {
                  bytes,
                  readlen,
                  arrlen = sizeof(tmp) / sizeof(*tmp);
+    unsigned long int fwords;
     char *pos = v->pos;
 
     if (cur->past < cur->entries 
@@ -399,6 +560,18 @@ static enum docmap_ret decode(struct docmap_cursor *cur) {
                 target->trecno_len = (unsigned int) tmp[i] 
                   + (unsigned int) tmp[i + 1];
                 target->trecno[target->trecno_len] = '\0';
+
+                /* field 0 gets the words the other fields don't */
+                target->fwords[0] = target->words;
+                for (i = 1; i < cur->fields; i++) {
+                    if (!vec_vbyte_read(v, &fwords) 
+                      || fwords > target->fwords[0]) {
+                        assert("can't get here" && 0);
+                        return DOCMAP_FMT_ERROR;
+                    }
+                    target->fwords[i] = (unsigned int) fwords;
+                    target->fwords[0] -= target->fwords[i];
+                }
                 cur->past++;
                 return DOCMAP_OK;
             } else {
@@ -563,13 +736,25 @@ static enum docmap_ret cache(struct docmap *dm, struct docmap_entry *entry) {
 
     assert(dm->cache.len == entry->docno);
     if (dm->cache.cache & DOCMAP_CACHE_WORDS) {
-        dm->cache.words[entry->docno] = entry->words;
+        if (dm->cache.cache & DOCMAP_CACHE_NORMS) {
+            dm->cache.nwords[entry->docno] = norm_encode(entry->words);
+        } else {
+            dm->cache.words[entry->docno] = entry->words;
+        }
     }
     if (dm->cache.cache & DOCMAP_CACHE_DISTINCT_WORDS) {
         dm->cache.dwords[entry->docno] = entry->dwords;
     }
+    if (dm->cache.cache & DOCMAP_CACHE_FIELD_WORDS) {
+        memcpy(DOCMAP_GET_FIELD_WORDS(dm, entry->docno), entry->fwords,
+          sizeof(*entry->fwords) * dm->fields);
+    }
     if (dm->cache.cache & DOCMAP_CACHE_WEIGHT) {
-        dm->cache.weight[entry->docno] = entry->weight;
+        if (dm->cache.cache & DOCMAP_CACHE_NORMS) {
+            dm->cache.nweight[entry->docno] = norm_encode_weight(entry->weight);
+        } else {
+            dm->cache.weight[entry->docno] = entry->weight;
+        }
     }
 
     if (dm->cache.cache & DOCMAP_CACHE_LOCATION) {
@@ -713,7 +898,17 @@ static enum docmap_ret cache(struct docmap *dm, struct docmap_entry *entry) {
 static enum docmap_ret cache_realloc(struct docmap *dm) {
     void *ptr;
 
-    if (dm->cache.cache & DOCMAP_CACHE_WORDS) {
+    if ((dm->cache.cache & DOCMAP_CACHE_WORDS) 
+      && (dm->cache.cache & DOCMAP_CACHE_NORMS)) {
+        if ((ptr = realloc(dm->cache.nwords, 
+            sizeof(*dm->cache.nwords) * dm->cache.size))) {
+
+            dm->cache.nwords = ptr;
+        } else {
+            assert(!CRASH);
+            return DOCMAP_MEM_ERROR;
+        }
+    } else if (dm->cache.cache & DOCMAP_CACHE_WORDS) {
         if ((ptr = realloc(dm->cache.words, 
             sizeof(*dm->cache.words) * dm->cache.size))) {
 
@@ -733,7 +928,27 @@ static enum docmap_ret cache_realloc(struct docmap *dm) {
             return DOCMAP_MEM_ERROR;
         }
     }
-    if (dm->cache.cache & DOCMAP_CACHE_WEIGHT) {
+    if (dm->cache.cache & DOCMAP_CACHE_FIELD_WORDS) {
+        if ((ptr = realloc(dm->cache.fwords, 
+            sizeof(*dm->cache.fwords) * dm->cache.size * dm->fields))) {
+
+            dm->cache.fwords = ptr;
+        } else {
+            assert(!CRASH);
+            return DOCMAP_MEM_ERROR;
+        }
+    }
+    if ((dm->cache.cache & DOCMAP_CACHE_WEIGHT) 
+      && (dm->cache.cache & DOCMAP_CACHE_NORMS)) {
+        if ((ptr = realloc(dm->cache.nweight, 
+            sizeof(*dm->cache.nweight) * dm->cache.size))) {
+
+            dm->cache.nweight = ptr;
+        } else {
+            assert(!CRASH);
+            return DOCMAP_MEM_ERROR;
+        }
+    } else if (dm->cache.cache & DOCMAP_CACHE_WEIGHT) {
         if ((ptr = realloc(dm->cache.weight, 
             sizeof(*dm->cache.weight) * dm->cache.size))) {
 
@@ -767,6 +982,522 @@ static enum docmap_ret cache_realloc(struct docmap *dm) {
     return DOCMAP_OK;
 }
 
+/* internal function to round len up to a multiple of COLUMNS_ALIGN */
+static unsigned long int columns_align(unsigned long int len) {
+    return (len + COLUMNS_ALIGN - 1) / COLUMNS_ALIGN * COLUMNS_ALIGN;
+}
+
+/* internal function to return the number of bytes occupied in the column 
+ * cache file by a length column of len values of width bits.  Packed 
+ * columns are followed by three spare bytes, so that the last value can be
+ * read from four bytes like the rest. */
+static unsigned long int columns_packed_len(unsigned long int len, 
+  unsigned int bits) {
+    if (bits == 32) {
+        return columns_align(sizeof(uint32_t) * len);
+    } else {
+        return columns_align((len * bits + 7) / 8 + 3);
+    }
+}
+
+/* internal function to return the width needed to pack the len values in 
+ * arr */
+static unsigned int columns_bits(const unsigned int *arr, 
+  unsigned long int len) {
+    unsigned long int i;
+    unsigned int max = 0,
+                 bits = 1;
+
+    for (i = 0; i < len; i++) {
+        if (arr[i] > max) {
+            max = arr[i];
+        }
+    }
+    while (bits < COLUMNS_MAX_BITS && (max >> bits)) {
+        bits++;
+    }
+    return (max >> bits) ? 32 : bits;
+}
+
+/* internal function to return the length of the column cache file with 
+ * header hdr */
+static unsigned long int columns_len(const uint32_t *hdr) {
+    unsigned long int entries = hdr[COLUMNS_HDR_ENTRIES],
+                      len = columns_align(sizeof(*hdr) * COLUMNS_HDR_LEN);
+
+    if ((hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WORDS)
+      && (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_NORMS)) {
+        len += columns_align(entries);
+    } else if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WORDS) {
+        len += columns_packed_len(entries, hdr[COLUMNS_HDR_WORDS_BITS]);
+    }
+    if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_DISTINCT_WORDS) {
+        len += columns_packed_len(entries, hdr[COLUMNS_HDR_DWORDS_BITS]);
+    }
+    if ((hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WEIGHT)
+      && (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_NORMS)) {
+        len += columns_align(entries);
+    } else if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WEIGHT) {
+        len += columns_align(sizeof(float) * entries);
+    }
+    if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_TRECNO) {
+        len += columns_align(sizeof(unsigned int) 
+            * ((entries + TRECNO_FRONT_FREQ - 1) / TRECNO_FRONT_FREQ))
+          + columns_align(hdr[COLUMNS_HDR_TRECNO_LEN]);
+    }
+    if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_LOCATION) {
+        len += columns_align(sizeof(unsigned int) 
+            * ((entries + LOC_REL_FREQ - 1) / LOC_REL_FREQ))
+          + columns_align(hdr[COLUMNS_HDR_LOC_LEN])
+          + columns_align(sizeof(struct docmap_type_ex) 
+            * hdr[COLUMNS_HDR_TYPEEX_LEN]);
+    }
+    return len;
+}
+
+/* internal function to write len bytes from buf to fd, followed by enough 
+ * zeroes to align the next column.  Returns true on success. */
+static int columns_write(int fd, const void *buf, unsigned long int len) {
+    char zero[COLUMNS_ALIGN] = {0};
+    unsigned long int pad = columns_align(len) - len;
+
+    return (!len || write(fd, buf, len) == (ssize_t) len)
+      && (!pad || write(fd, zero, pad) == (ssize_t) pad);
+}
+
+/* internal function to write the len values in arr to fd as a length column
+ * of width bits.  Returns true on success. */
+static int columns_write_packed(int fd, const unsigned int *arr, 
+  unsigned long int len, unsigned int bits) {
+    unsigned char buf[COLUMNS_CHUNK / 8 * COLUMNS_MAX_BITS + COLUMNS_ALIGN 
+      + 3];
+    unsigned long int i,
+                      j,
+                      bit,
+                      bytes,
+                      written = 0;
+
+    if (bits == 32) {
+        return columns_write(fd, arr, sizeof(*arr) * len);
+    }
+
+    /* chunks hold a multiple of 8 values, so they each end on a byte */
+    for (i = 0; i < len; i += COLUMNS_CHUNK) {
+        unsigned long int chunk = (len - i < COLUMNS_CHUNK) 
+          ? len - i : COLUMNS_CHUNK;
+
+        memset(buf, 0, sizeof(buf));
+        for (j = 0, bit = 0; j < chunk; j++, bit += bits) {
+            uint32_t val = arr[i + j] << (bit & 7);
+            unsigned char *pos = buf + (bit >> 3);
+
+            pos[0] |= val & 0xff;
+            pos[1] |= (val >> 8) & 0xff;
+            pos[2] |= (val >> 16) & 0xff;
+            pos[3] |= val >> 24;
+        }
+        bytes = (chunk * bits + 7) / 8;
+        if (write(fd, buf, bytes) != (ssize_t) bytes) {
+            return 0;
+        }
+        written += bytes;
+    }
+
+    /* pad out to the length of the column */
+    bytes = columns_packed_len(len, bits) - written;
+    memset(buf, 0, bytes);
+    return write(fd, buf, bytes) == (ssize_t) bytes;
+}
+
+/* internal function to write the cached quantities to the column cache 
+ * file, returning the quantities it holds */
+static enum docmap_cache columns_save(struct docmap *dm) {
+    enum docmap_cache cache = dm->cache.cache 
+      & (DOCMAP_CACHE_WORDS | DOCMAP_CACHE_DISTINCT_WORDS | DOCMAP_CACHE_WEIGHT
+        | DOCMAP_CACHE_TRECNO | DOCMAP_CACHE_LOCATION | DOCMAP_CACHE_NORMS);
+    enum docmap_cache normed = (cache & DOCMAP_CACHE_NORMS) 
+      ? cache & (DOCMAP_CACHE_WORDS | DOCMAP_CACHE_WEIGHT) 
+      : DOCMAP_CACHE_NOTHING;
+    uint32_t hdr[COLUMNS_HDR_LEN];
+    unsigned long int entries = dm->cache.len;
+    int fd,
+        ok;
+
+    if (dm->col_type < 0) {
+        return DOCMAP_CACHE_NOTHING;
+    } else if (dm->cache.columns) {
+        /* the file hasn't changed since we read it */
+        return dm->cache.columns_cache;
+    }
+
+    /* replace the file, if there is one (it's no longer current) */
+    fdset_unlink(dm->fdset, dm->col_type, 0);
+    if (!(cache & ~DOCMAP_CACHE_NORMS) || entries != dm->entries 
+      || (fd = fdset_create(dm->fdset, dm->col_type, 0)) < 0) {
+        return DOCMAP_CACHE_NOTHING;
+    }
+
+    hdr[COLUMNS_HDR_MAGIC] = COLUMNS_MAGIC;
+    hdr[COLUMNS_HDR_VERSION] = COLUMNS_VERSION;
+    hdr[COLUMNS_HDR_ENTRIES] = entries;
+    hdr[COLUMNS_HDR_MAP_LEN] = dm->map_len;
+    hdr[COLUMNS_HDR_CACHE] = cache;
+    hdr[COLUMNS_HDR_WORDS_BITS] = (normed & DOCMAP_CACHE_WORDS) ? CHAR_BIT
+      : (cache & DOCMAP_CACHE_WORDS) 
+        ? columns_bits(dm->cache.words, entries) : 0;
+    hdr[COLUMNS_HDR_DWORDS_BITS] = (cache & DOCMAP_CACHE_DISTINCT_WORDS) 
+      ? columns_bits(dm->cache.dwords, entries) : 0;
+    hdr[COLUMNS_HDR_TRECNO_LEN] = dm->cache.trecno.len;
+    hdr[COLUMNS_HDR_LOC_LEN] = dm->cache.loc.len;
+    hdr[COLUMNS_HDR_TYPEEX_LEN] = dm->cache.typeex_len;
+
+    ok = columns_write(fd, hdr, sizeof(hdr))
+      && (!(normed & DOCMAP_CACHE_WORDS)
+        || columns_write(fd, dm->cache.nwords, entries))
+      && (!(cache & DOCMAP_CACHE_WORDS) || (normed & DOCMAP_CACHE_WORDS)
+        || columns_write_packed(fd, dm->cache.words, entries, 
+          hdr[COLUMNS_HDR_WORDS_BITS]))
+      && (!(cache & DOCMAP_CACHE_DISTINCT_WORDS)
+        || columns_write_packed(fd, dm->cache.dwords, entries, 
+          hdr[COLUMNS_HDR_DWORDS_BITS]))
+      && (!(normed & DOCMAP_CACHE_WEIGHT)
+        || columns_write(fd, dm->cache.nweight, entries))
+      && (!(cache & DOCMAP_CACHE_WEIGHT) || (normed & DOCMAP_CACHE_WEIGHT)
+        || columns_write(fd, dm->cache.weight, sizeof(float) * entries))
+      && (!(cache & DOCMAP_CACHE_TRECNO)
+        || (columns_write(fd, dm->cache.trecno_off, sizeof(unsigned int) 
+            * ((entries + TRECNO_FRONT_FREQ - 1) / TRECNO_FRONT_FREQ))
+          && columns_write(fd, dm->cache.trecno.buf, dm->cache.trecno.len)))
+      && (!(cache & DOCMAP_CACHE_LOCATION)
+        || (columns_write(fd, dm->cache.loc_off, sizeof(unsigned int) 
+            * ((entries + LOC_REL_FREQ - 1) / LOC_REL_FREQ))
+          && columns_write(fd, dm->cache.loc.buf, dm->cache.loc.len)
+          && columns_write(fd, dm->cache.typeex, 
+            sizeof(*dm->cache.typeex) * dm->cache.typeex_len)));
+
+    fdset_unpin(dm->fdset, dm->col_type, 0, fd);
+    if (!ok) {
+        /* the quantities will just have to go in the cache pages */
+        fdset_unlink(dm->fdset, dm->col_type, 0);
+        return DOCMAP_CACHE_NOTHING;
+    }
+    return cache;
+}
+
+/* internal function to return which of the quantities in want can be taken
+ * from a column cache file holding the quantities in held.  Words and 
+ * weights are only any use in the form (norms or not) wanted. */
+static enum docmap_cache columns_take(enum docmap_cache held, 
+  enum docmap_cache want) {
+    enum docmap_cache cache = held & want & ~DOCMAP_CACHE_NORMS;
+
+    if ((held ^ want) & DOCMAP_CACHE_NORMS) {
+        cache &= ~(DOCMAP_CACHE_WORDS | DOCMAP_CACHE_WEIGHT);
+    } else if ((held & DOCMAP_CACHE_NORMS) 
+      && (cache & (DOCMAP_CACHE_WORDS | DOCMAP_CACHE_WEIGHT))) {
+        cache |= DOCMAP_CACHE_NORMS;
+    }
+    return cache;
+}
+
+/* internal function to take the quantities in want from the column cache 
+ * file, if it matches the docmap.  Failure isn't an error, the quantities 
+ * just have to be read from the docmap instead. */
+static void columns_load(struct docmap *dm, enum docmap_cache want) {
+    const char *addr;
+    char *buf = NULL,
+         *pos;
+    unsigned long int len = 0,
+                      entries = dm->entries;
+    uint32_t hdr[COLUMNS_HDR_LEN];
+    enum docmap_cache cache;
+    off_t end;
+    int fd,
+        mapped = 0;
+
+    if (dm->col_type < 0) {
+        return;
+    } else if (fdset_map(dm->fdset, dm->col_type, 0, &addr, &len) 
+      == FDSET_OK) {
+        buf = (char *) addr;
+        mapped = 1;
+    } else if ((fd = fdset_pin(dm->fdset, dm->col_type, 0, 0, SEEK_END)) 
+      >= 0) {
+        if ((end = lseek(fd, 0, SEEK_CUR)) > 0 
+          && lseek(fd, 0, SEEK_SET) == 0
+          && (buf = malloc(end))) {
+            len = end;
+            if (read(fd, buf, len) != (ssize_t) len) {
+                free(buf);
+                buf = NULL;
+            }
+        }
+        fdset_unpin(dm->fdset, dm->col_type, 0, fd);
+    }
+    if (!buf) {
+        return;
+    }
+
+    if (len >= sizeof(hdr)) {
+        memcpy(hdr, buf, sizeof(hdr));
+    }
+    if (len < sizeof(hdr)
+      || hdr[COLUMNS_HDR_MAGIC] != COLUMNS_MAGIC
+      || hdr[COLUMNS_HDR_VERSION] != COLUMNS_VERSION
+      || hdr[COLUMNS_HDR_ENTRIES] != entries
+      || hdr[COLUMNS_HDR_MAP_LEN] != dm->map_len
+      || ((hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WORDS)
+        && (!hdr[COLUMNS_HDR_WORDS_BITS] 
+          || (hdr[COLUMNS_HDR_WORDS_BITS] > COLUMNS_MAX_BITS 
+            && hdr[COLUMNS_HDR_WORDS_BITS] != 32)))
+      || ((hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_DISTINCT_WORDS)
+        && (!hdr[COLUMNS_HDR_DWORDS_BITS] 
+          || (hdr[COLUMNS_HDR_DWORDS_BITS] > COLUMNS_MAX_BITS 
+            && hdr[COLUMNS_HDR_DWORDS_BITS] != 32)))
+      || columns_len(hdr) != len
+      || !(cache = columns_take(hdr[COLUMNS_HDR_CACHE], 
+          want | (dm->cache.cache & DOCMAP_CACHE_NORMS)))) {
+        if (mapped) {
+            fdset_close_file(dm->fdset, dm->col_type, 0);
+        } else {
+            free(buf);
+        }
+        return;
+    }
+
+    /* point the cache into the file (skipping unwanted columns) */
+    pos = buf + columns_align(sizeof(hdr));
+    if ((hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WORDS)
+      && (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_NORMS)) {
+        if (cache & DOCMAP_CACHE_WORDS) {
+            dm->cache.nwords = (unsigned char *) pos;
+        }
+        pos += columns_align(entries);
+    } else if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WORDS) {
+        if (cache & DOCMAP_CACHE_WORDS) {
+            dm->cache.pwords.buf = (unsigned char *) pos;
+            dm->cache.pwords.bits = hdr[COLUMNS_HDR_WORDS_BITS];
+            dm->cache.pwords.mask = (dm->cache.pwords.bits == 32) 
+              ? 0xffffffff : (1U << dm->cache.pwords.bits) - 1;
+        }
+        pos += columns_packed_len(entries, hdr[COLUMNS_HDR_WORDS_BITS]);
+    }
+    if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_DISTINCT_WORDS) {
+        if (cache & DOCMAP_CACHE_DISTINCT_WORDS) {
+            dm->cache.pdwords.buf = (unsigned char *) pos;
+            dm->cache.pdwords.bits = hdr[COLUMNS_HDR_DWORDS_BITS];
+            dm->cache.pdwords.mask = (dm->cache.pdwords.bits == 32) 
+              ? 0xffffffff : (1U << dm->cache.pdwords.bits) - 1;
+        }
+        pos += columns_packed_len(entries, hdr[COLUMNS_HDR_DWORDS_BITS]);
+    }
+    if ((hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WEIGHT)
+      && (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_NORMS)) {
+        if (cache & DOCMAP_CACHE_WEIGHT) {
+            dm->cache.nweight = (unsigned char *) pos;
+        }
+        pos += columns_align(entries);
+    } else if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_WEIGHT) {
+        if (cache & DOCMAP_CACHE_WEIGHT) {
+            dm->cache.weight = (float *) pos;
+        }
+        pos += columns_align(sizeof(float) * entries);
+    }
+    if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_TRECNO) {
+        if (cache & DOCMAP_CACHE_TRECNO) {
+            dm->cache.trecno_off = (unsigned int *) pos;
+        }
+        pos += columns_align(sizeof(unsigned int) 
+          * ((entries + TRECNO_FRONT_FREQ - 1) / TRECNO_FRONT_FREQ));
+        if (cache & DOCMAP_CACHE_TRECNO) {
+            dm->cache.trecno.buf = pos;
+            dm->cache.trecno.len = dm->cache.trecno.size 
+              = hdr[COLUMNS_HDR_TRECNO_LEN];
+        }
+        pos += columns_align(hdr[COLUMNS_HDR_TRECNO_LEN]);
+    }
+    if (hdr[COLUMNS_HDR_CACHE] & DOCMAP_CACHE_LOCATION) {
+        if (cache & DOCMAP_CACHE_LOCATION) {
+            dm->cache.loc_off = (unsigned int *) pos;
+        }
+        pos += columns_align(sizeof(unsigned int) 
+          * ((entries + LOC_REL_FREQ - 1) / LOC_REL_FREQ));
+        if (cache & DOCMAP_CACHE_LOCATION) {
+            dm->cache.loc.buf = pos;
+            dm->cache.loc.len = dm->cache.loc.size = hdr[COLUMNS_HDR_LOC_LEN];
+        }
+        pos += columns_align(hdr[COLUMNS_HDR_LOC_LEN]);
+        if (cache & DOCMAP_CACHE_LOCATION) {
+            dm->cache.typeex = (struct docmap_type_ex *) pos;
+            dm->cache.typeex_len = dm->cache.typeex_size 
+              = hdr[COLUMNS_HDR_TYPEEX_LEN];
+        }
+    }
+
+    dm->cache.cache |= cache;
+    dm->cache.columns = buf;
+    dm->cache.columns_mapped = mapped;
+    dm->cache.columns_cache = cache;
+}
+
+/* internal function to stop using the column cache file, forgetting the 
+ * quantities taken from it */
+static void columns_release(struct docmap *dm) {
+    enum docmap_cache cache = dm->cache.columns_cache;
+
+    if (!dm->cache.columns) {
+        return;
+    }
+
+    if (cache & DOCMAP_CACHE_WORDS) {
+        dm->cache.nwords = NULL;
+        dm->cache.pwords.buf = NULL;
+        dm->cache.pwords.bits = 0;
+        dm->cache.pwords.mask = 0;
+    }
+    if (cache & DOCMAP_CACHE_DISTINCT_WORDS) {
+        dm->cache.pdwords.buf = NULL;
+        dm->cache.pdwords.bits = 0;
+        dm->cache.pdwords.mask = 0;
+    }
+    if (cache & DOCMAP_CACHE_WEIGHT) {
+        dm->cache.weight = NULL;
+        dm->cache.nweight = NULL;
+    }
+    if (cache & DOCMAP_CACHE_TRECNO) {
+        dm->cache.trecno_off = NULL;
+        dm->cache.trecno.buf = NULL;
+        dm->cache.trecno.len = dm->cache.trecno.size = 0;
+    }
+    if (cache & DOCMAP_CACHE_LOCATION) {
+        dm->cache.loc_off = NULL;
+        dm->cache.loc.buf = NULL;
+        dm->cache.loc.len = dm->cache.loc.size = 0;
+        dm->cache.typeex = NULL;
+        dm->cache.typeex_len = dm->cache.typeex_size = 0;
+    }
+
+    if (dm->cache.columns_mapped) {
+        fdset_close_file(dm->fdset, dm->col_type, 0);
+    } else {
+        free(dm->cache.columns);
+    }
+    dm->cache.columns = NULL;
+    dm->cache.columns_mapped = 0;
+    dm->cache.columns_cache = DOCMAP_CACHE_NOTHING;
+}
+
+/* internal function to return a copy of the first len bytes of src, in an 
+ * allocation of size bytes (or NULL if memory couldn't be allocated) */
+static void *columns_copy(const void *src, unsigned long int len, 
+  unsigned long int size) {
+    void *dst;
+
+    if ((dst = malloc(size ? size : 1))) {
+        memcpy(dst, src, len);
+    }
+    return dst;
+}
+
+/* internal function to copy the quantities taken from the column cache file
+ * into memory of their own, so that they can be changed */
+static enum docmap_ret columns_detach(struct docmap *dm) {
+    enum docmap_cache cache = dm->cache.columns_cache;
+    unsigned long int i,
+                      len = dm->cache.len,
+                      size = dm->cache.size;
+    unsigned int *words = NULL,
+                 *dwords = NULL,
+                 *trecno_off = NULL,
+                 *loc_off = NULL,
+                 trecno_len = dm->cache.trecno.len,
+                 loc_len = dm->cache.loc.len,
+                 typeex_len = dm->cache.typeex_len;
+    float *weight = NULL;
+    unsigned char *nwords = NULL,
+                  *nweight = NULL;
+    char *trecno = NULL,
+         *loc = NULL;
+    struct docmap_type_ex *typeex = NULL;
+
+    if (!dm->cache.columns) {
+        return DOCMAP_OK;
+    }
+    assert(len <= size);
+
+    if (((cache & DOCMAP_CACHE_WORDS) && (cache & DOCMAP_CACHE_NORMS)
+        && !(nwords = columns_copy(dm->cache.nwords, len, size)))
+      || ((cache & DOCMAP_CACHE_WEIGHT) && (cache & DOCMAP_CACHE_NORMS)
+        && !(nweight = columns_copy(dm->cache.nweight, len, size)))
+      || ((cache & DOCMAP_CACHE_WORDS) && !(cache & DOCMAP_CACHE_NORMS)
+        && !(words = malloc(sizeof(*words) * (size + 1))))
+      || ((cache & DOCMAP_CACHE_DISTINCT_WORDS) 
+        && !(dwords = malloc(sizeof(*dwords) * (size + 1))))
+      || ((cache & DOCMAP_CACHE_WEIGHT) && !(cache & DOCMAP_CACHE_NORMS)
+        && !(weight = columns_copy(dm->cache.weight, sizeof(*weight) * len, 
+            sizeof(*weight) * size)))
+      || ((cache & DOCMAP_CACHE_TRECNO) 
+        && (!(trecno_off = columns_copy(dm->cache.trecno_off, 
+              sizeof(*trecno_off) 
+                * ((len + TRECNO_FRONT_FREQ - 1) / TRECNO_FRONT_FREQ), 
+              sizeof(*trecno_off) * (size / TRECNO_FRONT_FREQ + 1)))
+          || !(trecno = columns_copy(dm->cache.trecno.buf, trecno_len, 
+              trecno_len))))
+      || ((cache & DOCMAP_CACHE_LOCATION) 
+        && (!(loc_off = columns_copy(dm->cache.loc_off, 
+              sizeof(*loc_off) * ((len + LOC_REL_FREQ - 1) / LOC_REL_FREQ), 
+              sizeof(*loc_off) * (size / LOC_REL_FREQ + 1)))
+          || !(loc = columns_copy(dm->cache.loc.buf, loc_len, loc_len))
+          || !(typeex = columns_copy(dm->cache.typeex, 
+              sizeof(*typeex) * typeex_len, sizeof(*typeex) * typeex_len))))) {
+        free(words);
+        free(nwords);
+        free(dwords);
+        free(weight);
+        free(nweight);
+        free(trecno_off);
+        free(trecno);
+        free(loc_off);
+        free(loc);
+        free(typeex);
+        assert(!CRASH);
+        return DOCMAP_MEM_ERROR;
+    }
+
+    for (i = 0; words && i < len; i++) {
+        words[i] = DOCMAP_PACKED_GET(&dm->cache.pwords, i);
+    }
+    for (i = 0; dwords && i < len; i++) {
+        dwords[i] = DOCMAP_PACKED_GET(&dm->cache.pdwords, i);
+    }
+
+    columns_release(dm);
+    if (cache & DOCMAP_CACHE_WORDS) {
+        dm->cache.words = words;
+        dm->cache.nwords = nwords;
+    }
+    if (cache & DOCMAP_CACHE_DISTINCT_WORDS) {
+        dm->cache.dwords = dwords;
+    }
+    if (cache & DOCMAP_CACHE_WEIGHT) {
+        dm->cache.weight = weight;
+        dm->cache.nweight = nweight;
+    }
+    if (cache & DOCMAP_CACHE_TRECNO) {
+        dm->cache.trecno_off = trecno_off;
+        dm->cache.trecno.buf = trecno;
+        dm->cache.trecno.len = dm->cache.trecno.size = trecno_len;
+    }
+    if (cache & DOCMAP_CACHE_LOCATION) {
+        dm->cache.loc_off = loc_off;
+        dm->cache.loc.buf = loc;
+        dm->cache.loc.len = dm->cache.loc.size = loc_len;
+        dm->cache.typeex = typeex;
+        dm->cache.typeex_len = dm->cache.typeex_size = typeex_len;
+    }
+    return DOCMAP_OK;
+}
+
 void update_append_entries(struct docmap *dm) {
     /* first update entries in current append page */
     mem_hton(dm->appendbuf.buf 
@@ -777,18 +1508,25 @@ void update_append_entries(struct docmap *dm) {
 enum docmap_ret docmap_add(struct docmap *dm, 
   unsigned int fileno, off_t offset, 
   unsigned int bytes, enum docmap_flag flags, 
-  unsigned int words, unsigned int distinct_words,
-  float weight, const char *trecno, unsigned trecno_len, enum mime_types mtype,
-  unsigned long int *docno) {
+  unsigned int words, unsigned int distinct_words, 
+  const unsigned int *field_words, float weight, const char *trecno, 
+  unsigned trecno_len, enum mime_types mtype, unsigned long int *docno) {
     enum docmap_ret dmret;
     struct docmap_entry entry;
     char *tmp;
     unsigned int tmplen,
-                 reposno;
+                 reposno,
+                 i;
     enum reposset_ret rret;
 
     assert(offset >= 0);
 
+    /* the cache is about to change, so it can't stay in the column cache 
+     * file */
+    if ((dmret = columns_detach(dm)) != DOCMAP_OK) {
+        return dmret;
+    }
+
     /* copy parameters into entry */
     entry.docno = dm->entries;
     entry.fileno = fileno;
@@ -802,6 +1540,16 @@ enum docmap_ret docmap_add(struct docmap *dm,
     entry.trecno = (char *) trecno;
     entry.trecno_size = entry.trecno_len = trecno_len;
 
+    /* field 0 gets the words the other fields don't */
+    entry.fwords[0] = words;
+    for (i = 1; i < dm->fields; i++) {
+        entry.fwords[i] = field_words ? field_words[i] : 0;
+        if (entry.fwords[i] > entry.fwords[0]) {
+            return DOCMAP_ARG_ERROR;
+        }
+        entry.fwords[0] -= entry.fwords[i];
+    }
+
     //printf("AYXX: fileno: %d\n", fileno);
     //reposset_print(dm->rset, stdout);
     //printf("AYXX: before add dm->rset->entries: %d\n", dm->rset->entries);
@@ -870,7 +1618,8 @@ enum docmap_ret docmap_add(struct docmap *dm,
         }
     }
 
-    while ((dmret = encode(&dm->write.pos, &dm->write.entry, &entry)) 
+    while ((dmret = encode(&dm->write.pos, &dm->write.entry, &entry, 
+        dm->fields)) 
       != DOCMAP_OK) {
         switch (dmret) {
         case DOCMAP_OK: assert("can't get here" && 0); break;
@@ -968,6 +1717,9 @@ enum docmap_ret docmap_add(struct docmap *dm,
     dm->agg.sum_dwords += distinct_words;
     dm->agg.sum_weight += weight;
     dm->agg.sum_trecno += trecno_len;
+    for (i = 0; i < dm->fields; i++) {
+        dm->agg.sum_fwords[i] += entry.fwords[i];
+    }
 
     *docno = dm->entries++;
     return DOCMAP_OK;
@@ -1035,6 +1787,9 @@ static unsigned int find_page(struct docmap *dm, unsigned long int docno) {
 /* arrange for the read buffer to find the page that contains docno */
 static enum docmap_ret page_in(struct docmap *dm, unsigned int page) {
     enum docmap_ret dmret;
+    const char *addr;
+    unsigned long int len,
+                      offset;
     int fd;
 
     /* check that the page we want isn't already in the read buffer */
@@ -1057,14 +1812,27 @@ static enum docmap_ret page_in(struct docmap *dm, unsigned int page) {
             return dmret;
         }
 
-        if (((fd = fdset_pin(dm->fdset, dm->fd_type, page / dm->file_pages, 
-            (page % dm->file_pages) * dm->pagesize, SEEK_SET)) >= 0)
-          && (dm->readbuf.buflen 
+        offset = (page % dm->file_pages) * dm->pagesize;
+        if ((fdset_map(dm->fdset, dm->fd_type, page / dm->file_pages, &addr, 
+            &len) == FDSET_OK)
+          && (len > offset)) {
+            /* copy the pages out of the memory-mapped file */
+            dm->readbuf.buflen = dm->readbuf.bufsize * dm->pagesize;
+            if (dm->readbuf.buflen > len - offset) {
+                dm->readbuf.buflen = len - offset;
+            }
+            memcpy(dm->readbuf.buf, addr + offset, dm->readbuf.buflen);
+        } else if (((fd = fdset_pin(dm->fdset, dm->fd_type, 
+              page / dm->file_pages, offset, SEEK_SET)) < 0)
+          || ((dm->readbuf.buflen 
             = read(fd, dm->readbuf.buf, dm->readbuf.bufsize * dm->pagesize)) 
-              != -1
-          && (fdset_unpin(dm->fdset, dm->fd_type, page / dm->file_pages, fd) 
-              == FDSET_OK)
-          && (dm->readbuf.buflen > 0)) {
+              == -1)
+          || (fdset_unpin(dm->fdset, dm->fd_type, page / dm->file_pages, fd) 
+              != FDSET_OK)) {
+            dm->readbuf.buflen = 0;
+        }
+
+        if (dm->readbuf.buflen > 0) {
             assert((dm->readbuf.buflen / dm->pagesize) * dm->pagesize 
               == dm->readbuf.buflen);
             dm->readbuf.buflen /= dm->pagesize;
@@ -1171,14 +1939,16 @@ enum docmap_ret docmap_get_trecno(struct docmap *dm, unsigned long int
 
         *aux_len = prefix + len;
         return DOCMAP_OK;
-    } else if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
-        len = (aux_buf_len < dm->read.entry.trecno_len) 
-          ? aux_buf_len
-          : dm->read.entry.trecno_len;
-        memcpy(aux_buf, dm->read.entry.trecno, len);
-        *aux_len = dm->read.entry.trecno_len;
-        return DOCMAP_OK;
     } else {
+        LOCK(dm);
+        if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
+            len = (aux_buf_len < dm->read.entry.trecno_len) 
+              ? aux_buf_len
+              : dm->read.entry.trecno_len;
+            memcpy(aux_buf, dm->read.entry.trecno, len);
+            *aux_len = dm->read.entry.trecno_len;
+        }
+        UNLOCK(dm);
         return dmret;
     }
 }
@@ -1281,15 +2051,17 @@ enum docmap_ret docmap_get_location(struct docmap *dm,
             *mtype = MIME_TYPE_APPLICATION_X_TREC;
         }
 
-        return DOCMAP_OK;
-    } else if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
-        *fileno = dm->read.entry.fileno;
-        *disk_offset_ptr = dm->read.entry.offset;
-        *flags = dm->read.entry.flags;
-        *bytes = dm->read.entry.bytes;
-        *mtype = dm->read.entry.mtype;
         return DOCMAP_OK;
     } else {
+        LOCK(dm);
+        if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
+            *fileno = dm->read.entry.fileno;
+            *disk_offset_ptr = dm->read.entry.offset;
+            *flags = dm->read.entry.flags;
+            *bytes = dm->read.entry.bytes;
+            *mtype = dm->read.entry.mtype;
+        }
+        UNLOCK(dm);
         return dmret;
     }
 }
@@ -1328,6 +2100,48 @@ unsigned int docmap_get_bytes_cached(struct docmap *dm,
     return arr[offset];
 }
 
+enum docmap_ret docmap_add_checkpoint(struct docmap *dm,
+  unsigned int fileno, const struct docmap_checkpoint *point) {
+    struct reposset_check check,
+                          *first;
+
+    /* only compressed repositories have a checkpoint at the start */
+    if (!(first = reposset_check(dm->rset, fileno))) {
+        return DOCMAP_ARG_ERROR;
+    }
+
+    check.reposno = fileno;
+    check.offset = point->offset;
+    check.comp = first->comp;
+    check.in_offset = point->in_offset;
+    check.bits = point->bits;
+    check.prime = point->prime;
+    check.window = point->window;
+    check.window_len = point->window_len;
+    if (reposset_add_resume(dm->rset, &check) != REPOSSET_OK) {
+        return DOCMAP_MEM_ERROR;
+    }
+    dm->dirty = 1;
+    return DOCMAP_OK;
+}
+
+enum docmap_ret docmap_get_checkpoint(struct docmap *dm,
+  unsigned int fileno, off_t offset, struct docmap_checkpoint *point) {
+    struct reposset_check *check;
+
+    if (!(check = reposset_check_at(dm->rset, fileno, offset))) {
+        return DOCMAP_ARG_ERROR;
+    }
+
+    point->offset = check->offset;
+    point->in_offset = check->in_offset;
+    point->bits = check->bits;
+    point->prime = check->prime;
+    point->window = check->window;
+    point->window_len = check->window_len;
+    return DOCMAP_OK;
+}
+
 enum docmap_ret docmap_get_bytes(struct docmap *dm,
   unsigned long int docno, unsigned int *bytes) {
     enum docmap_ret dmret;
@@ -1335,10 +2149,12 @@ enum docmap_ret docmap_get_bytes(struct docmap *dm,
     if (docno < dm->entries && dm->cache.cache & DOCMAP_CACHE_LOCATION) {
         *bytes = docmap_get_bytes_cached(dm, docno);
         return DOCMAP_OK;
-    } else if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
-        *bytes = dm->read.entry.bytes;
-        return DOCMAP_OK;
     } else {
+        LOCK(dm);
+        if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
+            *bytes = dm->read.entry.bytes;
+        }
+        UNLOCK(dm);
         return dmret;
     }
 }
@@ -1348,12 +2164,14 @@ enum docmap_ret docmap_get_words(struct docmap *dm,
     enum docmap_ret dmret;
 
     if (docno < dm->entries && dm->cache.cache & DOCMAP_CACHE_WORDS) {
-        *words = dm->cache.words[docno];
-        return DOCMAP_OK;
-    } else if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
-        *words = dm->read.entry.words;
+        *words = DOCMAP_GET_WORDS(dm, docno);
         return DOCMAP_OK;
     } else {
+        LOCK(dm);
+        if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
+            *words = dm->read.entry.words;
+        }
+        UNLOCK(dm);
         return dmret;
     }
 }
@@ -1363,12 +2181,33 @@ enum docmap_ret docmap_get_distinct_words(struct docmap *dm,
     enum docmap_ret dmret;
 
     if (docno < dm->entries && dm->cache.cache & DOCMAP_CACHE_DISTINCT_WORDS) {
-        *distinct_words = dm->cache.dwords[docno];
+        *distinct_words = DOCMAP_GET_DISTINCT_WORDS(dm, docno);
         return DOCMAP_OK;
-    } else if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
-        *distinct_words = dm->read.entry.dwords;
+    } else {
+        LOCK(dm);
+        if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
+            *distinct_words = dm->read.entry.dwords;
+        }
+        UNLOCK(dm);
+        return dmret;
+    }
+}
+
+enum docmap_ret docmap_get_field_words(struct docmap *dm,
+  unsigned long int docno, unsigned int *field_words) {
+    enum docmap_ret dmret;
+
+    if (docno < dm->entries && dm->cache.cache & DOCMAP_CACHE_FIELD_WORDS) {
+        memcpy(field_words, DOCMAP_GET_FIELD_WORDS(dm, docno), 
+          sizeof(*field_words) * dm->fields);
         return DOCMAP_OK;
     } else {
+        LOCK(dm);
+        if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
+            memcpy(field_words, dm->read.entry.fwords, 
+              sizeof(*field_words) * dm->fields);
+        }
+        UNLOCK(dm);
         return dmret;
     }
 }
@@ -1381,12 +2220,12 @@ enum docmap_ret docmap_get_weight(struct docmap *dm,
         *weight = dm->cache.weight[docno];
         return DOCMAP_OK;
     }
+    LOCK(dm);
     if ((dmret = traverse(dm, &dm->read, docno)) == DOCMAP_OK) {
         *weight = dm->read.entry.weight;
-        return DOCMAP_OK;
-    } else {
-        return dmret;
     }
+    UNLOCK(dm);
+    return dmret;
 }
 
 enum docmap_cache docmap_get_cache(struct docmap *dm) {
@@ -1394,24 +2233,46 @@ enum docmap_cache docmap_get_cache(struct docmap *dm) {
 }
 
 static void cache_cleanup(struct docmap *dm) {
-    if (!(dm->cache.cache & DOCMAP_CACHE_WORDS)) {
+    if (!(dm->cache.cache & DOCMAP_CACHE_WORDS) 
+      || (dm->cache.cache & DOCMAP_CACHE_NORMS)) {
         if (dm->cache.words) {
             free(dm->cache.words);
             dm->cache.words = NULL;
         }
     } 
+    if (!(dm->cache.cache & DOCMAP_CACHE_WORDS) 
+      || !(dm->cache.cache & DOCMAP_CACHE_NORMS)) {
+        if (dm->cache.nwords) {
+            free(dm->cache.nwords);
+            dm->cache.nwords = NULL;
+        }
+    } 
     if (!(dm->cache.cache & DOCMAP_CACHE_DISTINCT_WORDS)) {
         if (dm->cache.dwords) {
             free(dm->cache.dwords);
             dm->cache.dwords = NULL;
         }
     } 
-    if (!(dm->cache.cache & DOCMAP_CACHE_WEIGHT)) {
+    if (!(dm->cache.cache & DOCMAP_CACHE_FIELD_WORDS)) {
+        if (dm->cache.fwords) {
+            free(dm->cache.fwords);
+            dm->cache.fwords = NULL;
+        }
+    } 
+    if (!(dm->cache.cache & DOCMAP_CACHE_WEIGHT) 
+      || (dm->cache.cache & DOCMAP_CACHE_NORMS)) {
         if (dm->cache.weight) {
             free(dm->cache.weight);
             dm->cache.weight = NULL;
         }
     }
+    if (!(dm->cache.cache & DOCMAP_CACHE_WEIGHT) 
+      || !(dm->cache.cache & DOCMAP_CACHE_NORMS)) {
+        if (dm->cache.nweight) {
+            free(dm->cache.nweight);
+            dm->cache.nweight = NULL;
+        }
+    }
     if (!(dm->cache.cache & DOCMAP_CACHE_TRECNO)) {
         if (dm->cache.trecno.buf) {
             free(dm->cache.trecno.buf);
@@ -1462,7 +2323,8 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
                  pages = dm->map_len,
                  prev_entries = dm->entries,
                  prev_size = dm->cache.size,
-                 prev_fileno = -1;
+                 prev_fileno = -1,
+                 i;
 
     assert(pages);
 
@@ -1470,27 +2332,42 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
         /* nothing to do */
         return DOCMAP_OK;
 
-    } else if (!reread && (tocache - (dm->cache.cache & tocache)) == 0) {
-        /* all required entries are cached, just turn some off */
+    } else if ((dmret = columns_detach(dm)) != DOCMAP_OK) {
+        return dmret;
+
+    } else if (!reread && (tocache - (dm->cache.cache & tocache)) == 0
+      && !(((prev ^ tocache) & DOCMAP_CACHE_NORMS)
+        && (tocache & (DOCMAP_CACHE_WORDS | DOCMAP_CACHE_WEIGHT)))) {
+        /* all required entries are cached (in the same form), just turn some 
+         * off */
         dm->cache.cache = tocache;
 
         /* now use tocache to figure out what to remove */
         tocache = (dm->cache.cache & tocache) - tocache;
 
         if (tocache & DOCMAP_CACHE_WORDS) {
-            assert(dm->cache.words);
+            assert(dm->cache.words || dm->cache.nwords);
             free(dm->cache.words);
+            free(dm->cache.nwords);
             dm->cache.words = NULL;
+            dm->cache.nwords = NULL;
         }
         if (tocache & DOCMAP_CACHE_DISTINCT_WORDS) {
             assert(dm->cache.dwords);
             free(dm->cache.dwords);
             dm->cache.dwords = NULL;
         }
+        if (tocache & DOCMAP_CACHE_FIELD_WORDS) {
+            assert(dm->cache.fwords);
+            free(dm->cache.fwords);
+            dm->cache.fwords = NULL;
+        }
         if (tocache & DOCMAP_CACHE_WEIGHT) {
-            assert(dm->cache.weight);
+            assert(dm->cache.weight || dm->cache.nweight);
             free(dm->cache.weight);
+            free(dm->cache.nweight);
             dm->cache.weight = NULL;
+            dm->cache.nweight = NULL;
         }
         if (tocache & DOCMAP_CACHE_TRECNO) {
             assert(dm->cache.trecno.buf && dm->cache.trecno_off);
@@ -1518,6 +2395,9 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
     dm->dirty = 1;
     dm->agg.sum_weight = dm->agg.sum_bytes 
       = dm->agg.sum_words = dm->agg.sum_dwords = 0;
+    for (i = 0; i < INDEX_FIELDS; i++) {
+        dm->agg.sum_fwords[i] = 0;
+    }
 
     /* ensure that we've got initial memory for cached items */
     dm->cache.cache = tocache;
@@ -1546,7 +2426,9 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
     dm->cache.typeex_len = 0;
     dm->cache.trecno.len = 0;
     dm->cache.loc.len = 0;
-    reposset_clear(dm->rset);
+    /* checkpoints part way through compressed repositories can't be
+     * recreated from the entries, so keep the checkpoints we have */
+    reposset_clear_records(dm->rset);
     for (page = 0; page < pages; page++) {
         if ((dmret = page_in(dm, page)) == DOCMAP_OK) {
             unsigned int entry = 0;
@@ -1582,7 +2464,8 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
                 }
                 reposset_append_docno(dm->rset, dm->read.entry.docno, 1);
                 if (dm->read.entry.flags == DOCMAP_COMPRESSED 
-                  && dm->read.entry.offset == 0) {
+                  && dm->read.entry.offset == 0
+                  && !reposset_check(dm->rset, dm->read.entry.fileno)) {
                     enum reposset_ret rret;
                     /* XXX: add in a checkpoint at the start of each compressed
                      * file, because that's what the indexing code does */
@@ -1610,6 +2493,9 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
                 dm->agg.sum_bytes += dm->read.entry.bytes;
                 dm->agg.sum_weight += dm->read.entry.weight;
                 dm->agg.sum_trecno += dm->read.entry.trecno_len;
+                for (i = 0; i < dm->fields; i++) {
+                    dm->agg.sum_fwords[i] += dm->read.entry.fwords[i];
+                }
 
                 /* update cache */
                 if ((dmret = cache(dm, &dm->read.entry)) != DOCMAP_OK) {
@@ -1643,9 +2529,14 @@ static enum docmap_ret docmap_cache_int(struct docmap *dm,
 }
 
 enum docmap_ret docmap_cache(struct docmap *dm, enum docmap_cache tocache) {
+    enum docmap_ret dmret;
+
     /* need to have a separate function so that we can force reread of the
      * docmap when necessary */
-    return docmap_cache_int(dm, tocache, 0);
+    LOCK(dm);
+    dmret = docmap_cache_int(dm, tocache, 0);
+    UNLOCK(dm);
+    return dmret;
 }
 
 enum docmap_ret docmap_avg_bytes(struct docmap *dm, double *avg_bytes) {
@@ -1674,10 +2565,28 @@ enum docmap_ret docmap_avg_weight(struct docmap *dm, double *avg_weight) {
     return DOCMAP_OK;
 }
 
+enum docmap_ret docmap_avg_field_words(struct docmap *dm,
+  double *avg_fwords) {
+    unsigned int i;
+
+    for (i = 0; i < dm->fields; i++) {
+        avg_fwords[i] = dm->entries ? dm->agg.sum_fwords[i] / dm->entries : 0;
+    }
+    return DOCMAP_OK;
+}
+
+unsigned int docmap_fields(struct docmap *dm) {
+    return dm->fields;
+}
+
 unsigned long int docmap_entries(struct docmap *dm) {
     return dm->entries;
 }
 
+unsigned int docmap_norm_words(unsigned int words) {
+    return norm_decode(norm_encode(words));
+}
+
 const char *docmap_strerror(enum docmap_ret dmret) {
     switch (dmret) {
     case DOCMAP_OK:
@@ -1762,6 +2671,15 @@ enum docmap_ret docmap_save(struct docmap *dm) {
                  *end_pos,
                  byte;
             struct reposset_check* check;
+            /* cached quantities that go in cache pages, rather than the 
+             * column cache file */
+            enum docmap_cache paged = dm->cache.cache & ~columns_save(dm);
+            /* cached quantities that go in cache pages as norms */
+            enum docmap_cache normed = (dm->cache.cache & DOCMAP_CACHE_NORMS)
+              ? paged & (DOCMAP_CACHE_WORDS | DOCMAP_CACHE_WEIGHT) 
+              : DOCMAP_CACHE_NOTHING;
+
+            paged &= ~normed;
 
             /* dump out the contents of the read buffer to give us 
              * working space */
@@ -1782,13 +2700,22 @@ enum docmap_ret docmap_save(struct docmap *dm) {
             vec_flt_write(&v, (float) dm->agg.sum_trecno, 
               VEC_FLT_FULL_PRECISION);
 
+            /* write words in each field but the first (which has the rest) */
+            if (dm->fields > 1) {
+                *v.pos++ = CACHE_ID_FIELD_AGG;
+                for (i = 1; i < dm->fields; i++) {
+                    vec_flt_write(&v, (float) dm->agg.sum_fwords[i], 
+                      VEC_FLT_FULL_PRECISION);
+                }
+            }
+
 /* macro to perform repetitive paging out of arrays */
 #define PAGE_OUT_INT 1
 #define PAGE_OUT_FLT 2
 #define PAGE_OUT_CHR 3
 #define PAGE_OUT_LONG 4
-#define PAGE_OUT_CACHE(id, elem, num, masked, mask, type)                     \
-            for (written = 0; (!masked || dm->cache.cache & mask)             \
+#define PAGE_OUT_CACHE(id, elem, num, cached, mask, type)                     \
+            for (written = 0; (!mask || (cached & mask))                      \
               && written < num; ) {                                           \
                 uint32_t entries = 0;                                         \
                                                                               \
@@ -1825,29 +2752,36 @@ enum docmap_ret docmap_save(struct docmap *dm) {
                 }                                                             \
             }
 
-            PAGE_OUT_CACHE(CACHE_ID_MAP, dm->map, dm->map_len, 0, 0, 
+            PAGE_OUT_CACHE(CACHE_ID_MAP, dm->map, dm->map_len, paged, 0, 
               PAGE_OUT_LONG);
             PAGE_OUT_CACHE(CACHE_ID_WORDS, dm->cache.words, dm->cache.len, 
-              1, DOCMAP_CACHE_WORDS, PAGE_OUT_INT);
+              paged, DOCMAP_CACHE_WORDS, PAGE_OUT_INT);
             PAGE_OUT_CACHE(CACHE_ID_DWORDS, dm->cache.dwords, dm->cache.len, 
-              1, DOCMAP_CACHE_DISTINCT_WORDS, PAGE_OUT_INT);
+              paged, DOCMAP_CACHE_DISTINCT_WORDS, PAGE_OUT_INT);
             PAGE_OUT_CACHE(CACHE_ID_WEIGHT, dm->cache.weight, dm->cache.len, 
-              1, DOCMAP_CACHE_WEIGHT, PAGE_OUT_FLT);
+              paged, DOCMAP_CACHE_WEIGHT, PAGE_OUT_FLT);
+            PAGE_OUT_CACHE(CACHE_ID_FIELD_WORDS, dm->cache.fwords, 
+              dm->cache.len * dm->fields, paged, DOCMAP_CACHE_FIELD_WORDS, 
+              PAGE_OUT_INT);
+            PAGE_OUT_CACHE(CACHE_ID_WORDS_NORM, dm->cache.nwords, 
+              dm->cache.len, normed, DOCMAP_CACHE_WORDS, PAGE_OUT_CHR);
+            PAGE_OUT_CACHE(CACHE_ID_WEIGHT_NORM, dm->cache.nweight, 
+              dm->cache.len, normed, DOCMAP_CACHE_WEIGHT, PAGE_OUT_CHR);
             PAGE_OUT_CACHE(CACHE_ID_TRECNO, dm->cache.trecno_off, 
-              (dm->cache.len + TRECNO_FRONT_FREQ - 1) / TRECNO_FRONT_FREQ, 1, 
+              (dm->cache.len + TRECNO_FRONT_FREQ - 1) / TRECNO_FRONT_FREQ, paged,
               DOCMAP_CACHE_TRECNO, PAGE_OUT_INT);
             PAGE_OUT_CACHE(CACHE_ID_TRECNO_CODE, dm->cache.trecno.buf, 
-              dm->cache.trecno.len, 1, DOCMAP_CACHE_TRECNO, PAGE_OUT_CHR);
+              dm->cache.trecno.len, paged, DOCMAP_CACHE_TRECNO, PAGE_OUT_CHR);
             PAGE_OUT_CACHE(CACHE_ID_LOC, dm->cache.loc_off, 
-              (dm->cache.len + LOC_REL_FREQ - 1) / LOC_REL_FREQ, 1, 
+              (dm->cache.len + LOC_REL_FREQ - 1) / LOC_REL_FREQ, paged,
               DOCMAP_CACHE_LOCATION, PAGE_OUT_INT);
             PAGE_OUT_CACHE(CACHE_ID_LOC_CODE, dm->cache.loc.buf, 
-              dm->cache.loc.len, 1, DOCMAP_CACHE_LOCATION, PAGE_OUT_CHR);
+              dm->cache.loc.len, paged, DOCMAP_CACHE_LOCATION, PAGE_OUT_CHR);
 
             /* note that we're being dodgy and just processing the type 
              * exception array as an array of unsigned ints */
             PAGE_OUT_CACHE(CACHE_ID_TYPEEX, (unsigned int *) dm->cache.typeex,
-              dm->cache.typeex_len * 2, 1, DOCMAP_CACHE_LOCATION, 
+              dm->cache.typeex_len * 2, paged, DOCMAP_CACHE_LOCATION, 
               PAGE_OUT_INT);
 
             /* write out reposset details */
@@ -1885,14 +2819,22 @@ enum docmap_ret docmap_save(struct docmap *dm) {
             /* write out checkpoint details */
             check = reposset_check_first(dm->rset);
             for (i = 0; i < reposset_checks(dm->rset); i++) {
-                char idc = CACHE_ID_REPOS_CHECK;
+                char idc = check[i].in_offset 
+                  ? CACHE_ID_REPOS_RESUME : CACHE_ID_REPOS_CHECK;
                 char *pos = v.pos;
 
-                /* try to write record to output */
+                /* try to write record to output (checkpoints part way through
+                 * a repository also need to record the decompression state) */
                 if (vec_byte_write(&v, &idc, 1)
                   && vec_vbyte_write(&v, check[i].reposno)
                   && vec_vbyte_write(&v, check[i].offset)
-                  && vec_vbyte_write(&v, check[i].comp)) {
+                  && vec_vbyte_write(&v, check[i].comp)
+                  && (!check[i].in_offset
+                    || (vec_vbyte_write(&v, check[i].in_offset)
+                      && vec_vbyte_write(&v, check[i].bits)
+                      && vec_vbyte_write(&v, check[i].prime)
+                      && vec_vbyte_write(&v, check[i].window)
+                      && vec_vbyte_write(&v, check[i].window_len)))) {
                     /* succeeded in writing out this record */
                 } else {
                     v.pos = pos;
@@ -1933,11 +2875,11 @@ enum docmap_ret docmap_save(struct docmap *dm) {
 }
 
 struct docmap *docmap_new(struct fdset *fdset, 
-  int fd_type, unsigned int pagesize, unsigned int pages, 
-  unsigned long int max_filesize, enum docmap_cache cache, 
-  enum docmap_ret *ret) {
-    struct docmap *dm 
-      = docmap_init(fdset, fd_type, pagesize, pages, max_filesize, cache);
+  int fd_type, int col_type, unsigned int pagesize, unsigned int pages, 
+  unsigned long int max_filesize, unsigned int fields, 
+  enum docmap_cache cache, enum docmap_ret *ret) {
+    struct docmap *dm = docmap_init(fdset, fd_type, col_type, pagesize, pages,
+        max_filesize, fields, cache);
     dm->dirty = 1;
 
     if (dm) {
@@ -1964,11 +2906,11 @@ struct docmap *docmap_new(struct fdset *fdset,
 static enum docmap_ret docmap_cache_check(struct docmap *dm);
 
 struct docmap *docmap_load(struct fdset *fdset, 
-  int fd_type, unsigned int pagesize, unsigned int bufpages, 
-  unsigned long int max_filesize, enum docmap_cache cache, 
-  enum docmap_ret *ret) {
-    struct docmap *dm = docmap_init(fdset, fd_type, pagesize, bufpages, 
-        max_filesize, 0);
+  int fd_type, int col_type, unsigned int pagesize, unsigned int bufpages, 
+  unsigned long int max_filesize, unsigned int fields, 
+  enum docmap_cache cache, enum docmap_ret *ret) {
+    struct docmap *dm = docmap_init(fdset, fd_type, col_type, pagesize, 
+        bufpages, max_filesize, fields, 0);
     int fd = -1,
         prev_fd,
         corrupt,
@@ -2141,6 +3083,21 @@ struct docmap *docmap_load(struct fdset *fdset,
                             corrupt = 1;
                         }
                         dm->agg.sum_trecno = tmpf;
+                        /* field 0 has words the other fields don't */
+                        dm->agg.sum_fwords[0] = dm->agg.sum_words;
+                        break;
+
+                    case CACHE_ID_FIELD_AGG:
+                        for (target = 1; !corrupt && target < dm->fields; 
+                          target++) {
+                            if (vec_len(&v) && vec_flt_read(&v, &tmpf, 
+                                VEC_FLT_FULL_PRECISION)) {
+                                dm->agg.sum_fwords[target] = tmpf;
+                                dm->agg.sum_fwords[0] -= tmpf;
+                            } else {
+                                corrupt = 1;
+                            }
+                        }
                         break;
 
                     case CACHE_ID_REPOS_REC:
@@ -2180,6 +3137,34 @@ struct docmap *docmap_load(struct fdset *fdset,
                         }
                         break;
 
+                    case CACHE_ID_REPOS_RESUME:
+                        vec_vbyte_read(&v, &tmpl);
+                        tmpcheck.reposno = tmpl;
+                        vec_vbyte_read(&v, &tmpcheck.offset);
+                        vec_vbyte_read(&v, &tmpl);
+                        tmpcheck.comp = tmpl;
+                        vec_vbyte_read(&v, &tmpcheck.in_offset);
+                        vec_vbyte_read(&v, &tmpl);
+                        tmpcheck.bits = tmpl;
+                        vec_vbyte_read(&v, &tmpl);
+                        tmpcheck.prime = tmpl;
+                        vec_vbyte_read(&v, &tmpcheck.window);
+                        if (vec_vbyte_read(&v, &tmpl)) {
+                            tmpcheck.window_len = tmpl;
+
+                            assert(tmpcheck.comp 
+                              == MIME_TYPE_APPLICATION_X_GZIP);
+                            if (reposset_add_resume(dm->rset, &tmpcheck) 
+                              != REPOSSET_OK) {
+                                assert(!CRASH);
+                                FAIL(DOCMAP_MEM_ERROR);
+                            }
+                        } else {
+                            assert(!CRASH);
+                            FAIL(DOCMAP_FMT_ERROR);
+                        }
+                        break;
+
                     case CACHE_ID_MAP:
                     case CACHE_ID_WEIGHT:
                     case CACHE_ID_TRECNO:
@@ -2189,6 +3174,9 @@ struct docmap *docmap_load(struct fdset *fdset,
                     case CACHE_ID_LOC:
                     case CACHE_ID_LOC_CODE:
                     case CACHE_ID_TYPEEX:
+                    case CACHE_ID_WORDS_NORM:
+                    case CACHE_ID_WEIGHT_NORM:
+                    case CACHE_ID_FIELD_WORDS:
                         v.pos--;
                         bytes = *v.pos++;
                         vec_vbyte_read(&v, &tmpl);
@@ -2260,6 +3248,26 @@ struct docmap *docmap_load(struct fdset *fdset,
                             target = dm->entries;
                             arrptr = &dm->cache.words; 
                             break;
+                        case CACHE_ID_FIELD_WORDS: 
+                            dm->cache.cache |= DOCMAP_CACHE_FIELD_WORDS;
+                            type = PAGE_OUT_INT;
+                            target = dm->entries * dm->fields;
+                            arrptr = &dm->cache.fwords; 
+                            break;
+                        case CACHE_ID_WORDS_NORM: 
+                            dm->cache.cache 
+                              |= DOCMAP_CACHE_WORDS | DOCMAP_CACHE_NORMS;
+                            type = PAGE_OUT_CHR;
+                            target = dm->entries;
+                            carrptr = (char **) &dm->cache.nwords; 
+                            break;
+                        case CACHE_ID_WEIGHT_NORM: 
+                            dm->cache.cache 
+                              |= DOCMAP_CACHE_WEIGHT | DOCMAP_CACHE_NORMS;
+                            type = PAGE_OUT_CHR;
+                            target = dm->entries;
+                            carrptr = (char **) &dm->cache.nweight; 
+                            break;
                         default: assert("can't get here" && 0);
                         }
 
@@ -2316,7 +3324,7 @@ struct docmap *docmap_load(struct fdset *fdset,
                         case PAGE_OUT_CHR:
                             if (corrupt || !vec_len(&v)) break;
                             if (!*carrptr 
-                              && !(*carrptr = malloc(sizeof(float) * target))) {
+                              && !(*carrptr = malloc(target))) {
                                 assert(!CRASH);
                                 FAIL(DOCMAP_MEM_ERROR);
                             }
@@ -2342,6 +3350,11 @@ struct docmap *docmap_load(struct fdset *fdset,
         }
     }
     dm->map[dm->map_len] = ULONG_MAX;
+
+    /* take whatever else we want from the column cache file */
+    if (!corrupt && map && (cache & ~dm->cache.cache)) {
+        columns_load(dm, cache & ~dm->cache.cache);
+    }
     TIMINGS_END("docmap fastload");
     fprintf(stderr, "AYXX: docmap load: rset->entries: %d\n", dm->rset->entries);
 
@@ -2366,6 +3379,7 @@ struct docmap *docmap_load(struct fdset *fdset,
 }
 
 void docmap_delete(struct docmap *dm) {
+    columns_release(dm);
     dm->cache.cache = 0;
     cache_cleanup(dm);
     if (dm->write.entry.trecno) {
@@ -2380,6 +3394,9 @@ void docmap_delete(struct docmap *dm) {
     reposset_delete(dm->rset);
     free(dm->buf);
     dm->buf = NULL;
+#ifdef MT_ZET
+    pthread_mutex_destroy(&dm->mutex);
+#endif /* MT_ZET */
     free(dm);
 }
 
@@ -2415,19 +3432,41 @@ static enum docmap_ret docmap_cache_check(struct docmap *dm) {
                 char buf[BUFSIZ + 1];
 
                 if (((dm->cache.cache & DOCMAP_CACHE_WORDS)
+                    && !(dm->cache.cache & DOCMAP_CACHE_NORMS)
                     && dm->read.entry.words
-                      != dm->cache.words[dm->read.entry.docno])
+                      != DOCMAP_GET_WORDS(dm, dm->read.entry.docno))
+                  || ((dm->cache.cache & DOCMAP_CACHE_WORDS)
+                    && (dm->cache.cache & DOCMAP_CACHE_NORMS)
+                    && norm_encode(dm->read.entry.words)
+                      != dm->cache.nwords[dm->read.entry.docno])
                   || ((dm->cache.cache & DOCMAP_CACHE_LOCATION)
                     && dm->read.entry.bytes
                       != docmap_get_bytes_cached(dm, dm->read.entry.docno))
                   || ((dm->cache.cache & DOCMAP_CACHE_DISTINCT_WORDS)
                     && dm->read.entry.dwords
-                      != dm->cache.dwords[dm->read.entry.docno])) {
+                      != DOCMAP_GET_DISTINCT_WORDS(dm, dm->read.entry.docno))
+                  || ((dm->cache.cache & DOCMAP_CACHE_FIELD_WORDS)
+                    && memcmp(dm->read.entry.fwords, 
+                        DOCMAP_GET_FIELD_WORDS(dm, dm->read.entry.docno),
+                        sizeof(*dm->read.entry.fwords) * dm->fields))) {
+                    assert(!CRASH);
+                    return DOCMAP_FMT_ERROR;
+                }
+
+                /* weights in the docmap are only approximate, so their 
+                 * norms can be one off */
+                if ((dm->cache.cache & DOCMAP_CACHE_WEIGHT)
+                    && (dm->cache.cache & DOCMAP_CACHE_NORMS)
+                    && (norm_encode_weight(dm->read.entry.weight) 
+                        > dm->cache.nweight[dm->read.entry.docno] + 1
+                      || norm_encode_weight(dm->read.entry.weight) + 1
+                        < dm->cache.nweight[dm->read.entry.docno])) {
                     assert(!CRASH);
                     return DOCMAP_FMT_ERROR;
                 }
 
                 if ((dm->cache.cache & DOCMAP_CACHE_WEIGHT)
+                    && !(dm->cache.cache & DOCMAP_CACHE_NORMS)
                     && (dm->read.entry.weight
                       < 0.95 * dm->cache.weight[dm->read.entry.docno]
                       || dm->read.entry.weight
@@ -0,0 +1,525 @@
+/* docstore.c implements the document store declared in docstore.h.
+ *
+ * Blocks of a repository are numbered consecutively, so a repository only
+ * needs to record its first block and its length.  A block that doesn't get
+ * any smaller when compressed is stored as it is, which is recognisable
+ * because only such blocks are as long as their uncompressed text.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "docstore.h"
+
+#include "cache.h"
+#include "fdset.h"
+#include "mem.h"
+#include "stream.h"
+#include "zstdint.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* size of the buffer files are read into when they're added */
+#define INBUF_SIZE 65536
+
+struct docstore_block {
+    unsigned int fileno;             /* file the block is in */
+    unsigned long int offset;        /* where the block starts in the file */
+    unsigned int len;                /* stored length of the block */
+};
+
+struct docstore_repos {
+    int stored;                      /* whether the repository is stored */
+    unsigned long int first;         /* first block of the repository */
+    unsigned long int bytes;         /* uncompressed length */
+};
+
+struct docstore {
+    struct fdset *fd;                /* fdset the store files are in */
+    unsigned int type;               /* fdset type of the store files */
+    unsigned long int max_filesize;  /* maximum length of a store file */
+    struct docstore_block *block;    /* table of blocks */
+    unsigned long int blocks;        /* number of blocks */
+    unsigned long int blocks_size;   /* capacity of block */
+    struct docstore_repos *repos;    /* repositories, by number */
+    unsigned int repos_len;          /* highest repository number + 1 */
+    unsigned int repos_size;         /* capacity of repos */
+    unsigned int fileno;             /* file blocks are being appended to */
+    unsigned long int end;           /* length of that file */
+    struct cache *cache;             /* uncompressed blocks, keyed by block
+                                      * number (or NULL) */
+};
+
+struct docstore *docstore_new(struct fdset *fds, unsigned int type,
+  unsigned long int max_filesize, unsigned long int cache) {
+    struct docstore *ds = malloc(sizeof(*ds));
+
+    if (!ds) {
+        return NULL;
+    }
+    ds->fd = fds;
+    ds->type = type;
+    ds->max_filesize = max_filesize;
+    ds->block = NULL;
+    ds->blocks = ds->blocks_size = 0;
+    ds->repos = NULL;
+    ds->repos_len = ds->repos_size = 0;
+    ds->fileno = 0;
+    ds->end = 0;
+    ds->cache = NULL;
+    if (cache && !(ds->cache = cache_new(cache))) {
+        free(ds);
+        return NULL;
+    }
+    return ds;
+}
+
+void docstore_delete(struct docstore *ds) {
+    if (ds->cache) {
+        cache_delete(ds->cache);
+    }
+    free(ds->block);
+    free(ds->repos);
+    free(ds);
+}
+
+void docstore_rm(struct docstore *ds) {
+    unsigned int i;
+
+    for (i = 0; fdset_unlink(ds->fd, ds->type, i) == FDSET_OK; i++) ;
+}
+
+/* internal function to read n 32-bit values from fp into vals */
+static int read_vals(FILE *fp, unsigned long int *vals, unsigned int n) {
+    uint32_t tmp[4],
+             val;
+    unsigned int i;
+
+    assert(n <= sizeof(tmp) / sizeof(*tmp));
+    if (!fread(tmp, sizeof(*tmp) * n, 1, fp)) {
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        mem_ntoh(&val, &tmp[i], sizeof(val));
+        vals[i] = val;
+    }
+    return 1;
+}
+
+/* internal function to write n values from vals to fp as 32-bit values */
+static int write_vals(FILE *fp, const unsigned long int *vals,
+  unsigned int n) {
+    uint32_t tmp[4],
+             val;
+    unsigned int i;
+
+    assert(n <= sizeof(tmp) / sizeof(*tmp));
+    for (i = 0; i < n; i++) {
+        val = vals[i];
+        mem_hton(&tmp[i], &val, sizeof(val));
+    }
+    return fwrite(tmp, sizeof(*tmp) * n, 1, fp);
+}
+
+/* internal function to make room for repository number repos */
+static int repos_reserve(struct docstore *ds, unsigned int repos) {
+    void *ptr;
+    unsigned int size;
+
+    if (repos >= ds->repos_size) {
+        size = ds->repos_size * 2 + 1;
+        if (size <= repos) {
+            size = repos + 1;
+        }
+        if (!(ptr = realloc(ds->repos, sizeof(*ds->repos) * size))) {
+            return 0;
+        }
+        ds->repos = ptr;
+        ds->repos_size = size;
+    }
+    while (ds->repos_len <= repos) {
+        ds->repos[ds->repos_len++].stored = 0;
+    }
+    return 1;
+}
+
+/* internal function to make room for another block */
+static int block_reserve(struct docstore *ds) {
+    void *ptr;
+
+    if (ds->blocks >= ds->blocks_size) {
+        if (!(ptr = realloc(ds->block,
+            sizeof(*ds->block) * (ds->blocks_size * 2 + 1)))) {
+            return 0;
+        }
+        ds->block = ptr;
+        ds->blocks_size = ds->blocks_size * 2 + 1;
+    }
+    return 1;
+}
+
+enum docstore_ret docstore_read(struct docstore *ds, FILE *fp) {
+    unsigned long int vals[4],
+                      repos,
+                      blocks,
+                      i;
+    struct docstore_block *last;
+
+    if (!read_vals(fp, vals, 2)) {
+        return DOCSTORE_EIO;
+    }
+    repos = vals[0];
+    blocks = vals[1];
+    ds->blocks = 0;
+
+    for (i = 0; i < repos; i++) {
+        if (!read_vals(fp, vals, 4)) {
+            return DOCSTORE_EIO;
+        } else if (!repos_reserve(ds, vals[0])) {
+            return DOCSTORE_ENOMEM;
+        }
+        ds->repos[vals[0]].stored = 1;
+        ds->repos[vals[0]].first = vals[1];
+        ds->repos[vals[0]].bytes = vals[2] + (vals[3] << 16 << 16);
+    }
+
+    for (i = 0; i < blocks; i++) {
+        if (!read_vals(fp, vals, 3)) {
+            return DOCSTORE_EIO;
+        } else if (!block_reserve(ds)) {
+            return DOCSTORE_ENOMEM;
+        }
+        ds->block[ds->blocks].fileno = vals[0];
+        ds->block[ds->blocks].offset = vals[1];
+        ds->block[ds->blocks].len = vals[2];
+        ds->blocks++;
+    }
+
+    /* carry on appending after the last block */
+    if (ds->blocks) {
+        last = &ds->block[ds->blocks - 1];
+        ds->fileno = last->fileno;
+        ds->end = last->offset + last->len;
+    }
+    return DOCSTORE_OK;
+}
+
+enum docstore_ret docstore_write(struct docstore *ds, FILE *fp) {
+    unsigned long int vals[4],
+                      j;
+    unsigned int i;
+
+    vals[0] = 0;
+    for (i = 0; i < ds->repos_len; i++) {
+        vals[0] += ds->repos[i].stored;
+    }
+    vals[1] = ds->blocks;
+    if (!write_vals(fp, vals, 2)) {
+        return DOCSTORE_EIO;
+    }
+
+    for (i = 0; i < ds->repos_len; i++) {
+        if (ds->repos[i].stored) {
+            vals[0] = i;
+            vals[1] = ds->repos[i].first;
+            vals[2] = ds->repos[i].bytes & 0xffffffff;
+            vals[3] = (ds->repos[i].bytes >> 16) >> 16;
+            if (!write_vals(fp, vals, 4)) {
+                return DOCSTORE_EIO;
+            }
+        }
+    }
+
+    for (j = 0; j < ds->blocks; j++) {
+        vals[0] = ds->block[j].fileno;
+        vals[1] = ds->block[j].offset;
+        vals[2] = ds->block[j].len;
+        if (!write_vals(fp, vals, 3)) {
+            return DOCSTORE_EIO;
+        }
+    }
+    return DOCSTORE_OK;
+}
+
+/* internal function to compress len bytes of text in buf into cbuf (which
+ * must be compressBound(DOCSTORE_BLOCK) bytes long) and append them to the
+ * store as a new block */
+static enum docstore_ret append(struct docstore *ds, const char *buf,
+  unsigned int len, char *cbuf) {
+    uLongf clen = compressBound(DOCSTORE_BLOCK);
+    const char *data = cbuf;
+    int fd,
+        zret;
+    ssize_t wlen;
+
+    if (!block_reserve(ds)) {
+        return DOCSTORE_ENOMEM;
+    }
+
+    if ((zret = compress2((Bytef *) cbuf, &clen, (const Bytef *) buf, len,
+        Z_BEST_SPEED)) == Z_MEM_ERROR) {
+        return DOCSTORE_ENOMEM;
+    } else if (zret != Z_OK) {
+        return DOCSTORE_ERR;
+    } else if (clen >= len) {
+        /* incompressible, store it as it is */
+        data = buf;
+        clen = len;
+    }
+
+    if (ds->end && (ds->end + clen > ds->max_filesize)) {
+        ds->fileno++;
+        ds->end = 0;
+    }
+    if (((fd = fdset_pin(ds->fd, ds->type, ds->fileno, ds->end, SEEK_SET))
+        < 0)
+      && ((ds->end)
+        || ((fd = fdset_create(ds->fd, ds->type, ds->fileno)) < 0))) {
+        return DOCSTORE_EIO;
+    }
+    wlen = write(fd, data, clen);
+    fdset_unpin(ds->fd, ds->type, ds->fileno, fd);
+    if (wlen != (ssize_t) clen) {
+        return DOCSTORE_EIO;
+    }
+
+    ds->block[ds->blocks].fileno = ds->fileno;
+    ds->block[ds->blocks].offset = ds->end;
+    ds->block[ds->blocks].len = clen;
+    ds->blocks++;
+    ds->end += clen;
+    return DOCSTORE_OK;
+}
+
+enum docstore_ret docstore_add(struct docstore *ds, unsigned int repos,
+  int fd) {
+    struct stream *instream = NULL;
+    struct stream_filter *filter = NULL;
+    char *inbuf,
+         *buf,
+         *cbuf;
+    unsigned int buflen = 0,
+                 len;
+    unsigned long int bytes = 0,
+                      first = ds->blocks,
+                      end = ds->end;
+    unsigned int fileno = ds->fileno;
+    ssize_t readlen;
+    enum stream_ret sret;
+    enum docstore_ret ret = DOCSTORE_OK;
+
+    if (!repos_reserve(ds, repos)
+      || !(inbuf = malloc(INBUF_SIZE + DOCSTORE_BLOCK
+          + compressBound(DOCSTORE_BLOCK)))) {
+        return DOCSTORE_ENOMEM;
+    }
+    buf = inbuf + INBUF_SIZE;
+    cbuf = buf + DOCSTORE_BLOCK;
+
+    /* decompress the file the same way index_parse does, so that offsets in
+     * the docmap refer to the same text */
+    if (!(instream = stream_new())
+      || !(filter = (struct stream_filter *) detectfilter_new(BUFSIZ, 0))) {
+        if (instream) {
+            stream_delete(instream);
+        }
+        free(inbuf);
+        return DOCSTORE_ENOMEM;
+    }
+    stream_filter_push(instream, filter);
+
+    do {
+        switch ((sret = stream(instream))) {
+        case STREAM_OK:
+            while (instream->avail_out && (ret == DOCSTORE_OK)) {
+                len = DOCSTORE_BLOCK - buflen;
+                if (len > instream->avail_out) {
+                    len = instream->avail_out;
+                }
+                memcpy(buf + buflen, instream->curr_out, len);
+                instream->curr_out += len;
+                instream->avail_out -= len;
+                buflen += len;
+                bytes += len;
+                if (buflen == DOCSTORE_BLOCK) {
+                    ret = append(ds, buf, buflen, cbuf);
+                    buflen = 0;
+                }
+            }
+            break;
+
+        case STREAM_END:
+            if (buflen) {
+                ret = append(ds, buf, buflen, cbuf);
+            }
+            break;
+
+        case STREAM_INPUT:
+            instream->next_in = inbuf;
+            if ((readlen = read(fd, inbuf, INBUF_SIZE)) > 0) {
+                instream->avail_in = readlen;
+            } else if (!readlen) {
+                stream_flush(instream, STREAM_FLUSH_FINISH);
+            } else {
+                ret = DOCSTORE_EIO;
+            }
+            break;
+
+        default:
+            ret = DOCSTORE_EINVAL;
+            break;
+        }
+    } while ((sret != STREAM_END) && (ret == DOCSTORE_OK));
+
+    stream_delete(instream);
+    free(inbuf);
+
+    if (ret == DOCSTORE_OK) {
+        ds->repos[repos].stored = 1;
+        ds->repos[repos].first = first;
+        ds->repos[repos].bytes = bytes;
+    } else {
+        /* forget the blocks written, they'll be overwritten */
+        ds->blocks = first;
+        ds->fileno = fileno;
+        ds->end = end;
+    }
+    return ret;
+}
+
+int docstore_contains(const struct docstore *ds, unsigned int repos) {
+    return (repos < ds->repos_len) && ds->repos[repos].stored;
+}
+
+/* internal function to get the uncompressed text of block blockno, which
+ * is len bytes long, from the cache or the store.  *cached is set to true if
+ * the text is pinned in the cache (to be released with cache_release) and
+ * false if it has to be freed with cache_free. */
+static enum docstore_ret block_get(struct docstore *ds,
+  unsigned long int blockno, unsigned int len, const char **text,
+  int *cached) {
+    struct docstore_block *block = &ds->block[blockno];
+    char *buf,
+         *cbuf = NULL,
+         key[sizeof(blockno) * 3 + 1];
+    unsigned int cachelen,
+                 keylen;
+    uLongf outlen = len;
+    enum docstore_ret ret = DOCSTORE_OK;
+    int fd;
+
+    /* cache keys are strings, so the block number is written out in 
+     * decimal */
+    keylen = sprintf(key, "%lu", blockno);
+    if (ds->cache && (*text = cache_find(ds->cache, key, keylen, 
+        &cachelen))) {
+        assert(cachelen == len);
+        *cached = 1;
+        return DOCSTORE_OK;
+    }
+
+    if (!(buf = cache_alloc(len))
+      || ((block->len != len) && !(cbuf = malloc(block->len)))) {
+        if (buf) {
+            cache_free(buf);
+        }
+        return DOCSTORE_ENOMEM;
+    }
+
+    if ((fd = fdset_pin(ds->fd, ds->type, block->fileno, block->offset,
+        SEEK_SET)) < 0) {
+        ret = DOCSTORE_EIO;
+    } else {
+        if (read(fd, cbuf ? cbuf : buf, block->len) != (ssize_t) block->len) {
+            ret = DOCSTORE_EIO;
+        } else if (cbuf && ((uncompress((Bytef *) buf, &outlen,
+              (Bytef *) cbuf, block->len) != Z_OK)
+            || (outlen != len))) {
+            ret = DOCSTORE_EINVAL;
+        }
+        fdset_unpin(ds->fd, ds->type, block->fileno, fd);
+    }
+    if (cbuf) {
+        free(cbuf);
+    }
+
+    if (ret != DOCSTORE_OK) {
+        cache_free(buf);
+        return ret;
+    }
+    *text = buf;
+    *cached = ds->cache 
+      && (cache_insert(ds->cache, key, keylen, buf, 1) == CACHE_OK);
+    return DOCSTORE_OK;
+}
+
+enum docstore_ret docstore_retrieve(struct docstore *ds, unsigned int repos,
+  unsigned long int offset, void *dst, unsigned int len,
+  unsigned int *copied) {
+    struct docstore_repos *rep;
+    unsigned long int start;
+    unsigned int within,
+                 blocklen,
+                 n;
+    const char *text;
+    char *cdst = dst;
+    int cached;
+    enum docstore_ret ret;
+
+    if (!docstore_contains(ds, repos)) {
+        return DOCSTORE_ENOENT;
+    }
+    rep = &ds->repos[repos];
+
+    *copied = 0;
+    if (offset >= rep->bytes) {
+        return DOCSTORE_OK;
+    } else if (len > rep->bytes - offset) {
+        len = rep->bytes - offset;
+    }
+
+    while (len) {
+        within = offset % DOCSTORE_BLOCK;
+        start = offset - within;
+        blocklen = DOCSTORE_BLOCK;
+        if (blocklen > rep->bytes - start) {
+            blocklen = rep->bytes - start;
+        }
+        if ((ret = block_get(ds, rep->first + start / DOCSTORE_BLOCK,
+            blocklen, &text, &cached)) != DOCSTORE_OK) {
+            return ret;
+        }
+
+        n = blocklen - within;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(cdst, text + within, n);
+        if (cached) {
+            cache_release(ds->cache, text);
+        } else {
+            cache_free((void *) text);
+        }
+
+        cdst += n;
+        offset += n;
+        len -= n;
+        *copied += n;
+    }
+    return DOCSTORE_OK;
+}
+
+void docstore_cache_stats(struct docstore *ds, unsigned long int *size,
+  unsigned long int *lookups, unsigned long int *hits) {
+    if (ds->cache) {
+        *size = cache_size(ds->cache);
+        cache_stats(ds->cache, lookups, hits);
+    } else {
+        *size = *lookups = *hits = 0;
+    }
+}
+
@@ -26,12 +26,32 @@
 #include <string.h>
 #include <stdio.h>
 
-/* Make multi-thread safe.  Note: only the fdset_pin and fdset_unpin
-   functions obey this. */
+/* Make multi-thread safe.  Everything that looks up or changes the types,
+   names or open fds of the set holds the mutex (the internal _locked 
+   functions expect it to be held already), so that files can be created and
+   removed while other threads are reading through the set. */
 #ifdef MT_ZET
 #include <pthread.h>
+
+#define FDSET_LOCK(set) pthread_mutex_lock(&(set)->mutex)
+#define FDSET_UNLOCK(set) pthread_mutex_unlock(&(set)->mutex)
+#else
+#define FDSET_LOCK(set)
+#define FDSET_UNLOCK(set)
 #endif /* MT_ZET */
 
+/* read-only files can be memory-mapped where the OS supports it */
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define FDSET_MMAP
+#include <sys/mman.h>
+#endif
+
+/* struct to represent a memory-mapped file */
+struct mapping {
+    const char *addr;                     /* start of mapping (or NULL) */
+    unsigned long int len;                /* length of mapping */
+};
+
 /* struct to represent a specific filename for a given type, fileno pair */
 struct specific {
     const char *filename;                 /* name of specific file */
@@ -44,6 +64,9 @@ struct type {
                                            * %u printf conversion) */
     int write;                            /* whether to enable writing */
     struct chash *specific;               /* hashtable of specific entries */
+    enum fdset_map map;                   /* whether to map files */
+    struct mapping *mapping;              /* mapped files, by fileno */
+    unsigned int mappings;                /* size of mapping array */
 };
 
 /* struct to represent an open file descriptor */
@@ -202,8 +225,26 @@ static void specific_delete(void *userdata, unsigned long int key,
     free(sp);
 }
 
+/* internal function to remove the mapping of a file, if it has one */
+static void unmap(struct type *type, unsigned int fileno) {
+    if ((fileno < type->mappings) && type->mapping[fileno].addr) {
+#ifdef FDSET_MMAP
+        munmap((void *) type->mapping[fileno].addr, 
+          type->mapping[fileno].len);
+#endif /* FDSET_MMAP */
+        type->mapping[fileno].addr = NULL;
+        type->mapping[fileno].len = 0;
+    }
+}
+
 static void type_delete(void *userdata, unsigned long int key, void **data) {
     struct type *type = *data;
+    unsigned int i;
+
+    for (i = 0; i < type->mappings; i++) {
+        unmap(type, i);
+    }
+    free(type->mapping);
     chash_luint_ptr_foreach(type->specific, NULL, specific_delete);
     chash_delete(type->specific);
     free((void *) type->template);
@@ -328,7 +369,7 @@ static unsigned int untemplate(char *dst, unsigned int dstlen,
     return 0;
 }
 
-int fdset_set_type_name(struct fdset *set, unsigned int typeno, 
+static int fdset_set_type_name_locked(struct fdset *set, unsigned int typeno, 
   const char *name, unsigned int namelen, int write) {
     char buf[FILENAME_MAX * 2 + 1];
     void **find;
@@ -354,6 +395,9 @@ int fdset_set_type_name(struct fdset *set, unsigned int typeno,
             return -EINVAL;
         }
 
+        type->map = FDSET_MAP_NONE;
+        type->mapping = NULL;
+        type->mappings = 0;
         if ((type->template = str_dup(buf))) {
             type->write = !!write;
             return FDSET_OK;
@@ -370,6 +414,16 @@ int fdset_set_type_name(struct fdset *set, unsigned int typeno,
     return -EINVAL;
 }
 
+int fdset_set_type_name(struct fdset *set, unsigned int typeno, 
+  const char *name, unsigned int namelen, int write) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval = fdset_set_type_name_locked(set, typeno, name, namelen, write);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
 int fdset_create_new_type(struct fdset *set, const char *basename,
   const char *suffix, int write, unsigned int *typeno) {
     char name_buf[FILENAME_MAX + 1];
@@ -381,11 +435,16 @@ int fdset_create_new_type(struct fdset *set, const char *basename,
     else if (ret < 0)
         return -errno;
 
+    /* the type has to be numbered and named in one go, so that types created
+     * at the same time get different numbers */
+    FDSET_LOCK(set);
     *typeno = fdset_types(set);
-    return fdset_set_type_name(set, *typeno, name_buf, ret, write);
+    ret = fdset_set_type_name_locked(set, *typeno, name_buf, ret, write);
+    FDSET_UNLOCK(set);
+    return ret;
 }
 
-int fdset_set_fd_name(struct fdset *set, unsigned int typeno, 
+static int fdset_set_fd_name_locked(struct fdset *set, unsigned int typeno, 
   unsigned int fileno, const char *name, unsigned int namelen, 
   int write) {
     struct type *type;
@@ -431,6 +490,18 @@ int fdset_set_fd_name(struct fdset *set, unsigned int typeno,
     return -ENOENT;
 }
 
+int fdset_set_fd_name(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno, const char *name, unsigned int namelen, 
+  int write) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval 
+      = fdset_set_fd_name_locked(set, typeno, fileno, name, namelen, write);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
 static int fdset_ensure_fd_array_space(struct fdset *set) {
     if (set->fds >= set->fdsize) {
         int retval = expand_fd_array(&set->fd, &set->fdsize);
@@ -448,6 +519,11 @@ static int fdset_ensure_fd_array_space(struct fdset *set) {
     return 0;
 }
 
+static int fdset_close_locked(struct fdset *set);
+static int fdset_name_locked(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno, char *buf, unsigned int buflen, unsigned int *len, 
+  int *write);
+
 /* Insert a fd into our fdhash. */
 static int fdset_insert_fd(struct fdset *set, unsigned int typeno,
   unsigned int fileno, int fd) {
@@ -480,7 +556,8 @@ static int fdset_insert_fd(struct fdset *set, unsigned int typeno,
     return FDSET_OK;
 }
 
-int fdset_create(struct fdset *set, unsigned int typeno, unsigned int fileno) {
+static int fdset_create_locked(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno) {
     char filename[FILENAME_MAX + 1];
     int retval;
     unsigned int namelen = 0;
@@ -488,8 +565,8 @@ int fdset_create(struct fdset *set, unsigned int typeno, unsigned int fileno) {
     int fd;
     int flags;
 
-    if ((retval = fdset_name(set, typeno, fileno, filename, FILENAME_MAX, 
-        &namelen, &write)) != FDSET_OK) {
+    if ((retval = fdset_name_locked(set, typeno, fileno, filename, 
+        FILENAME_MAX, &namelen, &write)) != FDSET_OK) {
 
         return retval;
     }
@@ -498,7 +575,7 @@ int fdset_create(struct fdset *set, unsigned int typeno, unsigned int fileno) {
 
     /* make sure we're not over the limit */ 
     if (set->fds >= set->limit) {
-        if ((retval = fdset_close(set)) != FDSET_OK) {
+        if ((retval = fdset_close_locked(set)) != FDSET_OK) {
             return retval;
         }
     }
@@ -507,7 +584,7 @@ int fdset_create(struct fdset *set, unsigned int typeno, unsigned int fileno) {
     if ((fd = open((const char *) filename, flags, set->umask)) < 0) {
         if (errno == EMFILE || errno == ENFILE) {
             errno = 0;
-            if ((retval = fdset_close(set)) != FDSET_OK) {
+            if ((retval = fdset_close_locked(set)) != FDSET_OK) {
                 return retval;
             }
             if ((fd = open((const char *) filename, flags, set->umask)) < 0) {
@@ -530,6 +607,15 @@ int fdset_create(struct fdset *set, unsigned int typeno, unsigned int fileno) {
     return fd;
 }
 
+int fdset_create(struct fdset *set, unsigned int typeno, unsigned int fileno) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval = fdset_create_locked(set, typeno, fileno);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
 int fdset_debug_create(struct fdset *set, unsigned int typeno, 
   unsigned int fileno, const char * src_file, int src_line) {
     int retval;
@@ -660,7 +746,7 @@ static int fdset_pin_locked(struct fdset *set, unsigned int typeno,
                 return -ENOMEM;
             } else if (((set->fds >= set->limit) 
                 || (errno == EMFILE) || (errno == ENFILE))
-              && (fdset_close(set) == FDSET_OK)) {
+              && (fdset_close_locked(set) == FDSET_OK)) {
                 /* having closed a file, try again */
                 void **find = NULL;
 
@@ -716,13 +802,10 @@ static int fdset_pin_locked(struct fdset *set, unsigned int typeno,
 int fdset_pin(struct fdset *set, unsigned int typeno, unsigned int fileno,
   off_t offset, int whence) {
     int retval = 0;
-#ifdef MT_ZET
-    pthread_mutex_lock(&set->mutex);
-#endif /* MT_ZET */
+
+    FDSET_LOCK(set);
     retval = fdset_pin_locked(set, typeno, fileno, offset, whence);
-#ifdef MT_ZET
-    pthread_mutex_unlock(&set->mutex);
-#endif /* MT_ZET */
+    FDSET_UNLOCK(set);
     return retval;
 }
 
@@ -737,8 +820,9 @@ int fdset_debug_pin(struct fdset *set, unsigned int typeno,
     return retval;
 }
 
-int fdset_name(struct fdset *set, unsigned int typeno, unsigned int fileno, 
-  char *buf, unsigned int buflen, unsigned int *len, int *write) {
+static int fdset_name_locked(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno, char *buf, unsigned int buflen, unsigned int *len, 
+  int *write) {
     void **find;
     struct type *type;
     struct specific *sp;
@@ -761,21 +845,33 @@ int fdset_name(struct fdset *set, unsigned int typeno, unsigned int fileno,
     }
 }
 
+int fdset_name(struct fdset *set, unsigned int typeno, unsigned int fileno, 
+  char *buf, unsigned int buflen, unsigned int *len, int *write) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval = fdset_name_locked(set, typeno, fileno, buf, buflen, len, write);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
 int fdset_type_name(struct fdset *set, unsigned int typeno, 
   char *buf, unsigned int buflen, unsigned int *len, int *write) {
     void **find;
     struct type *type;
+    int retval = -ENOENT;
 
     /* lookup name in hash tables */
+    FDSET_LOCK(set);
     if (chash_luint_ptr_find(set->typehash, typeno, &find) == CHASH_OK) {
         type = *find;
         *write = type->write;
         *len 
           = untemplate(buf, buflen, type->template, str_len(type->template));
-        return FDSET_OK;
-    } else {
-        return -ENOENT;
+        retval = FDSET_OK;
     }
+    FDSET_UNLOCK(set);
+    return retval;
 }
 
 static int fdset_unpin_locked(struct fdset *set, unsigned int typeno, 
@@ -805,13 +901,10 @@ static int fdset_unpin_locked(struct fdset *set, unsigned int typeno,
 int fdset_unpin(struct fdset *set, unsigned int typeno, unsigned int fileno, 
   int fd) {
     int retval = 0;
-#ifdef MT_ZET
-    pthread_mutex_lock(&set->mutex);
-#endif /* MT_ZET */
+
+    FDSET_LOCK(set);
     retval = fdset_unpin_locked(set, typeno, fileno, fd);
-#ifdef MT_ZET
-    pthread_mutex_unlock(&set->mutex);
-#endif /* MT_ZET */
+    FDSET_UNLOCK(set);
     return retval;
 }
 
@@ -871,7 +964,7 @@ static int fdset_fd_close(struct fdset *set, int index) {
     return FDSET_OK;
 }
 
-int fdset_close(struct fdset *set) {
+static int fdset_close_locked(struct fdset *set) {
     int changed;
     unsigned int i;
 
@@ -920,6 +1013,15 @@ int fdset_close(struct fdset *set) {
     return -ENOENT;
 }
 
+int fdset_close(struct fdset *set) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval = fdset_close_locked(set);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
 unsigned int fdset_opened(struct fdset *set) {
     return set->fds;
 }
@@ -942,8 +1044,10 @@ int fdset_isset(struct fdset *set, unsigned int typeno, unsigned int fileno,
     void **find;
     struct type *type;
     struct specific *sp;
+    int retval = -EINVAL;
 
     /* lookup name in hash tables */
+    FDSET_LOCK(set);
     if (chash_luint_ptr_find(set->typehash, typeno, &find) == CHASH_OK) {
         type = *find;
         if ((chash_luint_ptr_find(type->specific, fileno, &find) == CHASH_OK)
@@ -952,17 +1056,17 @@ int fdset_isset(struct fdset *set, unsigned int typeno, unsigned int fileno,
         } else {
             *isset = 0;
         }
-        return FDSET_OK;
+        retval = FDSET_OK;
     }
-
-    return -EINVAL;
+    FDSET_UNLOCK(set);
+    return retval;
 }
 
 unsigned int fdset_types(struct fdset *set) {
     return chash_size(set->typehash);
 }
 
-int fdset_close_file(struct fdset *set, unsigned int typeno, 
+static int fdset_close_file_locked(struct fdset *set, unsigned int typeno, 
   unsigned int fileno) {
     struct fd key,
               *found;
@@ -992,10 +1096,25 @@ int fdset_close_file(struct fdset *set, unsigned int typeno,
             }
         }
     }
+
+    if (chash_luint_ptr_find(set->typehash, typeno, &find) == CHASH_OK) {
+        unmap(*find, fileno);
+    }
     return FDSET_OK;
 }
 
-int fdset_unlink(struct fdset *set, unsigned int typeno, unsigned int fileno) {
+int fdset_close_file(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval = fdset_close_file_locked(set, typeno, fileno);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
+static int fdset_unlink_locked(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno) {
     char buf[FILENAME_MAX + 1];
     void **find;
     struct specific *sp;
@@ -1003,7 +1122,7 @@ int fdset_unlink(struct fdset *set, unsigned int typeno, unsigned int fileno) {
     unsigned int len;
     int ret;
 
-    ret = fdset_close_file(set, typeno, fileno);
+    ret = fdset_close_file_locked(set, typeno, fileno);
     if (ret < 0)
         return ret;
 
@@ -1040,6 +1159,161 @@ int fdset_unlink(struct fdset *set, unsigned int typeno, unsigned int fileno) {
     }
 }
 
+int fdset_unlink(struct fdset *set, unsigned int typeno, unsigned int fileno) {
+    int retval;
+
+    FDSET_LOCK(set);
+    retval = fdset_unlink_locked(set, typeno, fileno);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
+int fdset_set_type_map(struct fdset *set, unsigned int typeno, 
+  enum fdset_map map) {
+    void **find;
+    struct type *type;
+    int retval = -ENOENT;
+
+#ifndef FDSET_MMAP
+    if (map != FDSET_MAP_NONE) {
+        return -ENOSYS;
+    }
+#endif /* FDSET_MMAP */
+
+    FDSET_LOCK(set);
+    if (chash_luint_ptr_find(set->typehash, typeno, &find) == CHASH_OK) {
+        type = *find;
+        type->map = map;
+        retval = FDSET_OK;
+    }
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
+static int fdset_map_locked(struct fdset *set, unsigned int typeno, 
+  unsigned int fileno, const char **addr, unsigned long int *len) {
+#ifdef FDSET_MMAP
+    void **find;
+    struct type *type;
+    struct stat st;
+    void *ptr;
+    int fd,
+        ret;
+
+    if (chash_luint_ptr_find(set->typehash, typeno, &find) != CHASH_OK) {
+        return -ENOENT;
+    }
+    type = *find;
+
+    if ((fileno < type->mappings) && type->mapping[fileno].addr) {
+        /* already mapped */
+        *addr = type->mapping[fileno].addr;
+        *len = type->mapping[fileno].len;
+        return FDSET_OK;
+    } else if (type->map == FDSET_MAP_NONE) {
+        return -EINVAL;
+    }
+
+    if (fileno >= type->mappings) {
+        unsigned int size = type->mappings * 2 + 1,
+                     i;
+
+        while (size <= fileno) {
+            size = size * 2 + 1;
+        }
+        if (!(ptr = realloc(type->mapping, sizeof(*type->mapping) * size))) {
+            return -ENOMEM;
+        }
+        type->mapping = ptr;
+        for (i = type->mappings; i < size; i++) {
+            type->mapping[i].addr = NULL;
+            type->mapping[i].len = 0;
+        }
+        type->mappings = size;
+    }
+
+    /* the mapping outlives the fd, so we don't need to keep it pinned */
+    if ((fd = fdset_pin_locked(set, typeno, fileno, 0, SEEK_CUR)) < 0) {
+        return fd;
+    }
+    if (fstat(fd, &st)) {
+        ret = -errno;
+    } else if (!st.st_size
+      || ((off_t) (unsigned long int) st.st_size != st.st_size)) {
+        /* can't map empty files, or files larger than we can address */
+        ret = -EINVAL;
+    } else if ((ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) 
+      == MAP_FAILED) {
+        ret = -errno;
+    } else {
+#ifdef HAVE_MADVISE
+        if (type->map == FDSET_MAP_RANDOM) {
+            /* readahead would only waste memory */
+            madvise(ptr, st.st_size, MADV_RANDOM);
+        }
+#endif /* HAVE_MADVISE */
+        type->mapping[fileno].addr = ptr;
+        type->mapping[fileno].len = st.st_size;
+        *addr = ptr;
+        *len = st.st_size;
+        ret = FDSET_OK;
+    }
+    fdset_unpin_locked(set, typeno, fileno, fd);
+    return ret;
+#else
+    return -ENOSYS;
+#endif /* FDSET_MMAP */
+}
+
+int fdset_map(struct fdset *set, unsigned int typeno, unsigned int fileno, 
+  const char **addr, unsigned long int *len) {
+    int retval = 0;
+
+    FDSET_LOCK(set);
+    retval = fdset_map_locked(set, typeno, fileno, addr, len);
+    FDSET_UNLOCK(set);
+    return retval;
+}
+
+void fdset_map_willneed(const void *addr, unsigned long int len) {
+#if defined(FDSET_MMAP) && defined(HAVE_MADVISE)
+    /* madvise wants a page-aligned address */
+    unsigned long int pagesize = sysconf(_SC_PAGESIZE),
+                      start = (unsigned long int) addr & ~(pagesize - 1);
+
+    madvise((void *) start, (unsigned long int) addr + len - start, 
+      MADV_WILLNEED);
+#endif
+}
+
+int fdset_willneed(struct fdset *set, unsigned int type, unsigned int fileno,
+  unsigned long int offset, unsigned long int len) {
+    const char *addr;
+    unsigned long int maplen;
+
+    if ((fdset_map(set, type, fileno, &addr, &maplen) == FDSET_OK)
+      && (offset + len <= maplen)) {
+        fdset_map_willneed(addr + offset, len);
+        return FDSET_OK;
+    }
+
+#ifdef HAVE_POSIX_FADVISE
+    {
+        int fd;
+
+        if ((fd = fdset_pin(set, type, fileno, 0, SEEK_CUR)) < 0) {
+            return fd;
+        }
+        /* POSIX_FADV_WILLNEED starts reading the range in and returns 
+         * without waiting for it.  Failure just means no advice was taken. */
+        posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+        return fdset_unpin(set, type, fileno, fd);
+    }
+#else
+    return FDSET_OK;
+#endif
+}
+
 /* debugging function to return the name of a repository.  DONT USE THIS FOR
  * ANYTHING SERIOUS (uses static buffer) */
 const char *fdset_debug_name(struct fdset *set, int typeno, 
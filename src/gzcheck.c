@@ -0,0 +1,159 @@
+/* gzcheck.c implements the gzip checkpoints declared in gzcheck.h.
+ *
+ * The scan uses zlib's Z_BLOCK flush to stop at the end of each deflate
+ * block, and takes the window from zlib's own history using
+ * inflateGetDictionary, in the manner of the zran example that comes with
+ * zlib.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "gzcheck.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* size of the buffer compressed data is read into */
+#define INBUF_SIZE 65536
+
+enum gzcheck_ret gzcheck_scan(int fd, unsigned long int span,
+  enum gzcheck_ret (*fn)(void *opaque, const struct gzcheck_point *point),
+  void *opaque) {
+    z_stream zstate;
+    struct gzcheck_point *point;
+    unsigned char *inbuf,
+                  *outbuf,
+                  last = 0;            /* last byte of the previous input */
+    unsigned long int in = 0,          /* compressed bytes consumed */
+                      out = 0,         /* uncompressed bytes produced */
+                      prev = 0;        /* offset of previous checkpoint */
+    ssize_t readlen;
+    int zret;
+    enum gzcheck_ret ret = GZCHECK_OK;
+
+    if (!(point = malloc(sizeof(*point) + INBUF_SIZE + GZCHECK_WINDOW))) {
+        return GZCHECK_ENOMEM;
+    }
+    inbuf = (unsigned char *) (point + 1);
+    outbuf = inbuf + INBUF_SIZE;
+
+    zstate.zalloc = Z_NULL;
+    zstate.zfree = Z_NULL;
+    zstate.opaque = NULL;
+    zstate.next_in = inbuf;
+    zstate.avail_in = 0;
+    /* windowbits + 16 accepts only the gzip format */
+    if (inflateInit2(&zstate, MAX_WBITS + 16) != Z_OK) {
+        free(point);
+        return GZCHECK_ENOMEM;
+    }
+
+    do {
+        if (!zstate.avail_in) {
+            if (zstate.next_in != inbuf) {
+                last = zstate.next_in[-1];
+            }
+            if ((readlen = read(fd, inbuf, INBUF_SIZE)) > 0) {
+                zstate.next_in = inbuf;
+                zstate.avail_in = readlen;
+            } else {
+                /* file ended before the compressed data did */
+                ret = readlen ? GZCHECK_EIO : GZCHECK_EINVAL;
+                break;
+            }
+        }
+        /* uncompressed data is only needed for the window, which zlib keeps
+         * for us, so just keep overwriting the same buffer */
+        zstate.next_out = outbuf;
+        zstate.avail_out = GZCHECK_WINDOW;
+
+        in += zstate.avail_in;
+        out += zstate.avail_out;
+        zret = inflate(&zstate, Z_BLOCK);
+        in -= zstate.avail_in;
+        out -= zstate.avail_out;
+
+        if (zret == Z_STREAM_END) {
+            break;
+        } else if (zret != Z_OK && zret != Z_BUF_ERROR) {
+            ret = (zret == Z_MEM_ERROR) ? GZCHECK_ENOMEM : GZCHECK_EINVAL;
+            break;
+        }
+
+        /* data_type has bit 7 set at the end of a block, and bit 6 set if
+         * that block was the last one */
+        if ((zstate.data_type & 128) && !(zstate.data_type & 64)
+          && out - prev >= span) {
+            point->offset = out;
+            point->in_offset = in;
+            point->bits = zstate.data_type & 7;
+            if (point->bits) {
+                point->prime = (zstate.next_in != inbuf)
+                  ? zstate.next_in[-1] : last;
+                point->prime >>= 8 - point->bits;
+            } else {
+                point->prime = 0;
+            }
+            point->windowlen = GZCHECK_WINDOW;
+            if (inflateGetDictionary(&zstate, point->window,
+                &point->windowlen) != Z_OK) {
+                ret = GZCHECK_ERR;
+                break;
+            }
+            if ((ret = fn(opaque, point)) != GZCHECK_OK) {
+                break;
+            }
+            prev = out;
+        }
+    } while (1);
+
+    inflateEnd(&zstate);
+    free(point);
+    return ret;
+}
+
+enum gzcheck_ret gzcheck_window_write(int fd,
+  const struct gzcheck_point *point, unsigned int *len) {
+    uLongf buflen = compressBound(point->windowlen);
+    unsigned char *buf;
+    enum gzcheck_ret ret = GZCHECK_OK;
+
+    if (!(buf = malloc(buflen))) {
+        return GZCHECK_ENOMEM;
+    }
+
+    if (compress2(buf, &buflen, point->window, point->windowlen,
+        Z_BEST_SPEED) != Z_OK) {
+        ret = GZCHECK_ERR;
+    } else if (write(fd, buf, buflen) != (ssize_t) buflen) {
+        ret = GZCHECK_EIO;
+    } else {
+        *len = buflen;
+    }
+    free(buf);
+    return ret;
+}
+
+enum gzcheck_ret gzcheck_window_read(int fd, unsigned int len,
+  void *window, unsigned int *windowlen) {
+    uLongf outlen = GZCHECK_WINDOW;
+    unsigned char *buf;
+    enum gzcheck_ret ret = GZCHECK_OK;
+
+    if (!(buf = malloc(len))) {
+        return GZCHECK_ENOMEM;
+    }
+
+    if (read(fd, buf, len) != (ssize_t) len) {
+        ret = GZCHECK_EIO;
+    } else if (uncompress(window, &outlen, buf, len) != Z_OK) {
+        ret = GZCHECK_EINVAL;
+    } else {
+        *windowlen = outlen;
+    }
+    free(buf);
+    return ret;
+}
+
@@ -11,13 +11,16 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "chash.h"
 #include "def.h"
+#include "denseacc.h"
 #include "error.h"
 #include "heap.h"
 #include "impact_build.h"
 #include "impact.h"
+#include "impactcodec.h"
 #include "index.h"
 #include "_index.h"
 #include "search.h"
@@ -25,28 +28,13 @@
 #include "vocab.h"
 #include "index_querybuild.h"
 
-struct disksrc {
-    struct search_list_src src;      /* parent source structure */
-    struct alloc alloc;              /* buffer allocation object */
-    char *buf;                       /* available buffer */
-    unsigned int bufsize;            /* size of stuff in buffer */
-    unsigned int bufcap;             /* capacity of buffer */
-    unsigned long int bufpos;        /* position buffer was read from */
-    unsigned int size;               /* size of the list */
-    unsigned int pos;                /* position in list */
-
-    struct index *idx;               /* index we're using */
-    int fd;                          /* pinned fd */
-    unsigned int type;               /* the type of the fd */
-    unsigned int fileno;             /* the file number of the fd */
-    unsigned long int offset;        /* starting offset of the list */
-};
-
 struct term_data {
     unsigned int impact;                /* current impact */
     unsigned int w_qt;                  /* term weight */
     unsigned int blocksize;             /* number of docs remaining in block */
     unsigned long int docno;            /* current docno */
+    int packed;                         /* whether docnos are bit-packed
+                                         * (VOCAB_VTYPE_IMPACT_BLOCK) */
     struct vec v;                       /* vector of in-memory data */
     struct search_list_src *src;        /* list src */
 };
@@ -116,6 +104,126 @@ static void impact_decode_block_and(struct chash *accs, struct term_data *term,
     }
 }
 
+/* decode a block and add contributions into array accumulators */
+static void impact_decode_block_dense(struct denseacc *accs, 
+  struct term_data *term, unsigned int blockfine) {
+    unsigned int contrib = term->impact - blockfine;
+    unsigned long int docno_d;
+
+    assert(contrib);
+    while (term->blocksize && vec_vbyte_read(&term->v, &docno_d)) {
+        term->docno += docno_d + 1;
+        assert(term->docno < accs->docs);
+
+        DENSEACC_TOUCH(accs, term->docno);
+        if (!accs->acc[term->docno]) {
+            accs->size++;
+        }
+        accs->acc[term->docno] += contrib;
+
+        term->blocksize--;
+    }
+}
+
+/* decode a block and add contributions into array accumulators, but don't 
+ * create new accumulators */
+static void impact_decode_block_and_dense(struct denseacc *accs, 
+  struct term_data *term, unsigned int blockfine) {
+    unsigned int contrib = term->impact - blockfine;
+    unsigned long int docno_d;
+
+    while (term->blocksize && vec_vbyte_read(&term->v, &docno_d)) {
+        term->docno += docno_d + 1;
+        assert(term->docno < accs->docs);
+
+        if (DENSEACC_GET(accs, term->docno)) {
+            accs->acc[term->docno] += contrib;
+        }
+        term->blocksize--;
+    }
+}
+
+/* decode the chunks of a block of bit-packed document numbers that have been
+ * read in, and add contributions into the accumulators, which are either
+ * array accumulators dense, or hashed accumulators hash if dense is NULL.
+ * New accumulators are created unless and is true.  Each chunk is decoded in
+ * one go, leaving the adds to accumulators in a tight loop of their own (an
+ * array add for array accumulators). */
+static void impact_decode_block_packed(struct chash *hash, 
+  struct denseacc *dense, int and, struct term_data *term, 
+  unsigned int blockfine) {
+    unsigned int contrib = term->impact - blockfine,
+                 i,
+                 n;
+    uint32_t docno[IMPACTCODEC_CHUNK];
+
+    assert(contrib);
+    while (term->blocksize 
+      && (n = impactcodec_read(&term->v, 
+          term->blocksize < IMPACTCODEC_CHUNK 
+            ? term->blocksize : IMPACTCODEC_CHUNK, 
+          &term->docno, docno))) {
+        term->blocksize -= n;
+
+        if (dense && !and) {
+            for (i = 0; i < n; i++) {
+                assert(docno[i] < dense->docs);
+                DENSEACC_TOUCH(dense, docno[i]);
+                if (!dense->acc[docno[i]]) {
+                    dense->size++;
+                }
+                dense->acc[docno[i]] += contrib;
+            }
+        } else if (dense) {
+            for (i = 0; i < n; i++) {
+                assert(docno[i] < dense->docs);
+                if (DENSEACC_GET(dense, docno[i])) {
+                    dense->acc[docno[i]] += contrib;
+                }
+            }
+        } else if (!and) {
+            for (i = 0; i < n; i++) {
+                unsigned long int *fw;
+                int found,
+                    ret;
+
+                /* should never fail */
+                ret = chash_luint_luint_find_insert(hash, docno[i], &fw, 0, 
+                    &found);
+                assert(ret == CHASH_OK);
+                *fw += contrib;
+            }
+        } else {
+            for (i = 0; i < n; i++) {
+                unsigned long int *fw;
+
+                if (chash_luint_luint_find(hash, docno[i], &fw) == CHASH_OK) {
+                    *fw += contrib;
+                }
+            }
+        }
+    }
+}
+
+/* internal function to indicate whether the budget of an anytime evaluation
+ * that started at then has been spent, after processing postings postings */
+static int budget_spent(struct index_search_opt *opt, 
+  unsigned long int postings, struct timeval *then) {
+    struct timeval now;
+
+    if (opt->budget_postings && (postings >= opt->budget_postings)) {
+        return 1;
+    }
+    if (opt->budget_usec) {
+        gettimeofday(&now, NULL);
+        if ((unsigned long int) (now.tv_sec - then->tv_sec) * 1000000 
+            + now.tv_usec - then->tv_usec >= opt->budget_usec) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static void source_delete(struct term_data *term, unsigned int terms) {
     unsigned int i;
 
@@ -128,8 +236,11 @@ static void source_delete(struct term_data *term, unsigned int terms) {
 }
 
 enum search_ret impact_ord_eval(struct index *idx, struct query *query, 
-  struct chash *accumulators, unsigned int acc_limit, struct alloc *alloc, 
-  unsigned int mem) {
+  struct chash *accumulators, struct denseacc *dense, unsigned int acc_limit, 
+  struct alloc *alloc, unsigned int mem, int opts, 
+  struct index_search_opt *opt, int *exact) {
+    struct timeval then;
+    int anytime = (opts & INDEX_SEARCH_ANYTIME);
     double norm_B;
     unsigned int i,
                  terms = 0,
@@ -137,11 +248,14 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
                  blocks_read,
                  postings_read = 0,
                  postings = 0,
-                 bytes = 0,
-                 bytes_read = 0;
+                 bytes = 0;
     struct term_data *term,
                      *largest;
-    struct disksrc *dsrc;
+
+    gettimeofday(&then, NULL);
+    /* only anytime evaluation can be exact, as it doesn't apply the term and
+     * block fines */
+    *exact = anytime;
 
     if (query->terms == 0) {
         /* no terms to process */
@@ -177,7 +291,7 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
             idx->impact_stats.w_qt_min);
 
         /* apply term fine to term impact */
-        termfine = (i < 2) ? 0 : i - 2;
+        termfine = (i < 2 || anytime) ? 0 : i - 2;
         if (termfine < term[i].w_qt) {
             term[i].w_qt -= termfine;
             /* initialise to highest impact, so we'll select and initialise this
@@ -190,6 +304,8 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
             term[i].impact = 0;
         }
         term[i].blocksize = 0;
+        term[i].packed 
+          = (query->term[i].term.vocab.type == VOCAB_VTYPE_IMPACT_BLOCK);
 
         /* XXX */
         postings += query->term[i].f_t;
@@ -221,9 +337,41 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
     do {
         largest = heap_pop(term, &terms, sizeof(*term), term_data_cmp);
 
+        if (anytime && largest && largest->blocksize 
+          && budget_spent(opt, postings_read, &then)) {
+            /* out of budget, leave the remaining blocks unprocessed */
+            *exact = 0;
+            break;
+        }
+
         if (largest && (largest->impact > blockfine)) {
             postings_read += largest->blocksize;
-            if (chash_size(accumulators) < acc_limit) {
+            if (largest->packed) {
+                int and = dense ? (dense->size >= acc_limit) 
+                  : (chash_size(accumulators) >= acc_limit);
+
+                /* reserve enough memory for hashed accumulators */
+                if (!dense && !and 
+                  && (chash_reserve(accumulators, largest->blocksize) 
+                    < largest->blocksize)) {
+                    assert(!CRASH); ERROR("impact_ord_eval()");
+                    source_delete(term, terms);
+                    free(term);
+                    return SEARCH_EINVAL;
+                }
+                impact_decode_block_packed(accumulators, dense, and, largest, 
+                  blockfine);
+                if (and) {
+                    *exact = 0;
+                }
+            } else if (dense) {
+                if (dense->size < acc_limit) {
+                    impact_decode_block_dense(dense, largest, blockfine);
+                } else {
+                    impact_decode_block_and_dense(dense, largest, blockfine);
+                    *exact = 0;
+                }
+            } else if (chash_size(accumulators) < acc_limit) {
                 /* reserve enough memory for accumulators and decode */
                 if (chash_reserve(accumulators, largest->blocksize) 
                   >= largest->blocksize) {
@@ -236,10 +384,13 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
                 }
             } else {
                 impact_decode_block_and(accumulators, largest, blockfine);
+                *exact = 0;
             }
 
-            if (VEC_LEN(&largest->v) < 2 * VEC_VBYTE_MAX) {
-                /* need to read more data */
+            if (VEC_LEN(&largest->v) < 2 * VEC_VBYTE_MAX 
+                + (largest->packed ? IMPACTCODEC_MAX_BYTES : 0)) {
+                /* need to read more data (bit-packed chunks can only be
+                 * decoded once they've been read in whole) */
                 unsigned int bytes;
                 enum search_ret sret;
 
@@ -277,7 +428,7 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
                     || ((largest->v.pos -= vec_vbyte_len(tmp_bsize)), 0))) {
 
                     blocks_read++;
-                    if (blocks_read > terms) {
+                    if (blocks_read > terms && !anytime) {
                         blockfine++;
                     }
 
@@ -288,7 +439,6 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
                       largest);
                 } else if (!VEC_LEN(&largest->v)) {
                     /* finished, don't put back on the heap */
-                    dsrc = (void *) largest->src; bytes_read += dsrc->pos;
                     largest->src->delet(largest->src);
                     largest->src = NULL;
                 } else if (largest->impact != INT_MAX) {
@@ -312,10 +462,6 @@ enum search_ret impact_ord_eval(struct index *idx, struct query *query,
         }
     } while (largest && (largest->impact > blockfine));
 
-    for (i = 0; i < terms; i++) {
-        dsrc = (void *) term[i].src; bytes_read += dsrc->pos;
-    }
-
     if (largest) {
         largest->src->delet(largest->src);
         largest->src = NULL;
@@ -22,8 +22,14 @@
 #include "error.h"
 #include "vec.h"
 #include "fdset.h"
+#include "impactcodec.h"
+#include "skip_build.h"
 #include "str.h"
 
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
 #define IMPACT_UNSET -1.0F
 #define W_QT_UNSET -1.0F
 #define E_VALUE 0.0001 
@@ -46,7 +52,8 @@ static enum impact_ret decompress_list(struct vocab_vector *vocab,
   char *vec_buf, struct list_decomp *decomp_list);
 
 static enum impact_ret compress_impact_ordered_list(struct list_decomp * list,
-  char ** vec_mem, unsigned int * vec_mem_len, unsigned int * vec_size);
+  char ** vec_mem, unsigned int * vec_mem_len, unsigned int * vec_size,
+  int packed);
 
 static enum impact_ret load_vector(struct index * idx, const char * term,
   struct vocab_vector * vocab, char ** vec_mem,
@@ -58,7 +65,8 @@ static enum impact_ret get_doc_vec(struct index * idx, const char * term,
   struct vocab_vector * vocab_in);
 
 static enum impact_ret calculate_impact_limits(struct index * idx,
-  double pivot, double * max_impact, double * min_impact, double *ft_avg);
+  unsigned int threads, double pivot, double * max_impact, 
+  double * min_impact, double *ft_avg);
 
 static double calc_impact_pivoted_cosine(unsigned long int f_dt, 
   unsigned long int f_t, double W_d, double aW_d, double pivot);
@@ -88,72 +96,636 @@ static enum impact_ret fdset_write(unsigned int fileno,
   unsigned int filetype, unsigned long int offset,
   struct fdset *fdset, char *data, unsigned int data_len);
 
+/* Both passes over the vocab (finding the limits of impacts, and then
+ * writing impact-ordered lists) run as a pipeline.  The calling thread reads
+ * lists from the vocab in batches of up to IMPACT_BATCH_LISTS lists, or about
+ * IMPACT_BATCH_BYTES bytes of vectors, and hands them to a pool of worker
+ * threads, which decompress and transform them (for the second pass, into
+ * impact-ordered vectors) independently of each other.  The calling thread
+ * consumes finished batches in vocab order, so the result is the same however
+ * many threads there are.  Twice as many batches as workers are in flight at
+ * once, so that workers don't sit idle while the calling thread reads and
+ * writes.  Without thread support (MT_ZET), or with only one thread, the
+ * calling thread transforms each batch itself. */
+
+#define IMPACT_BATCH_LISTS 256
+#define IMPACT_BATCH_BYTES (1024 * 1024)
+
+/* what a pass computes for each list */
+enum impact_stage {
+    IMPACT_STAGE_LIMITS,             /* largest and smallest impact */
+    IMPACT_STAGE_ORDER               /* impact-ordered vector */
+};
+
+enum impact_batch_state {
+    IMPACT_BATCH_FREE,               /* not in use */
+    IMPACT_BATCH_READY,              /* read, waiting for a worker */
+    IMPACT_BATCH_BUSY,               /* being transformed by a worker */
+    IMPACT_BATCH_DONE                /* transformed, waiting to be consumed */
+};
+
+/* a list read from the vocab, and what a pass made of it */
+struct impact_list {
+    unsigned int term;               /* offset of term in batch buffer */
+    unsigned int termlen;            /* length of term */
+    unsigned int data;               /* offset of vocab entry in buffer */
+    unsigned int datalen;            /* length of vocab entry */
+    struct vocab_vector vocab;       /* document ordered vector of term */
+    char *vec;                       /* document ordered vector, then
+                                      * impact-ordered vector */
+    unsigned int veclen;             /* capacity of vec */
+    unsigned int vecsize;            /* size of impact-ordered vector */
+    double max_impact;               /* largest impact in list */
+    double min_impact;               /* smallest impact in list */
+};
+
+struct impact_batch {
+    struct impact_list *list;        /* lists in batch */
+    unsigned int lists;              /* number of lists in batch */
+    char *buf;                       /* terms and vocab entries of lists */
+    unsigned int buflen;             /* length of buf used */
+    unsigned int bufsize;            /* capacity of buf */
+    enum impact_batch_state state;   /* progress of batch */
+    enum impact_ret ret;             /* outcome of transforming batch */
+    double w_qt_min;                 /* smallest w_qt in batch */
+    double w_qt_max;                 /* largest w_qt in batch */
+};
+
+struct impact_pass {
+    struct index *idx;               /* index being impact-ordered */
+    enum impact_stage stage;         /* what to compute for each list */
+    double avg_weight;               /* transformation parameters */
+    double pivot;
+    double slope;
+    unsigned int quant_bits;
+    double max_impact;
+    double min_impact;
+    double norm_B;
+    double f_t_avg;
+    int packed;                      /* whether to bit-pack document 
+                                      * numbers (VOCAB_VTYPE_IMPACT_BLOCK) */
+    unsigned int term_state[3];      /* vocab iteration state */
+    int eof;                         /* whether vocab has been read */
+    struct impact_batch *batch;      /* ring of batches */
+    unsigned int batches;            /* number of batches */
+    unsigned int threads;            /* number of worker threads */
+#ifdef MT_ZET
+    unsigned int take;               /* next batch for a worker to take */
+    int finish;                      /* whether workers should exit */
+    pthread_t *thread;               /* worker threads */
+    pthread_mutex_t mutex;           /* protects batch states and above */
+    pthread_cond_t work;             /* signalled when a batch is ready, or
+                                      * the pass is finishing */
+    pthread_cond_t done;             /* signalled when a batch is done */
+#endif /* MT_ZET */
+};
+
+/* function to consume a finished batch */
+typedef enum impact_ret (*impact_consume_fn)(struct impact_pass *pass,
+  struct impact_batch *batch, void *opaque);
+
+/* read the next batch of lists from the vocab, setting pass->eof if there are
+ * no more */
+static enum impact_ret impact_batch_read(struct impact_pass *pass,
+  struct impact_batch *batch) {
+    const char *term;
+    unsigned int termlen;
+    void *data;
+    unsigned int datalen;
+    unsigned long int bytes = 0;
+    enum impact_ret ret;
+
+    batch->lists = 0;
+    batch->buflen = 0;
+    while (batch->lists < IMPACT_BATCH_LISTS && bytes < IMPACT_BATCH_BYTES) {
+        struct impact_list *list = &batch->list[batch->lists];
+
+        if (!(term = iobtree_next_term(pass->idx->vocab, pass->term_state,
+              &termlen, &data, &datalen))) {
+            pass->eof = 1;
+            break;
+        }
+
+        /* copy term and vocab entry, which only last until the next term is
+         * read */
+        if (batch->buflen + termlen + 1 + datalen > batch->bufsize) {
+            unsigned int size = 2 * batch->bufsize + termlen + 1 + datalen;
+            char *buf = realloc(batch->buf, size);
+
+            if (!buf) {
+                return IMPACT_MEM_ERROR;
+            }
+            batch->buf = buf;
+            batch->bufsize = size;
+        }
+        list->term = batch->buflen;
+        list->termlen = termlen;
+        memcpy(batch->buf + batch->buflen, term, termlen);
+        batch->buflen += termlen;
+        batch->buf[batch->buflen++] = '\0';
+        list->data = batch->buflen;
+        list->datalen = datalen;
+        memcpy(batch->buf + batch->buflen, data, datalen);
+        batch->buflen += datalen;
+
+        if ((ret = get_doc_vec(pass->idx, batch->buf + list->term, data,
+              datalen, &list->vec, &list->veclen, &list->vocab))
+          != IMPACT_OK) {
+            ERROR1("loading document vector for term '%s'",
+              batch->buf + list->term);
+            return ret;
+        }
+        bytes += list->vocab.size;
+        batch->lists++;
+    }
+    return IMPACT_OK;
+}
+
+/* transform a batch of lists, using decomp to decompress them */
+static enum impact_ret impact_batch_transform(struct impact_pass *pass,
+  struct impact_batch *batch, struct list_decomp *decomp) {
+    unsigned int i;
+    enum impact_ret ret;
+
+    batch->w_qt_min = batch->w_qt_max = W_QT_UNSET;
+    for (i = 0; i < batch->lists; i++) {
+        struct impact_list *list = &batch->list[i];
+
+        switch (pass->stage) {
+        case IMPACT_STAGE_LIMITS:
+            if ((ret = calculate_list_impact_limits(&list->vocab, list->vec,
+                  pass->idx->map, pass->avg_weight, pass->pivot,
+                  &list->max_impact, &list->min_impact)) != IMPACT_OK) {
+                ERROR1("calculating max and min impact for term '%s'",
+                  batch->buf + list->term);
+                return ret;
+            }
+            break;
+
+        case IMPACT_STAGE_ORDER:
+            if ((ret = decompress_list(&list->vocab, list->vec, decomp))
+              != IMPACT_OK) {
+                return ret;
+            }
+            impact_transform_list(decomp, pass->idx->map, pass->avg_weight,
+              pass->pivot, pass->max_impact, pass->min_impact, pass->slope,
+              pass->quant_bits, pass->norm_B, &batch->w_qt_min,
+              &batch->w_qt_max, pass->f_t_avg);
+            if ((ret = compress_impact_ordered_list(decomp, &list->vec,
+                  &list->veclen, &list->vecsize, pass->packed)) 
+              != IMPACT_OK) {
+                return ret;
+            }
+            break;
+        }
+    }
+    return IMPACT_OK;
+}
+
+#ifdef MT_ZET
+/* main loop of worker threads */
+static void *impact_worker(void *arg) {
+    struct impact_pass *pass = arg;
+    struct impact_batch *batch;
+    struct list_decomp decomp;
+    enum impact_ret ret;
+
+    decomp.postings = NULL;
+    decomp.postings_size = 0;
+
+    pthread_mutex_lock(&pass->mutex);
+    while (!pass->finish) {
+        /* batches are made ready in ring order, so the next one to take is
+         * always the oldest */
+        batch = &pass->batch[pass->take];
+        if (batch->state == IMPACT_BATCH_READY) {
+            batch->state = IMPACT_BATCH_BUSY;
+            pass->take = (pass->take + 1) % pass->batches;
+            pthread_mutex_unlock(&pass->mutex);
+
+            ret = impact_batch_transform(pass, batch, &decomp);
+
+            pthread_mutex_lock(&pass->mutex);
+            batch->ret = ret;
+            batch->state = IMPACT_BATCH_DONE;
+            pthread_cond_signal(&pass->done);
+        } else {
+            pthread_cond_wait(&pass->work, &pass->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pass->mutex);
+
+    free(decomp.postings);
+    return NULL;
+}
+#endif /* MT_ZET */
+
+/* run a pass over every list in the vocab, transforming them on threads
+ * worker threads (if more than one), and handing each finished batch to
+ * consume in vocab order */
+static enum impact_ret impact_pass_run(struct impact_pass *pass,
+  unsigned int threads, impact_consume_fn consume, void *opaque) {
+    struct list_decomp decomp;
+    struct impact_batch *batch;
+    unsigned int fill = 0,             /* next batch to read */
+                 out = 0,              /* next batch to consume */
+                 inflight = 0,         /* batches read but not consumed */
+                 i,
+                 j;
+    enum impact_ret ret = IMPACT_OK;
+
+    decomp.postings = NULL;
+    decomp.postings_size = 0;
+    pass->term_state[0] = pass->term_state[1] = pass->term_state[2] = 0;
+    pass->eof = 0;
+    pass->threads = 0;
+    pass->batches = 1;
+#ifdef MT_ZET
+    pass->thread = NULL;
+    if (threads > 1) {
+        pass->batches = 2 * threads;
+    }
+#endif /* MT_ZET */
+
+    if (!(pass->batch = malloc(sizeof(*pass->batch) * pass->batches))) {
+        return IMPACT_MEM_ERROR;
+    }
+    for (i = 0; i < pass->batches; i++) {
+        batch = &pass->batch[i];
+        batch->lists = 0;
+        batch->buf = NULL;
+        batch->buflen = batch->bufsize = 0;
+        batch->state = IMPACT_BATCH_FREE;
+        if ((batch->list
+          = malloc(sizeof(*batch->list) * IMPACT_BATCH_LISTS))) {
+            for (j = 0; j < IMPACT_BATCH_LISTS; j++) {
+                batch->list[j].vec = NULL;
+                batch->list[j].veclen = 0;
+            }
+        } else {
+            ret = IMPACT_MEM_ERROR;
+        }
+    }
+
+#ifdef MT_ZET
+    if (ret == IMPACT_OK && threads > 1) {
+        if ((pass->thread = malloc(sizeof(*pass->thread) * threads))) {
+            pass->take = 0;
+            pass->finish = 0;
+            pthread_mutex_init(&pass->mutex, NULL);
+            pthread_cond_init(&pass->work, NULL);
+            pthread_cond_init(&pass->done, NULL);
+
+            /* if we can't create all of them, make do with what we have */
+            while (pass->threads < threads
+              && !pthread_create(&pass->thread[pass->threads], NULL,
+                impact_worker, pass)) {
+                pass->threads++;
+            }
+        } else {
+            ret = IMPACT_MEM_ERROR;
+        }
+    }
+#endif /* MT_ZET */
+
+    while (ret == IMPACT_OK) {
+        /* read batches until they're all in flight */
+        while (!pass->eof && inflight < pass->batches) {
+            batch = &pass->batch[fill];
+            assert(batch->state == IMPACT_BATCH_FREE);
+            if ((ret = impact_batch_read(pass, batch)) != IMPACT_OK
+              || !batch->lists) {
+                break;
+            }
+            fill = (fill + 1) % pass->batches;
+            inflight++;
+
+#ifdef MT_ZET
+            if (pass->threads) {
+                pthread_mutex_lock(&pass->mutex);
+                batch->state = IMPACT_BATCH_READY;
+                pthread_cond_signal(&pass->work);
+                pthread_mutex_unlock(&pass->mutex);
+                continue;
+            }
+#endif /* MT_ZET */
+
+            batch->ret = impact_batch_transform(pass, batch, &decomp);
+            batch->state = IMPACT_BATCH_DONE;
+        }
+        if (ret != IMPACT_OK || !inflight) {
+            break;
+        }
+
+        /* consume the oldest batch */
+        batch = &pass->batch[out];
+#ifdef MT_ZET
+        if (pass->threads) {
+            pthread_mutex_lock(&pass->mutex);
+            while (batch->state != IMPACT_BATCH_DONE) {
+                pthread_cond_wait(&pass->done, &pass->mutex);
+            }
+            pthread_mutex_unlock(&pass->mutex);
+        }
+#endif /* MT_ZET */
+        assert(batch->state == IMPACT_BATCH_DONE);
+        if ((ret = batch->ret) == IMPACT_OK) {
+            ret = consume(pass, batch, opaque);
+        }
+
+#ifdef MT_ZET
+        /* workers look at batch states (and reuse the batch once it's free)
+         * under the mutex */
+        if (pass->threads) {
+            pthread_mutex_lock(&pass->mutex);
+        }
+#endif /* MT_ZET */
+        /* don't hold on to the memory of unusually long lists */
+        for (i = 0; i < batch->lists; i++) {
+            if (batch->list[i].veclen > IMPACT_BATCH_BYTES) {
+                free(batch->list[i].vec);
+                batch->list[i].vec = NULL;
+                batch->list[i].veclen = 0;
+            }
+        }
+        batch->state = IMPACT_BATCH_FREE;
+#ifdef MT_ZET
+        if (pass->threads) {
+            pthread_mutex_unlock(&pass->mutex);
+        }
+#endif /* MT_ZET */
+        out = (out + 1) % pass->batches;
+        inflight--;
+    }
+
+#ifdef MT_ZET
+    if (pass->thread) {
+        /* workers finish the batch they're on, and leave the rest */
+        pthread_mutex_lock(&pass->mutex);
+        pass->finish = 1;
+        pthread_cond_broadcast(&pass->work);
+        pthread_mutex_unlock(&pass->mutex);
+        for (i = 0; i < pass->threads; i++) {
+            pthread_join(pass->thread[i], NULL);
+        }
+        pthread_cond_destroy(&pass->done);
+        pthread_cond_destroy(&pass->work);
+        pthread_mutex_destroy(&pass->mutex);
+        free(pass->thread);
+    }
+#endif /* MT_ZET */
+
+    for (i = 0; i < pass->batches; i++) {
+        batch = &pass->batch[i];
+        if (batch->list) {
+            for (j = 0; j < IMPACT_BATCH_LISTS; j++) {
+                free(batch->list[j].vec);
+            }
+            free(batch->list);
+        }
+        free(batch->buf);
+    }
+    free(pass->batch);
+    free(decomp.postings);
+    return ret;
+}
+
+/* state of the writer of impact-ordered vectors and the new vocab */
+struct impact_writer {
+    struct index *idx;               /* index being impact-ordered */
+    struct btbulk bulk;              /* bulk inserter for new vocab */
+    unsigned int vocab_fileno;       /* current new vocab file */
+    unsigned long int vocab_offset;  /* offset in current new vocab file */
+    unsigned int vocab_fd_type;      /* fdset type of new vocab files */
+    unsigned int vector_fileno;      /* current vector file */
+    unsigned long int vector_offset; /* offset in current vector file */
+    unsigned int vector_fd_type;     /* fdset type of vector files */
+    int vector_file_is_new;          /* whether vector file needs creating */
+    enum vocab_vtype type;           /* type of impact-ordered vectors */
+    char *entry;                     /* buffer for new vocab entries */
+    unsigned int entrylen;           /* capacity of entry */
+    unsigned long int terms;         /* number of terms written */
+    double w_qt_min;                 /* smallest w_qt seen */
+    double w_qt_max;                 /* largest w_qt seen */
+};
+
+/* write the impact-ordered vector of a list, and add it to the list's vocab
+ * entry in the new vocab */
+static enum impact_ret impact_write_list(struct impact_writer *w,
+  const char *term, unsigned int termlen, void *data, unsigned int datalen,
+  struct vocab_vector *vocab_in, char *vec_mem, unsigned int vec_size) {
+    struct index *idx = w->idx;
+    struct vocab_vector vocab_entry_out;
+    unsigned int vocab_entry_out_len;
+    unsigned int vocab_vector_out_len;
+    enum vocab_ret vocab_ret;
+    enum btbulk_ret bulk_inserter_ret;
+    enum impact_ret our_ret;
+    struct vec vec;
+    int new_vector_fd_out;
+    ssize_t nwritten;
+
+    /* Write vector to disk. */
+    /* XXX currently, we write all impact ordered vectors to location
+       type 'file'.  This should be changed in future. */
+    /* NOTE expressed this way to avoid integer overflow, which
+       is a real issue, as the max filesize is quite likely to be
+       UINT_MAX.  Be VERY CAREFUL about modifying this expression! */
+    if (idx->storage.max_filesize - vec_size < w->vector_offset) {
+        w->vector_fileno++;
+        w->vector_offset = 0;
+        w->vector_file_is_new = 1;
+    }
+
+    if (w->vector_file_is_new) {
+        if ( (new_vector_fd_out = fdset_create_seek(idx->fd,
+                  w->vector_fd_type, w->vector_fileno,
+                  w->vector_offset)) < 0) {
+            ERROR2("unable to create output temporary vector file number "
+              "%lu and seek to offset %lu", w->vector_fileno,
+              w->vector_offset);
+            return IMPACT_IO_ERROR;
+        }
+        w->vector_file_is_new = 0;
+    } else {
+        if ( (new_vector_fd_out = fdset_pin(idx->fd, w->vector_fd_type,
+                  w->vector_fileno, w->vector_offset, SEEK_SET)) < 0) {
+            ERROR2("unable to open output temporary vector file number "
+                   "%lu to offset %lu", w->vector_fileno,
+                   w->vector_offset);
+            return IMPACT_IO_ERROR;
+        }
+    }
+
+    nwritten = index_atomic_write(new_vector_fd_out, vec_mem, vec_size);
+    fdset_unpin(idx->fd, w->vector_fd_type, w->vector_fileno,
+      new_vector_fd_out);
+    if (nwritten != (ssize_t) vec_size) {
+        ERROR3("writing vector of size %lu to temporary vector file "
+          "number %lu, offset %lu", vec_size, w->vector_fileno,
+          w->vector_offset);
+        return IMPACT_IO_ERROR;
+    }
+
+    /* XXX we should really remove any old impact-ordered vector
+       entries; but the policy for this is still unclear. */
+
+    /* Add vocab entry for impact vector to existing vocab entries. */
+    vocab_entry_out.attr = VOCAB_ATTRIBUTES_NONE;
+    vocab_entry_out.attribute = 0;
+    vocab_entry_out.type = w->type;
+    vocab_entry_out.size = vec_size;
+    switch (vocab_in->type) {
+    case VOCAB_VTYPE_DOC:
+        vocab_entry_out.header.impact.docs = vocab_in->header.doc.docs;
+        vocab_entry_out.header.impact.occurs = vocab_in->header.doc.occurs;
+        vocab_entry_out.header.impact.last = vocab_in->header.doc.last;
+        break;
+    case VOCAB_VTYPE_DOCWP:
+        vocab_entry_out.header.impact.docs = vocab_in->header.docwp.docs;
+        vocab_entry_out.header.impact.occurs = vocab_in->header.docwp.occurs;
+        vocab_entry_out.header.impact.last = vocab_in->header.docwp.last;
+        break;
+    default:
+        assert("shouldn't happen" && 0);
+    }
+    vocab_entry_out.location = VOCAB_LOCATION_FILE;
+    vocab_entry_out.loc.file.capacity = vec_size;
+    vocab_entry_out.loc.file.fileno = w->vector_fileno;
+    vocab_entry_out.loc.file.offset = w->vector_offset;
+
+    vocab_entry_out_len = vocab_len(&vocab_entry_out);
+    vocab_vector_out_len = datalen + vocab_entry_out_len;
+
+    if (vocab_vector_out_len > w->entrylen) {
+        char * new_entry;
+        new_entry = realloc(w->entry, vocab_vector_out_len);
+        if (new_entry == NULL) {
+            return IMPACT_MEM_ERROR;
+        }
+        w->entry = new_entry;
+        w->entrylen = vocab_vector_out_len;
+    }
+    memcpy(w->entry, data, datalen);
+
+    vec.pos = w->entry + datalen;
+    vec.end = w->entry + w->entrylen;
+    vocab_ret = vocab_encode(&vocab_entry_out, &vec);
+    assert(vocab_ret == VOCAB_OK); /* bug if not */
+
+    /* w->entry now contains new vocab vector to add to new index. */
+    w->bulk.term = term;
+    w->bulk.termlen = termlen;
+    w->bulk.datasize = vocab_vector_out_len;
+    do {
+        w->bulk.fileno = w->vocab_fileno;
+        w->bulk.offset = w->vocab_offset;
+
+        bulk_inserter_ret = btbulk_insert(&w->bulk);
+        switch (bulk_inserter_ret) {
+        case BTBULK_OK:
+            memcpy(w->bulk.output.ok.data, w->entry, vocab_vector_out_len);
+            break;
+        case BTBULK_WRITE:
+            our_ret = fdset_write(w->vocab_fileno, w->vocab_fd_type,
+              w->vocab_offset, idx->fd, w->bulk.output.write.next_out,
+              w->bulk.output.write.avail_out);
+            if (our_ret != IMPACT_OK)
+                return our_ret;
+            w->vocab_offset += w->bulk.output.write.avail_out;
+            break;
+        case BTBULK_FLUSH:
+            w->vocab_fileno++;
+            idx->vectors++;
+            assert(w->vocab_fileno == idx->vectors - 1);
+            w->vocab_offset = 0;
+            break;
+        case BTBULK_ERR:
+            ERROR2("error on btbulk_insert call for term '%s', "
+              "data size %u", term, vocab_vector_out_len);
+            return IMPACT_OTHER_ERROR;
+            break;
+        default:
+            assert(0);
+        }
+    } while (bulk_inserter_ret != BTBULK_OK);
+    w->terms++;
+    w->vector_offset += vec_size;
+    return IMPACT_OK;
+}
+
+/* consume a batch of impact-ordered lists by writing them out */
+static enum impact_ret impact_write_batch(struct impact_pass *pass,
+  struct impact_batch *batch, void *opaque) {
+    struct impact_writer *w = opaque;
+    unsigned int i;
+    enum impact_ret ret;
+
+    if (batch->w_qt_min != W_QT_UNSET) {
+        if (w->w_qt_min == W_QT_UNSET || batch->w_qt_min < w->w_qt_min)
+            w->w_qt_min = batch->w_qt_min;
+        if (w->w_qt_max == W_QT_UNSET || batch->w_qt_max > w->w_qt_max)
+            w->w_qt_max = batch->w_qt_max;
+    }
+    for (i = 0; i < batch->lists; i++) {
+        struct impact_list *list = &batch->list[i];
+
+        if ((ret = impact_write_list(w, batch->buf + list->term,
+              list->termlen, batch->buf + list->data, list->datalen,
+              &list->vocab, list->vec, list->vecsize)) != IMPACT_OK) {
+            return ret;
+        }
+    }
+    return IMPACT_OK;
+}
+
 /**
  *  Routines for creating an impact-ordered index.
  */
-enum impact_ret impact_order_index(struct index *idx) {
-    unsigned int new_vocab_fileno;
-    unsigned long int new_vocab_file_offset;
-    struct btbulk new_vocab_bulk_inserter;
+enum impact_ret impact_order_index(struct index *idx, unsigned int threads,
+  enum index_codec codec) {
+    struct impact_pass pass;
+    struct impact_writer w;
     int new_vocab_bulk_inserter_inited = 0;
-    unsigned int tmp_vocab_fd_type;
 
     unsigned int new_vocab_root_fileno = 0;
     unsigned long int new_vocab_root_file_offset = 0;
 
-    unsigned int new_vector_fileno;
-    unsigned long int vector_file_offset;
-    int new_vector_fd_out;
-    unsigned int new_vector_fd_type;
-
-    char * vec_mem = NULL;
-    unsigned vec_mem_len = 0;
-
-    ssize_t nwritten;
-    unsigned int term_iterator_state[3] = { 0U, 0U, 0U };
-    const char * term;
-    unsigned int termlen;
-    void * data;
-    unsigned int datalen;
     enum btbulk_ret bulk_inserter_ret;
-    struct list_decomp decomp_list;
     double max_impact;
     double min_impact;
     enum impact_ret our_ret = IMPACT_OK;
     double norm_B; /* used for logarithmic normalisation */
-    struct addfile_data addfile_data;
     unsigned int fileno;
-    unsigned long int terms = 0;
-    unsigned long int dummy_offset = 0;
-    unsigned int dummy_size = 0;
-    int vector_file_is_new = 1;
     double f_t_avg;
-    double w_qt_max = W_QT_UNSET;
-    double w_qt_min = W_QT_UNSET;
     double pivot = IMPACT_DEFAULT_PIVOT;
     double slope = IMPACT_DEFAULT_SLOPE;
     unsigned int quant_bits = IMPACT_DEFAULT_QUANT_BITS;
-    
-    if ( (our_ret = calculate_impact_limits(idx, pivot,
+
+    w.entry = NULL;
+    w.entrylen = 0;
+
+    if ( (our_ret = calculate_impact_limits(idx, threads, pivot,
               &max_impact, &min_impact, &f_t_avg)) != IMPACT_OK) {
         ERROR("calculating impact limits");
         goto ERROR;
     }
     assert(min_impact <= max_impact);
 
-    norm_B = pow(max_impact / min_impact, 
+    norm_B = pow(max_impact / min_impact,
       min_impact / (max_impact - min_impact));
 
-    decomp_list.postings = NULL;
-    decomp_list.postings_size = 0;
-
-    tmp_vocab_fd_type = idx->tmp_type;
-    addfile_data.fd = idx->fd;
-    addfile_data.fd_type = tmp_vocab_fd_type;
+    w.idx = idx;
+    w.vocab_fd_type = idx->tmp_type;
+    w.terms = 0;
+    w.w_qt_min = W_QT_UNSET;
+    w.w_qt_max = W_QT_UNSET;
+    w.type = (codec == INDEX_CODEC_BLOCK) 
+      ? VOCAB_VTYPE_IMPACT_BLOCK : VOCAB_VTYPE_IMPACT;
 
     if (!(btbulk_new(idx->storage.pagesize, idx->storage.max_filesize,
               idx->storage.btleaf_strategy, idx->storage.btnode_strategy,
-              1.0 /* fill factor */, 0, &new_vocab_bulk_inserter))) {
+              1.0 /* fill factor */, 0, &w.bulk))) {
         ERROR("creating new btbulk inserter for impact ordering");
         goto ERROR;
     }
@@ -161,199 +733,50 @@ enum impact_ret impact_order_index(struct index *idx) {
 
     /* add the new vectors to existing vector file set (though starting
        with a new file. */
-    new_vector_fd_type = idx->index_type;
-    new_vector_fileno = idx->vectors;
-    /* not first_file_header, as these vector files follow 
+    w.vector_fd_type = idx->index_type;
+    w.vector_fileno = idx->vectors;
+    /* not first_file_header, as these vector files follow
        the existings ones. */
-    vector_file_offset = 0;
+    w.vector_offset = 0;
+    w.vector_file_is_new = 1;
 
-    new_vocab_fileno = 0;
-    new_vocab_file_offset = 0;
     /* not first_file_header, as that is only for vectors files */
-    new_vocab_file_offset = 0;
-
-    while ( (term = iobtree_next_term(idx->vocab, term_iterator_state,
-              &termlen, &data, &datalen)) != NULL) {
-        struct vocab_vector vocab_in;
-        unsigned int vec_size;
-        struct vocab_vector vocab_entry_out;
-        unsigned int vocab_entry_out_len;
-        unsigned int vocab_vector_out_len;
-        enum vocab_ret vocab_ret;
-        struct vec vec;
-
-        if ( (our_ret = get_doc_vec(idx, term, data, datalen, 
-                  &vec_mem, &vec_mem_len, &vocab_in)) != IMPACT_OK) {
-            ERROR1("loading document vector for term '%s'", term);
-            goto ERROR;
-        }
-        if ( (our_ret = decompress_list(&vocab_in, vec_mem, &decomp_list))
-          != IMPACT_OK) {
-            goto ERROR;
-        }
-        impact_transform_list(&decomp_list, idx->map, idx->stats.avg_weight, 
-          pivot, max_impact, min_impact, slope, quant_bits, norm_B, 
-          &w_qt_min, &w_qt_max, f_t_avg);
-        if ( (our_ret = compress_impact_ordered_list(&decomp_list,
-                  &vec_mem, &vec_mem_len, &vec_size)) != IMPACT_OK) {
-            goto ERROR;
-        }
-
-        /* Write vector to disk. */
-        /* XXX currently, we write all impact ordered vectors to location
-           type 'file'.  This should be changed in future. */
-        /* NOTE expressed this way to avoid integer overflow, which
-           is a real issue, as the max filesize is quite likely to be 
-           UINT_MAX.  Be VERY CAREFUL about modifying this expression! */
-        if (idx->storage.max_filesize - vec_size < vector_file_offset) {
-            dummy_offset = 0;
-            dummy_size = vector_file_offset;
-            new_vector_fileno++;
-            vector_file_offset = 0;
-            vector_file_is_new = 1;
-        }
-
-        if (vector_file_is_new) {
-            if ( (new_vector_fd_out = fdset_create_seek(idx->fd, 
-                      new_vector_fd_type, new_vector_fileno, 
-                      vector_file_offset)) < 0) {
-                ERROR2("unable to create output temporary vector file number "
-                  "%lu and seek to offset %lu", new_vector_fileno, 
-                  vector_file_offset);
-                goto ERROR;
-            }
-            vector_file_is_new = 0;
-        } else {
-            if ( (new_vector_fd_out = fdset_pin(idx->fd, new_vector_fd_type,
-                      new_vector_fileno, vector_file_offset, SEEK_SET)) < 0) {
-                ERROR2("unable to open output temporary vector file number "
-                       "%lu to offset %lu", new_vector_fileno, 
-                       vector_file_offset);
-                goto ERROR;
-            }
-        }
-
-        nwritten = index_atomic_write(new_vector_fd_out, vec_mem, vec_size);
-        fdset_unpin(idx->fd, new_vector_fd_type, new_vector_fileno,
-          new_vector_fd_out);
-        if (nwritten != (ssize_t) vec_size) {
-            ERROR3("writing vector of size %lu to temporary vector file "
-              "number %lu, offset %lu", vec_size, new_vector_fileno,
-              vector_file_offset);
-            goto ERROR;
-        }
-
-        /* XXX we should really remove any old impact-ordered vector
-           entries; but the policy for this is still unclear. */
-
-        /* Add vocab entry for impact vector to existing vocab entries. */
-        vocab_entry_out.attr = VOCAB_ATTRIBUTES_NONE;
-        vocab_entry_out.attribute = 0;
-        vocab_entry_out.type = VOCAB_VTYPE_IMPACT;
-        vocab_entry_out.size = vec_size;
-        switch (vocab_in.type) {
-        case VOCAB_VTYPE_DOC:
-            vocab_entry_out.header.impact.docs = vocab_in.header.doc.docs;
-            vocab_entry_out.header.impact.occurs = vocab_in.header.doc.occurs;
-            vocab_entry_out.header.impact.last = vocab_in.header.doc.last;
-            break;
-        case VOCAB_VTYPE_DOCWP:
-            vocab_entry_out.header.impact.docs = vocab_in.header.docwp.docs;
-            vocab_entry_out.header.impact.occurs = vocab_in.header.docwp.occurs;
-            vocab_entry_out.header.impact.last = vocab_in.header.docwp.last;
-            break;
-        default:
-            assert("shouldn't happen" && 0);
-        }
-        vocab_entry_out.location = VOCAB_LOCATION_FILE;
-        vocab_entry_out.loc.file.capacity = vec_size;
-        vocab_entry_out.loc.file.fileno = new_vector_fileno;
-        vocab_entry_out.loc.file.offset = vector_file_offset;
-
-        vocab_entry_out_len = vocab_len(&vocab_entry_out);
-        vocab_vector_out_len = datalen + vocab_entry_out_len;
+    w.vocab_fileno = 0;
+    w.vocab_offset = 0;
+
+    pass.idx = idx;
+    pass.stage = IMPACT_STAGE_ORDER;
+    pass.avg_weight = idx->stats.avg_weight;
+    pass.pivot = pivot;
+    pass.slope = slope;
+    pass.quant_bits = quant_bits;
+    pass.max_impact = max_impact;
+    pass.min_impact = min_impact;
+    pass.norm_B = norm_B;
+    pass.f_t_avg = f_t_avg;
+    pass.packed = (codec == INDEX_CODEC_BLOCK);
+    if ((our_ret = impact_pass_run(&pass, threads, impact_write_batch, &w))
+      != IMPACT_OK) {
+        goto ERROR;
+    }
+    assert(w.terms == iobtree_size(idx->vocab));
+    assert(w.w_qt_max > w.w_qt_min);
 
-        if (vocab_vector_out_len > vec_mem_len) {
-            char * new_vec_mem;
-            new_vec_mem = realloc(vec_mem, vocab_vector_out_len); 
-            if (new_vec_mem == NULL) {
-                our_ret = IMPACT_MEM_ERROR;
-                goto ERROR;
-            }
-            vec_mem = new_vec_mem;
-            vec_mem_len = vocab_vector_out_len;
-        }
-        memcpy(vec_mem, data, datalen);
-
-        vec.pos = vec_mem + datalen;
-        vec.end = vec_mem + vec_mem_len;
-        vocab_ret = vocab_encode(&vocab_entry_out, &vec);
-        assert(vocab_ret == VOCAB_OK); /* bug if not */
-
-        /* vec_mem now contains new vocab vector to add to new index. */
-        new_vocab_bulk_inserter.term = term;
-        new_vocab_bulk_inserter.termlen = termlen;
-        new_vocab_bulk_inserter.datasize = vocab_vector_out_len;
-        do {
-            new_vocab_bulk_inserter.fileno = new_vocab_fileno;
-            new_vocab_bulk_inserter.offset = new_vocab_file_offset;
-
-            bulk_inserter_ret = btbulk_insert(&new_vocab_bulk_inserter);
-            switch (bulk_inserter_ret) {
-            case BTBULK_OK:
-                memcpy(new_vocab_bulk_inserter.output.ok.data, 
-                  vec_mem, vocab_vector_out_len);
-                break;
-            case BTBULK_WRITE:
-                our_ret = fdset_write(new_vocab_fileno,
-                  tmp_vocab_fd_type, new_vocab_file_offset, idx->fd, 
-                  new_vocab_bulk_inserter.output.write.next_out,
-                  new_vocab_bulk_inserter.output.write.avail_out);
-                if (our_ret != IMPACT_OK)
-                    goto ERROR;
-                new_vocab_file_offset += 
-                      new_vocab_bulk_inserter.output.write.avail_out;
-                break;
-            case BTBULK_FLUSH:
-                new_vocab_fileno++;
-                idx->vectors++;
-                assert(new_vocab_fileno == idx->vectors - 1);
-                new_vocab_file_offset = 0;
-                new_vocab_file_offset = 0;
-                break;
-            case BTBULK_ERR:
-                ERROR2("error on btbulk_insert call for term '%s', "
-                  "data size %u", term, vocab_vector_out_len);
-                goto ERROR;
-                break;
-            default:
-                assert(0);
-            }
-        } while (bulk_inserter_ret != BTBULK_OK);
-        terms++;
-        vector_file_offset += vec_size;
-    } /* end while term = iobtree_next_term */
-    assert(terms == iobtree_size(idx->vocab));
-    assert(w_qt_max > w_qt_min);
-    
     /* save parameters required at query time for impact ordering in index */
-    /* these are saved in index_params_write() which is called in 
+    /* these are saved in index_params_write() which is called in
        index_commit_superblock() below */
     idx->impact_stats.avg_f_t = f_t_avg;
     idx->impact_stats.slope = slope;
     idx->impact_stats.quant_bits = quant_bits;
-    idx->impact_stats.w_qt_min = w_qt_min;
-    idx->impact_stats.w_qt_max = w_qt_max;
+    idx->impact_stats.w_qt_min = w.w_qt_min;
+    idx->impact_stats.w_qt_max = w.w_qt_max;
     idx->impact_vectors = 1;
-    
-    dummy_offset = 0;
-    dummy_size = vector_file_offset;
 
     do {
-        new_vocab_bulk_inserter.fileno = new_vocab_fileno;
-        new_vocab_bulk_inserter.offset = new_vocab_file_offset;
-        bulk_inserter_ret 
-          = btbulk_finalise(&new_vocab_bulk_inserter, &new_vocab_root_fileno, 
+        w.bulk.fileno = w.vocab_fileno;
+        w.bulk.offset = w.vocab_offset;
+        bulk_inserter_ret
+          = btbulk_finalise(&w.bulk, &new_vocab_root_fileno,
             &new_vocab_root_file_offset);
         switch (bulk_inserter_ret) {
         case BTBULK_FINISH:
@@ -361,22 +784,20 @@ enum impact_ret impact_order_index(struct index *idx) {
             bulk_inserter_ret = BTBULK_OK;
             break;
         case BTBULK_WRITE:
-            our_ret = fdset_write(new_vocab_fileno,
-              tmp_vocab_fd_type, new_vocab_file_offset, idx->fd,
-              new_vocab_bulk_inserter.output.write.next_out,
-              new_vocab_bulk_inserter.output.write.avail_out);
+            our_ret = fdset_write(w.vocab_fileno,
+              w.vocab_fd_type, w.vocab_offset, idx->fd,
+              w.bulk.output.write.next_out,
+              w.bulk.output.write.avail_out);
             if (our_ret != IMPACT_OK)
                 goto ERROR;
-            new_vocab_file_offset += 
-                new_vocab_bulk_inserter.output.write.avail_out;
+            w.vocab_offset += w.bulk.output.write.avail_out;
             break;
         case BTBULK_FLUSH:
-            /* XXX copied from main loop. */
-            new_vocab_fileno++;
+            /* XXX copied from impact_write_list. */
+            w.vocab_fileno++;
             idx->vectors++;
-            assert(new_vocab_fileno == idx->vectors - 1);
-            new_vocab_file_offset = 0;
-            new_vocab_file_offset = 0;
+            assert(w.vocab_fileno == idx->vectors - 1);
+            w.vocab_offset = 0;
             break;
         case BTBULK_ERR:
             ERROR("error on btbulk_finalise call");
@@ -399,7 +820,7 @@ enum impact_ret impact_order_index(struct index *idx) {
         }
     }
     idx->vocabs = 0;
-    for (fileno = 0; fileno <= new_vocab_fileno; fileno++) {
+    for (fileno = 0; fileno <= w.vocab_fileno; fileno++) {
         char final_fname[FILENAME_MAX + 1];
         char tmp_fname[FILENAME_MAX + 1];
         unsigned int final_fname_len;
@@ -408,10 +829,10 @@ enum impact_ret impact_order_index(struct index *idx) {
 
         fdset_name(idx->fd, idx->vocab_type, fileno, final_fname, FILENAME_MAX,
           &final_fname_len, &writeable);
-        fdset_name(idx->fd, tmp_vocab_fd_type, fileno, tmp_fname, FILENAME_MAX,
+        fdset_name(idx->fd, w.vocab_fd_type, fileno, tmp_fname, FILENAME_MAX,
           &tmp_fname_len, &writeable);
-        if (fdset_close_file(idx->fd, tmp_vocab_fd_type, fileno) < 0) {
-            /* in fact probably indicates a still-pinned fd, i.e. a 
+        if (fdset_close_file(idx->fd, w.vocab_fd_type, fileno) < 0) {
+            /* in fact probably indicates a still-pinned fd, i.e. a
                programming error */
             ERROR1("closing new vocab file %u", fileno);
             our_ret = IMPACT_IO_ERROR;
@@ -424,13 +845,13 @@ enum impact_ret impact_order_index(struct index *idx) {
             goto ERROR;
         }
     }
-    idx->vocabs = new_vocab_fileno + 1;
+    idx->vocabs = w.vocab_fileno + 1;
 
     /* do quick load of vocab */
-    idx->vocab = iobtree_load_quick(idx->storage.pagesize, 
+    idx->vocab = iobtree_load_quick(idx->storage.pagesize,
       idx->storage.btleaf_strategy, idx->storage.btnode_strategy,
       NULL, idx->fd, idx->vocab_type, new_vocab_root_fileno,
-      new_vocab_root_file_offset, terms);
+      new_vocab_root_file_offset, w.terms);
     if (idx->vocab == NULL) {
         ERROR("quick-loading new vocab");
         our_ret = IMPACT_OTHER_ERROR; /* could be mem, io, prob. bug */
@@ -452,11 +873,10 @@ ERROR:
 
 END:
     if (new_vocab_bulk_inserter_inited) {
-        btbulk_delete(&new_vocab_bulk_inserter);
+        btbulk_delete(&w.bulk);
     }
 
-    free(vec_mem);
-    free(decomp_list.postings);
+    free(w.entry);
     return our_ret;
 }
 
@@ -554,23 +974,46 @@ static enum impact_ret load_vector(struct index * idx, const char * term,
     return IMPACT_OK;
 }
 
+/* running limits of impacts over the lists seen so far */
+struct impact_limits {
+    double max_impact;               /* largest impact */
+    double min_impact;               /* smallest impact */
+    unsigned long int ft_sum;        /* cumulitive sum of f_t for each term */
+    unsigned long int ft_count;      /* number of terms */
+};
+
+/* consume a batch of lists by adding them to the limits */
+static enum impact_ret impact_limits_batch(struct impact_pass *pass,
+  struct impact_batch *batch, void *opaque) {
+    struct impact_limits *lim = opaque;
+    unsigned int i;
+
+    for (i = 0; i < batch->lists; i++) {
+        struct impact_list *list = &batch->list[i];
+
+        lim->ft_sum += list->vocab.header.docwp.docs;
+        if (!lim->ft_count++) {
+            lim->max_impact = list->max_impact;
+            lim->min_impact = list->min_impact;
+        } else {
+            if (lim->max_impact < list->max_impact)
+                lim->max_impact = list->max_impact;
+            if (lim->min_impact > list->min_impact)
+                lim->min_impact = list->min_impact;
+        }
+    }
+    return IMPACT_OK;
+}
+
 static enum impact_ret calculate_impact_limits(struct index * idx,
-  double pivot, double * max_impact, double * min_impact, double *ft_avg) {
-    unsigned int term_iterator_state[3] = { 0U, 0U, 0U };
-    const char * term;
-    unsigned int termlen;
-    void * data;
-    unsigned int datalen;
-    char * vec_mem = NULL;
-    unsigned vec_mem_len = 0;
-    double avg_weight;
+  unsigned int threads, double pivot, double * max_impact,
+  double * min_impact, double *ft_avg) {
+    struct impact_pass pass;
+    struct impact_limits lim;
     enum impact_ret our_ret = IMPACT_OK;
-    int first_term = 1;
     enum docmap_ret docmap_ret;
-    unsigned long int ft_sum = 0; /* cumulitive sum of f_t for each term */
-    unsigned long int ft_count = 0; /* number of terms */
 
-    docmap_ret = docmap_cache(idx->map, docmap_get_cache(idx->map) 
+    docmap_ret = docmap_cache(idx->map, docmap_get_cache(idx->map)
       | DOCMAP_CACHE_WEIGHT);
     if (docmap_ret != DOCMAP_OK) {
         ERROR("loading document weights");
@@ -587,57 +1030,30 @@ static enum impact_ret calculate_impact_limits(struct index * idx,
         default:
             our_ret = IMPACT_OTHER_ERROR;
         }
-        goto ERROR;
+        return our_ret;
     }
 
-    avg_weight = idx->stats.avg_weight;
-
-    *max_impact = IMPACT_UNSET;
-    *min_impact = IMPACT_UNSET;
-    while ( (term = iobtree_next_term(idx->vocab, term_iterator_state,
-              &termlen, &data, &datalen)) != NULL) {
-        struct vocab_vector vocab_in;
-        double list_max_impact;
-        double list_min_impact;
-
-        if ( (our_ret = get_doc_vec(idx, term, data, datalen, 
-                  &vec_mem, &vec_mem_len, &vocab_in)) != IMPACT_OK) {
-            ERROR1("loading document vector for term '%s'", term);
-            goto ERROR;
-        }
-        
-        ft_sum += vocab_in.header.docwp.docs;
-        ft_count++;
-        
-        if ( (our_ret = calculate_list_impact_limits(&vocab_in, 
-                  vec_mem, idx->map, avg_weight, pivot,
-                  &list_max_impact, &list_min_impact)) != IMPACT_OK) {
-            ERROR1("calculating max and min impact for term '%s'", term);
-            goto ERROR;
-        }
-        if (first_term) {
-            *max_impact = list_max_impact;
-            *min_impact = list_min_impact;
-            first_term = 0;
-        } else {
-            if (*max_impact < list_max_impact)
-                *max_impact = list_max_impact;
-            if (*min_impact > list_min_impact)
-                *min_impact = list_min_impact;
-        }
+    lim.max_impact = IMPACT_UNSET;
+    lim.min_impact = IMPACT_UNSET;
+    lim.ft_sum = 0;
+    lim.ft_count = 0;
+
+    pass.idx = idx;
+    pass.stage = IMPACT_STAGE_LIMITS;
+    pass.avg_weight = idx->stats.avg_weight;
+    pass.pivot = pivot;
+    if ((our_ret = impact_pass_run(&pass, threads, impact_limits_batch, &lim))
+      != IMPACT_OK) {
+        return our_ret;
     }
-    *ft_avg = ft_sum/ft_count;
-    goto END;
 
-ERROR:
-    if (our_ret == IMPACT_OK)
-        our_ret = IMPACT_OTHER_ERROR;
-
-END:
-    free(vec_mem);
-    return our_ret;
+    *max_impact = lim.max_impact;
+    *min_impact = lim.min_impact;
+    *ft_avg = lim.ft_sum/lim.ft_count;
+    return IMPACT_OK;
 }
 
+
 static enum impact_ret calculate_list_impact_limits(
   struct vocab_vector * vocab_entry, char * vec_buf, struct docmap * docmap,
   double avg_weight, double pivot, double * list_max_impact, 
@@ -728,13 +1144,34 @@ static enum impact_ret get_doc_vec(struct index * idx, const char * term,
     vocab_vec.end = (char *)term_data + term_data_len;
     while ( (vocab_ret = vocab_decode(vocab_in, &vocab_vec)) == VOCAB_OK
       && vocab_in->type != VOCAB_VTYPE_DOC 
-      && vocab_in->type != VOCAB_VTYPE_DOCWP) 
+      && vocab_in->type != VOCAB_VTYPE_DOCWP
+      && vocab_in->type != VOCAB_VTYPE_DOCWP_SKIP
+      && vocab_in->type != VOCAB_VTYPE_DOCWP_SEP
+      && vocab_in->type != VOCAB_VTYPE_DOCWP_BLOCK) 
         ;
     if (vocab_ret != VOCAB_OK)
         return IMPACT_FMT_ERROR;
     if ( (our_ret = load_vector(idx, term, vocab_in, vec_mem, 
               vec_mem_len, &vec_len)) != IMPACT_OK)
         return our_ret;
+    if (vocab_in->type == VOCAB_VTYPE_DOCWP_SKIP
+      || vocab_in->type == VOCAB_VTYPE_DOCWP_SEP
+      || vocab_in->type == VOCAB_VTYPE_DOCWP_BLOCK) {
+        /* strip skip table, decode blocks and merge positions back in, 
+         * leaving a plain DOCWP vector */
+        unsigned long int bound = skip_docwp_bound(vocab_in);
+        char *plain = malloc(bound);
+
+        if (!plain) {
+            return IMPACT_MEM_ERROR;
+        } else if (skip_docwp(vocab_in, *vec_mem, plain) != SKIP_OK) {
+            free(plain);
+            return IMPACT_FMT_ERROR;
+        }
+        free(*vec_mem);
+        *vec_mem = plain;
+        *vec_mem_len = bound;
+    }
     return IMPACT_OK;
 }
 
@@ -802,8 +1239,29 @@ static int impact_order_compare(const void *p1, const void *p2) {
     }
 }
 
+/* write the document numbers of the n postings of a block to vec as 
+ * bit-packed chunks of d-gaps (see impactcodec.h) */
+static void compress_packed_block(struct vec *vec, 
+  struct list_posting *posting, unsigned long int n) {
+    uint32_t gaps[IMPACTCODEC_CHUNK];
+    unsigned long int prev_docno = -1,
+                      i,
+                      j;
+    unsigned int bytes;
+
+    for (i = 0; i < n; i += j) {
+        for (j = 0; (j < IMPACTCODEC_CHUNK) && (i + j < n); j++) {
+            gaps[j] = posting[i + j].docno - (prev_docno + 1);
+            prev_docno = posting[i + j].docno;
+        }
+        bytes = impactcodec_write(vec, gaps, j);
+        assert(bytes);
+    }
+}
+
 static enum impact_ret compress_impact_ordered_list(struct list_decomp * list,
-  char ** vec_mem, unsigned int * vec_mem_len, unsigned int * vec_size) {
+  char ** vec_mem, unsigned int * vec_mem_len, unsigned int * vec_size,
+  int packed) {
     unsigned long int prev_docno;
     unsigned long int block_size;
     struct vec vec;
@@ -829,7 +1287,9 @@ static enum impact_ret compress_impact_ordered_list(struct list_decomp * list,
                 /* no-op */ ;
 
             /* Check for space only at the start of each block.  This
-               frees us from having to check for any of the vbyte_writes. */
+               frees us from having to check for any of the vbyte_writes.
+               Bit-packed chunks fit in the same space, as a chunk of n
+               document numbers takes at most 1 + 4n bytes. */
             space_for_block = (2 + block_size) * VEC_VBYTE_MAX;
             if (vec_len(&vec) < space_for_block) {
                 char * new_vec_mem;
@@ -864,6 +1324,13 @@ static enum impact_ret compress_impact_ordered_list(struct list_decomp * list,
                work even for B >= 8, just with a (very slight) loss 
                in compression. */
             vec_vbyte_write(&vec, list->postings[d].impact);
+
+            if (packed) {
+                compress_packed_block(&vec, &list->postings[d], block_size);
+                d += block_size - 1;
+                block_size = 0;
+                continue;
+            }
         } 
         --block_size;
         
@@ -0,0 +1,189 @@
+/* impactcodec.c implements the bit-packed chunks described in impactcodec.h.
+ *
+ * Where the processor supports AVX2, four d-gaps at a time are unpacked by
+ * gathering the eight bytes that hold each of them, shifting each into place
+ * with a variable shift and masking them down to width bits.  The four d-gaps
+ * are then turned into document numbers with a prefix sum across an SSE
+ * register.  The gather reads up to eight bytes past the start of the last
+ * d-gap, so the last few d-gaps of a chunk at the end of the buffered data
+ * are unpacked one at a time, as they all are on other processors.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "impactcodec.h"
+
+#include "vec.h"
+
+#include <assert.h>
+
+#if defined(__GNUC__) && (__GNUC__ >= 5) \
+  && (defined(__x86_64__) || defined(__i386__))
+#define IMPACTCODEC_AVX2
+#include <immintrin.h>
+#endif
+
+/* mask of the lowest width bits */
+#define WIDTH_MASK(width) \
+    ((uint32_t) (((uint64_t) 1 << (width)) - 1))
+
+#ifdef IMPACTCODEC_AVX2
+
+/* decode d-gaps from the chunk data at in (of the given width) into document
+ * numbers in out, following on from *base, for as long as it's safe to load
+ * eight bytes for each of four d-gaps without reading past end.  Returns the
+ * number of document numbers decoded (a multiple of four), updating *base to
+ * the last of them. */
+__attribute__((target("avx2")))
+static unsigned int decode_avx2(const unsigned char *in,
+  const unsigned char *end, unsigned int n, unsigned int width,
+  uint32_t *base, uint32_t *out) {
+    const __m256i step = _mm256_set1_epi64x(4 * width),
+                  mask = _mm256_set1_epi64x(WIDTH_MASK(width)),
+                  seven = _mm256_set1_epi64x(7),
+                  low = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const __m128i one = _mm_set1_epi32(1);
+    __m256i off = _mm256_setr_epi64x(0, width, 2 * width, 3 * width),
+            words;
+    __m128i prev = _mm_set1_epi32(*base),
+            x;
+    unsigned int i;
+
+    for (i = 0; (i + 4 <= n)
+      && ((unsigned long int) (end - in) >= ((i + 3) * width) / 8 + 8);
+      i += 4) {
+        /* load the eight bytes starting at the byte holding the first bit of
+         * each d-gap, and shift and mask the d-gap out of them (width and the
+         * shift are never more than 39 bits between them) */
+        words = _mm256_i64gather_epi64((const long long int *) in,
+            _mm256_srli_epi64(off, 3), 1);
+        words = _mm256_and_si256(
+            _mm256_srlv_epi64(words, _mm256_and_si256(off, seven)), mask);
+        off = _mm256_add_epi64(off, step);
+
+        /* narrow to 32 bits, add one to each and prefix sum them onto the
+         * last document number */
+        x = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(words, low));
+        x = _mm_add_epi32(x, one);
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, prev);
+        _mm_storeu_si128((__m128i *) &out[i], x);
+        prev = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    *base = (uint32_t) _mm_cvtsi128_si32(prev);
+    return i;
+}
+
+#endif
+
+/* decode d-gaps i to n - 1 from the chunk data at in (of the given width)
+ * into document numbers in out, following on from *base, which is updated to
+ * the last of them.  Reads no further than the last byte holding d-gap
+ * n - 1. */
+static void decode_bits(const unsigned char *in, unsigned int i,
+  unsigned int n, unsigned int width, uint32_t *base, uint32_t *out) {
+    const uint32_t mask = WIDTH_MASK(width);
+    unsigned long int bit = (unsigned long int) i * width;
+    const unsigned char *pos = in + bit / 8;
+    uint64_t buf = 0;
+    unsigned int bits = 0;
+    uint32_t docno = *base;
+
+    if ((i < n) && width && (bit % 8)) {
+        /* start part way through a byte */
+        buf = *pos++ >> (bit % 8);
+        bits = 8 - bit % 8;
+    }
+
+    for (; i < n; i++) {
+        while (bits < width) {
+            buf |= (uint64_t) *pos++ << bits;
+            bits += 8;
+        }
+        docno += ((uint32_t) buf & mask) + 1;
+        buf >>= width;
+        bits -= width;
+        out[i] = docno;
+    }
+
+    *base = docno;
+}
+
+unsigned int impactcodec_write(struct vec *v, const uint32_t *gaps,
+  unsigned int n) {
+    unsigned int i,
+                 width = 0,
+                 bits = 0,
+                 bytes;
+    uint32_t max = 0;
+    uint64_t buf = 0;
+    unsigned char *out;
+
+    assert(n <= IMPACTCODEC_CHUNK);
+    for (i = 0; i < n; i++) {
+        max |= gaps[i];
+    }
+    while ((width < 32) && (max >> width)) {
+        width++;
+    }
+
+    bytes = 1 + (n * width + 7) / 8;
+    if (VEC_LEN(v) < bytes) {
+        return 0;
+    }
+
+    out = (unsigned char *) v->pos;
+    *out++ = width;
+    for (i = 0; i < n; i++) {
+        buf |= (uint64_t) gaps[i] << bits;
+        bits += width;
+        while (bits >= 8) {
+            *out++ = (unsigned char) (buf & 0xff);
+            buf >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits) {
+        *out++ = (unsigned char) buf;
+    }
+
+    assert((char *) out == v->pos + bytes);
+    v->pos = (char *) out;
+    return bytes;
+}
+
+unsigned int impactcodec_read(struct vec *v, unsigned int n,
+  unsigned long int *docno, uint32_t *docnos) {
+    const unsigned char *in = (const unsigned char *) v->pos;
+    unsigned int width,
+                 bytes,
+                 done = 0;
+    uint32_t base = (uint32_t) *docno;
+
+    assert(n <= IMPACTCODEC_CHUNK);
+    if (!n || !VEC_LEN(v) || ((width = *in) > 32)) {
+        return 0;
+    }
+    bytes = 1 + (n * width + 7) / 8;
+    if (VEC_LEN(v) < bytes) {
+        return 0;
+    }
+    in++;
+
+#ifdef IMPACTCODEC_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        /* may read past the chunk, as long as it stays in the buffer */
+        done = decode_avx2(in, (const unsigned char *) v->end, n, width,
+            &base, docnos);
+    }
+#endif
+    decode_bits(in, done, n, width, &base, docnos);
+
+    *docno = base;
+    v->pos += bytes;
+    return n;
+}
+
@@ -16,15 +16,52 @@ extern "C" {
 #endif
 
 #include "docmap.h"
+#include "index.h"
 #include "vec.h"
 #include "zstdint.h"
 
-/* macros/fns for fast access to loaded entries */
-#define DOCMAP_GET_WORDS(docmap, docno) docmap->cache.words[docno] 
-#define DOCMAP_GET_DISTINCT_WORDS(docmap, docno) docmap->cache.dwords[docno] 
-#define DOCMAP_GET_WEIGHT(docmap, docno) docmap->cache.weight[docno] 
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
+/* macros/fns for fast access to loaded entries.  Lengths read from the column
+ * cache file stay packed, and words and weights can be cached as norms, so 
+ * these macros evaluate docno more than once. */
+#define DOCMAP_GET_WORDS(docmap, docno)                                       \
+    ((docmap)->cache.words ? (docmap)->cache.words[docno]                     \
+      : (docmap)->cache.nwords                                                \
+        ? (docmap)->cache.words_norm[(docmap)->cache.nwords[docno]]           \
+        : DOCMAP_PACKED_GET(&(docmap)->cache.pwords, docno))
+#define DOCMAP_GET_DISTINCT_WORDS(docmap, docno)                              \
+    ((docmap)->cache.dwords ? (docmap)->cache.dwords[docno]                   \
+      : DOCMAP_PACKED_GET(&(docmap)->cache.pdwords, docno))
+#define DOCMAP_GET_WEIGHT(docmap, docno)                                      \
+    ((docmap)->cache.weight ? (docmap)->cache.weight[docno]                   \
+      : (docmap)->cache.weight_norm[(docmap)->cache.nweight[docno]])
+/* evaluates to a pointer to the lengths-in-words of each field of docno */
+#define DOCMAP_GET_FIELD_WORDS(docmap, docno)                                 \
+    (&(docmap)->cache.fwords[(unsigned long int) (docno) * (docmap)->fields])
 unsigned int docmap_get_bytes_cached(struct docmap *dm, unsigned int docno);
 
+/* norms (see DOCMAP_CACHE_NORMS) hold values below DOCMAP_NORM_EXACT 
+ * exactly, and larger values to DOCMAP_NORM_EXACT significant steps per 
+ * doubling, so that they're within about 3% of the truth.  Weights are
+ * quantised in units of 1 / DOCMAP_NORM_WEIGHT_SCALE. */
+#define DOCMAP_NORM_EXACT 16
+#define DOCMAP_NORM_WEIGHT_SCALE 8.0F
+
+/* retrieve entry docno from a packed column (see struct docmap_packed).  
+ * Values are packed into a little-endian stream of bits, so each can be 
+ * read from the four bytes starting at the byte it starts in. */
+#define DOCMAP_PACKED_GET(col, docno)                                         \
+    ((col)->bits == 32 ? ((const uint32_t *) (col)->buf)[docno]               \
+      : DOCMAP_PACKED_BITS((col)->buf                                         \
+          + (((unsigned long int) (docno) * (col)->bits) >> 3),               \
+        ((unsigned long int) (docno) * (col)->bits) & 7, (col)->mask))
+#define DOCMAP_PACKED_BITS(pos, shift, mask)                                  \
+    ((((pos)[0] | ((pos)[1] << 8) | ((pos)[2] << 16)                          \
+        | ((uint32_t) (pos)[3] << 24)) >> (shift)) & (mask))
+
 struct fdset;
 
 /* represents a single entry within the docmap */
@@ -34,6 +71,7 @@ struct docmap_entry {
     unsigned int fileno;              /* repository file number */
     unsigned int dwords;              /* number of distinct words in doc */
     unsigned int words;               /* number of words in doc */
+    unsigned int fwords[INDEX_FIELDS];/* number of words in each field */
     float weight;                     /* the cosine weight of the doc */
     unsigned int bytes;               /* size of doc in bytes */
     enum mime_types mtype;            /* mime type of document */
@@ -63,6 +101,7 @@ struct docmap_cursor {
     uint32_t entries;                 /* number of entries in pos page */
     struct docmap_buffer *buf;        /* buffer we're operating on */
     unsigned int page;                /* page we're currently in */
+    unsigned int fields;              /* number of fields in entries */
 };
 
 /* structure to represent a cache buf */
@@ -72,6 +111,14 @@ struct docmap_cbuf {
     unsigned int size;
 };
 
+/* a column of unsigned integers each packed into bits bits (or held as whole
+ * uint32_t's if bits is 32), as read from the column cache file */
+struct docmap_packed {
+    const unsigned char *buf;         /* packed values */
+    unsigned int bits;                /* width of each value */
+    uint32_t mask;                    /* mask of the low bits bits */
+};
+
 /* describes a type exception */
 struct docmap_type_ex {
     unsigned int docno;
@@ -82,10 +129,12 @@ struct docmap {
     struct fdset *fdset;
     struct reposset *rset;
     int fd_type;
+    int col_type;                     /* type of column cache file, or -1 */
     unsigned int pagesize;            /* size of each page */
     unsigned long int entries;        /* number of entries in docmap */
     unsigned long int max_filesize;   /* maximum filesize in bytes */
     unsigned int file_pages;          /* maximum number of pages in a file */
+    unsigned int fields;              /* number of fields in each entry */
 
     struct docmap_buffer readbuf;     /* read buffer */
     struct docmap_buffer appendbuf;   /* append buffer */
@@ -110,6 +159,8 @@ struct docmap {
         unsigned int *words;          /* length-in-words cache */
         unsigned int *dwords;         /* length-in-distinct-words cache */
         float *weight;                /* cosine weight cache */
+        unsigned int *fwords;         /* length-in-words of each field 
+                                       * cache, fields entries per doc */
 
         unsigned int *trecno_off;     /* trec docnos, as offsets 
                                        * into trecno array */
@@ -122,6 +173,23 @@ struct docmap {
         struct docmap_type_ex *typeex;/* type exceptions (not X_TREC) */
         unsigned int typeex_len;      /* utilised length of typeex array */
         unsigned int typeex_size;     /* capacity of typeex array */
+
+        struct docmap_packed pwords;  /* length-in-words cache, when read 
+                                       * from the column cache file (words
+                                       * is then NULL) */
+        struct docmap_packed pdwords; /* length-in-distinct-words cache, 
+                                       * likewise */
+        char *columns;                /* contents of the column cache file 
+                                       * that cached quantities point into, 
+                                       * or NULL */
+        int columns_mapped;           /* whether columns is memory-mapped,
+                                       * rather than allocated */
+        enum docmap_cache columns_cache; /* quantities held in columns */
+
+        unsigned char *nwords;        /* length-in-words cache, as norms */
+        unsigned char *nweight;       /* cosine weight cache, as norms */
+        unsigned int words_norm[256]; /* length-in-words of each norm */
+        float weight_norm[256];       /* cosine weight of each norm */
     } cache;
 
     /* aggregate quantities */
@@ -139,7 +207,12 @@ struct docmap {
                                       * roots */
 
         double sum_trecno;           /* total length of trecno entries */
+        double sum_fwords[INDEX_FIELDS]; /* total words in each field */
     } agg;
+
+#ifdef MT_ZET
+    pthread_mutex_t mutex;            /* serialises use of the read cursor */
+#endif /* MT_ZET */
 };
 
 #ifdef __cplusplus
@@ -15,10 +15,15 @@ extern "C" {
 
 #include "firstinclude.h"
 
+#include "docmap.h"
 #include "index.h"
 #include "storagep.h"
 #include "stream.h"
 
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
 enum index_flags {
     INDEX_BUILT = (1 << 0),             /* the index has been constructed */
     INDEX_SORTED = (1 << 1),            /* the index is sorted by vocabulary 
@@ -49,15 +54,46 @@ struct index {
     struct iobtree *vocab;              /* vocabulary */
     struct docmap *map;                 /* document map */
     struct psettings *settings;         /* parser settings */
-    struct summarise *sum;              /* summary producing object */
+    struct summarise *sum;              /* summary producing object (NULL 
+                                         * while a search is using it) */
+    struct {
+        struct summarise **sum;         /* further idle summary producing 
+                                         * objects, for concurrent searches */
+        unsigned int len;               /* number of idle objects */
+        unsigned int size;              /* capacity of sum array */
+#ifdef MT_ZET
+        pthread_mutex_t mutex;          /* protects sum (above) and pool */
+#endif /* MT_ZET */
+    } sumpool;
+    struct {
+        struct denseacc **acc;          /* idle array accumulators, for 
+                                         * impact-ordered searches */
+        unsigned int len;               /* number of idle accumulators */
+        unsigned int size;              /* capacity of acc array */
+#ifdef MT_ZET
+        pthread_mutex_t mutex;          /* protects pool */
+#endif /* MT_ZET */
+    } accpool;
 
     struct stem_cache *stem;            /* stemmer cache (or NULL) */
+    struct cache *listcache;            /* recently used inverted lists, 
+                                         * keyed by vector type and term (or 
+                                         * NULL) */
+    struct cache *resultcache;          /* results of recent searches, keyed 
+                                         * by query and search options (or 
+                                         * NULL) */
     struct stop *istop;                 /* construction stoplist (or NULL) */
     struct stop *qstop;                 /* construction stoplist (or NULL) */
 
     /* construction stuff */
     struct postings *post;              /* accumulated in-memory postings */
     struct pyramid *merger;             /* pointers to dumped postings */
+    struct segments *segs;              /* segments updates are written to 
+                                         * (or NULL if they're merged into 
+                                         * the index) */
+    struct docstore *store;             /* compressed copy of the documents 
+                                         * (or NULL if they're retrieved from 
+                                         * the files indexed) */
     struct storagep storage;            /* storage parameters */
 
     /* 'types' for accessing files through the fdset */
@@ -68,6 +104,9 @@ struct index {
     unsigned int vtmp_type;             /* temporary vocabulary fileset type */
     unsigned int vocab_type;            /* vocab btree fileset type */
     unsigned int docmap_type;           /* docmap fileset type */
+    unsigned int mapcache_type;         /* docmap column cache fileset type */
+    unsigned int window_type;           /* gzip checkpoint window fileset type */
+    unsigned int store_type;            /* document store fileset type */
 
     struct {
         unsigned int parsebuf;          /* size of parse buffer */
@@ -104,6 +143,30 @@ struct index {
                                        positions vectors are in index */
     unsigned int impact_vectors;    /* indicates if impact ordered vectors 
                                        are in index */
+    unsigned int skip_vectors;      /* indicates if long document ordered
+                                       vectors have skip tables (and should 
+                                       be given them on update) */
+    unsigned int separate_positions;/* indicates if document ordered 
+                                       vectors store word positions after the
+                                       postings (and should on update) */
+    enum index_codec list_codec;    /* how document ordered vectors are 
+                                       compressed (other than 
+                                       INDEX_CODEC_VBYTE implies 
+                                       separate_positions) */
+    struct {
+        unsigned int build;         /* indicates if vocab entries have 
+                                       BOUNDS vectors (and should be given
+                                       them on update) */
+        double k1;                  /* okapi parameters they're for */
+        double b;
+        double mu;                  /* dirichlet parameter they're for */
+    } bounds;
+    unsigned int fields;            /* number of fields documents are divided
+                                       into (see INDEX_FIELDS), 1 if they 
+                                       aren't.  Word positions are tagged 
+                                       with their field (see 
+                                       postings_field_bits) */
+    unsigned int field_bits;        /* postings_field_bits(fields) */
 };
 
 /* internal function to merge the current postings into the index */
@@ -118,6 +181,24 @@ int index_commit_superblock(struct index *idx);
 /* internal function to atomically perform a read */
 ssize_t index_atomic_read(int fd, void *buf, unsigned int size);
 
+/* internal function to obtain a summary producing object for the exclusive
+ * use of one search, creating one if none are idle.  Returns NULL on 
+ * failure. */
+struct summarise *index_summarise_get(struct index *idx);
+
+/* internal function to return a summary producing object obtained from 
+ * index_summarise_get */
+void index_summarise_put(struct index *idx, struct summarise *sum);
+
+/* internal function to obtain array accumulators covering docs documents, 
+ * reset for a new query, for the exclusive use of one search.  Returns NULL 
+ * on failure. */
+struct denseacc *index_denseacc_get(struct index *idx, unsigned long int docs);
+
+/* internal function to return accumulators obtained from 
+ * index_denseacc_get */
+void index_denseacc_put(struct index *idx, struct denseacc *acc);
+
 /* internal function to atomically perform a write */
 ssize_t index_atomic_write(int fd, void *buf, unsigned int size);
 
@@ -130,6 +211,31 @@ int index_commit_internal(struct index *idx, unsigned int opts,
   struct index_commit_opt *opt,
   unsigned int addopts, struct index_add_opt *addopt);
 
+struct makeindex;
+struct postings;
+
+/* internal function to parse the file file, open for reading as fd, into
+ * post, with the first document numbered docno.  mimetype gives the type of
+ * the file, or NULL if it should be detected, and the type used is returned in
+ * *type.  enddoc is called with opaque after each document with the parser
+ * and the location of the document in the file (it may change the postings
+ * mi->post and document number mi->docs that the next document will be added
+ * to), and eof (if not NULL) after the end of the file.  Either returning 0
+ * aborts parsing.  Returns true on success. */
+int index_parse(struct index *idx, int fd, const char *file,
+  const char *mimetype, struct postings *post, unsigned long int docno,
+  int (*enddoc)(void *opaque, struct makeindex *mi, off_t offset,
+    unsigned int bytes, enum docmap_flag flags),
+  int (*eof)(void *opaque, struct makeindex *mi), void *opaque,
+  const char **type);
+
+/* internal function to copy repository repos, open for reading as fd, into
+ * the document store of idx, leaving the position of fd alone.  Documents 
+ * that aren't in the store are retrieved from the file instead, so failing 
+ * to store them isn't fatal, but an error is reported.  Returns true on 
+ * success. */
+int index_store(struct index *idx, unsigned int repos, int fd);
+
 /* function to return the stemming function used by an index */
 void (*index_stemmer(struct index *idx))(void *, char *);
 
@@ -137,6 +243,13 @@ void (*index_stemmer(struct index *idx))(void *, char *);
 enum stream_ret index_stream_read(struct stream *instream, int fd, 
   char *buf, unsigned int bufsize);
 
+/* utility function to create a filter that decompresses compressed repository
+ * source from the last checkpoint at or before offset.  The filter must be
+ * given the repository from *physoffset, and its output starts at *curroffset
+ * in the uncompressed data.  Returns NULL on failure. */
+struct stream_filter *index_repos_filter(const struct index *idx, 
+  unsigned int source, off_t offset, off_t *physoffset, off_t *curroffset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,6 +9,7 @@
 #ifndef PRIVATE_POSTINGS_H
 #define PRIVATE_POSTINGS_H
 
+#include "index.h"
 #include "vec.h"
 
 struct postings_node {
@@ -41,6 +42,10 @@ struct postings {
     int update_required;              /* whether there are unupdated postings */
     int err;                          /* last error that occurred or 0 */
     struct stop *stop;                /* build-time stoplist */
+    unsigned int fields;              /* number of fields */
+    unsigned int field_bits;          /* bits of positions holding field */
+    unsigned int field_terms[INDEX_FIELDS]; /* number of terms in each field
+                                       * of the current document */
 
     /* stemming function and opaque data for it */
     void *stem_opaque;
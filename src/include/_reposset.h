@@ -53,8 +53,23 @@ struct reposset_check {
     unsigned int reposno;              /* repository number */
     unsigned long int offset;          /* byte offset of checkpoint */
     enum mime_types comp;              /* compression type */
+
+    /* the following describe where decompression resumes from checkpoints
+     * part way through a file (see gzcheck.h).  They're all 0 for
+     * checkpoints at the start of a file. */
+    unsigned long int in_offset;       /* compressed offset to resume at */
+    unsigned int bits;                 /* bits of previous compressed byte
+                                        * that haven't been consumed */
+    unsigned int prime;                /* value of those bits */
+    unsigned long int window;          /* offset of window in window file */
+    unsigned int window_len;           /* (compressed) length of window */
 };
 
+/* add a checkpoint, which may be part way through a repository.  Checkpoints
+ * must be added in order of repository and offset. */
+enum reposset_ret reposset_add_resume(struct reposset *rset, 
+  const struct reposset_check *check);
+
 /* returns a pointer to the first checkpoint in repos array */
 struct reposset_check *reposset_check_first(struct reposset *rset);
 
@@ -63,6 +78,11 @@ struct reposset_check *reposset_check_first(struct reposset *rset);
 struct reposset_check *reposset_check(struct reposset *rset, 
   unsigned int reposno);
 
+/* returns a pointer to the last checkpoint in the given repository at or
+ * before offset, or NULL if there isn't one */
+struct reposset_check *reposset_check_at(struct reposset *rset, 
+  unsigned int reposno, unsigned long int offset);
+
 /* returns number of checkpoint entries */
 unsigned int reposset_checks(struct reposset *rset);
 
@@ -0,0 +1,79 @@
+/* blockcodec.h declares an interface to encode and decode blocks of integers
+ * using the Stream VByte scheme, which is an alternative to the vbyte coding
+ * in vec.h for document ordered lists.
+ *
+ * vbyte coding interleaves the length of each number with its data, so each
+ * byte read depends on the one before it and decoding branches on every
+ * byte.  Stream VByte instead stores the lengths of a group of numbers
+ * (2 bits each) separately from their data bytes, so that the data can be
+ * decoded with a handful of table lookups, or a single shuffle instruction
+ * for each four numbers on processors that have one.  See Lemire, Kurz and
+ * Rupp, Stream VByte: Faster Byte-Oriented Integer Compression (2017).
+ *
+ * Each block is self-delimiting, so that it can be decoded from a stream once
+ * it has been entirely read in:
+ *
+ *   <n, datalen, (n + 3) / 4: control, datalen: data>
+ *
+ * where n (the number of integers) and datalen are vbyte encoded, each
+ * control byte gives the length less one of four numbers (the first in the
+ * least significant two bits), and the data holds each number in the given
+ * number of little-endian bytes.  Only numbers of up to 32 bits can be
+ * stored.
+ *
+ * Document ordered lists coded this way (VOCAB_VTYPE_DOCWP_BLOCK) store
+ * their <d-gap, f_dt> pairs in blocks of BLOCKCODEC_POSTINGS postings.
+ *
+ */
+
+#ifndef BLOCKCODEC_H
+#define BLOCKCODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "zstdint.h"
+
+struct vec;
+
+/* number of postings in a full block of a document ordered list */
+#define BLOCKCODEC_POSTINGS 128
+
+/* maximum number of integers in a block (a d-gap and an f_dt per posting) */
+#define BLOCKCODEC_INTS (2 * BLOCKCODEC_POSTINGS)
+
+/* maximum number of bytes a block can occupy (the two vbyte numbers at the
+ * start of a block take no more than 4 bytes between them) */
+#define BLOCKCODEC_MAX_BYTES (4 + BLOCKCODEC_INTS / 4 + 4 * BLOCKCODEC_INTS)
+
+/* a decoded block, which is consumed an integer at a time */
+struct blockcodec_block {
+    unsigned int n;                  /* number of integers decoded */
+    unsigned int pos;                /* index of next integer to consume */
+    uint32_t ints[BLOCKCODEC_INTS];  /* decoded integers */
+};
+
+/* write the n integers in ints (n must be at most BLOCKCODEC_INTS) to v as a
+ * block.  Returns the number of bytes written, or 0 if there wasn't enough
+ * space in v (which is then unchanged). */
+unsigned int blockcodec_write(struct vec *v, const uint32_t *ints,
+  unsigned int n);
+
+/* read the block at the start of v into ints (which must have space for
+ * BLOCKCODEC_INTS integers), advancing v past it.  Returns the number of
+ * integers read, or 0 if v doesn't contain the whole block or the block is
+ * malformed (v is then unchanged). */
+unsigned int blockcodec_read(struct vec *v, uint32_t *ints);
+
+/* scan over the block at the start of v without decoding it, advancing v past
+ * it.  Returns the number of integers in the block, or 0 if v doesn't contain
+ * the whole block (v is then unchanged). */
+unsigned int blockcodec_scan(struct vec *v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,69 @@
+/* bound_build.h declares a function to add upper bounds on the scores of
+ * postings to the vocabulary of an index, so that queries can tell how much
+ * a term might contribute to a document's score without decoding its list.
+ *
+ * Each document ordered vector in the vocab is followed by a
+ * VOCAB_VTYPE_BOUNDS vector (see vocab.h), which holds the largest f_dt in
+ * the list, the largest contribution that a single query occurrance of the
+ * term can make to an okapi or dirichlet score, and (for lists long enough
+ * to have skip tables) the largest f_dt in each block of postings.  Block
+ * boundaries fall on skip table boundaries, so a block can be passed over
+ * using the skip table when its bound shows that it can't matter.
+ *
+ * Scores depend on collection statistics, so the bounds only hold until the
+ * index is next updated.  Updates drop them while merging, and then
+ * recompute them for the whole index if it had them.  They are computed
+ * using the exact length of each document, or the length given by its norm
+ * if that's shorter, so that they also hold for searchers caching lengths as
+ * norms.
+ *
+ */
+
+#ifndef BOUND_BUILD_H
+#define BOUND_BUILD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct index;
+
+/* default okapi and dirichlet parameters that bounds are computed for (the
+ * same as the defaults used by searches) */
+#define BOUND_DEFAULT_K1 1.2
+#define BOUND_DEFAULT_B 0.75
+#define BOUND_DEFAULT_MU 1500.0
+
+/* most blocks that a list is divided into.  Blocks are of
+ * SKIP_DEFAULT_INTERVAL postings, or of the smallest power of two multiple
+ * of that which gives no more than this many blocks */
+#define BOUND_MAX_BLOCKS 64
+
+enum bound_ret {
+    BOUND_OK = 0,
+    BOUND_FMT_ERROR = -1,    /* error with format of input index */
+    BOUND_IO_ERROR = -2,     /* I/O error */
+    BOUND_MEM_ERROR = -3,    /* out of memory */
+    BOUND_OTHER_ERROR = -10  /* some other error */
+};
+
+/* (re)compute the bounds of every document ordered list in idx, for okapi
+ * parameters k1 and b and dirichlet parameter mu, replacing any that it
+ * already has.  The new vocabulary is written to the index's temporary
+ * vocab files and renamed over the current files (the vectors themselves
+ * aren't rewritten).  The parameters are recorded in the index, so that
+ * later updates compute bounds for them too, and the superblock is
+ * committed. */
+enum bound_ret bound_build_index(struct index *idx, double k1, double b,
+  double mu);
+
+/* return the number of postings in each block of the per-block bounds of a
+ * list of docs postings, or 0 if it isn't given per-block bounds */
+unsigned long int bound_interval(unsigned long int docs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,96 @@
+/* buildpool.h declares a pool of threads that parse files into an index under
+ * construction concurrently, so that building an index can use all of the
+ * processors in a machine.
+ *
+ * Each thread parses a run of consecutive files into postings of its own,
+ * numbering documents from 0, and hands them to a merging thread.  The merging
+ * thread adds the documents to the docmap and dumps the postings (renumbered
+ * to where they belong) into the merging pyramid in file order, performing the
+ * merges the pyramid asks for while parsing continues.  As a result the index
+ * produced is identical to one built by calling index_add for each file.
+ *
+ * Files are submitted with buildpool_submit, and the outcome of adding each of
+ * them is collected (oldest first) with buildpool_next.  If zettair was built
+ * without thread support (MT_ZET), the pool has only one thread, or the index
+ * has already been constructed (so that adding files updates it), files are
+ * added with index_add as they are submitted.
+ *
+ * Each thread accumulates as much as index_add would before dumping, and about
+ * as many runs again can be waiting to be merged, so the pool uses up to about
+ * twice threads times the accumulation memory of index_add.
+ * Nothing else may change the index while the pool exists.
+ *
+ */
+
+#ifndef BUILDPOOL_H
+#define BUILDPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "index.h"
+
+enum buildpool_ret {
+    BUILDPOOL_OK = 0,           /* success */
+    BUILDPOOL_EMPTY = 1,        /* no files are outstanding */
+
+    BUILDPOOL_ERR = -1,         /* unexpected error */
+    BUILDPOOL_ENOMEM = -2       /* couldn't obtain sufficient memory */
+};
+
+struct buildpool;
+
+/* the outcome of adding a file to the index */
+struct buildpool_result {
+    char *file;                      /* file, as submitted */
+    void *userdata;                  /* userdata, as submitted */
+    int ok;                          /* true if the file was added */
+    unsigned long int docno;         /* first document number assigned */
+    unsigned int docs;               /* number of documents in the file */
+    const char *detected_type;       /* type the file was indexed as */
+    double seconds;                  /* time taken to add the file */
+};
+
+/* create a new pool of threads threads to add files to idx, with options as
+ * for index_add.  Returns NULL on failure. */
+struct buildpool *buildpool_new(struct index *idx, unsigned int threads,
+  unsigned int opts, struct index_add_opt *opt,
+  unsigned int commitopts, struct index_commit_opt *commitopt);
+
+/* delete a pool, waiting for all submitted files to be added to the index
+ * (unless adding one of them failed) and discarding all outstanding
+ * results.  The index can be committed afterward. */
+void buildpool_delete(struct buildpool *pool);
+
+/* submit a file to be added to the index, with type mimetype (or NULL to
+ * detect it).  The file name and type are copied, and userdata is handed back
+ * with the result.  Returns BUILDPOOL_OK on success. */
+enum buildpool_ret buildpool_submit(struct buildpool *pool, const char *file,
+  const char *mimetype, void *userdata);
+
+/* wait for the oldest outstanding file to be added to the index (or for that
+ * to fail), and hand the result to the caller in *res, which must be deleted
+ * with buildpool_result_delete.  Once adding a file has failed, all files not
+ * yet added fail too.  Returns BUILDPOOL_OK on success and BUILDPOOL_EMPTY if
+ * no files are outstanding. */
+enum buildpool_ret buildpool_next(struct buildpool *pool,
+  struct buildpool_result **res);
+
+/* return the number of files submitted whose results haven't been
+ * collected */
+unsigned int buildpool_pending(const struct buildpool *pool);
+
+/* return the number of threads parsing files (1 if files are added as they
+ * are submitted) */
+unsigned int buildpool_threads(const struct buildpool *pool);
+
+/* delete results returned by buildpool_next */
+void buildpool_result_delete(struct buildpool_result *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,76 @@
+/* cache.h declares a cache of variable-length values, keyed by strings, that
+ * holds at most a given number of bytes by discarding the least recently used
+ * values.  Values found in the cache are pinned until they are released, so
+ * that they remain valid while they're in use even if they're discarded (or
+ * replaced) in the meantime.  If zettair was built with thread support
+ * (MT_ZET), a cache can be shared between threads.
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum cache_ret {
+    CACHE_OK = 0,                   /* success */
+
+    CACHE_ENOMEM = -1,              /* couldn't obtain sufficient memory */
+    CACHE_ETOOBIG = -2              /* value is too large to be cached */
+};
+
+struct cache;
+
+/* create a new cache holding at most size bytes (including the space taken
+ * up by keys and bookkeeping).  Returns NULL on failure. */
+struct cache *cache_new(unsigned long int size);
+
+/* delete a cache.  No values may be pinned. */
+void cache_delete(struct cache *cache);
+
+/* find the value stored under key (of length keylen), returning a pointer to
+ * it and writing its length into *len, or returning NULL if it isn't cached.
+ * A value that is found is pinned, and must be released with cache_release
+ * once the caller is finished with it. */
+const void *cache_find(struct cache *cache, const char *key,
+  unsigned int keylen, unsigned int *len);
+
+/* release a value returned by cache_find or cache_insert */
+void cache_release(struct cache *cache, const void *value);
+
+/* allocate space for a value of len bytes, which can be filled in and then
+ * stored with cache_insert.  Returns NULL on failure. */
+void *cache_alloc(unsigned int len);
+
+/* free a value allocated by cache_alloc that wasn't stored in a cache */
+void cache_free(void *value);
+
+/* store value (allocated by cache_alloc) in the cache under key (of length
+ * keylen), replacing whatever was stored under it, and discarding least
+ * recently used values to make room for it.  On success the cache takes
+ * ownership of value, and if pin is true it is pinned as if found by
+ * cache_find.  On failure the caller retains ownership of value.  Returns
+ * CACHE_OK on success. */
+enum cache_ret cache_insert(struct cache *cache, const char *key,
+  unsigned int keylen, void *value, int pin);
+
+/* discard all values from the cache (pinned values remain valid until they
+ * are released) */
+void cache_clear(struct cache *cache);
+
+/* return the maximum number of bytes held by the cache */
+unsigned long int cache_size(const struct cache *cache);
+
+/* write the number of times a value has been looked for in the cache into
+ * *lookups, and the number of times it was found into *hits */
+void cache_stats(struct cache *cache, unsigned long int *lookups,
+  unsigned long int *hits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
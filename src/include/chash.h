@@ -84,6 +84,12 @@ unsigned int chash_reserve(struct chash *hash, unsigned int reserve);
  *   associated with the key into *data (so you can change the data in-situ -
  *   although you should beware cases where this changes the key!) on success
  *
+ * chash_[keytype]_[datatype]_peek:
+ *   find first instance matching given key, writing a copy of the data
+ *   associated with the key into *data on success.  Unlike find, peek doesn't
+ *   change the hashtable (find moves the entry to the front of its chain), so
+ *   many threads can peek at once.  Returns CHASH_OK on success.
+ *
  * chash_[keytype]_[datatype]_find_insert:
  *   find entry associated with key, or insert a new entry using ins_data if it
  *   can't be found.  On all successful cases, *fnd_data is written with a
@@ -111,6 +117,8 @@ enum chash_ret chash_ptr_ptr_find(struct chash *hash, const void *key,
   void ***data);
 enum chash_ret chash_ptr_ptr_find_insert(struct chash *hash, const void *key, 
   void ***fnd_data, void *ins_data, int *find);
+enum chash_ret chash_ptr_ptr_peek(const struct chash *hash, const void *key, 
+  void **data);
 enum chash_ret chash_ptr_ptr_foreach(struct chash *hash, void *userdata,
   void (*fn)(void *userdata, const void *key, void **data));
 enum chash_ret chash_iter_ptr_ptr_next(struct chash_iter *iter, 
@@ -127,6 +135,8 @@ enum chash_ret chash_ptr_luint_find(struct chash *hash, const void *key,
 enum chash_ret chash_ptr_luint_find_insert(struct chash *hash, 
   const void *key, unsigned long int **fnd_data, unsigned long int ins_data, 
   int *find);
+enum chash_ret chash_ptr_luint_peek(const struct chash *hash, const void *key, 
+  unsigned long int *data);
 enum chash_ret chash_ptr_luint_foreach(struct chash *hash, void *userdata,
   void (*fn)(void *userdata, const void *key, unsigned long int *data));
 enum chash_ret chash_iter_ptr_luint_next(struct chash_iter *iter, 
@@ -51,8 +51,11 @@
 #define REPOSSUF "repos"       /* repository file extension name */
 #define VECTORSUF "v"          /* vector file extension name */
 #define DOCMAPSUF "map"        /* map file extension name */
+#define MAPCACHESUF "mapcache" /* map column cache file extension name */
 #define VOCABSUF "vocab"       /* vocabulary file extension name */
 #define PARAMSUF "param"       /* parameters file extension name */
+#define WINDOWSUF "gzw"        /* gzip checkpoint window file extension name */
+#define STORESUF "store"       /* document store file extension name */
 
 /* prompt for query interface */
 #define PROMPT "> "
@@ -91,5 +94,16 @@
  * smaller than 0.5 */
 #define SEARCH_SAMPLES_MIN 0.05  /* 5% */
 
+/* queries that may produce accumulators for more than 1/SEARCH_DENSE_RATIO of
+ * the collection without reaching the accumulator limit are evaluated using
+ * dense accumulators rather than a list */
+#define SEARCH_DENSE_RATIO 32
+
+/* updates written as segments (see segment.h) are merged once there are
+ * SEGMENT_MERGE_FACTOR segments in a tier, tiers growing by that factor from
+ * SEGMENT_TIER_BASE bytes of postings */
+#define SEGMENT_MERGE_FACTOR 4
+#define SEGMENT_TIER_BASE (1024 * 1024)
+
 #endif
 
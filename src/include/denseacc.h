@@ -0,0 +1,79 @@
+/* denseacc.h declares accumulators held in an array indexed by document
+ * number, for evaluating queries over collections small enough that an
+ * accumulator per document fits comfortably in memory.  Adding to an
+ * accumulator is then an array access rather than a hashtable probe.
+ *
+ * The array is divided into pages of DENSEACC_PAGE documents, each tagged
+ * with the epoch (query) that last used it.  Starting a new query just
+ * increments the epoch, and pages are zeroed when first touched in an epoch,
+ * so that reusing the array for another query costs time proportional to the
+ * number of pages the previous one touched, not the size of the collection.
+ * The pages touched are kept in a list, so that accumulators can be
+ * traversed in the same time.
+ *
+ * An accumulator of zero is one that doesn't exist, so contributions must be
+ * positive.  A denseacc may only be used by one thread at a time.
+ *
+ */
+
+#ifndef DENSEACC_H
+#define DENSEACC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DENSEACC_PAGE_BITS 10
+#define DENSEACC_PAGE (1U << DENSEACC_PAGE_BITS)
+
+struct denseacc {
+    unsigned int *acc;               /* accumulators, by document number */
+    unsigned int *epoch;             /* epoch each page was last used in */
+    unsigned int *touched;           /* pages used in current epoch, in
+                                      * order of first use */
+    unsigned int touches;            /* number of pages in touched */
+    unsigned int pages;              /* number of pages */
+    unsigned long int docs;          /* number of documents covered */
+    unsigned long int size;          /* number of non-zero accumulators */
+    unsigned int current;            /* current epoch */
+};
+
+/* create a new set of accumulators covering documents 0 to docs - 1.
+ * Returns NULL on failure. */
+struct denseacc *denseacc_new(unsigned long int docs);
+
+/* delete a set of accumulators */
+void denseacc_delete(struct denseacc *acc);
+
+/* start a new epoch, making all accumulators zero, and making sure that
+ * documents 0 to docs - 1 are covered.  Returns true on success and 0 if it
+ * couldn't get enough memory (in which case acc is unchanged). */
+int denseacc_reset(struct denseacc *acc, unsigned long int docs);
+
+/* zero page page for the current epoch (use DENSEACC_TOUCH instead) */
+void denseacc_touch(struct denseacc *acc, unsigned int page);
+
+/* make sure the page of accumulators da containing docno has been zeroed
+ * for the current epoch */
+#define DENSEACC_TOUCH(da, docno)                                             \
+    do {                                                                      \
+        if ((da)->epoch[(docno) >> DENSEACC_PAGE_BITS] != (da)->current) {    \
+            denseacc_touch((da), (docno) >> DENSEACC_PAGE_BITS);              \
+        }                                                                     \
+    } while (0)
+
+/* return the accumulator in da for docno in the current epoch */
+#define DENSEACC_GET(da, docno)                                               \
+    (((da)->epoch[(docno) >> DENSEACC_PAGE_BITS] == (da)->current)            \
+      ? (da)->acc[docno] : 0)
+
+/* return the number of bytes that accumulators covering docs documents
+ * occupy */
+unsigned long int denseacc_memsize(unsigned long int docs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -37,7 +37,25 @@ enum docmap_cache {
     DOCMAP_CACHE_WORDS = (1 << 2),
     DOCMAP_CACHE_DISTINCT_WORDS = (1 << 3),
     DOCMAP_CACHE_WEIGHT = (1 << 4),
-    DOCMAP_CACHE_TRECNO = (1 << 5)
+    DOCMAP_CACHE_TRECNO = (1 << 5),
+    DOCMAP_CACHE_NORMS = (1 << 6),     /* hold cached words and weights as
+                                        * 8-bit quantised norms, which take
+                                        * a quarter of the space but are 
+                                        * only approximate */
+    DOCMAP_CACHE_FIELD_WORDS = (1 << 7) /* length-in-words of each field */
+};
+
+/* a point in a compressed repository from which decompression can be
+ * resumed (see gzcheck.h) */
+struct docmap_checkpoint {
+    off_t offset;                 /* offset in uncompressed data */
+    off_t in_offset;              /* offset of compressed data to resume 
+                                   * from (0 at the start of the file) */
+    unsigned int bits;            /* bits of previous compressed byte that
+                                   * haven't been consumed */
+    unsigned int prime;           /* value of those bits */
+    unsigned long int window;     /* offset of window in window file */
+    unsigned int window_len;      /* (compressed) length of window */
 };
 
 struct docmap;
@@ -49,7 +67,14 @@ struct docmap;
  *  RET.  PAGES is the number of docmap pages to hold in memory.  MAX_FILESIZE
  *  governs how often the docmap starts a new file (in bytes).  CACHE 
  *  determines  what quantities are held in-memory by the docmap 
- *  (can be changed later using docmap_cache())
+ *  (can be changed later using docmap_cache()).  COL_TYPE is the fdset type
+ *  of the column cache file, which holds the cached quantities in a form that
+ *  can be used without decoding them (so that loading the docmap is cheap), 
+ *  or -1 to keep them in the docmap itself.  If files of type COL_TYPE are 
+ *  memory-mapped (see fdset_set_type_map()) the column cache file is used in
+ *  place, otherwise it is read into memory in one go.  FIELDS is the number
+ *  of fields (see INDEX_FIELDS) that the docmap records the length of each
+ *  document in, 1 if documents aren't divided into fields.
  *
  *  Status values:
  *
@@ -57,9 +82,9 @@ struct docmap;
  *  DOCMAP_MEM_ERROR  - out of memory.
  */
 struct docmap *docmap_new(struct fdset *fdset, 
-  int fd_type, unsigned int pagesize, unsigned int pages, 
-  unsigned long int max_filesize, enum docmap_cache cache, 
-  enum docmap_ret *ret);
+  int fd_type, int col_type, unsigned int pagesize, unsigned int pages, 
+  unsigned long int max_filesize, unsigned int fields, 
+  enum docmap_cache cache, enum docmap_ret *ret);
 
 /*
  *  Load a docmap.
@@ -76,9 +101,9 @@ struct docmap *docmap_new(struct fdset *fdset,
  *  DOCMAP_FMT_ERROR   - error in the on-disk format
  */
 struct docmap *docmap_load(struct fdset *fdset, 
-  int fd_type, unsigned int pagesize, unsigned int pages, 
-  unsigned long int max_filesize, enum docmap_cache cache, 
-  enum docmap_ret *ret);
+  int fd_type, int col_type, unsigned int pagesize, unsigned int pages, 
+  unsigned long int max_filesize, unsigned int fields, 
+  enum docmap_cache cache, enum docmap_ret *ret);
 
 /*
  *  Save the docmap to disk.
@@ -102,7 +127,8 @@ void docmap_delete(struct docmap *docmap);
  *  DOC_INFO specifies the document to add.  The docmap will set 
  *  DOCNO to the new document number; the passed-in value
  *  is ignored.  TRECNO_LEN specifies the length of the TRECNO entry
- *  (NUL-termination is ignored)
+ *  (NUL-termination is ignored).  FIELD_WORDS gives the number of WORDS 
+ *  in each of the docmap's fields, or is NULL if they're all in field 0.
  *
  *  Return values:
  *
@@ -114,9 +140,9 @@ void docmap_delete(struct docmap *docmap);
 enum docmap_ret docmap_add(struct docmap *docmap, 
   unsigned int sourcefile, off_t offset, 
   unsigned int bytes, enum docmap_flag flags, 
-  unsigned int words, unsigned int distinct_words,
-  float weight, const char *trecno, unsigned trecno_len, 
-  enum mime_types type, unsigned long int *docno);
+  unsigned int words, unsigned int distinct_words, 
+  const unsigned int *field_words, float weight, const char *trecno, 
+  unsigned trecno_len, enum mime_types type, unsigned long int *docno);
 
 /*
  *  Get the TREC document number for a document.
@@ -158,6 +184,33 @@ enum docmap_ret docmap_get_location(struct docmap *docmap,
   off_t *offset, unsigned int *bytes, enum mime_types *type,
   enum docmap_flag *flags);
 
+/*
+ *  Add a checkpoint part way through compressed repository SOURCEFILE,
+ *  which must hold documents already added to the docmap.  Checkpoints
+ *  must be added in order of offset.  (A checkpoint at the start of each 
+ *  compressed repository is added by docmap_add.)
+ *
+ *  Return values:
+ *
+ *  DOCMAP_OK           - checkpoint added ok.
+ *  DOCMAP_MEM_ERROR    - out of memory
+ *  DOCMAP_ARG_ERROR    - repository isn't compressed
+ */
+enum docmap_ret docmap_add_checkpoint(struct docmap *docmap,
+  unsigned int sourcefile, const struct docmap_checkpoint *point);
+
+/*
+ *  Get the last checkpoint in compressed repository SOURCEFILE at or 
+ *  before OFFSET (in uncompressed data), writing it into POINT.
+ *
+ *  Return values:
+ *
+ *  DOCMAP_OK           - checkpoint retrieved ok.
+ *  DOCMAP_ARG_ERROR    - repository isn't compressed
+ */
+enum docmap_ret docmap_get_checkpoint(struct docmap *docmap,
+  unsigned int sourcefile, off_t offset, struct docmap_checkpoint *point);
+
 /*
  *  Get the number of bytes for a document.
  *
@@ -206,6 +259,23 @@ enum docmap_ret docmap_get_words(struct docmap *docmap,
 enum docmap_ret docmap_get_distinct_words(struct docmap *docmap,
   unsigned long int docno, unsigned int *distinct_words);
 
+/*
+ *  Get the number of words in each field of a document.
+ *
+ *  DOCNO must be less than the number of documents.
+ *  The number of words in each of the docmap's fields is written out into
+ *  FIELD_WORDS, which must have room for docmap_fields() entries.
+ *
+ *  Return values:
+ *
+ *  DOCMAP_OK         - field information retrieved ok.
+ *  DOCMAP_MEM_ERROR  - error allocating memory internally
+ *  DOCMAP_FMT_ERROR  - error in on-disk format
+ *  DOCMAP_IO_ERROR   - error reading info from disk
+ */
+enum docmap_ret docmap_get_field_words(struct docmap *docmap,
+  unsigned long int docno, unsigned int *field_words);
+
 /*
  *  Get the weight of a document.
  *
@@ -296,9 +366,27 @@ enum docmap_ret docmap_avg_words(struct docmap *docmap, double *avg_words);
 enum docmap_ret docmap_avg_distinct_words(struct docmap *docmap,
   double *avg_distinct_words);
 
+/*
+ *  Get the average number of words in each field of a document, writing 
+ *  docmap_fields() averages into AVG_FIELD_WORDS.
+ *
+ *  Return values:
+ *
+ *  DOCMAP_OK         - information retrieved ok.
+ */
+enum docmap_ret docmap_avg_field_words(struct docmap *docmap,
+  double *avg_field_words);
+
+/* Get the number of fields the docmap records the length of documents in */
+unsigned int docmap_fields(struct docmap *docmap);
+
 /* Get the number of documents in the docmap */
 unsigned long int docmap_entries(struct docmap *docmap);
 
+/* Get the number of words that a document of words words is taken to have
+ * when DOCMAP_CACHE_NORMS is cached */
+unsigned int docmap_norm_words(unsigned int words);
+
 /* Get a string described a docmap error code. */
 const char *docmap_strerror(enum docmap_ret nd_ret);
 
@@ -306,7 +394,10 @@ const char *docmap_strerror(enum docmap_ret nd_ret);
 enum docmap_cache docmap_get_cache(struct docmap *docmap);
 
 /* set the values for the docmap to cache (this may cause the docmap to read 
- * all values from disk) */
+ * all values from disk).  Changing what is cached isn't safe while other 
+ * threads are reading from the docmap, so concurrent searchers should cache
+ * everything they need beforehand; reads that aren't cached are safe, but 
+ * serialised. */
 enum docmap_ret docmap_cache(struct docmap *docmap, 
   enum docmap_cache cache);
 
@@ -0,0 +1,95 @@
+/* docstore.h declares a document store, which keeps a compressed copy of the
+ * files indexed, so that documents can be retrieved without the original
+ * files (which needn't be shipped with the index), and without decompressing
+ * whole gzip files to get at them.
+ *
+ * The text of each file (after decompressing it, if it was compressed) is
+ * cut into blocks of DOCSTORE_BLOCK bytes, the last of which may be short,
+ * and each block is compressed on its own with a fast setting of zlib.
+ * Documents are still located through the docmap, by repository number and
+ * offset: the offset gives the block and the position within it directly.
+ * Recently used blocks are kept (uncompressed) in a small cache.
+ *
+ * Blocks are appended to files of their own, and the table of where they are
+ * is written into the index parameter file.
+ *
+ */
+
+#ifndef DOCSTORE_H
+#define DOCSTORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+/* number of bytes of text in a block */
+#define DOCSTORE_BLOCK (16 * 1024)
+
+/* default number of bytes of uncompressed blocks to cache */
+#define DOCSTORE_CACHE (256 * DOCSTORE_BLOCK)
+
+enum docstore_ret {
+    DOCSTORE_OK = 0,                /* success */
+
+    DOCSTORE_ERR = -1,              /* unexpected error */
+    DOCSTORE_ENOMEM = -2,           /* couldn't obtain sufficient memory */
+    DOCSTORE_EIO = -3,              /* couldn't read or write a file */
+    DOCSTORE_ENOENT = -4,           /* repository isn't in the store */
+    DOCSTORE_EINVAL = -5            /* file or block couldn't be
+                                     * decompressed */
+};
+
+struct fdset;
+struct docstore;
+
+/* create an empty document store, writing blocks to files of fdset type
+ * type, none of which will be longer than max_filesize.  Up to cache bytes of
+ * blocks are cached.  Returns NULL on failure. */
+struct docstore *docstore_new(struct fdset *fds, unsigned int type,
+  unsigned long int max_filesize, unsigned long int cache);
+
+/* delete a document store (leaving its files alone) */
+void docstore_delete(struct docstore *ds);
+
+/* remove the files of a document store */
+void docstore_rm(struct docstore *ds);
+
+/* read the table of blocks from the index parameter file fp (as written by
+ * docstore_write).  Returns DOCSTORE_OK on success. */
+enum docstore_ret docstore_read(struct docstore *ds, FILE *fp);
+
+/* write the table of blocks to the index parameter file fp.  Returns
+ * DOCSTORE_OK on success. */
+enum docstore_ret docstore_write(struct docstore *ds, FILE *fp);
+
+/* add repository repos to the store, reading it from fd (from its current
+ * position) and decompressing it if it's compressed.  Documents must not be
+ * being retrieved meanwhile.  Returns DOCSTORE_OK on success. */
+enum docstore_ret docstore_add(struct docstore *ds, unsigned int repos,
+  int fd);
+
+/* return true if repository repos is in the store */
+int docstore_contains(const struct docstore *ds, unsigned int repos);
+
+/* copy up to len bytes from offset in (the uncompressed text of) repository
+ * repos into dst, writing the number of bytes copied into *copied (which is
+ * less than len only at the end of the repository).  Any number of threads
+ * can retrieve at once.  Returns DOCSTORE_OK on success. */
+enum docstore_ret docstore_retrieve(struct docstore *ds, unsigned int repos,
+  unsigned long int offset, void *dst, unsigned int len,
+  unsigned int *copied);
+
+/* write the size of the block cache into *size, the number of times a block
+ * has been looked for in it into *lookups, and the number of times it was
+ * found into *hits */
+void docstore_cache_stats(struct docstore *ds, unsigned long int *size,
+  unsigned long int *lookups, unsigned long int *hits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
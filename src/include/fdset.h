@@ -24,6 +24,15 @@ enum {
     FDSET_OK = 0
 };
 
+/* how (and whether) files of a type are memory-mapped by fdset_map */
+enum fdset_map {
+    FDSET_MAP_NONE = 0,            /* don't map files of this type */
+    FDSET_MAP_SEQUENTIAL = 1,      /* map files of this type, which are read 
+                                    * in long runs */
+    FDSET_MAP_RANDOM = 2           /* map files of this type, which are read 
+                                    * a page at a time */
+};
+
 struct fdset;
 
 /* FIXME: security of file creation */
@@ -117,6 +126,35 @@ int fdset_close_file(struct fdset *set, unsigned int type, unsigned int fileno);
  * exist for this file. */
 int fdset_unlink(struct fdset *set, unsigned int type, unsigned int fileno);
 
+/* arrange for files of the given type to be memory-mapped (read-only) by 
+ * fdset_map, with map indicating how they'll be read.  Returns FDSET_OK on
+ * success, -ENOSYS if memory-mapping isn't available and -errno on other 
+ * failures. */
+int fdset_set_type_map(struct fdset *set, unsigned int type, 
+  enum fdset_map map);
+
+/* get a read-only memory mapping of the whole of the file specified by type 
+ * and fileno, mapping it if it hasn't been already.  The address and length 
+ * of the mapping are written into *addr and *len.  The mapping remains valid
+ * until the file is closed with fdset_close_file or unlinked, or the fdset is
+ * deleted, but doesn't grow with the file.  Returns FDSET_OK on success and
+ * -errno on failure (including -EINVAL if the type isn't mapped). */
+int fdset_map(struct fdset *set, unsigned int type, unsigned int fileno, 
+  const char **addr, unsigned long int *len);
+
+/* advise that the len bytes at addr, within a mapping returned by fdset_map,
+ * are about to be read through */
+void fdset_map_willneed(const void *addr, unsigned long int len);
+
+/* advise that the len bytes at offset in the file specified by type and fileno
+ * are about to be read, so that the operating system can start reading them in
+ * the background (using posix_fadvise, or madvise if the file is mapped).
+ * Advice is given for many ranges at once to have them read concurrently.
+ * Returns FDSET_OK on success (including if advice can't be given on this
+ * system) and -errno on failure. */
+int fdset_willneed(struct fdset *set, unsigned int type, unsigned int fileno,
+  unsigned long int offset, unsigned long int len);
+
 /* debugging code. */
 
 int fdset_debug_create(struct fdset *set, unsigned int typeno, 
@@ -0,0 +1,73 @@
+/* gzcheck.h declares functions to find checkpoints in gzip files, from which
+ * decompression can be resumed without decompressing everything before them.
+ * Checkpoints are placed at the boundaries of deflate blocks.  Since the
+ * compressed data following a checkpoint can refer back to the last
+ * GZCHECK_WINDOW bytes of uncompressed data, and needn't start on a byte
+ * boundary, a checkpoint has to record both that window and the bits of the
+ * last compressed byte that haven't been consumed.
+ *
+ * Windows are stored (compressed) in a file of their own, since they're far
+ * too large to keep in memory for every checkpoint of a large collection.
+ *
+ */
+
+#ifndef GZCHECK_H
+#define GZCHECK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* size of the window of uncompressed data preceding a checkpoint */
+#define GZCHECK_WINDOW 32768
+
+/* default number of bytes of uncompressed data between checkpoints */
+#define GZCHECK_SPAN (512 * 1024)
+
+enum gzcheck_ret {
+    GZCHECK_OK = 0,                 /* success */
+
+    GZCHECK_ERR = -1,               /* unexpected error */
+    GZCHECK_ENOMEM = -2,            /* couldn't obtain sufficient memory */
+    GZCHECK_EIO = -3,               /* couldn't read or write a file */
+    GZCHECK_EINVAL = -4             /* data isn't in gzip format */
+};
+
+struct gzcheck_point {
+    unsigned long int offset;       /* offset in uncompressed data */
+    unsigned long int in_offset;    /* offset of the first compressed byte
+                                     * that hasn't been consumed */
+    unsigned int bits;              /* number of bits of the previous
+                                     * compressed byte yet to be consumed */
+    unsigned int prime;             /* value of those bits */
+    unsigned int windowlen;         /* length of window */
+    unsigned char window[GZCHECK_WINDOW];  /* uncompressed data preceding the
+                                     * checkpoint */
+};
+
+/* decompress the gzip file read from fd (from its current position), calling
+ * fn with each checkpoint found at least span bytes of uncompressed data after
+ * the previous one (or the start of the file).  fn may return anything other
+ * than GZCHECK_OK to stop the scan, which then returns that value.  Only the
+ * first member of a multi-member file is scanned. */
+enum gzcheck_ret gzcheck_scan(int fd, unsigned long int span,
+  enum gzcheck_ret (*fn)(void *opaque, const struct gzcheck_point *point),
+  void *opaque);
+
+/* compress the window of point and write it to fd at its current position,
+ * writing the number of bytes written into *len */
+enum gzcheck_ret gzcheck_window_write(int fd,
+  const struct gzcheck_point *point, unsigned int *len);
+
+/* read a window of len bytes written by gzcheck_window_write from fd at its
+ * current position, uncompressing it into window (which must be
+ * GZCHECK_WINDOW bytes long) and writing its length into *windowlen */
+enum gzcheck_ret gzcheck_window_read(int fd, unsigned int len,
+  void *window, unsigned int *windowlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -14,11 +14,20 @@ extern "C" {
 struct index;
 struct query;
 struct chash;
+struct denseacc;
 struct alloc;
+struct index_search_opt;
 
+/* evaluate query against impact-ordered lists, adding scores into
+ * accumulators, which are held in dense if it isn't NULL, and in the
+ * accumulators hashtable otherwise.  If opts contains INDEX_SEARCH_ANYTIME, blocks are
+ * processed in decreasing order of impact until the budget in opt runs out,
+ * and *exact is set to whether every posting was processed.  Otherwise
+ * evaluation stops as the impacts of blocks fall, and *exact is set to 0. */
 int impact_ord_eval(struct index *idx, struct query *query, 
-  struct chash *accumulators, unsigned int acc_limit, struct alloc *alloc, 
-  unsigned int mem);
+  struct chash *accumulators, struct denseacc *dense, unsigned int acc_limit, 
+  struct alloc *alloc, unsigned int mem, int opts, 
+  struct index_search_opt *opt, int *exact);
 
 #ifdef __cplusplus
 }
@@ -24,7 +24,14 @@ enum impact_ret {
     IMPACT_OTHER_ERROR = -10 /* some other error */
 };
 
-enum impact_ret impact_order_index(struct index *idx);
+/* add impact-ordered vectors for every list in idx, transforming lists on
+ * threads threads at once (if built with thread support).  The index
+ * produced doesn't depend on the number of threads.  Document numbers are 
+ * vbyte coded (VOCAB_VTYPE_IMPACT) if codec is INDEX_CODEC_VBYTE, and 
+ * bit-packed (VOCAB_VTYPE_IMPACT_BLOCK, see impactcodec.h) if it's 
+ * INDEX_CODEC_BLOCK. */
+enum impact_ret impact_order_index(struct index *idx, unsigned int threads,
+  enum index_codec codec);
 
 double impact_normalise(double impact, double norm_B, double slope, 
   double max_impact, double min_impact);
@@ -0,0 +1,67 @@
+/* impactcodec.h declares an interface to encode and decode the document
+ * numbers of impact ordered lists as fixed-width bit-packed chunks, an
+ * alternative to the vbyte coding of VOCAB_VTYPE_IMPACT lists.
+ *
+ * Every document in a block of an impact ordered list gets the same impact,
+ * so evaluating a block is nothing more than turning its d-gaps back into
+ * document numbers and adding a constant to each of their accumulators.
+ * vbyte coding makes that a serial loop over bytes.  Packing each chunk of
+ * d-gaps into the width of the largest of them instead lets a chunk be
+ * unpacked and prefix-summed several numbers at a time.
+ *
+ * Lists coded this way (VOCAB_VTYPE_IMPACT_BLOCK) keep the vbyte block
+ * headers of impact ordered lists, and divide the d-gaps of each block into
+ * chunks of IMPACTCODEC_CHUNK (the last chunk of a block may be shorter):
+ *
+ *   <blocksize, impact, (blocksize + 127) / 128: chunk>
+ *
+ * where each chunk is
+ *
+ *   <width, (n * width + 7) / 8: packed>
+ *
+ * width is a single byte (0 - 32), and the n d-gaps of the chunk are packed
+ * into consecutive width-bit fields, least significant bit first.  As for
+ * VOCAB_VTYPE_IMPACT, each d-gap is one less than the difference between
+ * a document number and the one before it in the block, and the first
+ * document number of each block is stored less one from -1.  Document
+ * numbers must fit in 32 bits.
+ *
+ */
+
+#ifndef IMPACTCODEC_H
+#define IMPACTCODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "zstdint.h"
+
+struct vec;
+
+/* number of d-gaps in a full chunk */
+#define IMPACTCODEC_CHUNK 128
+
+/* maximum number of bytes a chunk can occupy */
+#define IMPACTCODEC_MAX_BYTES (1 + 4 * IMPACTCODEC_CHUNK)
+
+/* write the n d-gaps in gaps (n must be at most IMPACTCODEC_CHUNK) to v as a
+ * chunk.  Returns the number of bytes written, or 0 if there wasn't enough
+ * space in v (which is then unchanged). */
+unsigned int impactcodec_write(struct vec *v, const uint32_t *gaps,
+  unsigned int n);
+
+/* read a chunk of n d-gaps (n must be at most IMPACTCODEC_CHUNK) from the
+ * start of v, advancing v past it, and write the document numbers they
+ * describe into docnos.  The document numbers follow on from *docno, which
+ * is updated to the last of them.  Returns n, or 0 if v doesn't contain the
+ * whole chunk or the chunk is malformed (v is then unchanged). */
+unsigned int impactcodec_read(struct vec *v, unsigned int n,
+  unsigned long int *docno, uint32_t *docnos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
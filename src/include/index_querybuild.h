@@ -47,6 +47,9 @@ struct conjunct {
     unsigned int sloppiness;              /* sloppiness of phrase */
     unsigned int cutoff;                  /* must find phrase in this number 
                                            * of words (0 means infinite) */
+    unsigned long int f_dt_max;           /* largest f_dt of the first term 
+                                           * as recorded in the vocab (0 
+                                           * means unknown) */
 };
 
 /* struct to hold a parsed query */
@@ -93,6 +93,24 @@ int iobtree_remove(struct iobtree *iobtree, const char *term,
 void *iobtree_find(struct iobtree *iobtree, const char *term, 
   unsigned int termlen, int write, unsigned int *veclen);
 
+/* find the entry associated with key term, termlen in the btree without
+ * changing the btree, so that many threads can call it at once (as long as
+ * nothing else is using the btree).  Pages that aren't held in memory are
+ * read into pagebuf, which must be iobtree_pagesize() bytes long, unless the
+ * btree's file is memory-mapped (see fdset_map).  Returns a pointer to the 
+ * entry and writes its length into veclen on success.  The returned pointer 
+ * may point into pagebuf or the mapping, and is good until pagebuf is reused
+ * or the btree is changed.  It must not be written through. */
+void *iobtree_find_r(struct iobtree *iobtree, const char *term, 
+  unsigned int termlen, void *pagebuf, unsigned int *veclen);
+
+/* start reading the page that iobtree_find_r would have to read to find key
+ * term, termlen, without waiting for it (see fdset_willneed), so that the 
+ * pages for many keys can be read at once before they're looked up.  Like
+ * iobtree_find_r, doesn't change the btree. */
+void iobtree_prefetch_r(struct iobtree *iobtree, const char *term, 
+  unsigned int termlen);
+
 /* append a new term, of length termlen, to the end of the btree.  
  * Successive application of this call can be used to bulk-load a btree.  Note 
  * that it is the caller's responsibility to ensure that the new term is 
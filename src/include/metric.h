@@ -13,6 +13,9 @@
 /* okapi metric */
 const struct search_metric *okapi_k3();
 
+/* okapi metric over multiple weighted fields */
+const struct search_metric *bm25f();
+
 /* dirichlet metric */
 const struct search_metric *dirichlet();
 
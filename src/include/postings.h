@@ -20,6 +20,8 @@
 extern "C" {
 #endif
 
+#include "index.h"
+
 /* users of postings should note that to add to the postings, you must
  * now use the sequence (adddoc(), addword()*, update())*, dump() to
  * get sensible postings out */
@@ -34,14 +36,24 @@ struct postings_docstats {
     float weight;                      /* vector space length of document */
     unsigned int terms;                /* number of terms in document */
     unsigned int distinct;             /* number of distinct terms in document*/
+    unsigned int fields[INDEX_FIELDS]; /* number of terms in each field */
 };
 
 /* constructor, creates a new (empty) postings list.  tablesize is
  * the size of the hashtable to create.  stem and opaque define the stemming to
  * be used, where both can be NULL (for no stemming).  stop is the build-time
- * stoplist to be used, or NULL for none. */
+ * stoplist to be used, or NULL for none.  fields is the number of fields
+ * (see INDEX_FIELDS) that words can be added to, 1 if documents aren't 
+ * divided into fields. */
 struct postings* postings_new(unsigned int tablesize, 
-  void (*stem)(void *opaque, char *term), void *opaque, struct stop *list);
+  void (*stem)(void *opaque, char *term), void *opaque, struct stop *list,
+  unsigned int fields);
+
+/* the number of low bits of each word position that hold the field the word
+ * is in, when documents are divided into fields fields.  Positions are 
+ * stored as (wordno << bits) | field, so with only one field they're the 
+ * word numbers themselves. */
+unsigned int postings_field_bits(unsigned int fields);
 
 /* remove a postings structure */
 void postings_delete(struct postings *post);
@@ -52,11 +64,11 @@ void postings_delete(struct postings *post);
 void postings_adddoc(struct postings *post, unsigned long int docno);
 
 /* a reference to a word in a document, identified by term, wordno and docno
- * respectively.  Returns true on success and 0 on failure. vocab is a pointer
- * to the current vocabulary, can be NULL, and is used to look up the last docno
- * encoded for this word.  Note that the term will be stemmed in this function
- * if needed. */
-int postings_addword(struct postings *post, char *term, 
+ * respectively.  Returns true on success and 0 on failure.  field is the 
+ * field the word is in (fields past those given to postings_new count as 
+ * field 0).  Note that the term will be stemmed in this function if 
+ * needed. */
+int postings_addword(struct postings *post, char *term, unsigned int field,
   unsigned long int wordno);
 
 /* whether postings list needs an update */
@@ -71,6 +83,13 @@ int postings_update(struct postings *post, struct postings_docstats *stats);
 int postings_dump(struct postings *post, void *buf, unsigned int bufsize, 
   int fd);
 
+/* dump the postings to a file as postings_dump does, adding base to each
+ * document number in them.  This allows postings to be accumulated with
+ * document numbers starting from 0 before it is known where in the collection
+ * they belong. */
+int postings_dump_rebase(struct postings *post, void *buf,
+  unsigned int bufsize, int fd, unsigned long int base);
+
 /* remove all postings from the postings list */
 void postings_clear(struct postings *post);
 
@@ -96,6 +115,17 @@ unsigned int postings_documents(struct postings *post);
  * before passing it to this function. */
 struct vec *postings_vector(struct postings *post, char *term);
 
+/* find the postings accumulated for term (which should already be stemmed, if
+ * required), writing a pointer to their encoded vector into *vec, its length
+ * into *len, the number of documents and occurrances it contains into *docs
+ * and *occurs, and the last document number in it into *last.  The vector
+ * remains valid until more postings are added, or the postings are dumped or
+ * cleared.  Must not be called while a document is being added.  Returns 1 if
+ * postings for term were found, and 0 otherwise. */
+int postings_find(struct postings *post, const char *term, const void **vec,
+  unsigned int *len, unsigned int *docs, unsigned int *occurs, 
+  unsigned long int *last);
+
 #ifdef __cplusplus
 }
 #endif
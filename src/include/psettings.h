@@ -57,6 +57,15 @@ enum psettings_attr {
     PSETTINGS_ATTR_TITLE = (1 << 8)     /* indicates the start of a title */
 };
 
+/* the content of tags that are indexed (or titles) can also be put into a 
+ * field, numbered from 1 to INDEX_FIELDS - 1, until the corresponding end 
+ * tag.  Field 0 is the rest of the document.  The field number is held in 
+ * the attributes above PSETTINGS_FIELD_SHIFT. */
+#define PSETTINGS_FIELD_SHIFT 16
+#define PSETTINGS_FIELD(attr) (((unsigned int) (attr)) >> PSETTINGS_FIELD_SHIFT)
+#define PSETTINGS_ATTR_FIELD(field)                                           \
+    ((enum psettings_attr) ((field) << PSETTINGS_FIELD_SHIFT))
+
 enum psettings_ret {
     PSETTINGS_OK = 0,
     PSETTINGS_ENOMEM = -ENOMEM,
@@ -111,6 +120,11 @@ enum psettings_attr psettings_default(struct psettings *pset);
  * PSETTINGS_ATTR_ID).  Returns 0 for unknown types */
 int psettings_self_id(struct psettings *pset, enum mime_types type);
 
+/* returns the number of fields that the settings divide documents into, 
+ * which is one more than the largest field number given to a tag (and so 1 
+ * if no tags have fields) */
+unsigned int psettings_fields(struct psettings *pset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -72,6 +72,9 @@ unsigned int reposset_entries(struct reposset *rset);
 /* clear a reposset of all records */
 void reposset_clear(struct reposset *db);
 
+/* clear a reposset of all records except checkpoints */
+void reposset_clear_records(struct reposset *rset);
+
 #ifdef __cplusplus
 }
 #endif
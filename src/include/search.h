@@ -35,6 +35,22 @@ struct search_acc_cons {
     struct search_acc acc;
 };
 
+/* number of consecutive documents covered by each page of dense accumulators
+ * (must be a multiple of 8) */
+#define SEARCH_DENSE_PAGE 4096
+
+/* page of dense accumulators, indexed by document number within the page.
+ * Dense accumulators are used instead of a list when a query is likely to
+ * accumulate weight for a large proportion of the collection, since looking
+ * them up is then cheaper than merging each list into a list of
+ * accumulators.  Pages are only allocated once a document in them is
+ * needed. */
+struct search_acc_page {
+    float weight[SEARCH_DENSE_PAGE];           /* accumulated weights */
+    unsigned char used[SEARCH_DENSE_PAGE / 8]; /* bitmap of which documents
+                                                * have an accumulator */
+};
+
 /* declaration we'll need for the metric structure below */
 struct query;
 struct objalloc;
@@ -44,6 +60,13 @@ struct index_search_opt;
 /* struct to model the operation of a source of compressed postings */
 struct search_list_src {
     void *opaque;
+    /* whether each posting is followed by the word offsets of its 
+     * occurrances, which have to be scanned over if they're not needed */
+    int offsets;
+    /* whether the postings are coded in blocks (see blockcodec.h) rather than
+     * as vbyte <d-gap, f_dt> pairs.  Such lists never have offsets, and
+     * their sources buffer enough to hold a whole block. */
+    int blocks;
     /* method to reset the list src to the start of the list */
     enum search_ret (*reset)(struct search_list_src *src);
     /* method to read bytes from the src into buf, which is of length len.
@@ -57,6 +80,18 @@ struct search_list_src {
      * few bytes again. */
     enum search_ret (*readlist)(struct search_list_src *src, 
       unsigned int leftover, void **retbuf, unsigned int *retlen);
+    /* method to skip forward over blocks of postings toward the first posting
+     * for a document numbered at least docno.  On entry, base is the last
+     * document number decoded from the list (or SEARCH_DOCNO_START).  If a
+     * block further along the list can be skipped to, the src is positioned
+     * at its start and base and postings are set to the document number
+     * preceding it and the number of postings before it.  The caller must
+     * then discard any data it has buffered, and pass 0 leftover bytes to the
+     * next readlist call.  If not, base and postings are left unchanged.
+     * NULL if the list has no skip information. */
+    enum search_ret (*skip_to)(struct search_list_src *src,
+      unsigned long int docno, unsigned long int *base,
+      unsigned long int *postings);
     /* method to delete the src structure and free all resources used by it */
     void (*delet)(struct search_list_src *src);
 };
@@ -71,6 +106,10 @@ struct search_metric_results {
      int estimated;                   /* whether total_results is estimated */
      double total_results;            /* total number of possible results for 
                                        * this query */
+     struct search_acc_page **dense;  /* table of dense accumulator pages, 
+                                       * indexed by docno / SEARCH_DENSE_PAGE,
+                                       * used by the dense_xxx_decode fns 
+                                       * instead of acc */
 };
 
 /* structure containing a set of functions that define a metric over document 
@@ -119,8 +158,41 @@ struct search_metric {
     enum search_ret (*thresh_decode)(struct index *idx, struct query *query,
       unsigned int qterm, unsigned long int start_docno, 
       struct search_metric_results *results, 
-      struct search_list_src *src, unsigned int postings, 
+      struct search_list_src *src, unsigned int postings,
+      int opts, struct index_search_opt *opt);
+
+    /* decode a list in OR mode into dense accumulators (results->dense),
+     * allocating pages as needed */
+    enum search_ret (*dense_or_decode)(struct index *idx, struct query *query,
+      unsigned int qterm, unsigned long int start_docno, 
+      struct search_metric_results *results, struct search_list_src *src,
+      int opts, struct index_search_opt *opt);
+
+    /* decode a list in AND mode into dense accumulators (results->dense) */
+    enum search_ret (*dense_and_decode)(struct index *idx, 
+      struct query *query, unsigned int qterm, unsigned long int start_docno, 
+      struct search_metric_results *results, struct search_list_src *src,
+      int opts, struct index_search_opt *opt);
+
+    /* adds the contribution of a single posting, with frequency f_dt in
+     * document acc->acc.docno, to acc->acc.weight.  Used by
+     * document-at-a-time evaluation, which scores one document at a time. */
+    enum search_ret (*score)(struct index *idx, struct query *query,
+      unsigned int qterm, struct search_acc_cons *acc, unsigned long int f_dt,
       int opts, struct index_search_opt *opt);
+
+    /* calculates into weight an upper bound on the contribution of any
+     * posting with a frequency no greater than f_dt for term qterm to any
+     * document in the collection */
+    enum search_ret (*bound)(struct index *idx, struct query *query,
+      unsigned int qterm, unsigned long int f_dt, float *weight,
+      int opts, struct index_search_opt *opt);
+
+    /* calculates into weight an upper bound on the amount that post
+     * processing can add to an accumulator (only meaningful for metrics where
+     * post processing is additive) */
+    enum search_ret (*post_bound)(struct index *idx, struct query *query,
+      float *weight, int opts, struct index_search_opt *opt);
 };
 
 /* constant to pass as start_docno when decoding from the start of a list */
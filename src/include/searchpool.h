@@ -0,0 +1,88 @@
+/* searchpool.h declares a pool of threads that evaluate queries against a
+ * single loaded index concurrently, handing back the results of each query in
+ * the order in which the queries were submitted.  This allows a batch of
+ * queries to use all of the processors in a machine without loading the
+ * index once per processor.
+ *
+ * Queries are submitted with searchpool_submit, and their results are
+ * collected (oldest first) with searchpool_next.  Submission doesn't wait for
+ * evaluation to finish, so callers should collect results as they go to
+ * limit the number of queries (and result arrays) outstanding.  If zettair
+ * was built without thread support (MT_ZET), or the pool has only one thread,
+ * queries are evaluated as they are submitted.
+ *
+ * Nothing else may change the index while the pool exists.
+ *
+ */
+
+#ifndef SEARCHPOOL_H
+#define SEARCHPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "index.h"
+
+enum searchpool_ret {
+    SEARCHPOOL_OK = 0,          /* success */
+    SEARCHPOOL_EMPTY = 1,       /* no queries are outstanding */
+
+    SEARCHPOOL_ERR = -1,        /* unexpected error */
+    SEARCHPOOL_ENOMEM = -2      /* couldn't obtain sufficient memory */
+};
+
+struct searchpool;
+
+/* the results of a query evaluated by the pool */
+struct searchpool_result {
+    char *query;                     /* query string, as submitted */
+    void *userdata;                  /* userdata, as submitted */
+    int ok;                          /* return value from index_search */
+    struct index_result *result;     /* array of results */
+    unsigned int results;            /* number of results in result */
+    double total_results;            /* number of documents matched */
+    int est;                         /* whether total_results is estimated */
+    double seconds;                  /* time taken to evaluate the query */
+};
+
+/* create a new pool of threads threads to evaluate queries against idx.
+ * Since the documents the ranking metrics need can't be read safely from
+ * many threads at once, the docmap is made to cache them.  Returns NULL on
+ * failure. */
+struct searchpool *searchpool_new(struct index *idx, unsigned int threads);
+
+/* delete a pool, waiting for queries being evaluated to finish and
+ * discarding all outstanding results */
+void searchpool_delete(struct searchpool *pool);
+
+/* submit a query for evaluation, with parameters as for index_search.  The
+ * query and options are copied, and userdata is handed back with the
+ * results.  Returns SEARCHPOOL_OK on success. */
+enum searchpool_ret searchpool_submit(struct searchpool *pool,
+  const char *query, unsigned long int startdoc, unsigned long int len,
+  int opts, const struct index_search_opt *opt, void *userdata);
+
+/* wait for the oldest outstanding query to be evaluated, and hand its
+ * results to the caller in *res, which must be deleted with
+ * searchpool_result_delete.  Returns SEARCHPOOL_OK on success and
+ * SEARCHPOOL_EMPTY if no queries are outstanding. */
+enum searchpool_ret searchpool_next(struct searchpool *pool,
+  struct searchpool_result **res);
+
+/* return the number of queries submitted but not yet collected */
+unsigned int searchpool_pending(const struct searchpool *pool);
+
+/* return the number of threads evaluating queries (1 if queries are
+ * evaluated as they are submitted) */
+unsigned int searchpool_threads(const struct searchpool *pool);
+
+/* delete results returned by searchpool_next */
+void searchpool_result_delete(struct searchpool_result *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,117 @@
+/* segment.h declares the segments of an index that is updated by writing
+ * each batch of added documents out as an immutable segment, rather than by
+ * merging them into every inverted list of the index (see remerge.c).  A
+ * segment has its own vector and vocabulary files, holding postings for the
+ * documents added in one or more consecutive commits; the documents
+ * themselves are appended to the docmap and repositories as usual.
+ *
+ * The vector of a term in a segment carries on from the vector of the term in
+ * the index and any earlier segments: its first document number is coded as
+ * a gap from the last document in them.  Reading the vectors of a term from
+ * the index and each segment in turn therefore gives its complete list, and
+ * the vectors of adjacent segments can be merged by concatenating them.
+ *
+ * Segments are merged in tiers: segments holding less than
+ * SEGMENT_TIER_BASE bytes of postings are in tier 0, and each tier above
+ * holds segments SEGMENT_MERGE_FACTOR times larger than the one below.
+ * Whenever the newest SEGMENT_MERGE_FACTOR segments are in the same tier they
+ * are merged into one, so that there are only a logarithmic number of
+ * segments, and the cost of adding documents doesn't depend on the size of
+ * the index.  If zettair was built with thread support (MT_ZET) merges are
+ * performed by a background thread, and the segments they replace are kept
+ * until the index parameters recording the merge have been written.
+ * Otherwise they're performed by the commit that triggers them.
+ *
+ * The index itself is never merged with its segments.
+ *
+ */
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+enum segment_ret {
+    SEGMENT_OK = 0,                 /* success */
+
+    SEGMENT_ERR = -1,               /* unexpected error */
+    SEGMENT_ENOMEM = -2,            /* couldn't obtain sufficient memory */
+    SEGMENT_EIO = -3                /* couldn't read or write a file */
+};
+
+struct index;
+struct postings;
+struct vocab_vector;
+struct segments;
+
+/* create an empty set of segments for idx, which must have been loaded or
+ * created.  Their files are named after the index parameter file.  Returns
+ * NULL on failure. */
+struct segments *segments_new(struct index *idx);
+
+/* wait for merges that are in progress or waiting to be performed to finish,
+ * returning true if any of them have finished since the segments were last
+ * written with segments_write */
+int segments_finish(struct segments *segs);
+
+/* delete a set of segments, waiting for merges in progress to finish.  The
+ * files of segments that haven't been written with segments_write are
+ * removed, those of segments that have are left alone. */
+void segments_delete(struct segments *segs);
+
+/* remove the files of all segments, as well as those replaced by merges */
+void segments_rm(struct segments *segs);
+
+/* read descriptions of segments from the index parameter file fp (as written
+ * by segments_write), opening their vocabularies.  Returns SEGMENT_OK on
+ * success. */
+enum segment_ret segments_read(struct segments *segs, FILE *fp);
+
+/* write descriptions of the segments to the index parameter file fp.  Once
+ * the file is complete, segments_written should be called.  Returns
+ * SEGMENT_OK on success. */
+enum segment_ret segments_write(struct segments *segs, FILE *fp);
+
+/* remove the files of segments that were replaced by merges before the last
+ * call to segments_write, which no longer refers to them */
+void segments_written(struct segments *segs);
+
+/* write the postings in post (which are for documents following those in the
+ * index and existing segments) out as a new segment, merging segments if
+ * that's called for.  Searches must not be in progress.  Returns SEGMENT_OK
+ * on success. */
+enum segment_ret segments_commit(struct segments *segs,
+  struct postings *post);
+
+/* lock the segments against changes while searching them.  Any number of
+ * searches can hold the lock at once, but merges have to wait for all of
+ * them to release it before replacing segments. */
+void segments_read_lock(struct segments *segs);
+
+/* release a lock obtained with segments_read_lock */
+void segments_read_unlock(struct segments *segs);
+
+/* return the number of segments, which are numbered from the oldest.  The
+ * segments must be locked with segments_read_lock while they are being
+ * searched. */
+unsigned int segments_len(struct segments *segs);
+
+/* look up the document ordered vector of term (of length termlen) in segment
+ * seg, writing its vocabulary entry into *vv and the fdset type of the file
+ * it's stored in into *type.  pagebuf must be a page long (the vocabulary
+ * isn't changed, so many threads can search it at once).  Returns 1 if the
+ * term occurs in the segment, 0 if not and < 0 on error. */
+int segments_find(struct segments *segs, unsigned int seg, const char *term,
+  unsigned int termlen, void *pagebuf, struct vocab_vector *vv,
+  unsigned int *type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
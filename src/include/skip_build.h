@@ -0,0 +1,129 @@
+/* skip_build.h declares functions to rewrite the document ordered inverted
+ * lists of an index into the layout requested for it, which may add skip
+ * tables, store word positions separately from the postings and/or block
+ * code the postings.
+ *
+ * Lists with skip tables are stored as VOCAB_VTYPE_DOCWP_SKIP vectors, which
+ * consist of a skip table followed by the postings in exactly the same format
+ * as VOCAB_VTYPE_DOCWP vectors.  Postings are divided into blocks of interval
+ * postings, and the skip table contains an entry for each block after the
+ * first:
+ *
+ *   <interval, (blocks - 1): <d, offset>>
+ *
+ * where d is the document number of the last posting before the block and
+ * offset the byte offset of the start of the block from the start of the
+ * postings.  Both are stored as vbyte-encoded gaps from the previous entry
+ * (the first entry is stored absolutely).  Since the postings are d-gap
+ * encoded relative to the previous posting, decoding can start at the
+ * beginning of any block by adding its first d-gap to d.
+ *
+ * Lists with separated word positions are stored as VOCAB_VTYPE_DOCWP_SEP
+ * vectors, which consist of an optional skip table, then the <d, f_dt> pairs
+ * of all postings, then the word offsets of all postings, each encoded
+ * exactly as they would be in a VOCAB_VTYPE_DOCWP vector.  Ranked queries
+ * only need to read the document numbers and frequencies.  The offsets in a
+ * skip table refer to the start of the document numbers, so the table is only
+ * useful when the word positions aren't needed.
+ *
+ * Lists with block coded postings are stored as VOCAB_VTYPE_DOCWP_BLOCK
+ * vectors, which are laid out as for VOCAB_VTYPE_DOCWP_SEP, except that the
+ * <d, f_dt> pairs are coded in blocks of SKIP_DEFAULT_INTERVAL postings (see
+ * blockcodec.h), so that the offsets in the skip table are those of the
+ * start of each block.
+ *
+ */
+
+#ifndef SKIP_BUILD_H
+#define SKIP_BUILD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct index;
+struct vocab_vector;
+
+/* number of postings in each block between skip entries.  Lists with no more
+ * than this number of postings aren't given skip tables */
+#define SKIP_DEFAULT_INTERVAL 128
+
+enum skip_ret {
+    SKIP_OK = 0,
+    SKIP_FMT_ERROR = -1,     /* error with format of input index */
+    SKIP_IO_ERROR = -2,      /* I/O error */
+    SKIP_MEM_ERROR = -3,     /* out of memory */
+    SKIP_OTHER_ERROR = -10   /* some other error */
+};
+
+/* buffers used to convert vectors one at a time into the layout wanted for
+ * them in an index.  Zero before first use and release with 
+ * skip_layout_free. */
+struct skip_layout {
+    char *vec;                       /* vector to be converted */
+    unsigned int veclen;             /* capacity of vec */
+    char *plain;                     /* scratch space for conversion */
+    unsigned int plainlen;           /* capacity of plain */
+    char *out;                       /* converted vector */
+    unsigned int outlen;             /* capacity of out */
+};
+
+/* rewrite the document ordered vectors of idx that are stored in files into
+ * the layout given by the index's skip_vectors, separate_positions and
+ * list_codec settings.  Skip tables are only given to lists long enough to 
+ * benefit from them.  The new vectors and vocabulary are written to the 
+ * index's temporary file types, and then renamed over the current files, so
+ * this reads and writes the whole vector file once more.  The remerge lays
+ * out vectors as it writes them (see skip_layout_convert), so this is only 
+ * needed after the final merge that builds an index.  Does nothing if all 
+ * lists already have the right layout. */
+enum skip_ret skip_build_index(struct index *idx);
+
+/* return true if the document ordered vector described by vv has to be 
+ * converted to give it the layout wanted for it in idx */
+int skip_layout_wanted(struct index *idx, struct vocab_vector *vv);
+
+/* ensure that layout->vec has room for len bytes.  Returns true on 
+ * success, and false if memory can't be allocated. */
+int skip_layout_reserve(struct skip_layout *layout, unsigned int len);
+
+/* convert the document ordered vector described by vv, held in the vv->size
+ * bytes at layout->vec, into the layout wanted for it in idx, leaving the
+ * result in the vv->size bytes at layout->out (vv is updated to describe 
+ * it) */
+enum skip_ret skip_layout_convert(struct index *idx, struct vocab_vector *vv,
+  struct skip_layout *layout);
+
+/* free the buffers held by layout */
+void skip_layout_free(struct skip_layout *layout);
+
+/* separate the word positions from the len bytes of VOCAB_VTYPE_DOCWP 
+ * postings for docs documents at vec, writing the document numbers and 
+ * frequencies followed by the word positions into out (which must have len 
+ * bytes available).  Returns the number of bytes of document numbers and 
+ * frequencies, or 0 if the postings are malformed. */
+unsigned int skip_separate(char *vec, unsigned int len, unsigned long int docs,
+  char *out);
+
+/* merge the docsize bytes of document numbers and frequencies at docvec with
+ * the possize bytes of word positions at posvec, writing VOCAB_VTYPE_DOCWP
+ * postings into out (which must have docsize + possize bytes available).
+ * Returns true on success and false if the streams are malformed. */
+int skip_interleave(char *docvec, unsigned int docsize, char *posvec, 
+  unsigned int possize, char *out);
+
+/* return an upper bound on the size of the document ordered vector described
+ * by vv once converted to a plain VOCAB_VTYPE_DOCWP vector */
+unsigned long int skip_docwp_bound(struct vocab_vector *vv);
+
+/* convert the document ordered vector described by vv, held in the vv->size
+ * bytes at vec, into a plain VOCAB_VTYPE_DOCWP vector in out (which must
+ * have skip_docwp_bound(vv) bytes available), updating vv to describe it */
+enum skip_ret skip_docwp(struct vocab_vector *vv, char *vec, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -256,6 +256,17 @@ struct teefilter *teefilter_new(int id);
 struct gunzipfilter;
 struct gunzipfilter *gunzipfilter_new(unsigned int bufsize);
 
+/* create a gunzipfilter that resumes decompression of a gzip file part way
+ * through it, at the end of a deflate block.  The filter should be given the
+ * file from the first compressed byte that hasn't been consumed at that
+ * point.  bits is the number of bits of the previous byte that haven't been
+ * consumed, and prime their value.  window must contain the windowlen
+ * (at most 32K) bytes of uncompressed data preceding that point.  The
+ * trailing checksum can't be verified by a filter created this way. */
+struct gunzipfilter *gunzipfilter_new_at(unsigned int bufsize, 
+  unsigned int bits, unsigned int prime, const void *window, 
+  unsigned int windowlen);
+
 #ifdef __cplusplus
 }
 #endif
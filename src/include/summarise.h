@@ -41,10 +41,10 @@ struct summary {
 };
 
 /* create a textual summary of document number docno, biased toward the given
- * query.  The summary and title are written into result, with the type of
- * summary dictated by type (plain gives a plaintext summary, capitalise has
- * query words capitalised, html has query words bolded and html-significant
- * characters html-escaped). */
+ * query.  The summary and title are written into result (NUL-terminated), 
+ * with the type of summary dictated by type (plain gives a plaintext summary,
+ * capitalise has query words capitalised, html has query words bolded and 
+ * html-significant characters html-escaped). */
 enum summarise_ret summarise(struct summarise *sum, unsigned long int docno,
   const struct query *query, enum index_summary_type type,
   struct summary *result);
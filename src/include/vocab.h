@@ -42,8 +42,46 @@ enum vocab_vtype {
     VOCAB_VTYPE_DOCWP = 1,             /* document ordered, with word 
                                         * positions,
                                         * f_t: <d, f_dt, (offset)> */
-    VOCAB_VTYPE_IMPACT = 2             /* impact ordered 
+    VOCAB_VTYPE_IMPACT = 2,            /* impact ordered 
                                         * f_t: <blocksize, impact (d, f_dt)> */
+    VOCAB_VTYPE_DOCWP_SKIP = 3,        /* document ordered, with word 
+                                        * positions, preceded by a table of 
+                                        * skips over blocks of postings,
+                                        * <interval, f_t / interval: 
+                                        *   <d, offset>>
+                                        * f_t: <d, f_dt, (offset)> */
+    VOCAB_VTYPE_DOCWP_SEP = 4,         /* document ordered, with word 
+                                        * positions stored after all of the
+                                        * document numbers, optionally 
+                                        * preceded by a skip table over the 
+                                        * document numbers,
+                                        * (<interval, f_t / interval: 
+                                        *   <d, offset>>)
+                                        * f_t: <d, f_dt> f_t: <f_dt: offset> */
+    VOCAB_VTYPE_DOCWP_BLOCK = 5,       /* as for DOCWP_SEP, except that the
+                                        * document numbers and frequencies
+                                        * are coded in blocks (see 
+                                        * blockcodec.h) of up to 
+                                        * BLOCKCODEC_POSTINGS postings,
+                                        * (<interval, f_t / interval: 
+                                        *   <d, offset>>)
+                                        * f_t / 128: <block(<d, f_dt>)> 
+                                        * f_t: <f_dt: offset> */
+    VOCAB_VTYPE_BOUNDS = 6,            /* upper bounds on the postings of
+                                        * the document ordered vector that 
+                                        * precedes it (always location 
+                                        * VOCAB, and not a list of postings 
+                                        * itself), the largest f_dt in each
+                                        * block of interval postings,
+                                        * (f_t / interval: <max f_dt>) */
+    VOCAB_VTYPE_IMPACT_BLOCK = 7       /* impact ordered, with the document
+                                        * numbers of each block bit-packed
+                                        * in chunks of up to 
+                                        * IMPACTCODEC_CHUNK (see 
+                                        * impactcodec.h)
+                                        * <blocksize, impact, 
+                                        *   blocksize / 128: 
+                                        *   <width, packed (d)>> */
 
     /* other possibilities are: access ordered, access ordered with word 
      * positions, frequency ordered, page rank ordered, 
@@ -54,6 +92,11 @@ enum vocab_vtype {
      * access and page rank are) */
 };
 
+/* whether vectors of type type are impact ordered (both kinds share the
+ * impact header) */
+#define VOCAB_IMPACT_ORDERED(type)                                            \
+    (((type) == VOCAB_VTYPE_IMPACT) || ((type) == VOCAB_VTYPE_IMPACT_BLOCK))
+
 /* structure representing an individual vector */
 struct vocab_vector {
     enum vocab_attributes attr;
@@ -81,7 +124,44 @@ struct vocab_vector {
             unsigned long int docs;    /* number of documents term occurs in */
             unsigned long int occurs;  /* total number of times term occurrs */
             unsigned long int last;    /* last docno in vector */
-        } impact;
+        } impact;                      /* (also used by IMPACT_BLOCK) */
+
+        struct {
+            unsigned long int docs;    /* number of documents term occurs in */
+            unsigned long int occurs;  /* total number of times term occurrs */
+            unsigned long int last;    /* last docno in vector */
+            unsigned long int skipsize;/* size of the skip table at the start 
+                                        * of the vector (size includes it) */
+        } docwp_skip;
+
+        struct {
+            unsigned long int docs;    /* number of documents term occurs in */
+            unsigned long int occurs;  /* total number of times term occurrs */
+            unsigned long int last;    /* last docno in vector */
+            unsigned long int skipsize;/* size of the skip table at the start 
+                                        * of the vector, or 0 */
+            unsigned long int docsize; /* size of the document numbers and 
+                                        * frequencies following the table 
+                                        * (the word positions take up the 
+                                        * rest of size) */
+        } docwp_sep;                   /* (also used by DOCWP_BLOCK) */
+
+        struct {
+            unsigned long int docs;    /* as for the vector bounded */
+            unsigned long int occurs;  /* as for the vector bounded */
+            unsigned long int last;    /* as for the vector bounded */
+            unsigned long int max_fdt; /* largest f_dt in the vector */
+            unsigned long int interval;/* number of postings in each block 
+                                        * of the per-block table, or 0 if 
+                                        * there's no table */
+            float okapi;               /* largest contribution of a single 
+                                        * query occurrance of the term to an
+                                        * okapi score (for the parameters 
+                                        * recorded in the index) */
+            float dirichlet;           /* largest contribution of a single
+                                        * query occurrance of the term to a
+                                        * dirichlet score (ditto) */
+        } bounds;
     } header;
 
     enum vocab_locations location;     /* location */
@@ -100,6 +180,10 @@ struct vocab_vector {
     } loc;
 };
 
+/* scores in BOUNDS vectors are stored in fixed point, with this many steps
+ * per unit, and are rounded upward so that they remain bounds */
+#define VOCAB_BOUNDS_SCALE 65536.0F
+
 /* return values that below functions can return */
 enum vocab_ret {
     VOCAB_ENOSPC = -ENOSPC,            /* vector didn't contain a full vocab 
@@ -138,6 +222,11 @@ unsigned long int vocab_occurs(struct vocab_vector *vocab);
 /* returns the last docnum from a vocab vector */
 unsigned long int vocab_last(struct vocab_vector *vocab);
 
+/* decodes vectors from v until a BOUNDS vector is found, which is decoded
+ * into bounds.  Returns _OK if one was found, _END if the entry doesn't have
+ * one, or an error as for vocab_decode. */
+enum vocab_ret vocab_bounds(struct vocab_vector *bounds, struct vec *v);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,12 +15,16 @@
 
 #include "_mem.h"
 
+#include "cache.h"
 #include "def.h"
+#include "denseacc.h"
 #include "error.h"
 #include "fdset.h"
 #include "freemap.h"
 #include "docmap.h"
+#include "docstore.h"
 #include "getmaxfsize.h"
+#include "gzcheck.h"
 #include "iobtree.h"
 #include "str.h"
 #include "stream.h"
@@ -32,12 +36,15 @@
 #include "mime.h"
 #include "postings.h"
 #include "pyramid.h"
+#include "segment.h"
 #include "psettings.h"
 #include "stop.h"
 #include "vec.h"
 #include "vocab.h"
 #include "zvalgrind.h"
 #include "impact_build.h"
+#include "skip_build.h"
+#include "bound_build.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -47,9 +54,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef MT_ZET
+#include <pthread.h>
+
+#define SUMPOOL_LOCK(idx) pthread_mutex_lock(&(idx)->sumpool.mutex)
+#define SUMPOOL_UNLOCK(idx) pthread_mutex_unlock(&(idx)->sumpool.mutex)
+#define ACCPOOL_LOCK(idx) pthread_mutex_lock(&(idx)->accpool.mutex)
+#define ACCPOOL_UNLOCK(idx) pthread_mutex_unlock(&(idx)->accpool.mutex)
+#else
+#define SUMPOOL_LOCK(idx)
+#define SUMPOOL_UNLOCK(idx)
+#define ACCPOOL_LOCK(idx)
+#define ACCPOOL_UNLOCK(idx)
+#endif /* MT_ZET */
+
 /* Version number for index format.  This gets incremented every time
    a change is made to the format of the on-disk index. */
-#define INDEX_FILE_FORMAT_VERSION 0x3141592e
+#define INDEX_FILE_FORMAT_VERSION 0x31415933
 
 const char *index_doctype_names[] = {"" /* err */, "html", "trec", "inex"};
 
@@ -84,6 +105,96 @@ ssize_t index_atomic_read(int fd, void *buf, unsigned int size) {
     }
 }
 
+struct summarise *index_summarise_get(struct index *idx) {
+    struct summarise *sum = NULL;
+
+    SUMPOOL_LOCK(idx);
+    if (idx->sum) {
+        sum = idx->sum;
+        idx->sum = NULL;
+    } else if (idx->sumpool.len) {
+        sum = idx->sumpool.sum[--idx->sumpool.len];
+    }
+    SUMPOOL_UNLOCK(idx);
+
+    if (!sum) {
+        /* all in use by other searches, create another */
+        sum = summarise_new(idx);
+    }
+    return sum;
+}
+
+void index_summarise_put(struct index *idx, struct summarise *sum) {
+    SUMPOOL_LOCK(idx);
+    if (!idx->sum) {
+        idx->sum = sum;
+        sum = NULL;
+    } else if (idx->sumpool.len < idx->sumpool.size) {
+        idx->sumpool.sum[idx->sumpool.len++] = sum;
+        sum = NULL;
+    } else {
+        void *ptr = realloc(idx->sumpool.sum, 
+            sizeof(*idx->sumpool.sum) * (idx->sumpool.size * 2 + 1));
+
+        if (ptr) {
+            idx->sumpool.sum = ptr;
+            idx->sumpool.size = idx->sumpool.size * 2 + 1;
+            idx->sumpool.sum[idx->sumpool.len++] = sum;
+            sum = NULL;
+        }
+    }
+    SUMPOOL_UNLOCK(idx);
+
+    if (sum) {
+        /* couldn't keep it, so get rid of it */
+        summarise_delete(sum);
+    }
+}
+
+struct denseacc *index_denseacc_get(struct index *idx, unsigned long int docs) {
+    struct denseacc *acc = NULL;
+
+    ACCPOOL_LOCK(idx);
+    if (idx->accpool.len) {
+        acc = idx->accpool.acc[--idx->accpool.len];
+    }
+    ACCPOOL_UNLOCK(idx);
+
+    if (!acc) {
+        /* all in use by other searches, create another */
+        acc = denseacc_new(docs);
+    }
+    if (acc && !denseacc_reset(acc, docs)) {
+        denseacc_delete(acc);
+        acc = NULL;
+    }
+    return acc;
+}
+
+void index_denseacc_put(struct index *idx, struct denseacc *acc) {
+    ACCPOOL_LOCK(idx);
+    if (idx->accpool.len < idx->accpool.size) {
+        idx->accpool.acc[idx->accpool.len++] = acc;
+        acc = NULL;
+    } else {
+        void *ptr = realloc(idx->accpool.acc, 
+            sizeof(*idx->accpool.acc) * (idx->accpool.size * 2 + 1));
+
+        if (ptr) {
+            idx->accpool.acc = ptr;
+            idx->accpool.size = idx->accpool.size * 2 + 1;
+            idx->accpool.acc[idx->accpool.len++] = acc;
+            acc = NULL;
+        }
+    }
+    ACCPOOL_UNLOCK(idx);
+
+    if (acc) {
+        /* couldn't keep it, so get rid of it */
+        denseacc_delete(acc);
+    }
+}
+
 /* internal function to atomically perform a write */
 ssize_t index_atomic_write(int fd, void *buf, unsigned int size) {
     unsigned int wlen,
@@ -211,6 +322,14 @@ static int index_params_read(struct index *idx,
         READ_MEMBER(fp, idx->doc_order_vectors, uint32_t);
         READ_MEMBER(fp, idx->doc_order_word_pos_vectors, uint32_t);
         READ_MEMBER(fp, idx->impact_vectors, uint32_t);
+        READ_MEMBER(fp, idx->skip_vectors, uint32_t);
+        READ_MEMBER(fp, idx->separate_positions, uint32_t);
+        READ_MEMBER(fp, idx->list_codec, uint32_t);
+        READ_MEMBER(fp, idx->bounds.build, uint32_t);
+        READ_DOUBLE(fp, idx->bounds.k1);
+        READ_DOUBLE(fp, idx->bounds.b);
+        READ_DOUBLE(fp, idx->bounds.mu);
+        READ_MEMBER(fp, idx->fields, uint32_t);
 
         READ_MEMBER(fp, *root_fileno, uint32_t);
         READ_MEMBER(fp, *root_offset, uint32_t);
@@ -224,6 +343,23 @@ static int index_params_read(struct index *idx,
             FAIL();
         }
 
+        /* read segments, if updates are written out as them */
+        READ_MEMBER(fp, tmp, uint32_t);
+        if (tmp && (!(idx->segs = segments_new(idx)) 
+            || (segments_read(idx->segs, fp) != SEGMENT_OK))) {
+            ERROR("reading segments");
+            FAIL();
+        }
+
+        /* read document store, if there is one */
+        READ_MEMBER(fp, tmp, uint32_t);
+        if (tmp && (!(idx->store = docstore_new(idx->fd, idx->store_type, 
+              idx->storage.max_filesize, DOCSTORE_CACHE))
+            || (docstore_read(idx->store, fp) != DOCSTORE_OK))) {
+            ERROR("reading document store");
+            FAIL();
+        }
+
         /* retrieve index config name */
         idx->params.config = NULL;
         READ_MEMBER(fp, tmp, uint32_t);
@@ -342,6 +478,14 @@ static int index_params_write(struct index *idx,
         WRITE_MEMBER(fp, idx->doc_order_vectors, uint32_t);
         WRITE_MEMBER(fp, idx->doc_order_word_pos_vectors, uint32_t);
         WRITE_MEMBER(fp, idx->impact_vectors, uint32_t);
+        WRITE_MEMBER(fp, idx->skip_vectors, uint32_t);
+        WRITE_MEMBER(fp, idx->separate_positions, uint32_t);
+        WRITE_MEMBER(fp, idx->list_codec, uint32_t);
+        WRITE_MEMBER(fp, idx->bounds.build, uint32_t);
+        WRITE_DOUBLE(fp, idx->bounds.k1);
+        WRITE_DOUBLE(fp, idx->bounds.b);
+        WRITE_DOUBLE(fp, idx->bounds.mu);
+        WRITE_MEMBER(fp, idx->fields, uint32_t);
 
         WRITE_MEMBER(fp, root_fileno, uint32_t);
         WRITE_MEMBER(fp, root_offset, uint32_t);
@@ -353,6 +497,18 @@ static int index_params_write(struct index *idx,
             FAIL();
         }
 
+        /* write segments */
+        WRITE_MEMBER(fp, !!idx->segs, uint32_t);
+        if (idx->segs && (segments_write(idx->segs, fp) != SEGMENT_OK)) {
+            FAIL();
+        }
+
+        /* write document store */
+        WRITE_MEMBER(fp, !!idx->store, uint32_t);
+        if (idx->store && (docstore_write(idx->store, fp) != DOCSTORE_OK)) {
+            FAIL();
+        }
+
         /* write config filename */
         if (idx->params.config) {
             i = str_len(idx->params.config);
@@ -437,7 +593,11 @@ int index_commit_superblock(struct index *idx) {
 
     /* write parameters to disk */
     if (index_params_write(idx, root_fileno, root_offset, btree_size)) {
-        /* write succeeded */
+        /* write succeeded, segments replaced by merges aren't needed any 
+         * more */
+        if (idx->segs) {
+            segments_written(idx->segs);
+        }
     } else {
         assert(!CRASH);
         return 0;
@@ -456,10 +616,16 @@ static int index_set_fd_types(struct index *idx, const char * name) {
           &idx->vocab_type) != FDSET_OK
       || fdset_create_new_type(idx->fd, name, DOCMAPSUF, 1, 
           &idx->docmap_type) != FDSET_OK
+      || fdset_create_new_type(idx->fd, name, MAPCACHESUF, 1, 
+          &idx->mapcache_type) != FDSET_OK
       || fdset_create_new_type(idx->fd, name, "vtmp", 1, 
           &idx->vtmp_type) != FDSET_OK
       || fdset_create_new_type(idx->fd, name, "tmp", 1, 
-          &idx->tmp_type) != FDSET_OK) {
+          &idx->tmp_type) != FDSET_OK
+      || fdset_create_new_type(idx->fd, name, WINDOWSUF, 1, 
+          &idx->window_type) != FDSET_OK
+      || fdset_create_new_type(idx->fd, name, STORESUF, 1, 
+          &idx->store_type) != FDSET_OK) {
         return -1;
     }
     return 0;
@@ -505,6 +671,18 @@ struct index *index_new(const char *name, const char *config,
     idx->vocabs = 0;
     idx->merger = NULL;
     idx->sum = NULL;
+    idx->listcache = NULL;
+    idx->resultcache = NULL;
+    idx->segs = NULL;
+    idx->store = NULL;
+    idx->sumpool.sum = NULL;
+    idx->sumpool.len = idx->sumpool.size = 0;
+    idx->accpool.acc = NULL;
+    idx->accpool.len = idx->accpool.size = 0;
+#ifdef MT_ZET
+    pthread_mutex_init(&idx->sumpool.mutex, NULL);
+    pthread_mutex_init(&idx->accpool.mutex, NULL);
+#endif /* MT_ZET */
     idx->istop = NULL;
     idx->qstop = NULL;
     idx->params.config = NULL;
@@ -518,6 +696,15 @@ struct index *index_new(const char *name, const char *config,
     idx->doc_order_vectors = 0;
     idx->doc_order_word_pos_vectors = 1;
     idx->impact_vectors = 0;
+    idx->skip_vectors = 0;
+    idx->separate_positions = 0;
+    idx->list_codec = INDEX_CODEC_VBYTE;
+    idx->bounds.build = 0;
+    idx->bounds.k1 = BOUND_DEFAULT_K1;
+    idx->bounds.b = BOUND_DEFAULT_B;
+    idx->bounds.mu = BOUND_DEFAULT_MU;
+    idx->fields = 1;
+    idx->field_bits = 0;
     
     /* initialise stemming algorithm if requested */
     if (opts & INDEX_NEW_STEM) {
@@ -577,6 +764,15 @@ struct index *index_new(const char *name, const char *config,
     if (opts & INDEX_NEW_PARSEBUF) {
         idx->params.parsebuf = opt->parsebuf;
     }
+    if (opts & INDEX_NEW_CODEC) {
+        if ((opt->codec != INDEX_CODEC_VBYTE) 
+          && (opt->codec != INDEX_CODEC_BLOCK)) {
+            ERROR1("unknown list codec %d", (int) opt->codec);
+            index_delete(idx);
+            return NULL;
+        }
+        idx->list_codec = opt->codec;
+    }
 
     if ((idx->fd = fdset_new(0644, 1)) == NULL) {
         ERROR("creating fdset for new index");
@@ -621,6 +817,15 @@ struct index *index_new(const char *name, const char *config,
         idx->storage.vocab_lsize = opt->vocab_size;
     }
 
+    if ((opts & INDEX_NEW_DOCSTORE) 
+      && !(idx->store = docstore_new(idx->fd, idx->store_type, 
+          idx->storage.max_filesize, DOCSTORE_CACHE))) {
+        ERROR("creating document store");
+        index_rm(idx);
+        index_delete(idx);
+        return NULL;
+    }
+
     idx->params.memory = memory;
     if (config) {
         if ((idx->params.config = str_dup(config)) == NULL) {
@@ -631,23 +836,6 @@ struct index *index_new(const char *name, const char *config,
         }
     }
 
-    if ((idx->map = docmap_new(idx->fd, idx->docmap_type, 
-        idx->storage.pagesize,
-        0, idx->storage.max_filesize, 0, &dm_ret)) == NULL) {
-
-        ERROR1("creating docmap: error code '%d'", dm_ret);
-        index_rm(idx);
-        index_delete(idx);
-        return NULL;
-    }
-    if (!(idx->post = postings_new(idx->params.tblsize, index_stemmer(idx), 
-        idx->stem, idx->istop))) {
-
-        ERROR("creating postings");
-        index_rm(idx);
-        index_delete(idx);
-        return NULL;
-    }
     if (idx->params.config) {
         if ((fp = fopen((const char *) idx->params.config, "rb"))
           && (idx->settings = psettings_read(fp, PSETTINGS_ATTR_INDEX))) {
@@ -669,6 +857,28 @@ struct index *index_new(const char *name, const char *config,
         return NULL;
     }
 
+    /* documents are divided into the fields the parser settings give */
+    idx->fields = psettings_fields(idx->settings);
+    idx->field_bits = postings_field_bits(idx->fields);
+
+    if ((idx->map = docmap_new(idx->fd, idx->docmap_type, 
+        idx->mapcache_type, idx->storage.pagesize,
+        0, idx->storage.max_filesize, idx->fields, 0, &dm_ret)) == NULL) {
+
+        ERROR1("creating docmap: error code '%d'", dm_ret);
+        index_rm(idx);
+        index_delete(idx);
+        return NULL;
+    }
+    if (!(idx->post = postings_new(idx->params.tblsize, index_stemmer(idx), 
+        idx->stem, idx->istop, idx->fields))) {
+
+        ERROR("creating postings");
+        index_rm(idx);
+        index_delete(idx);
+        return NULL;
+    }
+
     if ((idx->merger 
       = pyramid_new(idx->fd, idx->tmp_type, idx->index_type, idx->vocab_type,
           PYRAMID_WIDTH, &idx->storage, NULL, NULL)) 
@@ -729,6 +939,18 @@ struct index *index_load(const char *name, unsigned int memory, int opts,
     idx->istop = NULL; 
     idx->qstop = NULL; 
     idx->sum = NULL; 
+    idx->listcache = NULL;
+    idx->resultcache = NULL;
+    idx->segs = NULL;
+    idx->store = NULL;
+    idx->sumpool.sum = NULL;
+    idx->sumpool.len = idx->sumpool.size = 0;
+    idx->accpool.acc = NULL;
+    idx->accpool.len = idx->accpool.size = 0;
+#ifdef MT_ZET
+    pthread_mutex_init(&idx->sumpool.mutex, NULL);
+    pthread_mutex_init(&idx->accpool.mutex, NULL);
+#endif /* MT_ZET */
     idx->repos = 0; 
     idx->vectors = 0; 
     idx->merger = NULL; 
@@ -779,6 +1001,21 @@ struct index *index_load(const char *name, unsigned int memory, int opts,
     if (opts & INDEX_LOAD_DOCMAP_CACHE) {
         dm_cache = opt->docmap_cache;
     }
+    if (opts & INDEX_LOAD_MMAP) {
+        /* failure isn't fatal, files just get read instead */
+        fdset_set_type_map(idx->fd, idx->index_type, FDSET_MAP_SEQUENTIAL);
+        fdset_set_type_map(idx->fd, idx->vocab_type, FDSET_MAP_RANDOM);
+        fdset_set_type_map(idx->fd, idx->docmap_type, FDSET_MAP_RANDOM);
+        fdset_set_type_map(idx->fd, idx->mapcache_type, FDSET_MAP_RANDOM);
+    }
+    if (((opts & INDEX_LOAD_LIST_CACHE) && opt->list_cache
+        && !(idx->listcache = cache_new(opt->list_cache)))
+      || ((opts & INDEX_LOAD_RESULT_CACHE) && opt->result_cache
+        && !(idx->resultcache = cache_new(opt->result_cache)))) {
+        ERROR("creating caches");
+        index_delete(idx);
+        return NULL;
+    }
 
     /* initialise stemming algorithm if required */
     if (idx->flags & INDEX_STEMMED) {
@@ -817,8 +1054,8 @@ struct index *index_load(const char *name, unsigned int memory, int opts,
 
     /* read the docmap off of disk */
     if ((idx->map = docmap_load(idx->fd, idx->docmap_type, 
-          idx->storage.pagesize, 0, idx->storage.max_filesize, 
-          dm_cache, &dm_ret)) 
+          idx->mapcache_type, idx->storage.pagesize, 0, idx->storage.max_filesize, 
+          idx->fields, dm_cache, &dm_ret)) 
       == NULL) {
 
         ERROR1("loading docmap: error is '%s'", docmap_strerror(dm_ret));
@@ -827,8 +1064,9 @@ struct index *index_load(const char *name, unsigned int memory, int opts,
     }
 
     /* now initialise the rest of the members */
+    idx->field_bits = postings_field_bits(idx->fields);
     if (!(idx->post = postings_new(idx->params.tblsize, index_stemmer(idx), 
-        idx->stem, NULL))) {
+        idx->stem, NULL, idx->fields))) {
 
         ERROR("creating postings");
         index_delete(idx);
@@ -902,6 +1140,18 @@ int index_rm(struct index *idx) {
     }
 
     for (i = 0; fdset_unlink(idx->fd, idx->docmap_type, i) == FDSET_OK; i++) ;
+    fdset_unlink(idx->fd, idx->mapcache_type, 0);
+
+    /* there's only a window file if compressed files were indexed */
+    fdset_unlink(idx->fd, idx->window_type, 0);
+
+    if (idx->store) {
+        docstore_rm(idx->store);
+    }
+
+    if (idx->segs) {
+        segments_rm(idx->segs);
+    }
 
     /* index_new creates a single vector file to find out maximum file
        size, but this doesn't get added to idx->vectors until actually
@@ -957,6 +1207,7 @@ int index_expensive_stats(const struct index *idx,
       = stats->vectors_vocab = stats->allocated_files = 0;
     stats->vocab_info = 0;
     stats->vocab_structure = 0;
+    stats->vectors_postings = stats->vectors_positions = 0;
     terms = 0;
     while ((term 
       = iobtree_next_term(idx->vocab, state, &tmp, &data, &datalen))) {
@@ -976,6 +1227,16 @@ int index_expensive_stats(const struct index *idx,
             info = vec_vbyte_len(vv.header.doc.docs) 
               + vec_vbyte_len(vv.header.doc.occurs) 
               + vec_vbyte_len(vv.header.doc.last) + vec_vbyte_len(vv.size);
+            if (vv.type == VOCAB_VTYPE_DOCWP_SKIP) {
+                info += vec_vbyte_len(vv.header.docwp_skip.skipsize);
+            } else if ((vv.type == VOCAB_VTYPE_DOCWP_SEP)
+              || (vv.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
+                info += vec_vbyte_len(vv.header.docwp_sep.skipsize)
+                  + vec_vbyte_len(vv.header.docwp_sep.docsize);
+                stats->vectors_postings += vv.header.docwp_sep.docsize;
+                stats->vectors_positions += vv.size 
+                  - vv.header.docwp_sep.skipsize - vv.header.docwp_sep.docsize;
+            }
             stats->vocab_info += vec_vbyte_len(tmp) + tmp + info;
             assert(bytes > info);
             stats->vocab_structure += bytes - info;
@@ -1019,8 +1280,38 @@ int index_stats(const struct index *idx, struct index_stats *stats) {
     stats->doc_order_vectors = idx->doc_order_vectors;
     stats->doc_order_word_pos_vectors = idx->doc_order_word_pos_vectors;
     stats->impact_vectors = idx->impact_vectors;
+    stats->skip_vectors = idx->skip_vectors;
+    stats->separate_positions = idx->separate_positions;
+    stats->list_codec = idx->list_codec;
+    stats->docstore = !!idx->store;
+    stats->score_bounds = idx->bounds.build;
+    stats->fields = idx->fields;
     stats->sorted = idx->flags & INDEX_SORTED;
 
+    stats->list_cache = 0;
+    stats->list_cache_lookups = stats->list_cache_hits = 0;
+    if (idx->listcache) {
+        stats->list_cache = cache_size(idx->listcache);
+        cache_stats(idx->listcache, &stats->list_cache_lookups, 
+          &stats->list_cache_hits);
+    }
+    stats->result_cache = 0;
+    stats->result_cache_lookups = stats->result_cache_hits = 0;
+    if (idx->resultcache) {
+        stats->result_cache = cache_size(idx->resultcache);
+        cache_stats(idx->resultcache, &stats->result_cache_lookups, 
+          &stats->result_cache_hits);
+    }
+    stats->store_cache = 0;
+    stats->store_cache_lookups = stats->store_cache_hits = 0;
+    if (idx->store) {
+        unsigned long int size;
+
+        docstore_cache_stats(idx->store, &size, &stats->store_cache_lookups, 
+          &stats->store_cache_hits);
+        stats->store_cache = size;
+    }
+
     return 1;
 }
 
@@ -1054,17 +1345,53 @@ enum stream_ret index_stream_read(struct stream *instream, int fd,
     } while (1);
 }
 
+struct stream_filter *index_repos_filter(const struct index *idx, 
+  unsigned int source, off_t offset, off_t *physoffset, off_t *curroffset) {
+    struct docmap_checkpoint check;
+    struct stream_filter *filter = NULL;
+    unsigned int windowlen;
+    void *window;
+    int fd;
+
+    if ((docmap_get_checkpoint(idx->map, source, offset, &check) 
+        == DOCMAP_OK)
+      && check.in_offset
+      && (window = malloc(GZCHECK_WINDOW))) {
+        if ((fd = fdset_pin(idx->fd, idx->window_type, 0, check.window, 
+            SEEK_SET)) >= 0) {
+            if (gzcheck_window_read(fd, check.window_len, window, &windowlen)
+              == GZCHECK_OK) {
+                filter = (struct stream_filter *) gunzipfilter_new_at(BUFSIZ,
+                    check.bits, check.prime, window, windowlen);
+            }
+            fdset_unpin(idx->fd, idx->window_type, 0, fd);
+        }
+        free(window);
+
+        if (filter) {
+            *physoffset = check.in_offset;
+            *curroffset = check.offset;
+            return filter;
+        }
+    }
+
+    /* decompress from the start of the file */
+    *physoffset = *curroffset = 0;
+    return (struct stream_filter *) gunzipfilter_new(BUFSIZ);
+}
+
 unsigned int index_retrieve(const struct index *idx, unsigned long int docno,
   unsigned long int dst_offset, void *dst, unsigned int dstsize) {
     off_t offset,
-          curroffset;
+          curroffset,
+          physoffset;
     unsigned int source,
                  bytes, 
                  rlen,
                  readb;
     enum docmap_flag flags;
     enum mime_types type;
-    int fd;
+    int fd = -1;
     struct stream *instream = NULL;
     struct stream_filter *gunzipfilter = NULL;
     char *buf = NULL,
@@ -1085,20 +1412,27 @@ unsigned int index_retrieve(const struct index *idx, unsigned long int docno,
             dstsize = bytes - dst_offset;
         }
 
-        if (flags & DOCMAP_COMPRESSED) {
-            /* read from compressed repository */
-            if ((fd = fdset_pin(idx->fd, idx->repos_type, source, 0, SEEK_SET))
+        if (idx->store && docstore_contains(idx->store, source)) {
+            /* read from the document store */
+            if (docstore_retrieve(idx->store, source, offset + dst_offset, 
+                dst, dstsize, &rlen) == DOCSTORE_OK) {
+                return rlen;
+            }
+        } else if (flags & DOCMAP_COMPRESSED) {
+            /* read from compressed repository, starting from the nearest
+             * checkpoint */
+            if ((gunzipfilter = index_repos_filter(idx, source, 
+                offset + dst_offset, &physoffset, &curroffset))
+              && ((fd = fdset_pin(idx->fd, idx->repos_type, source, 
+                physoffset, SEEK_SET)) >= 0)
               && (instream = stream_new()) 
-              && (gunzipfilter 
-                = (struct stream_filter *) gunzipfilter_new(BUFSIZ))
               && (buf = malloc(BUFSIZ))) {
                 /* read compressed repository until we get to where we're 
                  * after */
                 stream_filter_push(instream, gunzipfilter);
 
-                for (curroffset = 0; 
-                  curroffset + instream->avail_out < offset + dst_offset; ) {
-
+                while (curroffset + instream->avail_out 
+                  < offset + dst_offset) {
                     curroffset += instream->avail_out;
                     if (index_stream_read(instream, fd, buf, BUFSIZ) 
                       != STREAM_OK) {
@@ -1200,6 +1534,14 @@ int index_load_stoplist(struct index *idx, void *src,
 }
 
 void index_delete(struct index *idx) {
+    /* wait for segments to finish merging, and record merges that finished
+     * since the last commit (unless that would record uncommitted 
+     * documents) */
+    if (idx->segs && segments_finish(idx->segs) && idx->map 
+      && (!idx->post || !postings_documents(idx->post))) {
+        index_commit_superblock(idx);
+    }
+
     /* first, save the docmap */
     if (idx->map) {
         docmap_save(idx->map);  /* XXX: should be in index_commit()? */
@@ -1211,12 +1553,45 @@ void index_delete(struct index *idx) {
         summarise_delete(idx->sum);
         idx->sum = NULL;
     }
+    while (idx->sumpool.len) {
+        summarise_delete(idx->sumpool.sum[--idx->sumpool.len]);
+    }
+    free(idx->sumpool.sum);
+    idx->sumpool.sum = NULL;
+    while (idx->accpool.len) {
+        denseacc_delete(idx->accpool.acc[--idx->accpool.len]);
+    }
+    free(idx->accpool.acc);
+    idx->accpool.acc = NULL;
+#ifdef MT_ZET
+    pthread_mutex_destroy(&idx->sumpool.mutex);
+    pthread_mutex_destroy(&idx->accpool.mutex);
+#endif /* MT_ZET */
 
     if (idx->merger) {
         pyramid_delete(idx->merger);
         idx->merger = NULL;
     }
 
+    if (idx->listcache) {
+        cache_delete(idx->listcache);
+        idx->listcache = NULL;
+    }
+    if (idx->resultcache) {
+        cache_delete(idx->resultcache);
+        idx->resultcache = NULL;
+    }
+
+    if (idx->segs) {
+        segments_delete(idx->segs);
+        idx->segs = NULL;
+    }
+
+    if (idx->store) {
+        docstore_delete(idx->store);
+        idx->store = NULL;
+    }
+
     if (idx->vocab) {
         iobtree_delete(idx->vocab);
         idx->vocab = NULL;
@@ -1283,16 +1658,15 @@ unsigned int index_retrieve_doc_bytes(const struct index *idx,
         return bytes;
 }
 
-int index_add(struct index *idx, const char *file, const char *mimetype,
-  unsigned long int *docno, unsigned int *docs, 
-  unsigned int opts, struct index_add_opt *opt, 
-  unsigned int commitopts, struct index_commit_opt *commitopt) {
-    void *parsebuf = NULL, 
-         *dumpbuf = NULL;
+int index_parse(struct index *idx, int fd, const char *file,
+  const char *mimetype, struct postings *post, unsigned long int docno,
+  int (*enddoc)(void *opaque, struct makeindex *mi, off_t offset,
+    unsigned int bytes, enum docmap_flag flags),
+  int (*eof)(void *opaque, struct makeindex *mi), void *opaque,
+  const char **type) {
+    void *parsebuf = NULL;
     struct makeindex mispace,
                      *mi = NULL;
-    int infd = -1,
-        outfd;
     off_t bytes_read = 0,
           last_pos = 0,
           curr_pos = 0;
@@ -1300,33 +1674,13 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
                  multiple_compression = 0;
     ssize_t readlen;
     enum makeindex_ret miret;
-    unsigned int accbuf = idx->params.memory,
-                 accdoc = 0,
-                 dumpbufsz = DUMP_BUFFER;
     struct stream *instream = NULL;
     enum stream_ret sret;
     struct stream_filter *filter = NULL;
-    enum docmap_ret dm_ret;
-    unsigned long int docno_out;
-    const char *aux_docno;
     enum mime_types mtype,
                     comptype;
     enum docmap_flag flags = DOCMAP_NO_FLAGS;
 
-    TIMINGS_DECL();
-
-    TIMINGS_START();
-
-    if (opts & INDEX_ADD_ACCBUF) {
-        accbuf = opt->accbuf;
-    }
-    if (opts & INDEX_ADD_ACCDOC) {
-        accdoc = opt->accdoc;
-    }
-    if (commitopts & INDEX_COMMIT_DUMPBUF) {
-        dumpbufsz = commitopt->dumpbuf;
-    }
-
 #define FAIL()                                                                \
     if (1) {                                                                  \
         assert(!CRASH);                                                       \
@@ -1339,27 +1693,15 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
         if (mi) {                                                             \
             makeindex_delete(mi);                                             \
         }                                                                     \
-        if (dumpbuf) {                                                        \
-            free(dumpbuf);                                                    \
-        }                                                                     \
         if (parsebuf) {                                                       \
             free(parsebuf);                                                   \
         }                                                                     \
-        if (infd >= 0) {                                                      \
-            fdset_unpin(idx->fd, idx->repos_type, idx->repos, infd);          \
-        }                                                                     \
         return 0;                                                             \
     } else
 
     if ((parsebuf = malloc(idx->params.parsebuf)) 
-      && (fdset_set_fd_name(idx->fd, idx->repos_type, idx->repos, file,
-          str_len(file), 0) == FDSET_OK)
-      && ((infd = fdset_pin(idx->fd, idx->repos_type, idx->repos, 0, 
-          SEEK_SET)) >= 0)
       && (instream = stream_new())
       && (filter = (struct stream_filter *) detectfilter_new(BUFSIZ, 0))) {
-        int ret;
-
         /* push detection filter onto stream to auto-detect gzip encoding */
         stream_filter_push(instream, filter);
         filter = NULL;
@@ -1381,7 +1723,7 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
             case STREAM_INPUT:
                 assert(instream->avail_in == 0);
                 instream->next_in = parsebuf;
-                if ((readlen = read(infd, parsebuf, idx->params.parsebuf)) 
+                if ((readlen = read(fd, parsebuf, idx->params.parsebuf)) 
                   > 0) {
                     instream->avail_in = (unsigned int) readlen;
                 } else if (!readlen) {
@@ -1428,15 +1770,14 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
             /* detect from the start of the file */
             mtype = mime_content_guess(instream->curr_out, instream->avail_out);
         }
-        opt->detected_type = mime_string(mtype);
+        *type = mime_string(mtype);
 
         /* can now initialise makeindex module */
         if (((miret = makeindex_new(&mispace, idx->settings, 
             idx->storage.max_termlen, mtype)) == MAKEINDEX_OK)) {
             mi = &mispace;
-            *docno = mi->docs = docmap_entries(idx->map);
-            mi->post = idx->post;
-            *docs = 0;
+            mi->docs = docno;
+            mi->post = post;
             mi->next_in = instream->curr_out;
             mi->avail_in = instream->avail_out;
         } else {
@@ -1452,9 +1793,7 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
         do {
             switch ((miret = makeindex(mi))) {
             case MAKEINDEX_ENDDOC:
-                assert(!postings_needs_update(idx->post));
-
-                /* add document to the docmap */
+                assert(!postings_needs_update(mi->post));
 
                 /* XXX: + (mi->avail_in == 0) is needed to push pos 
                  * over '>' in end tag.  This is dodgy because we 
@@ -1466,81 +1805,16 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
                 curr_pos = bytes_read - mi->avail_in 
                   - makeindex_buffered(mi) + (mi->avail_in != 0);
 
-                (*docs)++;
-                aux_docno = makeindex_docno(mi);
-                mtype = makeindex_type(mi);
-                dm_ret = docmap_add(idx->map, idx->repos, last_pos, 
-                  curr_pos - last_pos, flags, 
-                  mi->stats.terms, mi->stats.distinct, 
-                  mi->stats.weight, aux_docno, strlen(aux_docno), mtype,
-                  &docno_out);
-                if (dm_ret != DOCMAP_OK) {
-                    ERROR1("error on docmap_add: %s", 
-                      docmap_strerror(dm_ret));
+                if (!enddoc(opaque, mi, last_pos, curr_pos - last_pos, 
+                    flags)) {
                     FAIL();
                 }
-                assert(docno_out == mi->docs - 1);
                 last_pos = curr_pos;
-
-                /* check if we need to dump the postings */
-                if ((postings_memsize(idx->post) >= accbuf) 
-                  && (postings_documents(idx->post) >= accdoc)) {
-
-                    TIMINGS_END("parsing");
-                    TIMINGS_START();
-
-                    if (!(idx->flags & INDEX_BUILT)
-                        /* index is in construction, add to merger pyramid */
-                      && (dumpbuf || (dumpbuf = malloc(dumpbufsz)))
-                      && ((outfd = pyramid_pin_next(idx->merger)) >= 0)
-                      && (postings_dump(idx->post, dumpbuf, dumpbufsz, outfd))
-                      && (pyramid_unpin_next(idx->merger, outfd) == PYRAMID_OK)
-                      && (pyramid_add_file(idx->merger, 1, dumpbuf, dumpbufsz)
-                        == PYRAMID_OK)) {
-                        /* do nothing, dumping succeeded */
-
-                    } else if ((idx->flags & INDEX_BUILT) 
-                      /* need to do an update */
-                      && index_commit_internal(idx, commitopts, commitopt, 
-                          opts & ~INDEX_ADD_FLUSH, opt)) {
-
-                        /* update succeeded */
-                    } else {
-                        /* error */
-                        FAIL();
-                    }
-                    TIMINGS_END("dumping");
-                    TIMINGS_START();
-                }
                 break;
 
             case MAKEINDEX_EOF:
-                /* check if we need to commit changes */
-                if (opts & INDEX_ADD_FLUSH) {
-                    TIMINGS_END("parsing");
-                    TIMINGS_START();
-
-                    if (!(idx->flags & INDEX_BUILT)
-                        /* index is in construction, add to merger pyramid */
-                      && (dumpbuf || (dumpbuf = malloc(dumpbufsz)))
-                      && ((outfd = pyramid_pin_next(idx->merger)) >= 0)
-                      && (postings_dump(idx->post, dumpbuf, dumpbufsz, outfd))
-                      && (pyramid_unpin_next(idx->merger, outfd) == PYRAMID_OK)
-                      && (pyramid_add_file(idx->merger, 1, dumpbuf, dumpbufsz)
-                        == PYRAMID_OK)) {
-                        /* do nothing, dumping succeeded */
-                    } else if ((idx->flags & INDEX_BUILT) 
-                      /* need to do an update */
-                      && index_commit_internal(idx, commitopts, commitopt, 
-                          opts & ~INDEX_ADD_FLUSH, opt)) {
-
-                        /* update succeeded */
-                    } else {
-                        /* error */
-                        FAIL();
-                    }
-                    TIMINGS_END("dumping");
-                    TIMINGS_START();
+                if (eof && !eof(opaque, mi)) {
+                    FAIL();
                 }
                 break;
  
@@ -1567,7 +1841,7 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
                         assert(instream->avail_in == 0);
                         instream->next_in = parsebuf;
                         if ((readlen 
-                          = read(infd, parsebuf, idx->params.parsebuf)) > 0) {
+                          = read(fd, parsebuf, idx->params.parsebuf)) > 0) {
                             instream->avail_in = (unsigned int) readlen;
                         } else if (!readlen) {
                             /* flush stream */
@@ -1590,16 +1864,9 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
             }
         } while (miret != MAKEINDEX_EOF);
 
-        ret = fdset_unpin(idx->fd, idx->repos_type, idx->repos, infd);
-        assert(ret == FDSET_OK);
         free(parsebuf);
-        if (dumpbuf) {
-            free(dumpbuf);
-        }
-        assert(mi->docs == docmap_entries(idx->map));
         makeindex_delete(mi);
         stream_delete(instream);
-        idx->repos++;
 
         return 1;
     } else {
@@ -1608,6 +1875,252 @@ int index_add(struct index *idx, const char *file, const char *mimetype,
 #undef FAIL
 }
 
+/* state kept by index_add while it parses a file */
+struct add {
+    struct index *idx;                    /* index being added to */
+    unsigned int opts;                    /* options for index_add */
+    struct index_add_opt *opt;            /* options for index_add */
+    unsigned int commitopts;              /* options for commits */
+    struct index_commit_opt *commitopt;   /* options for commits */
+    unsigned int accbuf;                  /* postings memory before dumping */
+    unsigned int accdoc;                  /* documents before dumping */
+    void *dumpbuf;                        /* buffer for dumping (or NULL) */
+    unsigned int dumpbufsz;               /* size of dumpbuf */
+    unsigned int docs;                    /* documents added from file */
+    int fd;                               /* file being added */
+};
+
+/* internal function to write out the postings accumulated by index_add, either
+ * by adding them to the merging pyramid during construction or by updating the
+ * index */
+static int add_dump(struct add *add) {
+    struct index *idx = add->idx;
+    int outfd;
+
+    TIMINGS_DECL();
+    TIMINGS_START();
+
+    if (!(idx->flags & INDEX_BUILT)
+        /* index is in construction, add to merger pyramid */
+      && (add->dumpbuf || (add->dumpbuf = malloc(add->dumpbufsz)))
+      && ((outfd = pyramid_pin_next(idx->merger)) >= 0)
+      && (postings_dump(idx->post, add->dumpbuf, add->dumpbufsz, outfd))
+      && (pyramid_unpin_next(idx->merger, outfd) == PYRAMID_OK)
+      && (pyramid_add_file(idx->merger, 1, add->dumpbuf, add->dumpbufsz)
+        == PYRAMID_OK)) {
+        /* do nothing, dumping succeeded */
+
+    } else if ((idx->flags & INDEX_BUILT) 
+      /* need to do an update */
+      && index_commit_internal(idx, add->commitopts, add->commitopt, 
+          add->opts & ~INDEX_ADD_FLUSH, add->opt)) {
+
+        /* update succeeded */
+    } else {
+        /* error */
+        return 0;
+    }
+
+    TIMINGS_END("dumping");
+    return 1;
+}
+
+/* index_parse callback to add a document to the docmap */
+static int add_enddoc(void *opaque, struct makeindex *mi, off_t offset,
+  unsigned int bytes, enum docmap_flag flags) {
+    struct add *add = opaque;
+    struct index *idx = add->idx;
+    const char *aux_docno = makeindex_docno(mi);
+    unsigned long int docno_out;
+    enum docmap_ret dm_ret;
+
+    add->docs++;
+    dm_ret = docmap_add(idx->map, idx->repos, offset, bytes, flags, 
+      mi->stats.terms, mi->stats.distinct, mi->stats.fields, 
+      mi->stats.weight, aux_docno, 
+      strlen(aux_docno), makeindex_type(mi), &docno_out);
+    if (dm_ret != DOCMAP_OK) {
+        ERROR1("error on docmap_add: %s", docmap_strerror(dm_ret));
+        return 0;
+    }
+    assert(docno_out == mi->docs - 1);
+
+    /* documents added to a built index can be searched before they're 
+     * committed, so the number of terms in the collection has to include 
+     * them straight away */
+    if (idx->flags & INDEX_BUILT) {
+        if (idx->stats.terms_low + mi->stats.terms < idx->stats.terms_low) {
+            idx->stats.terms_high++;
+        }
+        idx->stats.terms_low += mi->stats.terms;
+    }
+
+    /* check if we need to dump the postings */
+    if ((postings_memsize(idx->post) >= add->accbuf) 
+      && (postings_documents(idx->post) >= add->accdoc)) {
+        return add_dump(add);
+    }
+    return 1;
+}
+
+/* gzcheck_scan callback to write out the window of a checkpoint and add the
+ * checkpoint to the docmap */
+static enum gzcheck_ret add_checkpoint(void *opaque, 
+  const struct gzcheck_point *point) {
+    struct index *idx = opaque;
+    struct docmap_checkpoint check;
+    enum gzcheck_ret ret;
+    off_t window;
+    int fd;
+
+    if (((fd = fdset_pin(idx->fd, idx->window_type, 0, 0, SEEK_END)) < 0)
+      && ((fd = fdset_create(idx->fd, idx->window_type, 0)) < 0)) {
+        return GZCHECK_EIO;
+    }
+    if ((window = lseek(fd, 0, SEEK_CUR)) < 0) {
+        fdset_unpin(idx->fd, idx->window_type, 0, fd);
+        return GZCHECK_EIO;
+    }
+    ret = gzcheck_window_write(fd, point, &check.window_len);
+    fdset_unpin(idx->fd, idx->window_type, 0, fd);
+    if (ret != GZCHECK_OK) {
+        return ret;
+    }
+
+    check.offset = point->offset;
+    check.in_offset = point->in_offset;
+    check.bits = point->bits;
+    check.prime = point->prime;
+    check.window = window;
+    if (docmap_add_checkpoint(idx->map, idx->repos, &check) != DOCMAP_OK) {
+        return GZCHECK_ERR;
+    }
+    return GZCHECK_OK;
+}
+
+/* internal function to record checkpoints throughout the file added by
+ * index_add if it's compressed, so that retrieving documents from it doesn't
+ * require decompressing everything before them.  This takes another pass
+ * over the file, since the decompression while parsing doesn't stop at the
+ * points where checkpoints can be taken.  Checkpoints only make retrieval
+ * faster, so failing to record them isn't an error. */
+static void add_checkpoints(struct add *add) {
+    struct index *idx = add->idx;
+    struct docmap_checkpoint check;
+    enum gzcheck_ret ret;
+    off_t pos;
+
+    if (add->docs 
+      && (docmap_get_checkpoint(idx->map, idx->repos, 0, &check) 
+        == DOCMAP_OK)
+      && ((pos = lseek(add->fd, 0, SEEK_CUR)) >= 0)
+      && (lseek(add->fd, 0, SEEK_SET) == 0)) {
+        if ((ret = gzcheck_scan(add->fd, GZCHECK_SPAN, add_checkpoint, idx)) 
+          != GZCHECK_OK) {
+            ERROR1("recording checkpoints in compressed file: error code '%d'", 
+              ret);
+        }
+        lseek(add->fd, pos, SEEK_SET);
+    }
+}
+
+int index_store(struct index *idx, unsigned int repos, int fd) {
+    enum docstore_ret ret;
+    off_t pos;
+
+    if (((pos = lseek(fd, 0, SEEK_CUR)) < 0)
+      || (lseek(fd, 0, SEEK_SET) != 0)) {
+        ret = DOCSTORE_EIO;
+    } else {
+        ret = docstore_add(idx->store, repos, fd);
+        lseek(fd, pos, SEEK_SET);
+    }
+    if (ret != DOCSTORE_OK) {
+        ERROR1("adding file to document store: error code '%d'", ret);
+        return 0;
+    }
+    return 1;
+}
+
+/* index_parse callback to copy the file into the document store (or record
+ * checkpoints, which the store makes unnecessary) and commit changes at the 
+ * end of the file if asked */
+static int add_eof(void *opaque, struct makeindex *mi) {
+    struct add *add = opaque;
+
+    if (add->idx->store) {
+        index_store(add->idx, add->idx->repos, add->fd);
+    } else {
+        add_checkpoints(add);
+    }
+    return !(add->opts & INDEX_ADD_FLUSH) || add_dump(add);
+}
+
+int index_add(struct index *idx, const char *file, const char *mimetype,
+  unsigned long int *docno, unsigned int *docs, 
+  unsigned int opts, struct index_add_opt *opt, 
+  unsigned int commitopts, struct index_commit_opt *commitopt) {
+    struct add add;
+    int infd,
+        ret;
+
+    TIMINGS_DECL();
+
+    TIMINGS_START();
+
+    add.idx = idx;
+    add.opts = opts;
+    add.opt = opt;
+    add.commitopts = commitopts;
+    add.commitopt = commitopt;
+    add.accbuf = idx->params.memory;
+    add.accdoc = 0;
+    add.dumpbuf = NULL;
+    add.dumpbufsz = DUMP_BUFFER;
+    add.docs = 0;
+    if (opts & INDEX_ADD_ACCBUF) {
+        add.accbuf = opt->accbuf;
+    }
+    if (opts & INDEX_ADD_ACCDOC) {
+        add.accdoc = opt->accdoc;
+    }
+    if (commitopts & INDEX_COMMIT_DUMPBUF) {
+        add.dumpbufsz = commitopt->dumpbuf;
+    }
+
+    if ((fdset_set_fd_name(idx->fd, idx->repos_type, idx->repos, file,
+          str_len(file), 0) != FDSET_OK)
+      || ((infd = fdset_pin(idx->fd, idx->repos_type, idx->repos, 0, 
+          SEEK_SET)) < 0)) {
+        assert(!CRASH);
+        return 0;
+    }
+
+    add.fd = infd;
+    *docno = docmap_entries(idx->map);
+    ret = index_parse(idx, infd, file, mimetype, idx->post, *docno, 
+      add_enddoc, add_eof, &add, &opt->detected_type);
+    *docs = add.docs;
+
+    /* documents added to a built index are found by searches before they're
+     * committed, so cached results may be out of date */
+    if (add.docs && (idx->flags & INDEX_BUILT) && idx->resultcache) {
+        cache_clear(idx->resultcache);
+    }
+
+    fdset_unpin(idx->fd, idx->repos_type, idx->repos, infd);
+    if (add.dumpbuf) {
+        free(add.dumpbuf);
+    }
+    TIMINGS_END("parsing");
+
+    if (ret) {
+        assert(*docno + *docs == docmap_entries(idx->map));
+        idx->repos++;
+    }
+    return ret;
+}
+
 int index_construct(struct index *idx, int opts, struct index_commit_opt *opt) {
     void *dumpbuf;
     unsigned int dumpbufsz = idx->params.memory;
@@ -1675,29 +2188,43 @@ int index_construct(struct index *idx, int opts, struct index_commit_opt *opt) {
     }
 }
 
-/* small internal function to update stats during commit */
+/* small internal function to update stats during commit (the number of 
+ * terms is updated as documents are added, see add_enddoc) */
 static int stat_update(struct index *idx) {
-    unsigned int terms = postings_total_terms(idx->post);
-
-    if (idx->stats.terms_low + terms < idx->stats.terms_low) {
-        idx->stats.terms_high++;
-    }
-    idx->stats.terms_low += terms;
-
     if (docmap_avg_weight(idx->map, &idx->stats.avg_weight) != DOCMAP_OK 
       || docmap_avg_bytes(idx->map, &idx->stats.avg_length) != DOCMAP_OK)
         return 0;
     return 1;
 }
 
+/* internal function to discard everything cached from an index that's about
+ * to change */
+static void index_cache_clear(struct index *idx) {
+    if (idx->listcache) {
+        cache_clear(idx->listcache);
+    }
+    if (idx->resultcache) {
+        cache_clear(idx->resultcache);
+    }
+}
+
 int index_commit_internal(struct index *idx, 
   unsigned int opts, struct index_commit_opt *opt, 
   unsigned int addopts, struct index_add_opt *addopt) {
 
+    index_cache_clear(idx);
+
     if (docmap_avg_weight(idx->map, &idx->stats.avg_weight) != DOCMAP_OK 
       || docmap_avg_bytes(idx->map, &idx->stats.avg_length) != DOCMAP_OK)
         return 0;
 
+    /* once asked for, updates are written as segments from then on */
+    if ((opts & INDEX_COMMIT_SEGMENTS) && !idx->segs 
+      && !(idx->segs = segments_new(idx))) {
+        ERROR("creating segments");
+        return 0;
+    }
+
     if (!(idx->flags & INDEX_BUILT)
         /* index is in construction, add to merger pyramid */
       && (idx->vocab == NULL)
@@ -1707,7 +2234,18 @@ int index_commit_internal(struct index *idx,
         /* construction succeeded */
         return 1;
 
-    } else if ((idx->flags & INDEX_BUILT)
+    } else if ((idx->flags & INDEX_BUILT) && idx->segs
+      /* write postings out as a new segment */
+      && (segments_commit(idx->segs, idx->post) == SEGMENT_OK)
+      && stat_update(idx)
+      && index_commit_superblock(idx)) {
+
+        /* succeeded, clear accumulated postings */
+        postings_clear(idx->post);
+        idx->stats.updates++;
+        return 1;
+
+    } else if ((idx->flags & INDEX_BUILT) && !idx->segs
       /* need to remerge index */
       && index_remerge(idx, opts, opt)
       && stat_update(idx)
@@ -1731,7 +2269,27 @@ int index_commit(struct index *idx,
   unsigned int addopts, struct index_add_opt *addopt) {
     int ret,
         altered = 0;
+    unsigned int root_fileno,
+                 terms;
+    unsigned long int root_offset;
     enum impact_ret impact_ret;
+    enum skip_ret skip_ret;
+    enum bound_ret bound_ret;
+    /* whether this commit writes a segment, leaving the index alone */
+    int segment = (idx->flags & INDEX_BUILT) 
+      && (idx->segs || (opts & INDEX_COMMIT_SEGMENTS));
+    /* whether this commit builds the index, rather than remerging it */
+    int build = !(idx->flags & INDEX_BUILT);
+
+    /* skip tables and separate word positions, once asked for, are kept 
+     * from then on.  They're recorded before the commit, so that the 
+     * remerge can lay out vectors as it writes them. */
+    if (opts & INDEX_COMMIT_SKIPS) {
+        idx->skip_vectors = 1;
+    }
+    if (opts & INDEX_COMMIT_SEPARATE_POSITIONS) {
+        idx->separate_positions = 1;
+    }
 
     ret = index_commit_internal(idx, opts, opt, addopts, addopt);
 
@@ -1757,6 +2315,11 @@ int index_commit(struct index *idx,
               && (fdset_name(idx->fd, idx->index_type, i, srcfile, FILENAME_MAX,
                 &len, &write) == FDSET_OK)
 
+              /* close fds cached under the old names, which would otherwise
+               * be handed out for the wrong files */
+              && (fdset_close_file(idx->fd, idx->tmp_type, i) == FDSET_OK)
+              && (fdset_close_file(idx->fd, idx->index_type, i) == FDSET_OK)
+
               /* perform move */
               && (unlink(dstfile), 1)        /* don't care if this fails */
               && (rename(srcfile, dstfile) == 0)) {
@@ -1797,6 +2360,8 @@ int index_commit(struct index *idx,
                 &len, &write) == FDSET_OK)
               && (fdset_name(idx->fd, idx->vocab_type, i, srcfile, FILENAME_MAX,
                 &len, &write) == FDSET_OK)
+              && (fdset_close_file(idx->fd, idx->vtmp_type, i) == FDSET_OK)
+              && (fdset_close_file(idx->fd, idx->vocab_type, i) == FDSET_OK)
 
               /* perform move */
               && (unlink(dstfile), 1)        /* don't care if this fails */
@@ -1814,11 +2379,58 @@ int index_commit(struct index *idx,
         idx->vtmp_type = idx->vocab_type;
         idx->vocab_type = len;
         altered = 1;
+
+        /* reload the vocab, which still refers to the files by their old
+         * names */
+        iobtree_root(idx->vocab, &root_fileno, &root_offset);
+        terms = iobtree_size(idx->vocab);
+        iobtree_delete(idx->vocab);
+        if (!(idx->vocab = iobtree_load_quick(idx->storage.pagesize, 
+            idx->storage.btleaf_strategy, idx->storage.btnode_strategy, 
+            NULL, idx->fd, idx->vocab_type, root_fileno, root_offset, 
+            terms))) {
+            assert(!CRASH);
+            return 0;
+        }
     }
    
+    /* the final merge of a new index can't lay out its vectors, so give long 
+     * vectors skip tables, separate word positions and block code them in a 
+     * pass over the merged index if asked to (which costs another read and 
+     * write of the vector file).  The remerge does this as it goes. */
+    if (ret && build && (idx->skip_vectors || idx->separate_positions 
+        || (idx->list_codec != INDEX_CODEC_VBYTE))) {
+        skip_ret = skip_build_index(idx);
+        altered = 1;
+        if (skip_ret != SKIP_OK) {
+            ERROR("rewriting vectors with skips, separate positions or "
+              "block coding");
+            return 0;
+        }
+    }
+
+    /* compute score bounds if requested now or previously (the remerge
+     * drops them, as they depend on the whole collection) */
+    if (ret && (opts & INDEX_COMMIT_BOUNDS)) {
+        idx->bounds.build = 1;
+        idx->bounds.k1 = opt->bound_k1;
+        idx->bounds.b = opt->bound_b;
+        idx->bounds.mu = opt->bound_mu;
+    }
+    if (ret && !segment && idx->bounds.build) {
+        bound_ret = bound_build_index(idx, idx->bounds.k1, idx->bounds.b, 
+          idx->bounds.mu);
+        altered = 1;
+        if (bound_ret != BOUND_OK) {
+            ERROR("computing score bounds");
+            return 0;
+        }
+    }
+
     /* add impact ordered vectors to index if requested */
     if (opts & INDEX_COMMIT_ANH_IMPACTS) {
-        impact_ret = impact_order_index(idx);
+        impact_ret = impact_order_index(idx, 
+          (opts & INDEX_COMMIT_THREADS) ? opt->threads : 1, idx->list_codec);
         altered = 1;
         if (impact_ret != IMPACT_OK) {
             ERROR("creating impact vectors");
@@ -15,7 +15,9 @@
 
 #include "def.h"
 #include "iobtree.h" 
+#include "postings.h" 
 #include "queryparse.h" 
+#include "segment.h"
 #include "str.h" 
 #include "stem.h" 
 #include "stop.h" 
@@ -25,47 +27,64 @@
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef MT_ZET
-#include <pthread.h>
-
-static pthread_mutex_t vocab_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-#endif /* MT_ZET */
-
 /* maximum length of an in-vocab vector. */
 #define MAX_VOCAB_VECTOR_LEN 4096
 
 /**
- *  Non-synchronized version of get_vocab_vector, i.e. we
- *  assume that, in a multi-threaded environment, the caller
- *  has already performed any necessary synchronisation.
+ *  Extract a vocab entry from a btree.
+ *
+ *  The btree is not changed by the lookup (vocab pages that aren't in 
+ *  memory are read into pagebuf, which must be a page long), so many
+ *  queries can be built from the same index at once.  At the end of this 
+ *  call, the vocab entry is completely independent from the btree.
+ *
+ *  @param vec_buf buffer to store vector if the vocab entry
+ *  has an in-vocab vector.  entry_out->loc.vocab.vec will be
+ *  made to point to this.  You need to copy this before
+ *  reusing the vector if you want to retain it.
+ *
+ *  @param f_dt_max the largest f_dt of the term, as recorded in its
+ *  bounds, is written here (0 if it has none)
+ *
+ *  @return 0 if the term does not exist in the vocab 
+ *  (entry_out will be unchanged); 1 if the term exists in
+ *  the vocab (entry_out will hold the vocab entry for the
+ *  term); < 0 on error.
  */
-static int get_vocab_vector_locked(struct iobtree * vocab, 
+static int get_vocab_vector(struct iobtree * vocab, 
   struct vocab_vector * entry_out, const char * term, unsigned int term_len,
-  char * vec_buf, int vec_buf_len, int impact) {
+  char * vec_buf, int vec_buf_len, int impact, void * pagebuf,
+  unsigned long int * f_dt_max) {
     void * ve_data = NULL;
     unsigned int veclen = 0;
-    struct vec v;
+    struct vec v,
+               bv;
+    struct vocab_vector bounds;
 
-    ve_data = iobtree_find(vocab, term, term_len, 0, &veclen);
+    *f_dt_max = 0;
+    ve_data = iobtree_find_r(vocab, term, term_len, pagebuf, &veclen);
     if (!ve_data)
         return 0;
     v.pos = ve_data;
     v.end = v.pos + veclen;
+    bv = v;
+    if (vocab_bounds(&bounds, &bv) == VOCAB_OK) {
+        *f_dt_max = bounds.header.bounds.max_fdt;
+    }
     if (!impact) {
         /* select first non-impact-ordered vector */
         do {
             if (vocab_decode(entry_out, &v) != VOCAB_OK) {
                 return -1; 
             }
-        } while (entry_out->type == VOCAB_VTYPE_IMPACT);
+        } while (VOCAB_IMPACT_ORDERED(entry_out->type));
     } else {
         /* select first impact-ordered vector */
         do {
             if (vocab_decode(entry_out, &v) != VOCAB_OK) {
                 return -1; 
             }
-        } while (entry_out->type != VOCAB_VTYPE_IMPACT);
+        } while (!VOCAB_IMPACT_ORDERED(entry_out->type));
     }
     if (entry_out->location == VOCAB_LOCATION_VOCAB) {
         assert(entry_out->size <= (unsigned int) vec_buf_len);
@@ -75,36 +94,120 @@ static int get_vocab_vector_locked(struct iobtree * vocab,
     return 1;
 }
 
+/* internal function to give a term that isn't in the vocab an empty in-vocab 
+ * vector (at vec_buf), which the search code appends its postings in 
+ * segments and memory to */
+static void empty_vector(struct vocab_vector *entry_out, char *vec_buf) {
+    entry_out->attr = VOCAB_ATTRIBUTES_NONE;
+    entry_out->attribute = 0;
+    entry_out->type = VOCAB_VTYPE_DOCWP;
+    entry_out->size = 0;
+    entry_out->header.docwp.docs = 0;
+    entry_out->header.docwp.occurs = 0;
+    entry_out->header.docwp.last = -1;
+    entry_out->location = VOCAB_LOCATION_VOCAB;
+    entry_out->loc.vocab.vec = vec_buf;
+}
+
 /**
- *  Extract a vocab entry from a btree.
- *
- *  This function is synchronised on the vocab_mutex mutex.
- *  At the end of this call, the vocab entry is completely
- *  independent form the btree.
+ *  Look up a term in the vocab (as get_vocab_vector does), in the segments
+ *  of the index and in the postings that have been added to the index since
+ *  it was last committed.
  *
- *  @param vec_buf buffer to store vector if the vocab entry
- *  has an in-vocab vector.  entry_out->loc.vocab.vec will be
- *  made to point to this.  You need to copy this before
- *  reusing the vector if you want to retain it.
+ *  The postings in segments and memory are included in the statistics of 
+ *  the vocab entry (the search code appends them to the vector as it's 
+ *  read).  Terms that aren't in the vocab are given an empty vector if the 
+ *  index has segments.  Otherwise terms that only occur in memory are given
+ *  an in-vocab vector pointing to their postings, which is valid until 
+ *  documents are next added to the index.  Segments and postings in memory 
+ *  aren't impact ordered, so they're ignored for impact ordered lookups.
+ *  The bounds in the vocab don't cover postings in segments or memory, so
+ *  f_dt_max is unknown (0) if there are any.
  *
- *  @return 0 if the term does not exist in the vocab 
- *  (entry_out will be unchanged); 1 if the term exists in
- *  the vocab (entry_out will hold the vocab entry for the
- *  term); < 0 on error.
+ *  @return as for get_vocab_vector
  */
-static int get_vocab_vector(struct iobtree * vocab, 
+static int get_vector(struct index *idx, 
   struct vocab_vector * entry_out, const char * term, unsigned int term_len,
-  char * vec_buf, int vec_buf_len, int impact) {
-    int retval = 0;
-#ifdef MT_ZET
-    pthread_mutex_lock(&vocab_mutex);
-#endif /* MT_ZET */
-    retval = get_vocab_vector_locked(vocab, entry_out, term, term_len,
-      vec_buf, vec_buf_len, impact);
-#ifdef MT_ZET
-    pthread_mutex_unlock(&vocab_mutex);
-#endif /* MT_ZET */
-    return retval;
+  char * vec_buf, int vec_buf_len, int impact, void * pagebuf,
+  unsigned long int * f_dt_max) {
+    char buf[TERMLEN_MAX + 1];
+    const void *live;
+    struct vocab_vector vv;
+    unsigned int i,
+                 segs,
+                 type,
+                 len,
+                 docs,
+                 occurs;
+    unsigned long int last;
+    int retval,
+        found;
+
+    retval = get_vocab_vector(idx->vocab, entry_out, term, term_len, 
+        vec_buf, vec_buf_len, impact, pagebuf, f_dt_max);
+    if ((retval < 0) || impact || !(idx->flags & INDEX_BUILT)) {
+        return retval;
+    }
+
+    /* the vocab entry has been copied out of pagebuf, so it can be reused */
+    segs = idx->segs ? segments_len(idx->segs) : 0;
+    for (i = 0; i < segs; i++) {
+        if ((found = segments_find(idx->segs, i, term, term_len, pagebuf, 
+            &vv, &type)) < 0) {
+            return found;
+        } else if (found) {
+            if (!retval) {
+                empty_vector(entry_out, vec_buf);
+                retval = 1;
+            }
+            entry_out->header.docwp.docs += vv.header.docwp.docs;
+            entry_out->header.docwp.occurs += vv.header.docwp.occurs;
+            *f_dt_max = 0;
+        }
+    }
+
+    if (!idx->post || !postings_documents(idx->post)) {
+        return retval;
+    }
+
+    assert(term_len <= TERMLEN_MAX);
+    memcpy(buf, term, term_len);
+    buf[term_len] = '\0';
+    if (!postings_find(idx->post, buf, &live, &len, &docs, &occurs, &last)) {
+        return retval;
+    }
+    *f_dt_max = 0;
+
+    if (retval || segs) {
+        if (!retval) {
+            empty_vector(entry_out, vec_buf);
+        }
+        assert(!entry_out->size || (last > entry_out->header.docwp.last));
+        entry_out->header.docwp.docs += docs;
+        entry_out->header.docwp.occurs += occurs;
+    } else {
+        entry_out->attr = VOCAB_ATTRIBUTES_NONE;
+        entry_out->attribute = 0;
+        entry_out->type = VOCAB_VTYPE_DOCWP;
+        entry_out->size = len;
+        entry_out->header.docwp.docs = docs;
+        entry_out->header.docwp.occurs = occurs;
+        entry_out->header.docwp.last = last;
+        entry_out->location = VOCAB_LOCATION_VOCAB;
+        entry_out->loc.vocab.vec = (void *) live;
+    }
+    return 1;
+}
+
+/* internal function to copy the size bytes of an in-vocab vector into newly 
+ * allocated memory (vectors of terms that are only in segments are empty) */
+static void *vecdup(const void *vec, unsigned int size) {
+    void *mem;
+
+    if ((mem = malloc(size ? size : 1))) {
+        memcpy(mem, vec, size);
+    }
+    return mem;
 }
 
 /* internal function to append a new word to a conjunct */
@@ -131,9 +234,9 @@ static int conjunct_append(struct query *query,
 
         /* allocate memory for vector part of vector */
         if (currterm->vocab.location == VOCAB_LOCATION_VOCAB) {
-            if ((currterm->vecmem = malloc(currterm->vocab.size))) {
-                memcpy(currterm->vecmem, 
-                  currterm->vocab.loc.vocab.vec, currterm->vocab.size);
+            if ((currterm->vecmem = vecdup(currterm->vocab.loc.vocab.vec, 
+                currterm->vocab.size))) {
+                /* do nothing */
             } else {
                 free(currterm->term);
                 return 0;
@@ -174,7 +277,7 @@ static struct conjunct *conjunct_find(struct query *query,
 
 /* internal function to copy a word into a new conjunct */
 static struct conjunct *conjunct_add(struct query *query, 
-  struct vocab_vector * sve, const char *term, 
+  struct vocab_vector * sve, unsigned long int f_dt_max, const char *term, 
   unsigned int termlen, int type, unsigned int *maxterms) {
     struct conjunct *ret = NULL;
 
@@ -195,6 +298,7 @@ static struct conjunct *conjunct_add(struct query *query,
             ret->terms = 1;
             ret->sloppiness = 0;
             ret->cutoff = 0;
+            ret->f_dt_max = f_dt_max;
             query->terms++;
             if (!(ret->term.term = str_ndup(term, termlen))) {
                 query->terms--;
@@ -203,8 +307,9 @@ static struct conjunct *conjunct_add(struct query *query,
             memcpy(&ret->term.vocab, sve, sizeof(*sve));
             /* allocate memory for vector part of vector */
             if (ret->term.vocab.location == VOCAB_LOCATION_VOCAB) {
-                if ((ret->term.vecmem = malloc(sve->size))) {
-                    memcpy(ret->term.vecmem, sve->loc.vocab.vec, sve->size);
+                if ((ret->term.vecmem 
+                  = vecdup(sve->loc.vocab.vec, sve->size))) {
+                    /* do nothing */
                 } else {
                     free(ret->term.term);
                     return 0;
@@ -244,9 +349,9 @@ static struct conjunct *conjunct_copy(struct query *query,
 
         /* allocate memory for vector part of vector */
         if (next->term.vocab.location == VOCAB_LOCATION_VOCAB) {
-            if ((next->term.vecmem = malloc(conj->term.vocab.size))) {
-                memcpy(next->term.vecmem, conj->term.vecmem, 
-                  conj->term.vocab.size);
+            if ((next->term.vecmem 
+              = vecdup(conj->term.vecmem, conj->term.vocab.size))) {
+                /* do nothing */
             } else {
                 free(next->term.term);
                 return NULL;
@@ -257,6 +362,7 @@ static struct conjunct *conjunct_copy(struct query *query,
         next->terms = 1;
         next->f_qt = 1;
         next->type = conj->type;
+        next->f_dt_max = conj->f_dt_max;
         matches--;
 
         nextterm = &next->term;
@@ -274,9 +380,9 @@ static struct conjunct *conjunct_copy(struct query *query,
 
             /* allocate memory for vector part of vector */
             if (nextterm->vocab.location == VOCAB_LOCATION_VOCAB) {
-                if ((nextterm->vecmem = malloc(currterm->vocab.size))) {
-                    memcpy(nextterm->vecmem, currterm->vecmem, 
-                      currterm->vocab.size);
+                if ((nextterm->vecmem 
+                  = vecdup(currterm->vecmem, currterm->vocab.size))) {
+                    /* do nothing */
                 } else {
                     free(nextterm->term);
                     return NULL;
@@ -298,9 +404,9 @@ static struct conjunct *conjunct_copy(struct query *query,
             memcpy(&currterm->vocab, sve, sizeof(*sve));
             /* allocate memory for vector part of vector */
             if (currterm->vocab.location == VOCAB_LOCATION_VOCAB) {
-                if ((currterm->vecmem = malloc(currterm->vocab.size))) {
-                    memcpy(currterm->vecmem, currterm->vocab.loc.vocab.vec,
-                      currterm->vocab.size);
+                if ((currterm->vecmem = vecdup(currterm->vocab.loc.vocab.vec,
+                    currterm->vocab.size))) {
+                    /* do nothing */
                 } else {
                     free(nextterm->term);
                     return NULL;
@@ -315,6 +421,48 @@ static struct conjunct *conjunct_copy(struct query *query,
     return ret;
 }
 
+/* internal function to start reading the vocabulary pages needed to look up
+ * each of the words in query string querystr (of length len), so that they're
+ * read at the same time instead of one after another as the words are looked
+ * up */
+static void prefetch_vocab(struct index *idx, const char *querystr, 
+  unsigned int len, unsigned int maxtermlen) {
+    struct queryparse *qp;
+    char word[TERMLEN_MAX + 1];
+    unsigned int wordlen;
+    enum queryparse_ret parse_ret;
+    void (*stem)(void *, char *) = index_stemmer(idx);
+
+    if (!(qp = queryparse_new(maxtermlen, querystr, len))) {
+        return;
+    }
+
+    while (((parse_ret = queryparse_parse(qp, word, &wordlen)) 
+        != QUERYPARSE_EOF) 
+      && (parse_ret != QUERYPARSE_ERR)) {
+        switch (parse_ret) {
+        case QUERYPARSE_WORD:
+        case QUERYPARSE_WORD_NOSTOP:
+            /* words are looked up stemmed (excluded words are looked up 
+             * unstemmed first) */
+            if (stem) {
+                word[wordlen] = '\0';
+                stem(idx->stem, word);
+                wordlen = str_len(word);
+            }
+            /* fallthrough */
+        case QUERYPARSE_WORD_EXCLUDE:
+            iobtree_prefetch_r(idx->vocab, word, wordlen);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    queryparse_delete(qp);
+}
+
 /* internal function to construct a query structure from a given string (query)
  * of length len.  At most maxterms will be read from the query. */ 
 unsigned int index_querybuild(struct index *idx, struct query *query, 
@@ -339,14 +487,20 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
     enum { MODIFIER_NONE, MODIFIER_SLOPPY, MODIFIER_CUTOFF } modifier 
       = MODIFIER_NONE;
     void (*stem)(void *, char *) = index_stemmer(idx);
+    void *pagebuf;                   /* buffer for vocab pages */
 
     assert(maxtermlen <= TERMLEN_MAX);
+    if (!(pagebuf = malloc(iobtree_pagesize(idx->vocab)))) {
+        return 0;
+    }
     if (!(qp 
       = queryparse_new(maxtermlen, querystr, len))) {
+        free(pagebuf);
         return 0;
     }
 
     query->terms = 0;
+    prefetch_vocab(idx, querystr, len, maxtermlen);
 
     /* This bit of code builds a structure that represents a query from an
      * array, where the array of words will be filled from 0 upwards, and
@@ -357,6 +511,7 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
         struct vocab_vector entry;
         int retval;
         char vec_buf[MAX_VOCAB_VECTOR_LEN];
+        unsigned long int f_dt_max;
         parse_ret = queryparse_parse(qp, word, &wordlen);
         switch (parse_ret) {
         case QUERYPARSE_WORD_EXCLUDE:
@@ -375,27 +530,29 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
                   &maxterms);
             } */
 
-            retval = get_vocab_vector(idx->vocab, &entry, word, wordlen,
-              vec_buf, sizeof(vec_buf), impacts);
+            retval = get_vector(idx, &entry, word, wordlen,
+              vec_buf, sizeof(vec_buf), impacts, pagebuf, &f_dt_max);
             if (retval < 0) {
+                free(pagebuf);
+                queryparse_delete(qp);
                 return 0;
             } 
             /* look up word in vocab */
-            /* FIXME: word needs to be looked up in in-memory postings as 
-             * well */
             if (retval == 0 && stem) {
                 word[wordlen] = '\0';
                 stem(idx->stem, word);
                 wordlen = str_len(word);
-                retval = get_vocab_vector(idx->vocab, &entry, word, wordlen,
-                    vec_buf, sizeof(vec_buf), impacts);
+                retval = get_vector(idx, &entry, word, wordlen,
+                    vec_buf, sizeof(vec_buf), impacts, pagebuf, &f_dt_max);
                 if (retval < 0) {
+                    free(pagebuf);
+                    queryparse_delete(qp);
                     return 0;
                 } 
             }
             if (retval > 0) {
-              current = conjunct_add(query, &entry, word, wordlen,
-                      CONJUNCT_TYPE_EXCLUDE, &maxterms);
+              current = conjunct_add(query, &entry, f_dt_max, word, 
+                      wordlen, CONJUNCT_TYPE_EXCLUDE, &maxterms);
 
               current = NULL;   /* this can't be the start of a conjunction */
               words++;
@@ -424,16 +581,16 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
                 break;
             }
             /* look up word in vocab */
-            /* FIXME: word needs to be looked up in in-memory postings as 
-             * well */
             if (stem) {
                 word[wordlen] = '\0';
                 stem(idx->stem, word);
                 wordlen = str_len(word);
             }
-            retval = get_vocab_vector(idx->vocab, &entry, word, wordlen,
-              vec_buf, sizeof(vec_buf), impacts);
+            retval = get_vector(idx, &entry, word, wordlen,
+              vec_buf, sizeof(vec_buf), impacts, pagebuf, &f_dt_max);
             if (retval < 0) {
+                free(pagebuf);
+                queryparse_delete(qp);
                 return 0;
             } else if (retval == 0) {
                 stopped = 0;   /* so we know that this term wasn't stopped */
@@ -465,7 +622,7 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
                 /* processing a phrase */
                 if (!currmatch) {
                     /* first word in phrase, match or add a conjunction */
-                    current = conjunct_add(query, &entry,
+                    current = conjunct_add(query, &entry, f_dt_max,
                       /* ve, veclen,  */
                       word, wordlen, 
                       CONJUNCT_TYPE_PHRASE, &maxterms);
@@ -525,8 +682,8 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
                 } else if (stopped) { 
                     /* first word(s) in conjunct was stopped, so start a new
                      * one */
-                    current = conjunct_add(query, &entry, word, wordlen,
-                      CONJUNCT_TYPE_WORD, &maxterms);
+                    current = conjunct_add(query, &entry, f_dt_max, word, 
+                      wordlen, CONJUNCT_TYPE_WORD, &maxterms);
                 }
 
                 state = CONJUNCT_TYPE_WORD;   /* stop AND condition */
@@ -544,7 +701,7 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
                 }
 
                 if (!stopped) {
-                    current = conjunct_add(query, &entry,
+                    current = conjunct_add(query, &entry, f_dt_max,
                       /* ve, veclen, */
                       word, wordlen,
                       CONJUNCT_TYPE_WORD, &maxterms);
@@ -626,12 +783,14 @@ unsigned int index_querybuild(struct index *idx, struct query *query,
 
         default:
             /* unexpected return code, error */
+            free(pagebuf);
             queryparse_delete(qp);
             return 0;
         }
     } while ((parse_ret != QUERYPARSE_EOF)
       && (query->terms < maxterms));  /* FIXME: temporary stopping condition */
 
+    free(pagebuf);
     queryparse_delete(qp);
     /* returning word count confuses errors with empty queries. */
     /* return words; */
@@ -168,6 +168,8 @@ static struct page *read_page(struct iobtree *btree, unsigned int fileno,
         ret;
     off_t prev;
     struct page *page = givenpage;
+    const char *addr;
+    unsigned long int len;
 
     if (!page) {
         if ((page = new_page(btree->pagesize, NULL))) {
@@ -181,7 +183,13 @@ static struct page *read_page(struct iobtree *btree, unsigned int fileno,
     }
 
     assert(!page->h.dirty);
-    if ((fd = fdset_pin(btree->fd, btree->fdset, fileno, 0, SEEK_CUR)) >= 0) {
+    if ((fdset_map(btree->fd, btree->fdset, fileno, &addr, &len) == FDSET_OK)
+      && (offset + btree->pagesize <= len)) {
+        /* copy the page out of the memory-mapped file */
+        memcpy(page->mem, addr + offset, btree->pagesize);
+        ret = FDSET_OK;
+    } else if ((fd = fdset_pin(btree->fd, btree->fdset, fileno, 0, SEEK_CUR)) 
+      >= 0) {
 
         /* XXX: hack to restore fd to previous location after paging in, so 
          * that other algorithms don't have to worry about the btree seeking 
@@ -192,45 +200,49 @@ static struct page *read_page(struct iobtree *btree, unsigned int fileno,
 
           && (read(fd, page->mem, btree->pagesize) == (ssize_t) btree->pagesize)
           && (lseek(fd, prev, SEEK_SET) == prev)) {
-            if ((ret = fdset_unpin(btree->fd, btree->fdset, fileno, fd)) 
-              == FDSET_OK) {
-                page->h.fileno = fileno;
-                page->h.offset = offset;
-                page->h.dirty = 0;
-                page->h.parent = parent;
+            ret = fdset_unpin(btree->fd, btree->fdset, fileno, fd);
+        } else {
+            ret = errno ? -errno : -EIO;
+            fdset_unpin(btree->fd, btree->fdset, fileno, fd);
+        }
+    } else {
+        ret = fd;
+    }
 
-                if (!BTBUCKET_LEAF(page->mem, btree->pagesize)) {
-                    unsigned int entries;
+    if (ret == FDSET_OK) {
+        page->h.fileno = fileno;
+        page->h.offset = offset;
+        page->h.dirty = 0;
+        page->h.parent = parent;
 
-                    entries = bucket_entries(BTBUCKET_BUCKET(page->mem), 
-                        btree->pagesize, btree->leaf_strategy);
+        if (!BTBUCKET_LEAF(page->mem, btree->pagesize)) {
+            unsigned int entries;
 
-                    if (page->h.dirsize < entries) {
-                        void *ptr;
+            entries = bucket_entries(BTBUCKET_BUCKET(page->mem), 
+                btree->pagesize, btree->leaf_strategy);
 
-                        if ((ptr = realloc(page->h.directory, 
-                              sizeof(*page->h.directory) * entries))) {
-                            page->h.directory = ptr;
-                            page->h.dirsize = entries;
-                        } else {
-                            if (!givenpage) {
-                                free(page);
-                            }
-                            *err = IOBTREE_ENOMEM;
-                            return NULL;
-                        }
-                    }
+            if (page->h.dirsize < entries) {
+                void *ptr;
 
-                    BIT_ARRAY_NULL(page->h.directory, page->h.dirsize);
+                if ((ptr = realloc(page->h.directory, 
+                      sizeof(*page->h.directory) * entries))) {
+                    page->h.directory = ptr;
+                    page->h.dirsize = entries;
+                } else {
+                    if (!givenpage) {
+                        free(page);
+                    }
+                    *err = IOBTREE_ENOMEM;
+                    return NULL;
                 }
-
-                return page;
-            } else {
-                errno = -ret;
             }
+
+            BIT_ARRAY_NULL(page->h.directory, page->h.dirsize);
         }
+
+        return page;
     } else {
-        errno = -fd;
+        errno = -ret;
     }
 
     if (err) {
@@ -1938,6 +1950,96 @@ void *iobtree_find(struct iobtree *btree, const char *term,
         termlen, veclen, &index);
 }
 
+void *iobtree_find_r(struct iobtree *btree, const char *term, 
+  unsigned int termlen, void *pagebuf, unsigned int *veclen) {
+    struct page *curr = btree->root;
+    char *mem = curr->mem;
+    unsigned int index,
+                 fileno;
+    unsigned long int offset,
+                      maplen;
+    const char *map;
+    void *addr;
+    int fd;
+
+    /* traverse down the internal nodes, reading pages that aren't in memory
+     * into pagebuf (or using them from the memory-mapped file) rather than
+     * caching them, so that nothing in the btree changes */
+    while (!BTBUCKET_LEAF(mem, btree->pagesize)) {
+        if (!(addr = bucket_search(BTBUCKET_BUCKET(mem),
+            BTBUCKET_SIZE(mem, btree->pagesize),
+            btree->node_strategy, term, termlen, veclen, &index))) {
+            assert(!CRASH);
+            return NULL;
+        }
+
+        if (curr && curr->h.directory[index] 
+          && (curr->h.directory[index] != LEAF_PTR(btree))) {
+            /* internal node in memory below */
+            curr = curr->h.directory[index];
+            mem = curr->mem;
+            continue;
+        }
+
+        BTBUCKET_ENTRY(addr, &fileno, &offset);
+        if ((fdset_map(btree->fd, btree->fdset, fileno, &map, &maplen) 
+            == FDSET_OK)
+          && (offset + btree->pagesize <= maplen)) {
+            /* search the page where it is in the memory-mapped file */
+            mem = (char *) map + offset;
+        } else {
+            if ((fd = fdset_pin(btree->fd, btree->fdset, fileno, offset, 
+                SEEK_SET)) < 0) {
+                return NULL;
+            }
+            if (read(fd, pagebuf, btree->pagesize) 
+              != (ssize_t) btree->pagesize) {
+                fdset_unpin(btree->fd, btree->fdset, fileno, fd);
+                return NULL;
+            }
+            fdset_unpin(btree->fd, btree->fdset, fileno, fd);
+            mem = pagebuf;
+        }
+
+        /* nothing below a page read this way is in memory */
+        curr = NULL;
+    }
+
+    return bucket_find(BTBUCKET_BUCKET(mem), 
+        BTBUCKET_SIZE(mem, btree->pagesize), btree->leaf_strategy, term, 
+        termlen, veclen, &index);
+}
+
+void iobtree_prefetch_r(struct iobtree *btree, const char *term, 
+  unsigned int termlen) {
+    struct page *curr = btree->root;
+    unsigned int index,
+                 fileno,
+                 veclen;
+    unsigned long int offset;
+    void *addr;
+
+    /* traverse down the internal nodes in memory, as iobtree_find_r does, 
+     * until we get to a page that has to be read */
+    while (!BTBUCKET_LEAF(curr->mem, btree->pagesize)) {
+        if (!(addr = bucket_search(BTBUCKET_BUCKET(curr->mem),
+            BTBUCKET_SIZE(curr->mem, btree->pagesize),
+            btree->node_strategy, term, termlen, &veclen, &index))) {
+            return;
+        }
+
+        if (curr->h.directory[index] 
+          && (curr->h.directory[index] != LEAF_PTR(btree))) {
+            curr = curr->h.directory[index];
+        } else {
+            BTBUCKET_ENTRY(addr, &fileno, &offset);
+            fdset_willneed(btree->fd, btree->fdset, fileno, offset, 
+              btree->pagesize);
+            return;
+        }
+    }
+}
+
 void *iobtree_append(struct iobtree *btree, const char *term,
   unsigned int termlen, unsigned int size, int *toobig) {
     struct page *parent;
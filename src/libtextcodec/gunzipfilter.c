@@ -81,6 +81,9 @@ struct gunzipfilter {
     unsigned char flags;             /* remaining flags from gzip header 
                                       * (bitfield composed of items from 
                                       * enum gunzipfilter_flags) */
+    int verify;                      /* whether to check the trailer (which
+                                      * can't be done if decompression started
+                                      * part way through the file) */
     char buf[1];                     /* allocated buffer (not 
                                       * necessarily of length one, via struct 
                                       * hack) */
@@ -489,6 +492,10 @@ end_flush_label:
     }
 
 end_check_label:
+    if (!state->verify) {
+        goto end_label;
+    }
+
     /* stream has ended, prebuf should now contain:
      *   0   1   2   3   4   5   6   7
      * +---+---+---+---+---+---+---+---+
@@ -579,6 +586,7 @@ struct gunzipfilter *gunzipfilter_new(unsigned int bufsize) {
     if ((state = malloc(sizeof(*state) + bufsize)) 
       && (state->crc = crc_new())) {
         state->state = STATE_START;
+        state->verify = 1;
         state->bufsize = bufsize + !bufsize;
         state->filter.filter = gunzipfilter_filter;
         state->filter.idfn = gunzipfilter_id;
@@ -610,3 +618,61 @@ struct gunzipfilter *gunzipfilter_new(unsigned int bufsize) {
     return state;
 }
 
+struct gunzipfilter *gunzipfilter_new_at(unsigned int bufsize, 
+  unsigned int bits, unsigned int prime, const void *window, 
+  unsigned int windowlen) {
+    struct gunzipfilter *state;
+    unsigned char header[6];
+    unsigned long int dictid = adler32(adler32(0, Z_NULL, 0), window, 
+        windowlen);
+
+    /* provide a fake header that asks for a preset dictionary with the
+     * window's checksum, so that zlib accepts the window as the dictionary.
+     * (Raw deflate would accept it too, but would report the end of the
+     * stream instead of waiting for the checksum we withhold, which the
+     * decompression states above aren't prepared for.) */
+    header[0] = 0x78;
+    header[1] = 0x20;
+    header[2] = (dictid >> 24) & 0xff;
+    header[3] = (dictid >> 16) & 0xff;
+    header[4] = (dictid >> 8) & 0xff;
+    header[5] = dictid & 0xff;
+
+    if ((state = malloc(sizeof(*state) + bufsize)) 
+      && (state->crc = crc_new())) {
+        state->state = STATE_DECOMPRESS;
+        state->len = 0;
+        state->verify = 0;
+        state->bufsize = bufsize + !bufsize;
+        state->filter.filter = gunzipfilter_filter;
+        state->filter.idfn = gunzipfilter_id;
+        state->filter.deletefn = gunzipfilter_delete;
+        state->zstate.zalloc = Z_NULL;
+        state->zstate.zfree = Z_NULL;
+        state->zstate.opaque = NULL;
+        state->zstate.next_out = ((unsigned char *) state) + sizeof(*state);
+        state->zstate.avail_out = bufsize;
+        state->zstate.next_in = header;
+        state->zstate.avail_in = sizeof(header);
+        if (inflateInit(&state->zstate) != Z_OK) {
+            crc_delete(state->crc);
+            free(state);
+            return NULL;
+        } else if ((inflate(&state->zstate, Z_NO_FLUSH) != Z_NEED_DICT)
+          || state->zstate.avail_in
+          || (inflateSetDictionary(&state->zstate, window, windowlen) 
+            != Z_OK)
+          || (bits && (inflatePrime(&state->zstate, bits, prime) != Z_OK))) {
+            inflateEnd(&state->zstate);
+            crc_delete(state->crc);
+            free(state);
+            return NULL;
+        }
+    } else if (state) {
+        free(state);
+        state = NULL;
+    }
+
+    return state;
+}
+
@@ -46,6 +46,9 @@ struct makeindex_state {
     char *term;                           /* current term */
     char *endtag;                         /* endtag we're looking for in 
                                            * OFFEND mode */
+    unsigned int field;                   /* field that words are going into */
+    char *fieldend;                       /* end tag of the current field, or 
+                                           * empty if in field 0 */
     char *docno;                          /* current document number */
     unsigned int docno_size;              /* size of docno field */
     unsigned int docno_pos;               /* position in docno field */
@@ -68,6 +71,7 @@ enum makeindex_ret makeindex_new(struct makeindex *mi,
     if (settings && (mi->state = malloc(sizeof(*mi->state))) 
       && (mi->state->term = malloc(termlen + 1))
       && (mi->state->endtag = malloc(termlen + 1))
+      && (mi->state->fieldend = malloc(termlen + 1))
       && (mi->state->docno = malloc(termlen + 1))
       && mlparse_new(&mi->state->mlparser, termlen, LOOKAHEAD)) {
         mi->state->settings = settings;
@@ -83,8 +87,11 @@ enum makeindex_ret makeindex_new(struct makeindex *mi,
         if (mi->state) {
             if (mi->state->term) {
                 if (mi->state->endtag) {
-                    if (mi->state->docno) {
-                        free(mi->state->docno);
+                    if (mi->state->fieldend) {
+                        if (mi->state->docno) {
+                            free(mi->state->docno);
+                        }
+                        free(mi->state->fieldend);
                     }
                     free(mi->state->endtag);
                 }
@@ -114,6 +121,8 @@ enum makeindex_ret makeindex_renew(struct makeindex *mi, enum mime_types type) {
     mi->state->type = type;
     mi->state->state = STATE_START;
     mi->state->termno = 0;
+    mi->state->field = 0;
+    mi->state->fieldend[0] = '\0';
     mi->state->eof = 0;
     mi->state->stack = 0;
     mi->state->docno_pos = 0;
@@ -125,6 +134,7 @@ void makeindex_delete(struct makeindex *mi) {
     mlparse_delete(&mi->state->mlparser);
     free(mi->state->term);
     free(mi->state->endtag);
+    free(mi->state->fieldend);
     free(mi->state->docno);
     free(mi->state);
     mi->state = NULL;
@@ -318,7 +328,21 @@ assert(val != MAKEINDEX_ERR);\
         mi->state->term[termlen] = '\0';                                      \
         attr = psettings_type_find(mi->state->settings, mi->state->ptype,     \
             mi->state->term);                                                 \
+        if (mi->state->fieldend[0]                                            \
+          && !str_cmp(mi->state->fieldend, mi->state->term)) {                \
+            /* end of the current field, back to field 0 */                   \
+            mi->state->field = 0;                                             \
+            mi->state->fieldend[0] = '\0';                                    \
+        }                                                                     \
         if (attr & PSETTINGS_ATTR_INDEX || attr & PSETTINGS_ATTR_TITLE) {     \
+            if (PSETTINGS_FIELD(attr)) {                                      \
+                /* words go into the field until its end tag */               \
+                mi->state->field = PSETTINGS_FIELD(attr);                     \
+                mi->state->fieldend[0] = '/';                                 \
+                mi->state->fieldend[1] = '\0';                                \
+                str_lcat(mi->state->fieldend, mi->state->term,                \
+                  mi->state->maxtermlen);                                     \
+            }                                                                 \
             /* continue in on state */                                        \
             mi->state->stack <<= 1;                                           \
             mi->state->stack |= !currstate;                                   \
@@ -330,6 +354,8 @@ assert(val != MAKEINDEX_ERR);\
             goto off_label;                                                   \
         } else if (attr & PSETTINGS_ATTR_DOCEND) {                            \
             mi->state->stack = 0;                                             \
+            mi->state->field = 0;                                             \
+            mi->state->fieldend[0] = '\0';                                    \
             if (postings_update(mi->post, &mi->stats)) {                      \
                 RETURN(MAKEINDEX_ENDDOC, STATE_ENDDOC);                       \
             } else {                                                          \
@@ -434,8 +460,10 @@ enum makeindex_ret makeindex(struct makeindex *mi) {
 /* start state is just the on state, except that we haven't gotten anything in
  * this document yet, and so we to call postings_adddoc if we get anything */
 start_label:
-    /* reset termno, as we're about to start a new document */
+    /* reset termno and field, as we're about to start a new document */
     mi->state->termno = 0;
+    mi->state->field = 0;
+    mi->state->fieldend[0] = '\0';
     mi->state->doctype = mi->state->type;
     while (1) {
         ret = mlparse_parse(&mi->state->mlparser, mi->state->term, &termlen, 1);
@@ -444,7 +472,8 @@ start_label:
             /* indicate to the postings that the document has started */
             postings_adddoc(mi->post, mi->docs++);
             // AYXX: add a test term..
-            if (postings_addword(mi->post, "TESTING123", mi->state->termno++)) {
+            if (postings_addword(mi->post, "TESTING123", 0, 
+              mi->state->termno++)) {
             } 
             /* complete hack, transfer to on state and complete processing */
             goto on_middle;
@@ -473,7 +502,7 @@ on_middle:
             assert(termlen <= mi->state->maxtermlen);
             mi->state->term[termlen] = '\0';
             //fprintf(stderr, "AYXX: posting term: '%s'\n", mi->state->term);
-            if (postings_addword(mi->post, mi->state->term, 
+            if (postings_addword(mi->post, mi->state->term, mi->state->field,
               mi->state->termno++)) {
                 if (ret & MLPARSE_END) {
                     /* increment termno so phrases don't match */
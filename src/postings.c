@@ -58,8 +58,18 @@
 /* initial size of memory pools created */
 #define MEMPOOL_SIZE 1000000
 
+unsigned int postings_field_bits(unsigned int fields) {
+    unsigned int bits = 0;
+
+    while ((1U << bits) < fields) {
+        bits++;
+    }
+    return bits;
+}
+
 struct postings* postings_new(unsigned int tablesize, 
-  void (*stem)(void *opaque, char *term), void *opaque, struct stop *list) {
+  void (*stem)(void *opaque, char *term), void *opaque, struct stop *list,
+  unsigned int fields) {
     struct postings *p = malloc(sizeof(*p));
     unsigned int bits = bit_log2(tablesize);
 
@@ -71,6 +81,10 @@ struct postings* postings_new(unsigned int tablesize,
       && (p->node_mem = objalloc_new(sizeof(struct postings_node), 0, 
           !!DEAR_DEBUG, MEMPOOL_SIZE, NULL))) {
         p->stop = list;
+        assert(fields && fields <= INDEX_FIELDS);
+        p->fields = fields;
+        p->field_bits = postings_field_bits(fields);
+        memset(p->field_terms, 0, sizeof(p->field_terms));
         p->stem = stem; 
         p->stem_opaque = opaque;
         p->tblbits = bits;
@@ -222,6 +236,8 @@ int postings_update(struct postings* post, struct postings_docstats* stats) {
     stats->weight = (float) sqrtf(weight);
     stats->terms = terms;
     stats->distinct = dterms;
+    memcpy(stats->fields, post->field_terms, sizeof(stats->fields));
+    memset(post->field_terms, 0, sizeof(post->field_terms));
     return 1;
 }
 
@@ -235,7 +251,7 @@ void postings_adddoc(struct postings* post, unsigned long int docno) {
     post->update_required = 1;
 }
 
-int postings_addword(struct postings *post, char *term, 
+int postings_addword(struct postings *post, char *term, unsigned int field,
   unsigned long int wordno) {
     unsigned int hash,
                  len,
@@ -332,6 +348,12 @@ int postings_addword(struct postings *post, char *term,
         }
     }
 
+    /* tag the word position with its field */
+    if (field >= post->fields) {
+        field = 0;
+    }
+    wordno = (wordno << post->field_bits) | field;
+
     /* encode new offset */
     assert((wordno > node->last_offset) || (node->last_offset == -1));
     while (!(bytes 
@@ -345,6 +367,7 @@ int postings_addword(struct postings *post, char *term,
     node->last_offset = wordno;
     node->offsets++;
     post->terms++;
+    post->field_terms[field]++;
     return 1;
 }
 
@@ -407,15 +430,41 @@ int postings_remove_offsets(struct postings *post) {
     return 1;
 }
 
+/* internal function to find the first document number in the vector of
+ * node once base is added to it, returning it in *first, and the number of
+ * bytes it currently occupies in *skip.  Returns the length of the vector with
+ * the first document number rewritten (document numbers after it are gaps, so
+ * nothing else changes). */
+static unsigned int rebase(struct postings_node *node, unsigned long int base,
+  unsigned long int *first, unsigned int *skip) {
+    struct vec v;
+
+    v.pos = node->vecmem;
+    v.end = node->vec.pos;
+    *skip = vec_vbyte_read(&v, first);
+    assert(*skip);
+    *first += base;
+    return (node->vec.pos - node->vecmem) - *skip + vec_vbyte_len(*first);
+}
+
 int postings_dump(struct postings* post, void *buf, unsigned int bufsize, 
   int fd) {
+    return postings_dump_rebase(post, buf, bufsize, fd, 0);
+}
+
+int postings_dump_rebase(struct postings* post, void *buf, 
+  unsigned int bufsize, int fd, unsigned long int base) {
     unsigned int i,
                  j,
                  stopped = 0,
                  pos,                     /* position in current vector */
                  len,                     /* length of current term */
+                 veclen,                  /* length of current vector */
+                 skip,                    /* length of first docno in 
+                                           * current vector */
                  wlen,                    /* length of last write */
                  dbufsz;                  /* size of dbuf */
+    unsigned long int first;              /* first docno in current vector */
     struct postings_node* node,           /* current node */
                         ** arr;           /* array of postings nodes */
     char *dbuf,                           /* dumping buffer */
@@ -474,18 +523,19 @@ int postings_dump(struct postings* post, void *buf, unsigned int bufsize,
     for (i = 0; i < j;) {
         while ((i < post->dterms) 
           && ((len = str_len(arr[i]->term)), 1)
+          && ((veclen = rebase(arr[i], base, &first, &skip)), 1)
           && (((unsigned int) VEC_LEN(&v)) >= vec_vbyte_len(len) + len 
             + vec_vbyte_len(arr[i]->docs) + vec_vbyte_len(arr[i]->occurs) 
-            + vec_vbyte_len(arr[i]->last_docno) 
-            + vec_vbyte_len(arr[i]->vec.pos - arr[i]->vecmem))) {
+            + vec_vbyte_len(arr[i]->last_docno + base) 
+            + vec_vbyte_len(veclen) + vec_vbyte_len(first))) {
 
             unsigned int bytes;
 
             assert(len);
             assert(dbufsz > vec_vbyte_len(len) + len 
               + vec_vbyte_len(arr[i]->docs) + vec_vbyte_len(arr[i]->occurs) 
-              + vec_vbyte_len(arr[i]->last_docno)
-              + vec_vbyte_len(arr[i]->vec.pos - arr[i]->vecmem));
+              + vec_vbyte_len(arr[i]->last_docno + base)
+              + vec_vbyte_len(veclen) + vec_vbyte_len(first));
 
             /* have enough space, copy stuff into buffer */
             bytes = vec_vbyte_write(&v, len);
@@ -496,13 +546,15 @@ int postings_dump(struct postings* post, void *buf, unsigned int bufsize,
             assert(bytes);
             bytes = vec_vbyte_write(&v, arr[i]->occurs);
             assert(bytes);
-            bytes = vec_vbyte_write(&v, arr[i]->last_docno);
+            bytes = vec_vbyte_write(&v, arr[i]->last_docno + base);
             assert(bytes);
-            bytes = vec_vbyte_write(&v, arr[i]->vec.pos - arr[i]->vecmem);
+            bytes = vec_vbyte_write(&v, veclen);
+            assert(bytes);
+            bytes = vec_vbyte_write(&v, first);
             assert(bytes);
 
-            /* copy the inverted list in */
-            pos = 0;
+            /* copy the rest of the inverted list in */
+            pos = skip;
             while (((unsigned int) VEC_LEN(&v)) 
               < (arr[i]->vec.pos - arr[i]->vecmem) - pos) {
 
@@ -560,6 +612,7 @@ int postings_dump(struct postings* post, void *buf, unsigned int bufsize,
     post->dterms = 0;
     post->terms = 0;
     post->docs = 0;
+    post->docno = 0;
     poolalloc_clear(post->string_mem);
     objalloc_clear(post->node_mem);
  
@@ -592,6 +645,7 @@ void postings_clear(struct postings* post) {
     post->dterms = 0;
     post->terms = 0;
     post->docs = 0;
+    post->docno = 0;
     poolalloc_clear(post->string_mem);
     objalloc_clear(post->node_mem);
     
@@ -635,9 +689,41 @@ struct vec *postings_vector(struct postings *post, char *term) {
             if (!str_cmp(term, node->term)) {
                 return &node->vec;
             }
+            node = node->next;
         }
     }
 
     return NULL;
 }
 
+int postings_find(struct postings *post, const char *term, const void **vec,
+  unsigned int *len, unsigned int *docs, unsigned int *occurs, 
+  unsigned long int *last) {
+    unsigned int hash;
+    struct postings_node *node;
+
+    assert(!post->update);
+    if (!post->stop || (stop_stop(post->stop, term) == STOP_OK)) {
+        hash = str_hash(term) & bit_lmask(post->tblbits);
+        node = post->hash[hash];
+        while (node) {
+            if (!str_cmp(term, node->term)) {
+                /* note that we don't move the node to the front of the hash
+                 * chain, so that lookups don't modify the postings */
+                if (node->docs) {
+                    *vec = node->vecmem;
+                    *len = node->vec.pos - node->vecmem;
+                    *docs = node->docs;
+                    *occurs = node->occurs;
+                    *last = node->last_docno;
+                    return 1;
+                }
+                return 0;
+            }
+            node = node->next;
+        }
+    }
+
+    return 0;
+}
+
@@ -12,6 +12,7 @@
 
 #include "chash.h"
 #include "error.h"
+#include "index.h"
 #include "str.h"
 #include "mlparse_wrap.h"
 
@@ -38,6 +39,7 @@ struct psettings {
     unsigned int types;              /* size of type array */
     enum psettings_attr def;         /* default settings for unrecognised 
                                       * tags */
+    unsigned int fields;             /* one more than largest field number */
 };
 
 struct psettings *psettings_new(enum psettings_attr def) {
@@ -51,6 +53,7 @@ struct psettings *psettings_new(enum psettings_attr def) {
         pset->type = NULL;
         pset->types = 0;
         pset->def = def;
+        pset->fields = 1;
     } else if (pset) {
         if (pset->strings) {
             chash_delete(pset->strings);
@@ -167,6 +170,10 @@ enum psettings_ret psettings_set(struct psettings *pset, enum mime_types type,
         pset->type[type].flags |= TYPE_FLAG_SELF_ID;
     }
 
+    if (PSETTINGS_FIELD(attr) >= pset->fields) {
+        pset->fields = PSETTINGS_FIELD(attr) + 1;
+    }
+
     return PSETTINGS_OK;
 }
 
@@ -198,12 +205,12 @@ enum psettings_attr psettings_find(struct psettings *pset,
 
 enum psettings_attr psettings_type_find(struct psettings *pset, 
   struct psettings_type *type, const char *tag) {
-    unsigned long int *settings;
+    unsigned long int settings;
 
     assert(type);
 
-    if (chash_ptr_luint_find(type->tags, tag, &settings) == CHASH_OK) {
-        return *settings;
+    if (chash_ptr_luint_peek(type->tags, tag, &settings) == CHASH_OK) {
+        return settings;
     } else {
         return pset->def;
     }
@@ -229,6 +236,10 @@ int psettings_self_id(struct psettings *pset, enum mime_types type) {
     }
 }
 
+unsigned int psettings_fields(struct psettings *pset) {
+    return pset->fields;
+}
+
 #define WORDLEN 100
 
 static int parse(struct mlparse_wrap *parser, char *buf, unsigned int *len, 
@@ -285,8 +296,10 @@ static int psettings_read_tag(struct psettings *pset,
     enum psettings_attr attr = PSETTINGS_ATTR_INDEX,
                         ex_attr;            /* existing attribute */
     struct psettings_type *ptype;
+    unsigned long int field = 0;
+    char *end;
 
-    /* 'tag' tag can contain name and index attributes only */
+    /* 'tag' tag can contain name, index, flow and field attributes only */
 
     /* read name and index tags */
     tagbuf[0] = '\0';
@@ -352,10 +365,32 @@ static int psettings_read_tag(struct psettings *pset,
                 ERROR("expecting parameter value after flow attribute");
                 return 0;
             }
+        } else if (!str_casecmp(buf, "field")) {
+            if ((ret = parse(parser, buf, &len, 1)) == MLPARSE_PARAMVAL) {
+                buf[len] = '\0';
+                field = strtoul(buf, &end, 10);
+                if (*end || end == buf || !field || field >= INDEX_FIELDS) {
+                    ERROR1("expected number from 1 to %u as value for field "
+                      "attribute", INDEX_FIELDS - 1U);
+                    return 0;
+                }
+            } else {
+                ERROR("expecting parameter value after field attribute");
+                return 0;
+            }
         } else {
-            ERROR("expected name, index or flow attribute");
+            ERROR("expected name, index, flow or field attribute");
+            return 0;
+        }
+    }
+
+    /* only content that's indexed can go into a field */
+    if (field) {
+        if (!(attr & (PSETTINGS_ATTR_INDEX | PSETTINGS_ATTR_TITLE))) {
+            ERROR("field attribute requires index value of true or title");
             return 0;
         }
+        attr |= PSETTINGS_ATTR_FIELD(field);
     }
 
     /* sanity checks */
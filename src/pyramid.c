@@ -19,12 +19,17 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
 /* absolute minimum size of an input buffer during a merge */
 #define MIN_INPUT 100
 
@@ -61,6 +66,10 @@ struct pyramid {
 
     int finished;                 /* whether the merger object has performed a 
                                    * final merge or not */
+#ifdef MT_ZET
+    struct readahead *ahead;      /* reader for the merge in progress, if 
+                                   * any */
+#endif /* MT_ZET */
 };
 
 struct pyramid* pyramid_new(struct fdset *fds, unsigned int tmp_type, 
@@ -81,6 +90,9 @@ struct pyramid* pyramid_new(struct fdset *fds, unsigned int tmp_type,
         p->storagep = storagep;
         p->map = map;
         p->vmap = vmap;
+#ifdef MT_ZET
+        p->ahead = NULL;
+#endif /* MT_ZET */
     }
 
     return p;
@@ -189,6 +201,188 @@ void pyramid_delete(struct pyramid* pyramid) {
     return;
 }
 
+/* advise the OS that an input file is about to be read sequentially */
+static void pyramid_sequential(int fd) {
+#ifdef HAVE_POSIX_FADVISE
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+#ifdef MT_ZET
+
+/* struct to read the inputs of a merge in a thread of its own, so that the
+ * merger doesn't sit idle waiting for each read to complete.  Each input has
+ * two buffers: the merger consumes one while the reader fills the other.  The
+ * reader fills buffers in the order in which the merger emptied them, which
+ * is the order in which it's likely to need them again. */
+struct readahead {
+    unsigned int count;           /* number of inputs */
+    char *buf[2];                 /* two sets of count buffers */
+    unsigned int bufsz;           /* size of each buffer */
+
+    struct readahead_input {
+        int fd;                   /* file descriptor to read from */
+        unsigned int spare;       /* which buffer the reader fills */
+        int ready;                /* whether the spare buffer is filled */
+        int len;                  /* result of reading into it */
+        int err;                  /* errno after reading into it */
+    } *input;
+
+    unsigned int *queue;          /* circular queue of inputs to read */
+    unsigned int head;            /* first input in queue */
+    unsigned int queued;          /* number of inputs in queue */
+
+    int stop;                     /* whether the reader should exit */
+    pthread_t thread;             /* reader thread */
+    pthread_mutex_t mutex;        /* protects input, queue and stop */
+    pthread_cond_t cond;          /* signalled on any change to them */
+};
+
+static void *readahead_thread(void *opaque) {
+    struct readahead *ra = opaque;
+    struct readahead_input *in;
+    unsigned int input;
+    int len,
+        err;
+
+    pthread_mutex_lock(&ra->mutex);
+    while (1) {
+        while (!ra->stop && !ra->queued) {
+            pthread_cond_wait(&ra->cond, &ra->mutex);
+        }
+        if (ra->stop) {
+            break;
+        }
+
+        input = ra->queue[ra->head];
+        ra->head = (ra->head + 1) % ra->count;
+        ra->queued--;
+        in = &ra->input[input];
+        pthread_mutex_unlock(&ra->mutex);
+
+        errno = 0;
+        len = read(in->fd, ra->buf[in->spare] + input * ra->bufsz, ra->bufsz);
+        err = errno;
+
+        pthread_mutex_lock(&ra->mutex);
+        in->len = len;
+        in->err = err;
+        in->ready = 1;
+        pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->mutex);
+    return NULL;
+}
+
+/* internal function to start reading count files from entry ahead of a
+ * merge, into buffers of bufsz bytes at buf0 and buf1.  The files must
+ * already be pinned.  Returns true on success, false if the merge should
+ * read them itself. */
+static int readahead_start(struct pyramid *pyramid, unsigned int entry,
+  unsigned int count, char *buf0, char *buf1, unsigned int bufsz) {
+    struct readahead *ra;
+    unsigned int i;
+
+    assert(!pyramid->ahead);
+    if (!(ra = malloc(sizeof(*ra)))) {
+        return 0;
+    }
+    ra->input = malloc(sizeof(*ra->input) * count);
+    ra->queue = malloc(sizeof(*ra->queue) * count);
+    if (!ra->input || !ra->queue) {
+        if (ra->input) {
+            free(ra->input);
+        }
+        if (ra->queue) {
+            free(ra->queue);
+        }
+        free(ra);
+        return 0;
+    }
+
+    ra->count = count;
+    ra->buf[0] = buf0;
+    ra->buf[1] = buf1;
+    ra->bufsz = bufsz;
+    for (i = 0; i < count; i++) {
+        ra->input[i].fd = pyramid->file[entry + i].fd;
+        ra->input[i].spare = 0;
+        ra->input[i].ready = 0;
+        ra->input[i].len = 0;
+        ra->input[i].err = 0;
+        ra->queue[i] = i;
+    }
+    ra->head = 0;
+    ra->queued = count;
+    ra->stop = 0;
+    pthread_mutex_init(&ra->mutex, NULL);
+    pthread_cond_init(&ra->cond, NULL);
+
+    if (pthread_create(&ra->thread, NULL, readahead_thread, ra)) {
+        pthread_cond_destroy(&ra->cond);
+        pthread_mutex_destroy(&ra->mutex);
+        free(ra->input);
+        free(ra->queue);
+        free(ra);
+        return 0;
+    }
+    pyramid->ahead = ra;
+    return 1;
+}
+
+/* internal function to obtain the next buffer read for input, pointing
+ * *next_in at it.  Returns the result of the read, with errno set. */
+static int readahead_next(struct pyramid *pyramid, unsigned int input,
+  char **next_in) {
+    struct readahead *ra = pyramid->ahead;
+    struct readahead_input *in = &ra->input[input];
+    int len,
+        err;
+
+    pthread_mutex_lock(&ra->mutex);
+    while (!in->ready) {
+        pthread_cond_wait(&ra->cond, &ra->mutex);
+    }
+    len = in->len;
+    err = in->err;
+    *next_in = ra->buf[in->spare] + input * ra->bufsz;
+
+    /* unless the input is exhausted, have the reader fill the buffer the
+     * merger just finished with */
+    if (len > 0) {
+        in->spare = !in->spare;
+        in->ready = 0;
+        ra->queue[(ra->head + ra->queued++) % ra->count] = input;
+        pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->mutex);
+
+    errno = err;
+    return len;
+}
+
+/* internal function to stop reading ahead of a merge */
+static void readahead_stop(struct pyramid *pyramid) {
+    struct readahead *ra = pyramid->ahead;
+
+    if (ra) {
+        pthread_mutex_lock(&ra->mutex);
+        ra->stop = 1;
+        pthread_cond_broadcast(&ra->cond);
+        pthread_mutex_unlock(&ra->mutex);
+        pthread_join(ra->thread, NULL);
+
+        pthread_cond_destroy(&ra->cond);
+        pthread_mutex_destroy(&ra->mutex);
+        free(ra->input);
+        free(ra->queue);
+        free(ra);
+        pyramid->ahead = NULL;
+    }
+}
+
+#endif /* MT_ZET */
+
 #define MERGE_FAIL(pyramid, entry, count, ofd, vfd, fileno, vf, fm, imerge) \
   (ERROR("merge failed"), \
    merge_fail(pyramid, entry, count, ofd, vfd, fileno, vf, fm, imerge))
@@ -200,6 +394,10 @@ static void merge_fail(struct pyramid *pyramid, unsigned int entry,
   struct merge_inter *imerge) {
     unsigned int i;
 
+#ifdef MT_ZET
+    readahead_stop(pyramid);
+#endif /* MT_ZET */
+
     if (outfd >= 0) {
         fdset_unpin(pyramid->fds, pyramid->tmp_type, fileno, outfd);
     }
@@ -238,7 +436,8 @@ int pyramid_merge(struct pyramid *pyramid, unsigned int *files,
     unsigned int inbufsz,                /* size of each input buffer */
                  outbufsz,               /* size of output buffer */
                  bigbufsz;               /* size of big buffer */
-    int len;                             /* length of write */
+    int len,                             /* length of write */
+        big;                             /* whether big buffer was read */
     enum merge_ret ret;                  /* return value from merge_final */
     unsigned int file = 0,               /* file we're writing to */ 
                  vfile = 0,              /* vocab file we're writing to */
@@ -296,6 +495,7 @@ int pyramid_merge(struct pyramid *pyramid, unsigned int *files,
       && ((pyramid->file[i].fd 
         = fdset_pin(pyramid->fds, pyramid->tmp_type, 
           pyramid->file[i].fileno, 0, SEEK_SET)) >= 0)) {
+        pyramid_sequential(pyramid->file[i].fd);
         inputs[i].next_in = inbuf + inbufsz * i;
         inputs[i].avail_in = 0;
         i++;
@@ -375,10 +575,23 @@ int pyramid_merge(struct pyramid *pyramid, unsigned int *files,
     file = merge.out.fileno_out;
     start = end = merge.out.offset_out;
 
+#ifdef MT_ZET
+    /* read inputs in the background, using the big buffer as the second 
+     * buffer for each of them */
+    readahead_start(pyramid, 0, pyramid->files, inbuf, bigbuf, inbufsz);
+#endif /* MT_ZET */
+
     /* ok, now merge them */
     while ((ret = merge_final(&merge, &input, &next_read)) != MERGE_OK) {
         switch (ret) {
         case MERGE_INPUT:
+            big = 0;
+#ifdef MT_ZET
+            if (pyramid->ahead) {
+                len = readahead_next(pyramid, input, 
+                    &merge.input[input].next_in);
+            } else
+#endif /* MT_ZET */
             if ((bigbufsz > inbufsz) && (next_read > inbufsz)) {
                 /* ensure that the big buffer is not in use */
                 for (i = 0; i < pyramid->files; i++) {
@@ -390,6 +603,7 @@ int pyramid_merge(struct pyramid *pyramid, unsigned int *files,
 
                 /* use the big buffer */
                 merge.input[input].next_in = bigbuf;
+                big = 1;
 
                 /* ensure we don't try to read too much into the buffer */
                 if (next_read > bigbufsz) {
@@ -400,17 +614,23 @@ int pyramid_merge(struct pyramid *pyramid, unsigned int *files,
                 merge.input[input].next_in = inbuf + input * inbufsz;
             }
 
-            /* use the normal buffer */
-            errno = 0;
-            if ((len = read(pyramid->file[input].fd, 
-                merge.input[input].next_in, next_read)) > 0) {
+#ifdef MT_ZET
+            if (!pyramid->ahead)
+#endif /* MT_ZET */
+            {
+                errno = 0;
+                len = read(pyramid->file[input].fd, 
+                    merge.input[input].next_in, next_read);
+            }
+
+            if (len > 0) {
 
                 /* read succeeded (note that we can't assign to avail_in
                  * directly, because its an unsigned int) */
                 merge.input[input].avail_in = len;
 
             /* reached EOF, let the merge module know */
-            } else if (!len && !errno && (merge.input[input].next_in != bigbuf)
+            } else if (!len && !errno && !big
               && (merge_final_input_finish(&merge, input) == MERGE_OK)
 
               /* unlink file */
@@ -579,6 +799,10 @@ int pyramid_merge(struct pyramid *pyramid, unsigned int *files,
         }
     }
 
+#ifdef MT_ZET
+    readahead_stop(pyramid);
+#endif /* MT_ZET */
+
     /* allocate space used in current files */
     i = end - start;
     if (!pyramid->map 
@@ -759,7 +983,8 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
                  next_read;              /* how big the next read will be */
     struct pyramid_state state;          /* some bits and pieces of merge 
                                           * state */
-    int len;                             /* length of write */
+    int len,                             /* length of write */
+        big;                             /* whether big buffer was read */
     enum merge_ret ret;                  /* return value from merge_inter */
 
     /* keep number of pinned fds, should be the same when we exit */
@@ -810,6 +1035,7 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
         = fdset_pin(pyramid->fds, pyramid->tmp_type, 
           pyramid->file[entry + i].fileno, 0, SEEK_SET)) >= 0)) {
 
+        pyramid_sequential(pyramid->file[entry + i].fd);
         if (pyramid->file[entry + i].level > state.level) {
             state.level = pyramid->file[entry + i].level;
         }
@@ -852,10 +1078,23 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
         return -EINVAL;
     }
 
+#ifdef MT_ZET
+    /* read inputs in the background, using the big buffer as the second 
+     * buffer for each of them */
+    readahead_start(pyramid, entry, count, inbuf, bigbuf, inbufsz);
+#endif /* MT_ZET */
+
     /* ok, now merge them */
     while ((ret = merge_inter(&merge, &input, &next_read)) != MERGE_OK) {
         switch (ret) {
         case MERGE_INPUT:
+            big = 0;
+#ifdef MT_ZET
+            if (pyramid->ahead) {
+                len = readahead_next(pyramid, input, 
+                    &merge.input[input].next_in);
+            } else
+#endif /* MT_ZET */
             if ((bigbufsz > inbufsz) && (next_read > inbufsz)) {
                 /* ensure that the big buffer is not in use */
                 for (i = 0; i < count; i++) {
@@ -868,6 +1107,7 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
 
                 /* use the big buffer */
                 merge.input[input].next_in = bigbuf;
+                big = 1;
 
                 /* ensure we don't try to read too much into the buffer */
                 /* note that we restrict our read to size next_read so as to
@@ -895,9 +1135,16 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
                 }
             }
 
-            errno = 0;
-            if ((len = read(pyramid->file[entry + input].fd, 
-                merge.input[input].next_in, next_read)) > 0) {
+#ifdef MT_ZET
+            if (!pyramid->ahead)
+#endif /* MT_ZET */
+            {
+                errno = 0;
+                len = read(pyramid->file[entry + input].fd, 
+                    merge.input[input].next_in, next_read);
+            }
+
+            if (len > 0) {
 
                 /* read succeeded (note that we can't assign to avail_in
                  * directly, because its an unsigned int, which hides 
@@ -906,7 +1153,7 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
 
             /* reached EOF, let the merge module know (its an error for the 
              * bigbuf, since we only tried to read an expected amount) */
-            } else if (!len && !errno && (merge.input[input].next_in != bigbuf)
+            } else if (!len && !errno && !big
               && (merge_inter_input_finish(&merge, input) == MERGE_OK)
 
               /* unlink file */
@@ -955,6 +1202,10 @@ int pyramid_partial_merge(struct pyramid* pyramid, unsigned int entry,
         }
     }
 
+#ifdef MT_ZET
+    readahead_stop(pyramid);
+#endif /* MT_ZET */
+
     merge_inter_delete(&merge);
 
     /* add final new file */
@@ -17,6 +17,7 @@
 #include "mlparse.h"
 #include "str.h"
 #include "ndocmap.h"
+#include "skip_build.h"
 
 /* 
  *  Utility function forward declarations.
@@ -451,6 +452,11 @@ typedef struct {
     unsigned long size;
     unsigned long docs;
     unsigned long last;
+    /* skip table (see skip_build.h), giving the last docno before each 
+     * block of postings and the offset of the block in vec */
+    unsigned long * skip_docno;
+    unsigned long * skip_offset;
+    unsigned int skips;
 } zet_PostingsObject;
 
 /*
@@ -597,6 +603,26 @@ static PyObject * PostingsIterator_skip_to(PyObject * self,
         PyErr_SetString(PyExc_IndexError, "Already past specified docno");
         return NULL;
     }
+    if (iterator->postings->skips) {
+        /* jump to the last block that starts before to_docno, if that's 
+         * further along than we are */
+        zet_PostingsObject * postings = iterator->postings;
+        unsigned int lo = 0, 
+                     hi = postings->skips;
+
+        while (lo < hi) {
+            unsigned int mid = lo + (hi - lo) / 2;
+            if (postings->skip_docno[mid] < to_docno)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo && (iterator->last_docno == (unsigned long) -1
+            || postings->skip_docno[lo - 1] > iterator->last_docno)) {
+            iterator->last_docno = postings->skip_docno[lo - 1];
+            iterator->vec_offset = postings->skip_offset[lo - 1];
+        }
+    }
     vec.pos = iterator->postings->vec + iterator->vec_offset;
     vec.end = vec.pos + iterator->postings->size;
 
@@ -680,6 +706,8 @@ static PyTypeObject zet_PostingsType = {
 static void Postings_dealloc(zet_PostingsObject * self) {
     if (self->vec != NULL)
         free(self->vec);
+    if (self->skip_docno != NULL)
+        free(self->skip_docno);
     self->ob_type->tp_free((PyObject *) self);
 }
 
@@ -1150,7 +1178,9 @@ static PyObject * Index_term_info(PyObject * self, PyObject * args) {
         return NULL;
     }
     /* XXX handle other types of vocab vector */
-    if (ve.type != VOCAB_VTYPE_DOCWP) {
+    if (ve.type != VOCAB_VTYPE_DOCWP && ve.type != VOCAB_VTYPE_DOCWP_SKIP
+      && ve.type != VOCAB_VTYPE_DOCWP_SEP
+      && ve.type != VOCAB_VTYPE_DOCWP_BLOCK) {
         PyErr_SetString(PyExc_StandardError, "Expected first vocab vector "
           "entry to be doc-ordered with word positions, but this was not "
           "the case");
@@ -1160,6 +1190,74 @@ static PyObject * Index_term_info(PyObject * self, PyObject * args) {
       ve.header.docwp.occurs, ve.header.docwp.last, ve.size);
 }
 
+/*
+ *  Decode the skip table of len bytes at table into postings, returning
+ *  the number of postings in each block, or 0 on error.
+ */
+static unsigned long postings_skips_decode(zet_PostingsObject * postings,
+  char * table, unsigned long len) {
+    struct vec vec;
+    unsigned long interval;
+    unsigned long docno = 0;
+    unsigned long offset = 0;
+    unsigned int i;
+    unsigned int entries;
+
+    vec.pos = table;
+    vec.end = table + len;
+    if (!vec_vbyte_read(&vec, &interval) || !interval)
+        return 0;
+    table = vec.pos;
+    entries = vec_vbyte_scan(&vec, UINT_MAX, &i) / 2;
+    if (VEC_LEN(&vec) || !entries)
+        return 0;
+    if ( (postings->skip_docno 
+          = malloc(sizeof(*postings->skip_docno) * 2 * entries)) == NULL)
+        return 0;
+    postings->skip_offset = postings->skip_docno + entries;
+    vec.pos = table;
+    for (i = 0; i < entries; i++) {
+        vec_vbyte_read(&vec, &postings->skip_docno[i]);
+        vec_vbyte_read(&vec, &postings->skip_offset[i]);
+        docno = postings->skip_docno[i] += docno;
+        offset = postings->skip_offset[i] += offset;
+    }
+    postings->skips = entries;
+    return interval;
+}
+
+/*
+ *  Point the skip table of postings at the start of each block of interval
+ *  postings in its (interleaved) vector.  The table was stored for the 
+ *  separated document numbers, so its offsets don't apply.  Returns 0 on
+ *  error.
+ */
+static int postings_skips_locate(zet_PostingsObject * postings, 
+  unsigned long interval) {
+    struct vec vec;
+    unsigned long docno = (unsigned long) -1;
+    unsigned long n;
+    unsigned long f_dt;
+    unsigned long i;
+    unsigned int block = 0;
+    unsigned int scanned;
+
+    vec.pos = postings->vec;
+    vec.end = postings->vec + postings->size;
+    for (i = 0; i < postings->docs && block < postings->skips; i++) {
+        if (i && !(i % interval)) {
+            if (postings->skip_docno[block] != docno)
+                return 0;
+            postings->skip_offset[block++] = vec.pos - postings->vec;
+        }
+        if (!vec_vbyte_read(&vec, &n) || !vec_vbyte_read(&vec, &f_dt)
+          || vec_vbyte_scan(&vec, f_dt, &scanned) != f_dt)
+            return 0;
+        docno = (docno == (unsigned long) -1) ? n : docno + n + 1;
+    }
+    return block == postings->skips;
+}
+
 static PyObject * Index_term_postings(PyObject * self, PyObject * args) {
     zet_IndexObject * Index = (zet_IndexObject *) self;
     struct index * idx = Index->idx;
@@ -1170,6 +1268,8 @@ static PyObject * Index_term_postings(PyObject * self, PyObject * args) {
     struct vec vec;
     void * term_data;
     unsigned int veclen;
+    unsigned long skipsize = 0;
+    unsigned long interval = 0;
     int fd;
     zet_PostingsObject * postings;
 
@@ -1189,7 +1289,12 @@ static PyObject * Index_term_postings(PyObject * self, PyObject * args) {
         return NULL;
     }
     /* XXX handle other types of vocab vector */
-    if (ve.type != VOCAB_VTYPE_DOCWP) {
+    if (ve.type == VOCAB_VTYPE_DOCWP_SKIP) {
+        /* postings follow the skip table, which skip_to uses */
+        skipsize = ve.header.docwp_skip.skipsize;
+    } else if (ve.type != VOCAB_VTYPE_DOCWP 
+      && ve.type != VOCAB_VTYPE_DOCWP_SEP
+      && ve.type != VOCAB_VTYPE_DOCWP_BLOCK) {
         PyErr_SetString(PyExc_StandardError, "Expected first vocab vector "
           "entry to be doc-ordered with word positions, but this was not "
           "the case");
@@ -1211,7 +1316,9 @@ static PyObject * Index_term_postings(PyObject * self, PyObject * args) {
     postings->size = ve.size;
     postings->docs = ve.header.docwp.docs;
     postings->last = ve.header.docwp.last;
-    if ( (postings->vec = malloc(ve.size)) == NULL) {
+    postings->skip_docno = postings->skip_offset = NULL;
+    postings->skips = 0;
+    if ( (postings->vec = malloc(postings->size)) == NULL) {
         PyErr_SetString(PyExc_MemoryError, 
           "Out of memory allocating vector buffer");
         PyObject_Del(postings);
@@ -1219,13 +1326,61 @@ static PyObject * Index_term_postings(PyObject * self, PyObject * args) {
     }
     fd = fdset_pin(idx->fd, idx->index_type, ve.loc.file.fileno, 
       ve.loc.file.offset, SEEK_SET);
-    if (fd == -1 || read(fd, postings->vec, ve.size) < ve.size) {
+    if (fd == -1 || read(fd, postings->vec, postings->size) < postings->size) {
         PyErr_SetString(PyExc_IOError, "Unable to read from vector file");
         free(postings->vec);
         PyObject_Del(postings);
         return NULL;
     }
     fdset_unpin(idx->fd, idx->index_type, ve.loc.file.fileno, fd);
+    if (ve.type == VOCAB_VTYPE_DOCWP_SEP 
+      || ve.type == VOCAB_VTYPE_DOCWP_BLOCK) {
+        skipsize = ve.header.docwp_sep.skipsize;
+    }
+    if (skipsize) {
+        if ( (interval = postings_skips_decode(postings, postings->vec, 
+                  skipsize)) == 0) {
+            PyErr_SetString(PyExc_StandardError, 
+              "Unable to decode skip table");
+            if (postings->skip_docno != NULL)
+                free(postings->skip_docno);
+            free(postings->vec);
+            PyObject_Del(postings);
+            return NULL;
+        }
+        if (ve.type == VOCAB_VTYPE_DOCWP_SKIP) {
+            postings->size -= skipsize;
+            memmove(postings->vec, postings->vec + skipsize, postings->size);
+        }
+    }
+    if (ve.type == VOCAB_VTYPE_DOCWP_SEP 
+      || ve.type == VOCAB_VTYPE_DOCWP_BLOCK) {
+        /* put word positions back after each (vbyte) posting */
+        char *plain = malloc(skip_docwp_bound(&ve));
+
+        if (plain == NULL || skip_docwp(&ve, postings->vec, plain) != SKIP_OK) {
+            PyErr_SetString(PyExc_StandardError, 
+              "Unable to interleave word positions");
+            free(plain);
+            if (postings->skip_docno != NULL)
+                free(postings->skip_docno);
+            free(postings->vec);
+            PyObject_Del(postings);
+            return NULL;
+        }
+        free(postings->vec);
+        postings->vec = plain;
+        postings->size = ve.size;
+        if (postings->skips 
+          && !postings_skips_locate(postings, interval)) {
+            PyErr_SetString(PyExc_StandardError, 
+              "Skip table doesn't match postings");
+            free(postings->skip_docno);
+            free(postings->vec);
+            PyObject_Del(postings);
+            return NULL;
+        }
+    }
     return (PyObject *) postings;
 }
 
@@ -15,6 +15,7 @@
 #include "_postings.h"
 #include "postings.h"
 #include "iobtree.h"
+#include "skip_build.h"
 #include "str.h"
 #include "vec.h"
 #include "vocab.h"
@@ -90,6 +91,54 @@ static ssize_t outbuf(struct filep *out, char *buf, unsigned int len,
     return len;
 }
 
+/* internal function to copy len bytes from buf to the output, or to memory at
+ * *mem (which is advanced past them) if mem is set */
+static ssize_t copybuf(struct filep *out, char **mem, char *buf, 
+  unsigned int len, struct fdset *fd) {
+    if (*mem) {
+        memcpy(*mem, buf, len);
+        *mem += len;
+        return len;
+    } else {
+        return outbuf(out, buf, len, fd);
+    }
+}
+
+/* internal function to start a new output file if another len bytes won't 
+ * fit into the current one, pointing nve at the start of the new file.  
+ * Returns true on success */
+static int outfile(struct index *idx, struct filep *out, unsigned int len,
+  struct fdset *fd, struct vocab_vector *nve) {
+    if (out->offset + out->buflen > idx->storage.max_filesize - len) {
+        /* unpin old fd */
+        if (out->fd >= 0) {
+            /* flush buffer */
+            if (out->buflen && index_atomic_write(out->fd, 
+                out->buf, out->buflen) 
+              == (ssize_t) out->buflen) {
+
+                out->buflen = out->bufpos = 0;
+            } else {
+                return 0;
+            }
+            fdset_unpin(fd, out->type, out->fileno, out->fd);
+        }
+
+        /* pin new fd */
+        if ((out->fd = fdset_create(fd, out->type, out->fileno + 1)) >= 0) {
+            out->fileno++;
+            out->offset = 0;
+        } else {
+            out->offset = -1;
+            return 0;
+        }
+
+        nve->loc.file.fileno = out->fileno;
+        nve->loc.file.offset = out->offset + out->buflen;
+    }
+    return 1;
+}
+
 /* internal function to load next vocab entry */
 static enum btbulk_ret vocab_load(struct btbulk_read *vocab, struct filep *fp, 
   struct fdset *fdset, unsigned int pagesize) {
@@ -168,17 +217,20 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
   struct filep *vin, struct btbulk_read *old_vocab, struct filep *out, 
   struct filep *vout, struct btbulk *new_vocab, 
   struct fdset *fd, struct postings_node **posting, unsigned int postings,
-  unsigned long int *nt, unsigned int *root_fileno,
-  unsigned long int *root_offset) {
+  struct skip_layout *layout, unsigned long int *nt, 
+  unsigned int *root_fileno, unsigned long int *root_offset) {
     struct postings_node **posting_end = posting + postings;
     enum btbulk_ret readret,
                     btret;
     int cmp;
     unsigned long int terms = 0;
     struct vocab_vector nve,
-                        ve;
+                        ve,
+                        lve;
     const unsigned int pagesize = idx->storage.pagesize;
     ssize_t sizeret;
+    char *mem;                     /* where the new vector is being gathered,
+                                    * if it needs converting */
 
     /* load first entry from old vocab */
     if ((readret = vocab_load(old_vocab, vin, fd, pagesize)) != BTBULK_OK 
@@ -189,7 +241,6 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
 
     /* these properties are invariant over all new vocab entries written out */
     nve.attr = VOCAB_ATTRIBUTES_NONE;
-    nve.type = VOCAB_VTYPE_DOCWP;
     nve.location = VOCAB_LOCATION_FILE;
 
     while ((posting < posting_end) || (readret != BTBULK_FINISH)) {
@@ -210,6 +261,8 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
         }
 
         terms++;
+        mem = NULL;
+        nve.type = VOCAB_VTYPE_DOCWP;
         nve.size = 0;
         nve.header.docwp.docs = 0;
         nve.header.docwp.occurs = 0;
@@ -221,7 +274,13 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
         if (cmp <= 0) {
             struct vec vv;
             enum vocab_ret vret;
-            unsigned int bytes;
+            unsigned int bytes,
+                         skipsize,
+                         sepsize = 0,
+                         plainsize = 0;
+            char *sepbuf = NULL,
+                 *sep = NULL;
+            struct vocab_vector sepve;
 
             new_vocab->term = old_vocab->output.ok.term;
             new_vocab->termlen = old_vocab->output.ok.termlen;
@@ -232,55 +291,80 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
                 switch (ve.type) {
                 case VOCAB_VTYPE_DOC:
                 case VOCAB_VTYPE_DOCWP:
+                case VOCAB_VTYPE_DOCWP_SKIP:
+                case VOCAB_VTYPE_DOCWP_SEP:
+                case VOCAB_VTYPE_DOCWP_BLOCK:
                     /* must be the only vector available */
                     assert(nve.size == 0);
                     assert(nve.location == VOCAB_LOCATION_FILE);
 
+                    /* skip tables and separated positions are rebuilt
+                     * below (the new postings change the blocks), so only 
+                     * the postings following the table are copied */
+                    skipsize = 0;
+                    if (ve.type == VOCAB_VTYPE_DOCWP_SKIP) {
+                        skipsize = ve.header.docwp_skip.skipsize;
+                        ve.size -= skipsize;
+                    } else if ((ve.type == VOCAB_VTYPE_DOCWP_SEP)
+                      || (ve.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
+                        skipsize = ve.header.docwp_sep.skipsize;
+                        ve.size -= skipsize;
+
+                        /* separated word positions (and block coded
+                         * postings) have to be merged back into vbyte
+                         * postings, so copy the vector into memory first
+                         * (converting into the second part of sepbuf).  The
+                         * output size is only known after conversion, so 
+                         * allow for the largest it can be until then. */
+                        sepve = ve;
+                        sepve.header.docwp_sep.skipsize = 0;
+                        sepsize = ve.size;
+                        plainsize = skip_docwp_bound(&sepve);
+                        if ((ve.header.docwp_sep.docsize > sepsize) 
+                          || !(sep = sepbuf 
+                            = malloc(sepsize + plainsize + 1))) {
+                            assert(!CRASH);
+                            return 0;
+                        }
+                    }
+
+                    /* gather the merged vector in memory if it has to be
+                     * converted into the layout wanted in the index, which
+                     * depends on how many documents it will have */
+                    lve = nve;
+                    lve.header.doc.docs = ve.header.doc.docs 
+                      + ((cmp == 0) ? (*posting)->docs : 0);
+                    if (skip_layout_wanted(idx, &lve)) {
+                        if (!skip_layout_reserve(layout, 
+                            (sepbuf ? plainsize : ve.size) 
+                              + ((cmp == 0) 
+                                ? (*posting)->vec.pos - (*posting)->vecmem 
+                                : 0))) {
+                            free(sepbuf);
+                            assert(!CRASH);
+                            return 0;
+                        }
+                        mem = layout->vec;
+                    }
+                    if (!sepbuf) {
+                        sep = mem;
+                    }
+
                     /* copy it to the new index */
-                    nve.size += ve.size;
+                    nve.size += sepbuf ? plainsize : ve.size;
                     nve.header.doc.docs += ve.header.doc.docs;
                     nve.header.doc.occurs += ve.header.doc.occurs;
                     nve.header.doc.last = ve.header.doc.last;
 
                     /* check whether we're about to go above file size 
                      * limit for output file */
-                    if (((cmp == 0) 
-                        && (out->offset + out->buflen 
-                          > idx->storage.max_filesize - nve.size 
-                            - ((*posting)->vec.pos - (*posting)->vecmem)))
-                      || ((cmp < 0) 
-                        && (out->offset + out->buflen
-                          > idx->storage.max_filesize - nve.size))) {
-                        /* unpin old fd */
-                        if (out->fd >= 0) {
-                            /* flush buffer */
-                            if (out->buflen && index_atomic_write(out->fd, 
-                                out->buf, out->buflen) 
-                              == (ssize_t) out->buflen) {
-
-                                out->buflen = out->bufpos = 0;
-                            } else {
-                                assert(!CRASH);
-                                return 0;
-                            }
-                            fdset_unpin(fd, out->type, out->fileno, out->fd);
-                        }
-
-                        /* pin new fd */
-                        if ((out->fd 
-                          = fdset_create(fd, out->type, out->fileno + 1)) 
-                            >= 0) {
-
-                            out->fileno++;
-                            out->offset = 0;
-                        } else {
-                            out->offset = -1;
-                            assert(!CRASH);
-                            return 0;
-                        }
-
-                        nve.loc.file.fileno = out->fileno;
-                        nve.loc.file.offset = out->offset + out->buflen;
+                    if (!outfile(idx, out, nve.size 
+                        + ((cmp == 0) 
+                          ? (*posting)->vec.pos - (*posting)->vecmem : 0), 
+                        fd, &nve)) {
+                        free(sepbuf);
+                        assert(!CRASH);
+                        return 0;
                     }
 
                     /* pin correct in fd */
@@ -321,11 +405,26 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
                     assert(lseek(in->fd, 0, SEEK_CUR) 
                       == (ssize_t) in->offset);
 
+                    /* pass over skip table */
+                    if (skipsize <= in->buflen - in->bufpos) {
+                        in->bufpos += skipsize;
+                    } else {
+                        skipsize -= in->buflen - in->bufpos;
+                        in->buflen = in->bufpos = 0;
+                        if (lseek(in->fd, skipsize, SEEK_CUR) 
+                          == (ssize_t) (in->offset + skipsize)) {
+                            in->offset += skipsize;
+                        } else {
+                            assert(!CRASH);
+                            return 0;
+                        }
+                    }
+
                     /* copy (possibly partially) buffered segment from input to
                      * output */
                     bytes = nve.size;
                     if (ve.size && (ve.size >= (in->buflen - in->bufpos))) {
-                        if (outbuf(out, in->buf + in->bufpos, 
+                        if (copybuf(out, &sep, in->buf + in->bufpos, 
                             in->buflen - in->bufpos, fd)
                           == (ssize_t) (in->buflen - in->bufpos)) {
                             ve.size -= in->buflen - in->bufpos;
@@ -342,7 +441,7 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
                         assert(in->bufpos == 0);
                         if (((in->buflen
                           = read(in->fd, in->buf, in->bufsize)) > 0)
-                          && (outbuf(out, in->buf, in->buflen, fd)) 
+                          && (copybuf(out, &sep, in->buf, in->buflen, fd)) 
                             == (ssize_t) in->buflen) {
 
                             ve.size -= in->buflen;
@@ -375,20 +474,44 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
                     /* copy last buffered segment from input to output */
                     assert(ve.size <= (in->buflen - in->bufpos));
                     if (ve.size 
-                      && (outbuf(out, in->buf + in->bufpos, ve.size, fd) 
-                        == (ssize_t) ve.size)) {
+                      && (copybuf(out, &sep, in->buf + in->bufpos, ve.size, 
+                          fd) == (ssize_t) ve.size)) {
 
                         in->bufpos += ve.size;
                     } else if (ve.size) {
                         assert(!CRASH);
                         return 0;
                     }
+                    if (!sepbuf) {
+                        mem = sep;
+                    }
+
+                    /* write out vector with word positions merged back in */
+                    if (sepbuf) {
+                        if ((skip_docwp(&sepve, sepbuf, sepbuf + sepsize) 
+                            == SKIP_OK)
+                          && (copybuf(out, &mem, sepbuf + sepsize, 
+                              sepve.size, fd) == (ssize_t) sepve.size)) {
+                            nve.size -= plainsize - sepve.size;
+                            free(sepbuf);
+                        } else {
+                            free(sepbuf);
+                            assert(!CRASH);
+                            return 0;
+                        }
+                    }
                     break;
 
                 case VOCAB_VTYPE_IMPACT:
+                case VOCAB_VTYPE_IMPACT_BLOCK:
                     /* impacts are now out-of-date, remove them from the 
                      * index */
                     break;
+
+                case VOCAB_VTYPE_BOUNDS:
+                    /* as are score bounds, which are recomputed after the
+                     * remerge if the index has them */
+                    break;
                 }
             }
             assert(vret == VOCAB_END);
@@ -401,38 +524,22 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
 
             /* check whether we're about to go above file size 
              * limit for output file */
-            if (out->offset + out->buflen > idx->storage.max_filesize 
-                  - ((*posting)->vec.pos - (*posting)->vecmem)) {
-                /* unpin old fd */
-                if (out->fd >= 0) {
-                    /* flush buffer */
-                    if (out->buflen && index_atomic_write(out->fd, 
-                        out->buf, out->buflen) 
-                      == (ssize_t) out->buflen) {
-
-                        out->buflen = out->bufpos = 0;
-                    } else {
-                        assert(!CRASH);
-                        return 0;
-                    }
-                    fdset_unpin(fd, out->type, out->fileno, out->fd);
-                }
-
-                /* pin new fd */
-                if ((out->fd 
-                  = fdset_create(fd, out->type, out->fileno + 1))
-                    >= 0) {
+            if (!outfile(idx, out, (*posting)->vec.pos - (*posting)->vecmem, 
+                fd, &nve)) {
+                assert(!CRASH);
+                return 0;
+            }
 
-                    out->fileno++;
-                    out->offset = 0;
-                } else {
-                    out->offset = -1;
+            /* gather the new vector in memory if it has to be converted */
+            lve = nve;
+            lve.header.doc.docs = (*posting)->docs;
+            if (skip_layout_wanted(idx, &lve)) {
+                if (!skip_layout_reserve(layout, 
+                    (*posting)->vec.pos - (*posting)->vecmem)) {
                     assert(!CRASH);
                     return 0;
                 }
-
-                nve.loc.file.fileno = out->fileno;
-                nve.loc.file.offset = out->offset + out->buflen;
+                mem = layout->vec;
             }
         }
 
@@ -460,7 +567,23 @@ static unsigned int actual_remerge(struct index *idx, struct filep *in,
 
             /* write in-memory vector to output */
             bytes = vec_len(&front);
-            if (outbuf(out, front.pos, bytes, fd) == (ssize_t) bytes) {
+            if (copybuf(out, &mem, front.pos, bytes, fd) 
+              == (ssize_t) bytes) {
+                /* do nothing */
+            } else {
+                assert(!CRASH);
+                return 0;
+            }
+        }
+
+        /* convert a gathered vector into the layout wanted for it, and write
+         * it out (only now is its final size known) */
+        if (mem) {
+            assert((unsigned long int) (mem - layout->vec) == nve.size);
+            if ((skip_layout_convert(idx, &nve, layout) == SKIP_OK)
+              && outfile(idx, out, nve.size, fd, &nve)
+              && (outbuf(out, layout->out, nve.size, fd) 
+                == (ssize_t) nve.size)) {
                 /* do nothing */
             } else {
                 assert(!CRASH);
@@ -653,6 +776,7 @@ int index_remerge(struct index *idx, unsigned int opts,
     unsigned long int terms,
                       root_offset;
     struct iobtree *tmpbtree;
+    struct skip_layout layout = {NULL, 0, NULL, 0, NULL, 0};
 
     assert(!postings_needs_update(idx->post));
 
@@ -712,10 +836,12 @@ int index_remerge(struct index *idx, unsigned int opts,
         qsort(posting, postings, sizeof(*posting), post_cmp);
         idx->vectors
           = actual_remerge(idx, &in, &vin, &old_vocab, &out, &vout, &new_vocab,
-            idx->fd, posting, postings, &terms, &root_fileno, &root_offset);
+            idx->fd, posting, postings, &layout, &terms, &root_fileno, 
+            &root_offset);
 
         btbulk_delete(&new_vocab);
         btbulk_read_delete(&old_vocab);
+        skip_layout_free(&layout);
         free(posting);
         free(vin.buf);
         free(in.buf);
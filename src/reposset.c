@@ -216,17 +216,31 @@ enum reposset_ret reposset_append_docno(struct reposset *rset,
 
 enum reposset_ret reposset_add_checkpoint(struct reposset *rset, 
   unsigned int reposno, enum mime_types comp, unsigned long int point) {
+    struct reposset_check check;
+
     /* XXX: technically, reposno should be below the number of
      * entries, but we'll allow checkpoints to be entered for the
-     * coming repository as well, for convenience sake.  Also, we
-     * should probably maintain the sorting of the array explicitly,
-     * but we assume that they come in sorted order. */
-    assert(comp == MIME_TYPE_APPLICATION_X_GZIP 
-      || comp == MIME_TYPE_APPLICATION_X_BZIP2);
-
+     * coming repository as well, for convenience sake. */
     assert(!rset->check_len 
       || rset->check[rset->check_len - 1].reposno < reposno);
 
+    check.reposno = reposno;
+    check.offset = point;
+    check.comp = comp;
+    check.in_offset = 0;
+    check.bits = check.prime = 0;
+    check.window = 0;
+    check.window_len = 0;
+    return reposset_add_resume(rset, &check);
+}
+
+enum reposset_ret reposset_add_resume(struct reposset *rset, 
+  const struct reposset_check *check) {
+    /* XXX: we should probably maintain the sorting of the array explicitly,
+     * but we assume that they come in sorted order. */
+    assert(check->comp == MIME_TYPE_APPLICATION_X_GZIP 
+      || check->comp == MIME_TYPE_APPLICATION_X_BZIP2);
+
     if (rset->check_len >= rset->check_size) {
         void *ptr = realloc(rset->check, 
             sizeof(*rset->check) * rset->check_size * 2);
@@ -240,9 +254,7 @@ enum reposset_ret reposset_add_checkpoint(struct reposset *rset,
         }
     }
 
-    rset->check[rset->check_len].reposno = reposno;
-    rset->check[rset->check_len].offset = point;
-    rset->check[rset->check_len].comp = comp;
+    rset->check[rset->check_len] = *check;
     assert(!rset->check_len || check_cmp(&rset->check[rset->check_len - 1], 
       &rset->check[rset->check_len]) < 0);  /* ensure ordering is correct */
     rset->check_len++;
@@ -357,6 +369,10 @@ void reposset_clear(struct reposset *rset) {
     rset->entries = rset->rec_len = rset->check_len = 0;
 }
 
+void reposset_clear_records(struct reposset *rset) {
+    rset->entries = rset->rec_len = 0;
+}
+
 struct reposset_check *reposset_check(struct reposset *rset, 
   unsigned int reposno) {
     struct reposset_check *find,
@@ -376,6 +392,33 @@ struct reposset_check *reposset_check(struct reposset *rset,
     }
 }
 
+struct reposset_check *reposset_check_at(struct reposset *rset, 
+  unsigned int reposno, unsigned long int offset) {
+    struct reposset_check *find,
+                          target;
+
+    target.reposno = reposno;
+    target.offset = offset;
+
+    /* find where the target would go, stepping back unless a checkpoint is
+     * there already */
+    find = binsearch(&target, rset->check, rset->check_len, sizeof(target), 
+        check_cmp);
+    if (find == rset->check + rset->check_len 
+      || check_cmp(find, &target) > 0) {
+        if (find == rset->check) {
+            return NULL;
+        }
+        find--;
+    }
+
+    if (find->reposno == reposno) {
+        return find;
+    } else {
+        return NULL;
+    }
+}
+
 struct reposset_check *reposset_check_first(struct reposset *rset) {
     return rset->check;
 }
@@ -9,14 +9,19 @@
 
 #include "_index.h"
 
+#include "ascii.h"
 #include "bit.h"
 #include "binsearch.h"
+#include "blockcodec.h"
 #include "bucket.h"
+#include "cache.h"
 #include "chash.h"
 #include "_chash.h"
 #include "def.h"
+#include "denseacc.h"
 #include "heap.h"
 #include "impact.h"
+#include "impactcodec.h"
 #include "index.h"
 #include "index_querybuild.h"
 #include "queryparse.h"
@@ -29,6 +34,7 @@
 #include "fdset.h"
 #include "metric.h"
 #include "postings.h"
+#include "segment.h"
 #include "summarise.h"
 #include "error.h"
 
@@ -40,6 +46,10 @@
 #include <limits.h>
 #include <string.h>
 
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
 /* number of significant digits in estimated results */
 #define RESULTS_SIGDIGITS 3
 
@@ -51,6 +61,8 @@ struct search_list_src *search_term_src(struct index *idx, struct term *term,
   struct alloc *alloc, unsigned int memlimit);
 struct search_list_src *search_conjunct_src(struct index *idx, 
   struct conjunct *conj, struct alloc *alloc, unsigned int memlimit);
+static struct search_list_src *search_term_pos_src(struct index *idx, 
+  struct term *term, int positions, struct alloc *alloc, unsigned int mem);
 
 /* internal function to compare phrase term pointers by frequency/estimated
  * frequency */
@@ -207,31 +219,92 @@ static void sort_hash(struct search_acc *heap, unsigned int heapsize,
     }
 }
 
+/* internal functions to sort array accumulators into an array, visiting only
+ * the pages that the query touched */
+static void sort_dense(struct search_acc *heap, unsigned int heapsize, 
+  struct denseacc *acc) {
+    unsigned int i,
+                 j = 0;
+    unsigned long int docno,
+                      end;
+    struct search_acc *lowest = NULL,
+                      tmp;
+    float lowest_weight = 0.0;
+
+    for (i = 0; i < acc->touches; i++) {
+        docno = (unsigned long int) acc->touched[i] << DENSEACC_PAGE_BITS;
+        for (end = docno + DENSEACC_PAGE; docno < end; docno++) {
+            if (!acc->acc[docno]) {
+                continue;
+            } else if (j < heapsize) {
+                /* fill heap with accumulators in the order they occur */
+                heap[j].docno = docno;
+                heap[j].weight = (float) acc->acc[docno];
+                if (++j == heapsize) {
+                    /* heapify heap, so the we know what the lowest 
+                     * accumulator in it is */
+                    heap_heapify(heap, heapsize, sizeof(*heap), 
+                      accumulator_cmp);
+                    lowest = heap_peek(heap, heapsize, sizeof(*heap));
+                    lowest_weight = lowest->weight;
+                }
+            } else if (acc->acc[docno] > lowest_weight) {
+                /* replace smallest element in heap with a larger one */
+                tmp.docno = docno;
+                tmp.weight = (float) acc->acc[docno];
+                heap_replace(heap, heapsize, sizeof(*heap), 
+                  accumulator_cmp, &tmp);
+                lowest = heap_peek(heap, heapsize, sizeof(*heap));
+                lowest_weight = lowest->weight;
+            }
+        }
+    }
+
+    assert(j == heapsize);
+
+    /* we now have all of the largest accumulators.  Continue heaping, taking
+     * the smallest element from the back of the array and copying it to the
+     * front. */
+    while (heapsize > 1) {
+        /* note: shrink heapsize by one, copy smallest element into space
+         * we just past */
+        heap_pop(heap, &heapsize, sizeof(*heap), accumulator_cmp);
+    }
+}
+
 /* internal function to select the top len results, starting from startdoc, 
- * into the results array from accumulators, either hashed or in a list. */
-static unsigned int index_heap_select(struct index *idx, 
-  struct index_result *results, unsigned int startdoc, unsigned int len, 
-  struct search_acc_cons *acc, unsigned int accs, struct chash *hashacc) {
+ * from accumulators, either hashed, in an array or in a list.  Returns an array 
+ * (allocated with malloc) of the selected accumulators in order of 
+ * decreasing score, writing their number into *selected, or NULL on 
+ * failure. */
+static struct search_acc *index_heap_select(unsigned int startdoc, 
+  unsigned int len, struct search_acc_cons *acc, unsigned int accs, 
+  struct chash *hashacc, struct denseacc *dense, unsigned int *selected) {
     struct search_acc *heap;
-    unsigned int i,
-                 numdocs = startdoc + len,
+    unsigned int numdocs = startdoc + len,
                  heapsize;
 
+    *selected = 0;
     if (accs <= startdoc) {
         /* not enough accumulators to get to desired result */
-        return 0;
+        numdocs = 0;
     } else if (numdocs > accs) {
         /* not enough accumulators to get all of desired results */
         numdocs = accs;
     }
 
     /* allocate a heap of startdoc + len elements */
-    if (!(heap = malloc(sizeof(*heap) * numdocs))) {
-        return 0;
+    if (!(heap = malloc(sizeof(*heap) * (numdocs ? numdocs : 1)))) {
+        return NULL;
     }
     heapsize = numdocs;
 
-    if (!hashacc) {
+    if (!numdocs) {
+        return heap;
+    } else if (dense) {
+        /* accumulators as array */
+        sort_dense(heap, heapsize, dense);
+    } else if (!hashacc) {
         /* accumulators as list */
         sort_list(heap, heapsize, acc);
     } else {
@@ -239,34 +312,12 @@ static unsigned int index_heap_select(struct index *idx,
         sort_hash(heap, heapsize, hashacc);
     }
 
-    /* copy relevant accumulators into results (this loop form works properly 
-     * if less than startdoc + len documents match the query - think before 
-     * changing it) */ 
-    for (i = startdoc; i < numdocs; i++) {
-        unsigned aux_len = 0;
-        enum docmap_ret ret;
-
-        results[i - startdoc].docno = heap[i].docno;
-        results[i - startdoc].score = heap[i].weight;
-
-        /* lookup document auxilliary */
-        ret = docmap_get_trecno(idx->map, heap[i].docno, 
-          results[i - startdoc].auxilliary, INDEX_AUXILIARYLEN, &aux_len);
-        if (ret != DOCMAP_OK) {
-            return 0;
-        }
-        if (aux_len > INDEX_AUXILIARYLEN) {
-            aux_len = INDEX_AUXILIARYLEN;
-        }
-        results[i - startdoc].auxilliary[aux_len] = '\0';
-
-        /* summary and title provided later */
-        results[i - startdoc].summary[0] = '\0';
-        results[i - startdoc].title[0] = '\0';
-    }
-
-    free(heap);                        /* free heap */
-    return i - startdoc;
+    /* move relevant accumulators to the front (this works properly if less 
+     * than startdoc + len documents match the query - think before changing 
+     * it) */ 
+    *selected = numdocs - startdoc;
+    memmove(heap, heap + startdoc, sizeof(*heap) * *selected);
+    return heap;
 }
 
 /* conjunct processing stuff */
@@ -275,8 +326,10 @@ static unsigned int index_heap_select(struct index *idx,
 struct phrase_pos {
     unsigned long int docno;         /* document number */
     unsigned long int term;          /* term number of start of phrase in doc */
+    unsigned long int pos;           /* offset as stored, tagged with field */
     unsigned long int f_dt;          /* number of occurances left in document */
     unsigned int term_offset;        /* offset of term from start of phrase */
+    unsigned int field_bits;         /* number of bits offsets are tagged with */
     struct vec vec;                  /* currently available vector */
     struct search_list_src *src;     /* list source */
     unsigned int bytes;              /* total size of vector */
@@ -286,19 +339,23 @@ struct phrase_pos {
 };
 
 /* internal function to increment a phrase position to at least minpos offset
- * within mindoc document */
+ * within mindoc document.  If the source doesn't have offsets, minpos must be
+ * 0 */
 static int phrase_inc(struct phrase_pos *pp, unsigned long int mindoc, 
   unsigned long int minpos) {
     unsigned int bytes;
     unsigned long int tmp,
                       tmp2;
     void *startpos = pp->vec.pos;
+    int offsets = pp->src->offsets;
+
+    assert(offsets || !minpos);
 
     /* increment past docs we know we're not interested in */
     while ((pp->docno < mindoc) 
       /* read a docno if we haven't got one yet */
       || (pp->docno == -1)) {
-        if (!pp->f_dt 
+        if (!pp->f_dt || !offsets
           || ((tmp = vec_vbyte_scan(&pp->vec, pp->f_dt, &bytes)) == pp->f_dt)) {
             pp->f_dt = 0;
             startpos = pp->vec.pos;   /* we can start from this point again */
@@ -311,9 +368,10 @@ static int phrase_inc(struct phrase_pos *pp, unsigned long int mindoc,
         assert(!pp->f_dt);
         if (vec_vbyte_read(&pp->vec, &tmp) 
           && vec_vbyte_read(&pp->vec, &pp->f_dt) 
-          && vec_vbyte_read(&pp->vec, &pp->term)) {
+          && (!offsets ? ((pp->pos = 0), 1) 
+            : vec_vbyte_read(&pp->vec, &pp->pos))) {
             assert(pp->f_dt);
-            pp->term += pp->term_offset;
+            pp->term = (pp->pos >> pp->field_bits) + pp->term_offset;
             pp->docno += tmp + 1;        /* + 1 to negate encoding */
             pp->f_dt--;
         } else {
@@ -334,14 +392,15 @@ static int phrase_inc(struct phrase_pos *pp, unsigned long int mindoc,
     while (pp->term < minpos) {
         startpos = pp->vec.pos;
         if (pp->f_dt && vec_vbyte_read(&pp->vec, &tmp)) {
-            pp->term += tmp + 1;    /* + 1 to negate encoding */
+            pp->pos += tmp + 1;    /* + 1 to negate encoding */
+            pp->term = (pp->pos >> pp->field_bits) + pp->term_offset;
             pp->f_dt--;
         } else if (!pp->f_dt && vec_vbyte_read(&pp->vec, &tmp) 
           && vec_vbyte_read(&pp->vec, &tmp2) 
-          && vec_vbyte_read(&pp->vec, &pp->term)) {
+          && vec_vbyte_read(&pp->vec, &pp->pos)) {
             /* skipped to new document, so we're no longer interested in
              * incrementing offsets */
-            pp->term += pp->term_offset;
+            pp->term = (pp->pos >> pp->field_bits) + pp->term_offset;
             pp->docno += tmp + 1;        /* + 1 to negate encoding */
             pp->f_dt = tmp2 - 1;
             return 1;
@@ -460,9 +519,8 @@ static enum search_ret phrase_read(struct phrase_pos *pp) {
 static enum search_ret phrase_write(struct conjunct *conj, struct vec *match, 
   unsigned long int match_docno, unsigned long int *last_docno, 
   unsigned long int f_dt) {
-    /* ensure that we have enough memory to encode match_docno, f_dt and 
-     * offsets */
-    while (VEC_LEN(match) < 2 * VEC_VBYTE_MAX + f_dt) {
+    /* ensure that we have enough memory to encode match_docno and f_dt */
+    while (VEC_LEN(match) < 2 * VEC_VBYTE_MAX) {
         unsigned int pos = match->pos - conj->vecmem;
         unsigned int len = pos + VEC_LEN(match);
         void *ptr = realloc(conj->vecmem, 2 * len);
@@ -481,14 +539,9 @@ static enum search_ret phrase_write(struct conjunct *conj, struct vec *match,
     vec_vbyte_write(match, match_docno - (*last_docno + 1));
     *last_docno = match_docno;
     vec_vbyte_write(match, f_dt);
-    /* just encode 0 offset gaps, as this is easy and we don't need the
-     * offsets anywhere else.  In theory the offsets might be interesting
-     * for phrase matches, but this is complex enough without worrying about
-     * that as well.  We should really produce vectors without offsets, but we
-     * can't handle that yet. */
-    while (f_dt--) {
-        vec_vbyte_write(match, 0);
-    }
+    /* don't encode offsets, as we don't need them anywhere else.  In theory
+     * the offsets might be interesting for phrase matches, but this is
+     * complex enough without worrying about that as well. */
 
     conj->vecsize = match->pos - conj->vecmem;
     return SEARCH_OK;
@@ -523,6 +576,7 @@ static enum search_ret process_conjunct(struct index *idx,
     int (*cmp)(const void *one, const void *two);
     enum search_ret sret;
     struct term *currterm;
+    int positions;                        /* whether word positions needed */
 
 /* macro to perform reads into the phrase position structure buffers */
 #define READ(pp, inmatch, arr)                                                \
@@ -577,6 +631,10 @@ static enum search_ret process_conjunct(struct index *idx,
         return SEARCH_ENOMEM;
     }
 
+    /* AND conjuncts without a cutoff only need document numbers */
+    positions = (conj->type == CONJUNCT_TYPE_PHRASE) 
+      || (conj->cutoff && (conj->cutoff != UINT_MAX));
+
     if (!conj->cutoff) {
         /* translate 0 (no limit) to highest possible number */
         conj->cutoff = UINT_MAX;
@@ -600,8 +658,9 @@ static enum search_ret process_conjunct(struct index *idx,
       i++, currterm = currterm->next) {
         pp[i].f_dt = 0;
         pp[i].docno = -1;   /* note: remove excess + 1 from decoding method */
-        pp[i].term = 0;
+        pp[i].term = pp[i].pos = 0;
         pp[i].term_offset = conj->terms - (i + 1);
+        pp[i].field_bits = idx->field_bits;
         pp[i].bytes = currterm->vocab.size;
         pp[i].slop = conj->sloppiness;
         pp[i].src = NULL;
@@ -623,7 +682,9 @@ static enum search_ret process_conjunct(struct index *idx,
         }
 
         sret = SEARCH_ENOMEM;
-        if ((pp[i].src = search_term_src(idx, pp[i].src_term, alloc, size)) 
+        if ((pp[i].src 
+            = search_term_pos_src(idx, pp[i].src_term, positions, alloc, 
+              size)) 
           && (sret = pp[i].src->reset(pp[i].src->opaque)) == SEARCH_OK) {
             /* read data into the buffer */
             do {
@@ -712,6 +773,23 @@ static enum search_ret process_conjunct(struct index *idx,
 
             /* increment all positions */
             for (i = 0; i < conj->terms; i++) {
+                if (pp[i].src->skip_to && (pp[i].docno < docno)) {
+                    /* skip over blocks of postings before docno */
+                    unsigned long int base = pp[i].docno,
+                                      postings;
+
+                    if ((sret = pp[i].src->skip_to(pp[i].src, docno, &base,
+                        &postings)) != SEARCH_OK) {
+                        phrase_cleanup(pp, conj->terms);
+                        free(conj->vecmem);
+                        conj->vecmem = NULL;
+                        return sret;
+                    } else if (base != pp[i].docno) {
+                        pp[i].docno = base;
+                        pp[i].f_dt = 0;
+                        pp[i].vec.pos = pp[i].vec.end = NULL;
+                    }
+                }
                 while (!phrase_inc(&pp[i], docno, highest->term & and_mask)) {
                     /* need more data */
                     READ(&pp[i], 0, pp);
@@ -790,57 +868,610 @@ struct termsrc {
     struct search_list_src *src;
 };
 
-/* internal function to compare phrase term pointers by frequency/estimated
- * frequency */
-static int loc_cmp(const void *one, const void *two) {
-    const struct termsrc *done = one,
-                         *dtwo = two;
+/* internal function to return the size of the skip table at the start of the
+ * vector for a term */
+static unsigned int term_skipsize(struct term *term) {
+    if (term->vocab.type == VOCAB_VTYPE_DOCWP_SKIP) {
+        return term->vocab.header.docwp_skip.skipsize;
+    } else if ((term->vocab.type == VOCAB_VTYPE_DOCWP_SEP)
+      || (term->vocab.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
+        return term->vocab.header.docwp_sep.skipsize;
+    } else {
+        return 0;
+    }
+}
 
-    /* order terms that have already been read toward the bottom */
-    if (done->term->vecmem || dtwo->term->vecmem) {
-        if (done->term->vecmem) {
-            return 1;
+/* internal function to return the number of bytes at the start of the vector
+ * for a term that have to be read to rank using it (this excludes word
+ * positions that are stored separately) */
+static unsigned int term_listsize(struct term *term) {
+    if ((term->vocab.type == VOCAB_VTYPE_DOCWP_SEP)
+      || (term->vocab.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
+        return term->vocab.header.docwp_sep.skipsize 
+          + term->vocab.header.docwp_sep.docsize;
+    } else {
+        return term->vocab.size;
+    }
+}
+
+/* internal function to return whether the postings of a term are 
+ * interleaved with their word positions */
+static int term_offsets(struct term *term) {
+    return (term->vocab.type != VOCAB_VTYPE_DOCWP_SEP)
+      && (term->vocab.type != VOCAB_VTYPE_DOCWP_BLOCK);
+}
+
+/* internal function to return whether the postings of a term are block 
+ * coded */
+static int term_blocks(struct term *term) {
+    return term->vocab.type == VOCAB_VTYPE_DOCWP_BLOCK;
+}
+
+static struct search_list_src *mapsrc_new(struct index *idx, 
+  unsigned int type, unsigned int fileno, unsigned long int offset, 
+  unsigned int size, unsigned int skipsize, int offsets);
+static struct search_list_src *memsrc_new_from_disk(struct index *idx, 
+  struct term *term, void *mem);
+static int term_parts(struct index *idx, struct term *term);
+
+/* number of bytes of buffer given to each list that has to be read from disk 
+ * during document-at-a-time evaluation */
+#define MAXSCORE_MIN_BUFFER 4096
+
+/* relative tolerance for pruning decisions, to absorb differences in
+ * floating-point rounding between score estimates and final scores */
+#define MAXSCORE_SLACK 1e-4
+
+/* document number that indicates the end of a list */
+#define MAXSCORE_END ULONG_MAX
+
+/* cursor over a single document ordered list for document-at-a-time
+ * evaluation */
+struct maxscore_cursor {
+    struct search_list_src *src;     /* source of list data */
+    struct vec v;                    /* buffered list data */
+    struct blockcodec_block blk;     /* decoded block, for block coded lists */
+    unsigned long int docno;         /* current document number */
+    unsigned long int f_dt;          /* frequency in current document */
+    unsigned int qterm;              /* which query term this list is for */
+    float bound;                     /* upper bound on term contribution */
+};
+
+/* internal function to advance a cursor to the next posting in its list, 
+ * skipping over any offsets.  Sets docno to MAXSCORE_END at the end of the list */
+static enum search_ret maxscore_next(struct maxscore_cursor *cur) {
+    unsigned long int docno_d;
+    unsigned int bytes,
+                 toscan,
+                 scanned;
+    enum search_ret ret;
+
+    /* read d-gap and f_dt, preserving partial reads across buffer loads */
+    while (cur->src->blocks 
+      ? !((cur->blk.pos < cur->blk.n) 
+        || ((cur->blk.pos = 0), 
+          (cur->blk.n = blockcodec_read(&cur->v, cur->blk.ints))))
+      : !(vec_vbyte_read(&cur->v, &docno_d) 
+        && (vec_vbyte_read(&cur->v, &cur->f_dt) 
+          || ((cur->v.pos -= vec_vbyte_len(docno_d)), 0)))) {
+
+        if ((ret = cur->src->readlist(cur->src, VEC_LEN(&cur->v), 
+            (void **) &cur->v.pos, &bytes)) == SEARCH_OK) {
+
+            cur->v.end = cur->v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            cur->docno = MAXSCORE_END;
+            if (!VEC_LEN(&cur->v)) {
+                return SEARCH_FINISH;
+            } else {
+                return SEARCH_EINVAL;
+            }
         } else {
-            return -1;
+            return ret;
         }
     }
+    if (cur->src->blocks) {
+        docno_d = cur->blk.ints[cur->blk.pos++];
+        cur->f_dt = cur->blk.ints[cur->blk.pos++];
+    }
+    cur->docno += docno_d + 1;
 
-    assert(done->term->term.vocab.location == VOCAB_LOCATION_FILE);
-    assert(dtwo->term->term.vocab.location == VOCAB_LOCATION_FILE);
+    /* scan over offsets */
+    toscan = cur->src->offsets ? cur->f_dt : 0;
+    while ((scanned = vec_vbyte_scan(&cur->v, toscan, &scanned)) < toscan) {
+        toscan -= scanned;
+        if ((ret = cur->src->readlist(cur->src, VEC_LEN(&cur->v),
+            (void **) &cur->v.pos, &bytes)) == SEARCH_OK) {
 
-    if (done->term->term.vocab.loc.file.fileno 
-      == dtwo->term->term.vocab.loc.file.fileno) {
-        if (done->term->term.vocab.loc.file.offset 
-          < dtwo->term->term.vocab.loc.file.offset) {
-            return -1;
-        } else if (done->term->term.vocab.loc.file.offset 
-          > dtwo->term->term.vocab.loc.file.offset) {
-            return 1;
+            cur->v.end = cur->v.pos + bytes;
+        } else if (ret == SEARCH_FINISH) {
+            /* shouldn't end while scanning offsets */
+            return SEARCH_EINVAL;
         } else {
-            assert("can't get here" && 0);
-            return 0;
+            return ret;
+        }
+    }
+
+    return SEARCH_OK;
+}
+
+/* internal function to advance a cursor to the first posting with a document
+ * number of at least docno */
+static enum search_ret maxscore_skip(struct maxscore_cursor *cur, 
+  unsigned long int docno) {
+    enum search_ret ret = SEARCH_OK;
+    unsigned long int base = cur->docno,
+                      postings;
+
+    /* skip over whole blocks of postings if the list allows it */
+    if ((cur->docno < docno) && cur->src->skip_to) {
+        if ((ret = cur->src->skip_to(cur->src, docno, &base, &postings))
+          != SEARCH_OK) {
+            return ret;
+        }
+        if (base != cur->docno) {
+            cur->docno = base;
+            cur->v.pos = cur->v.end = NULL;
+            cur->blk.n = cur->blk.pos = 0;
+        }
+    }
+
+    while ((cur->docno < docno) 
+      && ((ret = maxscore_next(cur)) == SEARCH_OK)) ;
+
+    return (ret == SEARCH_FINISH) ? SEARCH_OK : ret;
+}
+
+static int maxscore_bound_cmp(const void *vone, const void *vtwo) {
+    const struct maxscore_cursor * const *one = vone,
+                                 * const *two = vtwo;
+
+    if ((*one)->bound < (*two)->bound) {
+        return -1;
+    } else if ((*one)->bound > (*two)->bound) {
+        return 1;
+    } else {
+        return (*one)->qterm - (*two)->qterm;
+    }
+}
+
+static int acc_docno_cmp(const void *vone, const void *vtwo) {
+    const struct search_acc *one = vone,
+                            *two = vtwo;
+
+    if (one->docno < two->docno) {
+        return -1;
+    } else if (one->docno > two->docno) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* internal function to offer accumulator acc to a heap of the top docs
+ * accumulators, which holds *heapsize of them so far.  Once the heap is full,
+ * *thresh holds the weight an accumulator has to exceed to get into it.
+ * Accumulators are accepted under the same conditions as index_heap_select
+ * accepts them. */
+static void heap_offer(struct search_acc *heap, unsigned int *heapsize,
+  unsigned int docs, const struct search_acc *acc, float *thresh) {
+    struct search_acc *lowest;
+
+    if (*heapsize < docs) {
+        heap[(*heapsize)++] = *acc;
+        if (*heapsize < docs) {
+            return;
         }
+        heap_heapify(heap, docs, sizeof(*heap), accumulator_cmp);
+    } else if (acc->weight > *thresh) {
+        heap_replace(heap, docs, sizeof(*heap), accumulator_cmp, (void *) acc);
     } else {
-        return dtwo->term->term.vocab.loc.file.fileno
-          - done->term->term.vocab.loc.file.fileno;
+        return;
     }
+    lowest = heap_peek(heap, docs, sizeof(*heap));
+    *thresh = lowest->weight;
 }
 
-static int term_cmp(const void *one, const void *two) {
-    const struct termsrc *done = one,
-                         *dtwo = two;
-    return done->term - dtwo->term;
+/* internal function to replace the accumulators in results with the 
+ * heapsize accumulators in heap, in document order */
+static enum search_ret heap_accs(struct search_metric_results *results,
+  struct search_acc *heap, unsigned int heapsize) {
+    unsigned int i;
+
+    qsort(heap, heapsize, sizeof(*heap), acc_docno_cmp);
+    results->acc = NULL;
+    results->accs = 0;
+    for (i = heapsize; i--; ) {
+        struct search_acc_cons *newacc 
+          = objalloc_malloc(results->alloc, sizeof(*newacc));
+
+        if (!newacc) {
+            return SEARCH_ENOMEM;
+        }
+        newacc->acc = heap[i];
+        newacc->next = results->acc;
+        results->acc = newacc;
+        results->accs++;
+    }
+    return SEARCH_OK;
 }
 
-static struct search_list_src *memsrc_new_from_disk(struct index *idx, 
-  unsigned int type, unsigned int fileno, unsigned long int offset, 
-  unsigned int size, void *mem);
+/* internal function to evaluate a query document-at-a-time using the MaxScore
+ * dynamic pruning strategy (Turtle and Flood, 'Query evaluation: strategies
+ * and optimizations', IP&M 1995).  Each list is given an upper bound on its 
+ * contribution, calculated by the metric, and lists are split into
+ * essential lists, which generate candidate documents, and non-essential
+ * lists, whose combined bounds cannot get a document into the top docs
+ * results on their own.  Non-essential lists are only probed for candidate
+ * documents, and candidates are abandoned as soon as they can no longer
+ * reach the top docs.  Documents are accepted under exactly the same
+ * conditions as index_heap_select would accept them from an exhaustively
+ * evaluated accumulator list, so the top docs results are identical.  srcarr
+ * contains sources for lists that have already been read.  Document
+ * exclusion terms remove documents from consideration.  The top accumulators
+ * are left in results in document order. */
+static enum search_ret maxscore_eval(struct index *idx, struct query *query,
+  struct termsrc *srcarr, struct alloc *alloc, unsigned int bufsize,
+  struct search_metric_results *results, unsigned int docs,
+  const struct search_metric *sm, int opts, struct index_search_opt *opt) {
+    struct maxscore_cursor *cursor,      /* cursor for each list */
+                           **order,      /* ranking lists by bound */
+                           **exclude;    /* exclusion lists */
+    struct search_acc *heap;             /* top documents so far */
+    struct search_acc_cons acc;          /* candidate document */
+    double *cum,                         /* cumulative bounds */
+           est,                          /* estimate of candidate score */
+           slack = 0.0;                  /* tolerance in pruning decisions */
+    float *contrib,                      /* contribution of each term */
+          post_bound = 0.0,              /* bound on post-processing */
+          thresh = 0.0;                  /* score of lowest top document */
+    unsigned int i,
+                 j,
+                 terms = 0,              /* number of ranking lists */
+                 excludes = 0,           /* number of exclusion lists */
+                 essential = 0,          /* first essential list in order */
+                 opened = 0,             /* number of cursors opened */
+                 heapsize = 0,
+                 matched = 0;
+    unsigned long int docno;
+    enum search_ret ret = SEARCH_OK;
+
+    cursor = malloc(sizeof(*cursor) * query->terms);
+    order = malloc(sizeof(*order) * query->terms);
+    exclude = malloc(sizeof(*exclude) * query->terms);
+    cum = malloc(sizeof(*cum) * query->terms);
+    contrib = malloc(sizeof(*contrib) * query->terms);
+    heap = malloc(sizeof(*heap) * docs);
+    if (!cursor || !order || !exclude || !cum || !contrib || !heap) {
+        free(cursor);
+        free(order);
+        free(exclude);
+        free(cum);
+        free(contrib);
+        free(heap);
+        return SEARCH_ENOMEM;
+    }
+
+    /* open a cursor for each list, and calculate its bound */
+    for (i = 0; i < query->terms; i++) {
+        struct conjunct *conj = &query->term[i];
+        unsigned long int f_dt_max;
+
+        assert(srcarr[i].term == conj || !srcarr[i].term);
+        cursor[i].qterm = i;
+        cursor[i].v.pos = cursor[i].v.end = NULL;
+        cursor[i].blk.n = cursor[i].blk.pos = 0;
+        cursor[i].docno = SEARCH_DOCNO_START;
+        cursor[i].bound = 0.0;
+        contrib[i] = 0.0;
+        if (!(cursor[i].src = srcarr[i].src) 
+          && !(cursor[i].src 
+            = search_conjunct_src(idx, conj, alloc, bufsize))) {
+            ret = SEARCH_ENOMEM;
+            break;
+        }
+        srcarr[i].src = NULL;
+        opened++;
+
+        if (conj->type == CONJUNCT_TYPE_EXCLUDE) {
+            exclude[excludes++] = &cursor[i];
+        } else {
+            /* no document can contain the term more often than all of the
+             * occurrances left over after every other document that 
+             * contains it has one */
+            f_dt_max = conj->F_t;
+            if (conj->F_t >= conj->f_t) {
+                f_dt_max = conj->F_t - conj->f_t + 1;
+            }
+            /* but if the vocab records the largest f_dt, that's tighter */
+            if ((conj->type == CONJUNCT_TYPE_WORD) && conj->f_dt_max
+              && (conj->f_dt_max < f_dt_max)) {
+                f_dt_max = conj->f_dt_max;
+            }
+            if ((ret = sm->bound(idx, query, i, f_dt_max, &cursor[i].bound, 
+                opts, opt)) != SEARCH_OK) {
+                break;
+            }
+            slack += fabs(cursor[i].bound);
+            order[terms++] = &cursor[i];
+        }
+
+        if (((ret = maxscore_next(&cursor[i])) != SEARCH_OK) 
+          && (ret != SEARCH_FINISH)) {
+            break;
+        }
+        ret = SEARCH_OK;
+    }
+
+    if ((ret == SEARCH_OK) && sm->post_bound) {
+        ret = sm->post_bound(idx, query, &post_bound, opts, opt);
+    }
+
+    if (ret == SEARCH_OK) {
+        /* order lists by increasing bound and accumulate bounds */
+        qsort(order, terms, sizeof(*order), maxscore_bound_cmp);
+        for (j = 0; j < terms; j++) {
+            cum[j] = (j ? cum[j - 1] : post_bound) + order[j]->bound;
+        }
+        slack = MAXSCORE_SLACK * (slack + fabs(post_bound));
+    }
+
+    while (ret == SEARCH_OK) {
+        /* find the next candidate from the essential lists */
+        docno = MAXSCORE_END;
+        for (j = essential; j < terms; j++) {
+            if (order[j]->docno < docno) {
+                docno = order[j]->docno;
+            }
+        }
+        if (docno == MAXSCORE_END) {
+            break;
+        }
+        matched++;
+
+        /* score essential lists */
+        est = essential ? cum[essential - 1] : post_bound;
+        for (j = essential; (j < terms) && (ret == SEARCH_OK); j++) {
+            if (order[j]->docno == docno) {
+                acc.acc.docno = docno;
+                acc.acc.weight = 0.0;
+                if ((ret = sm->score(idx, query, order[j]->qterm, &acc, 
+                    order[j]->f_dt, opts, opt)) == SEARCH_OK) {
+
+                    contrib[order[j]->qterm] = acc.acc.weight;
+                    est += acc.acc.weight;
+                    if ((ret = maxscore_next(order[j])) == SEARCH_FINISH) {
+                        ret = SEARCH_OK;
+                    }
+                }
+            }
+        }
+
+        /* probe non-essential lists, largest bound first, while the 
+         * candidate can still make it into the top documents */
+        for (j = essential; (ret == SEARCH_OK) && j--; ) {
+            if ((heapsize == docs) && (est + slack <= thresh)) {
+                break;
+            }
+
+            est -= order[j]->bound;
+            if ((ret = maxscore_skip(order[j], docno)) == SEARCH_OK
+              && (order[j]->docno == docno)) {
+                acc.acc.docno = docno;
+                acc.acc.weight = 0.0;
+                if ((ret = sm->score(idx, query, order[j]->qterm, &acc, 
+                    order[j]->f_dt, opts, opt)) == SEARCH_OK) {
+
+                    contrib[order[j]->qterm] = acc.acc.weight;
+                    est += acc.acc.weight;
+                }
+            }
+        }
+
+        /* check exclusion lists for every candidate, so that excluded 
+         * documents aren't counted as results either */
+        for (j = 0; (j < excludes) && (ret == SEARCH_OK); j++) {
+            if (((ret = maxscore_skip(exclude[j], docno)) == SEARCH_OK)
+              && (exclude[j]->docno == docno)) {
+                break;
+            }
+        }
+
+        if ((ret == SEARCH_OK) && (j < excludes)) {
+            matched--;
+        } else if ((ret == SEARCH_OK) 
+          && ((heapsize < docs) || (est + slack > thresh))) {
+            /* calculate the final score, adding contributions in the 
+             * same order as term-at-a-time evaluation */
+            acc.next = NULL;
+            acc.acc.docno = docno;
+            acc.acc.weight = 0.0;
+            for (i = 0; i < query->terms; i++) {
+                acc.acc.weight += contrib[i];
+            }
+            if (sm->post) {
+                ret = sm->post(idx, query, &acc, opts, opt);
+            }
+
+            if (ret == SEARCH_OK) {
+                heap_offer(heap, &heapsize, docs, &acc.acc, &thresh);
+            }
+
+            if ((ret == SEARCH_OK) && (heapsize == docs)) {
+                /* lists whose combined bounds can't beat the threshold
+                 * become non-essential */
+                while ((essential < terms) 
+                  && (cum[essential] + slack <= thresh)) {
+                    essential++;
+                }
+            }
+        }
+
+        /* clear contributions for next candidate */
+        for (j = 0; j < terms; j++) {
+            contrib[order[j]->qterm] = 0.0;
+        }
+    }
+
+    if ((ret == SEARCH_OK) 
+      /* return top documents as accumulators in document order */
+      && ((ret = heap_accs(results, heap, heapsize)) == SEARCH_OK)) {
+        /* documents that only occur in non-essential lists weren't counted */
+        results->total_results = matched;
+        results->estimated = (essential > 0);
+    }
+
+    for (j = 0; j < opened; j++) {
+        cursor[j].src->delet(cursor[j].src);
+    }
+    free(cursor);
+    free(order);
+    free(exclude);
+    free(cum);
+    free(contrib);
+    free(heap);
+    return ret;
+}
+
+/* internal function to evaluate a query term-at-a-time into dense
+ * accumulators.  Ranking lists are decoded in OR mode and then exclusion
+ * lists in AND mode, as doc_ord_eval does when all lists fit under the
+ * accumulator limit.  Accumulators are then post-processed a page at a time,
+ * and offered to a heap of the top docs accumulators in document order, so
+ * that neither a list of every accumulator nor a sort of them is needed.  The
+ * heap accepts accumulators under the same conditions as index_heap_select,
+ * so the results are identical to those from an accumulator list.  srcarr
+ * contains sources for lists that have already been read.  The top
+ * accumulators are left in results in document order. */
+static enum search_ret dense_eval(struct index *idx, struct query *query,
+  struct termsrc *srcarr, struct alloc *alloc, 
+  struct poolalloc *list_alloc, unsigned int list_mem_limit, 
+  struct search_metric_results *results, unsigned int docs,
+  const struct search_metric *sm, int opts, struct index_search_opt *opt) {
+    struct search_acc_cons *batch;       /* accumulators from one page */
+    struct search_acc *heap;             /* top documents so far */
+    struct search_acc_page *page;
+    struct search_list_src *src;
+    unsigned long int pages,             /* number of pages in the table */
+                      p;
+    unsigned int i,
+                 j,
+                 n,
+                 heapsize = 0;
+    float thresh = 0.0;                  /* weight to beat to enter heap */
+    int exclude;
+    enum search_ret ret = SEARCH_OK;
+
+    pages = docmap_entries(idx->map) / SEARCH_DENSE_PAGE + 1;
+    results->dense = calloc(pages, sizeof(*results->dense));
+    heap = malloc(sizeof(*heap) * docs);
+    batch = malloc(sizeof(*batch) * SEARCH_DENSE_PAGE);
+    if (!results->dense || !heap || !batch) {
+        free(results->dense);
+        results->dense = NULL;
+        free(heap);
+        free(batch);
+        return SEARCH_ENOMEM;
+    }
+
+    for (exclude = 0; exclude < 2; exclude++) {
+        for (i = 0; (i < query->terms) && (ret == SEARCH_OK); i++) {
+            if ((query->term[i].type == CONJUNCT_TYPE_EXCLUDE) != exclude) {
+                continue;
+            }
+
+            assert(srcarr[i].term == &query->term[i] || !srcarr[i].term);
+            if ((src = srcarr[i].src) 
+              || (src = search_conjunct_src(idx, &query->term[i], alloc, 
+                  list_mem_limit))) {
+                srcarr[i].src = NULL;
+                if (exclude) {
+                    ret = sm->dense_and_decode(idx, query, i, 
+                        SEARCH_DOCNO_START, results, src, opts, opt);
+                } else {
+                    ret = sm->dense_or_decode(idx, query, i, 
+                        SEARCH_DOCNO_START, results, src, opts, opt);
+                }
+                src->delet(src);
+            } else {
+                ret = SEARCH_ENOMEM;
+            }
+
+            /* reuse list memory once no lists read earlier are left in it */
+            for (j = 0; (j < query->terms) && !srcarr[j].src; j++) ;
+            if (list_alloc && (j == query->terms)) {
+                poolalloc_clear(list_alloc);
+            }
+        }
+    }
+
+    for (p = 0; p < pages; p++) {
+        if (!(page = results->dense[p])) {
+            continue;
+        }
+
+        if (ret == SEARCH_OK) {
+            /* link the accumulators in this page into a list, so that they
+             * can be post-processed together */
+            for (i = 0, n = 0; i < SEARCH_DENSE_PAGE; i++) {
+                if (!page->used[i >> 3]) {
+                    i += 7;
+                } else if (page->used[i >> 3] & (1 << (i & 7))) {
+                    batch[n].acc.docno = p * SEARCH_DENSE_PAGE + i;
+                    batch[n].acc.weight = page->weight[i];
+                    batch[n].next = &batch[n + 1];
+                    n++;
+                }
+            }
+            if (n) {
+                batch[n - 1].next = NULL;
+            }
+
+            if (n && (!sm->post 
+                || (ret = sm->post(idx, query, batch, opts, opt)) 
+                  == SEARCH_OK)) {
+                for (i = 0; i < n; i++) {
+                    heap_offer(heap, &heapsize, docs, &batch[i].acc, &thresh);
+                }
+            }
+        }
+
+        free(page);
+    }
+    free(results->dense);
+    results->dense = NULL;
+    free(batch);
+
+    if (ret == SEARCH_OK) {
+        ret = heap_accs(results, heap, heapsize);
+    }
+    free(heap);
+    return ret;
+}
+
+/* internal function to remove superfluous significant digits from an 
+ * estimated number of results */
+static void estimate_round(struct search_metric_results *results) {
+    if (results->estimated) {
+        unsigned int lg 
+          = (unsigned int) ceil(log10(results->total_results));
+
+        /* remove superfluous significant digits from the estimate */
+        if (lg > RESULTS_SIGDIGITS) {
+            results->total_results = ((unsigned int) (results->total_results 
+              / pow(10, lg - RESULTS_SIGDIGITS))) 
+                * pow(10, lg - RESULTS_SIGDIGITS);
+        }
+    }
+}
 
 /* internal function to evaluate a query structure using document ordered
- * inverted lists and place the results into an accumulator linked list */
+ * inverted lists and place the results into an accumulator linked list.  docs
+ * is the number of top documents that the caller will select from the 
+ * accumulators */
 enum search_ret doc_ord_eval(struct index *idx, struct query *query,
   struct poolalloc *list_alloc, unsigned int list_mem_limit,
-  struct search_metric_results *results,
+  struct search_metric_results *results, unsigned long int docs,
   int opts, struct index_search_opt *opt) {
     unsigned int i,
                  small,
@@ -853,6 +1484,8 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
     int (*selectivity_cmp)(const void *one, const void *two) = f_t_cmp;
     struct termsrc *srcarr = malloc(sizeof(*srcarr) * query->terms);
     struct index_search_opt spareopt;
+    int prunable = 0;                 /* whether metric supports pruning */
+    double postings;                  /* total number of postings */
 
     if (!srcarr) {
         return SEARCH_ENOMEM;
@@ -865,19 +1498,25 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
     if (opts & INDEX_SEARCH_DIRICHLET_RANK) {
         selectivity_cmp = F_t_cmp;
         sm = dirichlet();
+        prunable = 1;
     } else if (opts & INDEX_SEARCH_OKAPI_RANK) {
         sm = okapi_k3();
+        prunable = 1;
     } else if (opts & INDEX_SEARCH_PCOSINE_RANK) {
         sm = pcosine();
     } else if (opts & INDEX_SEARCH_COSINE_RANK) {
         sm = cosine();
     } else if (opts & INDEX_SEARCH_HAWKAPI_RANK) {
         sm = hawkapi();
+    } else if (opts & INDEX_SEARCH_BM25F_RANK) {
+        /* not prunable, as its bounds don't account for field lengths */
+        sm = bm25f();
     } else {
         /* default is dirichlet with mu = 1500.  Fiddle with opt structure to
          * ensure everything works ok even if people pass a NULL */
         selectivity_cmp = F_t_cmp;
         sm = dirichlet();
+        prunable = 1;
         if (!opt) {
             opt = &spareopt;
             opts |= INDEX_SEARCH_DIRICHLET_RANK;
@@ -899,10 +1538,11 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
         srcarr[small].src = NULL;
         if (query->term[small].type == CONJUNCT_TYPE_WORD 
           && query->term[small].term.vocab.location == VOCAB_LOCATION_FILE) {
-            if (memsum + query->term[small].term.vocab.size > list_mem_limit) {
+            if (memsum + term_listsize(&query->term[small].term) 
+              > list_mem_limit) {
                 break;
             }
-            memsum += query->term[small].term.vocab.size;
+            memsum += term_listsize(&query->term[small].term);
             fprintf(stderr, "AYXX: vocabsize[%d]: %d, memsum: %d\n", small, query->term[small].term.vocab.size, memsum);
         }
     }
@@ -915,23 +1555,35 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
         srcarr[i].src = NULL;
     }
 
-    /* sort small vectors by disk location */
-    qsort(srcarr, small, sizeof(*srcarr), loc_cmp);
-
-    /* read them all off of disk, in location order.  This speeds disk transfer,
-     * by minimising the amount of seeking that needs to be done. */
+    /* create sources for them.  Reading of all of the lists has already been
+     * started (in disk location order, to minimise seeking) by 
+     * prefetch_lists, and each source reads its list in the first time it's
+     * used, so that we can start on the first list while the rest are still
+     * arriving.  Lists in memory-mapped files don't need to be read at 
+     * all. */
     for (i = 0; i < small; i++) {
         void *mem;
 
+        /* lists with postings in segments or still in memory are left for 
+         * search_conjunct_src, which appends them */
+        if (term_parts(idx, &srcarr[i].term->term)) {
+            continue;
+        }
+
         if ((srcarr[i].term->type == CONJUNCT_TYPE_WORD)
           && (srcarr[i].term->term.vocab.location == VOCAB_LOCATION_FILE)
-          && (mem 
-            = poolalloc_malloc(list_alloc, srcarr[i].term->term.vocab.size))
-          && (srcarr[i].src = memsrc_new_from_disk(idx, idx->index_type, 
+          && ((srcarr[i].src = mapsrc_new(idx, idx->index_type, 
               srcarr[i].term->term.vocab.loc.file.fileno, 
               srcarr[i].term->term.vocab.loc.file.offset, 
-              srcarr[i].term->term.vocab.size, mem))) {
-            /* succeeded, do nothing */
+              term_listsize(&srcarr[i].term->term), 
+              term_skipsize(&srcarr[i].term->term), 
+              term_offsets(&srcarr[i].term->term)))
+            || ((mem = poolalloc_malloc(list_alloc, 
+                term_listsize(&srcarr[i].term->term)))
+              && (srcarr[i].src = memsrc_new_from_disk(idx, 
+                  &srcarr[i].term->term, mem))))) {
+            /* succeeded, note how the postings are coded */
+            srcarr[i].src->blocks = term_blocks(&srcarr[i].term->term);
         } else if ((srcarr[i].term->type == CONJUNCT_TYPE_WORD)
           && (srcarr[i].term->term.vocab.location == VOCAB_LOCATION_FILE)) {
             /* failed to allocate or read new source */
@@ -942,14 +1594,58 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
         }
     }
 
-    /* sort by term again */
-    qsort(srcarr, small, sizeof(*srcarr), term_cmp);
+    /* evaluate document-at-a-time if we've been asked to prune and the 
+     * metric's post-processing is additive, so that bounds are valid */
+    if ((opts & INDEX_SEARCH_PRUNE) && prunable && docs) {
+        unsigned int bufsize = MAXSCORE_MIN_BUFFER;
+
+        if ((query->terms > small) && (list_mem_limit > memsum) 
+          && ((list_mem_limit - memsum) / (query->terms - small) 
+            > bufsize)) {
+            bufsize = (list_mem_limit - memsum) / (query->terms - small);
+        }
+
+        ret = maxscore_eval(idx, query, srcarr, &alloc, bufsize, results, 
+            docs, sm, opts, opt);
+        for (i = 0; i < query->terms; i++) {
+            if (srcarr[i].src) {
+                srcarr[i].src->delet(srcarr[i].src);
+            }
+        }
+        free(srcarr);
+        if (ret == SEARCH_OK) {
+            estimate_round(results);
+        }
+        return ret;
+    }
+
+    /* evaluate into dense accumulators if every list will be processed in OR
+     * mode, and there may be accumulators for a large proportion of the
+     * collection */
+    for (i = 0, postings = 0.0; i < query->terms; i++) {
+        postings += query->term[i].f_t;
+    }
+    if (docs && !results->accs && (postings < results->acc_limit) 
+      && (postings >= docmap_entries(idx->map) / SEARCH_DENSE_RATIO)) {
+        ret = dense_eval(idx, query, srcarr, &alloc, list_alloc, 
+            list_mem_limit, results, docs, sm, opts, opt);
+        for (i = 0; i < query->terms; i++) {
+            if (srcarr[i].src) {
+                srcarr[i].src->delet(srcarr[i].src);
+            }
+        }
+        free(srcarr);
+        if (ret == SEARCH_OK) {
+            estimate_round(results);
+        }
+        return ret;
+    }
 
     /* process terms that have no chance of overflowing the accumulator limit 
      * in OR mode */
     for (i = 0; (i < query->terms) 
         && (results->accs + query->term[i].f_t < results->acc_limit); i++) {
-        if (srcarr[i].term->type == CONJUNCT_TYPE_EXCLUDE) { 
+        if (query->term[i].type == CONJUNCT_TYPE_EXCLUDE) { 
             continue;
         }
 
@@ -988,7 +1684,7 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
     fprintf(stderr, "AYXX: searching in THRESH mode\n");
     ret = SEARCH_OK;
     for (; (i < query->terms) && (ret == SEARCH_OK); i++) {
-        if (srcarr[i].term->type == CONJUNCT_TYPE_EXCLUDE) { 
+        if (query->term[i].type == CONJUNCT_TYPE_EXCLUDE) { 
             continue;
         }
         /* don't perform thresholding for a small number of 
@@ -1031,7 +1727,7 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
     fprintf(stderr, "AYXX: searching in AND mode\n");
     for (; i < query->terms; i++) {
         assert(srcarr[i].term == &query->term[i] || !srcarr[i].term);
-        if (srcarr[i].term->type == CONJUNCT_TYPE_EXCLUDE) { 
+        if (query->term[i].type == CONJUNCT_TYPE_EXCLUDE) { 
             continue;
         }
         if (((src = srcarr[i].src) 
@@ -1059,11 +1755,11 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
     fprintf(stderr, "AYXX: remaining...\n");
     for (i=0; i < query->terms; i++) {
         assert(srcarr[i].term == &query->term[i] || !srcarr[i].term);
-        if (srcarr[i].term->type != CONJUNCT_TYPE_EXCLUDE) { 
-            fprintf(stderr, "AYXX: normal term: %s\n", srcarr[i].term->term.term);
+        if (query->term[i].type != CONJUNCT_TYPE_EXCLUDE) { 
+            fprintf(stderr, "AYXX: normal term: %s\n", query->term[i].term.term);
             continue;
         }
-        fprintf(stderr, "AYXX: exclude term: %s\n", srcarr[i].term->term.term);
+        fprintf(stderr, "AYXX: exclude term: %s\n", query->term[i].term.term);
         if (((src = srcarr[i].src) 
             || (src 
               = search_conjunct_src(idx, &query->term[i], &alloc, 
@@ -1094,58 +1790,395 @@ enum search_ret doc_ord_eval(struct index *idx, struct query *query,
         return ret;
     }
 
-    if (results->estimated) {
-        unsigned int lg 
-          = (unsigned int) ceil(log10(results->total_results));
-
-        /* remove superfluous significant digits from the estimate */
-        if (lg > RESULTS_SIGDIGITS) {
-            results->total_results = ((unsigned int) (results->total_results 
-              / pow(10, lg - RESULTS_SIGDIGITS))) 
-                * pow(10, lg - RESULTS_SIGDIGITS);
-        }
-    }
+    estimate_round(results);
 
     return SEARCH_OK;
 }
 
-static int res_docno_cmp(const void *vone, const void *vtwo) {
-    const struct index_result *one = vone, 
-                              *two = vtwo;
+/* search results in the compact form that they're produced in, and kept in
+ * the result cache.  This header is followed by an array of results, which
+ * is followed by the text of their fields, in order (each NUL-terminated). */
+struct packed_results {
+    double total_results;            /* estimated number of results */
+    int est;                         /* whether total_results (or the results
+                                      * themselves) are estimated, as enum
+                                      * index_search_est bits */
+    unsigned int results;            /* number of results following */
+    unsigned int fields;             /* fields (enum index_result_fields) 
+                                      * that results have */
+    int cached;                      /* whether they're pinned in the result 
+                                      * cache, rather than owned by search */
+};
 
-    if (one->docno < two->docno) {
+struct packed_result {
+    unsigned long int docno;         /* document number */
+    float score;                     /* score of the document */
+    unsigned int aux_len;            /* length of auxilliary field */
+    unsigned int title_len;          /* length of title */
+    unsigned int summary_len;        /* length of summary */
+};
+
+static int acc_ptr_docno_cmp(const void *vone, const void *vtwo) {
+    const struct search_acc *const *one = vone, 
+                            *const *two = vtwo;
+
+    if ((*one)->docno < (*two)->docno) {
         return -1;
-    } else if (one->docno > two->docno) {
+    } else if ((*one)->docno > (*two)->docno) {
         return 1;
     } else {
         return 0;
     }
 }
 
-static int res_score_cmp(const void *vone, const void *vtwo) {
-    const struct index_result *one = vone, 
-                              *two = vtwo;
+/* results being summarised, possibly by many threads at once */
+struct summary_work {
+    struct index *idx;               /* index being searched */
+    const struct query *query;       /* query to bias summaries toward */
+    enum index_summary_type type;    /* type of summaries */
+    const struct search_acc *sel;    /* selected results */
+    const struct search_acc **order; /* selected results, by docno */
+    unsigned int n;                  /* number of selected results */
+    char *scratch;                   /* slots to summarise into */
+    unsigned int slot;               /* size of each slot */
+    unsigned int titleoff;           /* offset of title in slot */
+    unsigned int summaryoff;         /* offset of summary in slot */
+    unsigned int next;               /* next result (in order) to summarise */
+#ifdef MT_ZET
+    pthread_mutex_t mutex;           /* protects next */
+#endif /* MT_ZET */
+};
 
-    /* note reverse sorting */
-    if (one->score < two->score) {
-        return 1;
-    } else if (one->score > two->score) {
-        return -1;
+/* internal function to summarise results from work until there are none 
+ * left, using a summariser of its own (other searches and threads may be 
+ * summarising at the same time).  Has the signature of a thread function. */
+static void *summarise_work(void *opaque) {
+    struct summary_work *work = opaque;
+    struct summarise *sum;
+    struct summary summary;
+    unsigned int i;
+    char *pos;
+
+    if (!(sum = index_summarise_get(work->idx))) {
+        ERROR("obtaining summarisation object");
+        return NULL;
+    }
+
+    while (1) {
+#ifdef MT_ZET
+        pthread_mutex_lock(&work->mutex);
+#endif /* MT_ZET */
+        i = work->next;
+        if (i < work->n) {
+            work->next++;
+        }
+#ifdef MT_ZET
+        pthread_mutex_unlock(&work->mutex);
+#endif /* MT_ZET */
+        if (i >= work->n) {
+            break;
+        }
+
+        pos = work->scratch + (work->order[i] - work->sel) * work->slot;
+        summary.summary = pos + work->summaryoff;
+        summary.summary_len = INDEX_SUMMARYLEN;
+        summary.title = pos + work->titleoff;
+        summary.title_len = INDEX_TITLELEN;
+
+        if (summarise(sum, work->order[i]->docno, work->query, work->type, 
+            &summary) != SUMMARISE_OK) {
+
+            ERROR1("creating summary for document %ul", 
+              work->order[i]->docno);
+        }
+    }
+
+    index_summarise_put(work->idx, sum);
+    return NULL;
+}
+
+/* internal function to summarise the results in work, on up to threads 
+ * threads (including this one) */
+static void summarise_results(struct summary_work *work, 
+  unsigned int threads) {
+#ifdef MT_ZET
+    pthread_t *thread = NULL;
+    unsigned int i,
+                 started = 0;
+
+    if (threads > work->n) {
+        threads = work->n;
+    }
+    pthread_mutex_init(&work->mutex, NULL);
+    if ((threads > 1) && (thread = malloc(sizeof(*thread) * (threads - 1)))) {
+        for (started = 0; started < threads - 1 
+          && !pthread_create(&thread[started], NULL, summarise_work, work); 
+          started++) ;
+    }
+#endif /* MT_ZET */
+
+    summarise_work(work);
+
+#ifdef MT_ZET
+    for (i = 0; i < started; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    if (thread) {
+        free(thread);
+    }
+    pthread_mutex_destroy(&work->mutex);
+#endif /* MT_ZET */
+}
+
+/* internal function to look up the fields requested of results (sel, an 
+ * array of n accumulators) for query and pack them, allocated with 
+ * cache_alloc.  Summaries are produced on up to threads threads.  Returns 
+ * NULL on failure. */
+static struct packed_results *pack_results(struct index *idx, 
+  const struct query *query, const struct search_acc *sel, unsigned int n,
+  unsigned int fields, enum index_summary_type summary_type, 
+  unsigned int threads) {
+    struct packed_results *packed;
+    struct packed_result *res;
+    struct summary_work work;
+    char *scratch = NULL,
+         *text;
+    unsigned int i,
+                 len,
+                 slot = 0,           /* space for the fields of a result */
+                 titleoff = 0,       /* offset of title in slot */
+                 summaryoff = 0;     /* offset of summary in slot */
+    unsigned long int textlen = 0;
+
+    /* look the fields up into fixed-size slots first, since we don't know 
+     * how long they are */
+    if (fields & INDEX_RESULT_AUX) {
+        slot += INDEX_AUXILIARYLEN + 1;
+    }
+    if (fields & (INDEX_RESULT_TITLE | INDEX_RESULT_SUMMARY)) {
+        titleoff = slot;
+        summaryoff = titleoff + INDEX_TITLELEN + 1;
+        slot = summaryoff + INDEX_SUMMARYLEN + 1;
+    }
+    if (slot && n && !(scratch = malloc(slot * n))) {
+        return NULL;
+    }
+
+    if (fields & INDEX_RESULT_AUX) {
+        for (i = 0; i < n; i++) {
+            len = 0;
+            if (docmap_get_trecno(idx->map, sel[i].docno, scratch + i * slot,
+                INDEX_AUXILIARYLEN, &len) != DOCMAP_OK) {
+                free(scratch);
+                return NULL;
+            }
+            if (len > INDEX_AUXILIARYLEN) {
+                len = INDEX_AUXILIARYLEN;
+            }
+            scratch[i * slot + len] = '\0';
+        }
+    }
+
+    if (fields & (INDEX_RESULT_TITLE | INDEX_RESULT_SUMMARY)) {
+        for (i = 0; i < n; i++) {
+            scratch[i * slot + titleoff] = '\0';
+            scratch[i * slot + summaryoff] = '\0';
+        }
+
+        /* summarise the results in order of docno, which sorts them by 
+         * repository location */
+        if (n && !(work.order = malloc(sizeof(*work.order) * n))) {
+            free(scratch);
+            return NULL;
+        } else if (n) {
+            for (i = 0; i < n; i++) {
+                work.order[i] = &sel[i];
+            }
+            qsort(work.order, n, sizeof(*work.order), acc_ptr_docno_cmp);
+
+            work.idx = idx;
+            work.query = query;
+            work.type = summary_type;
+            work.sel = sel;
+            work.n = n;
+            work.scratch = scratch;
+            work.slot = slot;
+            work.titleoff = titleoff;
+            work.summaryoff = summaryoff;
+            work.next = 0;
+            summarise_results(&work, threads);
+            free(work.order);
+        }
+    }
+
+    /* work out how much text there is, and pack it up */
+    for (i = 0; i < n; i++) {
+        if (fields & INDEX_RESULT_AUX) {
+            textlen += str_len(scratch + i * slot) + 1;
+        }
+        if (fields & INDEX_RESULT_TITLE) {
+            textlen += str_len(scratch + i * slot + titleoff) + 1;
+        }
+        if (fields & INDEX_RESULT_SUMMARY) {
+            textlen += str_len(scratch + i * slot + summaryoff) + 1;
+        }
+    }
+
+    if (!(packed = cache_alloc(sizeof(*packed) + sizeof(*res) * n 
+        + textlen))) {
+        if (scratch) {
+            free(scratch);
+        }
+        return NULL;
+    }
+    packed->results = n;
+    packed->fields = fields;
+    packed->cached = 0;
+    res = (struct packed_result *) (packed + 1);
+    text = (char *) (res + n);
+
+    for (i = 0; i < n; i++) {
+        res[i].docno = sel[i].docno;
+        res[i].score = sel[i].weight;
+        res[i].aux_len = res[i].title_len = res[i].summary_len = 0;
+        if (fields & INDEX_RESULT_AUX) {
+            res[i].aux_len = str_len(scratch + i * slot);
+            memcpy(text, scratch + i * slot, res[i].aux_len + 1);
+            text += res[i].aux_len + 1;
+        }
+        if (fields & INDEX_RESULT_TITLE) {
+            res[i].title_len = str_len(scratch + i * slot + titleoff);
+            memcpy(text, scratch + i * slot + titleoff, res[i].title_len + 1);
+            text += res[i].title_len + 1;
+        }
+        if (fields & INDEX_RESULT_SUMMARY) {
+            res[i].summary_len = str_len(scratch + i * slot + summaryoff);
+            memcpy(text, scratch + i * slot + summaryoff, 
+              res[i].summary_len + 1);
+            text += res[i].summary_len + 1;
+        }
+    }
+    assert(text == (char *) (res + n) + textlen);
+
+    if (scratch) {
+        free(scratch);
+    }
+    return packed;
+}
+
+/* internal function to point hit at packed result res, the text of which 
+ * starts at *text (advancing *text past it) */
+static void unpack_result(const struct packed_results *packed,
+  const struct packed_result *res, const char **text, struct index_hit *hit) {
+    hit->docno = res->docno;
+    hit->score = res->score;
+    hit->aux = hit->title = hit->summary = NULL;
+    hit->aux_len = res->aux_len;
+    hit->title_len = res->title_len;
+    hit->summary_len = res->summary_len;
+    if (packed->fields & INDEX_RESULT_AUX) {
+        hit->aux = *text;
+        *text += res->aux_len + 1;
+    }
+    if (packed->fields & INDEX_RESULT_TITLE) {
+        hit->title = *text;
+        *text += res->title_len + 1;
+    }
+    if (packed->fields & INDEX_RESULT_SUMMARY) {
+        hit->summary = *text;
+        *text += res->summary_len + 1;
+    }
+}
+
+/* extent of an inverted list on disk */
+struct prefetch_extent {
+    unsigned int fileno;                 /* number of file it's in */
+    unsigned long int offset;            /* offset of the list in file */
+    unsigned int len;                    /* number of bytes to read */
+};
+
+static int prefetch_extent_cmp(const void *vone, const void *vtwo) {
+    const struct prefetch_extent *one = vone,
+                                 *two = vtwo;
+
+    if (one->fileno != two->fileno) {
+        return one->fileno < two->fileno ? -1 : 1;
+    } else if (one->offset != two->offset) {
+        return one->offset < two->offset ? -1 : 1;
     } else {
         return 0;
     }
 }
 
-int index_search(struct index *idx, const char *querystr, 
-  unsigned long int startdoc, unsigned long int len, 
-  struct index_result *result, unsigned int *results, 
-  double *total_results, int *tr_est, int opts, struct index_search_opt *opt) {
+/* internal function to start reading all of the (at most mem bytes of each)
+ * inverted lists that the query needs from disk, in the order they're stored,
+ * so that the disk can fetch them in one sweep while we evaluate the query.
+ * This is purely advisory, and so has no failure conditions. */
+static void prefetch_lists(struct index *idx, struct query *query, 
+  unsigned int mem) {
+    struct prefetch_extent *ext;
+    struct term *term;
+    unsigned int i,
+                 j,
+                 lists = 0;
+
+    for (i = 0; i < query->terms; i++) {
+        for (term = &query->term[i].term; term; term = term->next) {
+            lists++;
+        }
+    }
+
+    /* there's nothing to order with less than two lists */
+    if ((lists < 2) || !(ext = malloc(sizeof(*ext) * lists))) {
+        return;
+    }
+
+    for (lists = 0, i = 0; i < query->terms; i++) {
+        for (term = &query->term[i].term; term; term = term->next) {
+            if (term->vocab.location == VOCAB_LOCATION_FILE) {
+                ext[lists].fileno = term->vocab.loc.file.fileno;
+                ext[lists].offset = term->vocab.loc.file.offset;
+                /* phrases need word positions as well as postings */
+                if ((query->term[i].type == CONJUNCT_TYPE_WORD)
+                  || (query->term[i].type == CONJUNCT_TYPE_EXCLUDE)) {
+                    ext[lists].len = term_listsize(term);
+                } else {
+                    ext[lists].len = term->vocab.size;
+                }
+                if (ext[lists].len > mem) {
+                    ext[lists].len = mem;
+                }
+                lists++;
+            }
+        }
+    }
+
+    qsort(ext, lists, sizeof(*ext), prefetch_extent_cmp);
+    for (j = 0; j < lists; j++) {
+        fdset_willneed(idx->fd, idx->index_type, ext[j].fileno, 
+          ext[j].offset, ext[j].len);
+    }
+    free(ext);
+}
+
+/* internal function to evaluate a search, with parameters as for 
+ * index_search_results, returning the fields requested of the results in 
+ * packed form (allocated with cache_alloc), or NULL on failure */
+static struct packed_results *search_uncached(struct index *idx, 
+  const char *querystr, unsigned long int startdoc, unsigned long int len, 
+  unsigned int fields, int opts, struct index_search_opt *opt) {
     struct query query;                  /* list of query terms/phrases */
+    struct packed_results *packed = NULL;/* results found */
+    struct search_acc *sel = NULL;       /* selected accumulators */
+    unsigned int selected = 0;           /* number of them */
+    double total_results = 0.0;          /* total number of results */
+    int tr_est = 0;                      /* whether total is estimated */
     struct objalloc *acc_alloc;          /* allocator for accumulators */
     struct alloc list_alloc;             /* memory allocator for query 
                                           * resolution */
     struct search_acc_cons *acc = NULL;  /* accumulators */
     struct chash *hashacc = NULL;        /* hashed accumulators */
+    struct denseacc *dense = NULL;       /* array accumulators */
     unsigned int accs = 0,               /* number of accumulators */
                  acc_limit,              /* accumulator limit */
                  mem,                    /* amount of memory required */
@@ -1153,7 +2186,7 @@ int index_search(struct index *idx, const char *querystr,
     int ret;                             /* return value */
     unsigned int i,                      /* counter */
                  query_words;            /* number of words allowed in query */
-    int summary_type;
+    enum index_summary_type summary_type;
 
     /* variables needed for bucket processing */
     void *bucketmem = NULL;              /* memory for holding a bucket */
@@ -1164,14 +2197,15 @@ int index_search(struct index *idx, const char *querystr,
         query_words = opt->word_limit;
     }
     
-    if (opts & INDEX_SEARCH_SUMMARY_TYPE) {
+    if ((opts & INDEX_SEARCH_SUMMARY_TYPE) 
+      && (opt->summary_type != INDEX_SUMMARISE_NONE)) {
         summary_type = opt->summary_type;
     } else {
-        summary_type = INDEX_SUMMARISE_NONE;
+        summary_type = INDEX_SUMMARISE_PLAIN;
     }
 
     if (!(query.term = malloc(sizeof(*query.term) * query_words))) {
-        return 0;
+        return NULL;
     }
 
     if (opts & INDEX_SEARCH_ACCUMULATOR_LIMIT) {
@@ -1203,7 +2237,7 @@ int index_search(struct index *idx, const char *querystr,
         /* query construction failed */
         free(query.term);
         ERROR1("building query '%s'", querystr);
-        return 0;
+        return NULL;
     }
 
     /* calculate the amount of memory required and create an allocator */
@@ -1231,7 +2265,7 @@ int index_search(struct index *idx, const char *querystr,
         default:
             assert("not implemented yet" && 0);
             free(query.term);
-            return 0;
+            return NULL;
         }
         if (mem > UINT_MAX - memsum) {
             /* prevent overflow */
@@ -1247,12 +2281,15 @@ int index_search(struct index *idx, const char *querystr,
         mem = memsum;
     }
 
+    /* get the disk started on the lists we're about to need */
+    prefetch_lists(idx, &query, mem);
+
     /* initialise list allocator */
     list_alloc.opaque = NULL;
     if (!(list_alloc.opaque 
       = poolalloc_new(0, mem + poolalloc_overhead_first(), NULL))) {
         free(query.term);
-        return 0;
+        return NULL;
     }
     list_alloc.malloc = (alloc_mallocfn) poolalloc_malloc;
     list_alloc.free = (alloc_freefn) poolalloc_free;
@@ -1278,7 +2315,7 @@ int index_search(struct index *idx, const char *querystr,
                 }
                 free(query.term);
                 ERROR("processing phrase");
-                return 0;
+                return NULL;
             }
         }
     }
@@ -1290,40 +2327,54 @@ int index_search(struct index *idx, const char *querystr,
             free(bucketmem);
         }
         free(query.term);
-        return 0;
+        return NULL;
     }
 
     /* evaluate the query */
     if (opts & INDEX_SEARCH_ANH_IMPACT_RANK) {
+        int exact = 0;
+
         ret = SEARCH_EINVAL;
-        if ((hashacc = chash_luint_new(bit_log2(acc_limit), 2.0)) 
-          && ((ret = impact_ord_eval(idx, &query, hashacc, acc_limit, 
-              &list_alloc, mem)) 
+        /* use an accumulator per document if they fit in the memory we're 
+         * allowed, otherwise hash them */
+        if (denseacc_memsize(docmap_entries(idx->map)) <= idx->params.memory) {
+            dense = index_denseacc_get(idx, docmap_entries(idx->map));
+        }
+        if ((dense || (hashacc = chash_luint_new(bit_log2(acc_limit), 2.0)))
+          && ((ret = impact_ord_eval(idx, &query, hashacc, dense, acc_limit, 
+              &list_alloc, mem, opts, opt, &exact)) 
             == SEARCH_OK)) {
             /* impact ordered evaluation succeeded */
-            accs = chash_size(hashacc);
+            accs = dense ? dense->size : chash_size(hashacc);
         } else {
-            if (hashacc) {
+            if (dense) {
+                index_denseacc_put(idx, dense);
+                free(query.term);
+                return NULL;
+            } else if (hashacc) {
                 chash_delete(hashacc);
                 free(query.term);
-                return 0;
+                return NULL;
             }
         }
         /* XXX: set total results because we don't do it in impact_ord_eval */
-        *total_results = accs; 
-        *tr_est = 1;
+        total_results = accs; 
+        tr_est = INDEX_SEARCH_EST_TOTAL;
+        if ((opts & INDEX_SEARCH_ANYTIME) && !exact) {
+            tr_est |= INDEX_SEARCH_EST_RESULTS;
+        }
     } else {
         struct search_metric_results results 
-          = {NULL, 0, 0, NULL, FLT_MIN, 0, 0.0};
+          = {NULL, 0, 0, NULL, FLT_MIN, 0, 0.0, NULL};
         results.acc_limit = acc_limit;
         results.alloc = acc_alloc;
         ret = doc_ord_eval(idx, &query, list_alloc.opaque, mem, &results, 
-            opts, opt);
+            startdoc + len, opts, opt);
         fprintf(stderr, "return from doc_ord_eval: %d, accs: %d\n", ret, results.accs);
         accs = results.accs;
         acc = results.acc;
-        *total_results = results.total_results; 
-        *tr_est = results.estimated;
+        total_results = results.total_results; 
+        tr_est = results.estimated;
     }
     if (list_alloc.opaque) {
         poolalloc_delete(list_alloc.opaque);
@@ -1340,38 +2391,23 @@ int index_search(struct index *idx, const char *querystr,
     }
 
     if (ret == SEARCH_OK) {
-        /* select top accumulators as results */
-        *results 
-          = index_heap_select(idx, result, startdoc, len, acc, accs, hashacc);
-        assert(*results <= len);
+        /* select top accumulators as results, and find their fields */
+        if ((sel = index_heap_select(startdoc, len, acc, accs, hashacc, 
+            dense, &selected))
+          && (packed = pack_results(idx, &query, sel, selected, fields, 
+              summary_type, (opts & INDEX_SEARCH_SUMMARY_THREADS) 
+                ? opt->summary_threads : 1))) {
+            packed->total_results = total_results;
+            packed->est = tr_est;
+        }
+        if (sel) {
+            free(sel);
+        }
         if (hashacc) {
             chash_delete(hashacc);
         }
-
-        /* summarise the selected results if necessary */
-        if (summary_type != INDEX_SUMMARISE_NONE) {
-            /* sort the results by docno, which sorts them by repository
-             * location, improving the efficiency of summarisation */
-            qsort(result, *results, sizeof(*result), res_docno_cmp);
-
-            for (i = 0; i < *results; i++) {
-                struct summary res;
-
-                res.summary = result[i].summary;
-                res.summary_len = INDEX_SUMMARYLEN;
-                res.title = result[i].title;
-                res.title_len = INDEX_TITLELEN;
-
-                if (summarise(idx->sum, result[i].docno, &query, 
-                    summary_type, &res) != SUMMARISE_OK) {
-
-                    ERROR1("creating summary for document %ul", 
-                      result[i].docno);
-                }
-            }
-
-            /* resort the results by score */
-            qsort(result, *results, sizeof(*result), res_score_cmp);
+        if (dense) {
+            index_denseacc_put(idx, dense);
         }
     }
 
@@ -1390,94 +2426,675 @@ int index_search(struct index *idx, const char *querystr,
     /* get rid of the accumulators */
     objalloc_delete(acc_alloc);
 
-    /* free dynamic memory */
-    free(query.term);
-    if (bucketmem) {
-        free(bucketmem);
+    /* free dynamic memory */
+    free(query.term);
+    if (bucketmem) {
+        free(bucketmem);
+    }
+
+    return packed;
+}
+
+/* internal function to return a key (allocated with malloc) that the results
+ * of a search are cached under, writing its length into *keylen.  Everything
+ * that can change the results is part of the key, and the query is included 
+ * with runs of whitespace (which the query parser ignores) collapsed, so that
+ * trivially different queries share results.  Returns NULL on failure. */
+static char *result_key(const char *querystr, unsigned long int startdoc, 
+  unsigned long int len, unsigned int fields, int opts, 
+  struct index_search_opt *opt, unsigned int *keylen) {
+    char *key,
+         *pos;
+    unsigned int i;
+    int space = 0;
+
+    /* the options take less than 600 characters between them */
+    if (!(pos = key = malloc(str_len(querystr) + 600))) {
+        return NULL;
+    }
+
+    pos += sprintf(pos, "%d %u %lu %lu", opts, fields, startdoc, len);
+    if (opts & INDEX_SEARCH_OKAPI_RANK) {
+        pos += sprintf(pos, " %.9g %.9g %.9g", opt->u.okapi_k3.k1, 
+            opt->u.okapi_k3.k3, opt->u.okapi_k3.b);
+    } else if (opts & INDEX_SEARCH_PCOSINE_RANK) {
+        pos += sprintf(pos, " %.9g", opt->u.pcosine.pivot);
+    } else if (opts & INDEX_SEARCH_DIRICHLET_RANK) {
+        pos += sprintf(pos, " %.9g", opt->u.dirichlet.mu);
+    } else if (opts & INDEX_SEARCH_HAWKAPI_RANK) {
+        pos += sprintf(pos, " %.9g %.9g", opt->u.hawkapi.alpha, 
+            opt->u.hawkapi.k3);
+    } else if (opts & INDEX_SEARCH_BM25F_RANK) {
+        pos += sprintf(pos, " %.9g %.9g", opt->u.bm25f.k1, opt->u.bm25f.k3);
+        for (i = 0; i < INDEX_FIELDS; i++) {
+            pos += sprintf(pos, " %.9g %.9g", opt->u.bm25f.boost[i], 
+                opt->u.bm25f.b[i]);
+        }
+    }
+    if (opts & INDEX_SEARCH_WORD_LIMIT) {
+        pos += sprintf(pos, " %u", opt->word_limit);
+    }
+    if (opts & INDEX_SEARCH_ACCUMULATOR_LIMIT) {
+        pos += sprintf(pos, " %u", opt->accumulator_limit);
+    }
+    if (opts & INDEX_SEARCH_SUMMARY_TYPE) {
+        pos += sprintf(pos, " %d", (int) opt->summary_type);
+    }
+    *pos++ = ':';
+
+    for (; *querystr; querystr++) {
+        switch (*querystr) {
+        case ASCII_CASE_SPACE:
+            space = 1;
+            break;
+
+        default:
+            if (space && (pos[-1] != ':')) {
+                *pos++ = ' ';
+            }
+            space = 0;
+            *pos++ = *querystr;
+            break;
+        }
+    }
+
+    *keylen = pos - key;
+    return key;
+}
+
+/* internal function to search the index, answering the query from the result
+ * cache if it's there.  Returns packed results, which must be released with
+ * search_release, or NULL on failure. */
+static const struct packed_results *search_cached(struct index *idx, 
+  const char *querystr, unsigned long int startdoc, unsigned long int len, 
+  unsigned int fields, int opts, struct index_search_opt *opt) {
+    struct packed_results *packed;
+    const void *found;
+    char *key;
+    unsigned int keylen,
+                 size;
+
+    if (!idx->resultcache || !(key = result_key(querystr, startdoc, len, 
+        fields, opts, opt, &keylen))) {
+        return search_uncached(idx, querystr, startdoc, len, fields, opts, 
+            opt);
+    }
+
+    if ((found = cache_find(idx->resultcache, key, keylen, &size))) {
+        assert(((const struct packed_results *) found)->cached);
+        free(key);
+        return found;
+    }
+
+    if (!(packed 
+      = search_uncached(idx, querystr, startdoc, len, fields, opts, opt))) {
+        free(key);
+        return NULL;
+    }
+
+    /* anytime queries that ran out of budget depend on how busy we were, so
+     * their results aren't worth keeping */
+    if (packed->est & INDEX_SEARCH_EST_RESULTS) {
+        free(key);
+        return packed;
+    }
+
+    /* failing to cache the results doesn't matter */
+    packed->cached = 1;
+    if (cache_insert(idx->resultcache, key, keylen, packed, 1) != CACHE_OK) {
+        packed->cached = 0;
+    }
+    free(key);
+    return packed;
+}
+
+/* internal function to release results returned by search_cached */
+static void search_release(struct index *idx, 
+  const struct packed_results *packed) {
+    if (packed->cached) {
+        cache_release(idx->resultcache, packed);
+    } else {
+        cache_free((void *) packed);
+    }
+}
+
+/* internal function to search the index, with parameters as for 
+ * search_cached */
+static const struct packed_results *search_packed(struct index *idx, 
+  const char *querystr, unsigned long int startdoc, unsigned long int len, 
+  unsigned int fields, int opts, struct index_search_opt *opt) {
+    const struct packed_results *packed;
+
+    /* BM25F finds the field of each occurrence from its word position, and
+     * only reads positions that are interleaved with the postings */
+    if ((opts & INDEX_SEARCH_BM25F_RANK) && idx->fields > 1
+      && (idx->separate_positions || idx->list_codec != INDEX_CODEC_VBYTE)) {
+        ERROR("BM25F needs word positions stored with the postings, which "
+          "this index doesn't have");
+        return NULL;
+    }
+
+    if (!idx->segs) {
+        return search_cached(idx, querystr, startdoc, len, fields, opts, opt);
+    }
+
+    /* merges can't replace segments while they're being searched */
+    segments_read_lock(idx->segs);
+    packed = search_cached(idx, querystr, startdoc, len, fields, opts, opt);
+    segments_read_unlock(idx->segs);
+    return packed;
+}
+
+/* internal function to copy field src of length len into fixed-size buffer 
+ * dst of size + 1 bytes */
+static void copy_field(char *dst, unsigned int size, const char *src, 
+  unsigned int len) {
+    if (!src) {
+        len = 0;
+    } else if (len > size) {
+        len = size;
+    }
+    if (len) {
+        memcpy(dst, src, len);
+    }
+    dst[len] = '\0';
+}
+
+int index_search(struct index *idx, const char *querystr, 
+  unsigned long int startdoc, unsigned long int len, 
+  struct index_result *result, unsigned int *results, 
+  double *total_results, int *tr_est, int opts, struct index_search_opt *opt) {
+    const struct packed_results *packed;
+    const char *text;
+    unsigned int i,
+                 fields = INDEX_RESULT_AUX;
+    struct index_hit hit;
+
+    if ((opts & INDEX_SEARCH_SUMMARY_TYPE) 
+      && (opt->summary_type != INDEX_SUMMARISE_NONE)) {
+        fields |= INDEX_RESULT_TITLE | INDEX_RESULT_SUMMARY;
+    }
+
+    if (!(packed 
+      = search_packed(idx, querystr, startdoc, len, fields, opts, opt))) {
+        return 0;
+    }
+
+    text = (const char *) ((const struct packed_result *) (packed + 1) 
+      + packed->results);
+    for (i = 0; i < packed->results; i++) {
+        unpack_result(packed, (const struct packed_result *) (packed + 1) + i,
+          &text, &hit);
+        result[i].docno = hit.docno;
+        result[i].score = hit.score;
+        copy_field(result[i].auxilliary, INDEX_AUXILIARYLEN, hit.aux, 
+          hit.aux_len);
+        copy_field(result[i].title, INDEX_TITLELEN, hit.title, 
+          hit.title_len);
+        copy_field(result[i].summary, INDEX_SUMMARYLEN, hit.summary, 
+          hit.summary_len);
+    }
+
+    *results = packed->results;
+    *total_results = packed->total_results;
+    *tr_est = packed->est;
+    search_release(idx, packed);
+    return 1;
+}
+
+/* internal function to copy a field of length len from *src into the arena,
+ * which has *arenalen bytes left at *arena, pointing *src at the copy (or 
+ * NULL if it doesn't fit) */
+static void arena_field(const char **src, unsigned int *len, char **arena, 
+  unsigned long int *arenalen) {
+    if (!*src) {
+        return;
+    } else if (*len + 1 <= *arenalen) {
+        memcpy(*arena, *src, *len + 1);
+        *src = *arena;
+        *arena += *len + 1;
+        *arenalen -= *len + 1;
+    } else {
+        *src = NULL;
+        *len = 0;
+    }
+}
+
+int index_search_results(struct index *idx, const char *querystr, 
+  unsigned long int startdoc, unsigned long int len, unsigned int fields,
+  struct index_hit *result, char *arena, unsigned long int arenalen, 
+  unsigned int *results, double *total_results, int *tr_est, int opts, 
+  struct index_search_opt *opt) {
+    const struct packed_results *packed;
+    const char *text;
+    unsigned int i;
+
+    if (!(packed 
+      = search_packed(idx, querystr, startdoc, len, fields, opts, opt))) {
+        return 0;
+    }
+
+    text = (const char *) ((const struct packed_result *) (packed + 1) 
+      + packed->results);
+    for (i = 0; i < packed->results; i++) {
+        unpack_result(packed, (const struct packed_result *) (packed + 1) + i,
+          &text, &result[i]);
+        arena_field(&result[i].aux, &result[i].aux_len, &arena, &arenalen);
+        arena_field(&result[i].title, &result[i].title_len, &arena, 
+          &arenalen);
+        arena_field(&result[i].summary, &result[i].summary_len, &arena, 
+          &arenalen);
+    }
+
+    *results = packed->results;
+    *total_results = packed->total_results;
+    *tr_est = packed->est;
+    search_release(idx, packed);
+    return 1;
+}
+
+int index_search_stream(struct index *idx, const char *querystr, 
+  unsigned long int startdoc, unsigned long int len, unsigned int fields,
+  int (*fn)(void *opaque, const struct index_hit *result), void *opaque,
+  unsigned int *results, double *total_results, int *tr_est, int opts, 
+  struct index_search_opt *opt) {
+    const struct packed_results *packed;
+    const char *text;
+    unsigned int i;
+    struct index_hit hit;
+
+    if (!(packed 
+      = search_packed(idx, querystr, startdoc, len, fields, opts, opt))) {
+        return 0;
+    }
+
+    /* results are passed straight from where they're packed */
+    text = (const char *) ((const struct packed_result *) (packed + 1) 
+      + packed->results);
+    for (i = 0; i < packed->results; i++) {
+        unpack_result(packed, (const struct packed_result *) (packed + 1) + i,
+          &text, &hit);
+        if (!fn(opaque, &hit)) {
+            i++;
+            break;
+        }
+    }
+
+    *results = i;
+    *total_results = packed->total_results;
+    *tr_est = packed->est;
+    search_release(idx, packed);
+    return 1;
+}
+
+/* structure to hold the skip table of a list (see skip_build.h), which is
+ * decoded into arrays the first time that it's needed */
+struct skiptab {
+    unsigned long int *docno;        /* last document before each block */
+    unsigned long int *offset;       /* offset of each block in postings */
+    unsigned int entries;            /* number of entries in the table */
+    unsigned int interval;           /* number of postings in each block */
+    unsigned int curr;               /* number of entries last passed */
+};
+
+/* internal function to decode a skip table of len bytes from buf into tab */
+static enum search_ret skiptab_decode(struct skiptab *tab, void *buf,
+  unsigned int len) {
+    struct vec v;
+    unsigned long int interval,
+                      docno,
+                      offset;
+    unsigned int i,
+                 entries;
+
+    v.pos = buf;
+    v.end = v.pos + len;
+    if (!vec_vbyte_read(&v, &interval) || !interval) {
+        return SEARCH_EINVAL;
+    }
+
+    /* count entries, then decode them */
+    buf = v.pos;
+    entries = vec_vbyte_scan(&v, UINT_MAX, &i) / 2;
+    if (VEC_LEN(&v)
+      || !(tab->docno = malloc(sizeof(*tab->docno) * 2 * (entries + 1)))) {
+        return VEC_LEN(&v) ? SEARCH_EINVAL : SEARCH_ENOMEM;
+    }
+    tab->offset = tab->docno + entries + 1;
+    v.pos = buf;
+    for (i = 0, docno = offset = 0; i < entries; i++) {
+        vec_vbyte_read(&v, &tab->docno[i]);
+        vec_vbyte_read(&v, &tab->offset[i]);
+        docno = tab->docno[i] += docno;
+        offset = tab->offset[i] += offset;
+    }
+
+    tab->entries = entries;
+    tab->interval = interval;
+    tab->curr = 0;
+    return SEARCH_OK;
+}
+
+/* internal function to find the last block in tab that starts before the
+ * first posting for a document numbered at least docno, given that base is
+ * the last document decoded from the list.  Returns the number of the block,
+ * or 0 if the block isn't any further along the list than base. */
+static unsigned int skiptab_find(struct skiptab *tab, unsigned long int docno,
+  unsigned long int base) {
+    unsigned int i = tab->curr;
+
+    /* lookups are mostly for increasing docno, so search from the last one */
+    while (i && tab->docno[i - 1] >= docno) {
+        i--;
+    }
+    while (i < tab->entries && tab->docno[i] < docno) {
+        i++;
+    }
+    tab->curr = i;
+
+    if (i && (base == (unsigned long int) SEARCH_DOCNO_START
+        || tab->docno[i - 1] > base)) {
+        return i;
+    } else {
+        return 0;
+    }
+}
+
+static void skiptab_delete(struct skiptab *tab) {
+    if (tab->interval) {
+        free(tab->docno);
+    }
+}
+
+/* structure to allow sourcing of a list from a single, contiguous
+ * location in memory */
+struct memsrc {
+    struct search_list_src src;
+    void *mem;                       /* start of postings */
+    unsigned int len;                /* length of postings */
+    unsigned int pos;                /* position of next read in postings */
+    void *skipmem;                   /* skip table */
+    unsigned int skipsize;           /* length of skip table */
+    struct skiptab skip;             /* decoded skip table */
+
+    struct index *idx;               /* index to read the vector from before
+                                      * it's first used, or NULL if it's
+                                      * already in memory */
+    struct term *term;               /* term the vector belongs to */
+    struct cache *cache;             /* cache the vector was found in (or 
+                                      * NULL) */
+    const void *cached;              /* pinned copy of the vector in cache */
+};
+
+/* internal function to write the key that the list of a term is cached under 
+ * into key, which must be TERMLEN_MAX + 2 bytes long.  Returns the length of
+ * the key. */
+static unsigned int listcache_key(struct term *term, char *key) {
+    unsigned int len = str_len(term->term);
+
+    assert(len <= TERMLEN_MAX);
+    key[0] = '0' + term->vocab.type;
+    memcpy(key + 1, term->term, len);
+    return len + 1;
+}
+
+/* internal function to read len bytes from offset in the given file into 
+ * buf */
+static enum search_ret read_list(struct index *idx, unsigned int type, 
+  unsigned int fileno, unsigned long int offset, void *buf, 
+  unsigned int len) {
+    char *pos = buf;
+    ssize_t read_bytes;
+    int fd;
+
+    if ((fd = fdset_pin(idx->fd, type, fileno, offset, SEEK_SET)) < 0) {
+        return SEARCH_EIO;
+    }
+    while (len && (((read_bytes = read(fd, pos, len)) > 0)
+        || ((read_bytes == -1) && (errno == EINTR)))) {
+        if (read_bytes > 0) {
+            pos += read_bytes;
+            len -= read_bytes;
+        }
+    }
+    fdset_unpin(idx->fd, type, fileno, fd);
+
+    if (len) {
+        return SEARCH_EIO;
+    }
+    return SEARCH_OK;
+}
+
+/* internal function to read the vector of a memory source in from the list
+ * cache or disk, if that hasn't been done yet.  Vectors read from disk are 
+ * added to the list cache. */
+static enum search_ret memsrc_load(struct memsrc *msrc) {
+    unsigned int bytes = msrc->skipsize + msrc->len,
+                 keylen = 0,
+                 len;
+    struct cache *cache;
+    char key[TERMLEN_MAX + 2];
+    const void *cached;
+    void *copy;
+    enum search_ret ret;
+
+    if (!msrc->idx) {
+        return SEARCH_OK;
+    }
+
+    if ((cache = msrc->idx->listcache)) {
+        keylen = listcache_key(msrc->term, key);
+        if ((cached = cache_find(cache, key, keylen, &len))) {
+            if (len == bytes) {
+                msrc->skipmem = (void *) cached;
+                msrc->mem = (char *) cached + msrc->skipsize;
+                msrc->cache = cache;
+                msrc->cached = cached;
+                msrc->idx = NULL;
+                return SEARCH_OK;
+            }
+            cache_release(cache, cached);
+        }
+    }
+
+    if ((ret = read_list(msrc->idx, msrc->idx->index_type, 
+        msrc->term->vocab.loc.file.fileno, msrc->term->vocab.loc.file.offset,
+        msrc->skipmem, bytes)) != SEARCH_OK) {
+        return ret;
+    }
+
+    /* failing to cache the vector doesn't matter */
+    if (cache && (copy = cache_alloc(bytes))) {
+        memcpy(copy, msrc->skipmem, bytes);
+        if (cache_insert(cache, key, keylen, copy, 0) != CACHE_OK) {
+            cache_free(copy);
+        }
     }
 
-    return ret == SEARCH_OK;
+    msrc->idx = NULL;
+    return SEARCH_OK;
 }
 
-/* structure to allow sourcing of a list from a single, contiguous
- * location in memory */
-struct memsrc {
-    struct search_list_src src;
-    void *mem;
-    unsigned int len;
-    int returned;
-};
-
 static enum search_ret memsrc_reset(struct search_list_src *src) {
     struct memsrc *msrc = src->opaque;
 
-    msrc->returned = 0;
+    msrc->pos = 0;
+    msrc->skip.curr = 0;
     return SEARCH_OK;
 }
 
 static enum search_ret memsrc_read(struct search_list_src *src, 
   unsigned int leftover, void **retbuf, unsigned int *retlen) {
     struct memsrc *msrc = src->opaque;
+    enum search_ret ret;
 
-    if (leftover) {
+    if (leftover > msrc->pos) {
         return SEARCH_EINVAL;
     }
 
-    if (msrc->returned || !msrc->len) {
+    if (msrc->idx && ((ret = memsrc_load(msrc)) != SEARCH_OK)) {
+        return ret;
+    }
+
+    if ((msrc->pos >= msrc->len) && !leftover) {
         return SEARCH_FINISH;
     }
 
-    msrc->returned = 1;
-    *retbuf = msrc->mem;
-    *retlen = msrc->len;
+    /* leftover bytes are just served again from where they are */
+    *retbuf = (char *) msrc->mem + msrc->pos - leftover;
+    *retlen = msrc->len - msrc->pos + leftover;
+    msrc->pos = msrc->len;
+    return SEARCH_OK;
+}
+
+static enum search_ret memsrc_skip_to(struct search_list_src *src,
+  unsigned long int docno, unsigned long int *base,
+  unsigned long int *postings) {
+    struct memsrc *msrc = src->opaque;
+    enum search_ret ret;
+    unsigned int block;
+
+    if (!msrc->skip.interval
+      && (((ret = memsrc_load(msrc)) != SEARCH_OK)
+        || ((ret = skiptab_decode(&msrc->skip, msrc->skipmem, msrc->skipsize))
+          != SEARCH_OK))) {
+        return ret;
+    }
+
+    if ((block = skiptab_find(&msrc->skip, docno, *base))) {
+        msrc->pos = msrc->skip.offset[block - 1];
+        *base = msrc->skip.docno[block - 1];
+        *postings = block * msrc->skip.interval;
+    }
     return SEARCH_OK;
 }
 
 static void memsrc_delete(struct search_list_src *src) {
+    struct memsrc *msrc = src->opaque;
+
+    if (msrc->cached) {
+        cache_release(msrc->cache, msrc->cached);
+    }
+    skiptab_delete(&msrc->skip);
     free(src);
 }
 
-static struct search_list_src *memsrc_new(void *mem, unsigned int len) {
+/* create a source for the len byte vector at mem, the first skipsize bytes of
+ * which are a skip table.  offsets indicates whether postings are followed by
+ * their word offsets. */
+static struct search_list_src *memsrc_new(void *mem, unsigned int len,
+  unsigned int skipsize, int offsets) {
     struct memsrc *msrc = malloc(sizeof(*msrc));
 
     if (msrc) {
-        msrc->mem = mem;
-        msrc->len = len;
-        msrc->returned = 0;
+        assert(skipsize <= len);
+        msrc->skipmem = mem;
+        msrc->skipsize = skipsize;
+        msrc->skip.interval = 0;
+        msrc->mem = (char *) mem + skipsize;
+        msrc->len = len - skipsize;
+        msrc->pos = 0;
+        msrc->idx = NULL;
+        msrc->term = NULL;
+        msrc->cache = NULL;
+        msrc->cached = NULL;
         msrc->src.opaque = msrc;
+        msrc->src.offsets = offsets;
+        msrc->src.blocks = 0;
         msrc->src.delet = memsrc_delete;
         msrc->src.reset = memsrc_reset;
         msrc->src.readlist = memsrc_read;
+        msrc->src.skip_to = skipsize ? memsrc_skip_to : NULL;
     }
     return &msrc->src;
 }
 
-static struct search_list_src *memsrc_new_from_disk(struct index *idx, 
+/* lists at least this long are read ahead when they're served from a memory
+ * mapping, since they're going to be scanned through */
+#define SEARCH_MMAP_WILLNEED (16 * 1024)
+
+/* create a source for the size byte vector at offset in the given file, the
+ * first skipsize bytes of which are a skip table, serving it straight out of
+ * the memory mapping of the file.  offsets indicates whether postings are 
+ * followed by their word offsets.  Returns NULL if the file isn't mapped. */
+static struct search_list_src *mapsrc_new(struct index *idx, 
   unsigned int type, unsigned int fileno, unsigned long int offset, 
-  unsigned int size, void *mem) {
-    unsigned int bytes = size;
-    char *pos;
-    int fd = fdset_pin(idx->fd, type, fileno, offset, SEEK_SET);
-    ssize_t read_bytes;
+  unsigned int size, unsigned int skipsize, int offsets) {
+    const char *addr;
+    unsigned long int len;
+
+    if ((fdset_map(idx->fd, type, fileno, &addr, &len) == FDSET_OK)
+      && (offset + size <= len)) {
+        if (size >= SEARCH_MMAP_WILLNEED) {
+            fdset_map_willneed(addr + offset + skipsize, size - skipsize);
+        }
+        return memsrc_new((char *) addr + offset, size, skipsize, offsets);
+    }
+    return NULL;
+}
+
+/* create a source for the postings of a term (which must be stored in a 
+ * file), read into mem (which must be term_listsize bytes long) the first time
+ * the source is used, unless they're in the list cache.  Reading should be 
+ * started beforehand with fdset_willneed, so that they're likely to be there 
+ * by then. */
+static struct search_list_src *memsrc_new_from_disk(struct index *idx, 
+  struct term *term, void *mem) {
+    struct search_list_src *src;
+    struct memsrc *msrc;
 
-    if ((fd >= 0) && (pos = mem)) {
-        do {
-            read_bytes = read(fd, pos, bytes);
-        } while ((read_bytes != -1) 
-          && (pos += read_bytes, bytes -= read_bytes));
+    assert(term->vocab.location == VOCAB_LOCATION_FILE);
+    if ((src = memsrc_new(mem, term_listsize(term), term_skipsize(term), 
+        term_offsets(term)))) {
+        msrc = src->opaque;
+        msrc->idx = idx;
+        msrc->term = term;
+    }
+    return src;
+}
 
-        fdset_unpin(idx->fd, type, fileno, fd);
-        if (!bytes) {
-            return memsrc_new(mem, size);
+/* create a source for the postings of a term (which must be stored in a 
+ * file) from the list cache, reading them into the cache first if they're not
+ * there.  Returns NULL if they can't be cached. */
+static struct search_list_src *cachesrc_new(struct index *idx, 
+  struct term *term) {
+    struct search_list_src *src;
+    struct memsrc *msrc;
+    char key[TERMLEN_MAX + 2];
+    unsigned int keylen = listcache_key(term, key),
+                 size = term_listsize(term),
+                 len;
+    const void *list;
+    void *buf;
+
+    if (!(list = cache_find(idx->listcache, key, keylen, &len))) {
+        if (!(buf = cache_alloc(size))) {
+            return NULL;
         }
-    } else {
-        if (fd >= 0) {
-            fdset_unpin(idx->fd, type, fileno, fd);
+        if ((read_list(idx, idx->index_type, term->vocab.loc.file.fileno, 
+            term->vocab.loc.file.offset, buf, size) != SEARCH_OK)
+          || (cache_insert(idx->listcache, key, keylen, buf, 1) 
+            != CACHE_OK)) {
+            cache_free(buf);
+            return NULL;
         }
+        list = buf;
+    } else if (len != size) {
+        cache_release(idx->listcache, list);
+        return NULL;
     }
-    return NULL;
+
+    if ((src = memsrc_new((void *) list, size, term_skipsize(term), 
+        term_offsets(term)))) {
+        msrc = src->opaque;
+        msrc->cache = idx->listcache;
+        msrc->cached = list;
+    } else {
+        cache_release(idx->listcache, list);
+    }
+    return src;
 }
- 
+
 /* FIXME: structure to allow sourcing of a list from a bucket on disk */
 
 /* structure to allow sourcing of a list from an fd */
@@ -1496,11 +3113,15 @@ struct disksrc {
     unsigned int type;               /* the type of the fd */
     unsigned int fileno;             /* the file number of the fd */
     unsigned long int offset;        /* starting offset of the list */
+
+    unsigned int skipsize;           /* size of skip table preceding list */
+    struct skiptab skip;             /* decoded skip table */
 };
 
 static enum search_ret disksrc_reset(struct search_list_src *src) {
     struct disksrc *dsrc = src->opaque;
     dsrc->pos = 0;
+    dsrc->skip.curr = 0;
     return SEARCH_OK;
 }
 
@@ -1542,7 +3163,7 @@ static enum search_ret disksrc_read(struct search_list_src *src,
 
             dsrc->bufsize = 0;
             if ((newoff = lseek(dsrc->fd, dsrc->offset + dsrc->pos, SEEK_SET)) 
-              != (off_t) dsrc->offset) {
+              != (off_t) (dsrc->offset + dsrc->pos)) {
                 return SEARCH_EINVAL;
             }
         }
@@ -1591,19 +3212,96 @@ static enum search_ret disksrc_read(struct search_list_src *src,
     }
 }
 
+/* internal function to read and decode the skip table preceding a list on
+ * disk.  The fd is left where it was, so that the buffer remains valid. */
+static enum search_ret disksrc_read_skips(struct disksrc *dsrc) {
+    char *buf,
+         *pos;
+    unsigned int bytes = dsrc->skipsize;
+    ssize_t read_bytes;
+    off_t curr;
+    enum search_ret ret;
+
+    if (!(pos = buf = malloc(dsrc->skipsize))) {
+        return SEARCH_ENOMEM;
+    }
+
+    if (((curr = lseek(dsrc->fd, 0, SEEK_CUR)) == (off_t) -1)
+      || (lseek(dsrc->fd, dsrc->offset - dsrc->skipsize, SEEK_SET)
+        == (off_t) -1)) {
+        free(buf);
+        return SEARCH_EIO;
+    }
+
+    while (bytes && (((read_bytes = read(dsrc->fd, pos, bytes)) > 0)
+        || ((read_bytes == -1) && (errno == EINTR)))) {
+        if (read_bytes > 0) {
+            pos += read_bytes;
+            bytes -= read_bytes;
+        }
+    }
+
+    if (bytes || (lseek(dsrc->fd, curr, SEEK_SET) != curr)) {
+        free(buf);
+        return SEARCH_EIO;
+    }
+
+    ret = skiptab_decode(&dsrc->skip, buf, dsrc->skipsize);
+    free(buf);
+    return ret;
+}
+
+static enum search_ret disksrc_skip_to(struct search_list_src *src,
+  unsigned long int docno, unsigned long int *base,
+  unsigned long int *postings) {
+    struct disksrc *dsrc = src->opaque;
+    enum search_ret ret;
+    unsigned int block;
+
+    if (!dsrc->skip.interval
+      && (ret = disksrc_read_skips(dsrc)) != SEARCH_OK) {
+        return ret;
+    }
+
+    if ((block = skiptab_find(&dsrc->skip, docno, *base))) {
+        /* the next read will be served from the buffer if the block is in
+         * it, or seek to the block otherwise */
+        dsrc->pos = dsrc->skip.offset[block - 1];
+        *base = dsrc->skip.docno[block - 1];
+        *postings = block * dsrc->skip.interval;
+    }
+    return SEARCH_OK;
+}
+
 static void disksrc_delete(struct search_list_src *src) {
     struct disksrc *dsrc = src->opaque;
 
+    skiptab_delete(&dsrc->skip);
     dsrc->alloc.free(dsrc->alloc.opaque, dsrc->buf);
     fdset_unpin(dsrc->idx->fd, dsrc->type, dsrc->fileno, dsrc->fd);
     free(src);
     return;
 }
 
+/* create a source for the size byte vector at offset in the given file, the
+ * first skipsize bytes of which are a skip table.  offsets indicates whether
+ * postings are followed by their word offsets. */
 static struct search_list_src *disksrc_new(struct index *idx, 
   unsigned int type, unsigned int fileno, unsigned long int offset, 
-  unsigned int size, struct alloc *alloc, unsigned int mem) {
-    int fd = fdset_pin(idx->fd, type, fileno, offset, SEEK_SET);
+  unsigned int size, unsigned int skipsize, int offsets, struct alloc *alloc, 
+  unsigned int mem) {
+    struct search_list_src *src;
+    int fd;
+
+    assert(skipsize <= size);
+    if ((src 
+      = mapsrc_new(idx, type, fileno, offset, size, skipsize, offsets))) {
+        return src;
+    }
+
+    offset += skipsize;
+    size -= skipsize;
+    fd = fdset_pin(idx->fd, type, fileno, offset, SEEK_SET);
 
     if (mem > size) {
         mem = size;
@@ -1614,9 +3312,12 @@ static struct search_list_src *disksrc_new(struct index *idx,
 
         if (dsrc && (dsrc->buf = alloc->malloc(alloc->opaque, mem))) {
             dsrc->src.opaque = dsrc;
+            dsrc->src.offsets = offsets;
+            dsrc->src.blocks = 0;
             dsrc->src.delet = disksrc_delete;
             dsrc->src.reset = disksrc_reset;
             dsrc->src.readlist = disksrc_read;
+            dsrc->src.skip_to = skipsize ? disksrc_skip_to : NULL;
 
             /* ensure that nothing gets served out of the buffer first time */
             dsrc->bufpos = -1;  
@@ -1631,6 +3332,8 @@ static struct search_list_src *disksrc_new(struct index *idx,
             dsrc->fileno = fileno;
             dsrc->offset = offset;
             dsrc->size = size;
+            dsrc->skipsize = skipsize;
+            dsrc->skip.interval = 0;
             return &dsrc->src;
         } else {
             if (dsrc) {
@@ -1695,6 +3398,22 @@ static enum search_ret debufsrc_read(struct search_list_src *src,
     }
 }
 
+static enum search_ret debufsrc_skip_to(struct search_list_src *src,
+  unsigned long int docno, unsigned long int *base,
+  unsigned long int *postings) {
+    struct debufsrc *dsrc = src->opaque;
+    unsigned long int prev = *base;
+    enum search_ret sret;
+
+    if ((sret = dsrc->srcsrc->skip_to(dsrc->srcsrc, docno, base, postings))
+        == SEARCH_OK
+      && *base != prev) {
+        /* underlying source has moved, so our buffer is no longer valid */
+        dsrc->len = 0;
+    }
+    return sret;
+}
+
 static void debufsrc_delete(struct search_list_src *src) {
     struct debufsrc *dsrc = src->opaque;
 
@@ -1710,7 +3429,10 @@ struct search_list_src *debufsrc_new(struct search_list_src *src,
         dsrc->src.readlist = debufsrc_read;
         dsrc->src.reset = debufsrc_reset;
         dsrc->src.delet = debufsrc_delete;
+        dsrc->src.skip_to = src->skip_to ? debufsrc_skip_to : NULL;
         dsrc->src.opaque = dsrc;
+        dsrc->src.offsets = src->offsets;
+        dsrc->src.blocks = src->blocks;
 
         dsrc->srcsrc = src;
         dsrc->pos = NULL;
@@ -1722,27 +3444,579 @@ struct search_list_src *debufsrc_new(struct search_list_src *src,
     }
 }
 
-struct search_list_src *search_term_src(struct index *idx, struct term *term,
+/* structure to allow sourcing of a list that has its word positions stored
+ * separately as though they were interleaved with the postings, for 
+ * evaluating phrases.  Also used without word positions to turn block coded
+ * postings back into vbyte postings for conjunctive processing. */
+struct possrc {
+    struct search_list_src src;      /* parent source structure */
+    struct alloc alloc;              /* buffer allocation object */
+    struct search_list_src *docsrc;  /* document numbers and frequencies */
+    struct search_list_src *possrc;  /* word positions, or NULL */
+    struct vec docv;                 /* unread document numbers, f_dt */
+    struct blockcodec_block blk;     /* decoded block from docsrc */
+    struct vec posv;                 /* unread word positions */
+    unsigned long int f_dt;          /* positions left in current document */
+    char *buf;                       /* buffer of interleaved postings */
+    unsigned int bufcap;             /* capacity of buffer */
+    unsigned int buflen;             /* length of last read */
+};
+
+/* minimum size of the interleaving buffer (must comfortably hold the
+ * leftovers of a read) */
+#define POSSRC_MIN_BUFFER (8 * VEC_VBYTE_MAX)
+
+/* internal function to read more data from src into v, preserving what's left
+ * of v */
+static enum search_ret possrc_fill(struct search_list_src *src, 
+  struct vec *v) {
+    enum search_ret ret;
+    unsigned int len;
+
+    if ((ret = src->readlist(src, VEC_LEN(v), (void **) &v->pos, &len)) 
+      == SEARCH_OK) {
+        v->end = v->pos + len;
+    }
+    return ret;
+}
+
+static enum search_ret possrc_reset(struct search_list_src *src) {
+    struct possrc *psrc = src->opaque;
+    enum search_ret ret;
+
+    psrc->docv.pos = psrc->docv.end = NULL;
+    psrc->blk.n = psrc->blk.pos = 0;
+    psrc->posv.pos = psrc->posv.end = NULL;
+    psrc->f_dt = 0;
+    psrc->buflen = 0;
+    if (((ret = psrc->docsrc->reset(psrc->docsrc)) == SEARCH_OK) 
+      && psrc->possrc) {
+        ret = psrc->possrc->reset(psrc->possrc);
+    }
+    return ret;
+}
+
+/* internal function to read the next d-gap and f_dt from the buffered data
+ * of the document source, returning false if more data has to be read */
+static int possrc_next_doc(struct possrc *psrc, unsigned long int *docno_d) {
+    if (psrc->docsrc->blocks) {
+        if ((psrc->blk.pos < psrc->blk.n)
+          || ((psrc->blk.pos = 0),
+            (psrc->blk.n = blockcodec_read(&psrc->docv, psrc->blk.ints)))) {
+            *docno_d = psrc->blk.ints[psrc->blk.pos++];
+            psrc->f_dt = psrc->blk.ints[psrc->blk.pos++];
+            return 1;
+        }
+        return 0;
+    }
+
+    return vec_vbyte_read(&psrc->docv, docno_d)
+      && (vec_vbyte_read(&psrc->docv, &psrc->f_dt)
+        || ((psrc->docv.pos -= vec_vbyte_len(*docno_d)), 0));
+}
+
+static enum search_ret possrc_read(struct search_list_src *src, 
+  unsigned int leftover, void **retbuf, unsigned int *retlen) {
+    struct possrc *psrc = src->opaque;
+    struct vec out;
+    unsigned long int docno_d,
+                      n;
+    enum search_ret ret;
+
+    if (leftover > psrc->buflen) {
+        assert("can't get here" && 0);
+        return SEARCH_EINVAL;
+    }
+
+    memmove(psrc->buf, psrc->buf + psrc->buflen - leftover, leftover);
+    out.pos = psrc->buf + leftover;
+    out.end = psrc->buf + psrc->bufcap;
+
+    /* copy <d, f_dt> from one source, followed by f_dt offsets from the 
+     * other, until the buffer is full */
+    while (VEC_LEN(&out) >= 2 * VEC_VBYTE_MAX) {
+        if (psrc->f_dt) {
+            if (vec_vbyte_read(&psrc->posv, &n)) {
+                vec_vbyte_write(&out, n);
+                psrc->f_dt--;
+            } else if ((ret = possrc_fill(psrc->possrc, &psrc->posv)) 
+              != SEARCH_OK) {
+                /* shouldn't end while there are offsets left */
+                return (ret == SEARCH_FINISH) ? SEARCH_EINVAL : ret;
+            }
+        } else if (possrc_next_doc(psrc, &docno_d)) {
+            vec_vbyte_write(&out, docno_d);
+            vec_vbyte_write(&out, psrc->f_dt);
+            if (!psrc->possrc) {
+                psrc->f_dt = 0;
+            }
+        } else if ((ret = possrc_fill(psrc->docsrc, &psrc->docv)) 
+          == SEARCH_FINISH) {
+            if (VEC_LEN(&psrc->docv)) {
+                return SEARCH_EINVAL;
+            }
+            break;
+        } else if (ret != SEARCH_OK) {
+            return ret;
+        }
+    }
+
+    psrc->buflen = out.pos - psrc->buf;
+    if (psrc->buflen) {
+        *retbuf = psrc->buf;
+        *retlen = psrc->buflen;
+        return SEARCH_OK;
+    } else {
+        return SEARCH_FINISH;
+    }
+}
+
+static void possrc_delete(struct search_list_src *src) {
+    struct possrc *psrc = src->opaque;
+
+    psrc->docsrc->delet(psrc->docsrc);
+    if (psrc->possrc) {
+        psrc->possrc->delet(psrc->possrc);
+    }
+    psrc->alloc.free(psrc->alloc.opaque, psrc->buf);
+    free(src);
+}
+
+/* create a source that interleaves the postings from docsrc with the word
+ * positions from possrc (taking ownership of both), using a buffer of mem 
+ * bytes.  possrc may be NULL, in which case the source returns vbyte coded
+ * postings without offsets. */
+static struct search_list_src *possrc_new(struct search_list_src *docsrc,
+  struct search_list_src *possrc, struct alloc *alloc, unsigned int mem) {
+    struct possrc *psrc = malloc(sizeof(*psrc));
+
+    if (mem < POSSRC_MIN_BUFFER) {
+        mem = POSSRC_MIN_BUFFER;
+    }
+
+    if (psrc && (psrc->buf = alloc->malloc(alloc->opaque, mem))) {
+        psrc->src.opaque = psrc;
+        psrc->src.offsets = (possrc != NULL);
+        psrc->src.blocks = 0;
+        psrc->src.delet = possrc_delete;
+        psrc->src.reset = possrc_reset;
+        psrc->src.readlist = possrc_read;
+        psrc->src.skip_to = NULL;
+
+        psrc->alloc = *alloc;
+        psrc->docsrc = docsrc;
+        psrc->possrc = possrc;
+        psrc->bufcap = mem;
+        psrc->docv.pos = psrc->docv.end = NULL;
+        psrc->blk.n = psrc->blk.pos = 0;
+        psrc->posv.pos = psrc->posv.end = NULL;
+        psrc->f_dt = 0;
+        psrc->buflen = 0;
+        return &psrc->src;
+    } else {
+        if (psrc) {
+            free(psrc);
+        }
+        return NULL;
+    }
+}
+
+/* smallest buffer given to a source of block coded postings, which has to be
+ * able to hold a whole block along with the leftovers of the previous one */
+#define SEARCH_BLOCK_BUFFER (2 * BLOCKCODEC_MAX_BYTES)
+
+/* smallest buffer given to a source of an impact ordered list with 
+ * bit-packed document numbers, for the same reason */
+#define SEARCH_IMPACT_BUFFER (2 * IMPACTCODEC_MAX_BYTES)
+
+/* internal function to return a source for the postings of a term in the 
+ * index, which won't include word positions if they're stored separately */
+static struct search_list_src *term_src(struct index *idx, struct term *term,
   struct alloc *alloc, unsigned int mem) {
+    struct search_list_src *src;
+
     if (term->vecmem) {
         /* memory source */
         assert(term->vocab.location == VOCAB_LOCATION_VOCAB);
-        return memsrc_new(term->vecmem, term->vocab.size);
+        src = memsrc_new(term->vecmem, term_listsize(term), 
+            term_skipsize(term), term_offsets(term));
     } else {
         /* disk source */
         assert(term->vocab.location == VOCAB_LOCATION_FILE);
-        return disksrc_new(idx, idx->index_type, 
-            term->vocab.loc.file.fileno, term->vocab.loc.file.offset, 
-            term->vocab.size, alloc, mem);
+        if (term_blocks(term) && (mem < SEARCH_BLOCK_BUFFER)) {
+            mem = SEARCH_BLOCK_BUFFER;
+        } else if ((term->vocab.type == VOCAB_VTYPE_IMPACT_BLOCK) 
+          && (mem < SEARCH_IMPACT_BUFFER)) {
+            mem = SEARCH_IMPACT_BUFFER;
+        }
+        /* lists that could be read in whole are served from the list cache,
+         * unless they're mapped into memory anyway */
+        if (!(src = mapsrc_new(idx, idx->index_type, 
+              term->vocab.loc.file.fileno, term->vocab.loc.file.offset, 
+              term_listsize(term), term_skipsize(term), term_offsets(term)))
+          && !(idx->listcache && (term_listsize(term) <= mem)
+            && (src = cachesrc_new(idx, term)))) {
+            src = disksrc_new(idx, idx->index_type, 
+                term->vocab.loc.file.fileno, term->vocab.loc.file.offset, 
+                term_listsize(term), term_skipsize(term), term_offsets(term), 
+                alloc, mem);
+        }
+    }
+
+    if (src) {
+        src->blocks = term_blocks(term);
+    }
+    return src;
+}
+
+/* internal function to return a source for the vbyte coded postings of a 
+ * term in the index, with word positions following each of them if positions
+ * is true */
+static struct search_list_src *term_pos_src(struct index *idx, 
+  struct term *term, int positions, struct alloc *alloc, unsigned int mem) {
+    struct search_list_src *docsrc,
+                           *possrc = NULL,
+                           *src;
+    unsigned int start,
+                 docsize;
+
+    if (!term_blocks(term) && (!positions || term_offsets(term))) {
+        return term_src(idx, term, alloc, mem);
+    }
+
+    /* split memory between the underlying sources and the buffer */
+    mem /= 2 + positions;
+    if (term_blocks(term) && (mem < SEARCH_BLOCK_BUFFER)) {
+        mem = SEARCH_BLOCK_BUFFER;
+    }
+    start = term->vocab.header.docwp_sep.skipsize;
+    docsize = term->vocab.header.docwp_sep.docsize;
+    if (term->vecmem) {
+        assert(term->vocab.location == VOCAB_LOCATION_VOCAB);
+        docsrc = memsrc_new((char *) term->vecmem + start, docsize, 0, 0);
+        if (positions) {
+            possrc = memsrc_new((char *) term->vecmem + start + docsize, 
+                term->vocab.size - start - docsize, 0, 0);
+        }
+    } else {
+        assert(term->vocab.location == VOCAB_LOCATION_FILE);
+        docsrc = disksrc_new(idx, idx->index_type, 
+            term->vocab.loc.file.fileno, term->vocab.loc.file.offset + start, 
+            docsize, 0, 0, alloc, mem);
+        if (positions) {
+            possrc = disksrc_new(idx, idx->index_type, 
+                term->vocab.loc.file.fileno, 
+                term->vocab.loc.file.offset + start + docsize, 
+                term->vocab.size - start - docsize, 0, 0, alloc, mem);
+        }
+    }
+
+    if (docsrc) {
+        docsrc->blocks = term_blocks(term);
+    }
+    if (docsrc && (possrc || !positions) 
+      && (src = possrc_new(docsrc, possrc, alloc, mem))) {
+        return src;
+    } else {
+        if (docsrc) {
+            docsrc->delet(docsrc);
+        }
+        if (possrc) {
+            possrc->delet(possrc);
+        }
+        return NULL;
+    }
+}
+
+/* internal function to find postings for a document ordered term that have
+ * been added to the index since it was last committed, and so aren't in its 
+ * vector yet, writing them into *live and their length into *len.  Returns 0 
+ * if there aren't any.  (If the index doesn't have segments, terms that only
+ * occur in these postings are given them as their vector by 
+ * index_querybuild, so they aren't found here.) */
+static int term_live(struct index *idx, struct term *term, const void **live,
+  unsigned int *len) {
+    unsigned int docs,
+                 occurs;
+    unsigned long int last;
+
+    return (idx->flags & INDEX_BUILT) && idx->post 
+      && postings_documents(idx->post)
+      && !VOCAB_IMPACT_ORDERED(term->vocab.type)
+      && postings_find(idx->post, term->term, live, len, &docs, &occurs, 
+        &last)
+      && (!term->vocab.size || (last > term->vocab.header.docwp.last));
+}
+
+/* internal function to return whether a document ordered term has postings
+ * in the segments of the index or in memory, which have to be read after its
+ * vector in the index */
+static int term_parts(struct index *idx, struct term *term) {
+    struct vocab_vector vv;
+    const void *live;
+    void *pagebuf;
+    unsigned int i,
+                 len,
+                 type;
+    int ret = 0;
+
+    if (term_live(idx, term, &live, &len)) {
+        return 1;
+    } else if (!idx->segs || !segments_len(idx->segs) 
+      || VOCAB_IMPACT_ORDERED(term->vocab.type)) {
+        return 0;
+    }
+
+    /* errors are left for partsrc_new to report */
+    if (!(pagebuf = malloc(idx->storage.pagesize))) {
+        return 1;
+    }
+    for (i = 0; !ret && (i < segments_len(idx->segs)); i++) {
+        ret = segments_find(idx->segs, i, term->term, str_len(term->term), 
+            pagebuf, &vv, &type) != 0;
+    }
+    free(pagebuf);
+    return ret;
+}
+
+/* internal function to copy the len bytes of in-memory postings at live, 
+ * which have word offsets following each of them, into buf, rebasing the 
+ * first document number so that they follow postings that end with document
+ * number last, and removing the offsets unless offsets is true.  Returns the 
+ * number of bytes written, which is never more than len. */
+static unsigned int live_recode(const void *live, unsigned int len,
+  unsigned long int last, int offsets, char *buf) {
+    struct vec src,
+               dst;
+    unsigned long int docno_d,
+                      f_dt,
+                      base = last + 1;
+    unsigned int scanned;
+    char *pos;
+
+    src.pos = (char *) live;
+    src.end = src.pos + len;
+    dst.pos = buf;
+    dst.end = buf + len;
+    while (vec_vbyte_read(&src, &docno_d) && vec_vbyte_read(&src, &f_dt)) {
+        /* rebasing only shrinks the first d-gap, so the output always 
+         * fits */
+        assert(docno_d >= base);
+        vec_vbyte_write(&dst, docno_d - base);
+        vec_vbyte_write(&dst, f_dt);
+        base = 0;
+
+        pos = src.pos;
+        if (vec_vbyte_scan(&src, f_dt, &scanned) != f_dt) {
+            break;
+        }
+        if (offsets) {
+            memcpy(dst.pos, pos, scanned);
+            dst.pos += scanned;
+        }
+    }
+    assert(!VEC_LEN(&src));
+    return dst.pos - buf;
+}
+
+/* smallest buffer given to a source of postings in a segment, since the 
+ * memory given to a term is worked out from the size of its vector in the 
+ * index */
+#define SEARCH_PART_BUFFER 4096
+
+/* source that serves the postings of a term in the index, followed by its 
+ * postings in each segment of the index that it occurs in (oldest first) and
+ * those that are still in memory (see term_parts) */
+struct partsrc {
+    struct search_list_src src;
+    struct search_list_src **part;   /* sources for each part, starting with
+                                      * the index (held after this struct, 
+                                      * along with the in-memory postings) */
+    unsigned int parts;              /* number of parts */
+    unsigned int curr;               /* part being read */
+};
+
+static enum search_ret partsrc_reset(struct search_list_src *src) {
+    struct partsrc *psrc = src->opaque;
+    enum search_ret ret = SEARCH_OK;
+    unsigned int i;
+
+    psrc->curr = 0;
+    for (i = 0; (ret == SEARCH_OK) && (i < psrc->parts); i++) {
+        ret = psrc->part[i]->reset(psrc->part[i]);
+    }
+    return ret;
+}
+
+static enum search_ret partsrc_read(struct search_list_src *src, 
+  unsigned int leftover, void **retbuf, unsigned int *retlen) {
+    struct partsrc *psrc = src->opaque;
+    enum search_ret ret;
+
+    while (psrc->curr < psrc->parts) {
+        ret = psrc->part[psrc->curr]->readlist(psrc->part[psrc->curr], 
+            leftover, retbuf, retlen);
+        if (ret != SEARCH_FINISH) {
+            return ret;
+        }
+
+        /* each part ends on a posting boundary, so nothing can be left over 
+         * from it */
+        assert(!leftover);
+        psrc->curr++;
+    }
+    return SEARCH_FINISH;
+}
+
+static enum search_ret partsrc_skip_to(struct search_list_src *src,
+  unsigned long int docno, unsigned long int *base,
+  unsigned long int *postings) {
+    struct partsrc *psrc = src->opaque;
+
+    /* only the index has skip tables */
+    if (!psrc->curr) {
+        return psrc->part[0]->skip_to(psrc->part[0], docno, base, postings);
+    }
+    return SEARCH_OK;
+}
+
+static void partsrc_delete(struct search_list_src *src) {
+    struct partsrc *psrc = src->opaque;
+    unsigned int i;
+
+    for (i = 0; i < psrc->parts; i++) {
+        psrc->part[i]->delet(psrc->part[i]);
+    }
+    free(psrc);
+}
+
+/* internal function to create a source that serves the postings of term from
+ * src (its vector in the index, which can't be block coded), followed by 
+ * those in segments and memory.  src is deleted if this fails. */
+static struct search_list_src *partsrc_new(struct index *idx, 
+  struct term *term, struct search_list_src *src, struct alloc *alloc, 
+  unsigned int mem) {
+    struct partsrc *psrc;
+    struct search_list_src *part;
+    struct vocab_vector vv;
+    const void *live = NULL;
+    void *pagebuf = NULL;
+    char *buf;
+    unsigned int i,
+                 segs = 0,
+                 len = 0,
+                 type;
+    unsigned long int last;
+    int found = 0;
+
+    assert(!src->blocks);
+    if (!term_live(idx, term, &live, &len)) {
+        live = NULL;
+        len = 0;
+    }
+    if (idx->segs && !VOCAB_IMPACT_ORDERED(term->vocab.type)) {
+        segs = segments_len(idx->segs);
+    }
+    if (!(psrc = malloc(sizeof(*psrc) + sizeof(*psrc->part) * (segs + 2) 
+        + len))
+      || (segs && !(pagebuf = malloc(idx->storage.pagesize)))) {
+        if (psrc) {
+            free(psrc);
+        }
+        src->delet(src);
+        return NULL;
+    }
+    psrc->src.opaque = psrc;
+    psrc->src.offsets = src->offsets;
+    psrc->src.blocks = 0;
+    psrc->src.delet = partsrc_delete;
+    psrc->src.reset = partsrc_reset;
+    psrc->src.readlist = partsrc_read;
+    psrc->src.skip_to = src->skip_to ? partsrc_skip_to : NULL;
+    psrc->part = (struct search_list_src **) (psrc + 1);
+    psrc->part[0] = src;
+    psrc->parts = 1;
+    psrc->curr = 0;
+    buf = (char *) (psrc->part + segs + 2);
+
+    /* each part carries on from the last document in the ones before it */
+    last = term->vocab.size ? term->vocab.header.docwp.last : -1;
+    for (i = 0; (found >= 0) && (i < segs); i++) {
+        if ((found = segments_find(idx->segs, i, term->term, 
+            str_len(term->term), pagebuf, &vv, &type)) > 0) {
+            /* segments always store word positions */
+            assert(src->offsets);
+            if ((part = disksrc_new(idx, type, vv.loc.file.fileno, 
+                vv.loc.file.offset, vv.size, 0, 1, alloc, 
+                mem > SEARCH_PART_BUFFER ? mem : SEARCH_PART_BUFFER))) {
+                psrc->part[psrc->parts++] = part;
+                last = vv.header.docwp.last;
+            } else {
+                found = -1;
+            }
+        }
+    }
+    if ((found >= 0) && live) {
+        if ((part = memsrc_new(buf, 
+            live_recode(live, len, last, src->offsets, buf), 0, 
+            src->offsets))) {
+            psrc->part[psrc->parts++] = part;
+        } else {
+            found = -1;
+        }
+    }
+    if (pagebuf) {
+        free(pagebuf);
+    }
+
+    if (found < 0) {
+        partsrc_delete(&psrc->src);
+        return NULL;
     }
+    return &psrc->src;
+}
+
+/* return a source for the postings of a term, which won't include word 
+ * positions if they're stored separately (unless the index has segments, 
+ * which always store them) */
+struct search_list_src *search_term_src(struct index *idx, struct term *term,
+  struct alloc *alloc, unsigned int mem) {
+    struct search_list_src *src;
+
+    if (!term_parts(idx, term)) {
+        return term_src(idx, term, alloc, mem);
+    }
+
+    /* postings in segments and memory are vbyte coded, so block coded 
+     * postings have to be decoded to go in front of them */
+    if ((src = term_pos_src(idx, term, idx->segs != NULL, alloc, mem))) {
+        src = partsrc_new(idx, term, src, alloc, mem);
+    }
+    return src;
+}
+
+/* internal function to return a source for the vbyte coded postings of a 
+ * term, with word positions following each of them if positions is true */
+static struct search_list_src *search_term_pos_src(struct index *idx, 
+  struct term *term, int positions, struct alloc *alloc, unsigned int mem) {
+    struct search_list_src *src;
+
+    if (!term_parts(idx, term)) {
+        return term_pos_src(idx, term, positions, alloc, mem);
+    }
+    if ((src = term_pos_src(idx, term, positions || idx->segs, alloc, 
+        mem))) {
+        src = partsrc_new(idx, term, src, alloc, mem);
+    }
+    return src;
 }
 
 /* internal function to return the correct source for a given term */
 struct search_list_src *search_conjunct_src(struct index *idx, 
   struct conjunct *conj, struct alloc *alloc, unsigned int memlimit) {
     if (conj->vecmem) {
-        /* memory source */
-        return memsrc_new(conj->vecmem, conj->vecsize);
+        /* memory source, which doesn't have offsets */
+        return memsrc_new(conj->vecmem, conj->vecsize, 0, 0);
     } else {
         /* source from term */
         return search_term_src(idx, &conj->term, alloc, memlimit);
@@ -0,0 +1,302 @@
+/* searchpool.c implements the concurrent query evaluation declared in
+ * searchpool.h.
+ *
+ * Submitted queries are kept in a list in submission order.  Worker threads
+ * take the oldest query that hasn't been started, evaluate it with
+ * index_search, and mark it done, while searchpool_next waits for the query
+ * at the head of the list to be done.  All of the thread-safety of evaluation
+ * itself comes from index_search.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "searchpool.h"
+
+#include "_index.h"
+
+#include "docmap.h"
+#include "str.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef MT_ZET
+#include <pthread.h>
+#endif /* MT_ZET */
+
+/* a submitted query */
+struct job {
+    struct searchpool_result res;    /* results (and query) */
+    unsigned long int startdoc;      /* number of results to skip */
+    unsigned long int len;           /* number of results requested */
+    int opts;                        /* options for index_search */
+    struct index_search_opt opt;     /* copy of options for index_search */
+    int done;                        /* whether the query has been
+                                      * evaluated */
+    struct job *next;                /* next query in submission order */
+};
+
+struct searchpool {
+    struct index *idx;               /* index being searched */
+    unsigned int threads;            /* number of worker threads */
+    struct job *head;                /* oldest uncollected query */
+    struct job *tail;                /* most recently submitted query */
+    struct job *next;                /* oldest query not yet started */
+    unsigned int pending;            /* number of uncollected queries */
+    int finish;                      /* whether workers should exit */
+#ifdef MT_ZET
+    pthread_t *thread;               /* worker threads */
+    pthread_mutex_t mutex;           /* protects everything above */
+    pthread_cond_t work;             /* signalled when a query is submitted
+                                      * or the pool is finishing */
+    pthread_cond_t done;             /* signalled when a query is done */
+#endif /* MT_ZET */
+};
+
+/* internal function to evaluate a query */
+static void evaluate(struct index *idx, struct job *job) {
+    struct timeval then,
+                   now;
+
+    gettimeofday(&then, NULL);
+    job->res.ok = index_search(idx, job->res.query, job->startdoc, job->len,
+        job->res.result, &job->res.results, &job->res.total_results,
+        &job->res.est, job->opts, &job->opt);
+    gettimeofday(&now, NULL);
+    job->res.seconds = (double) ((now.tv_sec - then.tv_sec)
+      + (now.tv_usec - (double) then.tv_usec) / 1000000.0);
+}
+
+static void job_delete(struct job *job) {
+    free(job->res.query);
+    free(job->res.result);
+    free(job);
+}
+
+#ifdef MT_ZET
+
+/* main loop of worker threads */
+static void *worker(void *vpool) {
+    struct searchpool *pool = vpool;
+    struct job *job;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->finish) {
+        if ((job = pool->next)) {
+            pool->next = job->next;
+            pthread_mutex_unlock(&pool->mutex);
+
+            evaluate(pool->idx, job);
+
+            pthread_mutex_lock(&pool->mutex);
+            job->done = 1;
+            pthread_cond_broadcast(&pool->done);
+        } else {
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+#endif /* MT_ZET */
+
+struct searchpool *searchpool_new(struct index *idx, unsigned int threads) {
+    struct searchpool *pool;
+
+#ifndef MT_ZET
+    threads = 1;
+#endif /* MT_ZET */
+
+    if (!(pool = malloc(sizeof(*pool)))) {
+        return NULL;
+    }
+    pool->idx = idx;
+    pool->threads = threads > 1 ? threads : 1;
+    pool->head = pool->tail = pool->next = NULL;
+    pool->pending = 0;
+    pool->finish = 0;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        unsigned int i;
+
+        /* the metrics ask the docmap to cache what they need, which isn't
+         * safe while other searches are reading it, so cache it all now */
+        if ((docmap_cache(idx->map, docmap_get_cache(idx->map)
+            | DOCMAP_CACHE_WORDS | DOCMAP_CACHE_WEIGHT) != DOCMAP_OK)
+          || !(pool->thread = malloc(sizeof(*pool->thread) * pool->threads))) {
+            free(pool);
+            return NULL;
+        }
+
+        pthread_mutex_init(&pool->mutex, NULL);
+        pthread_cond_init(&pool->work, NULL);
+        pthread_cond_init(&pool->done, NULL);
+        for (i = 0; i < pool->threads; i++) {
+            if (pthread_create(&pool->thread[i], NULL, worker, pool)) {
+                /* couldn't create all of them, make do with what we have */
+                break;
+            }
+        }
+
+        if (!i) {
+            pthread_cond_destroy(&pool->done);
+            pthread_cond_destroy(&pool->work);
+            pthread_mutex_destroy(&pool->mutex);
+            free(pool->thread);
+            free(pool);
+            return NULL;
+        }
+        pool->threads = i;
+    }
+#endif /* MT_ZET */
+
+    return pool;
+}
+
+void searchpool_delete(struct searchpool *pool) {
+    struct job *job;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        unsigned int i;
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->finish = 1;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->mutex);
+        for (i = 0; i < pool->threads; i++) {
+            pthread_join(pool->thread[i], NULL);
+        }
+
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->thread);
+    }
+#endif /* MT_ZET */
+
+    while ((job = pool->head)) {
+        pool->head = job->next;
+        job_delete(job);
+    }
+    free(pool);
+}
+
+enum searchpool_ret searchpool_submit(struct searchpool *pool,
+  const char *query, unsigned long int startdoc, unsigned long int len,
+  int opts, const struct index_search_opt *opt, void *userdata) {
+    struct job *job;
+
+    if (!(job = malloc(sizeof(*job)))) {
+        return SEARCHPOOL_ENOMEM;
+    }
+    job->res.query = str_dup(query);
+    job->res.result = malloc(sizeof(*job->res.result) * (len ? len : 1));
+    if (!job->res.query || !job->res.result) {
+        job_delete(job);
+        return SEARCHPOOL_ENOMEM;
+    }
+    job->res.userdata = userdata;
+    job->res.ok = 0;
+    job->res.results = 0;
+    job->res.total_results = 0.0;
+    job->res.est = 0;
+    job->res.seconds = 0.0;
+    job->startdoc = startdoc;
+    job->len = len;
+    job->opts = opts;
+    if (opt) {
+        memcpy(&job->opt, opt, sizeof(*opt));
+    } else {
+        memset(&job->opt, 0, sizeof(job->opt));
+    }
+    job->done = 0;
+    job->next = NULL;
+
+    if (pool->threads <= 1) {
+        /* evaluate it now */
+        evaluate(pool->idx, job);
+        job->done = 1;
+    }
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+    }
+#endif /* MT_ZET */
+
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    if (!pool->next && !job->done) {
+        pool->next = job;
+    }
+    pool->pending++;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+#endif /* MT_ZET */
+
+    return SEARCHPOOL_OK;
+}
+
+enum searchpool_ret searchpool_next(struct searchpool *pool,
+  struct searchpool_result **res) {
+    struct job *job;
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->head && !pool->head->done) {
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        }
+    }
+#endif /* MT_ZET */
+
+    if ((job = pool->head)) {
+        assert(job->done);
+        if (!(pool->head = job->next)) {
+            pool->tail = NULL;
+        }
+        pool->pending--;
+    }
+
+#ifdef MT_ZET
+    if (pool->threads > 1) {
+        pthread_mutex_unlock(&pool->mutex);
+    }
+#endif /* MT_ZET */
+
+    if (job) {
+        /* the results are the first member of the job, so hand them over
+         * and free the rest of it when they're deleted */
+        *res = &job->res;
+        return SEARCHPOOL_OK;
+    } else {
+        return SEARCHPOOL_EMPTY;
+    }
+}
+
+unsigned int searchpool_pending(const struct searchpool *pool) {
+    return pool->pending;
+}
+
+unsigned int searchpool_threads(const struct searchpool *pool) {
+    return pool->threads;
+}
+
+void searchpool_result_delete(struct searchpool_result *res) {
+    job_delete((struct job *) res);
+}
+
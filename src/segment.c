@@ -0,0 +1,1187 @@
+/* segment.c implements the segments declared in segment.h.
+ *
+ * Each segment gets fdset types of its own for its vector and vocabulary
+ * files, which are named after the index and the number the segment was
+ * given when it was written (index.s3.v.0, index.s3.vocab.0 and so on).
+ * Segments are written by a struct segwrite, which buffers vectors into the
+ * vector files and bulk loads the vocabulary as terms are added in order.
+ * Commits feed it the postings accumulated in memory, merges the
+ * concatenated vectors of the segments they replace.
+ *
+ * Searches hold a read lock on the segments, made from the mutex and a count
+ * of readers (the feature macros in firstinclude.h don't give us POSIX
+ * read-write locks).  Anything that changes the list of segments takes the
+ * write lock, which waits until there are no readers and holds the mutex
+ * until it's released.  Merges read their segments' vocabularies through
+ * private copies, since iterating over a btree changes it.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "segment.h"
+
+#include "_index.h"
+#include "_postings.h"
+
+#include "btbulk.h"
+#include "def.h"
+#include "error.h"
+#include "fdset.h"
+#include "iobtree.h"
+#include "mem.h"
+#include "postings.h"
+#include "str.h"
+#include "vec.h"
+#include "vocab.h"
+#include "zstdint.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef MT_ZET
+#include <pthread.h>
+
+#define SEGMENTS_LOCK(segs) pthread_mutex_lock(&(segs)->mutex)
+#define SEGMENTS_UNLOCK(segs) pthread_mutex_unlock(&(segs)->mutex)
+#else
+#define SEGMENTS_LOCK(segs)
+#define SEGMENTS_UNLOCK(segs)
+#endif /* MT_ZET */
+
+struct segment {
+    unsigned int id;                 /* number segment files are named by */
+    unsigned int vector_type;        /* fdset type of vector files */
+    unsigned int vocab_type;         /* fdset type of vocabulary files */
+    unsigned int vectors;            /* number of vector files */
+    unsigned int vocabs;             /* number of vocabulary files */
+    unsigned int root_fileno;        /* location of vocabulary root */
+    unsigned long int root_offset;
+    unsigned long int terms;         /* number of terms in vocabulary */
+    unsigned long int size;          /* total size of vectors */
+    struct iobtree *vocab;           /* vocabulary (or NULL once replaced) */
+    int written;                     /* whether segment has been recorded in
+                                      * the index parameters */
+};
+
+struct segments {
+    struct index *idx;               /* index the segments belong to */
+    char *name;                      /* base name of segment files */
+    struct segment **seg;            /* segments, oldest first */
+    unsigned int len;                /* number of segments */
+    unsigned int size;               /* capacity of seg array */
+    struct segment **retired;        /* written segments replaced by merges */
+    unsigned int retired_len;        /* number of retired segments */
+    unsigned int retired_size;       /* capacity of retired array */
+    unsigned int retired_written;    /* number of retired segments that the
+                                      * last segments_write left out */
+    unsigned int next_id;            /* id to give the next segment */
+#ifdef MT_ZET
+    pthread_mutex_t mutex;           /* protects everything above */
+    pthread_cond_t cond;             /* signalled when the lock counts or
+                                      * merge flags change */
+    unsigned int readers;            /* number of read locks held */
+    unsigned int writers;            /* number of write locks held or
+                                      * waited for */
+    pthread_t merger;                /* background merging thread */
+    int running;                     /* whether merger has been started */
+    int pending;                     /* whether segments have been added
+                                      * since merger last planned merges */
+    int finish;                      /* whether merger should exit once
+                                      * nothing is pending */
+#endif /* MT_ZET */
+};
+
+/* state for writing a segment */
+struct segwrite {
+    struct segments *segs;           /* segments it will be added to */
+    struct segment *seg;             /* segment being written */
+    int fd;                          /* current vector file (or -1) */
+    unsigned long int offset;        /* where buf goes in the vector file */
+    char *buf;                       /* buffered vector bytes */
+    unsigned int buflen;             /* number of bytes in buf */
+    unsigned int bufsize;            /* capacity of buf */
+    int vfd;                         /* current vocabulary file (or -1) */
+    unsigned long int voffset;       /* position of vfd */
+    struct btbulk bulk;              /* vocabulary bulk loader */
+};
+
+void segments_read_lock(struct segments *segs) {
+#ifdef MT_ZET
+    SEGMENTS_LOCK(segs);
+    while (segs->writers) {
+        pthread_cond_wait(&segs->cond, &segs->mutex);
+    }
+    segs->readers++;
+    SEGMENTS_UNLOCK(segs);
+#endif /* MT_ZET */
+}
+
+void segments_read_unlock(struct segments *segs) {
+#ifdef MT_ZET
+    SEGMENTS_LOCK(segs);
+    assert(segs->readers);
+    if (!--segs->readers) {
+        pthread_cond_broadcast(&segs->cond);
+    }
+    SEGMENTS_UNLOCK(segs);
+#endif /* MT_ZET */
+}
+
+/* internal function to lock the segments for changing them, which waits until
+ * no searches hold the read lock.  The mutex is held until write_unlock. */
+static void write_lock(struct segments *segs) {
+#ifdef MT_ZET
+    SEGMENTS_LOCK(segs);
+    segs->writers++;
+    while (segs->readers) {
+        pthread_cond_wait(&segs->cond, &segs->mutex);
+    }
+#endif /* MT_ZET */
+}
+
+static void write_unlock(struct segments *segs) {
+#ifdef MT_ZET
+    segs->writers--;
+    pthread_cond_broadcast(&segs->cond);
+    SEGMENTS_UNLOCK(segs);
+#endif /* MT_ZET */
+}
+
+/* internal function to append a segment to an array of them */
+static int append(struct segment ***arr, unsigned int *len,
+  unsigned int *size, struct segment *seg) {
+    void *ptr;
+
+    if (*len >= *size) {
+        if ((ptr = realloc(*arr, sizeof(**arr) * (*size * 2 + 1)))) {
+            *arr = ptr;
+            *size = *size * 2 + 1;
+        } else {
+            return 0;
+        }
+    }
+    (*arr)[(*len)++] = seg;
+    return 1;
+}
+
+/* internal function to create a segment numbered id, with fdset types for its
+ * files */
+static struct segment *segment_new(struct segments *segs, unsigned int id) {
+    struct segment *seg;
+    char suffix[50];
+
+    if (!(seg = malloc(sizeof(*seg)))) {
+        return NULL;
+    }
+    seg->id = id;
+    seg->vectors = seg->vocabs = 0;
+    seg->root_fileno = 0;
+    seg->root_offset = 0;
+    seg->terms = 0;
+    seg->size = 0;
+    seg->vocab = NULL;
+    seg->written = 0;
+
+    sprintf(suffix, "s%u." VECTORSUF, id);
+    if (fdset_create_new_type(segs->idx->fd, segs->name, suffix, 1,
+        &seg->vector_type) == FDSET_OK) {
+        sprintf(suffix, "s%u." VOCABSUF, id);
+        if (fdset_create_new_type(segs->idx->fd, segs->name, suffix, 1,
+            &seg->vocab_type) == FDSET_OK) {
+            return seg;
+        }
+    }
+    free(seg);
+    return NULL;
+}
+
+/* internal function to open the vocabulary of a segment */
+static struct iobtree *segment_vocab(struct segments *segs,
+  struct segment *seg) {
+    struct index *idx = segs->idx;
+
+    return iobtree_load_quick(idx->storage.pagesize,
+      idx->storage.btleaf_strategy, idx->storage.btnode_strategy, NULL,
+      idx->fd, seg->vocab_type, seg->root_fileno, seg->root_offset,
+      seg->terms);
+}
+
+/* internal function to close the files of a segment, which mustn't be in
+ * use */
+static void segment_close(struct segments *segs, struct segment *seg) {
+    unsigned int i;
+
+    if (seg->vocab) {
+        iobtree_delete(seg->vocab);
+        seg->vocab = NULL;
+    }
+    for (i = 0; i < seg->vectors; i++) {
+        fdset_close_file(segs->idx->fd, seg->vector_type, i);
+    }
+    for (i = 0; i < seg->vocabs; i++) {
+        fdset_close_file(segs->idx->fd, seg->vocab_type, i);
+    }
+}
+
+/* internal function to remove the files of a segment */
+static void segment_unlink(struct segments *segs, struct segment *seg) {
+    unsigned int i;
+
+    for (i = 0; i < seg->vectors; i++) {
+        fdset_unlink(segs->idx->fd, seg->vector_type, i);
+    }
+    for (i = 0; i < seg->vocabs; i++) {
+        fdset_unlink(segs->idx->fd, seg->vocab_type, i);
+    }
+}
+
+static void segment_delete(struct segment *seg) {
+    if (seg->vocab) {
+        iobtree_delete(seg->vocab);
+    }
+    free(seg);
+}
+
+struct segments *segments_new(struct index *idx) {
+    struct segments *segs;
+    char name[FILENAME_MAX + 1];
+    unsigned int len,
+                 suflen = str_len("." PARAMSUF);
+    int write;
+
+    if (!(segs = malloc(sizeof(*segs)))) {
+        return NULL;
+    }
+
+    /* segment files are named after the parameter file, without its
+     * suffix */
+    if ((fdset_type_name(idx->fd, idx->param_type, name, FILENAME_MAX, &len,
+        &write) != FDSET_OK)
+      || (len <= suflen)
+      || !(segs->name = str_ndup(name, len - suflen))) {
+        free(segs);
+        return NULL;
+    }
+
+    segs->idx = idx;
+    segs->seg = segs->retired = NULL;
+    segs->len = segs->size = 0;
+    segs->retired_len = segs->retired_size = segs->retired_written = 0;
+    segs->next_id = 0;
+#ifdef MT_ZET
+    pthread_mutex_init(&segs->mutex, NULL);
+    pthread_cond_init(&segs->cond, NULL);
+    segs->readers = segs->writers = 0;
+    segs->running = segs->pending = segs->finish = 0;
+#endif /* MT_ZET */
+    return segs;
+}
+
+unsigned int segments_len(struct segments *segs) {
+    return segs->len;
+}
+
+int segments_find(struct segments *segs, unsigned int seg, const char *term,
+  unsigned int termlen, void *pagebuf, struct vocab_vector *vv,
+  unsigned int *type) {
+    struct vec v;
+    unsigned int len;
+
+    assert(seg < segs->len);
+    if (!(v.pos = iobtree_find_r(segs->seg[seg]->vocab, term, termlen,
+        pagebuf, &len))) {
+        return 0;
+    }
+    v.end = v.pos + len;
+    if (vocab_decode(vv, &v) != VOCAB_OK) {
+        return -EINVAL;
+    }
+    assert(vv->type == VOCAB_VTYPE_DOCWP);
+    assert(vv->location == VOCAB_LOCATION_FILE);
+    *type = segs->seg[seg]->vector_type;
+    return 1;
+}
+
+/* internal function to start writing a new segment, buffering up to bufsize
+ * bytes of output */
+static enum segment_ret segwrite_new(struct segments *segs,
+  struct segwrite *w, unsigned int bufsize) {
+    struct index *idx = segs->idx;
+    unsigned int id;
+
+    w->segs = segs;
+    w->fd = w->vfd = -1;
+    w->offset = w->voffset = 0;
+    w->buflen = 0;
+    w->bufsize = bufsize;
+    w->seg = NULL;
+
+    SEGMENTS_LOCK(segs);
+    id = segs->next_id++;
+    SEGMENTS_UNLOCK(segs);
+
+    if (!(w->buf = malloc(bufsize))) {
+        return SEGMENT_ENOMEM;
+    }
+    if (!(w->seg = segment_new(segs, id))) {
+        free(w->buf);
+        return SEGMENT_ERR;
+    }
+    if ((w->fd = fdset_create(idx->fd, w->seg->vector_type, 0)) >= 0) {
+        w->seg->vectors = 1;
+        if ((w->vfd = fdset_create(idx->fd, w->seg->vocab_type, 0)) >= 0) {
+            w->seg->vocabs = 1;
+            if (btbulk_new(idx->storage.pagesize, idx->storage.max_filesize,
+                idx->storage.btleaf_strategy, idx->storage.btnode_strategy,
+                1.0, bufsize / (4 * idx->storage.pagesize) + 1, &w->bulk)) {
+                w->bulk.fileno = 0;
+                w->bulk.offset = 0;
+                return SEGMENT_OK;
+            }
+        }
+    }
+
+    if (w->fd >= 0) {
+        fdset_unpin(idx->fd, w->seg->vector_type, w->seg->vectors - 1, w->fd);
+    }
+    if (w->vfd >= 0) {
+        fdset_unpin(idx->fd, w->seg->vocab_type, w->seg->vocabs - 1, w->vfd);
+    }
+    segment_unlink(segs, w->seg);
+    segment_delete(w->seg);
+    free(w->buf);
+    return SEGMENT_EIO;
+}
+
+/* internal function to write the buffered vector bytes out */
+static int segwrite_flush(struct segwrite *w) {
+    if (w->buflen) {
+        if (index_atomic_write(w->fd, w->buf, w->buflen)
+          != (ssize_t) w->buflen) {
+            return 0;
+        }
+        w->offset += w->buflen;
+        w->buflen = 0;
+    }
+    return 1;
+}
+
+/* internal function to start a vector of size bytes, writing where it will
+ * be stored into *fileno and *offset.  Vectors don't span files. */
+static int segwrite_vector(struct segwrite *w, unsigned long int size,
+  unsigned int *fileno, unsigned long int *offset) {
+    struct index *idx = w->segs->idx;
+    struct segment *seg = w->seg;
+
+    if ((w->offset + w->buflen)
+      && (w->offset + w->buflen + size > idx->storage.max_filesize)) {
+        if (!segwrite_flush(w)) {
+            return 0;
+        }
+        fdset_unpin(idx->fd, seg->vector_type, seg->vectors - 1, w->fd);
+        if ((w->fd = fdset_create(idx->fd, seg->vector_type, seg->vectors))
+          < 0) {
+            return 0;
+        }
+        seg->vectors++;
+        w->offset = 0;
+    }
+
+    *fileno = seg->vectors - 1;
+    *offset = w->offset + w->buflen;
+    seg->size += size;
+    return 1;
+}
+
+/* internal function to write len bytes of the current vector */
+static int segwrite_bytes(struct segwrite *w, const void *data,
+  unsigned int len) {
+    if (w->buflen + len > w->bufsize) {
+        if (!segwrite_flush(w)) {
+            return 0;
+        }
+        if (len >= w->bufsize) {
+            if (index_atomic_write(w->fd, (void *) data, len)
+              != (ssize_t) len) {
+                return 0;
+            }
+            w->offset += len;
+            return 1;
+        }
+    }
+    memcpy(w->buf + w->buflen, data, len);
+    w->buflen += len;
+    return 1;
+}
+
+/* internal function to do what the vocabulary bulk loader asked for by
+ * returning ret (BTBULK_WRITE or BTBULK_FLUSH) */
+static int segwrite_bulk(struct segwrite *w, int ret) {
+    struct index *idx = w->segs->idx;
+    struct segment *seg = w->seg;
+
+    switch (ret) {
+    case BTBULK_WRITE:
+        assert(w->bulk.fileno == seg->vocabs - 1);
+        if (w->bulk.offset != w->voffset) {
+            if (lseek(w->vfd, w->bulk.offset, SEEK_SET)
+              != (off_t) w->bulk.offset) {
+                return 0;
+            }
+            w->voffset = w->bulk.offset;
+        }
+        if (index_atomic_write(w->vfd, w->bulk.output.write.next_out,
+            w->bulk.output.write.avail_out)
+          != (ssize_t) w->bulk.output.write.avail_out) {
+            return 0;
+        }
+        w->bulk.offset += w->bulk.output.write.avail_out;
+        w->voffset = w->bulk.offset;
+        return 1;
+
+    case BTBULK_FLUSH:
+        fdset_unpin(idx->fd, seg->vocab_type, seg->vocabs - 1, w->vfd);
+        if ((w->vfd = fdset_create(idx->fd, seg->vocab_type, seg->vocabs))
+          < 0) {
+            return 0;
+        }
+        w->bulk.fileno = seg->vocabs++;
+        w->bulk.offset = w->voffset = 0;
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+/* internal function to add term (of length termlen) to the vocabulary of the
+ * segment, with vocabulary entry vv */
+static int segwrite_term(struct segwrite *w, const char *term,
+  unsigned int termlen, struct vocab_vector *vv) {
+    struct vec v;
+    int ret;
+
+    vv->loc.file.capacity = vv->size;
+    w->bulk.term = term;
+    w->bulk.termlen = termlen;
+    w->bulk.datasize = vocab_len(vv);
+    while ((ret = btbulk_insert(&w->bulk)) != BTBULK_OK) {
+        if (!segwrite_bulk(w, ret)) {
+            return 0;
+        }
+    }
+    v.pos = w->bulk.output.ok.data;
+    v.end = v.pos + w->bulk.datasize;
+    if (vocab_encode(vv, &v) != VOCAB_OK) {
+        return 0;
+    }
+    w->seg->terms++;
+    return 1;
+}
+
+/* internal function to abandon writing a segment, removing its files */
+static void segwrite_abort(struct segwrite *w) {
+    struct index *idx = w->segs->idx;
+
+    if (w->fd >= 0) {
+        fdset_unpin(idx->fd, w->seg->vector_type, w->seg->vectors - 1, w->fd);
+    }
+    if (w->vfd >= 0) {
+        fdset_unpin(idx->fd, w->seg->vocab_type, w->seg->vocabs - 1, w->vfd);
+    }
+    btbulk_delete(&w->bulk);
+    segment_unlink(w->segs, w->seg);
+    segment_delete(w->seg);
+    free(w->buf);
+}
+
+/* internal function to finish writing a segment, returning it (with its
+ * vocabulary open) or NULL on failure, in which case it's abandoned */
+static struct segment *segwrite_finish(struct segwrite *w) {
+    struct index *idx = w->segs->idx;
+    struct segment *seg = w->seg;
+    int ret;
+
+    if (!segwrite_flush(w)) {
+        segwrite_abort(w);
+        return NULL;
+    }
+    fdset_unpin(idx->fd, seg->vector_type, seg->vectors - 1, w->fd);
+    w->fd = -1;
+
+    while (((ret = btbulk_finalise(&w->bulk, &seg->root_fileno,
+        &seg->root_offset)) != BTBULK_FINISH) && (ret != BTBULK_OK)) {
+        if (!segwrite_bulk(w, ret)) {
+            segwrite_abort(w);
+            return NULL;
+        }
+    }
+    fdset_unpin(idx->fd, seg->vocab_type, seg->vocabs - 1, w->vfd);
+    w->vfd = -1;
+
+    if (!(seg->vocab = segment_vocab(w->segs, seg))) {
+        segwrite_abort(w);
+        return NULL;
+    }
+    btbulk_delete(&w->bulk);
+    free(w->buf);
+    return seg;
+}
+
+/* internal function to find the last document number in the vector of term
+ * (of length termlen) in the index and the segments, writing it into *last
+ * (or (unsigned long int) -1 if the term doesn't occur in them) */
+static int prior_last(struct segments *segs, const char *term,
+  unsigned int termlen, void *pagebuf, unsigned long int *last) {
+    struct vocab_vector vv;
+    struct vec v;
+    unsigned int i,
+                 len,
+                 type;
+    int ret;
+
+    for (i = segs->len; i > 0; i--) {
+        if ((ret = segments_find(segs, i - 1, term, termlen, pagebuf, &vv,
+            &type)) < 0) {
+            return 0;
+        } else if (ret) {
+            *last = vv.header.docwp.last;
+            return 1;
+        }
+    }
+
+    if ((v.pos = iobtree_find_r(segs->idx->vocab, term, termlen, pagebuf,
+        &len))) {
+        v.end = v.pos + len;
+        while ((ret = vocab_decode(&vv, &v)) == VOCAB_OK) {
+            if (!VOCAB_IMPACT_ORDERED(vv.type)) {
+                /* all document ordered types share the header layout */
+                *last = vv.header.doc.last;
+                return 1;
+            }
+        }
+        if (ret != VOCAB_END) {
+            return 0;
+        }
+    }
+    *last = -1;
+    return 1;
+}
+
+/* internal function to add a finished segment as the newest one */
+static enum segment_ret add(struct segments *segs, struct segment *seg) {
+    int ok;
+
+    write_lock(segs);
+    ok = append(&segs->seg, &segs->len, &segs->size, seg);
+    write_unlock(segs);
+    return ok ? SEGMENT_OK : SEGMENT_ENOMEM;
+}
+
+/* internal function to return the tier of a segment holding size bytes of
+ * postings */
+static unsigned int tier(unsigned long int size) {
+    unsigned int t = 0;
+
+    while (size >= SEGMENT_TIER_BASE) {
+        size /= SEGMENT_MERGE_FACTOR;
+        t++;
+    }
+    return t;
+}
+
+/* internal function to decide which segments to merge next, writing them into
+ * merging and returning how many there are (0 if there's nothing to merge).
+ * The mutex must be held. */
+static unsigned int merge_plan(struct segments *segs,
+  struct segment **merging) {
+    unsigned int i,
+                 t;
+
+    if (segs->len < SEGMENT_MERGE_FACTOR) {
+        return 0;
+    }
+    t = tier(segs->seg[segs->len - 1]->size);
+    for (i = 0; i < SEGMENT_MERGE_FACTOR; i++) {
+        merging[i] = segs->seg[segs->len - SEGMENT_MERGE_FACTOR + i];
+        if (tier(merging[i]->size) != t) {
+            return 0;
+        }
+    }
+    return SEGMENT_MERGE_FACTOR;
+}
+
+/* position in the vocabulary of a segment being merged */
+struct cursor {
+    struct segment *seg;             /* segment */
+    struct iobtree *vocab;           /* private copy of its vocabulary */
+    unsigned int state[3];           /* iteration state */
+    const char *term;                /* current term (or NULL at the end) */
+    unsigned int termlen;            /* length of current term */
+    struct vocab_vector vv;          /* vocabulary entry of current term */
+};
+
+/* internal function to move a cursor to the next term */
+static int cursor_next(struct cursor *cur) {
+    struct vec v;
+    void *data;
+    unsigned int len;
+
+    if (!(cur->term = iobtree_next_term(cur->vocab, cur->state,
+        &cur->termlen, &data, &len))) {
+        return 1;
+    }
+    v.pos = data;
+    v.end = v.pos + len;
+    return vocab_decode(&cur->vv, &v) == VOCAB_OK;
+}
+
+/* internal function to copy the vector described by vv from segment seg to
+ * the segment being written, through buf (of size bufsize) */
+static int copy_vector(struct segwrite *w, struct segment *seg,
+  struct vocab_vector *vv, char *buf, unsigned int bufsize) {
+    struct fdset *fds = w->segs->idx->fd;
+    unsigned long int remaining = vv->size;
+    unsigned int len;
+    ssize_t ret;
+    int fd;
+
+    if ((fd = fdset_pin(fds, seg->vector_type, vv->loc.file.fileno,
+        vv->loc.file.offset, SEEK_SET)) < 0) {
+        return 0;
+    }
+    while (remaining) {
+        len = remaining < bufsize ? remaining : bufsize;
+        if (((ret = index_atomic_read(fd, buf, len)) != (ssize_t) len)
+          || !segwrite_bytes(w, buf, len)) {
+            fdset_unpin(fds, seg->vector_type, vv->loc.file.fileno, fd);
+            return 0;
+        }
+        remaining -= len;
+    }
+    fdset_unpin(fds, seg->vector_type, vv->loc.file.fileno, fd);
+    return 1;
+}
+
+/* internal function to replace the n consecutive segments in merging with
+ * seg.  Replaced segments that have been written are retired until the
+ * index parameters stop referring to them, the rest are removed. */
+static enum segment_ret replace(struct segments *segs,
+  struct segment **merging, unsigned int n, struct segment *seg) {
+    unsigned int i,
+                 j;
+
+    write_lock(segs);
+
+    /* make sure there's room to retire them all first, so that this can't
+     * fail halfway */
+    while (segs->retired_size < segs->retired_len + n) {
+        void *ptr = realloc(segs->retired,
+            sizeof(*segs->retired) * (segs->retired_size * 2 + n));
+        if (!ptr) {
+            write_unlock(segs);
+            return SEGMENT_ENOMEM;
+        }
+        segs->retired = ptr;
+        segs->retired_size = segs->retired_size * 2 + n;
+    }
+
+    for (i = 0; (i < segs->len) && (segs->seg[i] != merging[0]); i++) ;
+    assert(i + n <= segs->len);
+    for (j = 0; j < n; j++) {
+        assert(segs->seg[i + j] == merging[j]);
+        segment_close(segs, merging[j]);
+        if (merging[j]->written) {
+            segs->retired[segs->retired_len++] = merging[j];
+        } else {
+            segment_unlink(segs, merging[j]);
+            segment_delete(merging[j]);
+        }
+    }
+    segs->seg[i] = seg;
+    memmove(&segs->seg[i + 1], &segs->seg[i + n],
+      sizeof(*segs->seg) * (segs->len - i - n));
+    segs->len -= n - 1;
+
+    write_unlock(segs);
+    return SEGMENT_OK;
+}
+
+/* internal function to merge the n consecutive segments in merging (oldest
+ * first) into a new segment that replaces them */
+static enum segment_ret merge(struct segments *segs,
+  struct segment **merging, unsigned int n) {
+    struct index *idx = segs->idx;
+    struct cursor cur[SEGMENT_MERGE_FACTOR];
+    struct segwrite w;
+    struct segment *seg;
+    struct vocab_vector vv;
+    char term[TERMLEN_MAX + 1];
+    char *buf;
+    unsigned int i,
+                 termlen,
+                 bufsize = idx->storage.pagesize * 16,
+                 min;
+    unsigned long int size;
+    enum segment_ret ret = SEGMENT_OK;
+
+    assert(n <= SEGMENT_MERGE_FACTOR);
+    if (!(buf = malloc(bufsize))) {
+        return SEGMENT_ENOMEM;
+    }
+    for (i = 0; i < n; i++) {
+        cur[i].seg = merging[i];
+        cur[i].state[0] = cur[i].state[1] = cur[i].state[2] = 0;
+        if (!(cur[i].vocab = segment_vocab(segs, merging[i]))
+          || !cursor_next(&cur[i])) {
+            ret = SEGMENT_EIO;
+            n = i + !!cur[i].vocab;
+            goto out;
+        }
+    }
+    if ((ret = segwrite_new(segs, &w, idx->storage.pagesize * 64))
+      != SEGMENT_OK) {
+        goto out;
+    }
+
+    while (1) {
+        /* find the smallest term */
+        for (min = n, i = 0; i < n; i++) {
+            if (cur[i].term && ((min == n)
+              || (str_nncmp(cur[i].term, cur[i].termlen, cur[min].term,
+                  cur[min].termlen) < 0))) {
+                min = i;
+            }
+        }
+        if (min == n) {
+            break;
+        }
+        termlen = cur[min].termlen;
+        assert(termlen <= TERMLEN_MAX);
+        memcpy(term, cur[min].term, termlen);
+
+        /* its vector is the concatenation of its vectors in each segment, in
+         * order */
+        for (size = 0, i = 0; i < n; i++) {
+            if (cur[i].term && !str_nncmp(cur[i].term, cur[i].termlen, term,
+                termlen)) {
+                size += cur[i].vv.size;
+            }
+        }
+        vv.attr = VOCAB_ATTRIBUTES_NONE;
+        vv.attribute = 0;
+        vv.type = VOCAB_VTYPE_DOCWP;
+        vv.location = VOCAB_LOCATION_FILE;
+        vv.size = size;
+        vv.header.docwp.docs = vv.header.docwp.occurs = 0;
+        if (!segwrite_vector(&w, size, &vv.loc.file.fileno,
+            &vv.loc.file.offset)) {
+            ret = SEGMENT_EIO;
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (cur[i].term && !str_nncmp(cur[i].term, cur[i].termlen, term,
+                termlen)) {
+                if (!copy_vector(&w, cur[i].seg, &cur[i].vv, buf, bufsize)) {
+                    ret = SEGMENT_EIO;
+                    break;
+                }
+                vv.header.docwp.docs += cur[i].vv.header.docwp.docs;
+                vv.header.docwp.occurs += cur[i].vv.header.docwp.occurs;
+                vv.header.docwp.last = cur[i].vv.header.docwp.last;
+                if (!cursor_next(&cur[i])) {
+                    ret = SEGMENT_EIO;
+                    break;
+                }
+            }
+        }
+        if ((ret != SEGMENT_OK) || !segwrite_term(&w, term, termlen, &vv)) {
+            ret = SEGMENT_EIO;
+            break;
+        }
+    }
+
+    if (ret != SEGMENT_OK) {
+        segwrite_abort(&w);
+    } else if (!(seg = segwrite_finish(&w))) {
+        ret = SEGMENT_EIO;
+    } else if ((ret = replace(segs, merging, n, seg)) != SEGMENT_OK) {
+        segment_close(segs, seg);
+        segment_unlink(segs, seg);
+        segment_delete(seg);
+    }
+
+out:
+    for (i = 0; i < n; i++) {
+        if (cur[i].vocab) {
+            iobtree_delete(cur[i].vocab);
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+/* internal function to perform merges until the segments are in tiers
+ * again */
+static enum segment_ret merge_tiers(struct segments *segs) {
+    struct segment *merging[SEGMENT_MERGE_FACTOR];
+    unsigned int n;
+    enum segment_ret ret = SEGMENT_OK;
+
+    do {
+        SEGMENTS_LOCK(segs);
+        n = merge_plan(segs, merging);
+        SEGMENTS_UNLOCK(segs);
+    } while (n && ((ret = merge(segs, merging, n)) == SEGMENT_OK));
+    return ret;
+}
+
+#ifdef MT_ZET
+/* background merging thread, which merges whenever segments are added until
+ * it's asked to finish */
+static void *merger(void *opaque) {
+    struct segments *segs = opaque;
+
+    SEGMENTS_LOCK(segs);
+    while (segs->pending || !segs->finish) {
+        if (segs->pending) {
+            segs->pending = 0;
+            SEGMENTS_UNLOCK(segs);
+            if (merge_tiers(segs) != SEGMENT_OK) {
+                /* the segments are still usable, just not merged */
+                ERROR("merging segments");
+            }
+            SEGMENTS_LOCK(segs);
+        } else {
+            pthread_cond_wait(&segs->cond, &segs->mutex);
+        }
+    }
+    SEGMENTS_UNLOCK(segs);
+    return NULL;
+}
+#endif /* MT_ZET */
+
+/* internal function to arrange for merges after a segment is added */
+static enum segment_ret schedule(struct segments *segs) {
+#ifdef MT_ZET
+    SEGMENTS_LOCK(segs);
+    segs->pending = 1;
+    if (!segs->running) {
+        segs->finish = 0;
+        if (pthread_create(&segs->merger, NULL, merger, segs)) {
+            /* merge in this thread instead */
+            segs->pending = 0;
+            SEGMENTS_UNLOCK(segs);
+            return merge_tiers(segs);
+        }
+        segs->running = 1;
+    }
+    pthread_cond_broadcast(&segs->cond);
+    SEGMENTS_UNLOCK(segs);
+    return SEGMENT_OK;
+#else
+    return merge_tiers(segs);
+#endif /* MT_ZET */
+}
+
+enum segment_ret segments_commit(struct segments *segs,
+  struct postings *post) {
+    struct index *idx = segs->idx;
+    struct postings_node **nodes,
+                         *node;
+    struct segwrite w;
+    struct segment *seg;
+    struct vocab_vector vv;
+    struct vec v;
+    char first[VEC_VBYTE_MAX];
+    unsigned long int docno,
+                      last;
+    unsigned int i,
+                 n,
+                 termlen,
+                 firstlen;
+    void *pagebuf;
+    enum segment_ret ret = SEGMENT_OK;
+
+    if (!post->docs || !post->dterms) {
+        return SEGMENT_OK;
+    }
+
+    /* collect the terms that occur in documents and sort them */
+    if (!(nodes = malloc(sizeof(*nodes) * post->dterms))) {
+        return SEGMENT_ENOMEM;
+    }
+    for (n = 0, i = 0; i < post->tblsize; i++) {
+        for (node = post->hash[i]; node; node = node->next) {
+            if (node->docs) {
+                assert(n < post->dterms);
+                nodes[n++] = node;
+            }
+        }
+    }
+    qsort(nodes, n, sizeof(*nodes), post_cmp);
+
+    if (!(pagebuf = malloc(idx->storage.pagesize))) {
+        free(nodes);
+        return SEGMENT_ENOMEM;
+    }
+    if ((ret = segwrite_new(segs, &w, idx->storage.pagesize * 64))
+      != SEGMENT_OK) {
+        free(pagebuf);
+        free(nodes);
+        return ret;
+    }
+
+    /* merges may replace the segments we're looking terms up in */
+    segments_read_lock(segs);
+    for (i = 0; i < n; i++) {
+        node = nodes[i];
+        termlen = str_len(node->term);
+
+        /* recode the first document number as a gap from the last document
+         * the term occurs in so far */
+        v.pos = node->vecmem;
+        v.end = node->vec.pos;
+        if (!vec_vbyte_read(&v, &docno)
+          || !prior_last(segs, node->term, termlen, pagebuf, &last)) {
+            ret = SEGMENT_ERR;
+            break;
+        }
+        docno -= last + 1;
+        firstlen = vec_vbyte_len(docno);
+        {
+            struct vec fv;
+
+            fv.pos = first;
+            fv.end = first + VEC_VBYTE_MAX;
+            vec_vbyte_write(&fv, docno);
+        }
+
+        vv.attr = VOCAB_ATTRIBUTES_NONE;
+        vv.attribute = 0;
+        vv.type = VOCAB_VTYPE_DOCWP;
+        vv.location = VOCAB_LOCATION_FILE;
+        vv.size = firstlen + VEC_LEN(&v);
+        vv.header.docwp.docs = node->docs;
+        vv.header.docwp.occurs = node->occurs;
+        vv.header.docwp.last = node->last_docno;
+        if (!segwrite_vector(&w, vv.size, &vv.loc.file.fileno,
+            &vv.loc.file.offset)
+          || !segwrite_bytes(&w, first, firstlen)
+          || !segwrite_bytes(&w, v.pos, VEC_LEN(&v))
+          || !segwrite_term(&w, node->term, termlen, &vv)) {
+            ret = SEGMENT_EIO;
+            break;
+        }
+    }
+    segments_read_unlock(segs);
+    free(pagebuf);
+    free(nodes);
+
+    if (ret != SEGMENT_OK) {
+        segwrite_abort(&w);
+        return ret;
+    } else if (!(seg = segwrite_finish(&w))) {
+        return SEGMENT_EIO;
+    } else if ((ret = add(segs, seg)) != SEGMENT_OK) {
+        segment_close(segs, seg);
+        segment_unlink(segs, seg);
+        segment_delete(seg);
+        return ret;
+    }
+
+    return schedule(segs);
+}
+
+enum segment_ret segments_read(struct segments *segs, FILE *fp) {
+    struct segment *seg;
+    uint32_t tmp[9];
+    unsigned int i,
+                 j,
+                 len,
+                 vals[9];
+
+    if (!fread(tmp, sizeof(*tmp) * 2, 1, fp)) {
+        return SEGMENT_EIO;
+    }
+    for (j = 0; j < 2; j++) {
+        uint32_t val;
+
+        mem_ntoh(&val, &tmp[j], sizeof(val));
+        vals[j] = val;
+    }
+    segs->next_id = vals[0];
+    len = vals[1];
+
+    for (i = 0; i < len; i++) {
+        if (!fread(tmp, sizeof(tmp), 1, fp)) {
+            return SEGMENT_EIO;
+        }
+        for (j = 0; j < 9; j++) {
+            uint32_t val;
+
+            mem_ntoh(&val, &tmp[j], sizeof(val));
+            vals[j] = val;
+        }
+        if (!(seg = segment_new(segs, vals[0]))) {
+            return SEGMENT_ERR;
+        }
+        seg->vectors = vals[1];
+        seg->vocabs = vals[2];
+        seg->root_fileno = vals[3];
+        seg->root_offset = vals[4];
+        seg->terms = vals[5];
+        seg->size = vals[6] + ((unsigned long int) vals[7] << 16 << 16);
+        seg->written = 1;
+        assert(vals[8] == 0);
+        if (!(seg->vocab = segment_vocab(segs, seg))
+          || !append(&segs->seg, &segs->len, &segs->size, seg)) {
+            segment_delete(seg);
+            return SEGMENT_ERR;
+        }
+    }
+    return SEGMENT_OK;
+}
+
+enum segment_ret segments_write(struct segments *segs, FILE *fp) {
+    struct segment *seg;
+    uint32_t tmp[9];
+    unsigned int i,
+                 j;
+    unsigned long int vals[9];
+    enum segment_ret ret = SEGMENT_OK;
+
+    /* merges can't replace segments while we're writing them down */
+    write_lock(segs);
+
+    vals[0] = segs->next_id;
+    vals[1] = segs->len;
+    for (j = 0; j < 2; j++) {
+        uint32_t val = vals[j];
+
+        mem_hton(&tmp[j], &val, sizeof(val));
+    }
+    if (!fwrite(tmp, sizeof(*tmp) * 2, 1, fp)) {
+        ret = SEGMENT_EIO;
+    }
+
+    for (i = 0; (ret == SEGMENT_OK) && (i < segs->len); i++) {
+        seg = segs->seg[i];
+        vals[0] = seg->id;
+        vals[1] = seg->vectors;
+        vals[2] = seg->vocabs;
+        vals[3] = seg->root_fileno;
+        vals[4] = seg->root_offset;
+        vals[5] = seg->terms;
+        vals[6] = seg->size & 0xffffffff;
+        vals[7] = (seg->size >> 16) >> 16;
+        vals[8] = 0;                   /* reserved */
+        for (j = 0; j < 9; j++) {
+            uint32_t val = vals[j];
+
+            mem_hton(&tmp[j], &val, sizeof(val));
+        }
+        if (!fwrite(tmp, sizeof(tmp), 1, fp)) {
+            ret = SEGMENT_EIO;
+        }
+    }
+
+    if (ret == SEGMENT_OK) {
+        for (i = 0; i < segs->len; i++) {
+            segs->seg[i]->written = 1;
+        }
+        segs->retired_written = segs->retired_len;
+    }
+    write_unlock(segs);
+    return ret;
+}
+
+void segments_written(struct segments *segs) {
+    unsigned int i;
+
+    SEGMENTS_LOCK(segs);
+    for (i = 0; i < segs->retired_written; i++) {
+        segment_unlink(segs, segs->retired[i]);
+        segment_delete(segs->retired[i]);
+    }
+    if (segs->retired_written) {
+        memmove(segs->retired, segs->retired + segs->retired_written,
+          sizeof(*segs->retired) 
+            * (segs->retired_len - segs->retired_written));
+    }
+    segs->retired_len -= segs->retired_written;
+    segs->retired_written = 0;
+    SEGMENTS_UNLOCK(segs);
+}
+
+int segments_finish(struct segments *segs) {
+    unsigned int i;
+    int changed = 0;
+
+#ifdef MT_ZET
+    SEGMENTS_LOCK(segs);
+    if (segs->running) {
+        segs->finish = 1;
+        pthread_cond_broadcast(&segs->cond);
+        SEGMENTS_UNLOCK(segs);
+        pthread_join(segs->merger, NULL);
+        SEGMENTS_LOCK(segs);
+        segs->running = 0;
+    }
+    SEGMENTS_UNLOCK(segs);
+#endif /* MT_ZET */
+
+    SEGMENTS_LOCK(segs);
+    for (i = 0; i < segs->len; i++) {
+        if (!segs->seg[i]->written) {
+            changed = 1;
+        }
+    }
+    SEGMENTS_UNLOCK(segs);
+    return changed;
+}
+
+void segments_delete(struct segments *segs) {
+    unsigned int i;
+
+    segments_finish(segs);
+    for (i = 0; i < segs->len; i++) {
+        if (!segs->seg[i]->written) {
+            segment_close(segs, segs->seg[i]);
+            segment_unlink(segs, segs->seg[i]);
+        }
+        segment_delete(segs->seg[i]);
+    }
+    for (i = 0; i < segs->retired_len; i++) {
+        segment_delete(segs->retired[i]);
+    }
+    if (segs->seg) {
+        free(segs->seg);
+    }
+    if (segs->retired) {
+        free(segs->retired);
+    }
+#ifdef MT_ZET
+    pthread_mutex_destroy(&segs->mutex);
+    pthread_cond_destroy(&segs->cond);
+#endif /* MT_ZET */
+    free(segs->name);
+    free(segs);
+}
+
+void segments_rm(struct segments *segs) {
+    unsigned int i;
+
+    segments_finish(segs);
+    for (i = 0; i < segs->len; i++) {
+        segment_close(segs, segs->seg[i]);
+        segment_unlink(segs, segs->seg[i]);
+    }
+    for (i = 0; i < segs->retired_len; i++) {
+        segment_unlink(segs, segs->retired[i]);
+    }
+}
@@ -0,0 +1,782 @@
+/* skip_build.c implements a pass over a merged index that rewrites its
+ * document ordered inverted lists into the requested layout, adding skip
+ * tables to long lists, separating word positions from the postings and/or
+ * block coding the postings.  See skip_build.h for the formats.
+ *
+ * The final merge that builds an index copies postings through in pieces
+ * without decoding them, so it has no way of knowing where blocks start or
+ * where the word positions of each posting end.  Instead, this pass rewrites
+ * the vector files after it in the same way that the remerge does, 
+ * converting lists that need it and copying everything else through 
+ * unaltered.  This costs another read and write of the whole vector file at
+ * the end of the build.  The remerge writes one whole list at a time, so it
+ * gathers lists that need converting in memory and converts them as it 
+ * writes them using the skip_layout functions below, and updates don't 
+ * need the pass.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "skip_build.h"
+
+#include "_index.h"
+
+#include "blockcodec.h"
+#include "btbulk.h"
+#include "def.h"
+#include "error.h"
+#include "fdset.h"
+#include "iobtree.h"
+#include "vec.h"
+#include "vocab.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* skip entries for block coded lists have to land on block boundaries */
+#if SKIP_DEFAULT_INTERVAL != BLOCKCODEC_POSTINGS
+#error "skip interval must equal the number of postings per block"
+#endif
+
+/* output state for vectors being written by the pass */
+struct skip_out {
+    int fd;                          /* pinned fd for current file, or -1 */
+    unsigned int fileno;             /* number of current file */
+    unsigned long int offset;        /* offset within current file */
+};
+
+/* internal function to ensure that a buffer has at least len bytes */
+static int skip_reserve(char **buf, unsigned int *buflen, unsigned int len) {
+    if (len > *buflen) {
+        void *ptr = realloc(*buf, len);
+
+        if (ptr) {
+            *buf = ptr;
+            *buflen = len;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* internal function to determine whether the document ordered list described
+ * by vv should have a skip table in idx */
+static int skip_table_wanted(struct index *idx, struct vocab_vector *vv) {
+    return idx->skip_vectors && (vocab_docs(vv) > SKIP_DEFAULT_INTERVAL);
+}
+
+/* internal function to determine whether a vector has to be converted to
+ * give it the layout wanted in idx */
+static int skip_wanted(struct index *idx, struct vocab_vector *vv) {
+    if (vv->location != VOCAB_LOCATION_FILE) {
+        return 0;
+    }
+
+    switch (vv->type) {
+    case VOCAB_VTYPE_DOCWP:
+        return idx->separate_positions || skip_table_wanted(idx, vv)
+          || (idx->list_codec != INDEX_CODEC_VBYTE);
+
+    case VOCAB_VTYPE_DOCWP_SKIP:
+        return idx->separate_positions || !skip_table_wanted(idx, vv)
+          || (idx->list_codec != INDEX_CODEC_VBYTE);
+
+    case VOCAB_VTYPE_DOCWP_SEP:
+        return !idx->separate_positions
+          || (idx->list_codec != INDEX_CODEC_VBYTE)
+          || ((vv->header.docwp_sep.skipsize != 0)
+            != skip_table_wanted(idx, vv));
+
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        return (idx->list_codec != INDEX_CODEC_BLOCK)
+          || ((vv->header.docwp_sep.skipsize != 0)
+            != skip_table_wanted(idx, vv));
+
+    default:
+        return 0;
+    }
+}
+
+/* internal function to read a vector stored in a file into buf */
+static enum skip_ret skip_read(struct index *idx, struct vocab_vector *vv,
+  char **buf, unsigned int *buflen) {
+    int fd;
+    ssize_t bytes;
+
+    assert(vv->location == VOCAB_LOCATION_FILE);
+    if (!skip_reserve(buf, buflen, vv->size)) {
+        return SKIP_MEM_ERROR;
+    }
+
+    if ((fd = fdset_pin(idx->fd, idx->index_type, vv->loc.file.fileno,
+        vv->loc.file.offset, SEEK_SET)) < 0) {
+        return SKIP_IO_ERROR;
+    }
+    bytes = index_atomic_read(fd, *buf, vv->size);
+    fdset_unpin(idx->fd, idx->index_type, vv->loc.file.fileno, fd);
+
+    if (bytes != (ssize_t) vv->size) {
+        return SKIP_IO_ERROR;
+    }
+    return SKIP_OK;
+}
+
+/* internal function to write a vector of len bytes from buf to the output,
+ * starting a new file if the current one would exceed the file size limit.
+ * The location of the vector is written into vv. */
+static enum skip_ret skip_write(struct index *idx, struct skip_out *out,
+  char *buf, unsigned int len, struct vocab_vector *vv) {
+    if ((out->fd < 0)
+      || (out->offset > idx->storage.max_filesize - len)) {
+        if (out->fd >= 0) {
+            fdset_unpin(idx->fd, idx->tmp_type, out->fileno, out->fd);
+            out->fileno++;
+        }
+        out->offset = 0;
+        if ((out->fd = fdset_create(idx->fd, idx->tmp_type, out->fileno))
+          < 0) {
+            ERROR1("creating vector file number %u", out->fileno);
+            return SKIP_IO_ERROR;
+        }
+    }
+
+    if (index_atomic_write(out->fd, buf, len) != (ssize_t) len) {
+        ERROR2("writing %u bytes to vector file number %u", len, out->fileno);
+        return SKIP_IO_ERROR;
+    }
+
+    vv->location = VOCAB_LOCATION_FILE;
+    vv->loc.file.fileno = out->fileno;
+    vv->loc.file.offset = out->offset;
+    vv->loc.file.capacity = len;
+    out->offset += len;
+    return SKIP_OK;
+}
+
+unsigned int skip_separate(char *vec, unsigned int len, unsigned long int docs,
+  char *out) {
+    unsigned long int docno_d,
+                      f_dt,
+                      d;
+    unsigned int bytes;
+    char *start,
+         *pos;
+    struct vec in,
+               docv;
+
+    /* write document numbers and frequencies first, to find out where the
+     * positions start */
+    in.pos = vec;
+    in.end = vec + len;
+    docv.pos = out;
+    docv.end = out + len;
+    for (d = 0; d < docs; d++) {
+        if (vec_vbyte_read(&in, &docno_d)
+          && vec_vbyte_read(&in, &f_dt)
+          && (vec_vbyte_scan(&in, f_dt, &bytes) == f_dt)) {
+            vec_vbyte_write(&docv, docno_d);
+            vec_vbyte_write(&docv, f_dt);
+        } else {
+            return 0;
+        }
+    }
+
+    if (VEC_LEN(&in)) {
+        return 0;
+    }
+
+    /* then copy the positions of each posting after them */
+    in.pos = vec;
+    pos = docv.pos;
+    for (d = 0; d < docs; d++) {
+        vec_vbyte_read(&in, &docno_d);
+        vec_vbyte_read(&in, &f_dt);
+        start = in.pos;
+        vec_vbyte_scan(&in, f_dt, &bytes);
+        memcpy(pos, start, bytes);
+        pos += bytes;
+    }
+
+    return docv.pos - out;
+}
+
+int skip_interleave(char *docvec, unsigned int docsize, char *posvec, 
+  unsigned int possize, char *out) {
+    unsigned long int docno_d,
+                      f_dt;
+    unsigned int bytes;
+    char *start;
+    struct vec docv,
+               posv,
+               outv;
+
+    docv.pos = docvec;
+    docv.end = docvec + docsize;
+    posv.pos = posvec;
+    posv.end = posvec + possize;
+    outv.pos = out;
+    outv.end = out + docsize + possize;
+    while (VEC_LEN(&docv)) {
+        start = posv.pos;
+        if (vec_vbyte_read(&docv, &docno_d)
+          && vec_vbyte_read(&docv, &f_dt)
+          && (vec_vbyte_scan(&posv, f_dt, &bytes) == f_dt)) {
+            vec_vbyte_write(&outv, docno_d);
+            vec_vbyte_write(&outv, f_dt);
+            memcpy(outv.pos, start, bytes);
+            outv.pos += bytes;
+        } else {
+            return 0;
+        }
+    }
+
+    return !VEC_LEN(&posv);
+}
+
+/* internal function to block code the len bytes of vbyte <d-gap, f_dt> pairs
+ * for docs postings at vec into out, which has outlen bytes available.
+ * Returns the number of bytes written, or 0 on failure. */
+static unsigned int skip_block(char *vec, unsigned int len, 
+  unsigned long int docs, char *out, unsigned int outlen) {
+    uint32_t ints[BLOCKCODEC_INTS];
+    unsigned long int n;
+    unsigned int i,
+                 count;
+    struct vec in,
+               outv;
+
+    in.pos = vec;
+    in.end = vec + len;
+    outv.pos = out;
+    outv.end = out + outlen;
+    while (docs) {
+        count = (docs > BLOCKCODEC_POSTINGS) ? BLOCKCODEC_POSTINGS : docs;
+        for (i = 0; i < 2 * count; i++) {
+            if (vec_vbyte_read(&in, &n) && (n <= 0xffffffffUL)) {
+                ints[i] = n;
+            } else {
+                return 0;
+            }
+        }
+        if (!blockcodec_write(&outv, ints, 2 * count)) {
+            return 0;
+        }
+        docs -= count;
+    }
+
+    if (VEC_LEN(&in)) {
+        return 0;
+    }
+    return outv.pos - out;
+}
+
+/* internal function to decode the len bytes of blocks holding docs postings
+ * at vec into vbyte <d-gap, f_dt> pairs in out, which has outlen bytes
+ * available.  Returns the number of bytes written, or 0 on failure. */
+static unsigned int skip_unblock(char *vec, unsigned int len, 
+  unsigned long int docs, char *out, unsigned int outlen) {
+    uint32_t ints[BLOCKCODEC_INTS];
+    unsigned int i,
+                 n;
+    struct vec in,
+               outv;
+
+    in.pos = vec;
+    in.end = vec + len;
+    outv.pos = out;
+    outv.end = out + outlen;
+    while (VEC_LEN(&in)) {
+        if (!(n = blockcodec_read(&in, ints)) || (n % 2) || (n / 2 > docs)) {
+            return 0;
+        }
+        for (i = 0; i < n; i++) {
+            if (!vec_vbyte_write(&outv, ints[i])) {
+                return 0;
+            }
+        }
+        docs -= n / 2;
+    }
+
+    if (docs) {
+        return 0;
+    }
+    return outv.pos - out;
+}
+
+unsigned long int skip_docwp_bound(struct vocab_vector *vv) {
+    if (vv->type == VOCAB_VTYPE_DOCWP_BLOCK) {
+        /* vbyte coding takes at most one byte more than block coding for 
+         * each number, two per posting */
+        return vv->size + 2 * vocab_docs(vv);
+    } else {
+        return vv->size;
+    }
+}
+
+enum skip_ret skip_docwp(struct vocab_vector *vv, char *vec, char *out) {
+    unsigned long int skipsize,
+                      docsize;
+
+    switch (vv->type) {
+    case VOCAB_VTYPE_DOCWP:
+        memcpy(out, vec, vv->size);
+        return SKIP_OK;
+
+    case VOCAB_VTYPE_DOCWP_SKIP:
+        skipsize = vv->header.docwp_skip.skipsize;
+        if (skipsize > vv->size) {
+            return SKIP_FMT_ERROR;
+        }
+        vv->size -= skipsize;
+        memcpy(out, vec + skipsize, vv->size);
+        break;
+
+    case VOCAB_VTYPE_DOCWP_SEP:
+        skipsize = vv->header.docwp_sep.skipsize;
+        docsize = vv->header.docwp_sep.docsize;
+        if ((skipsize + docsize > vv->size)
+          || !skip_interleave(vec + skipsize, docsize, 
+              vec + skipsize + docsize, vv->size - skipsize - docsize, 
+              out)) {
+            return SKIP_FMT_ERROR;
+        }
+        vv->size -= skipsize;
+        break;
+
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        /* decode the blocks into temporary space, then interleave as for 
+         * DOCWP_SEP */
+        skipsize = vv->header.docwp_sep.skipsize;
+        docsize = vv->header.docwp_sep.docsize;
+        if (skipsize + docsize > vv->size) {
+            return SKIP_FMT_ERROR;
+        } else {
+            unsigned long int bound = docsize + 2 * vocab_docs(vv),
+                              possize = vv->size - skipsize - docsize;
+            char *docs = malloc(bound);
+            unsigned int len;
+
+            if (!docs) {
+                return SKIP_MEM_ERROR;
+            } else if (!(len = skip_unblock(vec + skipsize, docsize, 
+                  vocab_docs(vv), docs, bound))
+              || !skip_interleave(docs, len, vec + skipsize + docsize, 
+                  possize, out)) {
+                free(docs);
+                return SKIP_FMT_ERROR;
+            }
+            free(docs);
+            vv->size = len + possize;
+        }
+        break;
+
+    default:
+        return SKIP_FMT_ERROR;
+    }
+
+    /* header members shared by all document ordered types remain valid */
+    vv->type = VOCAB_VTYPE_DOCWP;
+    return SKIP_OK;
+}
+
+/* internal function to write a skip table for the len bytes of postings
+ * at vec (which are followed by their word offsets if offsets is true, or
+ * block coded if blocks is true) for the list described by vv into table, 
+ * which must have enough space.  The size of the table is written into 
+ * tablesize. */
+static enum skip_ret skip_table(struct vocab_vector *vv, char *vec, 
+  unsigned int len, int offsets, int blocks, char *table, 
+  unsigned int *tablesize) {
+    unsigned long int docno = -1,    /* note: d-gaps are encoded less 1 */
+                      prev_docno = 0,
+                      prev_offset = 0,
+                      docno_d,
+                      f_dt,
+                      d;
+    unsigned int bytes,
+                 n = 0,
+                 i = 0;
+    uint32_t ints[BLOCKCODEC_INTS];
+    struct vec in,
+               out;
+
+    in.pos = vec;
+    in.end = vec + len;
+    out.pos = table;
+    out.end = table + (2 * (vocab_docs(vv) / SKIP_DEFAULT_INTERVAL) + 1) 
+      * VEC_VBYTE_MAX;
+    vec_vbyte_write(&out, SKIP_DEFAULT_INTERVAL);
+
+    for (d = 0; d < vocab_docs(vv); d++) {
+        if (d && !(d % SKIP_DEFAULT_INTERVAL)) {
+            if (i != n) {
+                return SKIP_FMT_ERROR;
+            }
+
+            /* record start of new block */
+            vec_vbyte_write(&out, docno - prev_docno);
+            vec_vbyte_write(&out, (in.pos - vec) - prev_offset);
+            prev_docno = docno;
+            prev_offset = in.pos - vec;
+        }
+
+        if (blocks) {
+            /* blocks start at the same postings as skip entries, so block 
+             * boundaries are recorded above */
+            if ((i == n) 
+              && ((i = 0), !(n = blockcodec_read(&in, ints)) || (n % 2))) {
+                return SKIP_FMT_ERROR;
+            }
+            docno += ints[i] + 1;
+            i += 2;
+        } else if (vec_vbyte_read(&in, &docno_d)
+          && vec_vbyte_read(&in, &f_dt)
+          && (!offsets || (vec_vbyte_scan(&in, f_dt, &bytes) == f_dt))) {
+            docno += docno_d + 1;
+        } else {
+            return SKIP_FMT_ERROR;
+        }
+    }
+
+    if (VEC_LEN(&in) || (i != n) || (docno != vocab_last(vv))) {
+        return SKIP_FMT_ERROR;
+    }
+
+    *tablesize = out.pos - table;
+    return SKIP_OK;
+}
+
+/* internal function to convert the document ordered vector described by vv
+ * (held in vec, which is vv->size bytes long) into the layout wanted for it
+ * in idx, using vec and plain as scratch space and leaving the result in 
+ * out.  vv is updated to describe the new vector. */
+static enum skip_ret skip_convert(struct index *idx, struct vocab_vector *vv,
+  char **vec, unsigned int *veclen, char **plain, unsigned int *plainlen, 
+  char **out, unsigned int *outlen) {
+    unsigned int tablesize = 0,
+                 docsize = 0,
+                 postsize,
+                 bound;
+    int blocks = (idx->list_codec == INDEX_CODEC_BLOCK),
+        separate = blocks || idx->separate_positions;
+    char *postings;
+    enum skip_ret ret;
+
+    if (!skip_reserve(plain, plainlen, skip_docwp_bound(vv))) {
+        return SKIP_MEM_ERROR;
+    } else if ((ret = skip_docwp(vv, *vec, *plain)) != SKIP_OK) {
+        return ret;
+    }
+
+    /* separate positions into vec */
+    postings = *plain;
+    postsize = vv->size;
+    if (separate) {
+        if (!skip_reserve(vec, veclen, vv->size)) {
+            return SKIP_MEM_ERROR;
+        } else if (!(docsize 
+            = skip_separate(*plain, vv->size, vocab_docs(vv), *vec))) {
+            return SKIP_FMT_ERROR;
+        }
+        postings = *vec;
+        postsize = docsize;
+    }
+
+    /* block code document numbers and frequencies into plain, which we've
+     * finished with.  Block data is never longer than the vbyte numbers, to
+     * which we add a control byte for every four numbers and a header per 
+     * block. */
+    if (blocks) {
+        bound = docsize + vocab_docs(vv) / 2 + 1
+          + (vocab_docs(vv) / BLOCKCODEC_POSTINGS + 1) 
+            * (1 + 2 * VEC_VBYTE_MAX);
+        if (!skip_reserve(plain, plainlen, bound)) {
+            return SKIP_MEM_ERROR;
+        } else if (!(postsize 
+            = skip_block(*vec, docsize, vocab_docs(vv), *plain, bound))) {
+            return SKIP_FMT_ERROR;
+        }
+        postings = *plain;
+    }
+
+    if (!skip_reserve(out, outlen, 
+        (2 * (vocab_docs(vv) / SKIP_DEFAULT_INTERVAL) + 1) * VEC_VBYTE_MAX 
+          + postsize + (vv->size - docsize))) {
+        return SKIP_MEM_ERROR;
+    }
+
+    if (skip_table_wanted(idx, vv)
+      && ((ret = skip_table(vv, postings, postsize, !separate, blocks, 
+          *out, &tablesize)) != SKIP_OK)) {
+        return ret;
+    }
+
+    /* append postings after table, followed by the word positions if they're
+     * separate */
+    memcpy(*out + tablesize, postings, postsize);
+    if (separate) {
+        memcpy(*out + tablesize + postsize, *vec + docsize, 
+          vv->size - docsize);
+        vv->size = tablesize + postsize + (vv->size - docsize);
+        vv->type = blocks ? VOCAB_VTYPE_DOCWP_BLOCK : VOCAB_VTYPE_DOCWP_SEP;
+        vv->header.docwp_sep.skipsize = tablesize;
+        vv->header.docwp_sep.docsize = postsize;
+    } else if (tablesize) {
+        vv->size += tablesize;
+        vv->type = VOCAB_VTYPE_DOCWP_SKIP;
+        vv->header.docwp_skip.skipsize = tablesize;
+    }
+    return SKIP_OK;
+}
+
+/* internal function to write out a btree bucket produced by btbulk */
+static enum skip_ret skip_bucket(struct index *idx, struct btbulk *bulk) {
+    int fd;
+    ssize_t bytes;
+
+    if ((fd = fdset_pin(idx->fd, idx->vtmp_type, bulk->fileno, bulk->offset,
+        SEEK_SET)) < 0
+      && (fd = fdset_create_seek(idx->fd, idx->vtmp_type, bulk->fileno,
+        bulk->offset)) < 0) {
+        ERROR1("opening vocab file number %u", bulk->fileno);
+        return SKIP_IO_ERROR;
+    }
+    bytes = index_atomic_write(fd, bulk->output.write.next_out,
+      bulk->output.write.avail_out);
+    fdset_unpin(idx->fd, idx->vtmp_type, bulk->fileno, fd);
+
+    if (bytes != (ssize_t) bulk->output.write.avail_out) {
+        ERROR1("writing to vocab file number %u", bulk->fileno);
+        return SKIP_IO_ERROR;
+    }
+    bulk->offset += bulk->output.write.avail_out;
+    return SKIP_OK;
+}
+
+/* internal function to replace all files of type type with the count files
+ * of type tmptype, by renaming them into place */
+static enum skip_ret skip_replace(struct index *idx, unsigned int type,
+  unsigned int tmptype, unsigned int count) {
+    char final_fname[FILENAME_MAX + 1],
+         tmp_fname[FILENAME_MAX + 1];
+    unsigned int i,
+                 len;
+    int writeable;
+
+    for (i = 0; fdset_unlink(idx->fd, type, i) == FDSET_OK; i++) ;
+    for (i = 0; i < count; i++) {
+        if ((fdset_close_file(idx->fd, tmptype, i) < 0)
+          || (fdset_name(idx->fd, type, i, final_fname, FILENAME_MAX, &len,
+              &writeable) != FDSET_OK)
+          || (fdset_name(idx->fd, tmptype, i, tmp_fname, FILENAME_MAX, &len,
+              &writeable) != FDSET_OK)
+          || (rename(tmp_fname, final_fname) < 0)) {
+            ERROR2("renaming file number %u to %s", i, final_fname);
+            return SKIP_IO_ERROR;
+        }
+    }
+    return SKIP_OK;
+}
+
+int skip_layout_wanted(struct index *idx, struct vocab_vector *vv) {
+    return skip_wanted(idx, vv);
+}
+
+int skip_layout_reserve(struct skip_layout *layout, unsigned int len) {
+    return skip_reserve(&layout->vec, &layout->veclen, len);
+}
+
+enum skip_ret skip_layout_convert(struct index *idx, struct vocab_vector *vv,
+  struct skip_layout *layout) {
+    return skip_convert(idx, vv, &layout->vec, &layout->veclen, 
+      &layout->plain, &layout->plainlen, &layout->out, &layout->outlen);
+}
+
+void skip_layout_free(struct skip_layout *layout) {
+    free(layout->vec);
+    free(layout->plain);
+    free(layout->out);
+    layout->vec = layout->plain = layout->out = NULL;
+    layout->veclen = layout->plainlen = layout->outlen = 0;
+}
+
+/* internal function to check whether any vectors in the index need to be
+ * converted */
+static int skip_needed(struct index *idx) {
+    unsigned int state[3] = {0, 0, 0},
+                 termlen,
+                 datalen;
+    void *data;
+    struct vocab_vector vv;
+    struct vec v;
+
+    while (iobtree_next_term(idx->vocab, state, &termlen, &data, &datalen)) {
+        v.pos = data;
+        v.end = v.pos + datalen;
+        while (vocab_decode(&vv, &v) == VOCAB_OK) {
+            if (skip_wanted(idx, &vv)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+enum skip_ret skip_build_index(struct index *idx) {
+    struct btbulk bulk;
+    struct skip_out out = {-1, 0, 0};
+    unsigned int state[3] = {0, 0, 0},
+                 termlen,
+                 datalen,
+                 entrylen = 0,
+                 root_fileno,
+                 i;
+    unsigned long int root_offset,
+                      terms = 0;
+    const char *term;
+    char *entry = NULL;              /* new vocab entry */
+    struct skip_layout layout = {NULL, 0, NULL, 0, NULL, 0};
+    void *data;
+    enum skip_ret ret = SKIP_OK;
+    enum btbulk_ret btret;
+
+    if (!skip_needed(idx)) {
+        return SKIP_OK;
+    }
+
+    if (!btbulk_new(idx->storage.pagesize, idx->storage.max_filesize,
+        idx->storage.btleaf_strategy, idx->storage.btnode_strategy, 1.0, 0,
+        &bulk)) {
+        return SKIP_MEM_ERROR;
+    }
+    bulk.fileno = 0;
+    bulk.offset = 0;
+
+    while ((ret == SKIP_OK)
+      && (term = iobtree_next_term(idx->vocab, state, &termlen, &data,
+          &datalen))) {
+        struct vocab_vector vv;
+        struct vec v,
+                   ev;
+        unsigned int len = 0;
+        enum vocab_ret vret = VOCAB_OK;
+
+        /* copy or convert each vector in the entry, encoding new vocab
+         * entries as we go */
+        v.pos = data;
+        v.end = v.pos + datalen;
+        while ((ret == SKIP_OK) 
+          && ((vret = vocab_decode(&vv, &v)) == VOCAB_OK)) {
+            if (vv.location == VOCAB_LOCATION_VOCAB) {
+                /* vector stays in the vocab, just copy it */
+            } else if ((ret = skip_read(idx, &vv, &layout.vec, 
+                &layout.veclen)) != SKIP_OK) {
+                break;
+            } else if (skip_wanted(idx, &vv)) {
+                if ((ret = skip_layout_convert(idx, &vv, &layout)) 
+                  == SKIP_OK) {
+                    ret = skip_write(idx, &out, layout.out, vv.size, &vv);
+                }
+            } else {
+                ret = skip_write(idx, &out, layout.vec, vv.size, &vv);
+            }
+
+            if ((ret == SKIP_OK)
+              && skip_reserve(&entry, &entrylen, len + vocab_len(&vv))) {
+                ev.pos = entry + len;
+                ev.end = entry + entrylen;
+                if (vocab_encode(&vv, &ev) != VOCAB_OK) {
+                    ret = SKIP_OTHER_ERROR;
+                } else if (vv.location == VOCAB_LOCATION_VOCAB) {
+                    /* encode leaves space for in-vocab vector at the end */
+                    memcpy(ev.pos - vv.size, vv.loc.vocab.vec, vv.size);
+                }
+                len = ev.pos - entry;
+            } else if (ret == SKIP_OK) {
+                ret = SKIP_MEM_ERROR;
+            }
+        }
+
+        if ((ret == SKIP_OK) && (vret != VOCAB_END)) {
+            ERROR1("decoding vocab entry for term '%s'", term);
+            ret = SKIP_FMT_ERROR;
+        }
+
+        /* insert new entry into new vocab */
+        bulk.term = term;
+        bulk.termlen = termlen;
+        bulk.datasize = len;
+        while (ret == SKIP_OK) {
+            btret = btbulk_insert(&bulk);
+            if (btret == BTBULK_OK) {
+                memcpy(bulk.output.ok.data, entry, len);
+                terms++;
+                break;
+            } else if (btret == BTBULK_WRITE) {
+                ret = skip_bucket(idx, &bulk);
+            } else if (btret == BTBULK_FLUSH) {
+                bulk.fileno++;
+                bulk.offset = 0;
+            } else {
+                ret = SKIP_OTHER_ERROR;
+            }
+        }
+    }
+
+    /* finish new vocab */
+    while (ret == SKIP_OK) {
+        btret = btbulk_finalise(&bulk, &root_fileno, &root_offset);
+        if ((btret == BTBULK_OK) || (btret == BTBULK_FINISH)) {
+            break;
+        } else if (btret == BTBULK_WRITE) {
+            ret = skip_bucket(idx, &bulk);
+        } else if (btret == BTBULK_FLUSH) {
+            bulk.fileno++;
+            bulk.offset = 0;
+        } else {
+            ret = SKIP_OTHER_ERROR;
+        }
+    }
+
+    btbulk_delete(&bulk);
+    free(entry);
+    skip_layout_free(&layout);
+    if (out.fd >= 0) {
+        fdset_unpin(idx->fd, idx->tmp_type, out.fileno, out.fd);
+    }
+
+    if (ret != SKIP_OK) {
+        /* remove partially written files, leaving index as it was */
+        for (i = 0; fdset_unlink(idx->fd, idx->tmp_type, i) == FDSET_OK; i++) ;
+        for (i = 0; fdset_unlink(idx->fd, idx->vtmp_type, i) == FDSET_OK;
+          i++) ;
+        return ret;
+    }
+
+    /* replace old vectors and vocab with the new ones.  If this fails the
+     * index is probably stuffed, as with impact ordering. */
+    iobtree_delete(idx->vocab);
+    idx->vocab = NULL;
+    if (((ret = skip_replace(idx, idx->index_type, idx->tmp_type, 
+          out.fileno + 1)) != SKIP_OK)
+      || ((ret = skip_replace(idx, idx->vocab_type, idx->vtmp_type, 
+          bulk.fileno + 1)) != SKIP_OK)) {
+        return ret;
+    }
+    idx->vectors = out.fileno + 1;
+    idx->vocabs = bulk.fileno + 1;
+
+    if (!(idx->vocab = iobtree_load_quick(idx->storage.pagesize,
+        idx->storage.btleaf_strategy, idx->storage.btnode_strategy, NULL,
+        idx->fd, idx->vocab_type, root_fileno, root_offset, terms))) {
+        ERROR("loading new vocab");
+        return SKIP_OTHER_ERROR;
+    }
+
+    return SKIP_OK;
+}
+
@@ -149,10 +149,10 @@ enum stop_ret stop_add_term(struct stop *list, const char *term) {
 }
 
 enum stop_ret stop_stop(struct stop *list, const char *term) {
-    void **data;
+    void *data;
 
-    if (chash_ptr_ptr_find(list->table, term, &data) == CHASH_OK) {
-        assert(!str_cmp(*data, term));
+    if (chash_ptr_ptr_peek(list->table, term, &data) == CHASH_OK) {
+        assert(!str_cmp(data, term));
         return STOP_STOPPED;
     } else {
         return STOP_OK;
@@ -27,6 +27,7 @@
 #include "_index.h"
 #include "index_querybuild.h"
 #include "docmap.h"
+#include "docstore.h"
 #include "mlparse_wrap.h"
 #include "psettings.h"
 #include "str.h"
@@ -68,8 +69,13 @@ struct persum {
     struct chash *terms;           /* hashtable lookup for query terms */
     int index;                     /* current state */
     unsigned int stack;            /* state stack */
-    int fd;                        /* source fd */
+    int fd;                        /* source fd (or -1 if the document is 
+                                    * read from the document store) */
     unsigned int bytes_left;       /* bytes left in the document */
+    unsigned int fileno;           /* repository of the document */
+    unsigned long int offset;      /* where the rest of the document starts 
+                                    * in the repository (when read from the
+                                    * document store) */
 };
 
 struct summarise *summarise_new(struct index *idx) {
@@ -256,6 +262,25 @@ unsigned int html_cpy(struct sentence **sent, const char *term,
     return orig_len + extra;
 }
 
+/* internal function to give the parser the next bufferload of a document
+ * read from the document store.  Returns true on success. */
+static int store_input(struct summarise *sum, struct persum *ps) {
+    unsigned int len = sum->bufsize;
+
+    if (len > ps->bytes_left) {
+        len = ps->bytes_left;
+    }
+    if ((docstore_retrieve(sum->idx->store, ps->fileno, ps->offset, sum->buf, 
+        len, &len) != DOCSTORE_OK) || !len) {
+        return 0;
+    }
+    sum->parser.next_in = sum->buf;
+    sum->parser.avail_in = len;
+    ps->offset += len;
+    ps->bytes_left -= len;
+    return 1;
+}
+
 /* internal function to extract the next sentence */
 static struct sentence *extract(struct summarise *sum, struct persum *ps,
   enum index_summary_type type, const struct query *q, 
@@ -362,6 +387,11 @@ static struct sentence *extract(struct summarise *sum, struct persum *ps,
                         case MLPARSE_INPUT:
                             if (!ps->bytes_left) {
                                 mlparse_eof(&sum->parser);
+                            } else if (ps->fd < 0) {
+                                if (!store_input(sum, ps)) {
+                                    return extract_finish(sent, ps, type, 
+                                        highlight);
+                                }
                             } else if (index_stream_read(sum->last_stream, 
                                 ps->fd, sum->buf, sum->bufsize) == STREAM_OK) {
 
@@ -422,6 +452,7 @@ static struct sentence *extract(struct summarise *sum, struct persum *ps,
                     memcpy(ps->title + ps->title_len, ps->termbuf, len);
                     ps->title_len += len;
                     ps->title[ps->title_len++] = ' ';
+                    ps->title[ps->title_len] = '\0';
                 } else if (ps->title_len + 1 < ps->title_size) {
                     unsigned int tlen = ps->title_size - ps->title_len - 1;
                     memcpy(ps->title + ps->title_len, ps->termbuf, tlen);
@@ -431,6 +462,7 @@ static struct sentence *extract(struct summarise *sum, struct persum *ps,
                         ps->title[ps->title_len++] = ' ';
                     }
                     assert(ps->title_len + 1 == ps->title_size);
+                    ps->title[ps->title_len] = '\0';
                 }
                 break;
             } else if (!ps->index) {
@@ -539,6 +571,10 @@ static struct sentence *extract(struct summarise *sum, struct persum *ps,
         case MLPARSE_INPUT:
             if (!ps->bytes_left) {
                 mlparse_eof(&sum->parser);
+            } else if (ps->fd < 0) {
+                if (!store_input(sum, ps)) {
+                    return extract_finish(sent, ps, type, highlight);
+                }
             } else if (index_stream_read(sum->last_stream, ps->fd, sum->buf, 
                 sum->bufsize) == STREAM_OK) {
 
@@ -620,8 +656,10 @@ static int rev_sum_score_cmp(const void *vone, const void *vtwo) {
 
 static void persum_delete(struct summarise *sum, struct persum *ps) {
     free(ps->termbuf);
-    sum->last_poffset = lseek(ps->fd, 0, SEEK_CUR);
-    fdset_unpin(sum->fd, sum->idx->repos_type, sum->last_fileno, ps->fd);
+    if (ps->fd >= 0) {
+        sum->last_poffset = lseek(ps->fd, 0, SEEK_CUR);
+        fdset_unpin(sum->fd, sum->idx->repos_type, sum->last_fileno, ps->fd);
+    }
     chash_delete(ps->terms);
 }
 
@@ -646,11 +684,13 @@ enum summarise_ret summarise(struct summarise *sum, unsigned long int docno,
     off_t offset,                         /* repository offset of given doc */
           curroffset,
           physoffset;
-    int finished = 0;                     /* continued iteration indicator */
+    int finished = 0,                     /* continued iteration indicator */
+        store = 0;                        /* whether doc is in the store */
     enum docmap_ret dmret;
     enum docmap_flag dmflags;
     enum mime_types mtype;
     struct stream_filter *filter;
+    struct docmap_checkpoint check;
 
     if (!(occs = malloc(sizeof(*occs) * query->terms))) {
         return SUMMARISE_ENOMEM;
@@ -661,24 +701,37 @@ enum summarise_ret summarise(struct summarise *sum, unsigned long int docno,
         &bytes, &mtype, &dmflags)) == DOCMAP_OK)) {
 
         mlparse_reinit(&sum->parser);
-        if (dmflags & DOCMAP_COMPRESSED) {
+        if (sum->idx->store && docstore_contains(sum->idx->store, fileno)) {
+            /* read from the document store, which doesn't need a stream.
+             * The buffer the previous stream read into is about to be
+             * overwritten, so it can't be continued */
+            store = 1;
+            if (sum->last_stream) {
+                stream_delete(sum->last_stream);
+                sum->last_stream = NULL;
+            }
+            sum->last_fileno = -1;
+        } else if (dmflags & DOCMAP_COMPRESSED) {
             /* read from a compressed file */
-            if (sum->last_fileno == fileno && sum->last_offset < offset) {
-                /* can use previous stream */
+            if (sum->last_fileno == fileno && sum->last_offset < offset
+              && ((docmap_get_checkpoint(sum->map, fileno, offset, &check) 
+                  != DOCMAP_OK)
+                || check.offset <= sum->last_offset)) {
+                /* can use previous stream (there's no checkpoint nearer the
+                 * document) */
                 physoffset = sum->last_poffset;
                 curroffset = sum->last_offset;
                 sum->last_offset = offset + bytes;
             } else {
-                /* have to initialise a new stream */
-                curroffset = physoffset = 0;
-
+                /* have to initialise a new stream, from the nearest 
+                 * checkpoint */
                 if (sum->last_stream) {
                     stream_delete(sum->last_stream);
                 }
 
                 if ((sum->last_stream = stream_new())
-                  && (filter 
-                    = (struct stream_filter *) gunzipfilter_new(BUFSIZ))) {
+                  && (filter = index_repos_filter(sum->idx, fileno, offset, 
+                      &physoffset, &curroffset))) {
 
                     stream_filter_push(sum->last_stream, filter);
                     sum->last_fileno = fileno;
@@ -708,8 +761,8 @@ enum summarise_ret summarise(struct summarise *sum, unsigned long int docno,
     /* initialise ps */
     if ((ps.termbuf = malloc(sum->max_termlen + 1)) 
       && (ps.terms = chash_str_new(3, 0.5, str_nhash))
-      && (ps.fd = fdset_pin(sum->fd, sum->idx->repos_type, fileno, physoffset, 
-            SEEK_SET))
+      && (ps.fd = store ? -1 : fdset_pin(sum->fd, sum->idx->repos_type, 
+            fileno, physoffset, SEEK_SET))
       && (psettings_type_tags(sum->pset, mtype, &ps.ptype) == PSETTINGS_OK)) {
 
         if (DEAR_DEBUG) {
@@ -724,6 +777,9 @@ enum summarise_ret summarise(struct summarise *sum, unsigned long int docno,
         ps.summary_len = result->summary_len;
         ps.title_len = 0;
         ps.title_size = result->title_len;
+        if (ps.title_size) {
+            ps.title[0] = '\0';
+        }
     } else {
         free(occs);
         if (ps.termbuf) {
@@ -739,28 +795,37 @@ enum summarise_ret summarise(struct summarise *sum, unsigned long int docno,
         return SUMMARISE_ENOMEM;
     }
 
-    /* read until we hit the start of the document */
-    assert(curroffset <= offset);
-    while (curroffset + (off_t) sum->last_stream->avail_out < offset) {
-        curroffset += sum->last_stream->avail_out;
-        if (index_stream_read(sum->last_stream, ps.fd, sum->buf, sum->bufsize) 
-          != STREAM_OK) {
-            persum_delete(sum, &ps);
-            return SUMMARISE_EIO;
-        }
-    }
-    sum->last_stream->curr_out += offset - curroffset;
-    sum->last_stream->avail_out -= offset - curroffset;
-
-    /* stream now points to start of doc */
-    sum->parser.next_in = sum->last_stream->curr_out;
-    sum->parser.avail_in = sum->last_stream->avail_out;
-    if (ps.bytes_left > sum->last_stream->avail_out) {
-        ps.bytes_left -= sum->last_stream->avail_out;
+    if (store) {
+        /* the parser asks for the document to be read from the store as it
+         * needs it */
+        ps.fileno = fileno;
+        ps.offset = offset;
+        sum->parser.next_in = NULL;
+        sum->parser.avail_in = 0;
     } else {
-        sum->last_stream->curr_out += ps.bytes_left;
-        sum->last_stream->avail_out -= ps.bytes_left;
-        ps.bytes_left = 0;
+        /* read until we hit the start of the document */
+        assert(curroffset <= offset);
+        while (curroffset + (off_t) sum->last_stream->avail_out < offset) {
+            curroffset += sum->last_stream->avail_out;
+            if (index_stream_read(sum->last_stream, ps.fd, sum->buf, 
+                sum->bufsize) != STREAM_OK) {
+                persum_delete(sum, &ps);
+                return SUMMARISE_EIO;
+            }
+        }
+        sum->last_stream->curr_out += offset - curroffset;
+        sum->last_stream->avail_out -= offset - curroffset;
+
+        /* stream now points to start of doc */
+        sum->parser.next_in = sum->last_stream->curr_out;
+        sum->parser.avail_in = sum->last_stream->avail_out;
+        if (ps.bytes_left > sum->last_stream->avail_out) {
+            ps.bytes_left -= sum->last_stream->avail_out;
+        } else {
+            sum->last_stream->curr_out += ps.bytes_left;
+            sum->last_stream->avail_out -= ps.bytes_left;
+            ps.bytes_left = 0;
+        }
     }
 
     /* load all query terms into hash */
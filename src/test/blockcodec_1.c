@@ -0,0 +1,258 @@
+/* blockcodec_1.c tests the Stream VByte block coding in blockcodec.c, by
+ * writing blocks of every length with numbers of each width (1 to 4 bytes)
+ * and checking that they read and scan back the same.  Blocks are placed at
+ * the very end of their buffers, so that the decoder can't read past them
+ * without a memory checker noticing, and are read back from runs of blocks
+ * that end with a partial block, as document ordered lists do.  Truncated
+ * or inconsistent blocks and full output buffers must be refused without 
+ * moving the vector.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "test.h"
+
+#include "blockcodec.h"
+#include "lcrand.h"
+#include "vec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEED 17                      /* seed for random numbers */
+#define BLOCKS 5                     /* blocks in each run of blocks */
+
+/* the largest number of each width, and the smallest of the next */
+static const uint32_t edge[] = {
+    0, 1, 0xff, 0x100, 0xffff, 0x10000, 0xffffff, 0x1000000, 0xfffffffe,
+    0xffffffff
+};
+
+/* internal function to fill ints with n numbers.  If width is non-zero all
+ * numbers are width bytes long, otherwise widths are mixed, so that groups
+ * of four numbers take up different amounts of data */
+static void fill(struct lcrand *rand, uint32_t *ints, unsigned int n,
+  unsigned int width) {
+    unsigned int i,
+                 w;
+
+    for (i = 0; i < n; i++) {
+        w = width ? width : 1 + lcrand_limit(rand, 4);
+        ints[i] = lcrand(rand);
+        if (w < 4) {
+            ints[i] &= (1U << (8 * w)) - 1;
+        }
+        /* make sure the number is actually w bytes long */
+        ints[i] |= (uint32_t) 1 << (8 * w - 1);
+    }
+}
+
+/* internal function to write the n numbers in ints as a block at the end of
+ * a buffer of exactly the right size, and check that it reads and scans
+ * back the same, and that corrupted or truncated copies of it are refused */
+static int test_block(const uint32_t *ints, unsigned int n) {
+    char tmp[BLOCKCODEC_MAX_BYTES],
+         *buf;
+    uint32_t out[BLOCKCODEC_INTS];
+    struct vec v;
+    unsigned long int num;
+    unsigned int len,
+                 trunc;
+
+    v.pos = tmp;
+    v.end = tmp + sizeof(tmp);
+    if (!(len = blockcodec_write(&v, ints, n)) || (v.pos != tmp + len)
+      || (len > BLOCKCODEC_MAX_BYTES)) {
+        fprintf(stderr, "writing block of %u failed\n", n);
+        return 0;
+    }
+
+    /* no space for the block, by a single byte */
+    v.pos = tmp;
+    v.end = tmp + len - 1;
+    if (blockcodec_write(&v, ints, n) || (v.pos != tmp)) {
+        fprintf(stderr, "block of %u written without space\n", n);
+        return 0;
+    }
+
+    if (!(buf = malloc(len))) {
+        return 0;
+    }
+    memcpy(buf, tmp, len);
+
+    v.pos = buf;
+    v.end = buf + len;
+    memset(out, 0, sizeof(out));
+    if ((blockcodec_read(&v, out) != n) || (v.pos != v.end)
+      || memcmp(out, ints, n * sizeof(*ints))) {
+        fprintf(stderr, "block of %u read back wrongly\n", n);
+        free(buf);
+        return 0;
+    }
+
+    v.pos = buf;
+    if ((blockcodec_scan(&v) != n) || (v.pos != v.end)) {
+        fprintf(stderr, "block of %u scanned wrongly\n", n);
+        free(buf);
+        return 0;
+    }
+
+    /* changing the length of the first number in the control bytes means
+     * the numbers no longer fill the data, which has to be refused */
+    v.pos = buf;
+    vec_vbyte_read(&v, &num);
+    vec_vbyte_read(&v, &num);
+    *v.pos ^= 1;
+    v.pos = buf;
+    if (blockcodec_read(&v, out) || (v.pos != buf)) {
+        fprintf(stderr, "block of %u with bad control byte accepted\n", n);
+        free(buf);
+        return 0;
+    }
+    free(buf);
+
+    /* every truncation of the block has to be refused, again with the
+     * truncated block at the end of its buffer */
+    for (trunc = 0; trunc < len; trunc++) {
+        if (!(buf = malloc(trunc + 1))) {
+            return 0;
+        }
+        memcpy(buf, tmp, trunc);
+        v.pos = buf;
+        v.end = buf + trunc;
+        if (blockcodec_read(&v, out) || (v.pos != buf)
+          || blockcodec_scan(&v) || (v.pos != buf)) {
+            fprintf(stderr, "block of %u truncated to %u bytes accepted\n",
+              n, trunc);
+            free(buf);
+            return 0;
+        }
+        free(buf);
+    }
+
+    return 1;
+}
+
+/* internal function to write BLOCKS blocks, the last with only last numbers,
+ * one after another and check that they read back in order */
+static int test_run(struct lcrand *rand, unsigned int last) {
+    static uint32_t ints[BLOCKS][BLOCKCODEC_INTS];
+    uint32_t out[BLOCKCODEC_INTS];
+    char *buf;
+    struct vec v;
+    unsigned int i,
+                 n,
+                 len;
+    int ret = 1;
+
+    if (!(buf = malloc(BLOCKS * BLOCKCODEC_MAX_BYTES))) {
+        return 0;
+    }
+    v.pos = buf;
+    v.end = buf + BLOCKS * BLOCKCODEC_MAX_BYTES;
+    for (i = 0; i < BLOCKS; i++) {
+        n = (i + 1 < BLOCKS) ? BLOCKCODEC_INTS : last;
+        fill(rand, ints[i], n, 0);
+        if (!blockcodec_write(&v, ints[i], n)) {
+            free(buf);
+            return 0;
+        }
+    }
+    len = v.pos - buf;
+
+    v.pos = buf;
+    v.end = buf + len;
+    for (i = 0; ret && (i < BLOCKS); i++) {
+        n = (i + 1 < BLOCKS) ? BLOCKCODEC_INTS : last;
+        if ((blockcodec_read(&v, out) != n)
+          || memcmp(out, ints[i], n * sizeof(*out))) {
+            fprintf(stderr, "block %u of run ending with %u read wrongly\n",
+              i, last);
+            ret = 0;
+        }
+    }
+    if (ret && (v.pos != v.end)) {
+        fprintf(stderr, "run ending with %u not read entirely\n", last);
+        ret = 0;
+    }
+
+    /* scanning skips the same blocks */
+    v.pos = buf;
+    for (i = 0; ret && (i < BLOCKS); i++) {
+        n = (i + 1 < BLOCKS) ? BLOCKCODEC_INTS : last;
+        if (blockcodec_scan(&v) != n) {
+            fprintf(stderr, "block %u of run ending with %u scanned "
+              "wrongly\n", i, last);
+            ret = 0;
+        }
+    }
+    if (ret && (v.pos != v.end)) {
+        fprintf(stderr, "run ending with %u not scanned entirely\n", last);
+        ret = 0;
+    }
+
+    free(buf);
+    return ret;
+}
+
+int test_file(FILE *fp, int argc, char **argv) {
+    uint32_t ints[BLOCKCODEC_INTS];
+    struct lcrand *rand;
+    unsigned int n,
+                 i,
+                 width;
+    int ret = 1;
+
+    /* ensure that we aren't testing from a file */
+    if ((fp && (fp != stdin)) || (argc > 1)) {
+        return 0;
+    }
+
+    if (!(rand = lcrand_new(SEED))) {
+        return 0;
+    }
+
+    /* blocks of every length, so that the last group of four numbers is
+     * full or partial, with numbers all of one width and of mixed widths */
+    for (n = 1; ret && (n <= BLOCKCODEC_INTS); n++) {
+        for (width = 0; ret && (width <= 4); width++) {
+            fill(rand, ints, n, width);
+            ret = test_block(ints, n);
+        }
+    }
+
+    /* numbers either side of each width, in every position of a group */
+    for (i = 0; ret && (i < sizeof(edge) / sizeof(*edge)); i++) {
+        for (n = 0; n < BLOCKCODEC_INTS; n++) {
+            ints[n] = edge[(i + n) % (sizeof(edge) / sizeof(*edge))];
+        }
+        for (n = 1; ret && (n <= 9); n++) {
+            ret = test_block(ints, n);
+        }
+        if (ret) {
+            ret = test_block(ints, BLOCKCODEC_INTS);
+        }
+    }
+
+    /* runs of blocks ending with a partial block (or a full one) */
+    for (n = 1; ret && (n <= BLOCKCODEC_INTS); n++) {
+        ret = test_run(rand, n);
+    }
+
+    /* an empty vector holds no block */
+    if (ret) {
+        char c;
+        struct vec v;
+
+        v.pos = v.end = &c;
+        if (blockcodec_read(&v, ints) || blockcodec_scan(&v)) {
+            fprintf(stderr, "block read from empty vector\n");
+            ret = 0;
+        }
+    }
+
+    lcrand_delete(rand);
+    return ret;
+}
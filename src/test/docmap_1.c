@@ -55,6 +55,11 @@
 static int verbose = 0;
 
 #define NEWDOCMAP_TEST_FD_TYPE 0xEADE
+#define NEWDOCMAP_TEST_COL_TYPE 0xEADF
+
+/* everything is cached, so that DUMP_LOAD goes through the column cache */
+#define NEWDOCMAP_TEST_CACHE (DOCMAP_CACHE_LOCATION | DOCMAP_CACHE_WORDS      \
+  | DOCMAP_CACHE_DISTINCT_WORDS | DOCMAP_CACHE_WEIGHT | DOCMAP_CACHE_TRECNO)
 
 #define DEFAULT_SEED 87
 
@@ -238,9 +243,13 @@ int do_run(char ** cmds, int num_cmds) {
     }
     fdset_set_type_name(fdset, NEWDOCMAP_TEST_FD_TYPE, "docmaptest", 
       strlen("docmaptest"), 1 /* writeable */);
+    fdset_set_type_name(fdset, NEWDOCMAP_TEST_COL_TYPE, "docmaptestcol", 
+      strlen("docmaptestcol"), 1 /* writeable */);
+    fdset_set_type_map(fdset, NEWDOCMAP_TEST_COL_TYPE, FDSET_MAP_RANDOM);
 
-    docmap = docmap_new(fdset, NEWDOCMAP_TEST_FD_TYPE, 4096, 0, 
-      filelen_max, 0xfffff, &dm_ret);
+    docmap = docmap_new(fdset, NEWDOCMAP_TEST_FD_TYPE, 
+      NEWDOCMAP_TEST_COL_TYPE, 4096, 0, filelen_max, 1, 
+      NEWDOCMAP_TEST_CACHE, &dm_ret);
     if (dm_ret != DOCMAP_OK) {
         ERROR1("Failed to create docmap: code %d\n", dm_ret);
         goto ERROR;
@@ -284,7 +293,7 @@ int do_run(char ** cmds, int num_cmds) {
                 dm_ret = docmap_add(docmap, docinfo->sourcefile,
                   docinfo->offset, docinfo->bytes, 
                   docinfo->flags, docinfo->words,
-                  docinfo->distinct_words, docinfo->weight,
+                  docinfo->distinct_words, NULL, docinfo->weight,
                   docinfo->aux, docinfo->aux_len, docinfo->mtype, &docno);
                 if (dm_ret != DOCMAP_OK) {
                     ERROR1("docmap error: '%s'", docmap_strerror(dm_ret));
@@ -369,8 +378,9 @@ int do_run(char ** cmds, int num_cmds) {
                 goto FAILURE;
             }
             docmap_delete(docmap);
-            docmap = docmap_load(fdset, NEWDOCMAP_TEST_FD_TYPE, 4096, 0, 
-                filelen_max, 0xfffffff, &dm_ret);
+            docmap = docmap_load(fdset, NEWDOCMAP_TEST_FD_TYPE, 
+                NEWDOCMAP_TEST_COL_TYPE, 4096, 0, filelen_max, 1, 
+                NEWDOCMAP_TEST_CACHE, &dm_ret);
             if (dm_ret != DOCMAP_OK) {
                 ERROR1("docmap error: '%s'\n", docmap_strerror(dm_ret));
                 abort();
@@ -394,15 +404,16 @@ ERROR:
     ret = -1;
 
 END:
+    if (docmap != NULL) {
+        docmap_delete(docmap);
+    }
     if (fdset != NULL) {
         int i;
         for (i = 0; i < 256; i++) 
             fdset_unlink(fdset, NEWDOCMAP_TEST_FD_TYPE, i);
+        fdset_unlink(fdset, NEWDOCMAP_TEST_COL_TYPE, 0);
         fdset_delete(fdset);
     }
-    if (docmap != NULL) {
-        docmap_delete(docmap);
-    }
     return ret;
 }
 
@@ -0,0 +1,261 @@
+/* impactcodec_1.c tests the bit-packed chunks of impactcodec.c, by writing
+ * chunks of d-gaps of every width from 0 to 32 bits and every length up to
+ * IMPACTCODEC_CHUNK, and checking that they read back as the document
+ * numbers the d-gaps describe.  Chunks are placed at the very end of their
+ * buffers, so that the decoder can't read past them without a memory checker
+ * noticing, and are also read back from runs of chunks that make up impact
+ * blocks longer than a chunk, where the decoder may read ahead into the next
+ * chunk.  Truncated chunks, chunks of impossible width and full output
+ * buffers must be refused without moving the vector.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "test.h"
+
+#include "impactcodec.h"
+#include "lcrand.h"
+#include "vec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEED 23                      /* seed for random numbers */
+#define BLOCK_MAX (5 * IMPACTCODEC_CHUNK) /* longest block of a run tested */
+
+/* internal function to fill gaps with n d-gaps of the given width, with at
+ * least one of them exactly width bits wide */
+static void fill(struct lcrand *rand, uint32_t *gaps, unsigned int n,
+  unsigned int width) {
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        gaps[i] = width ? lcrand(rand) >> (32 - width) : 0;
+    }
+    if (width) {
+        gaps[lcrand_limit(rand, n)] |= (uint32_t) 1 << (width - 1);
+    }
+}
+
+/* internal function to work out the document numbers that the n d-gaps in
+ * gaps describe, following on from docno */
+static void expect(const uint32_t *gaps, unsigned int n, uint32_t docno,
+  uint32_t *docnos) {
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        docno += gaps[i] + 1;
+        docnos[i] = docno;
+    }
+}
+
+/* internal function to write the n d-gaps in gaps as a chunk at the end of a
+ * buffer of exactly the right size, and check that it reads back the same,
+ * and that truncated or altered copies of it are refused */
+static int test_chunk(const uint32_t *gaps, unsigned int n,
+  unsigned int width) {
+    char tmp[IMPACTCODEC_MAX_BYTES],
+         *buf;
+    uint32_t docnos[IMPACTCODEC_CHUNK],
+             exp[IMPACTCODEC_CHUNK];
+    unsigned long int docno;
+    struct vec v;
+    unsigned int len,
+                 trunc;
+
+    v.pos = tmp;
+    v.end = tmp + sizeof(tmp);
+    if (!(len = impactcodec_write(&v, gaps, n)) || (v.pos != tmp + len)
+      || (len != 1 + (n * width + 7) / 8) || ((unsigned char) *tmp != width)) {
+        fprintf(stderr, "writing chunk of %u %u-bit d-gaps failed\n", n,
+          width);
+        return 0;
+    }
+
+    /* no space for the chunk, by a single byte */
+    v.pos = tmp;
+    v.end = tmp + len - 1;
+    if (impactcodec_write(&v, gaps, n) || (v.pos != tmp)) {
+        fprintf(stderr, "chunk of %u %u-bit d-gaps written without space\n",
+          n, width);
+        return 0;
+    }
+
+    if (!(buf = malloc(len))) {
+        return 0;
+    }
+    memcpy(buf, tmp, len);
+
+    /* the first document number of a block follows on from -1 */
+    expect(gaps, n, -1, exp);
+    docno = -1;
+    v.pos = buf;
+    v.end = buf + len;
+    if ((impactcodec_read(&v, n, &docno, docnos) != n) || (v.pos != v.end)
+      || memcmp(docnos, exp, n * sizeof(*exp)) || (docno != exp[n - 1])) {
+        fprintf(stderr, "chunk of %u %u-bit d-gaps read back wrongly\n", n,
+          width);
+        free(buf);
+        return 0;
+    }
+
+    /* widths of more than 32 bits can't be read */
+    *buf = 33;
+    docno = -1;
+    v.pos = buf;
+    if (impactcodec_read(&v, n, &docno, docnos) || (v.pos != buf)) {
+        fprintf(stderr, "chunk of %u d-gaps of 33 bits accepted\n", n);
+        free(buf);
+        return 0;
+    }
+    free(buf);
+
+    /* every truncation of the chunk has to be refused, again with the
+     * truncated chunk at the end of its buffer */
+    for (trunc = 0; trunc < len; trunc++) {
+        if (!(buf = malloc(trunc + 1))) {
+            return 0;
+        }
+        memcpy(buf, tmp, trunc);
+        v.pos = buf;
+        v.end = buf + trunc;
+        if (impactcodec_read(&v, n, &docno, docnos) || (v.pos != buf)) {
+            fprintf(stderr, "chunk of %u %u-bit d-gaps truncated to %u bytes "
+              "accepted\n", n, width, trunc);
+            free(buf);
+            return 0;
+        }
+        free(buf);
+    }
+
+    return 1;
+}
+
+/* internal function to write a block of size d-gaps of the given width as
+ * chunks, one after another, followed by a chunk of a different width, and
+ * check that the chunks read back as the block's document numbers */
+static int test_block(struct lcrand *rand, unsigned int size,
+  unsigned int width) {
+    static uint32_t gaps[BLOCK_MAX + IMPACTCODEC_CHUNK],
+                    exp[BLOCK_MAX + IMPACTCODEC_CHUNK];
+    uint32_t docnos[IMPACTCODEC_CHUNK];
+    unsigned long int docno = -1;
+    char *buf;
+    struct vec v;
+    unsigned int i,
+                 n,
+                 len,
+                 chunks = (size + IMPACTCODEC_CHUNK - 1) / IMPACTCODEC_CHUNK;
+    int ret = 1;
+
+    fill(rand, gaps, size, width);
+    fill(rand, gaps + size, IMPACTCODEC_CHUNK, 32 - width);
+    expect(gaps, size, -1, exp);
+    expect(gaps + size, IMPACTCODEC_CHUNK, -1, exp + size);
+
+    len = (chunks + 1) * IMPACTCODEC_MAX_BYTES;
+    if (!(buf = malloc(len))) {
+        return 0;
+    }
+    v.pos = buf;
+    v.end = buf + len;
+    for (i = 0; i < size; i += n) {
+        n = (size - i < IMPACTCODEC_CHUNK) ? size - i : IMPACTCODEC_CHUNK;
+        if (!impactcodec_write(&v, gaps + i, n)) {
+            free(buf);
+            return 0;
+        }
+    }
+    if (!impactcodec_write(&v, gaps + size, IMPACTCODEC_CHUNK)) {
+        free(buf);
+        return 0;
+    }
+    v.end = v.pos;
+    v.pos = buf;
+
+    for (i = 0; ret && (i < size); i += n) {
+        n = (size - i < IMPACTCODEC_CHUNK) ? size - i : IMPACTCODEC_CHUNK;
+        if ((impactcodec_read(&v, n, &docno, docnos) != n)
+          || memcmp(docnos, exp + i, n * sizeof(*docnos))) {
+            fprintf(stderr, "chunk %u of block of %u %u-bit d-gaps read "
+              "wrongly\n", i / IMPACTCODEC_CHUNK, size, width);
+            ret = 0;
+        }
+    }
+
+    /* the following chunk starts a new block */
+    docno = -1;
+    if (ret && ((impactcodec_read(&v, IMPACTCODEC_CHUNK, &docno, docnos)
+          != IMPACTCODEC_CHUNK)
+        || memcmp(docnos, exp + size, IMPACTCODEC_CHUNK * sizeof(*docnos))
+        || (v.pos != v.end))) {
+        fprintf(stderr, "chunk after block of %u %u-bit d-gaps read "
+          "wrongly\n", size, width);
+        ret = 0;
+    }
+
+    free(buf);
+    return ret;
+}
+
+int test_file(FILE *fp, int argc, char **argv) {
+    uint32_t gaps[IMPACTCODEC_CHUNK],
+             docnos[IMPACTCODEC_CHUNK];
+    unsigned long int docno = -1;
+    struct lcrand *rand;
+    unsigned int n,
+                 width;
+    int ret = 1;
+
+    /* ensure that we aren't testing from a file */
+    if ((fp && (fp != stdin)) || (argc > 1)) {
+        return 0;
+    }
+
+    if (!(rand = lcrand_new(SEED))) {
+        return 0;
+    }
+
+    /* chunks of every width and length, including width 0 (consecutive
+     * documents) and width 32 */
+    for (width = 0; ret && (width <= 32); width++) {
+        for (n = 1; ret && (n <= IMPACTCODEC_CHUNK); n++) {
+            fill(rand, gaps, n, width);
+            ret = test_chunk(gaps, n, width);
+        }
+    }
+
+    /* the largest d-gaps of 32 bits */
+    for (n = 0; n < IMPACTCODEC_CHUNK; n++) {
+        gaps[n] = 0xffffffff;
+    }
+    for (n = 1; ret && (n <= IMPACTCODEC_CHUNK); n++) {
+        ret = test_chunk(gaps, n, 32);
+    }
+
+    /* blocks either side of each multiple of the chunk size */
+    for (width = 0; ret && (width <= 32); width++) {
+        for (n = IMPACTCODEC_CHUNK - 1; ret && (n <= BLOCK_MAX);
+          n += (n % IMPACTCODEC_CHUNK == 1) ? IMPACTCODEC_CHUNK - 2 : 1) {
+            ret = test_block(rand, n, width);
+        }
+    }
+
+    /* a chunk of no d-gaps can't be read */
+    if (ret) {
+        char c = 0;
+        struct vec v;
+
+        v.pos = &c;
+        v.end = &c + 1;
+        if (impactcodec_read(&v, 0, &docno, docnos) || (v.pos != &c)) {
+            fprintf(stderr, "chunk of no d-gaps read\n");
+            ret = 0;
+        }
+    }
+
+    lcrand_delete(rand);
+    return ret;
+}
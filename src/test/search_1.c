@@ -0,0 +1,268 @@
+/* search_1 builds a small index and checks that index_search_results and
+ * index_search_stream return the same results as each other, that fields
+ * that don't fit in the arena come back NULL, that titles come back as they
+ * are in the documents, and that streaming stops when the callback asks it 
+ * to
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "test.h"
+#include "index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME "search_1_idx"            /* prefix of the index built */
+#define FILE_NAME "search_1_docs.trec" /* collection indexed */
+#define DOCS 20                        /* number of documents in it */
+#define RESULTS 10                     /* number of results requested */
+#define QUERY "apple"                  /* query run (matches every doc) */
+
+/* state of a stream of results */
+struct stream {
+    struct index_hit hit[RESULTS];     /* results passed, up to stop */
+    unsigned int hits;                 /* number of results passed */
+    unsigned int stop;                 /* result to stop streaming after */
+};
+
+/* callback for index_search_stream, which copies the results into a struct
+ * stream until it has stop of them */
+static int stream_fn(void *opaque, const struct index_hit *hit) {
+    struct stream *stream = opaque;
+
+    if (stream->hits < RESULTS) {
+        stream->hit[stream->hits] = *hit;
+    }
+    stream->hits++;
+    return stream->hits < stream->stop;
+}
+
+/* internal function to write out a small TREC collection, where document i
+ * contains the query term i + 1 times, so every document matches */
+static int write_docs(void) {
+    FILE *fp;
+    unsigned int i,
+                 j;
+
+    if (!(fp = fopen(FILE_NAME, "wb"))) {
+        return 0;
+    }
+
+    for (i = 0; i < DOCS; i++) {
+        fprintf(fp, "<DOC>\n<DOCNO> DOC-%02u </DOCNO>\n"
+          "<TITLE> title of doc %02u </TITLE>\n", i, i);
+        for (j = 0; j <= i; j++) {
+            fprintf(fp, "%s pear banana\n", QUERY);
+        }
+        fprintf(fp, "</DOC>\n");
+    }
+
+    return !fclose(fp);
+}
+
+/* internal function to check that hit has the aux field of document docno */
+static int hit_aux(const struct index_hit *hit) {
+    char buf[10];
+
+    sprintf(buf, "DOC-%02lu", hit->docno);
+    return hit->aux && (hit->aux_len == strlen(buf))
+      && !strcmp(hit->aux, buf);
+}
+
+/* internal function to check that hit has the title of document docno */
+static int hit_title(const struct index_hit *hit) {
+    char buf[20];
+
+    sprintf(buf, "title of doc %02lu ", hit->docno);
+    return hit->title && (hit->title_len == strlen(buf))
+      && !strcmp(hit->title, buf);
+}
+
+/* internal function to leave garbage in freed memory, so that fields that
+ * aren't terminated properly don't happen to be terminated by zeroed memory 
+ * from the system */
+static void dirty_heap(void) {
+    void *block[64];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(block) / sizeof(*block); i++) {
+        if ((block[i] = malloc(64 * (i + 1)))) {
+            memset(block[i], 'X', 64 * (i + 1));
+        }
+    }
+    for (i = 0; i < sizeof(block) / sizeof(*block); i++) {
+        if (block[i]) {
+            free(block[i]);
+        }
+    }
+}
+
+/* internal function to run the searches that are being tested over idx */
+static int test_search(struct index *idx) {
+    struct index_hit full[RESULTS],
+                     part[RESULTS];
+    struct stream stream;
+    char arena[INDEX_RESULT_ARENA(RESULTS, 
+      INDEX_RESULT_AUX | INDEX_RESULT_TITLE)];
+    unsigned int results,
+                 i,
+                 fit;
+    double total;
+    int est;
+
+    /* with the whole arena, every result gets its aux field */
+    if (!index_search_results(idx, QUERY, 0, RESULTS, INDEX_RESULT_AUX,
+        full, arena, INDEX_RESULT_ARENA(RESULTS, INDEX_RESULT_AUX), &results,
+        &total, &est, INDEX_SEARCH_NOOPT, NULL)
+      || (results != RESULTS) || (total != DOCS)) {
+        fprintf(stderr, "full search failed\n");
+        return 0;
+    }
+    for (i = 0; i < RESULTS; i++) {
+        if (!hit_aux(&full[i]) || full[i].title || full[i].summary) {
+            fprintf(stderr, "full search result %u has wrong fields\n", i);
+            return 0;
+        }
+    }
+
+    /* with room for only a few of them, the rest come back NULL, but are
+     * otherwise the same */
+    fit = 3;
+    if (!index_search_results(idx, QUERY, 0, RESULTS, INDEX_RESULT_AUX,
+        part, arena, fit * (full[0].aux_len + 1), &results, &total, &est,
+        INDEX_SEARCH_NOOPT, NULL)
+      || (results != RESULTS)) {
+        fprintf(stderr, "partial search failed\n");
+        return 0;
+    }
+    for (i = 0; i < RESULTS; i++) {
+        if ((part[i].docno != full[i].docno)
+          || (part[i].score != full[i].score)
+          || ((i < fit) && !hit_aux(&part[i]))
+          || ((i >= fit) && (part[i].aux || part[i].aux_len))) {
+            fprintf(stderr, "partial search result %u is wrong\n", i);
+            return 0;
+        }
+    }
+
+    /* without an arena, only document numbers and scores come back */
+    if (!index_search_results(idx, QUERY, 0, RESULTS, INDEX_RESULT_AUX,
+        part, NULL, 0, &results, &total, &est, INDEX_SEARCH_NOOPT, NULL)
+      || (results != RESULTS)) {
+        fprintf(stderr, "search without arena failed\n");
+        return 0;
+    }
+    for (i = 0; i < RESULTS; i++) {
+        if ((part[i].docno != full[i].docno) || part[i].aux) {
+            fprintf(stderr, "search without arena result %u is wrong\n", i);
+            return 0;
+        }
+    }
+
+    /* titles are summarised into the results as they are in the documents */
+    dirty_heap();
+    if (!index_search_results(idx, QUERY, 0, RESULTS, 
+        INDEX_RESULT_AUX | INDEX_RESULT_TITLE, part, arena, sizeof(arena), 
+        &results, &total, &est, INDEX_SEARCH_NOOPT, NULL)
+      || (results != RESULTS)) {
+        fprintf(stderr, "search for titles failed\n");
+        return 0;
+    }
+    for (i = 0; i < RESULTS; i++) {
+        if ((part[i].docno != full[i].docno) || !hit_aux(&part[i]) 
+          || !hit_title(&part[i]) || part[i].summary) {
+            fprintf(stderr, "title search result %u is wrong (title '%s')\n",
+              i, part[i].title ? part[i].title : "");
+            return 0;
+        }
+    }
+
+    /* streaming all results gives the same results */
+    stream.hits = 0;
+    stream.stop = RESULTS + 1;
+    if (!index_search_stream(idx, QUERY, 0, RESULTS, INDEX_RESULT_AUX,
+        stream_fn, &stream, &results, &total, &est, INDEX_SEARCH_NOOPT, NULL)
+      || (results != RESULTS) || (stream.hits != RESULTS)
+      || (total != DOCS)) {
+        fprintf(stderr, "stream failed\n");
+        return 0;
+    }
+    for (i = 0; i < RESULTS; i++) {
+        if ((stream.hit[i].docno != full[i].docno)
+          || (stream.hit[i].score != full[i].score)) {
+            fprintf(stderr, "stream result %u is wrong\n", i);
+            return 0;
+        }
+    }
+
+    /* streaming stops as soon as the callback returns 0 */
+    stream.hits = 0;
+    stream.stop = 4;
+    if (!index_search_stream(idx, QUERY, 0, RESULTS, INDEX_RESULT_AUX,
+        stream_fn, &stream, &results, &total, &est, INDEX_SEARCH_NOOPT, NULL)
+      || (results != stream.stop) || (stream.hits != stream.stop)) {
+        fprintf(stderr, "stopped stream passed %u results (%u counted), "
+          "not %u\n", stream.hits, results, stream.stop);
+        return 0;
+    }
+    for (i = 0; i < stream.stop; i++) {
+        if (stream.hit[i].docno != full[i].docno) {
+            fprintf(stderr, "stopped stream result %u is wrong\n", i);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int test_file(FILE *fp, int argc, char **argv) {
+    struct index *idx;
+    struct index_new_opt nopt;
+    struct index_add_opt aopt;
+    struct index_commit_opt copt;
+    unsigned long int docno;
+    unsigned int docs;
+    int ret;
+
+    /* ensure that we aren't testing from a file */
+    if ((fp && (fp != stdin)) || (argc > 1)) {
+        return 0;
+    }
+
+    memset(&nopt, 0, sizeof(nopt));
+    memset(&aopt, 0, sizeof(aopt));
+    memset(&copt, 0, sizeof(copt));
+
+    if (!write_docs()) {
+        fprintf(stderr, "couldn't write collection\n");
+        return 0;
+    }
+
+    if (!(idx = index_new(NAME, NULL, 1024 * 1024, INDEX_NEW_NOOPT, &nopt))) {
+        fprintf(stderr, "couldn't create index\n");
+        remove(FILE_NAME);
+        return 0;
+    }
+
+    if (!index_add(idx, FILE_NAME, "application/x-trec", &docno, &docs,
+        INDEX_ADD_NOOPT, &aopt, INDEX_COMMIT_NOOPT, &copt)
+      || (docs != DOCS)
+      || !index_commit(idx, INDEX_COMMIT_NOOPT, &copt, INDEX_ADD_NOOPT, 
+          &aopt)) {
+        fprintf(stderr, "couldn't build index\n");
+        index_rm(idx);
+        index_delete(idx);
+        remove(FILE_NAME);
+        return 0;
+    }
+
+    ret = test_search(idx);
+
+    index_rm(idx);
+    index_delete(idx);
+    remove(FILE_NAME);
+    return ret;
+}
@@ -17,6 +17,7 @@
 #include "mlparse_wrap.h"
 #include "docmap.h"           /* needed to set cache values on index load */
 #include "index.h"
+#include "searchpool.h"
 #include "str.h"
 #include "summarise.h"
 #include "trec_eval.h"
@@ -59,6 +60,12 @@ static void print_usage(FILE *output, const char *progname) {
     fprintf(output, "    --timing: print total querying time to stderr\n");
     fprintf(output, "              (excludes index loading time)\n");
     fprintf(output, "    --big-and-fast: use more memory\n");
+    fprintf(output, "    --threads=[uint]: evaluate this many queries at "
+      "once\n");
+    fprintf(output, "    --mmap: memory-map the index rather than reading "
+      "it\n");
+    fprintf(output, "    --norms: hold document lengths and weights in "
+      "memory approximately,\n             as 8-bit norms\n");
     fprintf(output, "    --dummy: insert dummy results for topics with no "
       "results\n");
     fprintf(output, "    --non-stop: don't halt on empty topics\n");
@@ -78,6 +85,11 @@ static void print_usage(FILE *output, const char *progname) {
     fprintf(output, "    -1,--k1=[float]: set Okapi BM25 k1 value\n");
     fprintf(output, "    -3,--k3=[float]: set Okapi BM25 k3 value\n");
     fprintf(output, "    -b,--b=[float]: set Okapi BM25 b value\n");
+    fprintf(output, "    --bm25f=[boost[:b],...]: use BM25F metric, with "
+      "boost and b for\n"
+      "                             each field in turn (field 0 first, "
+      "others\n"
+      "                             default to a boost of 1 and the b value)\n");
     fprintf(output, "    -p,--pivoted-cosine=[float]: use pivoted cosine "
       "metric, with given pivot\n");
     fprintf(output, "    -c,--cosine: use cosine metric\n");
@@ -85,6 +97,14 @@ static void print_usage(FILE *output, const char *progname) {
       "with alpha given\n");
     fprintf(output, "    --dirichlet=[uint]: use Dirichlet-smoothed LM "
       "metric, with mu given\n");
+    fprintf(output, "    --prune: skip documents that can't make the results\n"
+      "             (okapi and dirichlet only, results are unchanged)\n");
+    fprintf(output, "    --budget-postings=[uint]: stop impact-ordered "
+      "evaluation after this many\n"
+      "                              postings (anh-impact only)\n");
+    fprintf(output, "    --budget-time=[uint]: stop impact-ordered "
+      "evaluation after this many\n"
+      "                          microseconds (anh-impact only)\n");
     return;
 }
 
@@ -116,6 +136,10 @@ struct args {
     int cont;                          /* whether to continue evaluation 
                                         * through errors */
     char *stoplist;                    /* stop file */
+    unsigned int threads;              /* number of queries to evaluate at 
+                                        * once */
+    struct searchpool *pool;           /* pool of threads to evaluate 
+                                        * queries (or NULL) */
 };
 
 static void free_args(struct args *args) {
@@ -135,6 +159,11 @@ static void free_args(struct args *args) {
         free(args->stoplist);
     }
 
+    if (args->pool) {
+        searchpool_delete(args->pool);
+        args->pool = NULL;
+    }
+
     if (args->idx) {
         index_delete(args->idx);
         args->idx = NULL;
@@ -219,9 +248,40 @@ enum {
     OPT_VERSION, OPT_QRELS, OPT_TIMING, OPT_ACCUMULATOR_LIMIT,
     OPT_IGNORE_VERSION, OPT_MEMORY, OPT_ANH_IMPACT, OPT_PHRASE, OPT_DUMMY, 
     OPT_CUTOFF, OPT_PARSEBUF, OPT_TABLESIZE, OPT_BIG_AND_FAST, OPT_NONSTOP,
-    OPT_STOP
+    OPT_STOP, OPT_PRUNE, OPT_THREADS, OPT_MMAP, OPT_NORMS, 
+    OPT_BUDGET_POSTINGS, OPT_BUDGET_TIME, OPT_BM25F
 };
 
+/* internal function to parse a comma-separated list of BM25F field 
+ * parameters (field 0 first), each a boost optionally followed by a colon 
+ * and a b value, into boost and b.  Fields that aren't listed are left
+ * alone.  Returns true on success. */
+static int parse_bm25f(const char *arg, float *boost, float *b) {
+    unsigned int field = 0;
+    char *end;
+
+    do {
+        if (field >= INDEX_FIELDS) {
+            return 0;
+        }
+        boost[field] = (float) strtod(arg, &end);
+        if (end == arg) {
+            return 0;
+        }
+        if (*end == ':') {
+            arg = end + 1;
+            b[field] = (float) strtod(arg, &end);
+            if (end == arg) {
+                return 0;
+            }
+        }
+        field++;
+        arg = end + 1;
+    } while (*end == ',');
+
+    return !*end;
+}
+
 static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
     struct args *args;
     int err = 0,
@@ -233,6 +293,9 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
     const char *arg;
     struct getlongopt *parser;
     enum getlongopt_ret ret = GETLONGOPT_OK;
+    float boost[INDEX_FIELDS],   /* BM25F boost for each field */
+          b[INDEX_FIELDS];       /* BM25F b for each field (-1 if unset) */
+    unsigned int field;          /* current field */
 
     struct getlongopt_opt opts[] = {
         {"file", 'f', GETLONGOPT_ARG_REQUIRED, OPT_FILE},
@@ -248,9 +311,14 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
         {"k1", '1', GETLONGOPT_ARG_REQUIRED, OPT_K1},
         {"k3", '3', GETLONGOPT_ARG_REQUIRED, OPT_K3},
         {"b", 'b', GETLONGOPT_ARG_REQUIRED, OPT_B},
+        {"bm25f", '\0', GETLONGOPT_ARG_REQUIRED, OPT_BM25F},
         {"pivoted-cosine", 'p', GETLONGOPT_ARG_REQUIRED, OPT_PIVOTED_COSINE},
         {"cosine", 'c', GETLONGOPT_ARG_NONE, OPT_COSINE},
         {"anh-impact", '\0', GETLONGOPT_ARG_NONE, OPT_ANH_IMPACT},
+        {"prune", '\0', GETLONGOPT_ARG_NONE, OPT_PRUNE},
+        {"budget-postings", '\0', GETLONGOPT_ARG_REQUIRED, 
+          OPT_BUDGET_POSTINGS},
+        {"budget-time", '\0', GETLONGOPT_ARG_REQUIRED, OPT_BUDGET_TIME},
 
         {"title", 't', GETLONGOPT_ARG_NONE, OPT_TITLE},
         {"description", 'd', GETLONGOPT_ARG_NONE, OPT_DESCRIPTION},
@@ -271,6 +339,9 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
         {"dummy", '\0', GETLONGOPT_ARG_NONE, OPT_DUMMY},
         {"non-stop", '\0', GETLONGOPT_ARG_NONE, OPT_NONSTOP},
         {"query-stop", '\0', GETLONGOPT_ARG_OPTIONAL, OPT_STOP},
+        {"threads", '\0', GETLONGOPT_ARG_REQUIRED, OPT_THREADS},
+        {"mmap", '\0', GETLONGOPT_ARG_NONE, OPT_MMAP},
+        {"norms", '\0', GETLONGOPT_ARG_NONE, OPT_NORMS},
         {NULL, 'V', GETLONGOPT_ARG_NONE, OPT_VERSION}
     };
 
@@ -302,6 +373,12 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
     args->sopt.u.okapi_k3.k1 = 1.2F;
     args->sopt.u.okapi_k3.k3 = 1e10;
     args->sopt.u.okapi_k3.b = 0.75;
+    for (field = 0; field < INDEX_FIELDS; field++) {
+        boost[field] = 1.0F;
+        b[field] = -1.0F;
+    }
+    args->sopt.budget_postings = 0;
+    args->sopt.budget_usec = 0;
     args->lopt.docmap_cache = DOCMAP_CACHE_TRECNO;
     args->print_queries = args->timing = 0;
     args->memory = MEMORY_DEFAULT;
@@ -309,6 +386,8 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
     args->cutoff = 0;
     args->dummy = 0;
     args->cont = 0;
+    args->threads = 1;
+    args->pool = NULL;
 
     /* parse arguments */
     while (!err 
@@ -426,6 +505,35 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
             args->cont = 1;
             break;
 
+        case OPT_THREADS:
+            errno = 0;
+            num = strtol(arg, &tmp, 10);
+            if (!errno && (num > 0) && (num <= UINT_MAX) && !*tmp) {
+                args->threads = num;
+#ifndef MT_ZET
+                if (num > 1) {
+                    fprintf(output, "%s was built without support for "
+                      "concurrent searching\n", PACKAGE);
+                    err = 1;
+                }
+#endif /* MT_ZET */
+            } else {
+                fprintf(output, "error converting threads value '%s'\n", 
+                  arg);
+                err = 1;
+            }
+            break;
+
+        case OPT_MMAP:
+            args->lopts |= INDEX_LOAD_MMAP;
+            break;
+
+        case OPT_NORMS:
+            /* arrange for lengths to be loaded into memory as norms */
+            args->lopts |= INDEX_LOAD_DOCMAP_CACHE;
+            args->lopt.docmap_cache |= DOCMAP_CACHE_WORDS | DOCMAP_CACHE_NORMS;
+            break;
+
         case OPT_DUMMY:
             args->dummy = 1;
             break;
@@ -506,6 +614,27 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
             args->sopts |= INDEX_SEARCH_ANH_IMPACT_RANK;
             break;
 
+        case OPT_PRUNE:
+            args->sopts |= INDEX_SEARCH_PRUNE;
+            break;
+
+        case OPT_BUDGET_POSTINGS:
+        case OPT_BUDGET_TIME:
+            errno = 0;
+            num = strtol(arg, &tmp, 10);
+            if (!errno && !*tmp && (num >= 0)) {
+                args->sopts |= INDEX_SEARCH_ANYTIME;
+                if (id == OPT_BUDGET_POSTINGS) {
+                    args->sopt.budget_postings = num;
+                } else {
+                    args->sopt.budget_usec = num;
+                }
+            } else {
+                fprintf(output, "error converting budget value '%s'\n", arg);
+                err = 1;
+            }
+            break;
+
         case OPT_HAWKAPI:
             /* they want to use hawkapi */
             args->sopts |= INDEX_SEARCH_HAWKAPI_RANK;
@@ -529,6 +658,15 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
             args->sopts |= INDEX_SEARCH_OKAPI_RANK;
             break;
 
+        case OPT_BM25F:
+            /* they want to use BM25F */
+            args->sopts |= INDEX_SEARCH_BM25F_RANK;
+            if (!parse_bm25f(arg, boost, b)) {
+                fprintf(output, "can't read BM25F field values '%s'\n", arg);
+                err = 1;
+            }
+            break;
+
         case OPT_K1:
             /* set okapi k1 parameter */
             if (sscanf(arg, "%f", &args->sopt.u.okapi_k3.k1)) {
@@ -635,6 +773,22 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
         free(args);
         return NULL;
     }
+
+    /* BM25F shares k1, k3 and (unless given per field) b with okapi, which
+     * occupies the same space, so move them across now */
+    if (args->sopts & INDEX_SEARCH_BM25F_RANK) {
+        float k1 = args->sopt.u.okapi_k3.k1,
+              k3 = args->sopt.u.okapi_k3.k3,
+              okapi_b = args->sopt.u.okapi_k3.b;
+
+        args->sopt.u.bm25f.k1 = k1;
+        args->sopt.u.bm25f.k3 = k3;
+        for (field = 0; field < INDEX_FIELDS; field++) {
+            args->sopt.u.bm25f.boost[field] = boost[field];
+            args->sopt.u.bm25f.b[field] 
+              = (b[field] < 0.0F) ? okapi_b : b[field];
+        }
+    }
         
     /* remaining arguments should be index */
     while (!err && (ind < (unsigned int) argc)) {
@@ -683,6 +837,13 @@ static struct args *parse_args(unsigned int argc, char **argv, FILE *output) {
         err = 1;
     }
 
+    /* start threads to evaluate queries if they want them */
+    if (!err && (args->threads > 1) 
+      && !(args->pool = searchpool_new(args->idx, args->threads))) {
+        fprintf(output, "couldn't start %u search threads\n", args->threads);
+        err = quiet = 1;
+    }
+
     if (!(args->title || args->descr || args->narr)) {
         /* title only run is default */
         args->title = 1;
@@ -956,6 +1117,119 @@ static char *get_next_query(struct mlparse_wrap *parser, char *querynum,
     return NULL;
 }
 
+/* internal function to output the results of a query for topic querynum in
+ * trec_eval format (or add them to teresults, if given) */
+static int output_results(struct args *args, FILE *output, 
+  struct treceval *teresults, const char *querynum, 
+  const struct index_hit *results, unsigned int returned) {
+    unsigned int i;
+    char aux_buf[512];
+
+    for (i = 0; i < returned; i++) {
+        char *docno = NULL;
+
+        /* hack: any document that doesn't have a TREC docno will
+         * inherit the docno of the previous document (until we 
+         * find one that has a docno) */
+
+        if (results[i].aux && results[i].aux[0]) {
+            strncpy(aux_buf, results[i].aux, sizeof(aux_buf));
+            docno = aux_buf;
+        } else {
+            int ret = 1;
+            unsigned long int docnum = results[i].docno;
+            unsigned int aux_len = 0;
+
+            /* retrieve TREC docno for progressively higher docs */
+            while (ret && (docnum > 0) && !aux_len) {
+                docnum--;
+                ret = index_retrieve_doc_aux(args->idx, docnum,
+                  aux_buf, sizeof(aux_buf) - 1, &aux_len);
+                /* XXX assume trec docno always < 512 bytes long */
+            }
+            if (ret && aux_len) {
+                docno = aux_buf;
+            }
+        }
+        aux_buf[sizeof(aux_buf) - 1] = '\0';
+
+        if (teresults 
+          && docno
+          && treceval_add_result(teresults, atoi(querynum), 
+              docno, (float) results[i].score)) {
+            /* they want evaluated results, stuck it in the results
+             * structure */
+        } else if (!teresults && docno) {
+            str_toupper(docno);
+
+            /* print out query_id, iter (ignored - so we print
+             * out number of seconds taken), docno, rank
+             * (ignored), score, run_id */
+            fprintf(output, "%s\tQ0\t%s\t%u\t%f\t%s\n", querynum, 
+              docno, i + 1, results[i].score, 
+              args->run_id);
+        } else if (teresults && docno) {
+            fprintf(stderr, "failed to add to treceval results\n");
+            return 0;
+        } else {
+            /* couldn't copy the docno */
+            fprintf(stderr, "docno ('%s') copy failed: %s\n", 
+              results[i].aux ? results[i].aux : "", strerror(errno));
+            return 0;
+        }
+    }
+
+    if (returned == 0 && args->dummy) {
+        /* no results, insert dummy result if requested */
+        fprintf(output, "%s\tQ0\t%s\t%u\t%f\t%s\n", querynum,    
+          "XXXX-XXX-XXXXXXX", 1, 0.0, args->run_id);
+    }
+
+    return 1;
+}
+
+/* internal function to output the results of queries evaluated by the search
+ * pool, until no more than pending are outstanding.  hits is an array of 
+ * args->numresults results to point at the pool's results while they're 
+ * output. */
+static int output_pool_results(struct args *args, FILE *output,
+  struct treceval *teresults, struct index_hit *hits, unsigned int pending) {
+    struct searchpool_result *res;
+    unsigned int i;
+    int ok = 1;
+
+    while (ok && (searchpool_pending(args->pool) > pending)
+      && (searchpool_next(args->pool, &res) == SEARCHPOOL_OK)) {
+        if (res->ok) {
+            if (args->print_queries) {
+                fprintf(stderr, 
+                  "query '%s' completed in %lu microseconds\n", res->query,
+                  (unsigned long int) (res->seconds * 1000000));
+            }
+            for (i = 0; i < res->results; i++) {
+                hits[i].docno = res->result[i].docno;
+                hits[i].score = res->result[i].score;
+                hits[i].aux = res->result[i].auxilliary;
+                hits[i].aux_len = strlen(res->result[i].auxilliary);
+                hits[i].title = hits[i].summary = NULL;
+                hits[i].title_len = hits[i].summary_len = 0;
+            }
+            ok = output_results(args, output, teresults, res->userdata, 
+                hits, res->results);
+        } else {
+            /* error searching */
+            fprintf(stderr, "error searching index\n");
+            ok = 0;
+        }
+
+        /* userdata is a copy of the topic number */
+        free(res->userdata);
+        searchpool_result_delete(res);
+    }
+
+    return ok;
+}
+
 /* internal function to execute queries from a topic file against an
  * index and output the results in trec_eval format */
 static int process_topic_file(FILE *fp, struct args *args, FILE *output, 
@@ -963,9 +1237,11 @@ static int process_topic_file(FILE *fp, struct args *args, FILE *output,
     struct index_stats stats;
     char *query,
          *querynum = NULL;
-    struct index_result *results = NULL;
-    unsigned int returned,
-                 i;
+    struct index_hit *results = NULL;
+    char *arena;
+    unsigned long int arenalen 
+      = INDEX_RESULT_ARENA(args->numresults, INDEX_RESULT_AUX);
+    unsigned int returned;
     int est;
     double total_results;
     struct mlparse_wrap *parser;
@@ -980,9 +1256,13 @@ static int process_topic_file(FILE *fp, struct args *args, FILE *output,
 
     if ((parser = mlparse_wrap_new_file(stats.maxtermlen, LOOKAHEAD, fp, 
         BUFSIZ, 0))
-      && (results = malloc(sizeof(*results) * args->numresults))
+      && (results = malloc(sizeof(*results) * args->numresults + arenalen))
       && (querynum = malloc(stats.maxtermlen + 2))) {
 
+        /* only the docnos of results are printed, which are kept in the 
+         * arena after the results */
+        arena = (char *) (results + args->numresults);
+
         while ((query = get_next_query(parser, 
             querynum, stats.maxtermlen + 1, args->title, args->descr, 
             args->narr, &args->sopt.word_limit, args))) {
@@ -1000,7 +1280,16 @@ static int process_topic_file(FILE *fp, struct args *args, FILE *output,
                 }
 
                 if (args->cont && strlen(querynum)) {
-                    /* continue evaluation */
+                    /* continue evaluation (printing everything before this 
+                     * topic first, to keep the output in order) */
+                    if (args->pool 
+                      && !output_pool_results(args, output, teresults, results, 0)) {
+                        free(query);
+                        free(results);
+                        free(querynum);
+                        mlparse_wrap_delete(parser);
+                        return 0;
+                    }
                     if (args->dummy) {
                         /* no results, insert dummy result if requested */
                         fprintf(output, "%s\tQ0\t%s\t%u\t%f\t%s\n", querynum,
@@ -1020,98 +1309,62 @@ static int process_topic_file(FILE *fp, struct args *args, FILE *output,
 
             /* FIXME: detect errors */
 
-            gettimeofday(&then, NULL);
-            if (index_search(args->idx, (const char *) query, 0, 
-                args->numresults, results, &returned, 
-                &total_results, &est, (args->sopts | INDEX_SEARCH_WORD_LIMIT | 
-                INDEX_SEARCH_SUMMARY_TYPE), &args->sopt)) {
-                char aux_buf[512];
-
-                gettimeofday(&now, NULL);
-
-                if (args->print_queries) {
-                    fprintf(stderr, 
-                      "query '%s' completed in %lu microseconds\n", query,
-                      (unsigned long int) now.tv_usec - then.tv_usec 
-                        + (now.tv_sec - then.tv_sec) * 1000000);
+            if (args->pool) {
+                /* hand the query to the pool (which copies the options, 
+                 * including the word limit for this query), and output 
+                 * results as they become available, keeping a few queries
+                 * per thread outstanding */
+                char *num = str_dup(querynum);
+
+                if (!num 
+                  || (searchpool_submit(args->pool, query, 0, 
+                      args->numresults, (args->sopts | INDEX_SEARCH_WORD_LIMIT
+                        | INDEX_SEARCH_SUMMARY_TYPE), &args->sopt, num)
+                    != SEARCHPOOL_OK)
+                  || !output_pool_results(args, output, teresults, results,
+                      4 * searchpool_threads(args->pool))) {
+                    fprintf(stderr, "error searching index\n");
+                    free(query);
+                    free(results);
+                    free(querynum);
+                    mlparse_wrap_delete(parser);
+                    return 0;
                 }
-
-                /* print results */
-                for (i = 0; i < returned; i++) {
-                    char *docno = NULL;
-
-                    /* hack: any document that doesn't have a TREC docno will
-                     * inherit the docno of the previous document (until we 
-                     * find one that has a docno) */
-
-                    if (results[i].auxilliary && results[i].auxilliary[0]) {
-                        strncpy(aux_buf, results[i].auxilliary, 
-                          sizeof(aux_buf));
-                        docno = aux_buf;
-                    } else {
-                        int ret = 1;
-                        unsigned long int docnum = results[i].docno;
-                        unsigned int aux_len = 0;
-
-                        /* retrieve TREC docno for progressively higher docs */
-                        while (ret && (docnum > 0) && !aux_len) {
-                            docnum--;
-                            ret = index_retrieve_doc_aux(args->idx, docnum,
-                              aux_buf, sizeof(aux_buf) - 1, &aux_len);
-                            /* XXX assume trec docno always < 512 bytes long */
-                        }
-                        if (ret && aux_len) {
-                            docno = aux_buf;
-                        }
+            } else {
+                gettimeofday(&then, NULL);
+                if (index_search_results(args->idx, (const char *) query, 0,
+                    args->numresults, INDEX_RESULT_AUX, results, arena, 
+                    arenalen, &returned, &total_results, &est, (args->sopts 
+                      | INDEX_SEARCH_WORD_LIMIT | INDEX_SEARCH_SUMMARY_TYPE), 
+                    &args->sopt)) {
+
+                    gettimeofday(&now, NULL);
+
+                    if (args->print_queries) {
+                        fprintf(stderr, 
+                          "query '%s' completed in %lu microseconds%s\n", 
+                          query, (unsigned long int) now.tv_usec 
+                            - then.tv_usec 
+                            + (now.tv_sec - then.tv_sec) * 1000000,
+                          (est & INDEX_SEARCH_EST_RESULTS) 
+                            ? " (budget exhausted)" : "");
                     }
-                    aux_buf[sizeof(aux_buf) - 1] = '\0';
-
-                    if (teresults 
-                      && docno
-                      && treceval_add_result(teresults, atoi(querynum), 
-                          docno, (float) results[i].score)) {
-                        /* they want evaluated results, stuck it in the results
-                         * structure */
-                    } else if (!teresults && docno) {
-                        str_toupper(docno);
-
-                        /* print out query_id, iter (ignored - so we print
-                         * out number of seconds taken), docno, rank
-                         * (ignored), score, run_id */
-                        fprintf(output, "%s\tQ0\t%s\t%u\t%f\t%s\n", querynum, 
-                          docno, i + 1, results[i].score, 
-                          args->run_id);
-                    } else if (teresults && docno) {
-                        fprintf(stderr, "failed to add to treceval results\n");
-                        free(results);
-                        free(querynum);
-                        free(docno);
-                        free(query);
-                        mlparse_wrap_delete(parser);
-                        return 0;
-                    } else {
-                        /* couldn't copy the docno */
-                        fprintf(stderr, "docno ('%s') copy failed: %s\n", 
-                          results[i].auxilliary, strerror(errno));
+
+                    if (!output_results(args, output, teresults, querynum, 
+                        results, returned)) {
                         free(query);
                         free(results);
                         free(querynum);
                         mlparse_wrap_delete(parser);
                         return 0;
                     }
+                } else {
+                    /* error searching */
+                    fprintf(stderr, "error searching index\n");
+                    free(query);
+                    mlparse_wrap_delete(parser);
+                    return 0;
                 }
-
-                if (returned == 0 && args->dummy) {
-                    /* no results, insert dummy result if requested */
-                    fprintf(output, "%s\tQ0\t%s\t%u\t%f\t%s\n", querynum,    
-                      "XXXX-XXX-XXXXXXX", 1, 0.0, args->run_id);
-                }
-            } else {
-                /* error searching */
-                fprintf(stderr, "error searching index\n");
-                free(query);
-                mlparse_wrap_delete(parser);
-                return 0;
             }
 
             free(query);
@@ -1125,6 +1378,12 @@ static int process_topic_file(FILE *fp, struct args *args, FILE *output,
             mlparse_wrap_delete(parser);
             return 0;
         }
+        if (args->pool && !output_pool_results(args, output, teresults, results, 0)) {
+            free(results);
+            free(querynum);
+            mlparse_wrap_delete(parser);
+            return 0;
+        }
         free(results);
         free(querynum);
 
@@ -18,6 +18,20 @@
 #include <string.h>
 #include <limits.h>
 
+/* internal functions to convert bounding scores to and from fixed point,
+ * rounding up (so that decoded scores are never less than the originals) */
+static unsigned long int score_encode(float score) {
+    if (score > 0.0F) {
+        return (unsigned long int) (score * VOCAB_BOUNDS_SCALE) + 1;
+    } else {
+        return 0;
+    }
+}
+
+static float score_decode(unsigned long int score) {
+    return score / VOCAB_BOUNDS_SCALE;
+}
+
 unsigned int vocab_len(struct vocab_vector *vocab) {
     unsigned int len = 1;   /* 1 for combination of attr, type and location */
 
@@ -36,6 +50,24 @@ unsigned int vocab_len(struct vocab_vector *vocab) {
         break;
 
     case VOCAB_VTYPE_IMPACT:
+    case VOCAB_VTYPE_IMPACT_BLOCK:
+        break;
+
+    case VOCAB_VTYPE_DOCWP_SKIP:
+        len += vec_vbyte_len(vocab->header.docwp_skip.skipsize);
+        break;
+
+    case VOCAB_VTYPE_DOCWP_SEP:
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        len += vec_vbyte_len(vocab->header.docwp_sep.skipsize)
+          + vec_vbyte_len(vocab->header.docwp_sep.docsize);
+        break;
+
+    case VOCAB_VTYPE_BOUNDS:
+        len += vec_vbyte_len(vocab->header.bounds.max_fdt)
+          + vec_vbyte_len(vocab->header.bounds.interval)
+          + vec_vbyte_len(score_encode(vocab->header.bounds.okapi))
+          + vec_vbyte_len(score_encode(vocab->header.bounds.dirichlet));
         break;
 
     default: return 0;
@@ -130,6 +162,62 @@ enum vocab_ret vocab_decode(struct vocab_vector *vocab, struct vec *v) {
             break;
 
         case VOCAB_VTYPE_IMPACT:
+        case VOCAB_VTYPE_IMPACT_BLOCK:
+            break;
+
+        case VOCAB_VTYPE_DOCWP_SKIP:
+            if ((ret = vec_vbyte_read(v, &vocab->header.docwp_skip.skipsize))) {
+                bytes += ret;
+            } else {
+                if (((unsigned int) VEC_LEN(v)) <= vec_vbyte_len(UINT_MAX)) {
+                    v->pos -= bytes;
+                    return VOCAB_ENOSPC;
+                } else {
+                    v->pos -= bytes;
+                    return VOCAB_EOVERFLOW;
+                }
+            }
+            break;
+
+        case VOCAB_VTYPE_DOCWP_SEP:
+        case VOCAB_VTYPE_DOCWP_BLOCK:
+            if ((ret = vec_vbyte_read(v, &vocab->header.docwp_sep.skipsize))
+              && (bytes += ret)
+              && (ret = vec_vbyte_read(v, &vocab->header.docwp_sep.docsize))
+              && (bytes += ret)) {
+                /* succeeded, do nothing */
+            } else {
+                if (((unsigned int) VEC_LEN(v)) <= vec_vbyte_len(UINT_MAX)) {
+                    v->pos -= bytes;
+                    return VOCAB_ENOSPC;
+                } else {
+                    v->pos -= bytes;
+                    return VOCAB_EOVERFLOW;
+                }
+            }
+            break;
+
+        case VOCAB_VTYPE_BOUNDS:
+            if ((ret = vec_vbyte_read(v, &vocab->header.bounds.max_fdt))
+              && (bytes += ret)
+              && (ret = vec_vbyte_read(v, &vocab->header.bounds.interval))
+              && (bytes += ret)
+              && (ret = vec_vbyte_read(v, &tmp))
+              && ((vocab->header.bounds.okapi = score_decode(tmp)), 
+                (bytes += ret))
+              && (ret = vec_vbyte_read(v, &tmp))
+              && ((vocab->header.bounds.dirichlet = score_decode(tmp)), 
+                (bytes += ret))) {
+                /* succeeded, do nothing */
+            } else {
+                if (((unsigned int) VEC_LEN(v)) <= vec_vbyte_len(UINT_MAX)) {
+                    v->pos -= bytes;
+                    return VOCAB_ENOSPC;
+                } else {
+                    v->pos -= bytes;
+                    return VOCAB_EOVERFLOW;
+                }
+            }
             break;
 
         default: 
@@ -228,6 +316,50 @@ enum vocab_ret vocab_encode(struct vocab_vector *vocab, struct vec *v) {
             break;
 
         case VOCAB_VTYPE_IMPACT:
+        case VOCAB_VTYPE_IMPACT_BLOCK:
+            break;
+
+        case VOCAB_VTYPE_DOCWP_SKIP:
+            if ((ret 
+              = vec_vbyte_write(v, vocab->header.docwp_skip.skipsize))) {
+                bytes += ret;
+            } else {
+                v->pos -= bytes;
+                return VOCAB_ENOSPC;
+            }
+            break;
+
+        case VOCAB_VTYPE_DOCWP_SEP:
+        case VOCAB_VTYPE_DOCWP_BLOCK:
+            if ((ret 
+                = vec_vbyte_write(v, vocab->header.docwp_sep.skipsize))
+              && (bytes += ret)
+              && (ret 
+                = vec_vbyte_write(v, vocab->header.docwp_sep.docsize))
+              && (bytes += ret)) {
+                /* succeeded, do nothing */
+            } else {
+                v->pos -= bytes;
+                return VOCAB_ENOSPC;
+            }
+            break;
+
+        case VOCAB_VTYPE_BOUNDS:
+            if ((ret = vec_vbyte_write(v, vocab->header.bounds.max_fdt))
+              && (bytes += ret)
+              && (ret = vec_vbyte_write(v, vocab->header.bounds.interval))
+              && (bytes += ret)
+              && (ret = vec_vbyte_write(v, 
+                  score_encode(vocab->header.bounds.okapi)))
+              && (bytes += ret)
+              && (ret = vec_vbyte_write(v, 
+                  score_encode(vocab->header.bounds.dirichlet)))
+              && (bytes += ret)) {
+                /* succeeded, do nothing */
+            } else {
+                v->pos -= bytes;
+                return VOCAB_ENOSPC;
+            }
             break;
 
         default: 
@@ -281,7 +413,15 @@ unsigned long int vocab_docs(struct vocab_vector *vocab) {
     case VOCAB_VTYPE_DOCWP:
         return vocab->header.docwp.docs;
     case VOCAB_VTYPE_IMPACT:
+    case VOCAB_VTYPE_IMPACT_BLOCK:
         return vocab->header.impact.docs;
+    case VOCAB_VTYPE_DOCWP_SKIP:
+        return vocab->header.docwp_skip.docs;
+    case VOCAB_VTYPE_DOCWP_SEP:
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        return vocab->header.docwp_sep.docs;
+    case VOCAB_VTYPE_BOUNDS:
+        return vocab->header.bounds.docs;
     default:
         assert("shouldn't happen");
         return 0;
@@ -295,7 +435,15 @@ unsigned long int vocab_occurs(struct vocab_vector *vocab) {
     case VOCAB_VTYPE_DOCWP:
         return vocab->header.docwp.occurs;
     case VOCAB_VTYPE_IMPACT:
+    case VOCAB_VTYPE_IMPACT_BLOCK:
         return vocab->header.impact.occurs;
+    case VOCAB_VTYPE_DOCWP_SKIP:
+        return vocab->header.docwp_skip.occurs;
+    case VOCAB_VTYPE_DOCWP_SEP:
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        return vocab->header.docwp_sep.occurs;
+    case VOCAB_VTYPE_BOUNDS:
+        return vocab->header.bounds.occurs;
     default:
         assert("shouldn't happen");
         return 0;
@@ -309,9 +457,28 @@ unsigned long int vocab_last(struct vocab_vector *vocab) {
     case VOCAB_VTYPE_DOCWP:
         return vocab->header.docwp.last;
     case VOCAB_VTYPE_IMPACT:
+    case VOCAB_VTYPE_IMPACT_BLOCK:
         return vocab->header.impact.last;
+    case VOCAB_VTYPE_DOCWP_SKIP:
+        return vocab->header.docwp_skip.last;
+    case VOCAB_VTYPE_DOCWP_SEP:
+    case VOCAB_VTYPE_DOCWP_BLOCK:
+        return vocab->header.docwp_sep.last;
+    case VOCAB_VTYPE_BOUNDS:
+        return vocab->header.bounds.last;
     default:
         assert("shouldn't happen");
         return 0;
     }
 }
+
+enum vocab_ret vocab_bounds(struct vocab_vector *bounds, struct vec *v) {
+    enum vocab_ret ret;
+
+    while ((ret = vocab_decode(bounds, v)) == VOCAB_OK) {
+        if (bounds->type == VOCAB_VTYPE_BOUNDS) {
+            return VOCAB_OK;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,74 @@
+/* boundify.c adds upper bounds on the scores of postings to the vocabulary of
+ * an index (see bound_build.h).
+ */
+
+#include "firstinclude.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+#include "bound_build.h"
+#include "error.h"
+
+static void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s [--k1 <value>] [--b <value>] [--mu <value>] "
+      "<index-prefix>\n", progname);
+    fprintf(stderr, "  (okapi k1 and b default to %g and %g, dirichlet mu "
+      "defaults to %g)\n", BOUND_DEFAULT_K1, BOUND_DEFAULT_B,
+      BOUND_DEFAULT_MU);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char ** argv) {
+    char * name = NULL;
+    double k1 = BOUND_DEFAULT_K1,
+           b = BOUND_DEFAULT_B,
+           mu = BOUND_DEFAULT_MU,
+           *param;
+    char *end;
+    int i;
+    enum bound_ret bound_ret;
+    struct index * index;
+    struct index_load_opt lopt;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--k1")) {
+            param = &k1;
+        } else if (!strcmp(argv[i], "--b")) {
+            param = &b;
+        } else if (!strcmp(argv[i], "--mu")) {
+            param = &mu;
+        } else if (!name) {
+            name = argv[i];
+            continue;
+        } else {
+            usage(argv[0]);
+        }
+
+        if ((++i >= argc) || ((*param = strtod(argv[i], &end)), *end)
+          || (end == argv[i])) {
+            usage(argv[0]);
+        }
+    }
+    if (!name) {
+        usage(argv[0]);
+    }
+
+    memset(&lopt, 0, sizeof(lopt));
+
+    index = index_load(name, 0, INDEX_LOAD_NOOPT, &lopt);
+    if (index == NULL) {
+        fprintf(stderr, "Error loading index with prefix '%s'\n", name);
+        exit(EXIT_FAILURE);
+    }
+    bound_ret = bound_build_index(index, k1, b, mu);
+    if (bound_ret != BOUND_OK) {
+        ERROR1("computing score bounds for %s failed", name);
+        exit(EXIT_FAILURE);
+    }
+    index_delete(index);
+    return EXIT_SUCCESS;
+}
+
@@ -17,12 +17,14 @@
 #include "_index.h"
 #include "docmap.h"
 #include "getlongopt.h"
+#include "impactcodec.h"
 #include "iobtree.h"
 #include "str.h"
 #include "vec.h"
 #include "vocab.h"
 #include "fdset.h"
 #include "bucket.h"
+#include "skip_build.h"
 
 int cat_vocab(FILE *output, struct index *idx, int verbose) {
     unsigned int state[3] = {0, 0, 0};
@@ -206,14 +208,29 @@ int cat_index(FILE *output, struct index *idx, int verbose) {
             case VOCAB_VTYPE_DOCWP:
                 fprintf(output, " docwp");
                 break;
+            case VOCAB_VTYPE_DOCWP_SKIP:
+                fprintf(output, " docwp_skip");
+                break;
+            case VOCAB_VTYPE_DOCWP_SEP:
+                fprintf(output, " docwp_sep");
+                break;
+            case VOCAB_VTYPE_DOCWP_BLOCK:
+                fprintf(output, " docwp_block");
+                break;
             case VOCAB_VTYPE_IMPACT:
                 fprintf(output, " impact");
                 break;
+            case VOCAB_VTYPE_IMPACT_BLOCK:
+                fprintf(output, " impact_block");
+                break;
+            case VOCAB_VTYPE_BOUNDS:
+                fprintf(output, " bounds");
+                break;
             }
             
             switch (vocab.location) {
             case VOCAB_LOCATION_VOCAB:
-                v.pos = ((char *) addr) + vocab_len(&vocab) - vocab.size;
+                v.pos = vocab.loc.vocab.vec;
                 v.end = v.pos + vocab.size;
                 buf = NULL;
 
@@ -256,6 +273,29 @@ int cat_index(FILE *output, struct index *idx, int verbose) {
 
             /* decode vector */
             fprintf(output, ":");
+            if (vocab.type == VOCAB_VTYPE_DOCWP_SKIP) {
+                /* pass over skip table to get to the postings */
+                v.pos += vocab.header.docwp_skip.skipsize;
+                vocab.type = VOCAB_VTYPE_DOCWP;
+            } else if ((vocab.type == VOCAB_VTYPE_DOCWP_SEP)
+              || (vocab.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
+                /* put word positions back after each (vbyte) posting */
+                char *plain = malloc(skip_docwp_bound(&vocab));
+
+                if (!plain || skip_docwp(&vocab, v.pos, plain) != SKIP_OK) {
+                    fprintf(stderr, "error interleaving word positions\n");
+                    free(plain);
+                    if (buf) {
+                        free(buf);
+                    }
+                    return 0;
+                }
+                if (buf) {
+                    free(buf);
+                }
+                buf = v.pos = plain;
+                v.end = v.pos + vocab.size;
+            }
             if (vocab.type == VOCAB_VTYPE_DOC 
               || vocab.type == VOCAB_VTYPE_DOCWP) {
                 docno = 0;
@@ -318,6 +358,45 @@ int cat_index(FILE *output, struct index *idx, int verbose) {
                     }
                     fprintf(output, " ])");
                 }
+            } else if (vocab.type == VOCAB_VTYPE_IMPACT_BLOCK) {
+                unsigned long int docno,
+                                  blocksize = 0,
+                                  impact;
+                uint32_t docnos[IMPACTCODEC_CHUNK];
+                unsigned int n;
+
+                while (VEC_LEN(&v)) {
+                    docno = -1;
+                    vec_vbyte_read(&v, &blocksize);
+                    vec_vbyte_read(&v, &impact);
+                    fprintf(output, " (%ld %ld [", impact, blocksize);
+                    while (blocksize 
+                      && (n = impactcodec_read(&v, 
+                          blocksize < IMPACTCODEC_CHUNK 
+                            ? blocksize : IMPACTCODEC_CHUNK, 
+                          &docno, docnos))) {
+                        for (i = 0; i < n; i++) {
+                            fprintf(output, " %lu", (unsigned long int) 
+                              docnos[i]);
+                        }
+                        blocksize -= n;
+                    }
+                    fprintf(output, " ])");
+                    if (blocksize) {
+                        fprintf(output, " (truncated chunk!)");
+                        break;
+                    }
+                }
+            } else if (vocab.type == VOCAB_VTYPE_BOUNDS) {
+                unsigned long int blockmax;
+
+                fprintf(output, " (max %lu okapi %g dirichlet %g [", 
+                  vocab.header.bounds.max_fdt, vocab.header.bounds.okapi,
+                  vocab.header.bounds.dirichlet);
+                while (vec_vbyte_read(&v, &blockmax)) {
+                    fprintf(output, " %lu", blockmax);
+                }
+                fprintf(output, " ])");
             }
 
             if (buf) {
@@ -0,0 +1,308 @@
+/* codectime.c is a small program to time decoding of the document numbers
+ * and frequencies of document ordered lists using vbyte coding (vec.h)
+ * against block coding (blockcodec.h).  The postings of every document
+ * ordered list in the given index are extracted (whatever way the index
+ * stores them) and coded both ways into memory, then each is decoded a
+ * number of times, summing the document numbers and frequencies to check
+ * that both decode the same thing.
+ *
+ */
+
+#include "firstinclude.h"
+
+#include "def.h"
+#include "index.h"
+#include "_index.h"
+#include "blockcodec.h"
+#include "fdset.h"
+#include "iobtree.h"
+#include "skip_build.h"
+#include "vec.h"
+#include "vocab.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* coded postings of all of the lists in an index */
+struct lists {
+    unsigned int count;              /* number of lists */
+    unsigned int size;               /* capacity of lists */
+    unsigned long int *docs;         /* number of postings in each list */
+    unsigned long int postings;      /* total number of postings */
+    struct vec vbyte;                /* vbyte coded postings */
+    unsigned long int vbytelen;      /* length of vbyte coded postings */
+    struct vec block;                /* block coded postings */
+    unsigned long int blocklen;      /* length of block coded postings */
+};
+
+/* ensure that v has at least len bytes available after v->pos, given that it
+ * was allocated at start */
+static int reserve(struct vec *v, char **start, unsigned long int *cap,
+  unsigned long int len) {
+    unsigned long int pos = v->pos - *start;
+
+    if (VEC_LEN(v) < len) {
+        void *ptr;
+
+        while (*cap - pos < len) {
+            *cap = *cap * 2 + len;
+        }
+        if (!(ptr = realloc(*start, *cap))) {
+            return 0;
+        }
+        *start = ptr;
+        v->pos = *start + pos;
+        v->end = *start + *cap;
+    }
+    return 1;
+}
+
+/* add the plain VOCAB_VTYPE_DOCWP postings for docs documents in the len
+ * bytes at vec to lists, coded both ways */
+static int add_list(struct lists *lists, char *vec, unsigned int len,
+  unsigned long int docs, char **vbyte, unsigned long int *vbytecap,
+  char **block, unsigned long int *blockcap) {
+    uint32_t ints[BLOCKCODEC_INTS];
+    unsigned long int docno_d,
+                      f_dt,
+                      d;
+    unsigned int n = 0,
+                 bytes;
+    struct vec in;
+
+    if (lists->count == lists->size) {
+        void *ptr = realloc(lists->docs,
+            sizeof(*lists->docs) * (lists->size * 2 + 1));
+
+        if (!ptr) {
+            return 0;
+        }
+        lists->docs = ptr;
+        lists->size = lists->size * 2 + 1;
+    }
+
+    /* postings never get longer when their offsets are removed, and block
+     * coding adds a control byte per four numbers and a small header per
+     * block */
+    if (!reserve(&lists->vbyte, vbyte, vbytecap, len)
+      || !reserve(&lists->block, block, blockcap,
+          len + docs + (docs / BLOCKCODEC_POSTINGS + 1)
+            * (1 + 2 * VEC_VBYTE_MAX))) {
+        return 0;
+    }
+
+    in.pos = vec;
+    in.end = vec + len;
+    for (d = 0; d < docs; d++) {
+        if (vec_vbyte_read(&in, &docno_d) && vec_vbyte_read(&in, &f_dt)
+          && (vec_vbyte_scan(&in, f_dt, &bytes) == f_dt)) {
+            vec_vbyte_write(&lists->vbyte, docno_d);
+            vec_vbyte_write(&lists->vbyte, f_dt);
+            ints[n++] = docno_d;
+            ints[n++] = f_dt;
+            if ((n == BLOCKCODEC_INTS) || (d + 1 == docs)) {
+                if (!blockcodec_write(&lists->block, ints, n)) {
+                    return 0;
+                }
+                n = 0;
+            }
+        } else {
+            return 0;
+        }
+    }
+
+    lists->docs[lists->count++] = docs;
+    lists->postings += docs;
+    return 1;
+}
+
+/* extract the postings of every document ordered list in idx into lists */
+static int load_lists(struct index *idx, struct lists *lists) {
+    unsigned int state[3] = {0, 0, 0},
+                 termlen,
+                 len;
+    unsigned long int vbytecap = 0,
+                      blockcap = 0;
+    char *vbyte = NULL,
+         *block = NULL,
+         *vec = NULL,
+         *plain = NULL;
+    const char *term;
+    void *data;
+    struct vocab_vector vv;
+    struct vec v;
+    int fd,
+        ok = 1;
+
+    lists->vbyte.pos = lists->vbyte.end = NULL;
+    lists->block.pos = lists->block.end = NULL;
+    while (ok
+      && (term = iobtree_next_term(idx->vocab, state, &termlen, &data,
+          &len))) {
+        v.pos = data;
+        v.end = v.pos + len;
+        while (ok && (vocab_decode(&vv, &v) == VOCAB_OK)) {
+            if ((vv.type != VOCAB_VTYPE_DOCWP)
+              && (vv.type != VOCAB_VTYPE_DOCWP_SKIP)
+              && (vv.type != VOCAB_VTYPE_DOCWP_SEP)
+              && (vv.type != VOCAB_VTYPE_DOCWP_BLOCK)) {
+                continue;
+            }
+
+            free(vec);
+            free(plain);
+            plain = NULL;
+            if (!(vec = malloc(vv.size))) {
+                ok = 0;
+            } else if (vv.location == VOCAB_LOCATION_VOCAB) {
+                memcpy(vec, vv.loc.vocab.vec, vv.size);
+            } else if ((fd = fdset_pin(idx->fd, idx->index_type,
+                vv.loc.file.fileno, vv.loc.file.offset, SEEK_SET)) >= 0) {
+                ok = (index_atomic_read(fd, vec, vv.size)
+                  == (ssize_t) vv.size);
+                fdset_unpin(idx->fd, idx->index_type, vv.loc.file.fileno,
+                  fd);
+            } else {
+                ok = 0;
+            }
+
+            ok = ok
+              && (plain = malloc(skip_docwp_bound(&vv)))
+              && (skip_docwp(&vv, vec, plain) == SKIP_OK)
+              && add_list(lists, plain, vv.size, vocab_docs(&vv), &vbyte,
+                  &vbytecap, &block, &blockcap);
+        }
+    }
+
+    free(vec);
+    free(plain);
+    lists->vbytelen = lists->vbyte.pos - vbyte;
+    lists->vbyte.pos = vbyte;
+    lists->vbyte.end = vbyte + lists->vbytelen;
+    lists->blocklen = lists->block.pos - block;
+    lists->block.pos = block;
+    lists->block.end = block + lists->blocklen;
+    if (!ok) {
+        fprintf(stderr, "failed to extract list for term '%.*s'\n",
+          (int) termlen, term);
+    }
+    return ok;
+}
+
+/* decode all vbyte coded lists, returning a checksum */
+static unsigned long int decode_vbyte(struct lists *lists) {
+    unsigned long int sum = 0,
+                      docno,
+                      docno_d,
+                      f_dt,
+                      d;
+    unsigned int i;
+    struct vec v = lists->vbyte;
+
+    for (i = 0; i < lists->count; i++) {
+        docno = -1;
+        for (d = 0; d < lists->docs[i]; d++) {
+            vec_vbyte_read(&v, &docno_d);
+            vec_vbyte_read(&v, &f_dt);
+            docno += docno_d + 1;
+            sum += docno + f_dt;
+        }
+    }
+    return sum;
+}
+
+/* decode all block coded lists, returning a checksum */
+static unsigned long int decode_block(struct lists *lists) {
+    unsigned long int sum = 0,
+                      docno,
+                      d;
+    unsigned int i,
+                 j,
+                 n;
+    struct blockcodec_block blk;
+    struct vec v = lists->block;
+
+    for (i = 0; i < lists->count; i++) {
+        docno = -1;
+        for (d = 0; d < lists->docs[i]; d += n / 2) {
+            n = blockcodec_read(&v, blk.ints);
+            assert(n);
+            for (j = 0; j < n; j += 2) {
+                docno += blk.ints[j] + 1;
+                sum += docno + blk.ints[j + 1];
+            }
+        }
+    }
+    return sum;
+}
+
+/* time reps decodes using fn, printing the results */
+static unsigned long int time_decode(const char *name,
+  unsigned long int (*fn)(struct lists *lists), struct lists *lists,
+  unsigned long int bytes, unsigned int reps) {
+    struct timeval now,
+                   then;
+    unsigned long int sum = 0;
+    unsigned int i;
+    double micros;
+
+    gettimeofday(&then, NULL);
+    for (i = 0; i < reps; i++) {
+        sum += fn(lists);
+    }
+    gettimeofday(&now, NULL);
+    micros = (now.tv_sec - then.tv_sec) * 1000000.0
+      + (now.tv_usec - then.tv_usec);
+    micros += !micros;
+
+    printf("%s: %lu bytes, %.0f microseconds, %.1f MB/s, "
+      "%.1f million postings/s\n", name, bytes, micros,
+      reps * (double) bytes / micros,
+      reps * (double) lists->postings / micros);
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    struct index *idx;
+    struct lists lists = {0, 0, NULL, 0};
+    unsigned int reps = 10;
+    unsigned long int vsum,
+                      bsum;
+
+    if ((argc < 2) || (argc > 3)
+      || ((argc == 3) && !(reps = strtoul(argv[2], NULL, 10)))) {
+        fprintf(stderr, "usage: %s index [repetitions]\n", *argv);
+        return EXIT_FAILURE;
+    }
+
+    if (!(idx = index_load(argv[1], MEMORY_DEFAULT, INDEX_LOAD_NOOPT, NULL))) {
+        fprintf(stderr, "failed to load index '%s'\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if (!load_lists(idx, &lists)) {
+        index_delete(idx);
+        return EXIT_FAILURE;
+    }
+    index_delete(idx);
+
+    printf("%u lists, %lu postings, %u repetitions\n", lists.count,
+      lists.postings, reps);
+    vsum = time_decode("vbyte", decode_vbyte, &lists, lists.vbytelen, reps);
+    bsum = time_decode("block", decode_block, &lists, lists.blocklen, reps);
+
+    free(lists.docs);
+    free(lists.vbyte.pos);
+    free(lists.block.pos);
+
+    if (vsum != bsum) {
+        fprintf(stderr, "checksums differ (%lu vs %lu)\n", vsum, bsum);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
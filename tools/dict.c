@@ -20,6 +20,15 @@
  *        Get the length in bytes of the inverted list for the
  *        term <term>
  *
+ *    bounds <term>
+ *        Get the upper bounds stored for the term <term> (see
+ *        bound_build.h): the largest f_dt, the largest okapi and 
+ *        dirichlet contributions, and the largest f_dt in each block 
+ *        of interval postings
+ *
+ *    vocab_size
+ *        Get the number of distinct terms in the vocab
+ *
  */
 
 #include "firstinclude.h"
@@ -148,6 +157,8 @@ static int print_veclen(FILE * stream, char * term, struct index * idx);
 
 static int print_vocab_size(FILE * stream, struct index * idx);
 
+static int print_bounds(FILE * stream, char * term, struct index * idx);
+
 static int do_query(char * query, struct index * idx) {
     char * args[QUERY_MAX_ARGS];
     int num_args = tokenize_query(query, args, QUERY_MAX_ARGS);
@@ -166,6 +177,13 @@ static int do_query(char * query, struct index * idx) {
         } else {
              print_veclen(stdout, args[1], idx);
         }
+    } else if (strcmp(args[0], "bounds") == 0) {
+        if (num_args != 2) {
+            fprintf(stderr, "'bounds' requires single term as argument\n");
+            return 1;
+        } else {
+            print_bounds(stdout, args[1], idx);
+        }
     } else if (strcmp(args[0], "vocab_size") == 0) {
         if (num_args != 1) {
             fprintf(stderr, "'vocab_size' takes no arguments\n");
@@ -199,7 +217,26 @@ static int get_vocab_vector(struct iobtree * vocab, char * term,
         return 0;
     v.pos = data;
     v.end = v.pos + veclen;
-    if (!(vocab_decode(vocab_vector, &v))) 
+    if (vocab_decode(vocab_vector, &v) != VOCAB_OK) 
+        return -1;
+    return 1;
+}
+
+static int get_bounds(struct iobtree * vocab, char * term,
+  struct vocab_vector * bounds) {
+    void * data;
+    unsigned int veclen;
+    struct vec v;
+    enum vocab_ret ret;
+
+    data = iobtree_find(vocab, term, strlen(term), 0, &veclen);
+    if (data == NULL)
+        return 0;
+    v.pos = data;
+    v.end = v.pos + veclen;
+    if ((ret = vocab_bounds(bounds, &v)) == VOCAB_END)
+        return 2;
+    else if (ret != VOCAB_OK)
         return -1;
     return 1;
 }
@@ -219,6 +256,35 @@ static int print_veclen(FILE * stream, char * term, struct index * idx) {
     return ret;
 }
 
+static int print_bounds(FILE * stream, char * term, struct index * idx) {
+    struct vocab_vector bounds;
+    struct vec v;
+    unsigned long int blockmax;
+    int ret;
+
+    if ( (ret = get_bounds(idx->vocab, term, &bounds)) == 1) {
+        fprintf(stream, "max_fdt %lu okapi %g dirichlet %g", 
+          bounds.header.bounds.max_fdt, bounds.header.bounds.okapi, 
+          bounds.header.bounds.dirichlet);
+        if (bounds.header.bounds.interval) {
+            fprintf(stream, " interval %lu:", bounds.header.bounds.interval);
+            v.pos = bounds.loc.vocab.vec;
+            v.end = v.pos + bounds.size;
+            while (vec_vbyte_read(&v, &blockmax)) {
+                fprintf(stream, " %lu", blockmax);
+            }
+        }
+        fprintf(stream, "\n");
+    } else if (ret == 2) {
+        fprintf(stream, "none\n");
+    } else if (ret == 0) {
+        fprintf(stream, "-1\n");
+    } else {
+        fprintf(stderr, "Error reading vocab entry for '%s'\n", term);
+    }
+    return ret;
+}
+
 static int tokenize_query(char * query, char ** args, int args_size) {
     char * qp = query;
     int num_args = 0;
@@ -117,7 +117,10 @@ static int vvdiff(struct index *one, struct index *two, struct vec *vone,
     while ((ret = vocab_decode(&vv1, &list1)) == VOCAB_OK) {
         entries1++;
 
-        if ((vv1.type == VOCAB_VTYPE_DOCWP) || (vv1.type == VOCAB_VTYPE_DOC)) {
+        if ((vv1.type == VOCAB_VTYPE_DOCWP) || (vv1.type == VOCAB_VTYPE_DOC)
+          || (vv1.type == VOCAB_VTYPE_DOCWP_SKIP)
+          || (vv1.type == VOCAB_VTYPE_DOCWP_SEP)
+          || (vv1.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
             docs1 += vv1.header.doc.docs;
             occurs1 += vv1.header.doc.occurs;
             if (last1 < vv1.header.doc.last) {
@@ -137,7 +140,10 @@ static int vvdiff(struct index *one, struct index *two, struct vec *vone,
     entries2 = 0;
     while ((ret = vocab_decode(&vv2, &list2)) == VOCAB_OK) {
         entries2++;
-        if ((vv2.type == VOCAB_VTYPE_DOCWP) || (vv2.type == VOCAB_VTYPE_DOC)) {
+        if ((vv2.type == VOCAB_VTYPE_DOCWP) || (vv2.type == VOCAB_VTYPE_DOC)
+          || (vv2.type == VOCAB_VTYPE_DOCWP_SKIP)
+          || (vv2.type == VOCAB_VTYPE_DOCWP_SEP)
+          || (vv2.type == VOCAB_VTYPE_DOCWP_BLOCK)) {
             docs2 += vv2.header.doc.docs;
             occurs2 += vv2.header.doc.occurs;
             if (last2 < vv2.header.doc.last) {
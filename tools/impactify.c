@@ -13,30 +13,66 @@
 #include "impact_build.h"
 #include "error.h"
 
+static void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s [--threads <number>] [--codec <vbyte|block>] "
+      "<index-prefix>\n", progname);
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char ** argv) {
-    char * name;
+    char * name = NULL;
     /* will be options later. */
     /*double pivot = DEFAULT_PIVOT;
     double slope = DEFAULT_SLOPE;
     unsigned int quant_bits = DEFAULT_QUANT_BITS; */
+    unsigned long int threads = 1;
+    char *end,
+         *codec = NULL;
+    int i;
     enum impact_ret impact_ret;
     struct index * index;
     struct index_load_opt lopt;
+    struct index_stats stats;
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <index-prefix>\n", argv[0]);
-        exit(EXIT_FAILURE);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads")) {
+            if ((++i >= argc)
+              || ((threads = strtoul(argv[i], &end, 10)), *end)
+              || (end == argv[i]) || !threads) {
+                usage(argv[0]);
+            }
+        } else if (!strcmp(argv[i], "--codec")) {
+            if ((++i >= argc) 
+              || (strcmp(argv[i], "vbyte") && strcmp(argv[i], "block"))) {
+                usage(argv[0]);
+            }
+            codec = argv[i];
+        } else if (!name) {
+            name = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!name) {
+        usage(argv[0]);
     }
 
     memset(&lopt, 0, sizeof(lopt));
 
-    name = argv[1];
     index = index_load(name, 0, INDEX_LOAD_NOOPT, &lopt);
     if (index == NULL) {
         fprintf(stderr, "Error loading index with prefix '%s'\n", name);
         exit(EXIT_FAILURE);
     }
-    impact_ret = impact_order_index(index);
+    /* code impact ordered lists the same way as document ordered ones, 
+     * unless told otherwise */
+    if (!codec && !index_stats(index, &stats)) {
+        fprintf(stderr, "Error getting statistics for index '%s'\n", name);
+        exit(EXIT_FAILURE);
+    }
+    impact_ret = impact_order_index(index, threads, 
+      codec ? (strcmp(codec, "block") ? INDEX_CODEC_VBYTE : INDEX_CODEC_BLOCK)
+        : stats.list_codec);
     if (impact_ret != IMPACT_OK) {
         ERROR1("impactification of %s failed", name);
         exit(EXIT_FAILURE);